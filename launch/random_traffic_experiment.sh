@@ -11,6 +11,10 @@ experiment_time=0.0
 experiment_timeout=0
 max_experiment_time=3600.0
 
+# Every episode is seeded, so that it can be replayed with
+# roslaunch ... scenario_seed:=<seed>.
+scenario_seed=0
+
 while [ $experiment_timeout -le 0 ]; do
   # Start the carla server.
   echo "Start carla server."
@@ -18,9 +22,10 @@ while [ $experiment_timeout -le 0 ]; do
   sleep 10
 
   # Start the ros clients.
-  echo "Start ROS nodes."
+  echo "Start ROS nodes with scenario seed $scenario_seed."
   roslaunch conformal_lattice_planner autonomous_driving.launch \
     random_traffic:=true \
+    scenario_seed:=$scenario_seed \
     $method:=true \
     agents_lane_follower:=true \
     record_bags:=true&
@@ -47,6 +52,7 @@ while [ $experiment_timeout -le 0 ]; do
   experiment_timeout=$(echo "$experiment_time>$max_experiment_time" | bc -l)
   episode_time=0.0
   episode_timeout=0
+  scenario_seed=$((scenario_seed+1))
 
   # Kill all ROS nodes in case some nodes has not died yet.
   echo "Stop all ROS nodes"
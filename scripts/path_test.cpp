@@ -1,18 +1,193 @@
+/*
+ * Micro-benchmark of the Kelly-Nagy path optimization.
+ *
+ * The optimization in src/planner/common/kn_path_gen.h is compared against
+ * the original implementation kept in path_optimization.h, which integrates
+ * with dynamically allocated arrays. The iterations taken from the heuristic
+ * initial guess, the warm start table, and the solution of the previous
+ * planning cycle are compared as well. Build with, e.g.
+ *
+ *   g++ -O2 -std=c++14 -I../src -I/usr/include/eigen3 path_test.cpp -o path_test -lboost_timer
+ */
 
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <stdexcept>
+#include <vector>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <random>
+#include <ostream>
+#include <stdexcept>
+#include <Eigen/Dense>
 
 #include <boost/format.hpp>
+#include <boost/timer/timer.hpp>
+
+// The original implementation, which shares the namespace, the class name,
+// and the include guard with kn_path_gen.h.
+namespace reference {
 #include "path_optimization.h"
+} // End namespace reference.
+#undef KN_PATH_GEN_KN_PATH_GEN_H
+
+#include <planner/common/kn_path_gen.h>
+#include <planner/common/path_warm_start_table.h>
 
 using namespace planner;
 using namespace std;
 
+namespace {
+
+// Count the heap allocations so that the allocation-free kernel can be checked.
+size_t allocations = 0;
+
+} // End anonymous namespace.
+
+void* operator new(size_t size) {
+  ++allocations;
+  void* ptr = std::malloc(size);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+/// Lane keeping and lane changing queries similar to the ones made by the planners.
+std::vector<std::pair<NonHolonomicPath::State, NonHolonomicPath::State>> queries() {
+  std::vector<std::pair<NonHolonomicPath::State, NonHolonomicPath::State>> queries;
+  for (int i = 0; i < 20; ++i) {
+    const double kappa0 = 0.002 * (i%5) - 0.004;
+    for (const double range : {20.0, 30.0, 50.0}) {
+      for (const double offset : {-3.7, -0.2, 0.2, 3.7}) {
+        queries.emplace_back(
+            NonHolonomicPath::State(0.0, 0.0, 0.0, kappa0),
+            NonHolonomicPath::State(range, offset, 0.01*(i%3), 0.0));
+      }
+    }
+  }
+  return queries;
+}
+
+template<typename Path, typename State>
+double benchmark(const std::vector<std::pair<
+                   NonHolonomicPath::State, NonHolonomicPath::State>>& queries,
+                 const size_t repeats,
+                 std::vector<Path>& paths,
+                 size_t& failures) {
+  paths.assign(queries.size(), Path());
+  failures = 0;
+
+  boost::timer::cpu_timer timer;
+  for (size_t r = 0; r < repeats; ++r) {
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const State start(queries[i].first.x, queries[i].first.y,
+                        queries[i].first.theta, queries[i].first.kappa);
+      const State end(queries[i].second.x, queries[i].second.y,
+                      queries[i].second.theta, queries[i].second.kappa);
+      if (!paths[i].optimizePath(start, end)) ++failures;
+    }
+  }
+  return static_cast<double>(timer.elapsed().wall) * 1.0e-3 /
+         static_cast<double>(repeats * queries.size());
+}
+
+/// Histogram of the iterations, with the diverged optimizations in the last bin.
+class IterationHistogram {
+public:
+  void add(const bool success, const unsigned iterations) {
+    size_t bin = 0;
+    while (bin < kUpperBounds_.size() && iterations > kUpperBounds_[bin]) ++bin;
+    ++counts_[success ? bin : counts_.size()-1];
+    if (success) total_iterations_ += iterations;
+    ++total_;
+  }
+
+  void print(const std::string& name) const {
+    std::printf("%-10s", name.c_str());
+    for (const size_t count : counts_) std::printf(" %6lu", count);
+    const size_t converged = total_ - counts_.back();
+    std::printf("   mean: %5.2f\n",
+        converged ? static_cast<double>(total_iterations_)/converged : 0.0);
+  }
+
+  static void printHeader() {
+    std::printf("%-10s", "seed");
+    unsigned lower = 1;
+    for (const unsigned upper : kUpperBounds_) {
+      std::printf(" %6s", (boost::format("%1%-%2%") % lower % upper).str().c_str());
+      lower = upper+1;
+    }
+    std::printf(" %6s\n", "fail");
+  }
+
+private:
+  static const std::vector<unsigned> kUpperBounds_;
+  std::vector<size_t> counts_ = std::vector<size_t>(kUpperBounds_.size()+1, 0);
+  size_t total_iterations_ = 0;
+  size_t total_ = 0;
+};
+
+const std::vector<unsigned> IterationHistogram::kUpperBounds_{2, 4, 8, 16, 32, 64, 100};
+
+/// Compare the iterations taken with different initial guesses.
+void warmStartHistograms() {
+
+  boost::timer::cpu_timer timer;
+  const PathWarmStartTable table;
+  std::printf("\nwarm start table: %lu/%lu valid entries, generated in %.2fs\n",
+      table.validSize(), table.size(), timer.elapsed().wall*1.0e-9);
+
+  // Random lane keeping and lane changing paths, and the same paths
+  // in the next planning cycle, after the start moves forward by 1.5m.
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> dx_dist(5.0, 55.0);
+  std::uniform_real_distribution<double> dy_noise(-0.3, 0.3);
+  std::uniform_real_distribution<double> dtheta_dist(-0.3, 0.3);
+  std::uniform_real_distribution<double> kappa_dist(-0.04, 0.04);
+  const double offsets[] = {-3.5, 0.0, 3.5};
+
+  IterationHistogram heuristic, warm_start, previous;
+  for (size_t i = 0; i < 3000; ++i) {
+    const double dx = dx_dist(rng);
+    const double dy = offsets[i%3] + dy_noise(rng);
+    const double dtheta = dtheta_dist(rng);
+    const double kappa0 = kappa_dist(rng);
+    const double kappaf = kappa_dist(rng);
+
+    const NonHolonomicPath::State start(0.0, 0.0, 0.0, kappa0);
+    const NonHolonomicPath::State end(dx, dy, dtheta, kappaf);
+    const NonHolonomicPath::State next_end(dx-1.5, dy, dtheta, kappaf);
+
+    NonHolonomicPath path;
+    bool success = path.optimizePath(start, end);
+    heuristic.add(success, path.num_iterations);
+
+    NonHolonomicPath warm_path;
+    const bool warm_success = warm_path.optimizePath(
+        start, end, table.guess(dx, dy, dtheta, kappa0, kappaf));
+    warm_start.add(warm_success, warm_path.num_iterations);
+
+    // Only the edges solved in the "previous" cycle can be seeded.
+    if (!success) continue;
+    NonHolonomicPath next_path;
+    const bool next_success = next_path.optimizePath(start, next_end, path);
+    previous.add(next_success, next_path.num_iterations);
+  }
+
+  IterationHistogram::printHeader();
+  heuristic.print("heuristic");
+  warm_start.print("table");
+  previous.print("previous");
+  return;
+}
+
 int main(int argc, char** argv) {
 
+  // Make sure the lane change path used to fail can be optimized.
   NonHolonomicPath::State lc_start(14.254, 125.566, -96.9345/(2*M_PI), 0.0461623);
   NonHolonomicPath::State lc_end(12.2967, 75.585, -90.2891/(2*M_PI), 0.0);
 
@@ -36,6 +211,44 @@ int main(int argc, char** argv) {
     return -1;
   }
 
+  const size_t repeats = argc > 1 ? std::atoi(argv[1]) : 50;
+  const auto test_queries = queries();
+
+  // Check there is no heap allocation in a single optimization.
+  const size_t allocations_before = allocations;
+  path.optimizePath(test_queries.front().first, test_queries.front().second);
+  const size_t path_allocations = allocations - allocations_before;
+
+  std::vector<reference::planner::NonHolonomicPath> reference_paths;
+  std::vector<NonHolonomicPath> paths;
+  size_t reference_failures = 0, failures = 0;
+
+  const double reference_time = benchmark<
+    reference::planner::NonHolonomicPath,
+    reference::planner::NonHolonomicPath::State>(
+        test_queries, repeats, reference_paths, reference_failures);
+  const double time = benchmark<
+    NonHolonomicPath, NonHolonomicPath::State>(
+        test_queries, repeats, paths, failures);
+
+  // The two implementations should find the same paths.
+  double max_difference = 0.0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    max_difference = std::max(max_difference, std::fabs(paths[i].b -reference_paths[i].b));
+    max_difference = std::max(max_difference, std::fabs(paths[i].c -reference_paths[i].c));
+    max_difference = std::max(max_difference, std::fabs(paths[i].d -reference_paths[i].d));
+    max_difference = std::max(max_difference, std::fabs(paths[i].sf-reference_paths[i].sf));
+  }
+
+  std::printf("queries: %lu repeats: %lu\n", test_queries.size(), repeats);
+  std::printf("reference: %8.2fus/path failures: %lu\n",
+      reference_time, reference_failures/repeats);
+  std::printf("current:   %8.2fus/path failures: %lu heap allocations/path: %lu\n",
+      time, failures/repeats, path_allocations);
+  std::printf("speedup: %.2fx max coefficient difference: %g\n",
+      reference_time/time, max_difference);
+
+  warmStartHistograms();
+
   return 0;
 }
-
@@ -0,0 +1,75 @@
+#!/usr/bin/env python
+
+from __future__ import division
+from __future__ import print_function
+
+import struct
+import sys
+
+import numpy as np
+
+# Reader of the telemetry logs recorded by the simulator nodes.
+# See planner::TelemetryLog in src/planner/common/telemetry.h for the format.
+
+MAGIC = b'CLPTELEM'
+VERSION = 1
+NAME_LENGTH = 31
+
+def read_telemetry_log(filename):
+    """ Read a telemetry log.
+
+    Returns:
+        A numpy structured array with one element per record, whose fields
+        are the columns of the log, e.g. 'simulation_time' and 'ttc'.
+    """
+    with open(filename, 'rb') as f:
+        magic, version, num_columns = struct.unpack('<8sII', f.read(16))
+        if magic != MAGIC:
+            raise RuntimeError('{} is not a telemetry log.'.format(filename))
+        if version != VERSION:
+            raise RuntimeError('unsupported version {} of {}.'.format(version, filename))
+
+        columns = []
+        for _ in range(num_columns):
+            name, column_type = struct.unpack('<{}sc'.format(NAME_LENGTH), f.read(NAME_LENGTH+1))
+            name = name.rstrip(b'\0').decode('ascii')
+            columns.append((name, '<f8' if column_type == b'f' else '<i8'))
+        data_type = np.dtype(columns)
+
+        blocks = []
+        while True:
+            size_bytes = f.read(4)
+            if len(size_bytes) < 4: break
+            num, = struct.unpack('<I', size_bytes)
+            block_bytes = f.read(num*8*num_columns)
+            # The last block is truncated if the recording process is killed.
+            if len(block_bytes) < num*8*num_columns: break
+
+            block = np.zeros(num, dtype=data_type)
+            for i, (name, column_type) in enumerate(columns):
+                block[name] = np.frombuffer(block_bytes, dtype=column_type, count=num, offset=i*num*8)
+            blocks.append(block)
+
+        if not blocks: return np.zeros(0, dtype=data_type)
+        return np.concatenate(blocks)
+
+def main():
+
+    if len(sys.argv) < 2:
+        print('Usage: {} <telemetry log>'.format(sys.argv[0]))
+        return
+
+    data = read_telemetry_log(sys.argv[1])
+
+    print('records: ', data.size)
+    if data.size > 0:
+        print('simulation time: ', data['simulation_time'][-1]-data['simulation_time'][0])
+        print('average ego speed: ', np.mean(data['ego_speed']))
+        print('average planning time: ', np.mean(data['planning_time']))
+        print('max planning time: ', np.max(data['planning_time']))
+        ttc = data['ttc'][data['ttc'] >= 0.0]
+        if ttc.size > 0: print('min ttc: ', np.min(ttc))
+        print('collisions: ', np.sum(data['collisions']))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,130 @@
+#!/usr/bin/env python
+
+from __future__ import division
+from __future__ import print_function
+
+import struct
+import sys
+
+import numpy as np
+
+# Streaming reader of the traffic logs recorded by the simulator nodes.
+# See planner::TrafficLog in src/planner/common/traffic_log.h for the format.
+
+MAGIC = b'CLPTRLOG'
+VERSION = 1
+
+FIELDS = ['x', 'y', 'z', 'roll', 'pitch', 'yaw',
+          'speed', 'acceleration', 'curvature', 'policy_speed']
+RESOLUTIONS = np.array([1.0e-4, 1.0e-4, 1.0e-4,
+                        1.0e-4, 1.0e-4, 1.0e-4,
+                        1.0e-4, 1.0e-4, 1.0e-7, 1.0e-4])
+
+BOUNDING_BOX_FIELDS = ['extent_x', 'extent_y', 'extent_z',
+                       'location_x', 'location_y', 'location_z']
+
+VEHICLE_TYPE = np.dtype(
+    [('id', 'uint64')] +
+    [(f, 'float') for f in BOUNDING_BOX_FIELDS] +
+    [(f, 'float') for f in FIELDS])
+
+def read_traffic_log(filename):
+    """ Iterate through the records of a traffic log.
+
+    Only one record is kept in the memory at a time, so that logs of
+    hours long experiments can be processed.
+
+    Yields:
+        A tuple of the simulation time and a numpy array of VEHICLE_TYPE,
+        where the first vehicle is the ego and the rest are the agents
+        sorted by their IDs.
+    """
+    with open(filename, 'rb') as f:
+        magic, version, _ = struct.unpack('<8sII', f.read(16))
+        if magic != MAGIC:
+            raise RuntimeError('{} is not a traffic log.'.format(filename))
+        if version != VERSION:
+            raise RuntimeError('unsupported version {} of {}.'.format(version, filename))
+
+        ids = np.zeros(0, dtype='uint64')
+        states = np.zeros((0, len(FIELDS)), dtype='int64')
+        boxes = np.zeros((0, len(BOUNDING_BOX_FIELDS)))
+
+        while True:
+            size_bytes = f.read(4)
+            if len(size_bytes) < 4: break
+            size, = struct.unpack('<I', size_bytes)
+            record = f.read(size)
+            # The last record is truncated if the recording process is killed.
+            if len(record) < size: break
+
+            t, num_vehicles, same_ids = struct.unpack_from('<dII', record, 0)
+            offset = 16
+
+            if same_ids:
+                new_ids = ids
+                last_indices = np.arange(num_vehicles)
+            else:
+                new_ids = np.frombuffer(record, dtype='<u8', count=num_vehicles, offset=offset)
+                offset += 8*num_vehicles
+                index_of = {vid: i for i, vid in enumerate(ids)}
+                last_indices = np.array([index_of.get(vid, -1) for vid in new_ids], dtype='int64')
+            is_new = last_indices < 0
+
+            num_new, = struct.unpack_from('<I', record, offset)
+            offset += 4
+            if num_new != np.count_nonzero(is_new):
+                raise RuntimeError('the number of new vehicles does not match the IDs.')
+
+            new_boxes = np.zeros((num_vehicles, len(BOUNDING_BOX_FIELDS)))
+            new_boxes[~is_new] = boxes[last_indices[~is_new]]
+            if num_new > 0:
+                new_boxes[is_new] = np.frombuffer(
+                    record, dtype='<f8', count=num_new*len(BOUNDING_BOX_FIELDS),
+                    offset=offset).reshape(num_new, len(BOUNDING_BOX_FIELDS))
+                offset += 8*num_new*len(BOUNDING_BOX_FIELDS)
+
+            deltas = np.frombuffer(
+                record, dtype='<i4', count=num_vehicles*len(FIELDS),
+                offset=offset).reshape(len(FIELDS), num_vehicles).T.astype('int64')
+            new_states = deltas
+            new_states[~is_new] += states[last_indices[~is_new]]
+
+            ids, states, boxes = np.array(new_ids), new_states, new_boxes
+
+            vehicles = np.zeros(num_vehicles, dtype=VEHICLE_TYPE)
+            vehicles['id'] = ids
+            for i, field in enumerate(BOUNDING_BOX_FIELDS):
+                vehicles[field] = boxes[:, i]
+            for i, field in enumerate(FIELDS):
+                vehicles[field] = states[:, i] * RESOLUTIONS[i]
+
+            yield t, vehicles
+
+def main():
+
+    if len(sys.argv) < 2:
+        print('Usage: {} <traffic log>'.format(sys.argv[0]))
+        return
+
+    records = 0
+    start_time = None
+    end_time = None
+    max_vehicles = 0
+    ego_speed = 0.0
+
+    for t, vehicles in read_traffic_log(sys.argv[1]):
+        if start_time is None: start_time = t
+        end_time = t
+        records += 1
+        max_vehicles = max(max_vehicles, vehicles.size)
+        ego_speed += vehicles[0]['speed']
+
+    print('records: ', records)
+    if records > 0:
+        print('simulation time: ', end_time-start_time)
+        print('max vehicles: ', max_vehicles)
+        print('average ego speed: ', ego_speed/records)
+
+if __name__ == '__main__':
+    main()
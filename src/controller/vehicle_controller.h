@@ -19,6 +19,8 @@
 #include <deque>
 #include <algorithm>
 #include <numeric>
+#include <vector>
+#include <stdexcept>
 #include <boost/core/noncopyable.hpp>
 #include <carla/geom/Transform.h>
 
@@ -208,5 +210,176 @@ public:
 
 };
 
+/**
+ * \brief FleetPIDController controls a number of vehicles with the same gains.
+ *
+ * The controller is equivalent to one \c VehiclePIDController per vehicle.
+ * However, the error history of all vehicles is stored in contiguous arrays,
+ * indexed by the slot of each vehicle, and the controls of all vehicles are
+ * computed in one pass. The heading of the vehicles is taken from the yaw
+ * directly instead of constructing the forward vectors.
+ */
+class FleetPIDController {
+
+private:
+
+  // Gains of the longitudinal and lateral controllers.
+  double long_kp_ = 8.0;
+  double long_ki_ = 0.0;
+  double long_kd_ = 0.0;
+
+  double lat_kp_ = 14.0;
+  double lat_ki_ = 0.0;
+  double lat_kd_ = 0.0;
+
+  // Error history of the vehicles, one element per vehicle.
+  std::vector<double> long_integrated_err_;
+  std::vector<double> long_previous_err_;
+  std::vector<double> lat_integrated_err_;
+  std::vector<double> lat_previous_err_;
+
+public:
+
+  FleetPIDController(const size_t size=0) { resize(size); }
+
+  template<typename Container>
+  FleetPIDController(const Container& long_gains,
+                     const Container& late_gains,
+                     const size_t size=0) :
+    long_kp_(long_gains[0]), long_ki_(long_gains[1]), long_kd_(long_gains[2]),
+    lat_kp_(late_gains[0]), lat_ki_(late_gains[1]), lat_kd_(late_gains[2]) {
+    resize(size);
+  }
+
+  double longitudinalKp() const { return long_kp_; }
+  double& longitudinalKp() { return long_kp_; }
+
+  double longitudinalKi() const { return long_ki_; }
+  double& longitudinalKi() { return long_ki_; }
+
+  double longitudinalKd() const { return long_kd_; }
+  double& longitudinalKd() { return long_kd_; }
+
+  double lateralKp() const { return lat_kp_; }
+  double& lateralKp() { return lat_kp_; }
+
+  double lateralKi() const { return lat_ki_; }
+  double& lateralKi() { return lat_ki_; }
+
+  double lateralKd() const { return lat_kd_; }
+  double& lateralKd() { return lat_kd_; }
+
+  /// Number of vehicles controlled.
+  size_t size() const { return long_previous_err_.size(); }
+
+  /// Change the number of vehicles. The history of the new vehicles is empty.
+  void resize(const size_t size) {
+    long_integrated_err_.resize(size, 0.0);
+    long_previous_err_.resize(size, 0.0);
+    lat_integrated_err_.resize(size, 0.0);
+    lat_previous_err_.resize(size, 0.0);
+    return;
+  }
+
+  /// Clear the history of the vehicle at the given slot,
+  /// e.g. when the slot is taken by another vehicle.
+  void reset(const size_t slot) {
+    long_integrated_err_[slot] = 0.0;
+    long_previous_err_[slot] = 0.0;
+    lat_integrated_err_[slot] = 0.0;
+    lat_previous_err_[slot] = 0.0;
+    return;
+  }
+
+  /**
+   * \brief Compute the controls of all vehicles for one tick.
+   *
+   * All input and output vectors have one element per vehicle.
+   * A positive longitudinal control is applied as throttle and a negative
+   * one as brake, both of which are clamped to [0, max].
+   *
+   * \param[in] current_speeds Current speeds of the vehicles.
+   * \param[in] reference_speeds Reference speeds of the vehicles.
+   * \param[in] current_transforms Current transforms of the vehicles.
+   * \param[in] reference_transforms Reference transforms of the vehicles.
+   * \param[in] dt Time step since the last tick.
+   * \param[out] throttles Throttle of the vehicles.
+   * \param[out] brakes Brake of the vehicles.
+   * \param[out] steerings Steering of the vehicles.
+   */
+  void control(const std::vector<double>& current_speeds,
+               const std::vector<double>& reference_speeds,
+               const std::vector<carla::geom::Transform>& current_transforms,
+               const std::vector<carla::geom::Transform>& reference_transforms,
+               const double dt,
+               std::vector<double>& throttles,
+               std::vector<double>& brakes,
+               std::vector<double>& steerings,
+               const double throttle_max = 1.0,
+               const double brake_max = 1.0,
+               const double steering_max = 1.0) {
+
+    const size_t num = size();
+    if (current_speeds.size() != num || reference_speeds.size() != num ||
+        current_transforms.size() != num || reference_transforms.size() != num) {
+      throw std::runtime_error(
+          "FleetPIDController::control(): "
+          "the inputs do not match the number of vehicles.\n");
+    }
+
+    throttles.resize(num);
+    brakes.resize(num);
+    steerings.resize(num);
+
+    // Longitudinal control.
+    for (size_t i = 0; i < num; ++i) {
+      const double error = reference_speeds[i] - current_speeds[i];
+      const double u = pid(error, long_integrated_err_[i], long_previous_err_[i],
+                           long_kp_, long_ki_, long_kd_, dt);
+      throttles[i] = std::min(std::max(u, 0.0), throttle_max);
+      brakes[i] = std::min(std::max(-u, 0.0), brake_max);
+    }
+
+    // Lateral control.
+    for (size_t i = 0; i < num; ++i) {
+      const carla::geom::Transform& current = current_transforms[i];
+      const carla::geom::Transform& reference = reference_transforms[i];
+
+      // The signed angle between the heading of the vehicle and the
+      // direction from the current location to the reference location,
+      // which agrees with \c PIDLateralController.
+      const double yaw = current.rotation.yaw / 180.0 * M_PI;
+      const double cx = std::cos(yaw);
+      const double cy = std::sin(yaw);
+      const double rx = reference.location.x - current.location.x;
+      const double ry = reference.location.y - current.location.y;
+      const double error = std::atan2(rx*cy - ry*cx, cx*rx + cy*ry);
+
+      const double u = pid(error, lat_integrated_err_[i], lat_previous_err_[i],
+                           lat_kp_, lat_ki_, lat_kd_, dt);
+      steerings[i] = std::min(std::max(u, -steering_max), steering_max);
+    }
+
+    return;
+  }
+
+private:
+
+  static double pid(const double error,
+                    double& integrated_err,
+                    double& previous_err,
+                    const double kp,
+                    const double ki,
+                    const double kd,
+                    const double dt) {
+    const double ie = integrated_err + error;
+    const double de = (error-previous_err) / dt;
+    previous_err = error;
+    integrated_err = ie;
+    return kp*error + ki*ie + kd*de;
+  }
+
+};
+
 } // End namespace controller
 
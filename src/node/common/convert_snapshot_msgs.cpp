@@ -0,0 +1,328 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <string>
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/format.hpp>
+
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2/LinearMath/Matrix3x3.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
+#include <geometry_msgs/Pose.h>
+
+#include <node/common/convert_snapshot_msgs.h>
+
+namespace node {
+
+namespace {
+
+/// Check if the vehicle is at the origin, which indicates that its
+/// transform is reset by the carla server.
+void checkVehicleNotAtOrigin(
+    const planner::Vehicle& vehicle, const std::string& which) {
+  if (vehicle.transform().location.x==0.0 &&
+      vehicle.transform().location.y==0.0 &&
+      vehicle.transform().location.z==0.0) {
+    std::string error_msg(
+        "createSnapshot(): " + which + " is set back to origin.\n");
+    std::string vehicle_msg = (
+        boost::format("ID: %lu\n") % vehicle.id()).str();
+    throw std::runtime_error(error_msg + vehicle_msg);
+  }
+  return;
+}
+
+void populatePoseMsg(
+    const carla::geom::Transform& transform, geometry_msgs::Pose& pose) {
+  pose.position.x = transform.location.x;
+  pose.position.y = transform.location.y;
+  pose.position.z = transform.location.z;
+  tf2::Matrix3x3 tf_mat;
+  tf_mat.setRPY(transform.rotation.roll /180.0*M_PI,
+                transform.rotation.pitch/180.0*M_PI,
+                transform.rotation.yaw  /180.0*M_PI);
+  tf2::Quaternion tf_quat;
+  tf_mat.getRotation(tf_quat);
+  pose.orientation = tf2::toMsg(tf_quat);
+  return;
+}
+
+void populateTransformObj(
+    const geometry_msgs::Pose& pose, carla::geom::Transform& transform) {
+  transform.location.x = pose.position.x;
+  transform.location.y = pose.position.y;
+  transform.location.z = pose.position.z;
+
+  tf2::Quaternion tf_quat;
+  tf2::fromMsg(pose.orientation, tf_quat);
+  tf2::Matrix3x3 tf_mat(tf_quat);
+  double yaw, pitch, roll;
+  tf_mat.getRPY(roll, pitch, yaw);
+  transform.rotation.yaw   = yaw  /M_PI*180.0;
+  transform.rotation.pitch = pitch/M_PI*180.0;
+  transform.rotation.roll  = roll /M_PI*180.0;
+  return;
+}
+
+/// Check if the static attributes, sent with the full vehicle msg, are the same.
+bool sameStaticAttributes(const planner::Vehicle& v1, const planner::Vehicle& v2) {
+  const carla::geom::BoundingBox& b1 = v1.boundingBox();
+  const carla::geom::BoundingBox& b2 = v2.boundingBox();
+  return b1.extent.x   == b2.extent.x   &&
+         b1.extent.y   == b2.extent.y   &&
+         b1.extent.z   == b2.extent.z   &&
+         b1.location.x == b2.location.x &&
+         b1.location.y == b2.location.y &&
+         b1.location.z == b2.location.z &&
+         v1.policySpeed() == v2.policySpeed();
+}
+
+/// Check if the dynamic states, sent with the vehicle state msg, are the same.
+bool sameDynamicState(const planner::Vehicle& v1, const planner::Vehicle& v2) {
+  const carla::geom::Transform& t1 = v1.transform();
+  const carla::geom::Transform& t2 = v2.transform();
+  return t1.location.x     == t2.location.x     &&
+         t1.location.y     == t2.location.y     &&
+         t1.location.z     == t2.location.z     &&
+         t1.rotation.roll  == t2.rotation.roll  &&
+         t1.rotation.pitch == t2.rotation.pitch &&
+         t1.rotation.yaw   == t2.rotation.yaw   &&
+         v1.speed()        == v2.speed()        &&
+         v1.acceleration() == v2.acceleration() &&
+         v1.curvature()    == v2.curvature();
+}
+
+} // End anonymous namespace.
+
+boost::shared_ptr<planner::Snapshot> createSnapshot(
+    const planner::Vehicle& ego,
+    const std::unordered_map<size_t, planner::Vehicle>& agents,
+    const boost::shared_ptr<router::Router>& router,
+    const boost::shared_ptr<carla::client::Map>& map,
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+    const boost::shared_ptr<utils::ThreadPool>& thread_pool) {
+
+  checkVehicleNotAtOrigin(ego, "ego vehicle");
+  for (const auto& agent : agents)
+    checkVehicleNotAtOrigin(agent.second, "an agent vehicle");
+
+  // Create the snapshot.
+  return boost::make_shared<planner::Snapshot>(
+      ego, agents, router, map, fast_map, thread_pool);
+}
+
+boost::shared_ptr<planner::Snapshot> createSnapshot(
+    const conformal_lattice_planner::TrafficSnapshot& snapshot_msg,
+    const boost::shared_ptr<router::Router>& router,
+    const boost::shared_ptr<carla::client::Map>& map,
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) {
+
+  if (snapshot_msg.incremental) {
+    throw std::runtime_error(
+        "createSnapshot(): "
+        "an incremental snapshot msg cannot be decoded on its own.\n");
+  }
+
+  // Create the ego vehicle.
+  planner::Vehicle ego_vehicle;
+  populateVehicleObj(snapshot_msg.ego, ego_vehicle);
+
+  // Create the agent vehicles.
+  std::unordered_map<size_t, planner::Vehicle> agent_vehicles;
+  for (const auto& agent : snapshot_msg.agents) {
+    planner::Vehicle agent_vehicle;
+    populateVehicleObj(agent, agent_vehicle);
+    agent_vehicles[agent_vehicle.id()] = agent_vehicle;
+  }
+
+  return createSnapshot(ego_vehicle, agent_vehicles, router, map, fast_map);
+}
+
+void populateVehicleMsg(
+    const planner::Vehicle& vehicle_obj,
+    conformal_lattice_planner::Vehicle& vehicle_msg) {
+  // ID.
+  vehicle_msg.id = vehicle_obj.id();
+  // Bounding box.
+  vehicle_msg.bounding_box.extent.x = vehicle_obj.boundingBox().extent.x;
+  vehicle_msg.bounding_box.extent.y = vehicle_obj.boundingBox().extent.y;
+  vehicle_msg.bounding_box.extent.z = vehicle_obj.boundingBox().extent.z;
+  vehicle_msg.bounding_box.location.x = vehicle_obj.boundingBox().location.x;
+  vehicle_msg.bounding_box.location.y = vehicle_obj.boundingBox().location.y;
+  vehicle_msg.bounding_box.location.z = vehicle_obj.boundingBox().location.z;
+  // Transform.
+  populatePoseMsg(vehicle_obj.transform(), vehicle_msg.transform);
+  // Speed.
+  vehicle_msg.speed = vehicle_obj.speed();
+  // Acceleration.
+  vehicle_msg.acceleration = vehicle_obj.acceleration();
+  // Curvature.
+  vehicle_msg.curvature = vehicle_obj.curvature();
+  // policy speed.
+  vehicle_msg.policy_speed = vehicle_obj.policySpeed();
+  return;
+}
+
+void populateVehicleObj(
+    const conformal_lattice_planner::Vehicle& vehicle_msg,
+    planner::Vehicle& vehicle_obj) {
+  // ID.
+  vehicle_obj.id() = vehicle_msg.id;
+  // Bounding box.
+  vehicle_obj.boundingBox().extent.x = vehicle_msg.bounding_box.extent.x;
+  vehicle_obj.boundingBox().extent.y = vehicle_msg.bounding_box.extent.y;
+  vehicle_obj.boundingBox().extent.z = vehicle_msg.bounding_box.extent.z;
+  vehicle_obj.boundingBox().location.x = vehicle_msg.bounding_box.location.x;
+  vehicle_obj.boundingBox().location.y = vehicle_msg.bounding_box.location.y;
+  vehicle_obj.boundingBox().location.z = vehicle_msg.bounding_box.location.z;
+  // Transform.
+  populateTransformObj(vehicle_msg.transform, vehicle_obj.transform());
+  // Speed.
+  vehicle_obj.speed() = vehicle_msg.speed;
+  // Acceleration.
+  vehicle_obj.acceleration() = vehicle_msg.acceleration;
+  // Curvature.
+  vehicle_obj.curvature() = vehicle_msg.curvature;
+  // Policy speed.
+  vehicle_obj.policySpeed() = vehicle_msg.policy_speed;
+  return;
+}
+
+void populateVehicleStateMsg(
+    const planner::Vehicle& vehicle_obj,
+    conformal_lattice_planner::VehicleState& state_msg) {
+  state_msg.id = vehicle_obj.id();
+  populatePoseMsg(vehicle_obj.transform(), state_msg.transform);
+  state_msg.speed = vehicle_obj.speed();
+  state_msg.acceleration = vehicle_obj.acceleration();
+  state_msg.curvature = vehicle_obj.curvature();
+  return;
+}
+
+void populateVehicleObj(
+    const conformal_lattice_planner::VehicleState& state_msg,
+    planner::Vehicle& vehicle_obj) {
+  vehicle_obj.id() = state_msg.id;
+  populateTransformObj(state_msg.transform, vehicle_obj.transform());
+  vehicle_obj.speed() = state_msg.speed;
+  vehicle_obj.acceleration() = state_msg.acceleration;
+  vehicle_obj.curvature() = state_msg.curvature;
+  return;
+}
+
+void SnapshotEncoder::encode(
+    const planner::Vehicle& ego,
+    const std::unordered_map<size_t, planner::Vehicle>& agents,
+    conformal_lattice_planner::TrafficSnapshot& snapshot_msg) {
+
+  const bool keyframe = !incremental_ || keyframe_required_ ||
+    (keyframe_interval_ > 0 && sequence_-keyframe_sequence_ >= keyframe_interval_);
+
+  snapshot_msg = conformal_lattice_planner::TrafficSnapshot();
+  snapshot_msg.sequence = ++sequence_;
+  snapshot_msg.incremental = !keyframe;
+  populateVehicleMsg(ego, snapshot_msg.ego);
+
+  if (keyframe) {
+    for (const auto& agent : agents) {
+      snapshot_msg.agents.push_back(conformal_lattice_planner::Vehicle());
+      populateVehicleMsg(agent.second, snapshot_msg.agents.back());
+    }
+    keyframe_sequence_ = sequence_;
+    keyframe_required_ = false;
+
+  } else {
+    for (const auto& agent : agents) {
+      std::unordered_map<size_t, planner::Vehicle>::const_iterator last_agent =
+        agents_.find(agent.first);
+
+      if (last_agent == agents_.end() ||
+          !sameStaticAttributes(agent.second, last_agent->second)) {
+        snapshot_msg.agents.push_back(conformal_lattice_planner::Vehicle());
+        populateVehicleMsg(agent.second, snapshot_msg.agents.back());
+      } else if (!sameDynamicState(agent.second, last_agent->second)) {
+        snapshot_msg.agent_states.push_back(conformal_lattice_planner::VehicleState());
+        populateVehicleStateMsg(agent.second, snapshot_msg.agent_states.back());
+      }
+    }
+
+    for (const auto& last_agent : agents_) {
+      if (agents.count(last_agent.first) != 0) continue;
+      snapshot_msg.removed_agents.push_back(last_agent.first);
+    }
+  }
+
+  ego_ = ego;
+  agents_ = agents;
+  return;
+}
+
+void SnapshotEncoder::resync(
+    conformal_lattice_planner::TrafficSnapshot& snapshot_msg) {
+
+  snapshot_msg = conformal_lattice_planner::TrafficSnapshot();
+  snapshot_msg.sequence = sequence_;
+  snapshot_msg.incremental = false;
+  populateVehicleMsg(ego_, snapshot_msg.ego);
+  for (const auto& agent : agents_) {
+    snapshot_msg.agents.push_back(conformal_lattice_planner::Vehicle());
+    populateVehicleMsg(agent.second, snapshot_msg.agents.back());
+  }
+
+  keyframe_sequence_ = sequence_;
+  return;
+}
+
+bool SnapshotDecoder::decode(
+    const conformal_lattice_planner::TrafficSnapshot& snapshot_msg) {
+
+  if (snapshot_msg.incremental &&
+      (!sequence_ || snapshot_msg.sequence != *sequence_+1)) {
+    sequence_ = boost::none;
+    return false;
+  }
+
+  if (!snapshot_msg.incremental) agents_.clear();
+
+  populateVehicleObj(snapshot_msg.ego, ego_);
+
+  for (const auto& agent : snapshot_msg.agents) {
+    planner::Vehicle agent_vehicle;
+    populateVehicleObj(agent, agent_vehicle);
+    agents_[agent_vehicle.id()] = agent_vehicle;
+  }
+
+  for (const auto& state : snapshot_msg.agent_states) {
+    std::unordered_map<size_t, planner::Vehicle>::iterator agent = agents_.find(state.id);
+    if (agent == agents_.end()) {
+      std::string error_msg(
+          "SnapshotDecoder::decode(): "
+          "the state of an unknown agent is received.\n");
+      std::string agent_msg = (
+          boost::format("Agent ID: %lu\n") % state.id).str();
+      sequence_ = boost::none;
+      throw std::runtime_error(error_msg + agent_msg);
+    }
+    populateVehicleObj(state, agent->second);
+  }
+
+  for (const auto& id : snapshot_msg.removed_agents) agents_.erase(id);
+
+  sequence_ = snapshot_msg.sequence;
+  return true;
+}
+
+} // End namespace node.
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <boost/smart_ptr.hpp>
+#include <boost/optional.hpp>
+
+#include <carla/client/Map.h>
+
+#include <router/common/router.h>
+#include <planner/common/vehicle.h>
+#include <planner/common/snapshot.h>
+#include <planner/common/fast_waypoint_map.h>
+#include <conformal_lattice_planner/Vehicle.h>
+#include <conformal_lattice_planner/VehicleState.h>
+#include <conformal_lattice_planner/TrafficSnapshot.h>
+
+namespace node {
+
+/// Populate the vehicle msg through object.
+void populateVehicleMsg(
+    const planner::Vehicle& vehicle_obj,
+    conformal_lattice_planner::Vehicle& vehicle_msg);
+
+/// Populate the vehicle object through msg.
+void populateVehicleObj(
+    const conformal_lattice_planner::Vehicle& vehicle_msg,
+    planner::Vehicle& vehicle_obj);
+
+/// Populate the vehicle state msg through object.
+void populateVehicleStateMsg(
+    const planner::Vehicle& vehicle_obj,
+    conformal_lattice_planner::VehicleState& state_msg);
+
+/// Update the dynamic state of the vehicle object through msg.
+void populateVehicleObj(
+    const conformal_lattice_planner::VehicleState& state_msg,
+    planner::Vehicle& vehicle_obj);
+
+/**
+ * \brief Create the snapshot object from the ego and agent vehicles.
+ *
+ * \param[in] ego The ego vehicle.
+ * \param[in] agents The agent vehicles.
+ * \param[in] router The router used by the snapshot.
+ * \param[in] map The carla map.
+ * \param[in] fast_map The fast waypoint map of the carla map.
+ * \param[in] thread_pool Resolves the waypoints of the vehicles concurrently, optional.
+ * \return The snapshot object.
+ */
+boost::shared_ptr<planner::Snapshot> createSnapshot(
+    const planner::Vehicle& ego,
+    const std::unordered_map<size_t, planner::Vehicle>& agents,
+    const boost::shared_ptr<router::Router>& router,
+    const boost::shared_ptr<carla::client::Map>& map,
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+    const boost::shared_ptr<utils::ThreadPool>& thread_pool = nullptr);
+
+/**
+ * \brief Create the snapshot object from a traffic snapshot msg.
+ *
+ * This does not require a carla server, so that recorded snapshot
+ * msgs can be replayed offline with a map loaded from an OpenDRIVE file.
+ * The msg should be complete, use \c SnapshotDecoder for incremental msgs.
+ *
+ * \param[in] snapshot_msg The traffic snapshot msg.
+ * \param[in] router The router used by the snapshot.
+ * \param[in] map The carla map.
+ * \param[in] fast_map The fast waypoint map of the carla map.
+ * \return The snapshot object.
+ */
+boost::shared_ptr<planner::Snapshot> createSnapshot(
+    const conformal_lattice_planner::TrafficSnapshot& snapshot_msg,
+    const boost::shared_ptr<router::Router>& router,
+    const boost::shared_ptr<carla::client::Map>& map,
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map);
+
+/**
+ * \brief SnapshotEncoder creates the traffic snapshot msgs sent to a planner.
+ *
+ * In the incremental mode, the bounding box and policy speed of an agent are
+ * only sent when the agent is spawned or they change, and the dynamic state
+ * is only sent when the agent moves. A complete snapshot is sent every
+ * \c keyframe_interval snapshots, so that a receiver joining in the middle
+ * of the stream can catch up.
+ */
+class SnapshotEncoder {
+
+protected:
+
+  /// Whether to create incremental snapshots.
+  bool incremental_;
+
+  /// Number of snapshots between two complete ones, 0 for no limit.
+  size_t keyframe_interval_;
+
+  /// Sequence number of the last snapshot.
+  uint64_t sequence_ = 0;
+
+  /// Sequence number of the last complete snapshot.
+  uint64_t keyframe_sequence_ = 0;
+
+  /// Whether the next snapshot must be complete.
+  bool keyframe_required_ = true;
+
+  /// The vehicles in the last snapshot, as known by the receiver.
+  planner::Vehicle ego_;
+  std::unordered_map<size_t, planner::Vehicle> agents_;
+
+public:
+
+  SnapshotEncoder(const bool incremental = false,
+                  const size_t keyframe_interval = 0) :
+    incremental_(incremental),
+    keyframe_interval_(keyframe_interval) {}
+
+  /**
+   * \brief Encode the next snapshot.
+   * \param[in] ego The ego vehicle.
+   * \param[in] agents The agent vehicles.
+   * \param[out] snapshot_msg The traffic snapshot msg.
+   */
+  void encode(const planner::Vehicle& ego,
+              const std::unordered_map<size_t, planner::Vehicle>& agents,
+              conformal_lattice_planner::TrafficSnapshot& snapshot_msg);
+
+  /**
+   * \brief Encode the last snapshot again in full, with the same sequence number.
+   *
+   * This is used if the receiver has missed some of the snapshots.
+   * \param[out] snapshot_msg The traffic snapshot msg.
+   */
+  void resync(conformal_lattice_planner::TrafficSnapshot& snapshot_msg);
+
+}; // End class SnapshotEncoder.
+
+/**
+ * \brief SnapshotDecoder rebuilds the traffic from the snapshot msgs
+ *        created by \c SnapshotEncoder.
+ */
+class SnapshotDecoder {
+
+protected:
+
+  /// Sequence number of the last decoded snapshot, if any.
+  boost::optional<uint64_t> sequence_ = boost::none;
+
+  /// The vehicles in the last decoded snapshot.
+  planner::Vehicle ego_;
+  std::unordered_map<size_t, planner::Vehicle> agents_;
+
+public:
+
+  /**
+   * \brief Decode a snapshot msg.
+   *
+   * An incremental msg can only be decoded if it follows the last decoded
+   * snapshot right away. Otherwise, the msg is rejected, and so are the
+   * following incremental msgs until a complete one is received.
+   *
+   * \param[in] snapshot_msg The traffic snapshot msg.
+   * \return false if there is a gap in the sequence.
+   */
+  bool decode(const conformal_lattice_planner::TrafficSnapshot& snapshot_msg);
+
+  /// Get the ego vehicle in the last decoded snapshot.
+  const planner::Vehicle& ego() const { return ego_; }
+
+  /// Get the agent vehicles in the last decoded snapshot.
+  const std::unordered_map<size_t, planner::Vehicle>& agents() const { return agents_; }
+
+}; // End class SnapshotDecoder.
+
+} // End namespace node.
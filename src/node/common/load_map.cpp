@@ -0,0 +1,41 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <boost/format.hpp>
+
+#include <carla/rpc/MapInfo.h>
+
+#include <node/common/load_map.h>
+
+namespace node {
+
+boost::shared_ptr<carla::client::Map> loadMap(const std::string& filename) {
+  std::ifstream fin(filename);
+  if (!fin.is_open()) {
+    throw std::runtime_error((boost::format(
+          "loadMap(): cannot open the OpenDRIVE file %1%.\n") % filename).str());
+  }
+  std::stringstream buffer;
+  buffer << fin.rdbuf();
+
+  carla::rpc::MapInfo map_info;
+  map_info.name = filename;
+  map_info.open_drive_file = buffer.str();
+  return boost::make_shared<carla::client::Map>(map_info);
+}
+
+} // End namespace node.
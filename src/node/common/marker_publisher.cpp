@@ -0,0 +1,119 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <node/common/marker_publisher.h>
+
+namespace node {
+
+namespace {
+
+bool samePose(const geometry_msgs::Pose& p1, const geometry_msgs::Pose& p2) {
+  return p1.position.x    == p2.position.x    &&
+         p1.position.y    == p2.position.y    &&
+         p1.position.z    == p2.position.z    &&
+         p1.orientation.x == p2.orientation.x &&
+         p1.orientation.y == p2.orientation.y &&
+         p1.orientation.z == p2.orientation.z &&
+         p1.orientation.w == p2.orientation.w;
+}
+
+bool samePoint(const geometry_msgs::Point& p1, const geometry_msgs::Point& p2) {
+  return p1.x == p2.x && p1.y == p2.y && p1.z == p2.z;
+}
+
+bool sameColor(const std_msgs::ColorRGBA& c1, const std_msgs::ColorRGBA& c2) {
+  return c1.r == c2.r && c1.g == c2.g && c1.b == c2.b && c1.a == c2.a;
+}
+
+/// Check if two markers look the same, the time stamps are ignored.
+bool sameMarker(const visualization_msgs::Marker& m1,
+                const visualization_msgs::Marker& m2) {
+
+  if (m1.header.frame_id != m2.header.frame_id ||
+      m1.type            != m2.type            ||
+      m1.action          != m2.action          ||
+      m1.lifetime        != m2.lifetime        ||
+      m1.frame_locked    != m2.frame_locked    ||
+      m1.text            != m2.text            ||
+      m1.mesh_resource   != m2.mesh_resource   ||
+      m1.points.size()   != m2.points.size()   ||
+      m1.colors.size()   != m2.colors.size()) return false;
+
+  if (!samePose(m1.pose, m2.pose)) return false;
+  if (m1.scale.x != m2.scale.x ||
+      m1.scale.y != m2.scale.y ||
+      m1.scale.z != m2.scale.z) return false;
+  if (!sameColor(m1.color, m2.color)) return false;
+
+  for (size_t i = 0; i < m1.points.size(); ++i)
+    if (!samePoint(m1.points[i], m2.points[i])) return false;
+  for (size_t i = 0; i < m1.colors.size(); ++i)
+    if (!sameColor(m1.colors[i], m2.colors[i])) return false;
+
+  return true;
+}
+
+} // End anonymous namespace.
+
+bool MarkerArrayPublisher::ready() {
+
+  if (publisher_.getNumSubscribers() == 0) return false;
+  if (min_interval_ <= 0.0) return true;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (last_publish_time_.isZero()) return true;
+  return (ros::WallTime::now()-last_publish_time_).toSec() >= min_interval_;
+}
+
+void MarkerArrayPublisher::publish(
+    const visualization_msgs::MarkerArrayConstPtr& msg) {
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // A new subscriber only knows the latched msg, which may be partial.
+  const uint32_t subscribers = publisher_.getNumSubscribers();
+  if (subscribers > subscribers_) published_.clear();
+  subscribers_ = subscribers;
+  last_publish_time_ = ros::WallTime::now();
+
+  visualization_msgs::MarkerArrayPtr diff_msg(new visualization_msgs::MarkerArray);
+
+  for (const auto& marker : msg->markers) {
+
+    if (marker.action == visualization_msgs::Marker::DELETEALL) {
+      published_.clear();
+      diff_msg->markers.push_back(marker);
+      continue;
+    }
+
+    const std::pair<std::string, int32_t> key(marker.ns, marker.id);
+
+    if (marker.action == visualization_msgs::Marker::DELETE) {
+      if (published_.erase(key) > 0) diff_msg->markers.push_back(marker);
+      continue;
+    }
+
+    auto published_marker = published_.find(key);
+    if (published_marker != published_.end() &&
+        sameMarker(published_marker->second, marker)) continue;
+
+    published_[key] = marker;
+    diff_msg->markers.push_back(marker);
+  }
+
+  if (!diff_msg->markers.empty()) publisher_.publish(diff_msg);
+  return;
+}
+
+} // End namespace node.
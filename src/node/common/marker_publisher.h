@@ -0,0 +1,95 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <cstdint>
+
+#include <boost/core/noncopyable.hpp>
+
+#include <ros/ros.h>
+#include <visualization_msgs/Marker.h>
+#include <visualization_msgs/MarkerArray.h>
+
+namespace node {
+
+/**
+ * \brief MarkerArrayPublisher publishes visualization markers only when
+ *        they are needed.
+ *
+ * \c ready() tells whether the markers are worth creating at all, i.e. there
+ * are subscribers on the topic and the throttle interval has passed, so that
+ * headless runs skip the work completely. \c publish() only sends the markers
+ * that have changed since they were last sent, keyed by their namespace and
+ * ID. Everything is sent again once a new subscriber connects.
+ *
+ * The object can be used from different threads.
+ */
+class MarkerArrayPublisher : private boost::noncopyable {
+
+protected:
+
+  /// The underlying ROS publisher.
+  ros::Publisher publisher_;
+
+  /// Minimum wall time (s) between two publications, 0 for no limit.
+  double min_interval_ = 0.0;
+
+  /// Wall time of the last publication.
+  ros::WallTime last_publish_time_;
+
+  /// Number of subscribers at the last publication.
+  uint32_t subscribers_ = 0;
+
+  /// The markers as they are known by the subscribers.
+  std::map<std::pair<std::string, int32_t>, visualization_msgs::Marker> published_;
+
+  /// Protects all of the above but \c publisher_ and \c min_interval_.
+  std::mutex mutex_;
+
+public:
+
+  /**
+   * \brief Advertise the topic.
+   * \param[in] nh The node handle to advertise the topic with.
+   * \param[in] topic The topic name.
+   * \param[in] max_rate The maximum publishing rate (Hz), 0 for no limit.
+   */
+  MarkerArrayPublisher(ros::NodeHandle& nh,
+                       const std::string& topic,
+                       const double max_rate = 0.0) :
+    publisher_(nh.advertise<visualization_msgs::MarkerArray>(topic, 1, true)),
+    min_interval_(max_rate > 0.0 ? 1.0/max_rate : 0.0) {}
+
+  /// Check if markers should be created and published at this moment.
+  bool ready();
+
+  /**
+   * \brief Publish the markers that have changed.
+   *
+   * Markers with the \c DELETE action are forwarded if the marker is
+   * known by the subscribers, and \c DELETEALL is always forwarded.
+   * Nothing is published if none of the markers has changed.
+   *
+   * \param[in] msg The complete set of markers.
+   */
+  void publish(const visualization_msgs::MarkerArrayConstPtr& msg);
+
+}; // End class MarkerArrayPublisher.
+
+} // End namespace node.
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <boost/smart_ptr.hpp>
+#include <nodelet/nodelet.h>
+
+namespace node {
+
+/**
+ * \brief Nodelet wraps a simulator or planning node, so that the nodes can
+ *        be loaded into the same nodelet manager.
+ *
+ * Co-located nodes exchange the action goals and results through shared
+ * pointers without serialization, and share one \c utils::FastWaypointMap,
+ * see \c utils::FastWaypointMap::shared().
+ *
+ * \tparam Node The node type, constructed with the private node handle.
+ */
+template<typename Node>
+class Nodelet : public nodelet::Nodelet {
+
+protected:
+
+  boost::shared_ptr<Node> node_ = nullptr;
+
+public:
+
+  Nodelet() = default;
+  virtual ~Nodelet() {}
+
+protected:
+
+  virtual void onInit() override {
+    node_ = boost::make_shared<Node>(getPrivateNodeHandle());
+    if (!node_->initialize()) {
+      NODELET_ERROR("Cannot initialize the node %s.", getName().c_str());
+    }
+    return;
+  }
+
+}; // End class Nodelet.
+
+} // End namespace node.
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pluginlib/class_list_macros.h>
+
+#include <node/common/nodelet.h>
+#include <node/planner/agents_lane_following_node.h>
+#include <node/planner/ego_lane_following_node.h>
+#include <node/planner/ego_idm_lattice_planning_node.h>
+#include <node/planner/ego_slc_lattice_planning_node.h>
+#include <node/planner/ego_spatiotemporal_lattice_planning_node.h>
+#include <node/simulator/no_traffic_node.h>
+#include <node/simulator/fixed_scenario_node.h>
+#include <node/simulator/random_traffic_node.h>
+
+namespace node {
+
+using AgentsLaneFollowingNodelet              = Nodelet<AgentsLaneFollowingNode>;
+using EgoLaneFollowingNodelet                 = Nodelet<EgoLaneFollowingNode>;
+using EgoIDMLatticePlanningNodelet            = Nodelet<EgoIDMLatticePlanningNode>;
+using EgoSLCLatticePlanningNodelet            = Nodelet<EgoSLCLatticePlanningNode>;
+using EgoSpatiotemporalLatticePlanningNodelet = Nodelet<EgoSpatiotemporalLatticePlanningNode>;
+using NoTrafficNodelet                        = Nodelet<NoTrafficNode>;
+using FixedScenarioNodelet                    = Nodelet<FixedScenarioNode>;
+using RandomTrafficNodelet                    = Nodelet<RandomTrafficNode>;
+
+} // End namespace node.
+
+PLUGINLIB_EXPORT_CLASS(node::AgentsLaneFollowingNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(node::EgoLaneFollowingNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(node::EgoIDMLatticePlanningNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(node::EgoSLCLatticePlanningNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(node::EgoSpatiotemporalLatticePlanningNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(node::NoTrafficNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(node::FixedScenarioNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(node::RandomTrafficNodelet, nodelet::Nodelet)
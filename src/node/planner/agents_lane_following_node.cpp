@@ -42,6 +42,38 @@ bool AgentsLaneFollowingNode::initialize() {
   all_param_exist &= nh_.param<std::string>("host", host, "localhost");
   all_param_exist &= nh_.param<int>("port", port, 2000);
 
+  // The directory to cache the waypoints of the map, shared by all nodes.
+  std::string fast_map_cache_directory = "/tmp/conformal_lattice_planner";
+  nh_.param<std::string>("fast_map_cache_directory",
+      fast_map_cache_directory, "/tmp/conformal_lattice_planner");
+
+  // Number of threads to plan the agents, including the callback thread.
+  int planning_threads = 1;
+  nh_.param<int>("planning_threads", planning_threads, 1);
+
+  // A negative seed means the agents are randomized differently every run.
+  // In that case, use the seed resolved by the simulator, so that the traffic
+  // and the agents are replayed together with the logged seed. The seed is
+  // only drawn here if the simulator does not share one in time.
+  int scenario_seed = -1;
+  nh_.param<int>("scenario_seed", scenario_seed, -1);
+  if (scenario_seed < 0) {
+    ROS_INFO_NAMED("agents_planner", "wait for the scenario seed of the simulator.");
+    const ros::WallTime timeout = ros::WallTime::now() + ros::WallDuration(10.0);
+    while (ros::ok() && ros::WallTime::now() < timeout) {
+      if (ros::param::get("resolved_scenario_seed", scenario_seed) &&
+          scenario_seed >= 0) break;
+      scenario_seed = -1;
+      ros::WallDuration(0.1).sleep();
+    }
+    if (scenario_seed < 0) {
+      ROS_WARN_NAMED("agents_planner",
+          "The simulator does not share the scenario seed, use a seed of the agents planner.");
+    }
+  }
+  scenario_seed_ = utils::ScenarioSeed::fromParam(scenario_seed);
+  ROS_INFO_NAMED("agents_planner", "scenario seed: %lu", scenario_seed_.seed());
+
   // Get the world.
   ROS_INFO_NAMED("agents_planner", "connect to the server.");
   client_ = boost::make_shared<CarlaClient>(host, port);
@@ -51,7 +83,19 @@ bool AgentsLaneFollowingNode::initialize() {
   // Create world and map.
   world_ = boost::make_shared<CarlaWorld>(client_->GetWorld());
   map_ = world_->GetMap();
-  fast_map_ = boost::make_shared<utils::FastWaypointMap>(map_);
+  fast_map_ = utils::FastWaypointMap::shared(
+      map_, 0.05, fast_map_cache_directory);
+
+  // Connect the waypoints of the whole map, so that the router finds the
+  // next, left, and right waypoints without walking the carla map.
+  router_->setWaypointGraph(utils::WaypointGraph::shared(fast_map_));
+
+  // Sample the lanes on the route once, so that the front waypoints
+  // are not searched on the map every time.
+  router_->buildRouteIndex(map_);
+
+  if (planning_threads > 1)
+    thread_pool_ = boost::make_shared<utils::ThreadPool>(planning_threads-1);
 
   // Start the action server.
   ROS_INFO_NAMED("agents_planner", "start action server.");
@@ -61,18 +105,32 @@ bool AgentsLaneFollowingNode::initialize() {
   return all_param_exist;
 }
 
+boost::shared_ptr<Snapshot> AgentsLaneFollowingNode::createSnapshot(
+    const conformal_lattice_planner::TrafficSnapshot& snapshot_msg) {
+  if (!snapshot_decoder_.decode(snapshot_msg)) return nullptr;
+  return node::createSnapshot(
+      snapshot_decoder_.ego(), snapshot_decoder_.agents(),
+      router_, map_, fast_map_, thread_pool_);
+}
+
+utils::CounterRandomEngine& AgentsLaneFollowingNode::agentRandomEngine(const size_t agent) {
+  auto iter = agent_rand_gen_.find(agent);
+  if (iter == agent_rand_gen_.end()) {
+    iter = agent_rand_gen_.emplace(
+        agent, scenario_seed_.stream("agent_policy", agent)).first;
+  }
+  return iter->second;
+}
+
 void AgentsLaneFollowingNode::perturbAgentPolicies(
     const boost::shared_ptr<planner::Snapshot>& snapshot) {
 
   // Collect all current agent IDs.
   std::unordered_set<size_t> current_agents;
-  for (const auto& agent : snapshot->agents())
-    current_agents.insert(agent.first);
+  for (const ConstVehicleView agent : snapshot->agents())
+    current_agents.insert(agent.id());
 
   // Update the policy speed of all agents.
-  const size_t seed = std::chrono::system_clock::now().time_since_epoch().count();
-  std::default_random_engine rand_gen(seed);
-
   for (const size_t agent : current_agents) {
 
     double noise = 0.0;
@@ -82,7 +140,7 @@ void AgentsLaneFollowingNode::perturbAgentPolicies(
       std::normal_distribution<double> normal_dist(
           sigma_xy/sigma*agent_policy_[agent].second,
           std::sqrt(sigma-sigma_xy*sigma_xy/sigma));
-      noise = normal_dist(rand_gen);
+      noise = normal_dist(agentRandomEngine(agent));
     }
 
     agent_policy_[agent] =
@@ -109,20 +167,20 @@ void AgentsLaneFollowingNode::manageAgentIdms(
 
   // Collect all current agent IDs.
   std::unordered_set<size_t> current_agents;
-  for (const auto& agent : snapshot->agents())
-    current_agents.insert(agent.first);
+  for (const ConstVehicleView agent : snapshot->agents())
+    current_agents.insert(agent.id());
 
   // Generate IDMs for new agents if necessary.
-  const size_t seed = std::chrono::system_clock::now().time_since_epoch().count();
-  std::default_random_engine rand_gen(seed);
   std::uniform_real_distribution<double> headway_noise_dist(-0.2, 0.2);
   std::uniform_real_distribution<double> distance_noise_dist(-1.0, 1.0);
 
   for (const size_t agent : current_agents) {
     if (agent_idm_.count(agent) > 0) continue;
+    utils::CounterRandomEngine& rand_gen = agentRandomEngine(agent);
+    const double headway_noise = headway_noise_dist(rand_gen);
+    const double distance_noise = distance_noise_dist(rand_gen);
     agent_idm_[agent] = boost::make_shared<IntelligentDriverModel>(
-        1.0 + headway_noise_dist(rand_gen),
-        6.0 + distance_noise_dist(rand_gen));
+        1.0 + headway_noise, 6.0 + distance_noise);
   }
 
   // Remove agents that are no longer in the snapshot.
@@ -132,8 +190,10 @@ void AgentsLaneFollowingNode::manageAgentIdms(
     agents_to_erase.insert(agent.first);
   }
 
-  for (const size_t agent : agents_to_erase)
+  for (const size_t agent : agents_to_erase) {
     agent_idm_.erase(agent);
+    agent_rand_gen_.erase(agent);
+  }
 
   return;
 }
@@ -149,6 +209,15 @@ void AgentsLaneFollowingNode::executeCallback(
 
   // Create the current snapshot.
   boost::shared_ptr<Snapshot> snapshot = createSnapshot(goal->snapshot);
+  if (!snapshot) {
+    ROS_WARN_NAMED("agents_planner", "missed traffic snapshots, ask for a resync.");
+    conformal_lattice_planner::AgentPlanResult result;
+    result.header.stamp = ros::Time::now();
+    result.success = false;
+    result.resync = true;
+    server_.setAborted(result);
+    return;
+  }
   perturbAgentPolicies(snapshot);
   manageAgentIdms(snapshot);
 
@@ -166,6 +235,7 @@ void AgentsLaneFollowingNode::executeCallback(
 
   boost::shared_ptr<LaneFollower> path_planner =
     boost::make_shared<LaneFollower>(map_, fast_map_, waypoint, range, router_);
+  path_planner->pathCache() = path_cache_;
 
   //// Create speed planner.
   //boost::shared_ptr<VehicleSpeedPlanner> speed_planner =
@@ -174,30 +244,72 @@ void AgentsLaneFollowingNode::executeCallback(
   double dt = 0.05;
   nh_.param<double>("fixed_delta_seconds", dt, 0.05);
 
-  // Compute the target speed and transform of all agents.
-  conformal_lattice_planner::AgentPlanResult result;
-
-  for (const auto& item : snapshot->agents()) {
-    const Vehicle& agent = item.second;
-
-    double accel = 0.0;
-    double movement = 0.0;
-    CarlaTransform updated_transform;
-    double updated_speed = agent.speed();
+  // The snapshot is only read from here on. The const reference keeps the
+  // threads away from the overloads which detach the shared tables.
+  const planner::Snapshot& snap = *snapshot;
+
+  // The agents in the order of the snapshot, which is the order of the result.
+  std::vector<size_t> agents;
+  agents.reserve(snap.agents().size());
+  for (const ConstVehicleView agent : snap.agents())
+    agents.push_back(agent.id());
+
+  // Plan the agents against the read-only snapshot.
+  // The agents are split into contiguous batches, one for each thread, and
+  // the planned states are stored by index so that the result does not
+  // depend on which thread finishes first.
+  std::vector<double> accels(agents.size(), 0.0);
+  std::vector<double> movements(agents.size(), 0.0);
+  std::vector<double> updated_speeds(agents.size(), 0.0);
+  std::vector<CarlaTransform> updated_transforms(agents.size());
+  std::vector<char> planned(agents.size(), 0);
+
+  const size_t num_batches = std::min(
+      agents.size(), thread_pool_ ? thread_pool_->size()+1 : size_t(1));
+
+  auto planBatch = [&](const size_t batch) {
+    const size_t begin = agents.size() * batch / num_batches;
+    const size_t end = agents.size() * (batch+1) / num_batches;
+
+    const std::vector<boost::shared_ptr<const DiscretePath>> paths =
+      path_planner->planPaths(std::vector<size_t>(
+            agents.begin()+begin, agents.begin()+end), snap);
+
+    for (size_t i = begin; i < end; ++i) {
+      const ConstVehicleView agent = snap.agent(agents[i]);
+      updated_speeds[i] = agent.speed();
+      if (!paths[i-begin]) continue;
+      try {
+        VehicleSpeedPlanner speed_planner(agent_idm_.at(agent.id()));
+        accels[i] = speed_planner.planSpeed(agent.id(), snap);
+
+        movements[i] = agent.speed()*dt + 0.5*accels[i]*dt*dt;
+        updated_transforms[i] = paths[i-begin]->transformAt(movements[i]).first;
+        updated_speeds[i] = agent.speed() + accels[i]*dt;
+        planned[i] = 1;
+      } catch(...) {
+        planned[i] = 0;
+      }
+    }
+  };
 
-    try {
+  if (thread_pool_) thread_pool_->parallelFor(num_batches, planBatch);
+  else for (size_t batch = 0; batch < num_batches; ++batch) planBatch(batch);
 
-      boost::shared_ptr<VehicleSpeedPlanner> speed_planner =
-        boost::make_shared<VehicleSpeedPlanner>(agent_idm_[agent.id()]);
+  // Compute the target speed and transform of all agents.
+  conformal_lattice_planner::AgentPlanResult result;
+  std::vector<std::pair<size_t, CarlaTransform>> carla_transforms;
+  carla_transforms.reserve(agents.size());
 
-      const DiscretePath path = path_planner->planPath(agent.id(), *snapshot);
-      accel = speed_planner->planSpeed(agent.id(), *snapshot);
+  for (size_t i = 0; i < agents.size(); ++i) {
 
-      movement = agent.speed()*dt + 0.5*accel*dt*dt;
-      updated_transform = path.transformAt(movement).first;
-      updated_speed = agent.speed() + accel*dt;
+    const ConstVehicleView agent = snap.agent(agents[i]);
+    double accel = accels[i];
+    double movement = movements[i];
+    CarlaTransform updated_transform = updated_transforms[i];
+    double updated_speed = updated_speeds[i];
 
-    } catch(...) {
+    if (!planned[i]) {
       //movement = agent.speed() * dt;
       // FIXME: It seems sometimes the speed is set back to 0.
       //        Not sure what causes this.
@@ -223,9 +335,8 @@ void AgentsLaneFollowingNode::executeCallback(
         updated_transform.rotation.pitch,
         updated_transform.rotation.yaw);
 
-    // Update the agent transform in the simulator.
-    boost::shared_ptr<CarlaVehicle> vehicle = carlaVehicle(agent.id());
-    vehicle->SetTransform(updated_transform);
+    // The agent transforms are updated in the simulator all at once.
+    carla_transforms.emplace_back(agent.id(), updated_transform);
     //vehicle->SetVelocity(updated_transform.GetForwardVector()*updated_speed);
 
     planner::Vehicle updated_agent(
@@ -235,12 +346,15 @@ void AgentsLaneFollowingNode::executeCallback(
         updated_speed,
         agent_policy_[agent.id()].first,
         accel,
-        utils::curvatureAtWaypoint(map_->GetWaypoint(updated_transform.location), map_));
+        fast_map_->curvature(map_->GetWaypoint(updated_transform.location)));
 
     result.agents.push_back(conformal_lattice_planner::Vehicle());
     populateVehicleMsg(updated_agent, result.agents.back());
   }
 
+  // Update the agent transforms in the simulator.
+  updateCarlaVehicleTransforms(carla_transforms);
+
   // Inform the client the result of plan.
   result.header.stamp = ros::Time::now();
   result.success = true;
@@ -250,6 +364,8 @@ void AgentsLaneFollowingNode::executeCallback(
 }
 } // End namespace node.
 
+// The nodelet library, see src/node/nodelets.cpp, is built without main().
+#ifndef CLP_NODELET
 int main(int argc, char** argv) {
   ros::init(argc, argv, "~");
   ros::NodeHandle nh("~");
@@ -269,3 +385,4 @@ int main(int argc, char** argv) {
   ros::spin();
   return 0;
 }
+#endif
@@ -14,9 +14,12 @@
 
 #pragma once
 
+#include <random>
 #include <unordered_map>
 #include <actionlib/server/simple_action_server.h>
 #include <conformal_lattice_planner/AgentPlanAction.h>
+#include <planner/common/thread_pool.h>
+#include <planner/common/scenario_seed.h>
 #include <node/planner/planning_node.h>
 
 namespace node {
@@ -41,6 +44,24 @@ protected:
   /// Stores the IDMs for different agents.
   std::unordered_map<size_t, boost::shared_ptr<planner::IntelligentDriverModel>> agent_idm_;
 
+  /// The seed of the scenario, from which the random engines of the agents are derived.
+  utils::ScenarioSeed scenario_seed_;
+
+  /**
+   * Stores the random engine of each agent, which is the stream of
+   * \c scenario_seed_ for the agent ID once the agent shows up. Every agent
+   * owns its engine, so that the noise of an agent does not depend on
+   * the order the agents are visited in, or on which thread plans it.
+   */
+  std::unordered_map<size_t, utils::CounterRandomEngine> agent_rand_gen_;
+
+  /// Plans the agents concurrently if there are more than one planning threads.
+  boost::shared_ptr<utils::ThreadPool> thread_pool_ = nullptr;
+
+  /// Paths of the agents kept across the planning cycles.
+  boost::shared_ptr<planner::ContinuousPathCache> path_cache_ =
+    boost::make_shared<planner::ContinuousPathCache>();
+
   mutable actionlib::SimpleActionServer<
     conformal_lattice_planner::AgentPlanAction> server_;
 
@@ -56,6 +77,13 @@ public:
 
 protected:
 
+  /// Create the snapshot, resolving the waypoints of the agents with \c thread_pool_.
+  virtual boost::shared_ptr<planner::Snapshot> createSnapshot(
+      const conformal_lattice_planner::TrafficSnapshot& snapshot_msg) override;
+
+  /// Get the random engine of an agent, which is created if necessary.
+  utils::CounterRandomEngine& agentRandomEngine(const size_t agent);
+
   void perturbAgentPolicies(
       const boost::shared_ptr<planner::Snapshot>& snapshot);
 
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include <boost/smart_ptr.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <ros/ros.h>
+#include <planner/common/snapshot.h>
+#include <planner/common/latest_mailbox.h>
+
+namespace node {
+
+/**
+ * \brief BackgroundPlanner replans continuously on the latest snapshot
+ *        in a dedicated thread.
+ *
+ * The snapshots are submitted into a \c utils::LatestMailbox, so that the
+ * planner thread always picks up the freshest snapshot once it finishes the
+ * previous one, and the snapshots submitted in the meantime are dropped.
+ * The latest completed plan can be read at any time without waiting for
+ * the planner, together with the time of its snapshot to tell its age.
+ *
+ * The planning function is only called on the planner thread, so the
+ * planner it uses should not be touched anywhere else.
+ *
+ * \tparam Plan The result of planning on a snapshot.
+ */
+template<typename Plan>
+class BackgroundPlanner : private boost::noncopyable {
+
+public:
+
+  using Clock = std::chrono::steady_clock;
+  using PlanningFunction = std::function<Plan(const planner::Snapshot&)>;
+
+  /// A completed plan.
+  struct TimedPlan {
+    Plan plan;
+    /// When the snapshot of the plan is submitted.
+    Clock::time_point snapshot_time;
+    /// Time (s) spent on the planning.
+    double planning_time;
+
+    /// Time (s) since the snapshot of the plan is submitted.
+    const double age() const {
+      return std::chrono::duration<double>(Clock::now()-snapshot_time).count();
+    }
+  };
+
+protected:
+
+  struct TimedSnapshot {
+    boost::shared_ptr<const planner::Snapshot> snapshot;
+    Clock::time_point time;
+  };
+
+  PlanningFunction plan_;
+
+  /// The latest snapshot not picked up by the planner thread yet.
+  utils::LatestMailbox<TimedSnapshot> snapshots_;
+
+  /// The latest completed plan, only accessed through \c boost::atomic_load()
+  /// and \c boost::atomic_store().
+  boost::shared_ptr<const TimedPlan> latest_plan_ = nullptr;
+
+  /// Number of snapshots planned, failed, and dropped without being planned.
+  std::atomic<size_t> planned_{0};
+  std::atomic<size_t> failed_{0};
+  std::atomic<size_t> dropped_{0};
+
+  /// Lets the planner thread sleep while there is no snapshot. Only the
+  /// waiting uses the mutex, the snapshots and plans are passed lock-free.
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  std::atomic<bool> stop_{false};
+
+  /// Declared last so that it starts after all the other members are initialized.
+  std::thread thread_;
+
+public:
+
+  BackgroundPlanner(const PlanningFunction& plan) :
+    plan_(plan), thread_([this]() { run(); }) {}
+
+  /// Stop the planner thread after the snapshot it is working on.
+  ~BackgroundPlanner() {
+    {
+      std::lock_guard<std::mutex> wake_lock(wake_mutex_);
+      stop_ = true;
+    }
+    wake_cv_.notify_one();
+    thread_.join();
+  }
+
+  /// Submit a snapshot, replacing the one not picked up by the planner yet.
+  void submit(const boost::shared_ptr<const planner::Snapshot>& snapshot) {
+    if (snapshots_.put(TimedSnapshot{snapshot, Clock::now()})) ++dropped_;
+    // The planner thread checks the mailbox with the mutex locked before it
+    // sleeps, so passing through the mutex here makes sure it is woken up.
+    {
+      std::lock_guard<std::mutex> wake_lock(wake_mutex_);
+    }
+    wake_cv_.notify_one();
+    return;
+  }
+
+  /// The latest completed plan, \c nullptr if no plan has completed yet.
+  boost::shared_ptr<const TimedPlan> latestPlan() const {
+    return boost::atomic_load(&latest_plan_);
+  }
+
+  const size_t planned() const { return planned_; }
+  const size_t failed() const { return failed_; }
+  const size_t dropped() const { return dropped_; }
+
+protected:
+
+  void run() {
+    while (!stop_) {
+      boost::optional<TimedSnapshot> snapshot = snapshots_.take();
+      if (!snapshot) {
+        std::unique_lock<std::mutex> wake_lock(wake_mutex_);
+        wake_cv_.wait(wake_lock, [this]() { return stop_ || !snapshots_.empty(); });
+        continue;
+      }
+
+      try {
+        const Clock::time_point start = Clock::now();
+        Plan plan = plan_(*(snapshot->snapshot));
+        const double planning_time =
+          std::chrono::duration<double>(Clock::now()-start).count();
+        boost::atomic_store(&latest_plan_, boost::shared_ptr<const TimedPlan>(
+              new TimedPlan{std::move(plan), snapshot->time, planning_time}));
+        ++planned_;
+      } catch (const std::exception& e) {
+        ++failed_;
+        ROS_WARN_NAMED("ego_planner",
+            "background planner fails on a snapshot: %s", e.what());
+      }
+    }
+    return;
+  }
+
+}; // End class BackgroundPlanner.
+
+} // End namespace node.
@@ -14,6 +14,7 @@
 
 #include <string>
 #include <chrono>
+#include <limits>
 #include <unordered_set>
 #include <boost/timer/timer.hpp>
 #include <gperftools/profiler.h>
@@ -30,6 +31,22 @@ using namespace planner::idm_lattice_planner;
 
 namespace node {
 
+namespace {
+
+/// Plan the path and speed of the ego on a snapshot.
+EgoPlan planPathSpeed(IDMLatticePlanner& path_planner,
+                      VehicleSpeedPlanner& speed_planner,
+                      const Snapshot& snapshot,
+                      const double time_budget) {
+  bool truncated = false;
+  const DiscretePath path = path_planner.planPath(
+      snapshot.ego().id(), snapshot, time_budget, truncated);
+  const double accel = speed_planner.planSpeed(snapshot.ego().id(), snapshot);
+  return EgoPlan{path, accel, truncated};
+}
+
+} // End anonymous namespace.
+
 bool EgoIDMLatticePlanningNode::initialize() {
 
   // Create the publishers.
@@ -39,6 +56,7 @@ bool EgoIDMLatticePlanningNode::initialize() {
       "conformal_lattice", 1, true);
   waypoint_lattice_pub_ = nh_.advertise<visualization_msgs::MarkerArray>(
       "waypoint_lattice", 1, true);
+  initializeProfiler();
 
   bool all_param_exist = true;
 
@@ -47,6 +65,31 @@ bool EgoIDMLatticePlanningNode::initialize() {
   all_param_exist &= nh_.param<std::string>("host", host, "localhost");
   all_param_exist &= nh_.param<int>("port", port, 2000);
 
+  // The directory to cache the waypoints of the map, shared by all nodes.
+  std::string fast_map_cache_directory = "/tmp/conformal_lattice_planner";
+  nh_.param<std::string>("fast_map_cache_directory",
+      fast_map_cache_directory, "/tmp/conformal_lattice_planner");
+
+  // Number of threads used to expand the stations in parallel.
+  // The calling thread is counted, so 1 means no worker thread.
+  int planning_threads = 1;
+  nh_.param<int>("planning_threads", planning_threads, 1);
+
+  // Seed the path optimization with the solution of the same edge
+  // in the previous planning cycle.
+  bool seed_paths_from_previous_cycle = true;
+  nh_.param<bool>("seed_paths_from_previous_cycle", seed_paths_from_previous_cycle, true);
+
+  // Reuse the simulated graph edges of the previous planning cycle if the
+  // traffic at the start of the edges has barely changed.
+  bool reuse_rollouts = false;
+  nh_.param<bool>("reuse_rollouts", reuse_rollouts, false);
+
+  // Drop the agents which cannot interact with the ego within this time
+  // horizon (s) from the simulations. A non-positive horizon keeps all agents.
+  double relevance_horizon = 0.0;
+  nh_.param<double>("relevance_horizon", relevance_horizon, 0.0);
+
   // Get the world.
   ROS_INFO_NAMED("ego_planner", "connect to the server.");
   client_ = boost::make_shared<CarlaClient>(host, port);
@@ -57,13 +100,57 @@ bool EgoIDMLatticePlanningNode::initialize() {
   // Get the world and map.
   world_ = boost::make_shared<CarlaWorld>(client_->GetWorld());
   map_ = world_->GetMap();
-  fast_map_ = boost::make_shared<utils::FastWaypointMap>(map_);
+  fast_map_ = utils::FastWaypointMap::shared(
+      map_, 0.05, fast_map_cache_directory);
+
+  // Connect the waypoints of the whole map, so that the router finds the
+  // next, left, and right waypoints without walking the carla map.
+  router_->setWaypointGraph(utils::WaypointGraph::shared(fast_map_));
+
+  // Sample the lanes on the route once, so that the front waypoints
+  // are not searched on the map every time.
+  router_->buildRouteIndex(map_);
 
   // Initialize the path and speed planner.
-  boost::shared_ptr<router::LoopRouter> router = boost::make_shared<router::LoopRouter>();
-  path_planner_ = boost::make_shared<planner::IDMLatticePlanner>(0.1, 150.0, router, map_, fast_map_);
+  boost::shared_ptr<utils::ThreadPool> thread_pool = nullptr;
+  if (planning_threads > 1)
+    thread_pool = boost::make_shared<utils::ThreadPool>(planning_threads-1);
+  path_planner_ = boost::make_shared<planner::IDMLatticePlanner>(
+      0.1, 150.0, router_, map_, fast_map_, thread_pool);
+
+  // The warm start table of the path optimization is cached in the same directory as the map.
+  boost::shared_ptr<planner::PathWarmStartTable> warm_start_table =
+    boost::make_shared<planner::PathWarmStartTable>(fast_map_cache_directory);
+  path_planner_->pathCache() = boost::make_shared<planner::ContinuousPathCache>(
+      8192, warm_start_table, seed_paths_from_previous_cycle);
+  path_planner_->costModel() = loadCostModel();
+  path_planner_->latticeResolution() = loadLatticeResolution();
+  path_planner_->relevanceHorizon() = relevance_horizon;
+  if (reuse_rollouts)
+    path_planner_->rolloutCache() = boost::make_shared<planner::RolloutCache>();
+
   speed_planner_ = boost::make_shared<planner::VehicleSpeedPlanner>();
 
+  // Fall back to lane following if the planning misses the deadline,
+  // and shorten the planning horizon until the latency recovers.
+  initializeWatchdog(path_planner_->spatialHorizon(),
+      [this](const size_t, const double spatial_horizon) {
+        path_planner_->setSpatialHorizon(spatial_horizon);
+      });
+
+  // Replan continuously in the background if async planning is enabled.
+  // The planners are held by the planning function, since the planner
+  // thread is only stopped after the members of this node are destroyed.
+  double planning_time_budget = 0.0;
+  nh_.param<double>("planning_time_budget", planning_time_budget, 0.0);
+  if (planning_time_budget <= 0.0)
+    planning_time_budget = std::numeric_limits<double>::infinity();
+  initializeBackgroundPlanner(
+      [path_planner = path_planner_, speed_planner = speed_planner_, planning_time_budget](
+        const Snapshot& snapshot) {
+        return planPathSpeed(*path_planner, *speed_planner, snapshot, planning_time_budget);
+      });
+
   // Start the action server.
   ROS_INFO_NAMED("ego_planner", "start action server.");
   server_.start();
@@ -76,6 +163,7 @@ void EgoIDMLatticePlanningNode::executeCallback(
     const conformal_lattice_planner::EgoPlanGoalConstPtr& goal) {
 
   ROS_INFO_NAMED("ego_planner", "executeCallback()");
+  beginProfileCycle();
 
   // Update the carla world and map.
   world_ = boost::make_shared<CarlaWorld>(client_->GetWorld());
@@ -83,27 +171,62 @@ void EgoIDMLatticePlanningNode::executeCallback(
 
   // Create the current snapshot.
   boost::shared_ptr<Snapshot> snapshot = createSnapshot(goal->snapshot);
+  if (!snapshot) {
+    ROS_WARN_NAMED("ego_planner", "missed traffic snapshots, ask for a resync.");
+    conformal_lattice_planner::EgoPlanResult result;
+    result.header.stamp = ros::Time::now();
+    result.success = false;
+    result.resync = true;
+    server_.setAborted(result);
+    return;
+  }
 
-  // Plan path.
+  // The planning time budget of each cycle.
+  // A non-positive budget means the planning time is not limited.
+  double planning_time_budget = 0.0;
+  nh_.param<double>("planning_time_budget", planning_time_budget, 0.0);
+  if (planning_time_budget <= 0.0)
+    planning_time_budget = std::numeric_limits<double>::infinity();
+
+  // Plan path and speed, either in the background or in this callback.
+  // The planning in this callback owns what it uses, since it may outlive
+  // the callback if it misses the deadline of the watchdog.
   ros::Time start_time = ros::Time::now();
-  const DiscretePath ego_path = path_planner_->planPath(snapshot->ego().id(), *snapshot);
+  bool planning_fallback = false;
+  double plan_age = 0.0;
+  EgoPlan ego_plan = background_planner_ ?
+    planEgoAsync(snapshot, plan_age, planning_fallback) :
+    planEgo([path_planner = path_planner_, speed_planner = speed_planner_,
+             snapshot, planning_time_budget]() {
+              return planPathSpeed(*path_planner, *speed_planner, *snapshot, planning_time_budget);
+            }, *snapshot, planning_fallback);
   ros::Duration path_planning_time = ros::Time::now() - start_time;
 
+  // The speed of a path planned on an earlier snapshot is planned again
+  // with the current traffic, which is cheap.
+  if (background_planner_)
+    ego_plan.accel = speed_planner_->planSpeed(snapshot->ego().id(), *snapshot);
+
+  const DiscretePath& ego_path = ego_plan.path;
+  const double ego_accel = ego_plan.accel;
+  const bool planning_truncated = ego_plan.truncated;
+
   // Publish the station graph.
   //conformal_lattice_pub_.publish(createConformalLatticeMsg(
   //      path_planner_->nodes(), path_planner_->edges()));
-  path_pub_.publish(createEgoPathMsg(ego_path));
+  if (path_pub_.getNumSubscribers() > 0)
+    path_pub_.publish(createEgoPathMsg(ego_path));
   //waypoint_lattice_pub_.publish(createWaypointLatticeMsg(path_planner_->waypointLattice()));
 
-  // Plan speed.
-  const double ego_accel = speed_planner_->planSpeed(snapshot->ego().id(), *snapshot);
+  endProfileCycle();
 
   // Update the ego vehicle in the simulator.
   double dt = 0.05;
   nh_.param<double>("fixed_delta_seconds", dt, 0.05);
 
   const double movement = snapshot->ego().speed()*dt + 0.5*ego_accel*dt*dt;
-  const std::pair<CarlaTransform, double> updated_transform_curvature = ego_path.transformAt(movement);
+  const std::pair<CarlaTransform, double> updated_transform_curvature =
+    ego_path.transformAt(ego_plan.start+movement);
   const CarlaTransform updated_transform = updated_transform_curvature.first;
   const double updated_curvature = updated_transform_curvature.second;
   const double updated_speed = snapshot->ego().speed() + ego_accel*dt;
@@ -112,6 +235,25 @@ void EgoIDMLatticePlanningNode::executeCallback(
   ROS_INFO_NAMED("ego_planner", "movement:%f", movement);
   ROS_INFO_NAMED("ego_planner", "acceleration:%f", ego_accel);
   ROS_INFO_NAMED("ego_planner", "speed:%f", updated_speed);
+  ROS_INFO_NAMED("ego_planner", "planning time:%f truncated:%d fallback:%d degradation:%lu plan age:%f",
+      path_planning_time.toSec(), planning_truncated, planning_fallback,
+      watchdog_ ? watchdog_->level() : 0, plan_age);
+  ROS_INFO_NAMED("ego_planner", "path cache hits:%lu misses:%lu failures:%lu",
+      path_planner_->pathCache()->hits(),
+      path_planner_->pathCache()->misses(),
+      path_planner_->pathCache()->failures());
+  if (path_planner_->rolloutCache()) {
+    ROS_INFO_NAMED("ego_planner", "rollout cache hits:%lu misses:%lu",
+        path_planner_->rolloutCache()->hits(),
+        path_planner_->rolloutCache()->misses());
+  }
+  // The counts of the last cycle are not touched if the planner may still
+  // be running, i.e. the fallback is used or the planner runs in the background.
+  if (!planning_fallback && !background_planner_) {
+    ROS_INFO_NAMED("ego_planner", "edges screened:%lu options screened:%lu",
+        path_planner_->edgeScreening().screenedEdges(),
+        path_planner_->edgeScreening().screenedOptions());
+  }
   ROS_INFO_NAMED("ego_planner", "transform: x:%f y:%f z:%f r:%f p:%f y:%f",
       updated_transform.location.x,
       updated_transform.location.y,
@@ -120,8 +262,7 @@ void EgoIDMLatticePlanningNode::executeCallback(
       updated_transform.rotation.pitch,
       updated_transform.rotation.yaw);
 
-  boost::shared_ptr<CarlaVehicle> ego_vehicle = carlaVehicle(snapshot->ego().id());
-  ego_vehicle->SetTransform(updated_transform);
+  updateCarlaVehicleTransform(snapshot->ego().id(), updated_transform);
   //ego_vehicle->SetVelocity(updated_transform.GetForwardVector()*updated_speed);
 
   // Inform the client the result of plan.
@@ -139,6 +280,20 @@ void EgoIDMLatticePlanningNode::executeCallback(
   result.success = true;
   result.path_type = ego_path.laneChangeType();
   result.planning_time = path_planning_time.toSec();
+  result.planning_truncated = planning_truncated;
+  result.planning_fallback = planning_fallback;
+  result.planning_degradation = watchdog_ ? watchdog_->level() : 0;
+  result.plan_age = plan_age;
+  result.path_cache_hits = path_planner_->pathCache()->hits();
+  result.path_cache_misses = path_planner_->pathCache()->misses();
+  if (path_planner_->rolloutCache()) {
+    result.rollout_cache_hits = path_planner_->rolloutCache()->hits();
+    result.rollout_cache_misses = path_planner_->rolloutCache()->misses();
+  }
+  if (!planning_fallback && !background_planner_) {
+    result.screened_edges = path_planner_->edgeScreening().screenedEdges();
+    result.screened_options = path_planner_->edgeScreening().screenedOptions();
+  }
   populateVehicleMsg(updated_ego, result.ego);
   server_.setSucceeded(result);
 
@@ -146,6 +301,8 @@ void EgoIDMLatticePlanningNode::executeCallback(
 }
 } // End namespace node.
 
+// The nodelet library, see src/node/nodelets.cpp, is built without main().
+#ifndef CLP_NODELET
 int main(int argc, char** argv) {
   ros::init(argc, argv, "~");
   ros::NodeHandle nh("~");
@@ -167,3 +324,4 @@ int main(int argc, char** argv) {
   //ProfilerStop();
   return 0;
 }
+#endif
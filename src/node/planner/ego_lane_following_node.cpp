@@ -45,6 +45,11 @@ bool EgoLaneFollowingNode::initialize() {
   all_param_exist &= nh_.param<std::string>("host", host, "localhost");
   all_param_exist &= nh_.param<int>("port", port, 2000);
 
+  // The directory to cache the waypoints of the map, shared by all nodes.
+  std::string fast_map_cache_directory = "/tmp/conformal_lattice_planner";
+  nh_.param<std::string>("fast_map_cache_directory",
+      fast_map_cache_directory, "/tmp/conformal_lattice_planner");
+
   // Get the world.
   ROS_INFO_NAMED("ego_planner", "connect to the server.");
   client_ = boost::make_shared<CarlaClient>(host, port);
@@ -54,7 +59,16 @@ bool EgoLaneFollowingNode::initialize() {
   // Create world and map.
   world_ = boost::make_shared<CarlaWorld>(client_->GetWorld());
   map_ = world_->GetMap();
-  fast_map_ = boost::make_shared<utils::FastWaypointMap>(map_);
+  fast_map_ = utils::FastWaypointMap::shared(
+      map_, 0.05, fast_map_cache_directory);
+
+  // Connect the waypoints of the whole map, so that the router finds the
+  // next, left, and right waypoints without walking the carla map.
+  router_->setWaypointGraph(utils::WaypointGraph::shared(fast_map_));
+
+  // Sample the lanes on the route once, so that the front waypoints
+  // are not searched on the map every time.
+  router_->buildRouteIndex(map_);
 
   // Start the action server.
   ROS_INFO_NAMED("ego_planner", "start action server.");
@@ -75,6 +89,15 @@ void EgoLaneFollowingNode::executeCallback(
 
   // Create the current snapshot.
   boost::shared_ptr<Snapshot> snapshot = createSnapshot(goal->snapshot);
+  if (!snapshot) {
+    ROS_WARN_NAMED("ego_planner", "missed traffic snapshots, ask for a resync.");
+    conformal_lattice_planner::EgoPlanResult result;
+    result.header.stamp = ros::Time::now();
+    result.success = false;
+    result.resync = true;
+    server_.setAborted(result);
+    return;
+  }
 
   boost::shared_ptr<CarlaWaypoint> ego_waypoint =
     carlaVehicleWaypoint(snapshot->ego().id());
@@ -114,12 +137,12 @@ void EgoLaneFollowingNode::executeCallback(
       updated_transform.rotation.yaw);
 
   // Update the transform of the ego in the simulator.
-  boost::shared_ptr<CarlaVehicle> ego_vehicle = carlaVehicle(snapshot->ego().id());
-  ego_vehicle->SetTransform(updated_transform);
+  updateCarlaVehicleTransform(snapshot->ego().id(), updated_transform);
   //ego_vehicle->SetVelocity(updated_transform.GetForwardVector()*updated_speed);
 
   // Publish the path planned for the ego.
-  path_pub_.publish(createEgoPathMsg(ego_path));
+  if (path_pub_.getNumSubscribers() > 0)
+    path_pub_.publish(createEgoPathMsg(ego_path));
 
   // Inform the client the result of plan.
   planner::Vehicle updated_ego(
@@ -129,7 +152,7 @@ void EgoLaneFollowingNode::executeCallback(
       updated_speed,
       snapshot->ego().policySpeed(),
       ego_accel,
-      utils::curvatureAtWaypoint(map_->GetWaypoint(updated_transform.location), map_));
+      fast_map_->curvature(map_->GetWaypoint(updated_transform.location)));
 
   conformal_lattice_planner::EgoPlanResult result;
   result.header.stamp = ros::Time::now();
@@ -143,6 +166,8 @@ void EgoLaneFollowingNode::executeCallback(
 
 } // End namespace node.
 
+// The nodelet library, see src/node/nodelets.cpp, is built without main().
+#ifndef CLP_NODELET
 int main(int argc, char** argv) {
   ros::init(argc, argv, "~");
   ros::NodeHandle nh("~");
@@ -162,3 +187,4 @@ int main(int argc, char** argv) {
   ros::spin();
   return 0;
 }
+#endif
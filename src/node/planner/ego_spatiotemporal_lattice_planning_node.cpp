@@ -12,8 +12,10 @@
  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <string>
 #include <chrono>
+#include <limits>
 #include <unordered_set>
 #include <boost/timer/timer.hpp>
 #include <gperftools/profiler.h>
@@ -30,6 +32,24 @@ using namespace planner::spatiotemporal_lattice_planner;
 
 namespace node {
 
+namespace {
+
+/// Plan the trajectory of the ego on a snapshot.
+EgoPlan planTraj(SpatiotemporalLatticePlanner& traj_planner,
+                 const Snapshot& snapshot,
+                 const double time_budget) {
+  bool truncated = false;
+  const std::list<std::pair<ContinuousPath, double>> ego_traj =
+    traj_planner.planTraj(snapshot.ego().id(), snapshot, time_budget, truncated);
+
+  DiscretePath path(ego_traj.front().first);
+  for (auto iter = ++(ego_traj.begin()); iter!=ego_traj.end(); ++iter)
+    path.append(iter->first);
+  return EgoPlan{path, ego_traj.front().second, truncated};
+}
+
+} // End anonymous namespace.
+
 bool EgoSpatiotemporalLatticePlanningNode::initialize() {
 
   // Create the publishers.
@@ -39,6 +59,7 @@ bool EgoSpatiotemporalLatticePlanningNode::initialize() {
       "conformal_lattice", 1, true);
   waypoint_lattice_pub_ = nh_.advertise<visualization_msgs::MarkerArray>(
       "waypoint_lattice", 1, true);
+  initializeProfiler();
 
   bool all_param_exist = true;
 
@@ -47,6 +68,56 @@ bool EgoSpatiotemporalLatticePlanningNode::initialize() {
   all_param_exist &= nh_.param<std::string>("host", host, "localhost");
   all_param_exist &= nh_.param<int>("port", port, 2000);
 
+  // The directory to cache the waypoints of the map, shared by all nodes.
+  std::string fast_map_cache_directory = "/tmp/conformal_lattice_planner";
+  nh_.param<std::string>("fast_map_cache_directory",
+      fast_map_cache_directory, "/tmp/conformal_lattice_planner");
+
+  // Seed the path optimization with the solution of the same edge
+  // in the previous planning cycle.
+  bool seed_paths_from_previous_cycle = true;
+  nh_.param<bool>("seed_paths_from_previous_cycle", seed_paths_from_previous_cycle, true);
+
+  // Reuse the simulated graph edges of the previous planning cycle if the
+  // traffic at the start of the edges has barely changed.
+  bool reuse_rollouts = false;
+  nh_.param<bool>("reuse_rollouts", reuse_rollouts, false);
+
+  // Drop the agents which cannot interact with the ego within this time
+  // horizon (s) from the simulations. A non-positive horizon keeps all agents.
+  double relevance_horizon = 0.0;
+  nh_.param<double>("relevance_horizon", relevance_horizon, 0.0);
+
+  // Number of threads used to simulate the acceleration options in parallel.
+  // The calling thread is counted, so 1 means no worker thread.
+  int planning_threads = 1;
+  nh_.param<int>("planning_threads", planning_threads, 1);
+
+  // Prune the vertex graph with branch-and-bound.
+  bool branch_and_bound = false;
+  nh_.param<bool>("branch_and_bound", branch_and_bound, false);
+
+  // Simulate the edges in the event driven mode, which is faster but
+  // approximates the costs of the default stepping mode.
+  bool event_driven_simulation = false;
+  nh_.param<bool>("event_driven_simulation", event_driven_simulation, false);
+
+  // Memory cap (MB) of the vertex graph in each planning cycle.
+  // A non-positive cap means the memory is not limited.
+  double planning_memory_cap = 0.0;
+  nh_.param<double>("planning_memory_cap", planning_memory_cap, 0.0);
+
+  // State buckets at each station. Vertices within the same (speed, time)
+  // bucket are merged, keeping only the non-dominated parents.
+  double speed_resolution = 13.4112;
+  double max_speed = 40.2336;
+  double time_resolution = 1.0;
+  int time_buckets = 1;
+  nh_.param<double>("speed_resolution", speed_resolution, 13.4112);
+  nh_.param<double>("max_speed", max_speed, 40.2336);
+  nh_.param<double>("time_resolution", time_resolution, 1.0);
+  nh_.param<int>("time_buckets", time_buckets, 1);
+
   // Get the world.
   ROS_INFO_NAMED("ego_planner", "connect to the server.");
   client_ = boost::make_shared<CarlaClient>(host, port);
@@ -57,11 +128,66 @@ bool EgoSpatiotemporalLatticePlanningNode::initialize() {
   // Get the world and map.
   world_ = boost::make_shared<CarlaWorld>(client_->GetWorld());
   map_ = world_->GetMap();
-  fast_map_ = boost::make_shared<utils::FastWaypointMap>(map_);
+  fast_map_ = utils::FastWaypointMap::shared(
+      map_, 0.05, fast_map_cache_directory);
+
+  // Connect the waypoints of the whole map, so that the router finds the
+  // next, left, and right waypoints without walking the carla map.
+  router_->setWaypointGraph(utils::WaypointGraph::shared(fast_map_));
+
+  // Sample the lanes on the route once, so that the front waypoints
+  // are not searched on the map every time.
+  router_->buildRouteIndex(map_);
 
   // Initialize the path and speed planner.
-  boost::shared_ptr<router::LoopRouter> router = boost::make_shared<router::LoopRouter>();
-  traj_planner_ = boost::make_shared<planner::SpatiotemporalLatticePlanner>(0.1, 150.0, router, map_, fast_map_);
+  boost::shared_ptr<utils::ThreadPool> thread_pool = nullptr;
+  if (planning_threads > 1)
+    thread_pool = boost::make_shared<utils::ThreadPool>(planning_threads-1);
+  traj_planner_ = boost::make_shared<planner::SpatiotemporalLatticePlanner>(
+      0.1, 150.0, router_, map_, fast_map_, thread_pool, branch_and_bound);
+  traj_planner_->setStateDiscretization(
+      planner::spatiotemporal_lattice_planner::StateDiscretization(
+        speed_resolution, max_speed, time_resolution,
+        static_cast<size_t>(std::max(time_buckets, 1))));
+
+  // The warm start table of the path optimization is cached in the same directory as the map.
+  boost::shared_ptr<planner::PathWarmStartTable> warm_start_table =
+    boost::make_shared<planner::PathWarmStartTable>(fast_map_cache_directory);
+  traj_planner_->pathCache() = boost::make_shared<planner::ContinuousPathCache>(
+      8192, warm_start_table, seed_paths_from_previous_cycle);
+  traj_planner_->costModel() = loadCostModel();
+  traj_planner_->latticeResolution() = loadLatticeResolution();
+  traj_planner_->relevanceHorizon() = relevance_horizon;
+  traj_planner_->eventDrivenSimulation() = event_driven_simulation;
+  if (planning_memory_cap > 0.0)
+    traj_planner_->memoryCap() = static_cast<size_t>(planning_memory_cap*1024.0*1024.0);
+  if (reuse_rollouts)
+    traj_planner_->rolloutCache() = boost::make_shared<planner::RolloutCache>();
+
+  // Fall back to lane following if the planning misses the deadline, and
+  // shorten the planning horizon until the latency recovers. Once degraded,
+  // the intermediate braking options are not simulated either.
+  initializeWatchdog(traj_planner_->spatialHorizon(),
+      [this](const size_t level, const double spatial_horizon) {
+        traj_planner_->setSpatialHorizon(spatial_horizon);
+        const auto& options = traj_planner_->accelerationOptions();
+        for (size_t k = 0; k < options.size(); ++k) {
+          traj_planner_->activeAccelerationOptions()[k] =
+            level == 0 || (options[k] != -4.0 && options[k] != -1.0);
+        }
+      });
+
+  // Replan continuously in the background if async planning is enabled.
+  // The planner is held by the planning function, since the planner
+  // thread is only stopped after the members of this node are destroyed.
+  double planning_time_budget = 0.0;
+  nh_.param<double>("planning_time_budget", planning_time_budget, 0.0);
+  if (planning_time_budget <= 0.0)
+    planning_time_budget = std::numeric_limits<double>::infinity();
+  initializeBackgroundPlanner(
+      [traj_planner = traj_planner_, planning_time_budget](const Snapshot& snapshot) {
+        return planTraj(*traj_planner, snapshot, planning_time_budget);
+      });
 
   // Start the action server.
   ROS_INFO_NAMED("ego_planner", "start action server.");
@@ -75,6 +201,7 @@ void EgoSpatiotemporalLatticePlanningNode::executeCallback(
     const conformal_lattice_planner::EgoPlanGoalConstPtr& goal) {
 
   ROS_INFO_NAMED("ego_planner", "executeCallback()");
+  beginProfileCycle();
 
   // Update the carla world and map.
   world_ = boost::make_shared<CarlaWorld>(client_->GetWorld());
@@ -82,32 +209,56 @@ void EgoSpatiotemporalLatticePlanningNode::executeCallback(
 
   // Create the current snapshot.
   boost::shared_ptr<Snapshot> snapshot = createSnapshot(goal->snapshot);
+  if (!snapshot) {
+    ROS_WARN_NAMED("ego_planner", "missed traffic snapshots, ask for a resync.");
+    conformal_lattice_planner::EgoPlanResult result;
+    result.header.stamp = ros::Time::now();
+    result.success = false;
+    result.resync = true;
+    server_.setAborted(result);
+    return;
+  }
+
+  // The planning time budget of each cycle.
+  // A non-positive budget means the planning time is not limited.
+  double planning_time_budget = 0.0;
+  nh_.param<double>("planning_time_budget", planning_time_budget, 0.0);
+  if (planning_time_budget <= 0.0)
+    planning_time_budget = std::numeric_limits<double>::infinity();
 
-  // Plan the ego trajectory.
+  // Plan the ego trajectory, either in the background or in this callback.
+  // The planning in this callback owns what it uses, since it may outlive
+  // the callback if it misses the deadline of the watchdog.
   ros::Time start_time = ros::Time::now();
-  const std::list<std::pair<ContinuousPath, double>> ego_traj =
-    traj_planner_->planTraj(snapshot->ego().id(), *snapshot);
+  bool planning_fallback = false;
+  double plan_age = 0.0;
+  const EgoPlan ego_plan = background_planner_ ?
+    planEgoAsync(snapshot, plan_age, planning_fallback) :
+    planEgo([traj_planner = traj_planner_, snapshot, planning_time_budget]() {
+              return planTraj(*traj_planner, *snapshot, planning_time_budget);
+            }, *snapshot, planning_fallback);
   ros::Duration traj_planning_time = ros::Time::now() - start_time;
 
-  DiscretePath ego_path(ego_traj.front().first);
-  for (auto iter = ++(ego_traj.begin()); iter!=ego_traj.end(); ++iter)
-    ego_path.append(iter->first);
+  const DiscretePath& ego_path = ego_plan.path;
+  const double ego_accel = ego_plan.accel;
+  const bool planning_truncated = ego_plan.truncated;
 
   // Publish the vertex graph.
   //conformal_lattice_pub_.publish(createConformalLatticeMsg(
   //      traj_planner_->nodes(), traj_planner_->edges()));
-  path_pub_.publish(createEgoPathMsg(ego_path));
+  if (path_pub_.getNumSubscribers() > 0)
+    path_pub_.publish(createEgoPathMsg(ego_path));
   //waypoint_lattice_pub_.publish(createWaypointLatticeMsg(traj_planner_->waypointLattice()));
 
-  // Plan speed.
-  const double ego_accel = ego_traj.front().second;
+  endProfileCycle();
 
   // Update the ego vehicle in the simulator.
   double dt = 0.05;
   nh_.param<double>("fixed_delta_seconds", dt, 0.05);
 
   const double movement = snapshot->ego().speed()*dt + 0.5*ego_accel*dt*dt;
-  const std::pair<CarlaTransform, double> updated_transform_curvature = ego_path.transformAt(movement);
+  const std::pair<CarlaTransform, double> updated_transform_curvature =
+    ego_path.transformAt(ego_plan.start+movement);
   const CarlaTransform updated_transform = updated_transform_curvature.first;
   const double updated_curvature = updated_transform_curvature.second;
   const double updated_speed = snapshot->ego().speed() + ego_accel*dt;
@@ -116,6 +267,34 @@ void EgoSpatiotemporalLatticePlanningNode::executeCallback(
   ROS_INFO_NAMED("ego_planner", "movement:%f", movement);
   ROS_INFO_NAMED("ego_planner", "acceleration:%f", ego_accel);
   ROS_INFO_NAMED("ego_planner", "speed:%f", updated_speed);
+  ROS_INFO_NAMED("ego_planner", "planning time:%f truncated:%d fallback:%d degradation:%lu plan age:%f",
+      traj_planning_time.toSec(), planning_truncated, planning_fallback,
+      watchdog_ ? watchdog_->level() : 0, plan_age);
+  ROS_INFO_NAMED("ego_planner", "path cache hits:%lu misses:%lu failures:%lu",
+      traj_planner_->pathCache()->hits(),
+      traj_planner_->pathCache()->misses(),
+      traj_planner_->pathCache()->failures());
+  if (traj_planner_->rolloutCache()) {
+    ROS_INFO_NAMED("ego_planner", "rollout cache hits:%lu misses:%lu",
+        traj_planner_->rolloutCache()->hits(),
+        traj_planner_->rolloutCache()->misses());
+  }
+  // The vertex graph is not touched if the planner may still be running,
+  // i.e. the fallback is used or the planner runs in the background.
+  if (!planning_fallback && !background_planner_) {
+    ROS_INFO_NAMED("ego_planner", "vertices expanded:%lu pruned:%lu",
+        traj_planner_->expandedVertices(),
+        traj_planner_->prunedVertices());
+    ROS_INFO_NAMED("ego_planner", "edges screened:%lu options screened:%lu",
+        traj_planner_->edgeScreening().screenedEdges(),
+        traj_planner_->edgeScreening().screenedOptions());
+    ROS_INFO_NAMED("ego_planner", "graph vertices:%lu snapshots:%lu bytes:%lu peak:%lu capped:%d",
+        traj_planner_->verticesSize(),
+        traj_planner_->graphMemory().snapshots(),
+        traj_planner_->graphMemory().bytes(),
+        traj_planner_->graphMemory().peakBytes(),
+        traj_planner_->memoryCapped());
+  }
   ROS_INFO_NAMED("ego_planner", "transform: x:%f y:%f z:%f r:%f p:%f y:%f",
       updated_transform.location.x,
       updated_transform.location.y,
@@ -124,8 +303,7 @@ void EgoSpatiotemporalLatticePlanningNode::executeCallback(
       updated_transform.rotation.pitch,
       updated_transform.rotation.yaw);
 
-  boost::shared_ptr<CarlaVehicle> ego_vehicle = carlaVehicle(snapshot->ego().id());
-  ego_vehicle->SetTransform(updated_transform);
+  updateCarlaVehicleTransform(snapshot->ego().id(), updated_transform);
   //ego_vehicle->SetVelocity(updated_transform.GetForwardVector()*updated_speed);
 
   // Inform the client the result of plan.
@@ -143,6 +321,27 @@ void EgoSpatiotemporalLatticePlanningNode::executeCallback(
   result.success = true;
   result.path_type = ego_path.laneChangeType();
   result.planning_time = traj_planning_time.toSec();
+  result.planning_truncated = planning_truncated;
+  result.planning_fallback = planning_fallback;
+  result.planning_degradation = watchdog_ ? watchdog_->level() : 0;
+  result.plan_age = plan_age;
+  result.path_cache_hits = traj_planner_->pathCache()->hits();
+  result.path_cache_misses = traj_planner_->pathCache()->misses();
+  if (traj_planner_->rolloutCache()) {
+    result.rollout_cache_hits = traj_planner_->rolloutCache()->hits();
+    result.rollout_cache_misses = traj_planner_->rolloutCache()->misses();
+  }
+  if (!planning_fallback && !background_planner_) {
+    result.expanded_vertices = traj_planner_->expandedVertices();
+    result.pruned_vertices = traj_planner_->prunedVertices();
+    result.screened_edges = traj_planner_->edgeScreening().screenedEdges();
+    result.screened_options = traj_planner_->edgeScreening().screenedOptions();
+    result.graph_vertices = traj_planner_->verticesSize();
+    result.graph_snapshots = traj_planner_->graphMemory().snapshots();
+    result.graph_bytes = traj_planner_->graphMemory().bytes();
+    result.peak_graph_bytes = traj_planner_->graphMemory().peakBytes();
+    result.planning_memory_capped = traj_planner_->memoryCapped();
+  }
   populateVehicleMsg(updated_ego, result.ego);
   server_.setSucceeded(result);
 
@@ -150,6 +349,8 @@ void EgoSpatiotemporalLatticePlanningNode::executeCallback(
 }
 } // End namespace node.
 
+// The nodelet library, see src/node/nodelets.cpp, is built without main().
+#ifndef CLP_NODELET
 int main(int argc, char** argv) {
   ros::init(argc, argv, "~");
   ros::NodeHandle nh("~");
@@ -171,3 +372,4 @@ int main(int argc, char** argv) {
   //ProfilerStop();
   return 0;
 }
+#endif
@@ -0,0 +1,567 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/**
+ * Offline benchmark of the lattice planners.
+ *
+ * The map is loaded from an OpenDRIVE file, and the traffic snapshots are
+ * read from a traffic log or a bag, so that neither a carla server nor a
+ * ROS master is required. The traffic log is the one recorded by the
+ * simulator nodes, see \c planner::TrafficLog. The bag may contain either
+ * \c TrafficSnapshot msgs or the \c EgoPlan action goals sent by the simulator. The snapshots are rebuilt
+ * in the same way as \c PlanningNode::createSnapshot(), and planned in
+ * the recorded order so that the lattice is reused across cycles as it
+ * is in the simulation.
+ *
+ * Usage:
+ *   planner_benchmarks <map.xodr> <snapshots> [planner] [repetitions] [planning_threads]
+ *
+ * where \c planner is one of \c idm, \c slc, \c spatiotemporal, \c rollouts,
+ * \c batch, or \c all. With \c rollouts, the throughput of the traffic simulators
+ * used by the planners is measured instead of the planning time. With \c batch,
+ * the snapshots are planned independently and concurrently by all planners,
+ * and the planning threads are used across the snapshots.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <tuple>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/timer/timer.hpp>
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+#include <carla/client/Map.h>
+
+#include <router/loop_router/loop_router.h>
+#include <planner/common/snapshot.h>
+#include <planner/common/fast_waypoint_map.h>
+#include <planner/common/thread_pool.h>
+#include <planner/common/traffic_log.h>
+#include <planner/common/monte_carlo_rollouts.h>
+#include <planner/common/batch_planner.h>
+#include <planner/idm_lattice_planner/idm_lattice_planner.h>
+#include <planner/slc_lattice_planner/slc_lattice_planner.h>
+#include <planner/spatiotemporal_lattice_planner/spatiotemporal_lattice_planner.h>
+#include <node/common/convert_snapshot_msgs.h>
+#include <node/common/load_map.h>
+
+#include <conformal_lattice_planner/TrafficSnapshot.h>
+#include <conformal_lattice_planner/EgoPlanActionGoal.h>
+
+using CarlaMap = carla::client::Map;
+using TrafficSnapshotMsg = conformal_lattice_planner::TrafficSnapshot;
+
+namespace {
+
+/// Statistics of one planning cycle.
+struct CycleStats {
+  /// Time of creating the snapshot from the msg (s).
+  double snapshot_time = 0.0;
+  /// Time of planning on the snapshot (s).
+  double planning_time = 0.0;
+  /// Number of nodes in the graph.
+  size_t nodes = 0;
+  /// Number of edges in the graph.
+  size_t edges = 0;
+  /// Bytes of the graph objects allocated in the cycle.
+  size_t graph_bytes = 0;
+};
+
+/// Plan on a snapshot.
+using PlanningFunction = std::function<void(const planner::Snapshot&)>;
+
+/// Get the number of nodes and edges of the graph of the last planning cycle.
+using GraphSizeFunction = std::function<std::pair<size_t, size_t>()>;
+
+/// Environment shared by all the planners.
+struct Environment {
+  boost::shared_ptr<router::LoopRouter> router = nullptr;
+  boost::shared_ptr<CarlaMap> map = nullptr;
+  boost::shared_ptr<utils::FastWaypointMap> fast_map = nullptr;
+  boost::shared_ptr<utils::ThreadPool> thread_pool = nullptr;
+};
+
+std::vector<TrafficSnapshotMsg> loadSnapshotMsgs(const std::string& filename) {
+
+  std::vector<TrafficSnapshotMsg> snapshot_msgs;
+
+  // Traffic logs recorded by the simulator nodes.
+  if (planner::TrafficLog::isTrafficLog(filename)) {
+    planner::TrafficLogReader traffic_log(filename);
+    planner::TrafficLogFrame frame;
+    while (traffic_log.read(frame)) {
+      snapshot_msgs.emplace_back();
+      node::populateVehicleMsg(frame.ego, snapshot_msgs.back().ego);
+      for (const auto& item : frame.agents) {
+        snapshot_msgs.back().agents.emplace_back();
+        node::populateVehicleMsg(item.second, snapshot_msgs.back().agents.back());
+      }
+    }
+  } else {
+    // Bags of the snapshot msgs or the ego planner goals.
+    rosbag::Bag bag(filename, rosbag::bagmode::Read);
+    rosbag::View view(bag);
+
+    for (const rosbag::MessageInstance& msg : view) {
+      conformal_lattice_planner::TrafficSnapshot::ConstPtr snapshot_msg =
+        msg.instantiate<TrafficSnapshotMsg>();
+      if (snapshot_msg) {
+        snapshot_msgs.push_back(*snapshot_msg);
+        continue;
+      }
+
+      conformal_lattice_planner::EgoPlanActionGoal::ConstPtr goal_msg =
+        msg.instantiate<conformal_lattice_planner::EgoPlanActionGoal>();
+      if (goal_msg) snapshot_msgs.push_back(goal_msg->goal.snapshot);
+    }
+    bag.close();
+  }
+
+  if (snapshot_msgs.empty()) {
+    throw std::runtime_error((boost::format(
+          "loadSnapshotMsgs(): no traffic snapshot is found in %1%.\n") % filename).str());
+  }
+  return snapshot_msgs;
+}
+
+/// Get the element at the given percentile, with the nearest rank method.
+double percentile(std::vector<double> values, const double p) {
+  if (values.empty()) return std::numeric_limits<double>::quiet_NaN();
+  std::sort(values.begin(), values.end());
+  const size_t rank = static_cast<size_t>(std::ceil(p*values.size()));
+  return values[std::max<size_t>(rank, 1) - 1];
+}
+
+double mean(const std::vector<double>& values) {
+  if (values.empty()) return std::numeric_limits<double>::quiet_NaN();
+  return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+}
+
+void report(const std::string& name,
+            const std::vector<CycleStats>& stats,
+            const size_t failures) {
+
+  std::vector<double> snapshot_times, planning_times, nodes, edges, graph_kbytes;
+  for (const CycleStats& cycle : stats) {
+    snapshot_times.push_back(cycle.snapshot_time*1.0e3);
+    planning_times.push_back(cycle.planning_time*1.0e3);
+    nodes.push_back(cycle.nodes);
+    edges.push_back(cycle.edges);
+    graph_kbytes.push_back(cycle.graph_bytes/1024.0);
+  }
+
+  std::printf("%s: cycles: %lu failures: %lu\n", name.c_str(), stats.size(), failures);
+  std::printf("  snapshot time (ms): mean: %.3f p50: %.3f p99: %.3f\n",
+      mean(snapshot_times), percentile(snapshot_times, 0.5), percentile(snapshot_times, 0.99));
+  std::printf("  planning time (ms): mean: %.3f p50: %.3f p99: %.3f max: %.3f\n",
+      mean(planning_times), percentile(planning_times, 0.5), percentile(planning_times, 0.99),
+      percentile(planning_times, 1.0));
+  std::printf("  nodes: mean: %.1f p50: %.0f p99: %.0f\n",
+      mean(nodes), percentile(nodes, 0.5), percentile(nodes, 0.99));
+  std::printf("  edges: mean: %.1f p50: %.0f p99: %.0f\n",
+      mean(edges), percentile(edges, 0.5), percentile(edges, 0.99));
+  std::printf("  graph allocation (KB): mean: %.1f p50: %.1f p99: %.1f\n",
+      mean(graph_kbytes), percentile(graph_kbytes, 0.5), percentile(graph_kbytes, 0.99));
+  return;
+}
+
+/**
+ * \brief Run one planner through all the snapshot msgs.
+ *
+ * \param[in] snapshot_msgs The recorded snapshot msgs, in the recorded order.
+ * \param[in] env The map and router shared by all the planners.
+ * \param[in] path_planner The planner, used to get the graph allocation.
+ * \param[in] plan Plan on a snapshot with the planner.
+ * \param[in] graph_size Get the graph size of the planner, which is not timed.
+ * \param[out] stats The statistics of the successful cycles.
+ * \return The number of failed cycles.
+ */
+size_t run(const std::vector<TrafficSnapshotMsg>& snapshot_msgs,
+           const Environment& env,
+           const planner::VehiclePathPlanner& path_planner,
+           const PlanningFunction& plan,
+           const GraphSizeFunction& graph_size,
+           std::vector<CycleStats>& stats) {
+
+  size_t failures = 0;
+  for (const TrafficSnapshotMsg& snapshot_msg : snapshot_msgs) {
+    CycleStats cycle;
+    try {
+      boost::timer::cpu_timer snapshot_timer;
+      boost::shared_ptr<planner::Snapshot> snapshot = node::createSnapshot(
+          snapshot_msg, env.router, env.map, env.fast_map);
+      cycle.snapshot_time = snapshot_timer.elapsed().wall*1.0e-9;
+
+      boost::timer::cpu_timer planning_timer;
+      plan(*snapshot);
+      cycle.planning_time = planning_timer.elapsed().wall*1.0e-9;
+
+      std::tie(cycle.nodes, cycle.edges) = graph_size();
+      cycle.graph_bytes = path_planner.graphArena()->allocatedBytes();
+      stats.push_back(cycle);
+
+    } catch (const std::exception& e) {
+      std::fprintf(stderr, "%s", e.what());
+      ++failures;
+    }
+  }
+
+  return failures;
+}
+
+void benchmarkIDMLatticePlanner(
+    const std::vector<TrafficSnapshotMsg>& snapshot_msgs,
+    const Environment& env,
+    const size_t repetitions) {
+
+  std::vector<CycleStats> stats;
+  size_t failures = 0;
+
+  // A new planner is created for every repetition, so that the lattice
+  // is not carried over from the end of the recording to its start.
+  for (size_t i = 0; i < repetitions; ++i) {
+    planner::IDMLatticePlanner path_planner(
+        0.1, 150.0, env.router, env.map, env.fast_map, env.thread_pool);
+    PlanningFunction plan = [&path_planner](const planner::Snapshot& snapshot) {
+      path_planner.planPath(snapshot.ego().id(), snapshot);
+    };
+    GraphSizeFunction graph_size = [&path_planner]() {
+      return std::make_pair(path_planner.nodes().size(), path_planner.edges().size());
+    };
+    failures += run(snapshot_msgs, env, path_planner, plan, graph_size, stats);
+  }
+
+  report("idm lattice planner", stats, failures);
+  return;
+}
+
+void benchmarkSLCLatticePlanner(
+    const std::vector<TrafficSnapshotMsg>& snapshot_msgs,
+    const Environment& env,
+    const size_t repetitions) {
+
+  std::vector<CycleStats> stats;
+  size_t failures = 0;
+
+  for (size_t i = 0; i < repetitions; ++i) {
+    planner::SLCLatticePlanner path_planner(
+        0.1, 150.0, env.router, env.map, env.fast_map, env.thread_pool);
+    PlanningFunction plan = [&path_planner](const planner::Snapshot& snapshot) {
+      path_planner.planPath(snapshot.ego().id(), snapshot);
+    };
+    GraphSizeFunction graph_size = [&path_planner]() {
+      return std::make_pair(path_planner.nodes().size(), path_planner.edges().size());
+    };
+    failures += run(snapshot_msgs, env, path_planner, plan, graph_size, stats);
+  }
+
+  report("slc lattice planner", stats, failures);
+  return;
+}
+
+void benchmarkSpatiotemporalLatticePlanner(
+    const std::vector<TrafficSnapshotMsg>& snapshot_msgs,
+    const Environment& env,
+    const size_t repetitions) {
+
+  std::vector<CycleStats> stats;
+  size_t failures = 0;
+
+  for (size_t i = 0; i < repetitions; ++i) {
+    planner::SpatiotemporalLatticePlanner traj_planner(
+        0.1, 150.0, env.router, env.map, env.fast_map, env.thread_pool);
+    PlanningFunction plan = [&traj_planner](const planner::Snapshot& snapshot) {
+      traj_planner.planTraj(snapshot.ego().id(), snapshot);
+    };
+    GraphSizeFunction graph_size = [&traj_planner]() {
+      return std::make_pair(traj_planner.nodes().size(), traj_planner.edges().size());
+    };
+    failures += run(snapshot_msgs, env, traj_planner, plan, graph_size, stats);
+  }
+
+  report("spatiotemporal lattice planner", stats, failures);
+  return;
+}
+
+/**
+ * \brief Measure the rollout throughput of a traffic simulator.
+ *
+ * \param[in] name The name of the simulator in the report.
+ * \param[in] rollouts The snapshots and the ego paths to be simulated.
+ * \param[in] env The map and router shared by all the planners.
+ * \param[in] repetitions The number of times every rollout is repeated.
+ */
+template<typename Simulator>
+void benchmarkRollouts(
+    const std::string& name,
+    const std::vector<std::pair<boost::shared_ptr<planner::Snapshot>,
+                                boost::shared_ptr<planner::ContinuousPath>>>& rollouts,
+    const Environment& env,
+    const size_t repetitions) {
+
+  size_t simulations = 0;
+  size_t collisions = 0;
+  size_t failures = 0;
+  double simulated_time = 0.0;
+
+  boost::timer::cpu_timer timer;
+  for (size_t i = 0; i < repetitions; ++i) {
+    for (const auto& rollout : rollouts) {
+      Simulator simulator(*(rollout.first), env.map, env.fast_map);
+      double time = 0.0; double cost = 0.0;
+      try {
+        if (!simulator.simulate(*(rollout.second), 0.1, 5.0, time, cost)) ++collisions;
+        else simulated_time += time;
+      } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s", e.what());
+        ++failures;
+      }
+      ++simulations;
+    }
+  }
+  const double wall_time = timer.elapsed().wall*1.0e-9;
+
+  std::printf("%s: rollouts: %lu collisions: %lu failures: %lu\n",
+      name.c_str(), simulations, collisions, failures);
+  std::printf("  rollout time (us): mean: %.3f\n", wall_time/simulations*1.0e6);
+  std::printf("  throughput: %.1f rollouts/s %.1f simulated s/s\n",
+      simulations/wall_time, simulated_time/wall_time);
+  return;
+}
+
+/**
+ * \brief Measure the throughput of evaluating the rollouts against sampled
+ *        hypotheses of the agent behaviours.
+ *
+ * \param[in] rollouts The snapshots and the ego paths to be simulated.
+ * \param[in] env The map and router shared by all the planners.
+ * \param[in] samples The number of hypotheses for every rollout.
+ */
+void benchmarkMonteCarloRollouts(
+    const std::vector<std::pair<boost::shared_ptr<planner::Snapshot>,
+                                boost::shared_ptr<planner::ContinuousPath>>>& rollouts,
+    const Environment& env,
+    const size_t samples) {
+
+  planner::MonteCarloRollouts<planner::idm_lattice_planner::IDMTrafficSimulator>
+    monte_carlo(env.map, env.fast_map, env.thread_pool);
+  std::mt19937 rand_gen(0);
+
+  std::vector<double> collision_rates;
+  std::vector<double> cost_spreads;
+
+  boost::timer::cpu_timer timer;
+  for (const auto& rollout : rollouts) {
+    const planner::AgentHypotheses hypotheses(*(rollout.first), samples, rand_gen);
+    const auto result = monte_carlo.simulate(
+        *(rollout.first), hypotheses, *(rollout.second), 0.1, 5.0);
+    collision_rates.push_back(result.collisionRate());
+    if (result.collisions < result.samples)
+      cost_spreads.push_back(result.worst_cost-result.expected_cost);
+  }
+  const double wall_time = timer.elapsed().wall*1.0e-9;
+
+  std::printf("idm traffic simulator with %lu hypotheses: rollouts: %lu\n",
+      samples, rollouts.size());
+  std::printf("  rollout time (us): mean: %.3f\n", wall_time/rollouts.size()*1.0e6);
+  std::printf("  collision rate: mean: %.3f worst - expected cost: mean: %.3f\n",
+      mean(collision_rates), mean(cost_spreads));
+  return;
+}
+
+/**
+ * \brief Measure the rollout throughput of the traffic simulators of all planners.
+ *
+ * For every snapshot, the ego is simulated along a keep lane path to the
+ * waypoint 50m ahead on the route, with the time step and the horizon of the
+ * planners. Only the simulation is timed, not the creation of the paths.
+ */
+void benchmarkTrafficSimulators(
+    const std::vector<TrafficSnapshotMsg>& snapshot_msgs,
+    const Environment& env,
+    const size_t repetitions) {
+
+  std::vector<std::pair<boost::shared_ptr<planner::Snapshot>,
+                        boost::shared_ptr<planner::ContinuousPath>>> rollouts;
+
+  for (const TrafficSnapshotMsg& snapshot_msg : snapshot_msgs) {
+    try {
+      boost::shared_ptr<planner::Snapshot> snapshot = node::createSnapshot(
+          snapshot_msg, env.router, env.map, env.fast_map);
+
+      boost::shared_ptr<carla::client::Waypoint> start =
+        env.fast_map->waypoint(snapshot->ego().transform().location);
+      boost::shared_ptr<carla::client::Waypoint> end =
+        env.router->tryFrontWaypoint(start, 50.0);
+      if (!end) continue;
+
+      boost::shared_ptr<planner::ContinuousPath> path =
+        boost::make_shared<planner::ContinuousPath>(
+            std::make_pair(snapshot->ego().transform(), snapshot->ego().curvature()),
+            std::make_pair(end->GetTransform(), env.fast_map->curvature(end)),
+            planner::ContinuousPath::LaneChangeType::KeepLane);
+      rollouts.emplace_back(snapshot, path);
+
+    } catch (const std::exception& e) {
+      std::fprintf(stderr, "%s", e.what());
+    }
+  }
+
+  benchmarkRollouts<planner::idm_lattice_planner::IDMTrafficSimulator>(
+      "idm traffic simulator", rollouts, env, repetitions);
+  benchmarkRollouts<planner::slc_lattice_planner::SLCTrafficSimulator>(
+      "slc traffic simulator", rollouts, env, repetitions);
+  benchmarkRollouts<planner::spatiotemporal_lattice_planner::ConstAccelTrafficSimulator>(
+      "const accel traffic simulator", rollouts, env, repetitions);
+  benchmarkMonteCarloRollouts(rollouts, env, 8);
+  return;
+}
+
+/**
+ * \brief Measure the throughput of planning the snapshots as a batch of
+ *        independent snapshots, see \c planner::BatchPlanner.
+ *
+ * Different from the other planner benchmarks, the snapshots are planned
+ * concurrently on the thread pool, each with a new planner, instead of in
+ * the recorded order with one planner.
+ */
+template<typename Planner>
+void benchmarkBatchPlanning(
+    const std::string& name,
+    const std::vector<planner::Snapshot>& snapshots,
+    const Environment& env,
+    const size_t repetitions) {
+
+  planner::BatchPlanner<Planner> batch_planner([&env]() {
+    return boost::make_shared<Planner>(0.1, 150.0, env.router, env.map, env.fast_map);
+  }, env.thread_pool);
+
+  std::vector<double> planning_times;
+  size_t failures = 0;
+
+  boost::timer::cpu_timer timer;
+  for (size_t i = 0; i < repetitions; ++i) {
+    for (const auto& outcome : batch_planner.plan(snapshots)) {
+      if (!outcome.result) {
+        std::fprintf(stderr, "%s", outcome.error.c_str());
+        ++failures;
+        continue;
+      }
+      planning_times.push_back(outcome.planning_time*1.0e3);
+    }
+  }
+  const double wall_time = timer.elapsed().wall*1.0e-9;
+
+  std::printf("%s batch: snapshots: %lu failures: %lu\n",
+      name.c_str(), snapshots.size()*repetitions, failures);
+  std::printf("  planning time (ms): mean: %.3f p50: %.3f p99: %.3f\n",
+      mean(planning_times), percentile(planning_times, 0.5), percentile(planning_times, 0.99));
+  std::printf("  throughput: %.1f snapshots/s\n", snapshots.size()*repetitions/wall_time);
+  return;
+}
+
+void benchmarkBatchPlanning(
+    const std::vector<TrafficSnapshotMsg>& snapshot_msgs,
+    const Environment& env,
+    const size_t repetitions) {
+
+  std::vector<planner::Snapshot> snapshots;
+  for (const TrafficSnapshotMsg& snapshot_msg : snapshot_msgs) {
+    try {
+      snapshots.push_back(*node::createSnapshot(
+            snapshot_msg, env.router, env.map, env.fast_map));
+    } catch (const std::exception& e) {
+      std::fprintf(stderr, "%s", e.what());
+    }
+  }
+
+  benchmarkBatchPlanning<planner::IDMLatticePlanner>(
+      "idm lattice planner", snapshots, env, repetitions);
+  benchmarkBatchPlanning<planner::SLCLatticePlanner>(
+      "slc lattice planner", snapshots, env, repetitions);
+  benchmarkBatchPlanning<planner::SpatiotemporalLatticePlanner>(
+      "spatiotemporal lattice planner", snapshots, env, repetitions);
+  return;
+}
+
+} // End anonymous namespace.
+
+int main(int argc, char** argv) {
+
+  if (argc < 3) {
+    std::fprintf(stderr,
+        "Usage: %s <map.xodr> <traffic log or bag> "
+        "[idm|slc|spatiotemporal|rollouts|batch|all] [repetitions] [planning_threads]\n", argv[0]);
+    return 1;
+  }
+
+  const std::string map_filename = argv[1];
+  const std::string bag_filename = argv[2];
+  const std::string planner_name = argc > 3 ? argv[3] : "all";
+  const size_t repetitions = argc > 4 ? std::max(std::atoi(argv[4]), 1) : 1;
+  const size_t planning_threads = argc > 5 ? std::max(std::atoi(argv[5]), 1) : 1;
+
+  if (planner_name != "idm" && planner_name != "slc" &&
+      planner_name != "spatiotemporal" && planner_name != "rollouts" &&
+      planner_name != "batch" && planner_name != "all") {
+    std::fprintf(stderr, "Unknown planner: %s\n", planner_name.c_str());
+    return 1;
+  }
+
+  // Prepare the map, the same as the planning nodes.
+  Environment env;
+  {
+    boost::timer::cpu_timer timer;
+    env.map = node::loadMap(map_filename);
+    env.fast_map = boost::make_shared<utils::FastWaypointMap>(
+        env.map, 0.05, "/tmp/conformal_lattice_planner");
+    env.router = boost::make_shared<router::LoopRouter>();
+    env.router->setWaypointGraph(
+        boost::make_shared<const utils::WaypointGraph>(env.fast_map));
+    env.router->buildRouteIndex(env.map);
+    if (planning_threads > 1)
+      env.thread_pool = boost::make_shared<utils::ThreadPool>(planning_threads-1);
+    std::printf("map preparation: %fs\n", timer.elapsed().wall*1.0e-9);
+  }
+
+  const std::vector<TrafficSnapshotMsg> snapshot_msgs = loadSnapshotMsgs(bag_filename);
+  std::printf("snapshots: %lu repetitions: %lu planning threads: %lu\n",
+      snapshot_msgs.size(), repetitions, planning_threads);
+
+  if (planner_name == "idm" || planner_name == "all")
+    benchmarkIDMLatticePlanner(snapshot_msgs, env, repetitions);
+  if (planner_name == "slc" || planner_name == "all")
+    benchmarkSLCLatticePlanner(snapshot_msgs, env, repetitions);
+  if (planner_name == "spatiotemporal" || planner_name == "all")
+    benchmarkSpatiotemporalLatticePlanner(snapshot_msgs, env, repetitions);
+  if (planner_name == "rollouts" || planner_name == "all")
+    benchmarkTrafficSimulators(snapshot_msgs, env, repetitions);
+  if (planner_name == "batch" || planner_name == "all")
+    benchmarkBatchPlanning(snapshot_msgs, env, repetitions);
+
+  return 0;
+}
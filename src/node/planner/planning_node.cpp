@@ -12,124 +12,237 @@
  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-#include <tf2/LinearMath/Quaternion.h>
-#include <tf2/LinearMath/Matrix3x3.h>
-#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
+#include <string>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <boost/format.hpp>
 
+#include <planner/common/vehicle_speed_planner.h>
+#include <planner/lane_follower/lane_follower.h>
+#include <node/common/convert_snapshot_msgs.h>
 #include <node/planner/planning_node.h>
 
 namespace node {
 
-boost::shared_ptr<planner::Snapshot> PlanningNode::createSnapshot(
-    const conformal_lattice_planner::TrafficSnapshot& snapshot_msg) {
+void PlanningNode::initializeProfiler() {
+  if (!utils::Profiler::kEnabled) return;
+
+  profile_pub_ = nh_.advertise<conformal_lattice_planner::PlanningProfile>(
+      "planning_profile", 10);
+
+  std::string profile_trace;
+  nh_.param<std::string>("profile_trace", profile_trace, "");
+  if (!profile_trace.empty())
+    profile_trace_ = boost::make_shared<utils::ChromeTraceWriter>(profile_trace);
+
+  return;
+}
+
+void PlanningNode::endProfileCycle() {
+  if (!utils::Profiler::kEnabled) return;
 
-  // Create the ego vehicle.
-  planner::Vehicle ego_vehicle;
-  populateVehicleObj(snapshot_msg.ego, ego_vehicle);
-
-  if (ego_vehicle.transform().location.x==0.0 &&
-      ego_vehicle.transform().location.y==0.0 &&
-      ego_vehicle.transform().location.z==0.0) {
-    std::string error_msg(
-        "PlanningNode::createSnapshot(): "
-        "ego vehicle is set back to origin.\n");
-    std::string ego_msg = (
-        boost::format("Ego ID: %lu\n") % ego_vehicle.id()).str();
-    throw std::runtime_error(error_msg + ego_msg);
+  utils::Profiler& profiler = utils::Profiler::instance();
+  profiler.endCycle();
+
+  conformal_lattice_planner::PlanningProfile profile_msg;
+  profile_msg.header.stamp = ros::Time::now();
+  profile_msg.cycle_time = profiler.cycleTime();
+
+  for (const auto& entry : profiler.breakdown()) {
+    profile_msg.scopes.push_back(entry.path);
+    profile_msg.calls.push_back(entry.calls);
+    profile_msg.times.push_back(entry.time);
   }
 
-  // Create the agent vehicles.
-  std::unordered_map<size_t, planner::Vehicle> agent_vehicles;
-  for (const auto& agent : snapshot_msg.agents) {
-    planner::Vehicle agent_vehicle;
-    populateVehicleObj(agent, agent_vehicle);
-
-    if (agent_vehicle.transform().location.x==0.0 &&
-        agent_vehicle.transform().location.y==0.0 &&
-        agent_vehicle.transform().location.z==0.0) {
-      std::string error_msg(
-          "PlanningNode::createSnapshot(): "
-          "an agent vehicle is set back to origin.\n");
-      std::string agent_msg = (
-          boost::format("Agent ID: %lu\n") % agent_vehicle.id()).str();
-      throw std::runtime_error(error_msg + agent_msg);
-    }
+  for (const auto& counter : profiler.counters()) {
+    profile_msg.counters.push_back(counter.first);
+    profile_msg.counts.push_back(counter.second);
+  }
+
+  profile_pub_.publish(profile_msg);
+  if (profile_trace_) profile_trace_->write(profiler);
+
+  return;
+}
+
+boost::shared_ptr<const planner::CostModel> PlanningNode::loadCostModel() const {
+
+  auto loadStepCost = [this](const std::string& name, planner::StepCost& cost)->void{
+    double bin_width = cost.binWidth();
+    std::vector<double> costs = cost.costs();
+    double overflow_cost = cost.overflowCost();
+    nh_.param<double>("cost_model/"+name+"/bin_width", bin_width, bin_width);
+    nh_.param<std::vector<double>>("cost_model/"+name+"/costs", costs, costs);
+    nh_.param<double>("cost_model/"+name+"/overflow_cost", overflow_cost, overflow_cost);
+    cost = planner::StepCost(bin_width, costs, overflow_cost);
+    return;
+  };
+
+  auto loadCost = [this](const std::string& name, double& cost)->void{
+    nh_.param<double>("cost_model/"+name, cost, cost);
+    return;
+  };
+
+  boost::shared_ptr<planner::CostModel> model =
+    boost::make_shared<planner::CostModel>();
+
+  loadStepCost("ttc", model->ttcCost());
+  loadStepCost("brake", model->brakeCost());
+  loadStepCost("policy_brake", model->policyBrakeCost());
+  loadStepCost("terminal_speed", model->terminalSpeedCost());
+  loadStepCost("terminal_distance", model->terminalDistanceCost());
+
+  loadCost("accel_below_policy_speed", model->accelBelowPolicySpeedCost());
+  loadCost("accel_above_policy_speed", model->accelAbovePolicySpeedCost());
+  loadCost("follower_accel_weight", model->followerAccelCostWeight());
+  loadCost("lane_change", model->laneChangeCost());
+
+  return model;
+}
+
+planner::LatticeResolution PlanningNode::loadLatticeResolution() const {
+
+  std::vector<double> distances{0.0};
+  std::vector<double> resolutions{1.0};
+  nh_.param<std::vector<double>>("lattice_resolution/distances", distances, distances);
+  nh_.param<std::vector<double>>("lattice_resolution/resolutions", resolutions, resolutions);
+
+  if (distances.size() != resolutions.size()) {
+    std::string error_msg = (boost::format(
+          "PlanningNode::loadLatticeResolution(): "
+          "%1% distances and %2% resolutions.\n")
+        % distances.size() % resolutions.size()).str();
+    throw std::runtime_error(error_msg);
+  }
+
+  std::vector<std::pair<double, double>> levels;
+  for (size_t i = 0; i < distances.size(); ++i)
+    levels.push_back(std::make_pair(distances[i], resolutions[i]));
 
-    agent_vehicles[agent_vehicle.id()] = agent_vehicle;
+  return planner::LatticeResolution(levels);
+}
+
+void PlanningNode::initializeWatchdog(
+    const double spatial_horizon,
+    const std::function<void(const size_t, const double)>& apply_level) {
+
+  // Deadline (s) of each planning cycle. A non-positive deadline disables the watchdog.
+  double deadline = 0.0;
+  int window = 20;
+  double quantile = 0.95;
+  double recovery_ratio = 0.5;
+  double horizon_step = 25.0;
+  double min_horizon = 75.0;
+  nh_.param<double>("watchdog_deadline", deadline, 0.0);
+  nh_.param<int>("watchdog_window", window, 20);
+  nh_.param<double>("watchdog_quantile", quantile, 0.95);
+  nh_.param<double>("watchdog_recovery_ratio", recovery_ratio, 0.5);
+  nh_.param<double>("watchdog_horizon_step", horizon_step, 25.0);
+  nh_.param<double>("watchdog_min_horizon", min_horizon, 75.0);
+
+  if (deadline <= 0.0) return;
+
+  size_t max_level = 0;
+  if (horizon_step > 0.0 && spatial_horizon > min_horizon) {
+    max_level = static_cast<size_t>(
+        std::ceil((spatial_horizon-min_horizon) / horizon_step));
   }
 
-  // Create the snapshot.
-  return boost::make_shared<planner::Snapshot>(
-      ego_vehicle, agent_vehicles, router_, map_, fast_map_);
+  watchdog_ = boost::make_shared<PlanningWatchdog<EgoPlan>>(
+      deadline, static_cast<size_t>(std::max(window, 1)),
+      quantile, recovery_ratio, max_level,
+      [spatial_horizon, horizon_step, min_horizon, apply_level](const size_t level) {
+        apply_level(level, std::max(
+              spatial_horizon-static_cast<double>(level)*horizon_step, min_horizon));
+      });
+  return;
+}
+
+EgoPlan PlanningNode::planFallback(const planner::Snapshot& snapshot) const {
+  CLP_PROFILE_SCOPE("PlanningNode::planFallback");
+
+  // The range of the lattice is just enough for the ego vehicle.
+  planner::lane_follower::LaneFollower path_planner(
+      map_, fast_map_,
+      fast_map_->waypoint(snapshot.ego().transform().location),
+      55.0, router_);
+  const planner::DiscretePath ego_path =
+    path_planner.planPath(snapshot.ego().id(), snapshot);
+
+  const double ego_accel =
+    planner::VehicleSpeedPlanner().planSpeed(snapshot.ego().id(), snapshot);
+
+  return EgoPlan{ego_path, ego_accel, false};
+}
+
+void PlanningNode::initializeBackgroundPlanner(
+    const std::function<EgoPlan(const planner::Snapshot&)>& plan) {
+
+  // Replan continuously in the background, and return the latest plan
+  // to the simulator without waiting for the planning.
+  bool async_planning = false;
+  nh_.param<bool>("async_planning", async_planning, false);
+
+  if (!async_planning) return;
+  background_planner_ = boost::make_shared<BackgroundPlanner<EgoPlan>>(plan);
+  return;
+}
+
+EgoPlan PlanningNode::planEgoAsync(
+    const boost::shared_ptr<const planner::Snapshot>& snapshot,
+    double& plan_age,
+    bool& fallback) {
+
+  // The ego should stay within this distance (m) from the path to follow it.
+  static constexpr double kMaxPathDeviation = 1.0;
+  // The path should extend beyond the ego by this distance (m) to be followed.
+  static constexpr double kMinRemainingPath = 10.0;
+
+  background_planner_->submit(snapshot);
+
+  const boost::shared_ptr<const BackgroundPlanner<EgoPlan>::TimedPlan> latest_plan =
+    background_planner_->latestPlan();
+  if (latest_plan) {
+    double deviation = 0.0;
+    const double start = latest_plan->plan.path.project(
+        snapshot->ego().transform().location, deviation);
+
+    if (deviation <= kMaxPathDeviation &&
+        latest_plan->plan.path.range()-start >= kMinRemainingPath) {
+      EgoPlan plan = latest_plan->plan;
+      plan.start = start;
+      plan_age = latest_plan->age();
+      fallback = false;
+      return plan;
+    }
+  }
+
+  plan_age = 0.0;
+  fallback = true;
+  return planFallback(*snapshot);
+}
+
+boost::shared_ptr<planner::Snapshot> PlanningNode::createSnapshot(
+    const conformal_lattice_planner::TrafficSnapshot& snapshot_msg) {
+  if (!snapshot_decoder_.decode(snapshot_msg)) return nullptr;
+  return node::createSnapshot(
+      snapshot_decoder_.ego(), snapshot_decoder_.agents(), router_, map_, fast_map_);
 }
 
 void PlanningNode::populateVehicleMsg(
     const planner::Vehicle& vehicle_obj,
     conformal_lattice_planner::Vehicle& vehicle_msg) {
-  // ID.
-  vehicle_msg.id = vehicle_obj.id();
-  // Bounding box.
-  vehicle_msg.bounding_box.extent.x = vehicle_obj.boundingBox().extent.x;
-  vehicle_msg.bounding_box.extent.y = vehicle_obj.boundingBox().extent.y;
-  vehicle_msg.bounding_box.extent.z = vehicle_obj.boundingBox().extent.z;
-  vehicle_msg.bounding_box.location.x = vehicle_obj.boundingBox().location.x;
-  vehicle_msg.bounding_box.location.y = vehicle_obj.boundingBox().location.y;
-  vehicle_msg.bounding_box.location.z = vehicle_obj.boundingBox().location.z;
-  // Transform.
-  vehicle_msg.transform.position.x = vehicle_obj.transform().location.x;
-  vehicle_msg.transform.position.y = vehicle_obj.transform().location.y;
-  vehicle_msg.transform.position.z = vehicle_obj.transform().location.z;
-  tf2::Matrix3x3 tf_mat;
-  tf_mat.setRPY(vehicle_obj.transform().rotation.roll /180.0*M_PI,
-                vehicle_obj.transform().rotation.pitch/180.0*M_PI,
-                vehicle_obj.transform().rotation.yaw  /180.0*M_PI);
-  tf2::Quaternion tf_quat;
-  tf_mat.getRotation(tf_quat);
-  vehicle_msg.transform.orientation = tf2::toMsg(tf_quat);
-  // Speed.
-  vehicle_msg.speed = vehicle_obj.speed();
-  // Acceleration.
-  vehicle_msg.acceleration = vehicle_obj.acceleration();
-  // Curvature.
-  vehicle_msg.curvature = vehicle_obj.curvature();
-  // policy speed.
-  vehicle_msg.policy_speed = vehicle_obj.policySpeed();
+  node::populateVehicleMsg(vehicle_obj, vehicle_msg);
   return;
 }
 
 void PlanningNode::populateVehicleObj(
     const conformal_lattice_planner::Vehicle& vehicle_msg,
     planner::Vehicle& vehicle_obj) {
-  // ID.
-  vehicle_obj.id() = vehicle_msg.id;
-  // Bounding box.
-  vehicle_obj.boundingBox().extent.x = vehicle_msg.bounding_box.extent.x;
-  vehicle_obj.boundingBox().extent.y = vehicle_msg.bounding_box.extent.y;
-  vehicle_obj.boundingBox().extent.z = vehicle_msg.bounding_box.extent.z;
-  vehicle_obj.boundingBox().location.x = vehicle_msg.bounding_box.location.x;
-  vehicle_obj.boundingBox().location.y = vehicle_msg.bounding_box.location.y;
-  vehicle_obj.boundingBox().location.z = vehicle_msg.bounding_box.location.z;
-  // Transform.
-  vehicle_obj.transform().location.x = vehicle_msg.transform.position.x;
-  vehicle_obj.transform().location.y = vehicle_msg.transform.position.y;
-  vehicle_obj.transform().location.z = vehicle_msg.transform.position.z;
-
-  tf2::Quaternion tf_quat;
-  tf2::fromMsg(vehicle_msg.transform.orientation, tf_quat);
-  tf2::Matrix3x3 tf_mat(tf_quat);
-  double yaw, pitch, roll;
-  tf_mat.getRPY(roll, pitch, yaw);
-  vehicle_obj.transform().rotation.yaw   = yaw  /M_PI*180.0;
-  vehicle_obj.transform().rotation.pitch = pitch/M_PI*180.0;
-  vehicle_obj.transform().rotation.roll  = roll /M_PI*180.0;
-  // Speed.
-  vehicle_obj.speed() = vehicle_msg.speed;
-  // Acceleration.
-  vehicle_obj.acceleration() = vehicle_msg.acceleration;
-  // Curvature.
-  vehicle_obj.curvature() = vehicle_msg.curvature;
-  // Policy speed.
-  vehicle_obj.policySpeed() = vehicle_msg.policy_speed;
+  node::populateVehicleObj(vehicle_msg, vehicle_obj);
   return;
 }
 
@@ -14,11 +14,14 @@
 
 #pragma once
 
+#include <vector>
 #include <utility>
+#include <functional>
 #include <unordered_map>
 
 #include <boost/core/noncopyable.hpp>
 #include <boost/smart_ptr.hpp>
+#include <boost/format.hpp>
 
 #include <carla/client/Client.h>
 #include <carla/client/World.h>
@@ -26,6 +29,8 @@
 #include <carla/client/Vehicle.h>
 #include <carla/client/Waypoint.h>
 #include <carla/geom/Transform.h>
+#include <carla/rpc/Command.h>
+#include <carla/rpc/CommandResponse.h>
 #include <carla/road/Road.h>
 #include <carla/road/element/RoadInfoGeometry.h>
 
@@ -34,10 +39,29 @@
 #include <planner/common/snapshot.h>
 #include <planner/common/utils.h>
 #include <planner/common/fast_waypoint_map.h>
+#include <planner/common/profiler.h>
+#include <planner/common/cost_model.h>
+#include <planner/common/lattice.h>
+#include <planner/common/vehicle_path.h>
+#include <node/common/convert_snapshot_msgs.h>
+#include <node/planner/planning_watchdog.h>
+#include <node/planner/background_planner.h>
 #include <conformal_lattice_planner/TrafficSnapshot.h>
+#include <conformal_lattice_planner/PlanningProfile.h>
 
 namespace node {
 
+/// The path and acceleration planned for the ego in a cycle.
+struct EgoPlan {
+  planner::DiscretePath path;
+  double accel;
+  /// Whether the planning is truncated by the time budget or memory cap.
+  bool truncated;
+  /// Distance along the path where the ego is, non-zero if the path
+  /// is planned on an earlier snapshot.
+  double start = 0.0;
+};
+
 class PlanningNode : private boost::noncopyable {
 
 protected:
@@ -60,10 +84,36 @@ protected:
 
   mutable ros::NodeHandle nh_;
 
+  /// Whether the planned vehicle states are set in the carla server.
+  /// This is disabled if the goals are replayed from a traffic log,
+  /// where the vehicles do not exist in the server.
+  bool update_carla_vehicles_ = true;
+
+  /// Publishes the time breakdown of the planning cycles,
+  /// only advertised if the planners are compiled with \c CLP_PROFILING.
+  mutable ros::Publisher profile_pub_;
+
+  /// Dumps the planning cycles into a chrome://tracing file if
+  /// the \c profile_trace parameter is set.
+  boost::shared_ptr<utils::ChromeTraceWriter> profile_trace_ = nullptr;
+
+  /// Rebuilds the traffic from the, possibly incremental, snapshot msgs.
+  SnapshotDecoder snapshot_decoder_;
+
+  /// Keeps the ego planning within a deadline by falling back to lane following,
+  /// \c nullptr if the \c watchdog_deadline parameter is not set.
+  boost::shared_ptr<PlanningWatchdog<EgoPlan>> watchdog_ = nullptr;
+
+  /// Replans continuously on the latest snapshot in the background,
+  /// \c nullptr unless the \c async_planning parameter is set.
+  boost::shared_ptr<BackgroundPlanner<EgoPlan>> background_planner_ = nullptr;
+
 public:
 
   PlanningNode(ros::NodeHandle& nh) :
-    router_(boost::make_shared<router::LoopRouter>()), nh_(nh) {}
+    router_(boost::make_shared<router::LoopRouter>()), nh_(nh) {
+    nh_.param<bool>("update_carla_vehicles", update_carla_vehicles_, true);
+  }
 
   virtual ~PlanningNode() {}
 
@@ -71,6 +121,111 @@ public:
 
 protected:
 
+  /// Advertise the profile topic and open the trace file,
+  /// no-op unless the planners are compiled with \c CLP_PROFILING.
+  void initializeProfiler();
+
+  /**
+   * \brief Load the cost model of the planners from the \c cost_model/ parameters.
+   *
+   * Each table, e.g. \c cost_model/ttc, is set by its \c bin_width, \c costs,
+   * and \c overflow_cost. The costs not set in the parameters keep the defaults.
+   */
+  boost::shared_ptr<const planner::CostModel> loadCostModel() const;
+
+  /**
+   * \brief Load the longitudinal resolution of the planner waypoint lattice
+   *        from the \c lattice_resolution/ parameters.
+   *
+   * \c lattice_resolution/distances and \c lattice_resolution/resolutions
+   * set the start distance and the resolution of each level. The default
+   * is the uniform 1.0m resolution.
+   */
+  planner::LatticeResolution loadLatticeResolution() const;
+
+  /**
+   * \brief Create the planning watchdog from the \c watchdog_ parameters.
+   *
+   * The watchdog is only created if \c watchdog_deadline is positive.
+   * \c watchdog_window, \c watchdog_quantile, and \c watchdog_recovery_ratio
+   * set how the latency of the next cycle is predicted and when the planner
+   * is recovered, see \c PlanningWatchdog. Each degradation level shortens
+   * the spatial horizon by \c watchdog_horizon_step, down to
+   * \c watchdog_min_horizon.
+   *
+   * \param[in] spatial_horizon The spatial horizon of the planner, not degraded.
+   * \param[in] apply_level Applies a degradation level, together with the
+   *                        spatial horizon of the level, to the planner.
+   */
+  void initializeWatchdog(
+      const double spatial_horizon,
+      const std::function<void(const size_t, const double)>& apply_level);
+
+  /**
+   * \brief Plan the ego with the lane follower and the IDM.
+   *
+   * The lattice only covers the range required by the ego, and is created
+   * from the snapshot, so that the carla server is not queried.
+   */
+  EgoPlan planFallback(const planner::Snapshot& snapshot) const;
+
+  /**
+   * \brief Start the background planner if the \c async_planning parameter is set.
+   *
+   * \param[in] plan Plans the ego on a snapshot. It is called on the planner
+   *                 thread, so it should own the planners it uses.
+   */
+  void initializeBackgroundPlanner(
+      const std::function<EgoPlan(const planner::Snapshot&)>& plan);
+
+  /**
+   * \brief Submit the snapshot to the background planner, and return the
+   *        latest completed plan right away.
+   *
+   * The plan is followed from where the ego is projected on its path. The
+   * fallback plan is returned instead if no plan has completed yet, or the
+   * ego is off the path or close to its end.
+   *
+   * \param[in] snapshot The current snapshot.
+   * \param[out] plan_age Time (s) since the snapshot of the plan is submitted.
+   * \param[out] fallback Whether the plan is from the fallback.
+   */
+  EgoPlan planEgoAsync(const boost::shared_ptr<const planner::Snapshot>& snapshot,
+                       double& plan_age,
+                       bool& fallback);
+
+  /**
+   * \brief Plan the ego through the watchdog if it is enabled.
+   *
+   * \param[in] primary The primary planner, which may outlive this call
+   *                    if it misses the deadline.
+   * \param[in] snapshot The snapshot used by the fallback.
+   * \param[out] fallback Whether the plan is from the fallback.
+   */
+  EgoPlan planEgo(const std::function<EgoPlan()>& primary,
+                  const planner::Snapshot& snapshot,
+                  bool& fallback) {
+    fallback = false;
+    if (!watchdog_) return primary();
+    return watchdog_->plan(
+        primary, [this, &snapshot]() { return planFallback(snapshot); }, fallback);
+  }
+
+  /// Start recording the scoped timers and counters of a planning cycle.
+  void beginProfileCycle() const {
+    if (utils::Profiler::kEnabled) utils::Profiler::instance().beginCycle();
+  }
+
+  /// Stop recording the planning cycle, publish its breakdown and
+  /// append it to the trace file.
+  void endProfileCycle();
+
+  /**
+   * \brief Create the snapshot object from a traffic snapshot msg.
+   * \return \c nullptr if the msg is incremental and some of the previous
+   *         msgs are missed, in which case the goal should be sent again
+   *         in full by the simulator.
+   */
   virtual boost::shared_ptr<planner::Snapshot> createSnapshot(
       const conformal_lattice_planner::TrafficSnapshot& snapshot_msg);
 
@@ -101,6 +256,41 @@ protected:
     return carlaVehicle(id)->GetTransform();
   }
 
+  /// Set the transform of a vehicle in the carla server by its ID,
+  /// unless \c update_carla_vehicles_ is disabled.
+  void updateCarlaVehicleTransform(const size_t id, const CarlaTransform& transform) const {
+    if (!update_carla_vehicles_) return;
+    carlaVehicle(id)->SetTransform(transform);
+  }
+
+  /// Set the transforms of vehicles in the carla server by their IDs in one
+  /// batch of carla commands, unless \c update_carla_vehicles_ is disabled.
+  void updateCarlaVehicleTransforms(
+      const std::vector<std::pair<size_t, CarlaTransform>>& transforms) const {
+    if (!update_carla_vehicles_ || transforms.empty()) return;
+
+    std::vector<carla::rpc::Command> commands;
+    commands.reserve(transforms.size());
+    for (const auto& transform : transforms) {
+      commands.emplace_back(carla::rpc::Command::ApplyTransform(
+            static_cast<carla::rpc::ActorId>(transform.first), transform.second));
+    }
+
+    // The batch is applied synchronously, so that the transforms are set
+    // before the simulator ticks the server on the result.
+    const std::vector<carla::rpc::CommandResponse> responses =
+      client_->ApplyBatchSync(std::move(commands));
+    for (size_t i = 0; i < responses.size(); ++i) {
+      if (!responses[i].HasError()) continue;
+      throw std::runtime_error((boost::format(
+            "PlanningNode::updateCarlaVehicleTransforms(): "
+            "Cannot set the transform of vehicle %1% in the carla server: %2%.\n")
+            % transforms[i].first
+            % responses[i].GetError().GetMessage()).str());
+    }
+    return;
+  }
+
   /// Get the carla waypoint a vehicle is at by its ID.
   boost::shared_ptr<CarlaWaypoint> carlaVehicleWaypoint(const size_t id) const {
     return fast_map_->waypoint(carlaVehicleTransform(id).location);
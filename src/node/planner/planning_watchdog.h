@@ -0,0 +1,365 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+
+#include <boost/format.hpp>
+#include <boost/optional.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <ros/ros.h>
+
+namespace node {
+
+/**
+ * \brief LatencyWindow keeps the latencies (s) of the latest planning cycles.
+ */
+class LatencyWindow {
+
+protected:
+
+  /// The latencies, used as a ring buffer once it is full.
+  std::vector<double> latencies_;
+
+  /// Maximum number of latencies kept in the window.
+  size_t capacity_;
+
+  /// Where the next latency is written once the window is full.
+  size_t next_ = 0;
+
+public:
+
+  LatencyWindow(const size_t capacity) : capacity_(capacity) {
+    if (capacity_ == 0) {
+      throw std::runtime_error(
+          "LatencyWindow::LatencyWindow(): "
+          "the capacity of the window should be positive.\n");
+    }
+    latencies_.reserve(capacity_);
+  }
+
+  /// Add the latency of a planning cycle, replacing the oldest one if the window is full.
+  void add(const double latency) {
+    if (latencies_.size() < capacity_) {
+      latencies_.push_back(latency);
+    } else {
+      latencies_[next_] = latency;
+      next_ = (next_+1) % capacity_;
+    }
+  }
+
+  /// Forget all the latencies, e.g. after the planner settings are changed.
+  void clear() { latencies_.clear(); next_ = 0; }
+
+  const size_t size() const { return latencies_.size(); }
+
+  const size_t capacity() const { return capacity_; }
+
+  const bool full() const { return latencies_.size() == capacity_; }
+
+  /// The nearest-rank quantile of the latencies, \c q in [0, 1].
+  /// 0.0 is returned if the window is empty.
+  const double quantile(const double q) const {
+    if (latencies_.empty()) return 0.0;
+    std::vector<double> sorted = latencies_;
+    const size_t rank = q <= 0.0 ? 0 : std::min(sorted.size()-1,
+        static_cast<size_t>(std::ceil(q*sorted.size()))-1);
+    std::nth_element(sorted.begin(), sorted.begin()+rank, sorted.end());
+    return sorted[rank];
+  }
+
+}; // End class LatencyWindow.
+
+/**
+ * \brief PlanningWatchdog keeps the latency of the ego planning cycles within a deadline.
+ *
+ * The primary planner is run asynchronously, while the fallback plan, which
+ * should be cheap, is computed on the calling thread in parallel. The primary
+ * plan is returned if it is ready by the deadline. Otherwise, the fallback is
+ * returned, and the late primary planner is left to finish in the background,
+ * since it cannot be stopped in the middle of a cycle. The fallback is also
+ * returned right away without running the primary planner, if the planner
+ * is still busy with a late cycle, or a deadline miss is predicted from the
+ * quantile of the latencies of the recent cycles.
+ *
+ * On a predicted or actual miss, the planner is degraded by one level. The
+ * meaning of a level is up to the user, e.g. a shorter planning horizon,
+ * through the \c apply_level callback, which is only called while the planner
+ * is idle. Once the latencies of a full window are well below the deadline,
+ * the planner is recovered by one level. Every degradation and recovery
+ * is logged.
+ *
+ * Profiling a cycle while a late planner is still running in the background
+ * is not reliable, see \c utils::Profiler.
+ *
+ * \tparam Plan The result of a planning cycle.
+ */
+template<typename Plan>
+class PlanningWatchdog : private boost::noncopyable {
+
+public:
+
+  using Clock = std::chrono::steady_clock;
+  using PlanningFunction = std::function<Plan()>;
+  using LevelFunction = std::function<void(const size_t)>;
+
+protected:
+
+  /// Deadline (s) of each planning cycle.
+  double deadline_;
+
+  /// The quantile of the recent latencies used to predict the latency of the next cycle.
+  double quantile_;
+
+  /// The planner is recovered by one level if the predicted latency of a
+  /// full window is below this ratio of the deadline.
+  double recovery_ratio_;
+
+  /// Minimum number of latencies required to predict a deadline miss.
+  size_t min_samples_;
+
+  /// The latencies of the recent cycles of the primary planner.
+  LatencyWindow window_;
+
+  /// Current degradation level, where 0 means the planner is not degraded.
+  size_t level_ = 0;
+
+  /// The level last applied to the planner.
+  size_t applied_level_ = 0;
+
+  /// The most degraded level.
+  size_t max_level_;
+
+  /// Applies a degradation level to the planner.
+  LevelFunction apply_level_;
+
+  /// The primary planner of the last cycle together with its latency,
+  /// kept if it misses the deadline and is still running.
+  std::future<std::pair<Plan, double>> pending_;
+
+  /// Number of cycles answered by the fallback.
+  size_t fallbacks_ = 0;
+
+  /// Number of degradation events.
+  size_t degradations_ = 0;
+
+public:
+
+  /**
+   * \brief Constructor of the class.
+   *
+   * \param[in] deadline The deadline (s) of each planning cycle.
+   * \param[in] window The number of recent latencies used to predict the next one.
+   * \param[in] quantile The quantile of the recent latencies used as the prediction.
+   * \param[in] recovery_ratio The planner is recovered if the prediction of a full
+   *                           window is below this ratio of the deadline.
+   * \param[in] max_level The most degraded level.
+   * \param[in] apply_level Applies a degradation level to the planner.
+   */
+  PlanningWatchdog(const double deadline,
+                   const size_t window,
+                   const double quantile,
+                   const double recovery_ratio,
+                   const size_t max_level,
+                   const LevelFunction& apply_level) :
+    deadline_(deadline),
+    quantile_(quantile),
+    recovery_ratio_(recovery_ratio),
+    min_samples_(std::max<size_t>(window/2, 1)),
+    window_(window),
+    max_level_(max_level),
+    apply_level_(apply_level) {
+
+    if (!(deadline_ > 0.0) || !std::isfinite(deadline_)) {
+      throw std::runtime_error(
+          (boost::format("PlanningWatchdog::PlanningWatchdog(): "
+                         "the deadline %1% should be positive and finite.\n") % deadline_).str());
+    }
+    if (quantile_ < 0.0 || quantile_ > 1.0) {
+      throw std::runtime_error(
+          (boost::format("PlanningWatchdog::PlanningWatchdog(): "
+                         "the quantile %1% should be within [0, 1].\n") % quantile_).str());
+    }
+  }
+
+  /// Wait for the late primary planner, if any, before the planner is destroyed.
+  ~PlanningWatchdog() { if (pending_.valid()) pending_.wait(); }
+
+  const double deadline() const { return deadline_; }
+
+  /// Current degradation level.
+  const size_t level() const { return level_; }
+
+  /// The most degraded level.
+  const size_t maxLevel() const { return max_level_; }
+
+  /// Number of cycles answered by the fallback so far.
+  const size_t fallbacks() const { return fallbacks_; }
+
+  /// Number of degradation events so far.
+  const size_t degradations() const { return degradations_; }
+
+  /// The latencies of the recent cycles of the primary planner.
+  const LatencyWindow& latencies() const { return window_; }
+
+  /**
+   * \brief Plan a cycle within the deadline.
+   *
+   * \param[in] primary The primary planner. It is run on another thread, and
+   *                    may outlive this call, so it should own what it uses.
+   * \param[in] fallback The fallback planner, run on the calling thread.
+   * \param[out] fallback_used Whether the fallback plan is returned.
+   * \return The primary plan if it is ready by the deadline, or the fallback plan.
+   *         If the fallback fails, the primary planner is waited for, and its
+   *         exception, if any, is thrown.
+   */
+  Plan plan(const PlanningFunction& primary,
+            const PlanningFunction& fallback,
+            bool& fallback_used) {
+
+    const Clock::time_point start = Clock::now();
+    fallback_used = false;
+
+    // The primary planner cannot start until its late cycle finishes.
+    if (pending_.valid()) {
+      if (pending_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        ROS_WARN_NAMED("ego_planner",
+            "watchdog: the planner is still busy with a late cycle, use the fallback.");
+        fallback_used = true;
+        ++fallbacks_;
+        return fallback();
+      }
+      // The result of the late cycle is out of date. Its latency is dropped
+      // as well, since it is measured with the settings before the degradation.
+      discard();
+    }
+
+    // The settings of the planner are only changed while it is idle.
+    if (applied_level_ != level_) {
+      apply_level_(level_);
+      applied_level_ = level_;
+    }
+
+    // Do not even try if the planner is expected to miss the deadline.
+    if (window_.size() >= min_samples_) {
+      const double predicted_latency = window_.quantile(quantile_);
+      if (predicted_latency > deadline_) {
+        degrade((boost::format("predicted latency %1%s exceeds the deadline %2%s")
+              % predicted_latency % deadline_).str());
+        fallback_used = true;
+        ++fallbacks_;
+        return fallback();
+      }
+    }
+
+    // Run the primary planner asynchronously.
+    pending_ = std::async(std::launch::async, [primary]()->std::pair<Plan, double>{
+        const Clock::time_point start = Clock::now();
+        Plan plan = primary();
+        return std::make_pair(std::move(plan),
+          std::chrono::duration<double>(Clock::now()-start).count());
+    });
+
+    // Compute the fallback in the meantime.
+    boost::optional<Plan> fallback_plan = boost::none;
+    try {
+      fallback_plan = fallback();
+    } catch (const std::exception& e) {
+      ROS_WARN_NAMED("ego_planner", "watchdog: the fallback fails: %s", e.what());
+    }
+
+    // Without a fallback, there is nothing to do but wait for the primary planner.
+    if (fallback_plan) {
+      const Clock::time_point deadline = start +
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(deadline_));
+      if (pending_.wait_until(deadline) != std::future_status::ready) {
+        degrade((boost::format("the planner misses the deadline %1%s") % deadline_).str());
+        fallback_used = true;
+        ++fallbacks_;
+        return *fallback_plan;
+      }
+    }
+
+    try {
+      std::pair<Plan, double> result = pending_.get();
+      record(result.second);
+      return std::move(result.first);
+    } catch (const std::exception& e) {
+      if (!fallback_plan) throw;
+      ROS_WARN_NAMED("ego_planner", "watchdog: the planner fails: %s", e.what());
+      fallback_used = true;
+      ++fallbacks_;
+      return *fallback_plan;
+    }
+  }
+
+protected:
+
+  /// Discard the finished late cycle.
+  void discard() {
+    try {
+      pending_.get();
+    } catch (const std::exception& e) {
+      ROS_WARN_NAMED("ego_planner", "watchdog: the late planning cycle fails: %s", e.what());
+    }
+  }
+
+  /// Record the latency of a primary planning cycle, and recover the planner
+  /// by one level if the latencies are well below the deadline.
+  void record(const double latency) {
+    window_.add(latency);
+    if (level_ == 0 || !window_.full()) return;
+
+    const double predicted_latency = window_.quantile(quantile_);
+    if (predicted_latency >= recovery_ratio_*deadline_) return;
+
+    --level_;
+    window_.clear();
+    ROS_WARN_NAMED("ego_planner",
+        "watchdog: predicted latency %fs is below %f of the deadline %fs, "
+        "recover the planner to level %lu.",
+        predicted_latency, recovery_ratio_, deadline_, level_);
+  }
+
+  /// Degrade the planner by one level, the recent latencies are forgotten
+  /// since they are measured with the previous settings.
+  void degrade(const std::string& reason) {
+    ++degradations_;
+    window_.clear();
+    if (level_ < max_level_) {
+      ++level_;
+      ROS_WARN_NAMED("ego_planner",
+          "watchdog: %s, use the fallback and degrade the planner to level %lu.",
+          reason.c_str(), level_);
+    } else {
+      ROS_WARN_NAMED("ego_planner",
+          "watchdog: %s, use the fallback, the planner is already at the most degraded level %lu.",
+          reason.c_str(), level_);
+    }
+  }
+
+}; // End class PlanningWatchdog.
+
+} // End namespace node.
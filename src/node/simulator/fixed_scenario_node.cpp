@@ -121,6 +121,9 @@ void FixedScenarioNode::spawnVehicles() {
     }
   }
 
+  // Let the server know about the vehicles.
+  world_->Tick();
+
   // Spawn the following camera of the ego vehicle.
   spawnCamera();
   return;
@@ -128,6 +131,8 @@ void FixedScenarioNode::spawnVehicles() {
 
 } // End namespace node.
 
+// The nodelet library, see src/node/nodelets.cpp, is built without main().
+#ifndef CLP_NODELET
 int main(int argc, char** argv) {
 
   ros::init(argc, argv, "~");
@@ -148,3 +153,4 @@ int main(int argc, char** argv) {
   ros::spin();
   return 0;
 }
+#endif
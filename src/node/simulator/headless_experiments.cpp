@@ -0,0 +1,709 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/**
+ * Headless batch experiments of the lattice planners.
+ *
+ * The experiments are the same as the ones with \c RandomTrafficNode, i.e.
+ * the ego is planned by one of the lattice planners and the agents are
+ * lane followers controlled by IDM, which are added and removed by the
+ * \c planner::TrafficManager around the ego. Instead of the carla server,
+ * the vehicles are moved kinematically along their planned paths, the same
+ * as the planner nodes set the vehicle transforms in the server, and the
+ * collisions are detected on the traffic lattice. The map is loaded from
+ * an OpenDRIVE file, so that neither a carla server nor a ROS master is
+ * required.
+ *
+ * Every scenario is seeded, which decides the start of the ego on the route
+ * and the spawned agents, and runs on its own planners. The scenarios are
+ * distributed to a number of workers, and the metrics of each scenario are
+ * written as one row of a CSV file.
+ *
+ * Usage:
+ *   headless_experiments <map.xodr> <planner> <scenarios> [workers]
+ *                        [max_time] [first_seed] [output.csv]
+ *
+ * where \c planner is one of \c idm, \c slc, or \c spatiotemporal.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <array>
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <random>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/optional.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <boost/timer/timer.hpp>
+
+#include <carla/client/Map.h>
+#include <carla/client/Waypoint.h>
+#include <carla/geom/BoundingBox.h>
+#include <carla/geom/Transform.h>
+
+#include <router/loop_router/loop_router.h>
+#include <planner/common/snapshot.h>
+#include <planner/common/vehicle.h>
+#include <planner/common/vehicle_path.h>
+#include <planner/common/vehicle_speed_planner.h>
+#include <planner/common/intelligent_driver_model.h>
+#include <planner/common/traffic_manager.h>
+#include <planner/common/fast_waypoint_map.h>
+#include <planner/common/thread_pool.h>
+#include <planner/lane_follower/lane_follower.h>
+#include <planner/idm_lattice_planner/idm_lattice_planner.h>
+#include <planner/slc_lattice_planner/slc_lattice_planner.h>
+#include <planner/spatiotemporal_lattice_planner/spatiotemporal_lattice_planner.h>
+#include <node/common/load_map.h>
+
+namespace {
+
+using CarlaMap         = carla::client::Map;
+using CarlaWaypoint    = carla::client::Waypoint;
+using CarlaTransform   = carla::geom::Transform;
+using CarlaBoundingBox = carla::geom::BoundingBox;
+using CarlaLocation    = carla::geom::Location;
+using CarlaVector3D    = carla::geom::Vector3D;
+
+/// Environment shared by all the scenarios, which is read only.
+struct Environment {
+  boost::shared_ptr<router::LoopRouter> router = nullptr;
+  boost::shared_ptr<CarlaMap> map = nullptr;
+  boost::shared_ptr<utils::FastWaypointMap> fast_map = nullptr;
+};
+
+/// Settings shared by all the scenarios.
+struct ExperimentConfig {
+  /// Planner of the ego vehicle, \c idm, \c slc, or \c spatiotemporal.
+  std::string planner = "slc";
+  /// Simulation time of each scenario (s).
+  double max_time = 500.0;
+  /// Simulation time step (s), the same as \c fixed_delta_seconds.
+  double dt = 0.05;
+  /// The number of agents kept around the ego.
+  size_t max_agents = 8;
+  /// Nominal policy speed of all vehicles.
+  double nominal_policy_speed = 20.0;
+};
+
+/// Metrics of one scenario.
+struct ScenarioResult {
+  size_t seed = 0;
+  /// One of \c completed, \c collision, \c planning_failure, or \c error.
+  std::string status = "completed";
+  /// Error message if the scenario does not complete.
+  std::string message;
+  /// Simulated time (s).
+  double simulation_time = 0.0;
+  /// Distance travelled by the ego (m).
+  double distance = 0.0;
+  /// Number of lane changes started by the ego.
+  size_t lane_changes = 0;
+  /// Number of planning cycles of the ego.
+  size_t cycles = 0;
+  /// Mean and max planning time of the ego (s).
+  double mean_planning_time = 0.0;
+  double max_planning_time = 0.0;
+  /// Wall time of running the scenario (s).
+  double wall_time = 0.0;
+
+  /// Mean speed of the ego (m/s).
+  double meanSpeed() const {
+    return simulation_time > 0.0 ? distance/simulation_time : 0.0;
+  }
+};
+
+/// Plan on a snapshot and return the ego path and its acceleration.
+using EgoPlanningFunction =
+  std::function<std::pair<planner::DiscretePath, double>(const planner::Snapshot&)>;
+
+/// Create the ego planner in the same way as the ego planning nodes.
+EgoPlanningFunction createEgoPlanner(
+    const std::string& name, const Environment& env) {
+
+  if (name == "idm") {
+    boost::shared_ptr<planner::IDMLatticePlanner> path_planner =
+      boost::make_shared<planner::IDMLatticePlanner>(
+          0.1, 150.0, env.router, env.map, env.fast_map);
+    boost::shared_ptr<planner::VehicleSpeedPlanner> speed_planner =
+      boost::make_shared<planner::VehicleSpeedPlanner>();
+
+    return [path_planner, speed_planner](const planner::Snapshot& snapshot) {
+      const planner::DiscretePath path =
+        path_planner->planPath(snapshot.ego().id(), snapshot);
+      const double accel = speed_planner->planSpeed(snapshot.ego().id(), snapshot);
+      return std::make_pair(path, accel);
+    };
+  }
+
+  if (name == "slc") {
+    boost::shared_ptr<planner::SLCLatticePlanner> path_planner =
+      boost::make_shared<planner::SLCLatticePlanner>(
+          0.1, 150.0, env.router, env.map, env.fast_map);
+    boost::shared_ptr<planner::VehicleSpeedPlanner> speed_planner =
+      boost::make_shared<planner::VehicleSpeedPlanner>();
+
+    return [path_planner, speed_planner](const planner::Snapshot& snapshot) {
+      const planner::DiscretePath path =
+        path_planner->planPath(snapshot.ego().id(), snapshot);
+      const double accel = speed_planner->planSpeed(snapshot.ego().id(), snapshot);
+      return std::make_pair(path, accel);
+    };
+  }
+
+  if (name == "spatiotemporal") {
+    boost::shared_ptr<planner::SpatiotemporalLatticePlanner> traj_planner =
+      boost::make_shared<planner::SpatiotemporalLatticePlanner>(
+          0.1, 150.0, env.router, env.map, env.fast_map);
+
+    return [traj_planner](const planner::Snapshot& snapshot) {
+      const std::list<std::pair<planner::ContinuousPath, double>> traj =
+        traj_planner->planTraj(snapshot.ego().id(), snapshot);
+      planner::DiscretePath path(traj.front().first);
+      for (auto iter = ++(traj.begin()); iter != traj.end(); ++iter)
+        path.append(iter->first);
+      return std::make_pair(path, traj.front().second);
+    };
+  }
+
+  throw std::runtime_error((boost::format(
+        "createEgoPlanner(): unknown planner %1%.\n") % name).str());
+}
+
+/**
+ * \brief Scenario runs one experiment with the random traffic.
+ *
+ * The scenario follows \c RandomTrafficNode and the planner nodes, except
+ * that all the random numbers are drawn from the generator seeded by the
+ * scenario, so that a scenario can be reproduced with its seed.
+ */
+class Scenario : private boost::noncopyable {
+
+protected:
+
+  using VehicleTuple = std::tuple<size_t, CarlaTransform, CarlaBoundingBox>;
+
+protected:
+
+  const Environment& env_;
+  const ExperimentConfig& config_;
+
+  std::mt19937 rand_gen_;
+
+  boost::shared_ptr<planner::TrafficManager> traffic_manager_ = nullptr;
+
+  planner::Vehicle ego_;
+  std::unordered_map<size_t, planner::Vehicle> agents_;
+
+  /// IDM of the agents, with noisy parameters.
+  std::unordered_map<size_t, boost::shared_ptr<planner::IntelligentDriverModel>> agent_idms_;
+
+  /// Nominal policy speed and the current noise of the agents.
+  std::unordered_map<size_t, std::pair<double, double>> agent_policies_;
+
+  EgoPlanningFunction plan_ego_;
+
+  /// ID of the next vehicle to be spawned.
+  size_t next_id_ = 1;
+
+  /// Lane change type of the last ego path.
+  planner::VehiclePath::LaneChangeType last_lane_change_ =
+    planner::VehiclePath::LaneChangeType::KeepLane;
+
+public:
+
+  Scenario(const size_t seed,
+           const Environment& env,
+           const ExperimentConfig& config) :
+    env_(env),
+    config_(config),
+    rand_gen_(seed),
+    plan_ego_(createEgoPlanner(config.planner, env)) {}
+
+  /// Run the scenario until the maximum time or a failure.
+  void run(ScenarioResult& result);
+
+protected:
+
+  /// Spawn the ego and the initial agents.
+  void spawnVehicles();
+
+  /// Spawn a vehicle at the waypoint, return its ID if successful.
+  boost::optional<size_t> spawnVehicle(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+      const double policy_speed,
+      const bool noisy_speed);
+
+  /**
+   * \brief Add and remove the agents around the ego, \see RandomTrafficNode::manageTraffic().
+   * \return false If a collision is detected on the traffic lattice.
+   */
+  bool manageTraffic();
+
+  /**
+   * \brief Plan all the vehicles on the current snapshot and move them forward by a step.
+   * \return false If the scenario ends, where the cause is set in the \c result.
+   */
+  bool step(ScenarioResult& result);
+
+  /// Plan the agents, \see AgentsLaneFollowingNode::executeCallback().
+  void planAgents(const boost::shared_ptr<planner::Snapshot>& snapshot,
+                  std::unordered_map<size_t, planner::Vehicle>& updated_agents);
+
+  /// A bounding box of one of the common vehicle sizes.
+  CarlaBoundingBox randomBoundingBox();
+
+}; // End class Scenario.
+
+CarlaBoundingBox Scenario::randomBoundingBox() {
+  // Extents of a compact, a sedan, and an SUV (half of the dimensions).
+  static const std::array<CarlaVector3D, 3> extents{{
+    CarlaVector3D(1.85f, 0.90f, 0.75f),
+    CarlaVector3D(2.40f, 0.95f, 0.75f),
+    CarlaVector3D(2.45f, 1.05f, 0.85f),
+  }};
+  std::uniform_int_distribution<size_t> index_dist(0, extents.size()-1);
+  const CarlaVector3D& extent = extents[index_dist(rand_gen_)];
+  return CarlaBoundingBox(CarlaLocation(0.0f, 0.0f, extent.z), extent);
+}
+
+boost::optional<size_t> Scenario::spawnVehicle(
+    const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+    const double policy_speed,
+    const bool noisy_speed) {
+
+  const size_t id = next_id_;
+  const CarlaTransform transform = waypoint->GetTransform();
+  const CarlaBoundingBox bounding_box = randomBoundingBox();
+
+  // The vehicle is not spawned if it collides with the others on the lattice.
+  if (traffic_manager_->addVehicle(std::make_tuple(id, transform, bounding_box)) != 1)
+    return boost::none;
+  ++next_id_;
+
+  std::uniform_real_distribution<double> uni_real_dist(-4.0, 4.0);
+  double speed = policy_speed;
+  double noisy_policy_speed = policy_speed;
+  if (noisy_speed) {
+    speed += uni_real_dist(rand_gen_);
+    noisy_policy_speed += uni_real_dist(rand_gen_);
+  }
+
+  const planner::Vehicle vehicle(
+      id, bounding_box, transform, speed, noisy_policy_speed, 0.0,
+      env_.fast_map->curvature(waypoint));
+
+  // The first vehicle is always the ego.
+  if (id == 1) ego_ = vehicle;
+  else agents_[id] = vehicle;
+
+  return id;
+}
+
+void Scenario::spawnVehicles() {
+
+  // A random start on the route, which is found through the
+  // waypoint closest to the origin as in the simulator nodes.
+  boost::shared_ptr<const CarlaWaypoint> origin_waypoint =
+    env_.fast_map->waypoint(CarlaLocation(0.0f, 0.0f, 0.0f));
+  std::uniform_real_distribution<double> start_dist(1.0, 1000.0);
+  boost::shared_ptr<CarlaWaypoint> start_waypoint =
+    env_.router->tryFrontWaypoint(origin_waypoint, start_dist(rand_gen_));
+  if (!start_waypoint) start_waypoint = env_.fast_map->waypoint(origin_waypoint->GetTransform().location);
+
+  traffic_manager_ = boost::make_shared<planner::TrafficManager>(
+      start_waypoint, 150.0, env_.router, env_.map, env_.fast_map);
+
+  // The ego vehicle is at 50m on the lattice, and there is an 100m buffer
+  // in the front of the ego vehicle.
+  boost::shared_ptr<const CarlaWaypoint> ego_waypoint =
+    traffic_manager_->front(start_waypoint, 50.0)->waypoint();
+  if (!spawnVehicle(ego_waypoint, config_.nominal_policy_speed, false)) {
+    throw std::runtime_error(
+        "Scenario::spawnVehicles(): cannot spawn the ego vehicle.\n");
+  }
+
+  // The same initial agents as in the random traffic simulator,
+  // which are skipped if the lanes do not exist.
+  const std::vector<std::pair<size_t, double>> agent_offsets{
+    {1, -30.0}, {1, 90.0}, {2, 20.0}, {3, 10.0}};
+
+  for (const auto& offset : agent_offsets) {
+    boost::shared_ptr<const CarlaWaypoint> lane_waypoint = ego_waypoint;
+    for (size_t i = 0; i < offset.first && lane_waypoint; ++i)
+      lane_waypoint = lane_waypoint->GetRight();
+    if (!lane_waypoint) continue;
+
+    boost::shared_ptr<const planner::WaypointNodeWithVehicle> node = offset.second > 0.0 ?
+      traffic_manager_->front(lane_waypoint, offset.second) :
+      traffic_manager_->back(lane_waypoint, -offset.second);
+    if (!node) continue;
+    spawnVehicle(node->waypoint(), config_.nominal_policy_speed, true);
+  }
+
+  return;
+}
+
+bool Scenario::manageTraffic() {
+
+  // Keep the ego vehicle at the 50m distance on the lattice.
+  boost::shared_ptr<const planner::TrafficManager> const_traffic_manager = traffic_manager_;
+  const boost::shared_ptr<CarlaWaypoint> ego_waypoint =
+    env_.fast_map->waypoint(ego_.transform().location);
+  boost::shared_ptr<const planner::WaypointNodeWithVehicle> ego_node =
+    const_traffic_manager->closestNode(ego_waypoint, 1.0);
+  if (!ego_node) {
+    throw std::runtime_error(
+        "Scenario::manageTraffic(): the ego vehicle is not on the lattice.\n");
+  }
+  const double shift_distance = ego_node->distance()<50.0 ? 0.0 : 2.0;
+
+  // Update the traffic on the lattice.
+  std::vector<VehicleTuple> vehicles;
+  vehicles.reserve(agents_.size()+1);
+  vehicles.emplace_back(ego_.id(), ego_.transform(), ego_.boundingBox());
+  for (const auto& agent : agents_)
+    vehicles.emplace_back(agent.first, agent.second.transform(), agent.second.boundingBox());
+
+  std::unordered_set<size_t> disappear_vehicles;
+  if (!traffic_manager_->moveTrafficForward(vehicles, shift_distance, disappear_vehicles))
+    return false;
+
+  // Remove the vehicles that disappear.
+  for (const size_t id : disappear_vehicles) {
+    if (id == ego_.id()) {
+      throw std::runtime_error(
+          "Scenario::manageTraffic(): the ego vehicle is removed from the lattice.\n");
+    }
+    agents_.erase(id);
+    agent_idms_.erase(id);
+    agent_policies_.erase(id);
+  }
+
+  // Spawn at most one vehicle if there are not enough agents.
+  if (agents_.size() >= config_.max_agents) return true;
+
+  const double min_distance = 30.0;
+  boost::optional<std::pair<double, boost::shared_ptr<const CarlaWaypoint>>> front =
+    traffic_manager_->frontSpawnWaypoint(min_distance);
+  boost::optional<std::pair<double, boost::shared_ptr<const CarlaWaypoint>>> back =
+    traffic_manager_->backSpawnWaypoint(min_distance);
+
+  double front_distance = 0.0;
+  double back_distance = 0.0;
+  if (front && traffic_manager_->back(front->second, 30.0)) front_distance = front->first;
+  if (back  && traffic_manager_->front(back->second, 30.0)) back_distance = back->first;
+
+  boost::shared_ptr<const CarlaWaypoint> spawn_waypoint = nullptr;
+  std::uniform_real_distribution<double> uni_real_dist(-10.0, 10.0);
+
+  if (front_distance>=back_distance && front_distance>=min_distance) {
+    const double distance = min_distance/2.0 + uni_real_dist(rand_gen_);
+    spawn_waypoint = traffic_manager_->back(front->second, distance)->waypoint();
+  }
+
+  if (front_distance<back_distance && back_distance>=min_distance) {
+    const double distance = min_distance/2.0 + uni_real_dist(rand_gen_);
+    spawn_waypoint = traffic_manager_->front(back->second, distance)->waypoint();
+  }
+
+  if (spawn_waypoint) spawnVehicle(spawn_waypoint, config_.nominal_policy_speed, true);
+  return true;
+}
+
+void Scenario::planAgents(
+    const boost::shared_ptr<planner::Snapshot>& snapshot,
+    std::unordered_map<size_t, planner::Vehicle>& updated_agents) {
+
+  // Perturb the policy speeds and create the IDMs of the new agents.
+  std::uniform_real_distribution<double> headway_noise_dist(-0.2, 0.2);
+  std::uniform_real_distribution<double> distance_noise_dist(-1.0, 1.0);
+
+  for (const planner::ConstVehicleView agent : snapshot->agents()) {
+    double noise = 0.0;
+    if (agent_policies_.count(agent.id()) > 0) {
+      const double sigma = 2.0;
+      const double sigma_xy = 1.95;
+      std::normal_distribution<double> normal_dist(
+          sigma_xy/sigma*agent_policies_[agent.id()].second,
+          std::sqrt(sigma-sigma_xy*sigma_xy/sigma));
+      noise = normal_dist(rand_gen_);
+    }
+    agent_policies_[agent.id()] = std::make_pair(agent.policySpeed(), noise);
+    snapshot->agent(agent.id()).policySpeed() = agent.policySpeed() + noise;
+
+    if (agent_idms_.count(agent.id()) == 0) {
+      agent_idms_[agent.id()] = boost::make_shared<planner::IntelligentDriverModel>(
+          1.0 + headway_noise_dist(rand_gen_),
+          6.0 + distance_noise_dist(rand_gen_));
+    }
+  }
+
+  // The lane follower covers the whole traffic lattice.
+  boost::shared_ptr<const CarlaWaypoint> lattice_start = nullptr;
+  for (const auto& node : snapshot->trafficLattice()->latticeEntries()) {
+    if (node->distance() != 0.0) continue;
+    lattice_start = node->waypoint();
+    break;
+  }
+  planner::lane_follower::LaneFollower path_planner(
+      env_.map, env_.fast_map, lattice_start,
+      snapshot->trafficLattice()->range() + 55.0, env_.router);
+
+  const double dt = config_.dt;
+  for (const planner::ConstVehicleView agent : snapshot->agents()) {
+
+    double accel = 0.0;
+    CarlaTransform updated_transform;
+    double updated_speed = agent.speed();
+
+    try {
+      planner::VehicleSpeedPlanner speed_planner(agent_idms_[agent.id()]);
+      const planner::DiscretePath path = path_planner.planPath(agent.id(), *snapshot);
+      accel = speed_planner.planSpeed(agent.id(), *snapshot);
+
+      const double movement = agent.speed()*dt + 0.5*accel*dt*dt;
+      updated_transform = path.transformAt(movement).first;
+      updated_speed = agent.speed() + accel*dt;
+
+    } catch (...) {
+      // Move the agent to its next waypoint if the path cannot be planned.
+      const std::vector<boost::shared_ptr<CarlaWaypoint>> front_waypoints =
+        env_.fast_map->waypoint(agent.transform())->GetNext(1.0);
+      if (front_waypoints.empty()) continue;
+      updated_transform = front_waypoints.front()->GetTransform();
+    }
+
+    updated_agents[agent.id()] = planner::Vehicle(
+        agent.id(),
+        agent.boundingBox(),
+        updated_transform,
+        updated_speed,
+        agent_policies_[agent.id()].first,
+        accel,
+        env_.fast_map->curvature(env_.map->GetWaypoint(updated_transform.location)));
+  }
+
+  return;
+}
+
+bool Scenario::step(ScenarioResult& result) {
+
+  if (!manageTraffic()) {
+    result.status = "collision";
+    return false;
+  }
+
+  boost::shared_ptr<planner::Snapshot> snapshot = boost::make_shared<planner::Snapshot>(
+      ego_, agents_, env_.router, env_.map, env_.fast_map);
+
+  // Plan the ego.
+  boost::timer::cpu_timer planning_timer;
+  boost::optional<std::pair<planner::DiscretePath, double>> ego_plan = boost::none;
+  try {
+    ego_plan = plan_ego_(*snapshot);
+  } catch (const std::exception& e) {
+    result.status = "planning_failure";
+    result.message = e.what();
+    return false;
+  }
+  const double planning_time = planning_timer.elapsed().wall*1.0e-9;
+
+  ++result.cycles;
+  result.mean_planning_time += planning_time;
+  result.max_planning_time = std::max(result.max_planning_time, planning_time);
+
+  const planner::VehiclePath::LaneChangeType lane_change = ego_plan->first.laneChangeType();
+  if (lane_change != planner::VehiclePath::LaneChangeType::KeepLane &&
+      last_lane_change_ == planner::VehiclePath::LaneChangeType::KeepLane)
+    ++result.lane_changes;
+  last_lane_change_ = lane_change;
+
+  // Plan the agents on the same snapshot, as the planner nodes do.
+  std::unordered_map<size_t, planner::Vehicle> updated_agents;
+  planAgents(snapshot, updated_agents);
+
+  // Move the ego forward.
+  const double dt = config_.dt;
+  const double ego_accel = ego_plan->second;
+  const double movement = std::max(ego_.speed()*dt + 0.5*ego_accel*dt*dt, 0.0);
+  const std::pair<CarlaTransform, double> updated_transform_curvature =
+    ego_plan->first.transformAt(movement);
+
+  ego_.transform() = updated_transform_curvature.first;
+  ego_.curvature() = updated_transform_curvature.second;
+  ego_.speed() = std::max(ego_.speed() + ego_accel*dt, 0.0);
+  ego_.acceleration() = ego_accel;
+  result.distance += movement;
+
+  agents_.swap(updated_agents);
+  result.simulation_time += dt;
+  return true;
+}
+
+void Scenario::run(ScenarioResult& result) {
+
+  boost::timer::cpu_timer wall_timer;
+  try {
+    spawnVehicles();
+    const size_t max_steps = static_cast<size_t>(std::round(config_.max_time/config_.dt));
+    for (size_t i = 0; i < max_steps; ++i) {
+      if (!step(result)) break;
+    }
+  } catch (const std::exception& e) {
+    result.status = "error";
+    result.message = e.what();
+  }
+
+  if (result.cycles > 0) result.mean_planning_time /= result.cycles;
+  result.wall_time = wall_timer.elapsed().wall*1.0e-9;
+  return;
+}
+
+void writeResults(const std::string& filename,
+                  const ExperimentConfig& config,
+                  const std::vector<ScenarioResult>& results) {
+
+  std::ofstream fout(filename, std::ios::trunc);
+  if (!fout.is_open()) {
+    throw std::runtime_error((boost::format(
+          "writeResults(): cannot open %1% for writing.\n") % filename).str());
+  }
+
+  fout << "seed,planner,status,simulation_time,distance,mean_speed,lane_changes,"
+          "cycles,mean_planning_time,max_planning_time,wall_time\n";
+  for (const ScenarioResult& result : results) {
+    fout << boost::format("%1%,%2%,%3%,%4%,%5%,%6%,%7%,%8%,%9%,%10%,%11%\n")
+      % result.seed % config.planner % result.status
+      % result.simulation_time % result.distance % result.meanSpeed()
+      % result.lane_changes % result.cycles
+      % result.mean_planning_time % result.max_planning_time
+      % result.wall_time;
+  }
+  return;
+}
+
+void report(const std::vector<ScenarioResult>& results, const double wall_time) {
+
+  std::unordered_map<std::string, size_t> status_counts;
+  double simulation_time = 0.0;
+  double distance = 0.0;
+  double planning_time = 0.0;
+  double max_planning_time = 0.0;
+  size_t cycles = 0;
+  size_t lane_changes = 0;
+
+  for (const ScenarioResult& result : results) {
+    ++status_counts[result.status];
+    simulation_time += result.simulation_time;
+    distance += result.distance;
+    planning_time += result.mean_planning_time * result.cycles;
+    max_planning_time = std::max(max_planning_time, result.max_planning_time);
+    cycles += result.cycles;
+    lane_changes += result.lane_changes;
+  }
+
+  std::printf("scenarios: %lu\n", results.size());
+  for (const auto& status : status_counts)
+    std::printf("  %s: %lu\n", status.first.c_str(), status.second);
+  std::printf("simulation time: %.1fs wall time: %.1fs real time factor: %.2f\n",
+      simulation_time, wall_time, simulation_time/wall_time);
+  std::printf("ego mean speed: %.3fm/s lane changes per km: %.3f\n",
+      simulation_time > 0.0 ? distance/simulation_time : 0.0,
+      distance > 0.0 ? lane_changes/distance*1.0e3 : 0.0);
+  std::printf("planning time (ms): mean: %.3f max: %.3f\n",
+      cycles > 0 ? planning_time/cycles*1.0e3 : 0.0, max_planning_time*1.0e3);
+  return;
+}
+
+} // End anonymous namespace.
+
+int main(int argc, char** argv) {
+
+  if (argc < 4) {
+    std::fprintf(stderr,
+        "Usage: %s <map.xodr> <idm|slc|spatiotemporal> <scenarios> "
+        "[workers] [max_time] [first_seed] [output.csv]\n", argv[0]);
+    return 1;
+  }
+
+  ExperimentConfig config;
+  const std::string map_filename = argv[1];
+  config.planner = argv[2];
+  const size_t scenarios = std::max(std::atoi(argv[3]), 0);
+  const size_t workers = argc > 4 ? std::max(std::atoi(argv[4]), 1) : 1;
+  if (argc > 5) config.max_time = std::atof(argv[5]);
+  const size_t first_seed = argc > 6 ? std::strtoul(argv[6], nullptr, 10) : 0;
+  const std::string output_filename = argc > 7 ? argv[7] : "headless_experiments.csv";
+
+  if (config.planner != "idm" && config.planner != "slc" &&
+      config.planner != "spatiotemporal") {
+    std::fprintf(stderr, "Unknown planner: %s\n", config.planner.c_str());
+    return 1;
+  }
+
+  // Prepare the map, the same as the planning nodes.
+  Environment env;
+  {
+    boost::timer::cpu_timer timer;
+    env.map = node::loadMap(map_filename);
+    env.fast_map = boost::make_shared<utils::FastWaypointMap>(
+        env.map, 0.05, "/tmp/conformal_lattice_planner");
+    env.router = boost::make_shared<router::LoopRouter>();
+    env.router->setWaypointGraph(
+        boost::make_shared<const utils::WaypointGraph>(env.fast_map));
+    env.router->buildRouteIndex(env.map);
+    std::printf("map preparation: %fs\n", timer.elapsed().wall*1.0e-9);
+  }
+
+  // Every scenario runs on a single thread with its own planners,
+  // so that the scenarios are parallelized instead of the planning.
+  std::vector<ScenarioResult> results(scenarios);
+  std::mutex print_mutex;
+  size_t finished = 0;
+
+  boost::timer::cpu_timer timer;
+  utils::ThreadPool thread_pool(workers-1);
+  thread_pool.parallelFor(scenarios, [&](const size_t i) {
+    ScenarioResult& result = results[i];
+    result.seed = first_seed + i;
+    Scenario scenario(result.seed, env, config);
+    scenario.run(result);
+
+    std::lock_guard<std::mutex> lock(print_mutex);
+    ++finished;
+    std::printf("[%lu/%lu] seed: %lu status: %s simulation time: %.1fs wall time: %.1fs\n",
+        finished, scenarios, result.seed, result.status.c_str(),
+        result.simulation_time, result.wall_time);
+    if (!result.message.empty()) std::fprintf(stderr, "%s", result.message.c_str());
+  });
+
+  writeResults(output_filename, config, results);
+  report(results, timer.elapsed().wall*1.0e-9);
+  return 0;
+}
@@ -31,7 +31,11 @@ bool NoTrafficNode::initialize() {
 
   // Create publishers.
   map_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("town_map", 1, true);
-  traffic_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("traffic", 1, true);
+
+  // The maximum rate (Hz) of the traffic markers, 0 for no limit.
+  double visualization_rate = 0.0;
+  nh_.param<double>("visualization_rate", visualization_rate, 0.0);
+  traffic_pub_ = boost::make_shared<MarkerArrayPublisher>(nh_, "traffic", visualization_rate);
 
   // Get the world.
   std::string host = "localhost";
@@ -39,6 +43,12 @@ bool NoTrafficNode::initialize() {
   all_param_exist &= nh_.param<std::string>("host", host, "localhost");
   all_param_exist &= nh_.param<int>("port", port, 2000);
 
+  // The directory to cache the waypoints of the map, shared by all nodes.
+  std::string fast_map_cache_directory = "/tmp/conformal_lattice_planner";
+  nh_.param<std::string>("fast_map_cache_directory",
+      fast_map_cache_directory, "/tmp/conformal_lattice_planner");
+  map_cache_directory_ = fast_map_cache_directory;
+
   ROS_INFO_NAMED("carla_simulator", "connect to the server.");
   client_ = boost::make_shared<CarlaClient>(host, port);
   client_->SetTimeout(std::chrono::seconds(10));
@@ -50,7 +60,16 @@ bool NoTrafficNode::initialize() {
 
   // Set the map.
   map_ = world_->GetMap();
-  fast_map_ = boost::make_shared<utils::FastWaypointMap>(map_);
+  fast_map_ = utils::FastWaypointMap::shared(
+      map_, 0.05, fast_map_cache_directory);
+
+  // Connect the waypoints of the whole map, so that the router finds the
+  // next, left, and right waypoints without walking the carla map.
+  loop_router_->setWaypointGraph(utils::WaypointGraph::shared(fast_map_));
+
+  // Sample the lanes on the route once, so that the front waypoints
+  // are not searched on the map every time.
+  loop_router_->buildRouteIndex(map_);
 
   // Applying the world settings.
   double fixed_delta_seconds = 0.05;
@@ -87,6 +106,24 @@ bool NoTrafficNode::initialize() {
       settings.no_rendering_mode,
       settings.synchronous_mode);
 
+  // The file to record the traffic at every tick.
+  // Nothing is recorded if the path is empty.
+  std::string traffic_log_path = "";
+  nh_.param<std::string>("traffic_log", traffic_log_path, "");
+  if (!traffic_log_path.empty())
+    traffic_log_ = boost::make_shared<planner::TrafficLogWriter>(traffic_log_path);
+
+  // The file to record the metrics of the experiment at every tick.
+  // Nothing is recorded if the path is empty.
+  std::string telemetry_log_path = "";
+  nh_.param<std::string>("telemetry_log", telemetry_log_path, "");
+  if (!telemetry_log_path.empty())
+    telemetry_ = boost::make_shared<planner::TelemetrySink>(telemetry_log_path);
+
+  initializeScenarioSeed();
+  initializePipeline();
+  initializeSnapshotEncoders();
+
   // Publish the map.
   ROS_INFO_NAMED("carla_simulator", "publish global map.");
   publishMap();
@@ -163,6 +200,9 @@ void NoTrafficNode::spawnVehicles() {
     throw std::runtime_error("Cannot spawn the ego vehicle.");
   }
 
+  // Let the server know about the vehicles.
+  world_->Tick();
+
   // Spawn the following camera of the ego vehicle.
   spawnCamera();
 
@@ -171,6 +211,8 @@ void NoTrafficNode::spawnVehicles() {
 
 } // End namespace node.
 
+// The nodelet library, see src/node/nodelets.cpp, is built without main().
+#ifndef CLP_NODELET
 int main(int argc, char** argv) {
 
   ros::init(argc, argv, "~");
@@ -191,3 +233,4 @@ int main(int argc, char** argv) {
   ros::spin();
   return 0;
 }
+#endif
@@ -48,8 +48,13 @@ protected:
   virtual void tickWorld() override {
     world_->Tick();
     updateSimTime();
-    publishTraffic();
-    sendEgoGoal();
+    if (visualization_worker_) {
+      sendEgoGoal();
+      publishTraffic();
+    } else {
+      publishTraffic();
+      sendEgoGoal();
+    }
     return;
   }
 
@@ -138,35 +138,31 @@ boost::optional<size_t> RandomTrafficNode::spawnEgoVehicle(
   CarlaTransform transform = waypoint->GetTransform();
   transform.location.z += 0.05;
 
-  boost::shared_ptr<CarlaActor> actor = world_->TrySpawnActor(blueprint, transform);
-  boost::shared_ptr<CarlaVehicle> vehicle = boost::static_pointer_cast<CarlaVehicle>(actor);
+  // The vehicle physics is disabled along with the spawning.
+  boost::shared_ptr<CarlaVehicle> vehicle =
+    spawnCarlaVehicles({std::make_pair(blueprint, transform)}).front();
 
-  if (!actor) {
+  if (!vehicle) {
     // Cannot spawn the actor.
     // There might be a collision at the waypoint or something.
     ROS_ERROR_NAMED("carla simulator", "Cannot spawn the ego vehicle.");
     return boost::none;
   }
 
-  // Disable the vehicle physics.
-  actor->SetSimulatePhysics(false);
-
   if (traffic_manager_->addVehicle(
         std::make_tuple(vehicle->GetId(), transform, vehicle->GetBoundingBox())) != 1) {
     // Cannot add this vehicle to the traffic lattice.
     // This is either because the vehicle already exists or it causes a collision on the lattice.
-    vehicle->Destroy();
+    destroyCarlaVehicles({vehicle->GetId()});
     ROS_ERROR_NAMED("carla simulator", "Cannot add ego vehicle to the traffic lattice.");
     return boost::none;
   }
-  world_->Tick();
 
   // Set the ego vehicle policy.
-  const size_t seed = std::chrono::system_clock::now().time_since_epoch().count();
-  std::default_random_engine rand_gen(seed);
+  utils::CounterRandomEngine rand_gen = vehicleRandomEngine();
   std::uniform_real_distribution<double> uni_real_dist(-4.0, 4.0);
 
-  populateVehicleObj(vehicle, ego_);
+  populateVehicleObj(vehicle, transform, ego_);
 
   ego_.speed() = policy_speed;
   ego_.policySpeed() = policy_speed;
@@ -184,47 +180,45 @@ boost::optional<size_t> RandomTrafficNode::spawnAgentVehicle(
     const double policy_speed,
     const bool noisy_speed) {
 
+  // All random numbers of the vehicle are drawn from its own stream.
+  utils::CounterRandomEngine rand_gen = vehicleRandomEngine();
+
   // Get the blueprint of the vehicle, which is randomly chosen from the
   // vehicle blueprint library.
   boost::shared_ptr<CarlaBlueprintLibrary> blueprint_library =
     world_->GetBlueprintLibrary()->Filter("vehicle");
-  auto blueprint = (*blueprint_library)[std::rand() % blueprint_library->size()];
+  auto blueprint = (*blueprint_library)[rand_gen() % blueprint_library->size()];
 
   // Make sure the vehicle will fall onto the ground instead of fall endlessly.
   CarlaTransform transform = waypoint->GetTransform();
   transform.location.z += 0.5;
 
-  boost::shared_ptr<CarlaActor> actor = world_->TrySpawnActor(blueprint, transform);
-  boost::shared_ptr<CarlaVehicle> vehicle = boost::static_pointer_cast<CarlaVehicle>(actor);
+  // The vehicle physics is disabled along with the spawning.
+  boost::shared_ptr<CarlaVehicle> vehicle =
+    spawnCarlaVehicles({std::make_pair(blueprint, transform)}).front();
 
-  if (!actor) {
+  if (!vehicle) {
     // Cannot spawn the actor.
     // There might be a collision at the waypoint or something.
     ROS_ERROR_NAMED("carla simulator", "Cannot spawn the agent vehicle.");
     return boost::none;
   }
 
-  // Disable the vehicle physics.
-  actor->SetSimulatePhysics(false);
-
   if (traffic_manager_->addVehicle(
         std::make_tuple(vehicle->GetId(), transform, vehicle->GetBoundingBox())) != 1) {
     // Cannot add this vehicle to the traffic lattice.
     // This is either because the vehicle already exists or it causes a collision on the lattice.
-    vehicle->Destroy();
+    destroyCarlaVehicles({vehicle->GetId()});
     ROS_ERROR_NAMED("carla simulator",
         "Cannot add the agent vehicle to the traffic lattice.");
     return boost::none;
   }
-  world_->Tick();
 
   // Set the agent vehicle policy
-  const size_t seed = std::chrono::system_clock::now().time_since_epoch().count();
-  std::default_random_engine rand_gen(seed);
   std::uniform_real_distribution<double> uni_real_dist(-4.0, 4.0);
 
   planner::Vehicle agent;
-  populateVehicleObj(vehicle, agent);
+  populateVehicleObj(vehicle, transform, agent);
 
   agent.speed() = policy_speed;
   agent.policySpeed() = policy_speed;
@@ -260,24 +254,22 @@ void RandomTrafficNode::manageTraffic() {
   if (!traffic_manager_->moveTrafficForward(
         vehicles, shift_distance, disappear_vehicles)) {
     ROS_ERROR_NAMED("carla simulator", "Collision detected");
+    ++collisions_;
   }
 
   // Remove the vehicles that disappear.
-  for (const size_t id : disappear_vehicles) {
-    if (id == ego_.id()) {
-      ROS_ERROR_NAMED("carla simulator", "The ego vehicle is removed.");
-      throw std::runtime_error("The ego vehicle is removed from the simulation.");
-    }
+  if (disappear_vehicles.count(ego_.id()) != 0) {
+    ROS_ERROR_NAMED("carla simulator", "The ego vehicle is removed.");
+    throw std::runtime_error("The ego vehicle is removed from the simulation.");
+  }
 
-    // Remove the vehicle from the carla server.
-    boost::shared_ptr<CarlaVehicle> vehicle = agentVehicle(id);
-    if (!world_->GetActor(id)->Destroy())
-      ROS_WARN_NAMED("carla simulator", "Cannot destroy agent %lu.", id);
-    world_->Tick();
+  // All the vehicles are removed from the carla server in one batch.
+  destroyCarlaVehicles(std::vector<size_t>(
+        disappear_vehicles.begin(), disappear_vehicles.end()));
+  for (const size_t id : disappear_vehicles) agents_.erase(id);
 
-    // Remove the vehicle from the agents.
-    agents_.erase(id);
-  }
+  // The server is ticked at most once for all the removed and spawned vehicles.
+  bool traffic_changed = !disappear_vehicles.empty();
 
   // Spawn more vehicles if the number of agents around the ego vehicle
   // does not meet the requirement.
@@ -299,20 +291,18 @@ void RandomTrafficNode::manageTraffic() {
     boost::shared_ptr<const CarlaWaypoint> spawn_waypoint = nullptr;
     double policy_speed = 0.0;
 
-    const size_t seed = std::chrono::system_clock::now().time_since_epoch().count();
-    std::default_random_engine rand_gen(seed);
     std::uniform_real_distribution<double> uni_real_dist(-10.0, 10.0);
 
     if (front_distance>=back_distance && front_distance>=min_distance) {
       // Spawn a new vehicle at the front of the lattice.
-      const double distance = min_distance/2.0 + uni_real_dist(rand_gen);
+      const double distance = min_distance/2.0 + uni_real_dist(spawn_rand_gen_);
       boost::shared_ptr<const CarlaWaypoint> waypoint = front->second;
       spawn_waypoint = traffic_manager_->back(waypoint, distance)->waypoint();
     }
 
     if (front_distance<back_distance && back_distance>=min_distance) {
       // Spawn a new vehicle at the back of the lattice.
-      const double distance = min_distance/2.0 + uni_real_dist(rand_gen);
+      const double distance = min_distance/2.0 + uni_real_dist(spawn_rand_gen_);
       boost::shared_ptr<const CarlaWaypoint> waypoint = back->second;
       spawn_waypoint = traffic_manager_->front(waypoint, distance)->waypoint();
     }
@@ -320,16 +310,18 @@ void RandomTrafficNode::manageTraffic() {
     if (!spawn_waypoint) {
       ROS_WARN_NAMED("carla simulator",
           "Cannot find a spawn waypoint for a new agent vehicle.");
-      return;
-    }
-
-    if (!spawnAgentVehicle(spawn_waypoint, nominal_policy_speed_)) {
+    } else if (!spawnAgentVehicle(spawn_waypoint, nominal_policy_speed_)) {
       ROS_WARN_NAMED("carla simulator",
           "Cannot spawn a new agent vehicle at the given waypoint.");
-      return;
+    } else {
+      traffic_changed = true;
     }
   }
 
+  // Let the server know about the removed and spawned vehicles, so that
+  // the transforms of the new vehicles are available from their actors.
+  if (traffic_changed) world_->Tick();
+
   return;
 }
 
@@ -356,44 +348,73 @@ void RandomTrafficNode::tickWorld() {
     }
   }
 
-  publishTraffic();
-  sendEgoGoal();
-  sendAgentsGoal();
+  if (visualization_worker_) {
+    sendEgoGoal();
+    sendAgentsGoal();
+    publishTraffic();
+  } else {
+    publishTraffic();
+    sendEgoGoal();
+    sendAgentsGoal();
+  }
 
   return;
 }
 
 void RandomTrafficNode::publishTraffic() const {
 
-  // Ego vehicle transform.
-  tf_broadcaster_.sendTransform(*(createVehicleTransformMsg(egoVehicle(), "ego")));
-
-  // Traffic msg.
-  visualization_msgs::MarkerArrayPtr vehicles_msg =
-    createVehiclesMsg(this->vehicles());
-  visualization_msgs::MarkerArrayPtr vehicle_ids_msg =
-    createVehicleIdsMsg(this->vehicles());
-  visualization_msgs::MarkerArrayPtr lattice_msg =
-    createTrafficManagerMsg(traffic_manager_);
-
-  visualization_msgs::MarkerArrayPtr traffic_msg(
-      new visualization_msgs::MarkerArray);
-  traffic_msg->markers.insert(
-      traffic_msg->markers.end(),
-      vehicles_msg->markers.begin(), vehicles_msg->markers.end());
-  traffic_msg->markers.insert(
-      traffic_msg->markers.end(),
-      vehicle_ids_msg->markers.begin(), vehicle_ids_msg->markers.end());
-  traffic_msg->markers.insert(
-      traffic_msg->markers.end(),
-      lattice_msg->markers.begin(), lattice_msg->markers.end());
-
-  traffic_pub_.publish(traffic_msg);
+  // The actors are collected on the calling thread, while the messages
+  // may be created and published on the visualization worker. In the
+  // pipelined mode, the traffic manager is copied since it is updated by
+  // the next tick while the markers are still being created. Nothing is
+  // collected if there is no subscriber to the markers.
+  const bool publish_markers = traffic_pub_->ready();
+  const boost::shared_ptr<const CarlaVehicle> ego_vehicle = egoVehicle();
+  std::vector<boost::shared_ptr<const CarlaVehicle>> vehicles;
+  boost::shared_ptr<const TrafficManager> traffic_manager = nullptr;
+  if (publish_markers) {
+    vehicles = this->vehicles();
+    traffic_manager = visualization_worker_ ?
+      boost::make_shared<const TrafficManager>(*traffic_manager_) :
+      traffic_manager_;
+  }
+
+  publishVisualization("traffic",
+      [this, ego_vehicle, vehicles, traffic_manager, publish_markers]() {
+    // Ego vehicle transform.
+    tf_broadcaster_.sendTransform(*(createVehicleTransformMsg(ego_vehicle, "ego")));
+    if (!publish_markers) return;
+
+    // Traffic msg.
+    visualization_msgs::MarkerArrayPtr vehicles_msg =
+      createVehiclesMsg(vehicles);
+    visualization_msgs::MarkerArrayPtr vehicle_ids_msg =
+      createVehicleIdsMsg(vehicles);
+    visualization_msgs::MarkerArrayPtr lattice_msg =
+      createTrafficManagerMsg(traffic_manager);
+
+    visualization_msgs::MarkerArrayPtr traffic_msg(
+        new visualization_msgs::MarkerArray);
+    traffic_msg->markers.insert(
+        traffic_msg->markers.end(),
+        vehicles_msg->markers.begin(), vehicles_msg->markers.end());
+    traffic_msg->markers.insert(
+        traffic_msg->markers.end(),
+        vehicle_ids_msg->markers.begin(), vehicle_ids_msg->markers.end());
+    traffic_msg->markers.insert(
+        traffic_msg->markers.end(),
+        lattice_msg->markers.begin(), lattice_msg->markers.end());
+
+    traffic_pub_->publish(traffic_msg);
+  });
+
   return;
 }
 
 } // End namespace node.
 
+// The nodelet library, see src/node/nodelets.cpp, is built without main().
+#ifndef CLP_NODELET
 int main(int argc, char** argv) {
 
   ros::init(argc, argv, "~");
@@ -414,3 +435,4 @@ int main(int argc, char** argv) {
   ros::spin();
   return 0;
 }
+#endif
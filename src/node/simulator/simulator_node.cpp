@@ -12,10 +12,20 @@
  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cstdio>
+#include <cstring>
 #include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
 #include <random>
 #include <chrono>
+#include <boost/format.hpp>
 
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <ros/serialization.h>
 #include <tf2/LinearMath/Quaternion.h>
 #include <tf2/LinearMath/Matrix3x3.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
@@ -26,13 +36,87 @@
 
 namespace node {
 
+namespace {
+
+/// Header of the file caching the map markers.
+struct MarkerCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t size;
+  uint64_t opendrive_hash;
+};
+
+/// Load the markers from the cache file, \c nullptr if the file does
+/// not exist or is created for a different map.
+visualization_msgs::MarkerArrayPtr loadMarkerArray(
+    const std::string& path, const uint64_t opendrive_hash) {
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return nullptr;
+
+  MarkerCacheHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(MarkerCacheHeader)))
+    return nullptr;
+  if (std::memcmp(header.magic, "CLPMAPMK", sizeof(header.magic)) != 0 ||
+      header.version != 1 ||
+      header.opendrive_hash != opendrive_hash) return nullptr;
+
+  std::vector<uint8_t> buffer(header.size);
+  if (!file.read(reinterpret_cast<char*>(buffer.data()), buffer.size()))
+    return nullptr;
+
+  visualization_msgs::MarkerArrayPtr msg(new visualization_msgs::MarkerArray);
+  ros::serialization::IStream stream(buffer.data(), buffer.size());
+  ros::serialization::deserialize(stream, *msg);
+  return msg;
+}
+
+/// Save the markers into the cache file. The file is written with a
+/// temporary name first, so that other processes never see a partial file.
+bool saveMarkerArray(const std::string& directory,
+                     const std::string& path,
+                     const uint64_t opendrive_hash,
+                     const visualization_msgs::MarkerArray& msg) {
+
+  mkdir(directory.c_str(), 0755);
+  const std::string tmp_path = (boost::format("%1%.%2%.tmp") % path % getpid()).str();
+  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+  if (!file) return false;
+
+  std::vector<uint8_t> buffer(ros::serialization::serializationLength(msg));
+  ros::serialization::OStream stream(buffer.data(), buffer.size());
+  ros::serialization::serialize(stream, msg);
+
+  MarkerCacheHeader header;
+  std::memset(&header, 0, sizeof(MarkerCacheHeader));
+  std::memcpy(header.magic, "CLPMAPMK", sizeof(header.magic));
+  header.version = 1;
+  header.size = buffer.size();
+  header.opendrive_hash = opendrive_hash;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(MarkerCacheHeader));
+  file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  file.close();
+
+  if (!file || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // End anonymous namespace.
+
 bool SimulatorNode::initialize() {
 
   bool all_param_exist = true;
 
   // Create publishers.
   map_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("town_map", 1, true);
-  traffic_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("traffic", 1, true);
+
+  // The maximum rate (Hz) of the traffic markers, 0 for no limit.
+  double visualization_rate = 0.0;
+  nh_.param<double>("visualization_rate", visualization_rate, 0.0);
+  traffic_pub_ = boost::make_shared<MarkerArrayPublisher>(nh_, "traffic", visualization_rate);
 
   // Get the world.
   std::string host = "localhost";
@@ -40,6 +124,12 @@ bool SimulatorNode::initialize() {
   all_param_exist &= nh_.param<std::string>("host", host, "localhost");
   all_param_exist &= nh_.param<int>("port", port, 2000);
 
+  // The directory to cache the waypoints of the map, shared by all nodes.
+  std::string fast_map_cache_directory = "/tmp/conformal_lattice_planner";
+  nh_.param<std::string>("fast_map_cache_directory",
+      fast_map_cache_directory, "/tmp/conformal_lattice_planner");
+  map_cache_directory_ = fast_map_cache_directory;
+
   ROS_INFO_NAMED("carla_simulator", "connect to the server.");
   client_ = boost::make_shared<CarlaClient>(host, port);
   client_->SetTimeout(std::chrono::seconds(10));
@@ -51,7 +141,16 @@ bool SimulatorNode::initialize() {
 
   // Set the map.
   map_ = world_->GetMap();
-  fast_map_ = boost::make_shared<utils::FastWaypointMap>(map_);
+  fast_map_ = utils::FastWaypointMap::shared(
+      map_, 0.05, fast_map_cache_directory);
+
+  // Connect the waypoints of the whole map, so that the router finds the
+  // next, left, and right waypoints without walking the carla map.
+  loop_router_->setWaypointGraph(utils::WaypointGraph::shared(fast_map_));
+
+  // Sample the lanes on the route once, so that the front waypoints
+  // are not searched on the map every time.
+  loop_router_->buildRouteIndex(map_);
 
   // Applying the world settings.
   double fixed_delta_seconds = 0.05;
@@ -88,6 +187,24 @@ bool SimulatorNode::initialize() {
       settings.no_rendering_mode,
       settings.synchronous_mode);
 
+  // The file to record the traffic at every tick.
+  // Nothing is recorded if the path is empty.
+  std::string traffic_log_path = "";
+  nh_.param<std::string>("traffic_log", traffic_log_path, "");
+  if (!traffic_log_path.empty())
+    traffic_log_ = boost::make_shared<planner::TrafficLogWriter>(traffic_log_path);
+
+  // The file to record the metrics of the experiment at every tick.
+  // Nothing is recorded if the path is empty.
+  std::string telemetry_log_path = "";
+  nh_.param<std::string>("telemetry_log", telemetry_log_path, "");
+  if (!telemetry_log_path.empty())
+    telemetry_ = boost::make_shared<planner::TelemetrySink>(telemetry_log_path);
+
+  initializeScenarioSeed();
+  initializePipeline();
+  initializeSnapshotEncoders();
+
   // Publish the map.
   ROS_INFO_NAMED("carla_simulator", "publish global map.");
   publishMap();
@@ -128,26 +245,22 @@ boost::optional<size_t> SimulatorNode::spawnEgoVehicle(
   CarlaTransform transform = waypoint->GetTransform();
   transform.location.z += 0.05;
 
-  boost::shared_ptr<CarlaActor> actor = world_->TrySpawnActor(blueprint, transform);
-  boost::shared_ptr<CarlaVehicle> vehicle = boost::static_pointer_cast<CarlaVehicle>(actor);
+  // The vehicle physics is disabled along with the spawning.
+  boost::shared_ptr<CarlaVehicle> vehicle =
+    spawnCarlaVehicles({std::make_pair(blueprint, transform)}).front();
 
-  if (!actor) {
+  if (!vehicle) {
     // Cannot spawn the actor.
     // There might be a collision at the waypoint or something.
     ROS_ERROR_NAMED("carla simulator", "Cannot spawn the ego vehicle.");
     return boost::none;
   }
 
-  // Disable the vehicle physics.
-  actor->SetSimulatePhysics(false);
-  world_->Tick();
-
   // Set the ego vehicle.
-  const size_t seed = std::chrono::system_clock::now().time_since_epoch().count();
-  std::default_random_engine rand_gen(seed);
+  utils::CounterRandomEngine rand_gen = vehicleRandomEngine();
   std::uniform_real_distribution<double> uni_real_dist(-2.0, 2.0);
 
-  populateVehicleObj(vehicle, ego_);
+  populateVehicleObj(vehicle, transform, ego_);
 
   ego_.speed() = policy_speed;
   ego_.policySpeed() = policy_speed;
@@ -165,37 +278,35 @@ boost::optional<size_t> SimulatorNode::spawnAgentVehicle(
     const double policy_speed,
     const bool noisy_speed) {
 
+  // All random numbers of the vehicle are drawn from its own stream.
+  utils::CounterRandomEngine rand_gen = vehicleRandomEngine();
+
   // Get the blueprint of the vehicle, which is randomly chosen from the
   // vehicle blueprint library.
   boost::shared_ptr<CarlaBlueprintLibrary> blueprint_library =
     world_->GetBlueprintLibrary()->Filter("vehicle");
-  auto blueprint = (*blueprint_library)[std::rand() % blueprint_library->size()];
+  auto blueprint = (*blueprint_library)[rand_gen() % blueprint_library->size()];
 
   // Make sure the vehicle will fall onto the ground instead of fall endlessly.
   CarlaTransform transform = waypoint->GetTransform();
   transform.location.z += 0.5;
 
-  boost::shared_ptr<CarlaActor> actor = world_->TrySpawnActor(blueprint, transform);
-  boost::shared_ptr<CarlaVehicle> vehicle = boost::static_pointer_cast<CarlaVehicle>(actor);
+  // The vehicle physics is disabled along with the spawning.
+  boost::shared_ptr<CarlaVehicle> vehicle =
+    spawnCarlaVehicles({std::make_pair(blueprint, transform)}).front();
 
-  if (!actor) {
+  if (!vehicle) {
     // Cannot spawn the actor.
     // There might be a collision at the waypoint or something.
     ROS_ERROR_NAMED("carla simulator", "Cannot spawn the agent vehicle.");
     return boost::none;
   }
 
-  // Disable the vehicle physics.
-  actor->SetSimulatePhysics(false);
-  world_->Tick();
-
   // Set the agent vehicle.
-  const size_t seed = std::chrono::system_clock::now().time_since_epoch().count();
-  std::default_random_engine rand_gen(seed);
   std::uniform_real_distribution<double> uni_real_dist(-2.0, 2.0);
 
   planner::Vehicle agent;
-  populateVehicleObj(vehicle, agent);
+  populateVehicleObj(vehicle, transform, agent);
 
   agent.speed() = policy_speed;
   agent.policySpeed() = policy_speed;
@@ -246,12 +357,145 @@ void SimulatorNode::spawnCamera() {
   return;
 }
 
+std::vector<boost::shared_ptr<SimulatorNode::CarlaVehicle>>
+  SimulatorNode::spawnCarlaVehicles(
+      const std::vector<std::pair<CarlaBlueprint, CarlaTransform>>& vehicles) {
+
+  std::vector<boost::shared_ptr<CarlaVehicle>> vehicle_actors(vehicles.size(), nullptr);
+  if (vehicles.empty()) return vehicle_actors;
+
+  // Spawn all the vehicles in one batch. The batch is applied synchronously
+  // since the IDs of the spawned vehicles are required.
+  std::vector<CarlaCommand> spawn_commands;
+  spawn_commands.reserve(vehicles.size());
+  for (const auto& vehicle : vehicles) {
+    spawn_commands.emplace_back(CarlaCommand::SpawnActor(
+          vehicle.first.MakeActorDescription(), vehicle.second));
+  }
+  const std::vector<CarlaCommandResponse> spawn_responses =
+    client_->ApplyBatchSync(std::move(spawn_commands));
+
+  // Disable the physics of all the spawned vehicles in one batch.
+  std::vector<carla::rpc::ActorId> ids;
+  std::vector<CarlaCommand> physics_commands;
+  for (const auto& response : spawn_responses) {
+    if (response.HasError()) continue;
+    ids.push_back(response.Get());
+    physics_commands.emplace_back(CarlaCommand::SetSimulatePhysics(response.Get(), false));
+  }
+  if (ids.empty()) return vehicle_actors;
+
+  const std::vector<CarlaCommandResponse> physics_responses =
+    client_->ApplyBatchSync(std::move(physics_commands));
+  for (size_t i = 0; i < physics_responses.size(); ++i) {
+    if (!physics_responses[i].HasError()) continue;
+    ROS_WARN_NAMED("carla simulator",
+        "Cannot disable the physics of vehicle %u: %s",
+        ids[i], physics_responses[i].GetError().GetMessage().c_str());
+  }
+
+  // Get the actors of all the spawned vehicles at once.
+  boost::shared_ptr<CarlaActorList> actors = world_->GetActors(ids);
+  for (size_t i = 0; i < spawn_responses.size(); ++i) {
+    if (spawn_responses[i].HasError()) continue;
+    vehicle_actors[i] = boost::static_pointer_cast<CarlaVehicle>(
+        actors->Find(spawn_responses[i].Get()));
+  }
+
+  return vehicle_actors;
+}
+
+size_t SimulatorNode::destroyCarlaVehicles(const std::vector<size_t>& vehicles) {
+
+  if (vehicles.empty()) return 0;
+
+  std::vector<CarlaCommand> commands;
+  commands.reserve(vehicles.size());
+  for (const size_t id : vehicles)
+    commands.emplace_back(CarlaCommand::DestroyActor(static_cast<carla::rpc::ActorId>(id)));
+
+  const std::vector<CarlaCommandResponse> responses =
+    client_->ApplyBatchSync(std::move(commands));
+
+  size_t destroyed = 0;
+  for (size_t i = 0; i < responses.size(); ++i) {
+    if (!responses[i].HasError()) {
+      ++destroyed;
+      continue;
+    }
+    ROS_WARN_NAMED("carla simulator", "Cannot destroy vehicle %lu: %s",
+        vehicles[i], responses[i].GetError().GetMessage().c_str());
+  }
+
+  return destroyed;
+}
+
+void SimulatorNode::initializeScenarioSeed() {
+  // A negative seed means the traffic differs every run.
+  // The seed is logged anyway, so that the run can be replayed.
+  int scenario_seed = -1;
+  nh_.param<int>("scenario_seed", scenario_seed, -1);
+  scenario_seed_ = utils::ScenarioSeed::fromParam(scenario_seed);
+  spawn_rand_gen_ = scenario_seed_.stream("spawn");
+  spawned_vehicles_ = 0;
+  ROS_INFO_NAMED("carla_simulator", "scenario seed: %lu", scenario_seed_.seed());
+
+  // Share the resolved seed with the agents planner in the same namespace,
+  // so that both nodes derive their random streams from the same seed.
+  ros::param::set("resolved_scenario_seed", static_cast<int>(scenario_seed_.seed()));
+  return;
+}
+
+void SimulatorNode::initializePipeline() {
+
+  bool pipelined = false;
+  nh_.param<bool>("pipelined", pipelined, false);
+  if (!pipelined) return;
+
+  ROS_INFO_NAMED("carla_simulator", "publish the visualization in the background.");
+  visualization_worker_ = boost::make_shared<utils::BackgroundWorker>(
+      [](const std::exception& e) {
+        ROS_WARN_NAMED("carla_simulator",
+            "Cannot publish the visualization: %s", e.what());
+      });
+  return;
+}
+
+void SimulatorNode::initializeSnapshotEncoders() {
+
+  // Only send the changes of the traffic to the planners, except
+  // a complete snapshot every snapshot_keyframe_interval ticks.
+  bool incremental_snapshots = false;
+  int snapshot_keyframe_interval = 100;
+  nh_.param<bool>("incremental_snapshots", incremental_snapshots, false);
+  nh_.param<int>("snapshot_keyframe_interval", snapshot_keyframe_interval, 100);
+
+  const size_t keyframe_interval = std::max(snapshot_keyframe_interval, 0);
+  ego_snapshot_encoder_ = SnapshotEncoder(incremental_snapshots, keyframe_interval);
+  agents_snapshot_encoder_ = SnapshotEncoder(incremental_snapshots, keyframe_interval);
+  return;
+}
+
+void SimulatorNode::publishVisualization(
+    const std::string& key, const std::function<void()>& task) const {
+  if (visualization_worker_) visualization_worker_->post(key, task);
+  else task();
+  return;
+}
+
 void SimulatorNode::publishImage(
     const boost::shared_ptr<CarlaSensorData>& data) const {
 
+  // Nobody is watching.
+  if (following_img_pub_.getNumSubscribers() == 0) return;
+
+  // The conversion of the image is left to the visualization worker,
+  // so that the sensor callback returns right away.
   const boost::shared_ptr<CarlaBGRAImage> img =
     boost::static_pointer_cast<CarlaBGRAImage>(data);
-  following_img_pub_.publish(createImageMsg(img));
+  publishVisualization("image", [this, img]() {
+      following_img_pub_.publish(createImageMsg(img));
+  });
 
   return;
 }
@@ -312,65 +556,97 @@ std::vector<boost::shared_ptr<const SimulatorNode::CarlaVehicle>>
 
 void SimulatorNode::publishMap() const {
 
-  std::vector<boost::shared_ptr<CarlaWaypoint>> waypoints =
-    map_->GenerateWaypoints(5.0);
-  std::vector<boost::shared_ptr<const CarlaWaypoint>> const_waypoints;
-
-  for (const auto& waypoint : waypoints)
-    const_waypoints.push_back(waypoint);
-
-  visualization_msgs::MarkerPtr waypoints_msg =
-    createWaypointMsg(const_waypoints);
-  visualization_msgs::MarkerPtr junctions_msg =
-    createJunctionMsg(map_->GetTopology());
-  visualization_msgs::MarkerArrayPtr road_ids_msg =
-    createRoadIdsMsg(map_->GetMap().GetMap().GetRoads());
-
-  visualization_msgs::MarkerArrayPtr map_msg(new visualization_msgs::MarkerArray);
-  map_msg->markers.push_back(*waypoints_msg);
-  map_msg->markers.push_back(*junctions_msg);
-  map_msg->markers.insert(
-      map_msg->markers.begin(),
-      road_ids_msg->markers.begin(), road_ids_msg->markers.end());
+  // The markers are latched, nothing to do if the map is not changed.
+  const uint64_t opendrive_hash = fast_map_->opendriveHash();
+  if (published_map_hash_ && *published_map_hash_ == opendrive_hash) return;
+
+  std::string map_name = map_->GetName();
+  std::replace(map_name.begin(), map_name.end(), '/', '_');
+  const std::string cache_path = map_cache_directory_.empty() ?
+    std::string() :
+    (boost::format("%1%/%2%_markers.bin") % map_cache_directory_ % map_name).str();
+
+  visualization_msgs::MarkerArrayPtr map_msg = nullptr;
+  if (!cache_path.empty()) map_msg = loadMarkerArray(cache_path, opendrive_hash);
+
+  if (!map_msg) {
+    std::vector<boost::shared_ptr<CarlaWaypoint>> waypoints =
+      map_->GenerateWaypoints(5.0);
+    std::vector<boost::shared_ptr<const CarlaWaypoint>> const_waypoints;
+
+    for (const auto& waypoint : waypoints)
+      const_waypoints.push_back(waypoint);
+
+    visualization_msgs::MarkerPtr waypoints_msg =
+      createWaypointMsg(const_waypoints);
+    visualization_msgs::MarkerPtr junctions_msg =
+      createJunctionMsg(map_->GetTopology());
+    visualization_msgs::MarkerArrayPtr road_ids_msg =
+      createRoadIdsMsg(map_->GetMap().GetMap().GetRoads());
+
+    map_msg = visualization_msgs::MarkerArrayPtr(new visualization_msgs::MarkerArray);
+    map_msg->markers.push_back(*waypoints_msg);
+    map_msg->markers.push_back(*junctions_msg);
+    map_msg->markers.insert(
+        map_msg->markers.begin(),
+        road_ids_msg->markers.begin(), road_ids_msg->markers.end());
+
+    // Failing to write the cache is not an error.
+    if (!cache_path.empty())
+      saveMarkerArray(map_cache_directory_, cache_path, opendrive_hash, *map_msg);
+  }
 
   map_pub_.publish(map_msg);
+  published_map_hash_ = opendrive_hash;
   return;
 }
 
 void SimulatorNode::publishTraffic() const {
 
-  // Ego vehicle transform.
-  tf_broadcaster_.sendTransform(*(createVehicleTransformMsg(egoVehicle(), "ego")));
-
-  // Traffic msg.
-  visualization_msgs::MarkerArrayPtr vehicles_msg =
-    createVehiclesMsg(this->vehicles());
-  visualization_msgs::MarkerArrayPtr vehicle_ids_msg =
-    createVehicleIdsMsg(this->vehicles());
-
-  visualization_msgs::MarkerArrayPtr traffic_msg(
-      new visualization_msgs::MarkerArray);
-  traffic_msg->markers.insert(
-      traffic_msg->markers.end(),
-      vehicles_msg->markers.begin(), vehicles_msg->markers.end());
-  traffic_msg->markers.insert(
-      traffic_msg->markers.end(),
-      vehicle_ids_msg->markers.begin(), vehicle_ids_msg->markers.end());
-
-  traffic_pub_.publish(traffic_msg);
+  // The actors are collected on the calling thread, while the messages
+  // may be created and published on the visualization worker.
+  // The markers are only created if there are subscribers.
+  const bool publish_markers = traffic_pub_->ready();
+  const boost::shared_ptr<const CarlaVehicle> ego_vehicle = egoVehicle();
+  std::vector<boost::shared_ptr<const CarlaVehicle>> vehicles;
+  if (publish_markers) vehicles = this->vehicles();
+
+  publishVisualization("traffic", [this, ego_vehicle, vehicles, publish_markers]() {
+    // Ego vehicle transform.
+    tf_broadcaster_.sendTransform(*(createVehicleTransformMsg(ego_vehicle, "ego")));
+    if (!publish_markers) return;
+
+    // Traffic msg.
+    visualization_msgs::MarkerArrayPtr vehicles_msg =
+      createVehiclesMsg(vehicles);
+    visualization_msgs::MarkerArrayPtr vehicle_ids_msg =
+      createVehicleIdsMsg(vehicles);
+
+    visualization_msgs::MarkerArrayPtr traffic_msg(
+        new visualization_msgs::MarkerArray);
+    traffic_msg->markers.insert(
+        traffic_msg->markers.end(),
+        vehicles_msg->markers.begin(), vehicles_msg->markers.end());
+    traffic_msg->markers.insert(
+        traffic_msg->markers.end(),
+        vehicle_ids_msg->markers.begin(), vehicle_ids_msg->markers.end());
+
+    traffic_pub_->publish(traffic_msg);
+  });
+
   return;
 }
 
 void SimulatorNode::sendEgoGoal() {
 
-  conformal_lattice_planner::EgoPlanGoal goal;
+  // Record the traffic before it is sent to the planners.
+  if (traffic_log_) traffic_log_->write(simulation_time_, ego_, agents_);
+
+  conformal_lattice_planner::EgoPlanGoal& goal = ego_goal_;
+  goal = conformal_lattice_planner::EgoPlanGoal();
   goal.header.stamp = ros::Time::now();
   goal.simulation_time = simulation_time_;
-  populateVehicleMsg(ego_, goal.snapshot.ego);
-  for (const auto& item : agents_) {
-    goal.snapshot.agents.push_back(conformal_lattice_planner::Vehicle());
-    populateVehicleMsg(item.second, goal.snapshot.agents.back());
-  }
+  ego_snapshot_encoder_.encode(ego_, agents_, goal.snapshot);
 
   // Figure out the leader and follower of the ego vehicle.
   boost::shared_ptr<planner::Snapshot> snapshot =
@@ -430,6 +706,25 @@ void SimulatorNode::sendEgoGoal() {
     goal.right_back_distance = -1.0;
   }
 
+  if (telemetry_) {
+    planner::TelemetryRecord& record = telemetry_record_;
+    record = planner::TelemetryRecord();
+    record.simulation_time = simulation_time_;
+    record.ego_speed = ego_.speed();
+    record.ego_acceleration = ego_.acceleration();
+    record.ego_policy_speed = ego_.policySpeed();
+    record.front_distance = goal.front_distance;
+    record.back_distance = goal.back_distance;
+
+    const double closing_speed = front_leader ?
+      ego_.speed() - agents_[front_leader->first].speed() : 0.0;
+    if (front_leader && closing_speed > 0.0)
+      record.ttc = front_leader->second / closing_speed;
+
+    record.collisions = collisions_;
+    collisions_ = 0;
+  }
+
   ego_client_.sendGoal(
       goal,
       boost::bind(&SimulatorNode::egoPlanDoneCallback, this, _1, _2),
@@ -446,12 +741,34 @@ void SimulatorNode::egoPlanDoneCallback(
 
   ROS_INFO_NAMED("carla_simulator", "egoPlanDoneCallback().");
 
+  // The planner has missed some of the incremental snapshots.
+  if (result->resync) {
+    ROS_WARN_NAMED("carla_simulator", "resync the traffic snapshot of the ego planner.");
+    ego_snapshot_encoder_.resync(ego_goal_.snapshot);
+    ego_goal_.header.stamp = ros::Time::now();
+    ego_client_.sendGoal(
+        ego_goal_,
+        boost::bind(&SimulatorNode::egoPlanDoneCallback, this, _1, _2),
+        boost::bind(&SimulatorNode::egoPlanActiveCallback, this),
+        boost::bind(&SimulatorNode::egoPlanFeedbackCallback, this, _1));
+    return;
+  }
+
   if (result->ego.id != ego_.id())
     throw std::runtime_error("The ego ID in the action result does not exist.");
 
   // Update the ego vehicle.
   populateVehicleObj(result->ego, ego_);
 
+  if (telemetry_) {
+    telemetry_record_.planning_time = result->planning_time;
+    telemetry_record_.path_type = result->path_type;
+    telemetry_record_.expanded_vertices = result->expanded_vertices;
+    telemetry_record_.graph_vertices = result->graph_vertices;
+    if (!telemetry_->push(telemetry_record_))
+      ROS_WARN_NAMED("carla_simulator", "telemetry record dropped.");
+  }
+
   ego_ready_ = true;
 
   if (ego_ready_ && agents_ready_) {
@@ -464,14 +781,11 @@ void SimulatorNode::egoPlanDoneCallback(
 
 void SimulatorNode::sendAgentsGoal() {
 
-  conformal_lattice_planner::AgentPlanGoal goal;
+  conformal_lattice_planner::AgentPlanGoal& goal = agents_goal_;
+  goal = conformal_lattice_planner::AgentPlanGoal();
   goal.header.stamp = ros::Time::now();
   goal.simulation_time = simulation_time_;
-  populateVehicleMsg(ego_, goal.snapshot.ego);
-  for (const auto& item : agents_) {
-    goal.snapshot.agents.push_back(conformal_lattice_planner::Vehicle());
-    populateVehicleMsg(item.second, goal.snapshot.agents.back());
-  }
+  agents_snapshot_encoder_.encode(ego_, agents_, goal.snapshot);
 
   agents_client_.sendGoal(
       goal,
@@ -489,6 +803,19 @@ void SimulatorNode::agentsPlanDoneCallback(
 
   ROS_INFO_NAMED("carla_simulator", "agentsPlanDoneCallback().");
 
+  // The planner has missed some of the incremental snapshots.
+  if (result->resync) {
+    ROS_WARN_NAMED("carla_simulator", "resync the traffic snapshot of the agents planner.");
+    agents_snapshot_encoder_.resync(agents_goal_.snapshot);
+    agents_goal_.header.stamp = ros::Time::now();
+    agents_client_.sendGoal(
+        agents_goal_,
+        boost::bind(&SimulatorNode::agentsPlanDoneCallback, this, _1, _2),
+        boost::bind(&SimulatorNode::agentsPlanActiveCallback, this),
+        boost::bind(&SimulatorNode::agentsPlanFeedbackCallback, this, _1));
+    return;
+  }
+
   // FIXME: Is it necessary to do cross check?
   for (const auto& agent : result->agents) {
     if (agents_.count(agent.id) == 0)
@@ -580,15 +907,23 @@ void SimulatorNode::populateVehicleObj(
 void SimulatorNode::populateVehicleObj(
     const boost::shared_ptr<const CarlaVehicle>& vehicle_actor,
     planner::Vehicle& vehicle_obj) {
+  populateVehicleObj(vehicle_actor, vehicle_actor->GetTransform(), vehicle_obj);
+  return;
+}
+
+void SimulatorNode::populateVehicleObj(
+    const boost::shared_ptr<const CarlaVehicle>& vehicle_actor,
+    const CarlaTransform& transform,
+    planner::Vehicle& vehicle_obj) {
   // ID.
   vehicle_obj.id() = vehicle_actor->GetId();
   // Bounding box.
   vehicle_obj.boundingBox() = vehicle_actor->GetBoundingBox();
   // Transform.
-  vehicle_obj.transform() = vehicle_actor->GetTransform();
+  vehicle_obj.transform() = transform;
   // Curvature.
-  vehicle_obj.curvature() = utils::curvatureAtWaypoint(
-      map_->GetWaypoint(vehicle_actor->GetLocation()), map_);
+  vehicle_obj.curvature() = fast_map_->curvature(
+      map_->GetWaypoint(transform.location));
   // Acceleration.
   vehicle_obj.acceleration() = 0.0;
   // Speed and policy speed should be set by the caller.
@@ -14,8 +14,10 @@
 
 #pragma once
 
+#include <string>
 #include <vector>
 #include <utility>
+#include <functional>
 #include <unordered_map>
 
 #include <boost/smart_ptr.hpp>
@@ -33,14 +35,23 @@
 #include <carla/client/Client.h>
 #include <carla/client/World.h>
 #include <carla/client/Map.h>
+#include <carla/client/ActorBlueprint.h>
 #include <carla/client/BlueprintLibrary.h>
 #include <carla/client/ActorList.h>
 #include <carla/client/Sensor.h>
 #include <carla/sensor/data/Image.h>
+#include <carla/rpc/Command.h>
+#include <carla/rpc/CommandResponse.h>
 
 #include <router/loop_router/loop_router.h>
 #include <planner/common/fast_waypoint_map.h>
 #include <planner/common/vehicle.h>
+#include <planner/common/traffic_log.h>
+#include <planner/common/telemetry.h>
+#include <planner/common/background_worker.h>
+#include <planner/common/scenario_seed.h>
+#include <node/common/convert_snapshot_msgs.h>
+#include <node/common/marker_publisher.h>
 
 #include <conformal_lattice_planner/EgoPlanAction.h>
 #include <conformal_lattice_planner/AgentPlanAction.h>
@@ -55,6 +66,7 @@ protected:
   using CarlaWorld            = carla::client::World;
   using CarlaMap              = carla::client::Map;
   using CarlaBlueprintLibrary = carla::client::BlueprintLibrary;
+  using CarlaBlueprint        = carla::client::ActorBlueprint;
   using CarlaActor            = carla::client::Actor;
   using CarlaActorList        = carla::client::ActorList;
   using CarlaVehicle          = carla::client::Vehicle;
@@ -63,6 +75,8 @@ protected:
   using CarlaSensorData       = carla::sensor::SensorData;
   using CarlaBGRAImage        = carla::sensor::data::Image;
   using CarlaTransform        = carla::geom::Transform;
+  using CarlaCommand          = carla::rpc::Command;
+  using CarlaCommandResponse  = carla::rpc::CommandResponse;
 
 protected:
 
@@ -99,6 +113,54 @@ protected:
   // A camera following the ego vehicle to generate the third person view.
   boost::shared_ptr<CarlaSensor> following_cam_ = nullptr;
 
+  /// The directory to cache the map markers, shared with the fast waypoint map.
+  std::string map_cache_directory_ = "";
+
+  /// The OpenDRIVE hash of the map whose markers are published on \c map_pub_.
+  /// The markers are latched, so they are only published again if the map changes.
+  mutable boost::optional<uint64_t> published_map_hash_ = boost::none;
+
+  /// Records the traffic sent to the ego planner at every tick.
+  /// Nothing is recorded if this is \c nullptr.
+  boost::shared_ptr<planner::TrafficLogWriter> traffic_log_ = nullptr;
+
+  /// Records the metrics of the experiment at every tick.
+  /// Nothing is recorded if this is \c nullptr.
+  boost::shared_ptr<planner::TelemetrySink> telemetry_ = nullptr;
+
+  /// The telemetry of the current tick, which is filled in when the ego
+  /// goal is sent, and pushed once the ego planner returns.
+  planner::TelemetryRecord telemetry_record_;
+
+  /// Number of collisions detected since the last telemetry record.
+  size_t collisions_ = 0;
+
+  /// Builds and publishes the visualization and camera messages, so that they
+  /// overlap with the planning of the next tick. In the serial mode, this is
+  /// \c nullptr and everything is published on the calling thread.
+  boost::shared_ptr<utils::BackgroundWorker> visualization_worker_ = nullptr;
+
+  /// Encode the traffic snapshots sent to the ego and agents planners.
+  /// Each planner keeps its own sequence of snapshots.
+  SnapshotEncoder ego_snapshot_encoder_;
+  SnapshotEncoder agents_snapshot_encoder_;
+
+  /// The seed of the scenario, from which all random numbers of the simulator
+  /// are derived, so that a run can be replayed with the logged seed.
+  utils::ScenarioSeed scenario_seed_;
+
+  /// Number of vehicles spawned so far, which indexes the random
+  /// stream of every vehicle.
+  size_t spawned_vehicles_ = 0;
+
+  /// Random stream deciding where the new vehicles are spawned over time.
+  utils::CounterRandomEngine spawn_rand_gen_;
+
+  /// The last goals sent to the planners, kept so that they can
+  /// be sent again in full if a planner asks for a resync.
+  conformal_lattice_planner::EgoPlanGoal ego_goal_;
+  conformal_lattice_planner::AgentPlanGoal agents_goal_;
+
   /**
    * @name ROS interface
    *
@@ -115,8 +177,9 @@ protected:
   /// Publish the map of the town.
   mutable ros::Publisher map_pub_;
 
-  /// Publish traffice relatated stuff.
-  mutable ros::Publisher traffic_pub_;
+  /// Publish traffice relatated stuff, throttled by the
+  /// \c visualization_rate parameter.
+  boost::shared_ptr<MarkerArrayPublisher> traffic_pub_ = nullptr;
 
   /// ROS image transport.
   mutable image_transport::ImageTransport img_transport_;
@@ -146,7 +209,9 @@ public:
     agents_client_(nh_, "agents_plan", false),
     sim_time_server_(nh_.advertiseService("simulation_time", &SimulatorNode::simTimeCallback, this)){}
 
-  virtual ~SimulatorNode() {}
+  /// The visualization worker is stopped first, since its tasks
+  /// use the publishers.
+  virtual ~SimulatorNode() { visualization_worker_.reset(); }
 
   /// Initialize the simulator ROS node.
   virtual bool initialize();
@@ -168,16 +233,70 @@ protected:
 
   virtual void spawnCamera();
 
+  /**
+   * \brief Spawn vehicles with their physics disabled.
+   *
+   * The vehicles are spawned in one batch of carla commands, and their physics
+   * are disabled in another, so the number of round trips to the server does
+   * not depend on the number of vehicles. The server is not ticked, so the
+   * transforms of the vehicles are not available from the actors until the
+   * next tick, see \c populateVehicleObj().
+   *
+   * \param[in] vehicles The blueprints and transforms of the vehicles.
+   * \return The spawned vehicle actors in the same order, where the ones
+   *         cannot be spawned, e.g. due to collisions, are \c nullptr.
+   */
+  std::vector<boost::shared_ptr<CarlaVehicle>> spawnCarlaVehicles(
+      const std::vector<std::pair<CarlaBlueprint, CarlaTransform>>& vehicles);
+
+  /**
+   * \brief Destroy vehicles in one batch of carla commands.
+   *
+   * The server is not ticked. The vehicles cannot be destroyed are logged.
+   *
+   * \param[in] vehicles The IDs of the vehicles to be destroyed.
+   * \return The number of vehicles destroyed.
+   */
+  size_t destroyCarlaVehicles(const std::vector<size_t>& vehicles);
+
   /// Simulate the world forward by one time step.
+  /// In the pipelined mode, the goals are sent before the traffic is
+  /// published, so that the planners start as early as possible.
   virtual void tickWorld() {
     world_->Tick();
     updateSimTime();
-    publishTraffic();
-    sendEgoGoal();
-    sendAgentsGoal();
+    if (visualization_worker_) {
+      sendEgoGoal();
+      sendAgentsGoal();
+      publishTraffic();
+    } else {
+      publishTraffic();
+      sendEgoGoal();
+      sendAgentsGoal();
+    }
     return;
   }
 
+  /// Start the visualization worker if the pipelined mode is enabled.
+  virtual void initializePipeline();
+
+  /// Set up the random streams with the \c scenario_seed parameter.
+  virtual void initializeScenarioSeed();
+
+  /// Get the random stream of the next vehicle to be spawned.
+  utils::CounterRandomEngine vehicleRandomEngine() {
+    return scenario_seed_.stream("vehicle", spawned_vehicles_++);
+  }
+
+  /// Set up the snapshot encoders with the \c incremental_snapshots
+  /// and \c snapshot_keyframe_interval parameters.
+  virtual void initializeSnapshotEncoders();
+
+  /// Run the task on the visualization worker if there is one,
+  /// otherwise run it right away.
+  void publishVisualization(
+      const std::string& key, const std::function<void()>& task) const;
+
   /// Update the simulation time based on the settings for the carla server.
   virtual void updateSimTime() {
     double fixed_delta_seconds = 0.05;
@@ -221,6 +340,7 @@ protected:
    */
   /// @{
   /// Publish the map visualization markers.
+  /// The markers are built once per map, or loaded from the cache directory.
   virtual void publishMap() const;
 
   /// Publish the vehicle visualization markers.
@@ -282,6 +402,14 @@ protected:
       const boost::shared_ptr<const CarlaVehicle>& vehicle_actor,
       planner::Vehicle& vehicle_obj);
 
+  /// Populate the vehicle object through actor, with the given transform
+  /// instead of the one of the actor, e.g. for a vehicle just spawned,
+  /// whose transform is not available until the server is ticked.
+  virtual void populateVehicleObj(
+      const boost::shared_ptr<const CarlaVehicle>& vehicle_actor,
+      const CarlaTransform& transform,
+      planner::Vehicle& vehicle_obj);
+
   /// Callback for the simulation time server.
   virtual bool simTimeCallback(
       std_srvs::Trigger::Request& req,
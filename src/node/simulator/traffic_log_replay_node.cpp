@@ -0,0 +1,122 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <boost/timer/timer.hpp>
+
+#include <ros/console.h>
+#include <node/common/convert_snapshot_msgs.h>
+#include <node/simulator/traffic_log_replay_node.h>
+
+namespace node {
+
+bool TrafficLogReplayNode::initialize() {
+
+  bool all_param_exist = true;
+
+  std::string traffic_log_path = "";
+  all_param_exist &= nh_.param<std::string>("traffic_log", traffic_log_path, "");
+  nh_.param<double>("result_timeout", result_timeout_, 0.0);
+
+  ROS_INFO_NAMED("traffic_log_replay", "open %s.", traffic_log_path.c_str());
+  traffic_log_ = boost::make_shared<planner::TrafficLogReader>(traffic_log_path);
+
+  ROS_INFO_NAMED("traffic_log_replay", "waiting for the ego action server.");
+  ego_client_.waitForServer();
+
+  ROS_INFO_NAMED("traffic_log_replay", "initialization finishes.");
+  return all_param_exist;
+}
+
+void TrafficLogReplayNode::replay() {
+
+  const ros::Duration timeout(std::max(result_timeout_, 0.0));
+
+  size_t failures = 0;
+  double planning_time = 0.0;
+  double start_simulation_time = 0.0;
+  double end_simulation_time = 0.0;
+  boost::timer::cpu_timer timer;
+
+  planner::TrafficLogFrame frame;
+  while (ros::ok() && traffic_log_->read(frame)) {
+
+    if (traffic_log_->records() == 1) start_simulation_time = frame.simulation_time;
+    end_simulation_time = frame.simulation_time;
+
+    // The surrounding vehicles of the ego are not recorded, which are
+    // only used for analysis but not planning.
+    conformal_lattice_planner::EgoPlanGoal goal;
+    goal.header.stamp = ros::Time::now();
+    goal.simulation_time = frame.simulation_time;
+    populateVehicleMsg(frame.ego, goal.snapshot.ego);
+    for (const auto& item : frame.agents) {
+      goal.snapshot.agents.push_back(conformal_lattice_planner::Vehicle());
+      populateVehicleMsg(item.second, goal.snapshot.agents.back());
+    }
+    goal.front_distance       = -1.0;
+    goal.left_front_distance  = -1.0;
+    goal.right_front_distance = -1.0;
+    goal.back_distance        = -1.0;
+    goal.left_back_distance   = -1.0;
+    goal.right_back_distance  = -1.0;
+
+    ego_client_.sendGoal(goal);
+    if (!ego_client_.waitForResult(timeout) ||
+        ego_client_.getState() != actionlib::SimpleClientGoalState::SUCCEEDED) {
+      ROS_WARN_NAMED("traffic_log_replay",
+          "record %lu at %f is not planned.",
+          traffic_log_->records(), frame.simulation_time);
+      ++failures;
+      continue;
+    }
+
+    planning_time += ego_client_.getResult()->planning_time;
+  }
+
+  const double wall_time = timer.elapsed().wall * 1.0e-9;
+  const size_t records = traffic_log_->records();
+  ROS_INFO_NAMED("traffic_log_replay", "records:%lu failures:%lu", records, failures);
+  ROS_INFO_NAMED("traffic_log_replay", "simulation time:%f wall time:%f",
+      end_simulation_time-start_simulation_time, wall_time);
+  if (records > failures) {
+    ROS_INFO_NAMED("traffic_log_replay", "average planning time:%f",
+        planning_time / (records-failures));
+  }
+  return;
+}
+
+} // End namespace node.
+
+int main(int argc, char** argv) {
+
+  ros::init(argc, argv, "~");
+  ros::NodeHandle nh("~");
+
+  if(ros::console::set_logger_level(
+        ROSCONSOLE_DEFAULT_NAME,
+        ros::console::levels::Info)) {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  node::TrafficLogReplayNodePtr replayer =
+    boost::make_shared<node::TrafficLogReplayNode>(nh);
+  if (!replayer->initialize()) {
+    ROS_ERROR("Cannot initialize the traffic log replayer.");
+    return 1;
+  }
+
+  replayer->replay();
+  return 0;
+}
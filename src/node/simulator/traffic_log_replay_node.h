@@ -0,0 +1,83 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+
+#include <boost/smart_ptr.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <ros/ros.h>
+#include <actionlib/client/simple_action_client.h>
+
+#include <planner/common/traffic_log.h>
+#include <conformal_lattice_planner/EgoPlanAction.h>
+
+namespace node {
+
+/**
+ * \brief TrafficLogReplayNode sends the traffic recorded by a simulator
+ *        node to the ego planner, replacing the simulator.
+ *
+ * Each record of the log is sent as soon as the result of the previous
+ * one is returned, so the replay is as fast as the planner. The ego planner
+ * should be launched with \c update_carla_vehicles disabled, since the
+ * recorded vehicles do not exist in the carla server.
+ */
+class TrafficLogReplayNode : private boost::noncopyable {
+
+private:
+
+  using This = TrafficLogReplayNode;
+
+public:
+
+  using Ptr = boost::shared_ptr<This>;
+  using ConstPtr = boost::shared_ptr<const This>;
+
+protected:
+
+  /// The traffic log to be replayed.
+  boost::shared_ptr<planner::TrafficLogReader> traffic_log_ = nullptr;
+
+  /// Time to wait for the result of a goal (s). Non-positive means forever.
+  double result_timeout_ = 0.0;
+
+  /// ROS node handle.
+  mutable ros::NodeHandle nh_;
+
+  /// The actionlib client for the ego vehicle planner.
+  mutable actionlib::SimpleActionClient<
+    conformal_lattice_planner::EgoPlanAction> ego_client_;
+
+public:
+
+  TrafficLogReplayNode(ros::NodeHandle& nh) :
+    nh_(nh), ego_client_(nh_, "ego_plan", false) {}
+
+  virtual ~TrafficLogReplayNode() {}
+
+  /// Open the traffic log and wait for the ego planner.
+  virtual bool initialize();
+
+  /// Send all the records in the traffic log to the ego planner.
+  virtual void replay();
+
+}; // End class TrafficLogReplayNode.
+
+using TrafficLogReplayNodePtr = TrafficLogReplayNode::Ptr;
+using TrafficLogReplayNodeConstPtr = TrafficLogReplayNode::ConstPtr;
+
+} // End namespace node.
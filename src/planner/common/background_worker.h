@@ -0,0 +1,125 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <string>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <boost/core/noncopyable.hpp>
+
+namespace utils {
+
+/**
+ * \brief BackgroundWorker runs tasks in order on a single thread.
+ *
+ * Every task is posted with a key. If a task with the same key is still
+ * waiting to be run, it is replaced by the new one in place, so that the
+ * worker never falls behind on stale work, e.g. visualization of an old
+ * simulation tick. Exceptions thrown by the tasks are passed to the error
+ * handler, which discards them by default.
+ */
+class BackgroundWorker : private boost::noncopyable {
+
+protected:
+
+  /// The worker thread.
+  std::thread worker_;
+
+  /// Tasks waiting to be run, together with their keys.
+  std::deque<std::pair<std::string, std::function<void()>>> tasks_;
+
+  /// Called with the exception thrown by a task.
+  std::function<void(const std::exception&)> error_handler_;
+
+  /// Protects \c tasks_ and \c stop_.
+  std::mutex tasks_mutex_;
+
+  /// Wakes up the worker when there are new tasks.
+  std::condition_variable tasks_cv_;
+
+  /// Set when the worker is destroyed.
+  bool stop_ = false;
+
+public:
+
+  BackgroundWorker(
+      const std::function<void(const std::exception&)>& error_handler =
+        [](const std::exception&){}) :
+    error_handler_(error_handler) {
+    worker_ = std::thread([this](){ workerLoop(); });
+    return;
+  }
+
+  /// Tasks that are already posted are finished before the worker stops.
+  ~BackgroundWorker() {
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex_);
+      stop_ = true;
+    }
+    tasks_cv_.notify_all();
+    worker_.join();
+    return;
+  }
+
+  /**
+   * \brief Post a task to be run on the worker thread.
+   * \param[in] key The task replaces the waiting task with the same key.
+   * \param[in] task The task to be run.
+   */
+  void post(const std::string& key, const std::function<void()>& task) {
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex_);
+      bool replaced = false;
+      for (auto& waiting : tasks_) {
+        if (waiting.first != key) continue;
+        waiting.second = task;
+        replaced = true;
+        break;
+      }
+      if (!replaced) tasks_.emplace_back(key, task);
+    }
+    tasks_cv_.notify_one();
+    return;
+  }
+
+protected:
+
+  /// The loop run by the worker thread.
+  void workerLoop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(tasks_mutex_);
+        tasks_cv_.wait(lock, [this](){ return stop_ || !tasks_.empty(); });
+        if (stop_ && tasks_.empty()) return;
+        task = std::move(tasks_.front().second);
+        tasks_.pop_front();
+      }
+      try {
+        task();
+      } catch (const std::exception& e) {
+        error_handler_(e);
+      }
+    }
+  }
+
+}; // End class BackgroundWorker.
+
+} // End namespace utils.
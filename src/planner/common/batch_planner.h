@@ -0,0 +1,140 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <boost/optional.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/timer/timer.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <planner/common/snapshot.h>
+#include <planner/common/vehicle_path.h>
+#include <planner/common/thread_pool.h>
+
+namespace planner {
+
+/**
+ * \brief BatchPlanner plans a batch of independent snapshots concurrently,
+ *        e.g. the snapshots of a traffic log in an offline evaluation.
+ *
+ * The snapshots are distributed over the thread pool. The worker planning
+ * a snapshot creates its own planner with the factory, so that no planner,
+ * waypoint lattice, or graph is shared between the workers, and nothing is
+ * carried over from one unrelated snapshot to the next. The planners only
+ * share what the factory gives them, e.g. the carla map, the fast waypoint
+ * map, and the router, which are read-only during planning. Caches that are
+ * valid across snapshots and safe to be used from multiple threads, such as
+ * \c ContinuousPathCache, may be shared by the factory as well.
+ *
+ * Since the snapshots are already planned in parallel, the planners created
+ * by the factory are usually not given a thread pool of their own.
+ *
+ * \tparam Planner The type of the planners.
+ * \tparam Result The type of the planning result of a snapshot.
+ */
+template<typename Planner, typename Result = DiscretePath>
+class BatchPlanner : private boost::noncopyable {
+
+public:
+
+  /// Create a planner. This is called from the worker threads concurrently.
+  using PlannerFactory = std::function<boost::shared_ptr<Planner>()>;
+
+  /// Plan a snapshot with a planner created by the factory.
+  using PlanningFunction = std::function<Result(Planner&, const Snapshot&)>;
+
+  /// The outcome of planning one snapshot of the batch.
+  struct Outcome {
+    /// The planning result, \c boost::none if the planning fails.
+    boost::optional<Result> result = boost::none;
+    /// The error message if the planning fails.
+    std::string error;
+    /// Wall time (s) of planning the snapshot, excluding the planner creation.
+    double planning_time = 0.0;
+  }; // End struct Outcome.
+
+protected:
+
+  /// Creates a planner for every snapshot.
+  PlannerFactory factory_;
+
+  /// Plans a snapshot.
+  PlanningFunction plan_;
+
+  /// Thread pool on which the snapshots are planned, serially if \c nullptr.
+  boost::shared_ptr<utils::ThreadPool> thread_pool_ = nullptr;
+
+public:
+
+  /**
+   * \brief Class constructor.
+   *
+   * \param[in] factory Creates the planners.
+   * \param[in] thread_pool The pool on which the snapshots are planned.
+   * \param[in] plan Plans a snapshot. By default, the path of the ego is planned.
+   */
+  BatchPlanner(const PlannerFactory& factory,
+               const boost::shared_ptr<utils::ThreadPool>& thread_pool = nullptr,
+               const PlanningFunction& plan = planEgoPath) :
+    factory_(factory), plan_(plan), thread_pool_(thread_pool) {}
+
+  const boost::shared_ptr<const utils::ThreadPool> threadPool() const { return thread_pool_; }
+  boost::shared_ptr<utils::ThreadPool>& threadPool() { return thread_pool_; }
+
+  /**
+   * \brief Plan all the snapshots.
+   *
+   * A snapshot failing to be planned does not affect the others. Its error
+   * is recorded in the corresponding outcome instead.
+   *
+   * \param[in] snapshots The independent snapshots to be planned.
+   * \return The outcomes in the same order as the input snapshots.
+   */
+  std::vector<Outcome> plan(const std::vector<Snapshot>& snapshots) const {
+
+    std::vector<Outcome> outcomes(snapshots.size());
+
+    auto planSnapshot = [this, &snapshots, &outcomes](const size_t i)->void{
+      Outcome& outcome = outcomes[i];
+      try {
+        boost::shared_ptr<Planner> planner = factory_();
+        boost::timer::cpu_timer timer;
+        outcome.result = plan_(*planner, snapshots[i]);
+        outcome.planning_time = timer.elapsed().wall*1.0e-9;
+      } catch (const std::exception& e) {
+        outcome.result = boost::none;
+        outcome.error = e.what();
+      }
+    };
+
+    if (thread_pool_) thread_pool_->parallelFor(snapshots.size(), planSnapshot);
+    else for (size_t i = 0; i < snapshots.size(); ++i) planSnapshot(i);
+
+    return outcomes;
+  }
+
+  /// Plan the path of the ego in the snapshot.
+  static Result planEgoPath(Planner& planner, const Snapshot& snapshot) {
+    return planner.planPath(snapshot.ego().id(), snapshot);
+  }
+
+}; // End class BatchPlanner.
+
+} // End namespace planner.
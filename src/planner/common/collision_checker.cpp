@@ -0,0 +1,232 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/format.hpp>
+
+#include <planner/common/collision_checker.h>
+
+namespace planner {
+
+constexpr double CollisionChecker::kMaxRotationMargin_;
+constexpr size_t CollisionChecker::kMaxSubsteps_;
+
+CollisionChecker::Footprint::Footprint(
+    const CarlaTransform& transform, const CarlaBoundingBox& bounding_box) {
+
+  yaw = transform.rotation.yaw / 180.0 * M_PI;
+  const double cos_yaw = std::cos(yaw);
+  const double sin_yaw = std::sin(yaw);
+
+  // The bounding box may be offset from the origin of the vehicle.
+  x = transform.location.x + cos_yaw*bounding_box.location.x - sin_yaw*bounding_box.location.y;
+  y = transform.location.y + sin_yaw*bounding_box.location.x + cos_yaw*bounding_box.location.y;
+  half_length = bounding_box.extent.x;
+  half_width = bounding_box.extent.y;
+  return;
+}
+
+CollisionChecker::CollisionChecker(const double cell_size) :
+  cell_size_(cell_size) {
+  if (cell_size_ <= 0.0) {
+    std::string error_msg = (boost::format(
+          "CollisionChecker::CollisionChecker(): "
+          "invalid cell size %1%.\n") % cell_size_).str();
+    throw std::runtime_error(error_msg);
+  }
+  return;
+}
+
+const double CollisionChecker::rotationMargin(
+    const Footprint& start, const Footprint& end) {
+  const double diff = std::remainder(end.yaw-start.yaw, 2.0*M_PI);
+  return std::hypot(end.half_length, end.half_width) * std::fabs(diff);
+}
+
+const CollisionChecker::Footprint CollisionChecker::interpolate(
+    const Footprint& start, const Footprint& end, const double t) {
+  Footprint footprint = end;
+  footprint.x = start.x + t*(end.x-start.x);
+  footprint.y = start.y + t*(end.y-start.y);
+  footprint.yaw = start.yaw + t*std::remainder(end.yaw-start.yaw, 2.0*M_PI);
+  return footprint;
+}
+
+const CollisionChecker::Box CollisionChecker::sweptBox(
+    const Footprint& start, const Footprint& end) {
+
+  auto box = [](const Footprint& footprint)->Box{
+    const double c = std::fabs(std::cos(footprint.yaw));
+    const double s = std::fabs(std::sin(footprint.yaw));
+    const double ex = footprint.half_length*c + footprint.half_width*s;
+    const double ey = footprint.half_length*s + footprint.half_width*c;
+    return Box{footprint.x-ex, footprint.y-ey, footprint.x+ex, footprint.y+ey};
+  };
+
+  const Box start_box = box(start);
+  const Box end_box = box(end);
+  const double margin = rotationMargin(start, end);
+
+  return Box{std::min(start_box.min_x, end_box.min_x) - margin,
+             std::min(start_box.min_y, end_box.min_y) - margin,
+             std::max(start_box.max_x, end_box.max_x) + margin,
+             std::max(start_box.max_y, end_box.max_y) + margin};
+}
+
+const bool CollisionChecker::sweptOverlap(
+    const Footprint& start0, const Footprint& end0,
+    const Footprint& start1, const Footprint& end1) {
+
+  // Subdivide the step so that the rotation within each substep only moves
+  // the corners of the footprints by a few centimeters. The margins covering
+  // the rotation would otherwise be as large as meters on a curve, so that
+  // the vehicles on the adjacent lanes were reported to collide.
+  const double margin = rotationMargin(start0, end0) + rotationMargin(start1, end1);
+  const size_t substeps = std::min(kMaxSubsteps_, std::max<size_t>(1,
+        static_cast<size_t>(std::ceil(margin/kMaxRotationMargin_))));
+
+  if (substeps == 1) return translationOverlap(start0, end0, start1, end1, margin);
+
+  Footprint substep_start0 = start0;
+  Footprint substep_start1 = start1;
+  for (size_t k = 1; k <= substeps; ++k) {
+    const double t = static_cast<double>(k) / substeps;
+    const Footprint substep_end0 = k < substeps ? interpolate(start0, end0, t) : end0;
+    const Footprint substep_end1 = k < substeps ? interpolate(start1, end1, t) : end1;
+    if (translationOverlap(substep_start0, substep_end0,
+                           substep_start1, substep_end1, margin/substeps)) return true;
+    substep_start0 = substep_end0;
+    substep_start1 = substep_end1;
+  }
+
+  return false;
+}
+
+const bool CollisionChecker::translationOverlap(
+    const Footprint& start0, const Footprint& end0,
+    const Footprint& start1, const Footprint& end1,
+    const double margin) {
+
+  const double u0x = std::cos(end0.yaw), u0y = std::sin(end0.yaw);
+  const double u1x = std::cos(end1.yaw), u1y = std::sin(end1.yaw);
+  const double axes[4][2] = {{u0x, u0y}, {-u0y, u0x}, {u1x, u1y}, {-u1y, u1x}};
+
+  // Relative position of vehicle 1 w.r.t. vehicle 0 at the start of the step,
+  // and its change over the step.
+  const double rx = start1.x - start0.x;
+  const double ry = start1.y - start0.y;
+  const double dx = (end1.x-end0.x) - rx;
+  const double dy = (end1.y-end0.y) - ry;
+
+  // The footprints overlap at time t in [0, 1] iff they overlap on all axes.
+  // Since the projection of the relative position is linear in t and the
+  // projected radii are constant, the overlap on each axis is an interval of t.
+  double t_min = 0.0;
+  double t_max = 1.0;
+
+  for (const auto& axis : axes) {
+    const double radius =
+      end0.half_length * std::fabs(u0x*axis[0] + u0y*axis[1]) +
+      end0.half_width  * std::fabs(-u0y*axis[0] + u0x*axis[1]) +
+      end1.half_length * std::fabs(u1x*axis[0] + u1y*axis[1]) +
+      end1.half_width  * std::fabs(-u1y*axis[0] + u1x*axis[1]) + margin;
+    const double p = rx*axis[0] + ry*axis[1];
+    const double dp = dx*axis[0] + dy*axis[1];
+
+    if (std::fabs(dp) < 1.0e-9) {
+      // Separated on this axis throughout the step.
+      if (std::fabs(p) > radius) return false;
+      continue;
+    }
+
+    double t0 = (-radius-p) / dp;
+    double t1 = ( radius-p) / dp;
+    if (t0 > t1) std::swap(t0, t1);
+    t_min = std::max(t_min, t0);
+    t_max = std::min(t_max, t1);
+    if (t_min > t_max) return false;
+  }
+
+  return true;
+}
+
+boost::optional<std::pair<size_t, size_t>> CollisionChecker::sweptCollision(
+    const std::vector<Footprint>& starts,
+    const std::vector<Footprint>& ends) {
+
+  if (starts.size() != ends.size()) {
+    std::string error_msg = (boost::format(
+          "CollisionChecker::sweptCollision(): "
+          "the number of start footprints [%1%] != the number of end footprints [%2%].\n")
+        % starts.size() % ends.size()).str();
+    throw std::runtime_error(error_msg);
+  }
+
+  // Broad phase, hash the swept boxes into the cells they touch.
+  boxes_.resize(starts.size());
+  cell_entries_.clear();
+
+  for (size_t i = 0; i < starts.size(); ++i) {
+    boxes_[i] = sweptBox(starts[i], ends[i]);
+    const int32_t x0 = cellCoordinate(boxes_[i].min_x);
+    const int32_t x1 = cellCoordinate(boxes_[i].max_x);
+    const int32_t y0 = cellCoordinate(boxes_[i].min_y);
+    const int32_t y1 = cellCoordinate(boxes_[i].max_y);
+    for (int32_t x = x0; x <= x1; ++x)
+      for (int32_t y = y0; y <= y1; ++y)
+        cell_entries_.emplace_back(cellKey(x, y), i);
+  }
+
+  std::sort(cell_entries_.begin(), cell_entries_.end());
+
+  // Narrow phase, check the pairs within each cell.
+  for (size_t begin = 0; begin < cell_entries_.size();) {
+    size_t end = begin + 1;
+    while (end < cell_entries_.size() &&
+           cell_entries_[end].first == cell_entries_[begin].first) ++end;
+
+    for (size_t m = begin; m < end; ++m) {
+      for (size_t n = m+1; n < end; ++n) {
+        const size_t i = cell_entries_[m].second;
+        const size_t j = cell_entries_[n].second;
+        const Box& box_i = boxes_[i];
+        const Box& box_j = boxes_[j];
+
+        // Skip the pairs whose swept boxes do not overlap.
+        const double min_x = std::max(box_i.min_x, box_j.min_x);
+        const double min_y = std::max(box_i.min_y, box_j.min_y);
+        if (min_x > std::min(box_i.max_x, box_j.max_x) ||
+            min_y > std::min(box_i.max_y, box_j.max_y)) continue;
+
+        // A pair may share several cells. It is only checked in the cell
+        // containing the minimum corner of the overlap of the swept boxes.
+        if (cellKey(cellCoordinate(min_x), cellCoordinate(min_y)) !=
+            cell_entries_[begin].first) continue;
+
+        if (sweptOverlap(starts[i], ends[i], starts[j], ends[j]))
+          return std::make_pair(std::min(i, j), std::max(i, j));
+      }
+    }
+
+    begin = end;
+  }
+
+  return boost::none;
+}
+
+} // End namespace planner.
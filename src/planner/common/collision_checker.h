@@ -0,0 +1,163 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <boost/optional.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <carla/geom/Transform.h>
+#include <carla/geom/BoundingBox.h>
+
+namespace planner {
+
+/**
+ * \brief CollisionChecker detects the collisions among vehicles moving
+ *        over one simulation step.
+ *
+ * The vehicles are treated as oriented rectangles (footprints) on the x-y plane.
+ * Within a step, each vehicle is assumed to translate linearly from its start
+ * to its end footprint, and the volume swept in between is checked, so that
+ * vehicles passing through each other within a long step are still detected.
+ *
+ * The check has two phases:
+ * - 1. Broad phase. The axis aligned bounding boxes of the swept footprints are
+ *      hashed into a uniform grid. Only the pairs sharing a cell are considered.
+ * - 2. Narrow phase. The yaws of the vehicles are interpolated linearly within
+ *      the step. A step turning the vehicles by more than a few centimeters at
+ *      their corners is subdivided, so that the rotation within each substep is
+ *      small. Within a substep, the separating axis test is solved in closed
+ *      form for the relative translation of the two footprints, which are only
+ *      inflated by the small displacement of their corners in the substep.
+ *
+ * The object keeps its buffers across checks, so that it can be reused at every
+ * step of a simulation without allocating memory. It is not thread safe.
+ */
+class CollisionChecker : private boost::noncopyable {
+
+public:
+
+  using CarlaTransform   = carla::geom::Transform;
+  using CarlaBoundingBox = carla::geom::BoundingBox;
+
+  /// Oriented rectangle occupied by a vehicle on the x-y plane.
+  struct Footprint {
+    /// Center of the rectangle.
+    double x = 0.0;
+    double y = 0.0;
+    /// Yaw of the rectangle (rad).
+    double yaw = 0.0;
+    /// Half length and half width of the rectangle.
+    double half_length = 0.0;
+    double half_width = 0.0;
+
+    Footprint() = default;
+    Footprint(const CarlaTransform& transform, const CarlaBoundingBox& bounding_box);
+  }; // End struct Footprint.
+
+protected:
+
+  /// The maximum displacement (m) of the corners of the footprints of two
+  /// vehicles due to their rotations within a substep of the narrow phase.
+  static constexpr double kMaxRotationMargin_ = 0.05;
+
+  /// The maximum number of substeps of a step. The margin of each substep
+  /// may exceed \c kMaxRotationMargin_ if the rotation requires more substeps.
+  static constexpr size_t kMaxSubsteps_ = 64;
+
+  /// Axis aligned bounding box of a swept footprint.
+  struct Box {
+    double min_x, min_y, max_x, max_y;
+  };
+
+  /// Side length of the cells of the broad phase grid.
+  double cell_size_;
+
+  /// Buffers reused across checks, i.e. the swept boxes of the vehicles,
+  /// and the (cell, vehicle index) pairs of the broad phase grid.
+  std::vector<Box> boxes_;
+  std::vector<std::pair<uint64_t, size_t>> cell_entries_;
+
+public:
+
+  /**
+   * \param[in] cell_size The side length of the cells of the broad phase grid,
+   *                      which should be about the length of the vehicles.
+   */
+  CollisionChecker(const double cell_size = 8.0);
+
+  const double cellSize() const { return cell_size_; }
+
+  /**
+   * \brief Find a pair of vehicles colliding within a step.
+   *
+   * \param[in] starts The footprints of the vehicles at the start of the step.
+   * \param[in] ends The footprints of the vehicles at the end of the step,
+   *                 in the same order as \c starts.
+   * \return The indices of a colliding pair, or \c boost::none if there is no collision.
+   */
+  boost::optional<std::pair<size_t, size_t>> sweptCollision(
+      const std::vector<Footprint>& starts,
+      const std::vector<Footprint>& ends);
+
+  /// Check whether two vehicles collide while moving from the start to the end footprints.
+  static const bool sweptOverlap(const Footprint& start0, const Footprint& end0,
+                                 const Footprint& start1, const Footprint& end1);
+
+  /// Check whether two footprints overlap.
+  static const bool overlap(const Footprint& footprint0, const Footprint& footprint1) {
+    return sweptOverlap(footprint0, footprint0, footprint1, footprint1);
+  }
+
+protected:
+
+  /// Axis aligned bounding box of the footprints of a vehicle within a step.
+  static const Box sweptBox(const Footprint& start, const Footprint& end);
+
+  /// Maximum displacement of the corners of a footprint due to its rotation within a step.
+  static const double rotationMargin(const Footprint& start, const Footprint& end);
+
+  /// The footprint at the fraction \c t of a step, with both the center and
+  /// the yaw interpolated linearly.
+  static const Footprint interpolate(const Footprint& start, const Footprint& end, const double t);
+
+  /**
+   * \brief Check whether two vehicles collide while translating from the start
+   *        to the end footprints.
+   *
+   * The footprints keep the orientations of the end footprints throughout,
+   * and are inflated by the given margin on every axis.
+   */
+  static const bool translationOverlap(const Footprint& start0, const Footprint& end0,
+                                       const Footprint& start1, const Footprint& end1,
+                                       const double margin);
+
+  /// Key of a cell of the broad phase grid.
+  const uint64_t cellKey(const int32_t x, const int32_t y) const {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) |
+            static_cast<uint64_t>(static_cast<uint32_t>(y));
+  }
+
+  /// Coordinate of the cell containing the given coordinate.
+  const int32_t cellCoordinate(const double v) const {
+    return static_cast<int32_t>(std::floor(v/cell_size_));
+  }
+
+}; // End class CollisionChecker.
+
+} // End namespace planner.
@@ -0,0 +1,394 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include <boost/optional.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <carla/geom/Transform.h>
+
+#include <planner/common/utils.h>
+#include <planner/common/kn_path_gen.h>
+#include <planner/common/vehicle_path.h>
+#include <planner/common/path_warm_start_table.h>
+
+namespace planner {
+
+/**
+ * \brief ContinuousPathCache is a bounded LRU cache of optimized Kelly-Nagy paths.
+ *
+ * The optimized coefficients of a path only depend on the pose of the end
+ * relative to the start, together with the curvatures at both ends. The
+ * cache is therefore keyed by the quantized relative pose instead of the
+ * absolute transforms, so that a path connecting the same pair of lattice
+ * nodes (or any pair with the same geometry) is only optimized once across
+ * planning cycles. Failed optimizations are cached as well.
+ *
+ * On a miss, the optimization is seeded with, in order, the solution of the
+ * same edge, i.e. a path with the same end and lane change type, found in a
+ * previous cycle, the closest path in an optional \c PathWarmStartTable,
+ * and the heuristic guess of \c NonHolonomicPath. A seed is only tried
+ * if the previous one diverges.
+ *
+ * The cache is safe to be used from multiple threads.
+ */
+class ContinuousPathCache : private boost::noncopyable {
+
+public:
+
+  using CarlaTransform = carla::geom::Transform;
+  using LaneChangeType = ContinuousPath::LaneChangeType;
+
+protected:
+
+  /// Quantized boundary conditions of a path, or the end of an edge.
+  struct Key {
+    int64_t values[5];
+    int lane_change_type;
+
+    bool operator==(const Key& other) const {
+      for (size_t i = 0; i < 5; ++i)
+        if (values[i] != other.values[i]) return false;
+      return lane_change_type == other.lane_change_type;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      size_t seed = 0;
+      for (size_t i = 0; i < 5; ++i) boost::hash_combine(seed, key.values[i]);
+      boost::hash_combine(seed, key.lane_change_type);
+      return seed;
+    }
+  };
+
+  /// Boundary conditions of a path in the right handed local frame of the start.
+  struct LocalBoundary {
+    double dx;
+    double dy;
+    double dtheta;
+    double start_kappa;
+    double end_kappa;
+  };
+
+  /// An entry stores the optimized path, or nothing if the optimization diverges.
+  using Entry = std::pair<Key, boost::optional<NonHolonomicPath>>;
+
+protected:
+
+  /// Quantization of the relative position (m).
+  static constexpr double kDistanceResolution_ = 0.01;
+
+  /// Quantization of the relative heading (rad).
+  static constexpr double kAngleResolution_ = 1.0e-4;
+
+  /// Quantization of the curvatures (1/m). This is kept below the
+  /// tolerance \c NonHolonomicPath accepts on the start curvature.
+  static constexpr double kCurvatureResolution_ = 1.0e-6;
+
+  /// Maximum number of paths in the cache.
+  size_t capacity_;
+
+  /// Entries ordered from the most to the least recently used.
+  std::list<Entry> entries_;
+
+  /// Map from the keys to the entries.
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> table_;
+
+  /// Number of lookups served from the cache.
+  size_t hits_ = 0;
+
+  /// Number of lookups requiring a path optimization.
+  size_t misses_ = 0;
+
+  /// Number of path optimizations which diverge with all seeds.
+  size_t failures_ = 0;
+
+  /// Number of optimizations taking i Newton iterations in total. The last
+  /// bin also counts the ones taking more iterations.
+  std::vector<size_t> iteration_histogram_;
+
+  /// Whether to seed the optimization with the solution of a previous cycle.
+  bool seed_from_previous_;
+
+  /// Latest solutions of the edges, keyed by the quantized end and lane change type.
+  std::unordered_map<Key, NonHolonomicPath, KeyHash> previous_solutions_;
+
+  /// Optional table of initial guesses.
+  boost::shared_ptr<const PathWarmStartTable> warm_start_table_;
+
+  /// Protects all of the above.
+  mutable std::mutex mutex_;
+
+public:
+
+  /// Number of bins in the iteration histogram.
+  static constexpr size_t kHistogramBins_ = 101;
+
+  /**
+   * \brief Class constructor.
+   * \param[in] capacity Maximum number of paths kept in the cache.
+   * \param[in] warm_start_table Table of initial guesses, may be nullptr.
+   * \param[in] seed_from_previous Seed the optimization with the solution
+   *                               of the same edge in a previous cycle.
+   */
+  ContinuousPathCache(const size_t capacity = 8192,
+                      const boost::shared_ptr<const PathWarmStartTable>& warm_start_table = nullptr,
+                      const bool seed_from_previous = true) :
+    capacity_(capacity),
+    iteration_histogram_(kHistogramBins_, 0),
+    seed_from_previous_(seed_from_previous),
+    warm_start_table_(warm_start_table) {
+    if (capacity_ == 0) {
+      throw std::runtime_error(
+          "ContinuousPathCache::ContinuousPathCache(): "
+          "capacity of the cache should be positive.\n");
+    }
+    table_.reserve(capacity_);
+    return;
+  }
+
+  /**
+   * \brief Get a path between the start and end.
+   *
+   * The path is created from the cached coefficients if there is a hit.
+   * Otherwise, the path is optimized and added to the cache.
+   *
+   * \param[in] start The start transform and curvature.
+   * \param[in] end The end transform and curvature.
+   * \param[in] lane_change_type The lane change type of the path.
+   * \return The path connecting the start and end.
+   * \throw std::runtime_error If the path optimization diverges.
+   */
+  boost::shared_ptr<ContinuousPath> path(
+      const std::pair<CarlaTransform, double>& start,
+      const std::pair<CarlaTransform, double>& end,
+      const LaneChangeType& lane_change_type) {
+
+    const LocalBoundary boundary = localBoundary(start, end);
+    const Key key = pathKey(boundary, lane_change_type);
+    const Key edge_key = edgeKey(end, lane_change_type);
+    boost::optional<NonHolonomicPath> previous_solution = boost::none;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto iter = table_.find(key);
+      if (iter != table_.end()) {
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, iter->second);
+        if (!iter->second->second) {
+          throw std::runtime_error(
+              "ContinuousPathCache::path(): "
+              "path optimization diverges (cached).\n");
+        }
+        return boost::make_shared<ContinuousPath>(
+            start, end, lane_change_type, *(iter->second->second));
+      }
+      ++misses_;
+
+      if (seed_from_previous_) {
+        auto previous_iter = previous_solutions_.find(edge_key);
+        if (previous_iter != previous_solutions_.end())
+          previous_solution = previous_iter->second;
+      }
+    }
+
+    // Optimize the path without holding the lock.
+    std::vector<boost::optional<NonHolonomicPath>> seeds;
+    seeds.reserve(3);
+    if (previous_solution) seeds.push_back(previous_solution);
+    if (warm_start_table_) {
+      const boost::optional<NonHolonomicPath> guess = warm_start_table_->guess(
+          boundary.dx, boundary.dy, boundary.dtheta,
+          boundary.start_kappa, boundary.end_kappa);
+      if (guess) seeds.push_back(guess);
+    }
+    seeds.push_back(boost::none);
+
+    const NonHolonomicPath::State start_state(0.0, 0.0, 0.0, boundary.start_kappa);
+    const NonHolonomicPath::State end_state(
+        boundary.dx, boundary.dy, boundary.dtheta, boundary.end_kappa);
+
+    NonHolonomicPath optimized_path;
+    bool success = false;
+    size_t iterations = 0;
+    for (const auto& seed : seeds) {
+      success = optimized_path.optimizePath(start_state, end_state, seed);
+      iterations += optimized_path.num_iterations;
+      if (success) break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++iteration_histogram_[std::min(iterations, kHistogramBins_-1)];
+      if (!success) ++failures_;
+      if (success && seed_from_previous_) {
+        if (previous_solutions_.size() >= capacity_) previous_solutions_.clear();
+        previous_solutions_[edge_key] = optimized_path;
+      }
+    }
+
+    if (!success) {
+      insert(key, boost::none);
+      std::string error_msg("ContinuousPathCache::path(): path optimization diverges.\n");
+      boost::format transform_format("%1% transform x:%2% y:%3% yaw:%4% curvature:%5%\n");
+      error_msg += (transform_format % "start"
+                                     % start.first.location.x
+                                     % start.first.location.y
+                                     % start.first.rotation.yaw
+                                     % start.second).str();
+      error_msg += (transform_format % "end"
+                                     % end.first.location.x
+                                     % end.first.location.y
+                                     % end.first.rotation.yaw
+                                     % end.second).str();
+      throw std::runtime_error(error_msg);
+    }
+
+    insert(key, optimized_path);
+    return boost::make_shared<ContinuousPath>(
+        start, end, lane_change_type, optimized_path);
+  }
+
+  /// Number of lookups served from the cache.
+  size_t hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+  }
+
+  /// Number of lookups requiring a path optimization.
+  size_t misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+  }
+
+  /// Number of path optimizations which diverge with all seeds.
+  size_t failures() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failures_;
+  }
+
+  /// Histogram of the total Newton iterations taken by each optimization.
+  std::vector<size_t> iterationHistogram() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return iteration_histogram_;
+  }
+
+  /// Number of paths in the cache.
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  /// Maximum number of paths in the cache.
+  size_t capacity() const { return capacity_; }
+
+  /// Remove all paths from the cache and reset the counters.
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    table_.clear();
+    previous_solutions_.clear();
+    hits_ = 0;
+    misses_ = 0;
+    failures_ = 0;
+    std::fill(iteration_histogram_.begin(), iteration_histogram_.end(), 0);
+    return;
+  }
+
+protected:
+
+  /// Add an entry to the cache, evicting the least recently used one if necessary.
+  void insert(const Key& key, const boost::optional<NonHolonomicPath>& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Another thread may have added the same path in the meantime.
+    if (table_.count(key)) return;
+
+    if (entries_.size() >= capacity_) {
+      table_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+
+    entries_.emplace_front(key, path);
+    table_[key] = entries_.begin();
+    return;
+  }
+
+  /// Get the boundary conditions in the right handed local frame of the start.
+  static LocalBoundary localBoundary(const std::pair<CarlaTransform, double>& start,
+                                     const std::pair<CarlaTransform, double>& end) {
+
+    // Same conversion as \c VehiclePath::carlaTransformToPathState().
+    const CarlaTransform start_rh = utils::convertTransform(start.first);
+    const CarlaTransform end_rh = utils::convertTransform(end.first);
+
+    const double theta0 = start_rh.rotation.yaw / 180.0 * M_PI;
+    const double thetaf = end_rh.rotation.yaw / 180.0 * M_PI;
+    const double x = end_rh.location.x - start_rh.location.x;
+    const double y = end_rh.location.y - start_rh.location.y;
+
+    LocalBoundary boundary;
+    boundary.dx =  std::cos(theta0)*x + std::sin(theta0)*y;
+    boundary.dy = -std::sin(theta0)*x + std::cos(theta0)*y;
+    boundary.dtheta = std::remainder(thetaf-theta0, 2.0*M_PI);
+    boundary.start_kappa = -start.second;
+    boundary.end_kappa = -end.second;
+    return boundary;
+  }
+
+  /// Quantize the boundary conditions of a path.
+  static Key pathKey(const LocalBoundary& boundary,
+                     const LaneChangeType& lane_change_type) {
+    Key key;
+    key.values[0] = std::llround(boundary.dx / kDistanceResolution_);
+    key.values[1] = std::llround(boundary.dy / kDistanceResolution_);
+    key.values[2] = std::llround(boundary.dtheta / kAngleResolution_);
+    key.values[3] = std::llround(boundary.start_kappa / kCurvatureResolution_);
+    key.values[4] = std::llround(boundary.end_kappa / kCurvatureResolution_);
+    key.lane_change_type = static_cast<int>(lane_change_type);
+    return key;
+  }
+
+  /// Quantize the end of an edge, which identifies the edge together with
+  /// the lane change type since the waypoints of the lattice are fixed.
+  static Key edgeKey(const std::pair<CarlaTransform, double>& end,
+                     const LaneChangeType& lane_change_type) {
+    Key key;
+    key.values[0] = std::llround(end.first.location.x / kDistanceResolution_);
+    key.values[1] = std::llround(end.first.location.y / kDistanceResolution_);
+    key.values[2] = std::llround(end.first.location.z / kDistanceResolution_);
+    key.values[3] = std::llround(end.first.rotation.yaw / 180.0 * M_PI / kAngleResolution_);
+    key.values[4] = std::llround(end.second / kCurvatureResolution_);
+    key.lane_change_type = static_cast<int>(lane_change_type);
+    return key;
+  }
+
+}; // End class ContinuousPathCache.
+
+} // End namespace planner.
@@ -0,0 +1,282 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+
+namespace planner {
+
+/**
+ * \brief StepCost is a piecewise constant cost of a non-negative variable.
+ *
+ * The variable is divided into bins of the same width starting from 0.
+ * The cost of the i-th bin, i.e. [i*width, (i+1)*width), is looked up
+ * from a table, and the cost beyond the last bin is a constant.
+ */
+class StepCost {
+
+protected:
+
+  /// Width of the bins, and its inverse by which the variables are scaled.
+  double bin_width_ = 1.0;
+  double inv_bin_width_ = 1.0;
+
+  /// Cost of each bin.
+  std::vector<double> costs_;
+
+  /// Cost beyond the last bin.
+  double overflow_cost_ = 0.0;
+
+public:
+
+  StepCost() = default;
+
+  /**
+   * \param[in] bin_width The width of the bins, which should be positive.
+   * \param[in] costs The cost of each bin.
+   * \param[in] overflow_cost The cost beyond the last bin.
+   */
+  StepCost(const double bin_width,
+           const std::vector<double>& costs,
+           const double overflow_cost) :
+    bin_width_(bin_width),
+    inv_bin_width_(1.0/bin_width),
+    costs_(costs),
+    overflow_cost_(overflow_cost) {
+    if (bin_width_ <= 0.0) {
+      std::string error_msg = (boost::format(
+            "StepCost::StepCost(): "
+            "invalid bin width %1%.\n") % bin_width_).str();
+      throw std::runtime_error(error_msg);
+    }
+    return;
+  }
+
+  template<size_t N>
+  StepCost(const double bin_width,
+           const std::array<double, N>& costs,
+           const double overflow_cost) :
+    StepCost(bin_width, std::vector<double>(costs.begin(), costs.end()), overflow_cost) {}
+
+  const double binWidth() const { return bin_width_; }
+  const std::vector<double>& costs() const { return costs_; }
+  const double overflowCost() const { return overflow_cost_; }
+
+  /// The minimum cost of any variable.
+  const double minCost() const {
+    double min_cost = overflow_cost_;
+    for (const double cost : costs_) min_cost = std::min(min_cost, cost);
+    return min_cost;
+  }
+
+  /// Cost of the variable, which is assumed to be non-negative.
+  const double operator()(const double x) const {
+    // Compare as double before the cast, so that huge or infinite
+    // values do not overflow the index.
+    const double bin = x * inv_bin_width_;
+    if (!(bin < static_cast<double>(costs_.size()))) return overflow_cost_;
+    return costs_[static_cast<size_t>(bin)];
+  }
+
+  /**
+   * \brief Evaluate the costs of a batch of variables in one call.
+   * \param[in] x The variables, which are assumed to be non-negative.
+   * \param[in] num The number of variables.
+   * \param[out] costs The costs of the variables.
+   */
+  void operator()(const double* x, const size_t num, double* costs) const {
+    const double bins = static_cast<double>(costs_.size());
+    for (size_t i = 0; i < num; ++i) {
+      const double bin = x[i] * inv_bin_width_;
+      costs[i] = bin < bins ? costs_[static_cast<size_t>(bin)] : overflow_cost_;
+    }
+    return;
+  }
+
+}; // End class StepCost.
+
+/**
+ * \brief CostModel gathers the costs used by all planners to evaluate the
+ *        traffic simulations and the terminals of the graphs.
+ *
+ * The defaults are the tables the planners have always used. All costs can be
+ * overwritten at runtime, e.g. from the ROS parameters by the planning nodes,
+ * so that they can be tuned without recompiling. A cost model should not be
+ * modified once it is shared with a planner.
+ */
+class CostModel {
+
+public:
+
+  /// The default tables of the costs.
+  /// @{
+  static constexpr std::array<double, 3> kDefaultTtcCosts_ {{4.0, 2.0, 1.0}};
+  static constexpr std::array<double, 8> kDefaultBrakeCosts_ {{
+    0.0, 1.0, 2.0, 2.0, 4.0, 4.0, 6.0, 6.0}};
+  static constexpr std::array<double, 8> kDefaultPolicyBrakeCosts_ {{
+    0.0, 1.0, 2.0, 2.0, 4.0, 4.0, 8.0, 8.0}};
+  static constexpr std::array<double, 10> kDefaultTerminalSpeedCosts_ {{
+    4.0, 4.0, 4.0, 3.0, 3.0, 2.0, 2.0, 1.0, 1.0, 0.0}};
+  static constexpr std::array<double, 10> kDefaultTerminalDistanceCosts_ {{
+    20.0, 20.0, 20.0, 20.0, 20.0, 20.0, 20.0, 20.0, 10.0, 5.0}};
+  /// @}
+
+protected:
+
+  /// Cost of the ttc (s) of the ego.
+  StepCost ttc_cost_ {1.0, kDefaultTtcCosts_, 0.0};
+
+  /// Cost of the deceleration (m/s^2) of a vehicle.
+  StepCost brake_cost_ {1.0, kDefaultBrakeCosts_, 6.0};
+
+  /// Cost of the deceleration (m/s^2) of a vehicle, used together with the
+  /// acceleration costs w.r.t. the policy speed, see \c policyAccelCost().
+  StepCost policy_brake_cost_ {1.0, kDefaultPolicyBrakeCosts_, 16.0};
+
+  /// Cost of accelerating below and above the policy speed.
+  double accel_below_policy_speed_cost_ = -1.0;
+  double accel_above_policy_speed_cost_ = 1.0;
+
+  /// Weight of the accel costs of the followers relative to the ego.
+  double follower_accel_cost_weight_ = 0.5;
+
+  /// Extra cost of a lane change path.
+  double lane_change_cost_ = 1.0;
+
+  /// Cost of the ratio between the speed and the policy speed at a terminal.
+  StepCost terminal_speed_cost_ {0.1, kDefaultTerminalSpeedCosts_, 0.0};
+
+  /// Cost of the ratio between the distance to a terminal and the spatial horizon.
+  StepCost terminal_distance_cost_ {0.1, kDefaultTerminalDistanceCosts_, 0.0};
+
+public:
+
+  CostModel() = default;
+
+  /// The cost model with the default costs, shared by all planners.
+  static const boost::shared_ptr<const CostModel>& defaultModel() {
+    static const boost::shared_ptr<const CostModel> model =
+      boost::make_shared<const CostModel>();
+    return model;
+  }
+
+  /// Accessors of the costs.
+  /// @{
+  const StepCost& ttcCost() const { return ttc_cost_; }
+  StepCost& ttcCost() { return ttc_cost_; }
+
+  const StepCost& brakeCost() const { return brake_cost_; }
+  StepCost& brakeCost() { return brake_cost_; }
+
+  const StepCost& policyBrakeCost() const { return policy_brake_cost_; }
+  StepCost& policyBrakeCost() { return policy_brake_cost_; }
+
+  const double accelBelowPolicySpeedCost() const { return accel_below_policy_speed_cost_; }
+  double& accelBelowPolicySpeedCost() { return accel_below_policy_speed_cost_; }
+
+  const double accelAbovePolicySpeedCost() const { return accel_above_policy_speed_cost_; }
+  double& accelAbovePolicySpeedCost() { return accel_above_policy_speed_cost_; }
+
+  const double followerAccelCostWeight() const { return follower_accel_cost_weight_; }
+  double& followerAccelCostWeight() { return follower_accel_cost_weight_; }
+
+  const double laneChangeCost() const { return lane_change_cost_; }
+  double& laneChangeCost() { return lane_change_cost_; }
+
+  const StepCost& terminalSpeedCost() const { return terminal_speed_cost_; }
+  StepCost& terminalSpeedCost() { return terminal_speed_cost_; }
+
+  const StepCost& terminalDistanceCost() const { return terminal_distance_cost_; }
+  StepCost& terminalDistanceCost() { return terminal_distance_cost_; }
+  /// @}
+
+  /// Cost of a ttc, which should be non-negative.
+  const double ttcCost(const double ttc) const { return ttc_cost_(ttc); }
+
+  /// Cost of an acceleration, only braking is penalized.
+  const double accelCost(const double accel) const {
+    return accel >= 0.0 ? 0.0 : brake_cost_(-accel);
+  }
+
+  /**
+   * \brief Compute the accel costs of a batch of vehicles in one call.
+   * \param[in] accels The accelerations of the vehicles.
+   * \param[in] num The number of vehicles.
+   * \param[out] costs The accel costs of the vehicles.
+   */
+  void accelCosts(const double* accels, const size_t num, double* costs) const {
+    for (size_t i = 0; i < num; ++i) costs[i] = accels[i] >= 0.0 ? 0.0 : -accels[i];
+    brake_cost_(costs, num, costs);
+    for (size_t i = 0; i < num; ++i) if (accels[i] >= 0.0) costs[i] = 0.0;
+    return;
+  }
+
+  /**
+   * \brief Cost of an acceleration w.r.t. the policy speed of the vehicle.
+   *
+   * Accelerating is rewarded below the policy speed, and penalized above it.
+   * Braking is penalized with \c policyBrakeCost().
+   */
+  const double policyAccelCost(
+      const double accel, const double speed, const double policy_speed) const {
+    if (accel == 0.0) return 0.0;
+    if (accel > 0.0) {
+      return speed < policy_speed ?
+        accel_below_policy_speed_cost_ : accel_above_policy_speed_cost_;
+    }
+    return policy_brake_cost_(-accel);
+  }
+
+  /**
+   * \brief The lower bound of the stage costs evaluated with \c policyAccelCost().
+   *
+   * The bound consists of the minimum ttc cost, the minimum accel cost of the ego,
+   * and the minimum accel costs of the three followers, whose policy speeds are
+   * taken as their current speeds, together with any reward of lane changes.
+   */
+  const double minPolicyStageCost() const {
+    const double ego_accel_cost = std::min({0.0,
+        accel_below_policy_speed_cost_,
+        accel_above_policy_speed_cost_,
+        policy_brake_cost_.minCost()});
+    const double follower_accel_cost = std::min({0.0,
+        accel_above_policy_speed_cost_,
+        policy_brake_cost_.minCost()});
+    return ttc_cost_.minCost() +
+           ego_accel_cost +
+           follower_accel_cost_weight_*3.0*follower_accel_cost +
+           std::min(lane_change_cost_, 0.0);
+  }
+
+  /// Cost of the ratio between the speed and the policy speed at a terminal.
+  const double terminalSpeedCost(const double speed_ratio) const {
+    return terminal_speed_cost_(speed_ratio);
+  }
+
+  /// Cost of the ratio between the distance and the spatial horizon at a terminal.
+  const double terminalDistanceCost(const double distance_ratio) const {
+    return terminal_distance_cost_(distance_ratio);
+  }
+
+}; // End class CostModel.
+
+} // End namespace planner.
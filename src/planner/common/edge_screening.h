@@ -0,0 +1,230 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <atomic>
+#include <cstddef>
+#include <algorithm>
+#include <boost/optional.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <planner/common/snapshot.h>
+#include <planner/common/vehicle_path.h>
+
+namespace planner {
+
+/**
+ * \brief EdgeScreening rejects the edges of a planner graph which are
+ *        infeasible by cheap checks, before the path of an edge is optimized
+ *        and the traffic is simulated along it.
+ *
+ * The checks only use the gap queries of the traffic lattice in the snapshot
+ * at the start of an edge, and the 1-D kinematics of the vehicles:
+ * - A lane change is rejected if the ego does not fit into the gap between
+ *   the vehicles on the target lane, i.e. either gap is shorter than the ego.
+ * - A constant ego acceleration over a lane keeping edge is rejected if the
+ *   ego certainly runs into its front vehicle, or its back vehicle runs into
+ *   the ego, with all vehicles keeping their accelerations until they stop.
+ * - A constant ego acceleration is rejected if the ego certainly exceeds the
+ *   maximum speed at the end of the edge.
+ *
+ * The number of the rejected edges and acceleration options are counted,
+ * which is thread safe, so that the checks can be run in the parallel
+ * expansion of the graph.
+ */
+class EdgeScreening : private boost::noncopyable {
+
+protected:
+
+  /// Whether the edges are screened.
+  bool enabled_ = true;
+
+  /// Tolerance (m) on the gaps, which covers the resolution of the traffic
+  /// lattice, so that an acceleration option is only rejected if the
+  /// vehicles close the gap by more than this.
+  double gap_tolerance_ = 2.0;
+
+  /// Number of the edges rejected in the current planning cycle.
+  /// The counters are updated in the const functions simulating the edges.
+  mutable std::atomic<size_t> screened_edges_{0};
+
+  /// Number of the acceleration options rejected in the current planning cycle.
+  mutable std::atomic<size_t> screened_options_{0};
+
+public:
+
+  EdgeScreening() = default;
+
+  /// Whether the edges are screened.
+  const bool enabled() const { return enabled_; }
+  bool& enabled() { return enabled_; }
+
+  /// Tolerance (m) on the gaps closed by the acceleration options.
+  const double gapTolerance() const { return gap_tolerance_; }
+  double& gapTolerance() { return gap_tolerance_; }
+
+  /// Start counting for a new planning cycle.
+  void reset() {
+    screened_edges_ = 0;
+    screened_options_ = 0;
+    return;
+  }
+
+  /// Number of the edges rejected in the current planning cycle.
+  const size_t screenedEdges() const { return screened_edges_; }
+
+  /// Number of the acceleration options rejected in the current planning cycle,
+  /// not counting the ones of the rejected edges.
+  const size_t screenedOptions() const { return screened_options_; }
+
+  void addScreenedEdge() const { ++screened_edges_; }
+  void addScreenedOptions(const size_t options) const { screened_options_ += options; }
+
+  /**
+   * \brief Check whether the ego fits into the gap on the target lane of a lane change.
+   *
+   * \param[in] snapshot The snapshot at the start of the edge.
+   * \param[in] lane_change_type The lane change of the edge.
+   * \return True if the edge keeps the lane, or the gaps to both the front and
+   *         back vehicles on the target lane are no shorter than the ego.
+   */
+  static const bool laneChangeGapClear(
+      const Snapshot& snapshot, const VehiclePath::LaneChangeType lane_change_type) {
+
+    boost::optional<std::pair<size_t, double>> front = boost::none;
+    boost::optional<std::pair<size_t, double>> back = boost::none;
+    const size_t ego = snapshot.ego().id();
+
+    if (lane_change_type == VehiclePath::LaneChangeType::LeftLaneChange) {
+      front = snapshot.trafficLattice()->leftFront(ego);
+      back = snapshot.trafficLattice()->leftBack(ego);
+    } else if (lane_change_type == VehiclePath::LaneChangeType::RightLaneChange) {
+      front = snapshot.trafficLattice()->rightFront(ego);
+      back = snapshot.trafficLattice()->rightBack(ego);
+    } else {
+      return true;
+    }
+
+    const double ego_length = 2.0 * snapshot.ego().boundingBox().extent.x;
+    if (front && front->second < ego_length) return false;
+    if (back && back->second < ego_length) return false;
+    return true;
+  }
+
+  /**
+   * \brief Check whether a constant ego acceleration over an edge is feasible.
+   *
+   * \param[in] snapshot The snapshot at the start of the edge.
+   * \param[in] lane_change_type The lane change of the edge. The gaps on the
+   *            lane of the ego are only checked for the lane keeping edges.
+   * \param[in] accel The constant acceleration of the ego.
+   * \param[in] distance A lower bound of the length of the edge, e.g. the
+   *            straight line distance between its ends.
+   * \param[in] max_time The maximum time (s) simulated over the edge.
+   * \param[in] max_speed The ego speed at the end of the edge should be less than this.
+   * \return False if the option certainly leads to a collision or an invalid
+   *         ego speed in the simulation.
+   */
+  const bool accelerationFeasible(
+      const Snapshot& snapshot,
+      const VehiclePath::LaneChangeType lane_change_type,
+      const double accel,
+      const double distance,
+      const double max_time,
+      const double max_speed) const {
+
+    const Vehicle& ego = snapshot.ego();
+
+    // The edge is simulated until the ego covers the edge, stops, or the
+    // maximum time is reached. Since the edge is no shorter than the given
+    // distance, the ego is simulated for at least this long.
+    const double time = std::min(
+        stopOrReachTime(ego.speed(), accel, distance), max_time);
+
+    if (ego.speed() + accel*time >= max_speed) return false;
+
+    if (lane_change_type != VehiclePath::LaneChangeType::KeepLane) return true;
+
+    const boost::optional<std::pair<size_t, double>> front =
+      snapshot.trafficLattice()->front(ego.id());
+    if (front) {
+      const ConstVehicleView leader = snapshot.vehicle(front->first);
+      if (maxClosing(ego.speed(), accel, leader.speed(), leader.acceleration(), time) >
+          front->second + gap_tolerance_) return false;
+    }
+
+    const boost::optional<std::pair<size_t, double>> back =
+      snapshot.trafficLattice()->back(ego.id());
+    if (back) {
+      const ConstVehicleView follower = snapshot.vehicle(back->first);
+      if (maxClosing(follower.speed(), follower.acceleration(), ego.speed(), accel, time) >
+          back->second + gap_tolerance_) return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * \brief The maximum distance by which a follower closes on its leader
+   *        within the given time, both with constant accelerations until
+   *        they stop.
+   */
+  static const double maxClosing(
+      const double follower_speed, const double follower_accel,
+      const double leader_speed, const double leader_accel,
+      const double time) {
+
+    auto closing = [&](const double t)->double{
+      return travel(follower_speed, follower_accel, t) -
+             travel(leader_speed, leader_accel, t);
+    };
+
+    // The closing is piecewise quadratic, whose pieces are split by the stops
+    // of the vehicles. The maximum is at the ends of the pieces, or where the
+    // relative speed is zero before any of the vehicles stops.
+    double max_closing = std::max(closing(0.0), closing(time));
+    auto candidate = [&](const double t)->void{
+      if (t > 0.0 && t < time) max_closing = std::max(max_closing, closing(t));
+    };
+
+    if (follower_accel < 0.0) candidate(-follower_speed/follower_accel);
+    if (leader_accel < 0.0) candidate(-leader_speed/leader_accel);
+    if (leader_accel != follower_accel)
+      candidate((follower_speed-leader_speed) / (leader_accel-follower_accel));
+
+    return max_closing;
+  }
+
+protected:
+
+  /// Distance travelled within the given time with a constant acceleration until stopped.
+  static const double travel(const double speed, const double accel, const double time) {
+    if (accel < 0.0 && speed+accel*time < 0.0) return -0.5*speed*speed/accel;
+    return speed*time + 0.5*accel*time*time;
+  }
+
+  /// Time until the given distance is covered or the vehicle stops,
+  /// the same as \c TrafficSimulator::remainingTime().
+  static const double stopOrReachTime(
+      const double speed, const double accel, const double distance) {
+    if (accel < 0.0 && speed*speed + 2.0*accel*distance <= 0.0) return -speed/accel;
+    if (accel == 0.0) return speed > 0.0 ? distance/speed : 100.0;
+    return (std::sqrt(speed*speed + 2.0*accel*distance) - speed) / accel;
+  }
+
+}; // End class EdgeScreening.
+
+} // End namespace planner.
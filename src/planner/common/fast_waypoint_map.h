@@ -14,6 +14,15 @@
 
 #pragma once
 
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -21,16 +30,41 @@
 #include <boost/smart_ptr.hpp>
 #include <boost/core/noncopyable.hpp>
 
-#include <pcl/point_cloud.h>
-#include <pcl/kdtree/kdtree_flann.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <carla/client/Map.h>
 #include <carla/client/Waypoint.h>
+#include <carla/road/Road.h>
 
 #include <planner/common/utils.h>
+#include <planner/common/mapped_file.h>
+#include <planner/common/location_grid.h>
 
 namespace utils {
 
+/**
+ * \brief FastWaypointMap stores the waypoints of a map with a fixed
+ *        resolution, and finds the closest waypoint to a location quickly.
+ *
+ * Generating the waypoints of a whole town is slow. If a cache directory is
+ * provided, the waypoints (transforms and road/section/lane/s) together with
+ * the grid index are stored in a cache file, named after the map and the
+ * resolution, the first time the map is constructed. Later constructions
+ * map the cache file into memory instead, so that no waypoint is generated
+ * and the pages are shared by all processes using the same map. The cache
+ * is regenerated if the OpenDRIVE description of the map changes.
+ *
+ * With a cache file, the carla waypoint objects are created lazily when
+ * they are first queried. The curvature tables of the roads and the curvature
+ * at every waypoint are stored in the cache file as well, so that a process
+ * attaching to an existing cache neither generates nor evaluates anything
+ * on the map, and keeps no copy of the index in its own memory.
+ *
+ * The road, section, and lane of every waypoint can be read with
+ * \c waypointInfo() without creating the carla waypoint, which is how
+ * \c WaypointGraph connects the waypoints of the whole map.
+ */
 class FastWaypointMap : private boost::noncopyable {
 
 protected:
@@ -40,129 +74,644 @@ protected:
   using CarlaTransform = carla::geom::Transform;
   using CarlaLocation  = carla::geom::Location;
 
-  /// Hash function of \c pcl::PointXYZ.
-  struct PointXYZHash {
-    size_t operator()(const pcl::PointXYZ& point) const {
-      size_t seed = 0;
-      hashCombine(seed, point.x, point.y, point.z);
-      return seed;
-    }
+public:
+
+  /// Handle of a waypoint stored in the map, which can be used to
+  /// retrieve the waypoint without any search.
+  using WaypointHandle = LocationGrid::Index;
+
+  /// Where a waypoint stored in the map is, see \c waypointInfo().
+  struct WaypointInfo {
+    uint32_t road_id;
+    uint32_t section_id;
+    int32_t lane_id;
+    /// Distance of the waypoint along the road.
+    double s;
+    /// Yaw (degree) of the waypoint.
+    float yaw;
+    /// The permitted lane change at the waypoint, as the underlying
+    /// value of \c carla::road::element::LaneMarking::LaneChange.
+    uint8_t lane_change;
   };
 
-  /// Compare function of \c pcl::PointXYZ.
-  struct PointXYZEqual {
-    bool operator()(const pcl::PointXYZ& p1, const pcl::PointXYZ& p2) const {
-      return (p1.x==p2.x) & (p1.y==p2.y) & (p1.z==p2.z);
-    }
+protected:
+
+  /// Header of the cache file.
+  struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t padding;
+    double resolution;
+    uint64_t opendrive_hash;
+    double cell_size;
+    double min_x;
+    double min_y;
+    int32_t x_cells;
+    int32_t y_cells;
+    uint64_t num_waypoints;
+    uint64_t num_roads;
+    uint64_t num_curvatures;
+  };
+
+  /// A waypoint stored in the cache file.
+  struct WaypointRecord {
+    float location[3];
+    float rotation[3];
+    uint32_t road_id;
+    uint32_t section_id;
+    int32_t lane_id;
+    float curvature;
+    double s;
+    uint32_t lane_change;
+    uint32_t padding;
   };
 
+  /// The curvature table of a road stored in the cache file.
+  struct RoadRecord {
+    uint32_t road_id;
+    uint32_t padding;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  /// The curvature of a road reference line sampled every \c resolution_
+  /// from the start of the road.
+  struct CurvatureTable {
+    const double* curvatures;
+    size_t size;
+  };
+
+  /// Version of the cache file format.
+  static constexpr uint32_t kCacheVersion_ = 3;
+
 protected:
 
+  /// The carla map.
+  boost::shared_ptr<const CarlaMap> map_;
+
   /// Resolution of the waypoints (minimum distance).
   double resolution_;
 
-  /// The map is stored as location-to-waypoint pair.
-  std::unordered_map<pcl::PointXYZ,
-                     boost::shared_ptr<CarlaWaypoint>,
-                     PointXYZHash,
-                     PointXYZEqual> xyz_to_waypoint_table_;
+  /// Hash of the OpenDRIVE description of the map.
+  uint64_t opendrive_hash_;
 
-  /// KDtree built with all waypoint locations.
-  pcl::KdTreeFLANN<pcl::PointXYZ> kdtree_;
+  /**
+   * All waypoints stored in the map, indexed by the waypoint handles.
+   *
+   * If the map is loaded from the cache file, the waypoints are filled
+   * in lazily, which is why the vector is mutable. The elements are only
+   * accessed with \c boost::atomic_load() and \c boost::atomic_store().
+   */
+  mutable std::vector<boost::shared_ptr<CarlaWaypoint>> waypoints_;
 
-  /// The point cloud built with all waypoint locations.
-  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_ = nullptr;
+  /// The cache file mapped into memory, if the map is loaded from it.
+  boost::shared_ptr<MappedFile> cache_ = nullptr;
 
-public:
+  /// Waypoint records within \c cache_.
+  const WaypointRecord* records_ = nullptr;
 
-  FastWaypointMap(const boost::shared_ptr<const CarlaMap>& map,
-                  const double resolution = 0.05) : resolution_(resolution) {
+  /// Grid index built with all waypoint locations.
+  boost::shared_ptr<LocationGrid> grid_ = nullptr;
 
-    // Generate waypoints on the map with the given resolution.
-    const std::vector<boost::shared_ptr<CarlaWaypoint>>
-      waypoints = map->GenerateWaypoints(resolution_);
+  /// Waypoints at the start of each lane, keyed by road, section, and lane IDs.
+  /// This is only used to create waypoints from \c records_.
+  mutable std::unordered_map<size_t, boost::shared_ptr<CarlaWaypoint>> lane_start_table_;
+  mutable std::mutex lane_start_table_mutex_;
 
-    // Add all waypoints to the table.
-    // At the same time, collect all locations into a point cloud.
-    cloud_ = boost::make_shared<pcl::PointCloud<pcl::PointXYZ>>();
-    cloud_->width = waypoints.size();
-    cloud_->height = 1;
+  /**
+   * A mapping from road ID to the curvature along the road.
+   *
+   * The tables point into \c cache_ if the map is loaded from the cache
+   * file, or into \c curvatures_storage_ otherwise.
+   */
+  std::unordered_map<size_t, CurvatureTable> road_to_curvatures_table_;
 
-    for (const auto& waypoint : waypoints) {
-      const pcl::PointXYZ point = carlaLocationToPointXYZ(waypoint->GetTransform().location);
-      xyz_to_waypoint_table_[point] = waypoint;
-      cloud_->push_back(point);
-    }
+  /// Storage of the curvature tables if they are not loaded from the cache file.
+  std::vector<double> curvatures_storage_;
 
-    // Build a KDtree with the point cloud.
-    kdtree_.setEpsilon(resolution_);
-    kdtree_.setInputCloud(cloud_);
+public:
+
+  /**
+   * \brief Construct the map.
+   *
+   * \param[in] map The carla map.
+   * \param[in] resolution The distance between adjacent waypoints.
+   * \param[in] cache_directory The directory of the cache file. No cache
+   *                            is used if the directory is empty.
+   */
+  FastWaypointMap(const boost::shared_ptr<const CarlaMap>& map,
+                  const double resolution = 0.05,
+                  const std::string& cache_directory = "") :
+    map_(map), resolution_(resolution),
+    opendrive_hash_(fnv1aHash(map_->GetOpenDrive())) {
+
+    const uint64_t opendrive_hash = opendrive_hash_;
+    const std::string cache_path = cache_directory.empty() ?
+      std::string() : cachePath(cache_directory);
+
+    if (cache_path.empty() || !loadCache(cache_path, opendrive_hash)) {
+      generateWaypoints();
+      buildCurvatureTables();
+      // Failing to write the cache is not an error, the map is still valid.
+      if (!cache_path.empty()) saveCache(cache_directory, cache_path, opendrive_hash);
+    }
 
     return;
   }
 
+  /**
+   * \brief Get the map shared by all users within the process.
+   *
+   * Nodes loaded into the same nodelet manager share one instance
+   * instead of building their own. The instance is kept as long as
+   * any of its users holds it.
+   *
+   * \param[in] map The carla map.
+   * \param[in] resolution The distance between adjacent waypoints.
+   * \param[in] cache_directory The directory of the cache file.
+   */
+  static boost::shared_ptr<FastWaypointMap> shared(
+      const boost::shared_ptr<const CarlaMap>& map,
+      const double resolution = 0.05,
+      const std::string& cache_directory = "") {
+
+    static std::mutex instances_mutex;
+    static std::unordered_map<std::string, boost::weak_ptr<FastWaypointMap>> instances;
+
+    const std::string key = (boost::format("%1%_%2$.3f_%3%")
+        % map->GetName() % resolution % cache_directory).str();
+
+    // The lock is held during the construction, so that the users
+    // started at the same time wait for one map instead of building many.
+    std::lock_guard<std::mutex> lock(instances_mutex);
+    boost::shared_ptr<FastWaypointMap> instance = instances[key].lock();
+    if (!instance) {
+      instance = boost::make_shared<FastWaypointMap>(map, resolution, cache_directory);
+      instances[key] = instance;
+    }
+    return instance;
+  }
+
+  /// Get the carla map.
+  const boost::shared_ptr<const CarlaMap>& map() const { return map_; }
+
   /// Get the resolution of the map.
   const double resolution() const { return resolution_; }
 
   /// Get the number of waypoints stored in the map.
-  const size_t size() const { return xyz_to_waypoint_table_.size(); }
+  const size_t size() const { return waypoints_.size(); }
+
+  /// Check if the map is loaded from a cache file.
+  const bool cached() const { return cache_ != nullptr; }
+
+  /// Get the hash of the OpenDRIVE description of the map, which
+  /// identifies the map across runs and processes.
+  const uint64_t opendriveHash() const { return opendrive_hash_; }
+
+  /**
+   * \brief Get the handle of the waypoint closest to the query location.
+   * \param[in] location The query location.
+   * \return The handle of the closest waypoint.
+   */
+  WaypointHandle waypointHandle(const CarlaLocation& location) const {
+    if (waypoints_.empty()) {
+      std::string error_msg = (boost::format(
+          "FastWaypointMap::waypointHandle(): "
+          "cannot find a waypoint close to the query location x:%1% y:%2% z:%3%.\n")
+          % location.x % location.y % location.z).str();
+      throw std::runtime_error(error_msg);
+    }
+    return grid_->closest(location);
+  }
+
+  /// Get the waypoint with the given handle.
+  boost::shared_ptr<CarlaWaypoint> waypoint(const WaypointHandle handle) const {
+    boost::shared_ptr<CarlaWaypoint> waypoint = boost::atomic_load(&waypoints_[handle]);
+    if (waypoint) return waypoint;
+
+    // Create the waypoint from the cache. In case several threads get here
+    // at the same time, they will create the same waypoint.
+    waypoint = recordWaypoint(records_[handle]);
+    boost::atomic_store(&waypoints_[handle], waypoint);
+    return waypoint;
+  }
+
+  /**
+   * \brief Get where the waypoint with the given handle is.
+   *
+   * If the map is loaded from the cache file, the information is read from
+   * the cache without creating the carla waypoint.
+   */
+  const WaypointInfo waypointInfo(const WaypointHandle handle) const {
+    if (records_) {
+      const WaypointRecord& record = records_[handle];
+      return WaypointInfo{record.road_id, record.section_id, record.lane_id,
+                          record.s, record.rotation[1],
+                          static_cast<uint8_t>(record.lane_change)};
+    }
+
+    const CarlaWaypoint& waypoint = *(waypoints_[handle]);
+    return WaypointInfo{
+      static_cast<uint32_t>(waypoint.GetRoadId()),
+      static_cast<uint32_t>(waypoint.GetSectionId()),
+      static_cast<int32_t>(waypoint.GetLaneId()),
+      waypoint.GetDistance(),
+      waypoint.GetTransform().rotation.yaw,
+      static_cast<uint8_t>(waypoint.GetLaneChange())};
+  }
 
   boost::shared_ptr<CarlaWaypoint> waypoint(
       const CarlaLocation& location) const {
+    return waypoint(waypointHandle(location));
+  }
 
-    // Create the query point based on the location.
-    const pcl::PointXYZ query_point = carlaLocationToPointXYZ(location);
+  boost::shared_ptr<CarlaWaypoint> waypoint(
+      const CarlaTransform& transform) const {
+    return waypoint(transform.location);
+  }
 
-    // Search for the closest point.
-    std::vector<int> indices(1);
-    std::vector<float> sqr_distance(1);
-    int num = kdtree_.nearestKSearch(query_point, 1, indices, sqr_distance);
+  /**
+   * \brief Get the handles of the waypoints closest to a batch of locations.
+   *
+   * No memory is allocated within this function. Use \c waypoint(handle)
+   * to retrieve the actual waypoints.
+   *
+   * \param[in] locations Pointer to the first query location.
+   * \param[in] num The number of query locations.
+   * \param[out] handles Pointer to the first output handle. There should
+   *                     be space for at least \c num handles.
+   */
+  void waypoints(const CarlaLocation* locations,
+                 const size_t num,
+                 WaypointHandle* handles) const {
+    if (num == 0) return;
+    if (waypoints_.empty()) {
+      throw std::runtime_error(
+          "FastWaypointMap::waypoints(): "
+          "there is no waypoint in the map.\n");
+    }
+    grid_->closest(locations, num, handles);
+    return;
+  }
 
-    if (num <= 0) {
-      std::string error_msg("Cannot find a waypoint close to the query location.\n");
-      std::string location_msg = (
-          boost::format("Query location: x:%1% y:%2% z:%3%\n")
-          % location.x % location.y % location.z).str();
-      std::string fast_map_msg = (
-          boost::format("fast map size:%lu resolution:%f\n")
-          % size() % resolution()).str();
+  /**
+   * \brief Get the waypoints closest to a batch of locations.
+   * \param[in] locations The query locations.
+   * \return The closest waypoints, in the same order as the queries.
+   */
+  std::vector<boost::shared_ptr<CarlaWaypoint>> waypoints(
+      const std::vector<CarlaLocation>& locations) const {
+    std::vector<WaypointHandle> handles(locations.size());
+    waypoints(locations.data(), locations.size(), handles.data());
+
+    std::vector<boost::shared_ptr<CarlaWaypoint>> closest_waypoints;
+    closest_waypoints.reserve(handles.size());
+    for (const WaypointHandle handle : handles)
+      closest_waypoints.push_back(waypoint(handle));
+    return closest_waypoints;
+  }
 
-      throw std::runtime_error(error_msg + location_msg);
-    }
+  /**
+   * \brief Get the curvature at the given waypoint.
+   *
+   * This is the table lookup version of \c utils::curvatureAtWaypoint().
+   * The curvature is corrected based on the sign of the lane ID.
+   *
+   * \param[in] waypoint The query waypoint.
+   * \return The curvature at the waypoint.
+   */
+  const double curvature(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
+    return curvature(waypoint->GetRoadId(), waypoint->GetDistance(), waypoint->GetLaneId());
+  }
+
+  /**
+   * \brief Get the curvature at the waypoint with the given handle.
+   *
+   * If the map is loaded from the cache file, the curvature is read from
+   * the cache without creating the carla waypoint.
+   */
+  const double curvature(const WaypointHandle handle) const {
+    if (records_) return records_[handle].curvature;
+    return curvature(waypoints_[handle]);
+  }
+
+protected:
 
-    const pcl::PointXYZ target_point = cloud_->at(indices[0]);
-    const auto iter = xyz_to_waypoint_table_.find(target_point);
+  /// Get the curvature at distance s on a lane of a road.
+  const double curvature(const size_t road_id, const double s, const int lane_id) const {
 
-    const CarlaLocation target_location(
-        target_point.x, target_point.y, target_point.z);
-    if ((target_location-location).Length() > resolution_) {
+    const auto iter = road_to_curvatures_table_.find(road_id);
+    if (iter == road_to_curvatures_table_.end()) {
       std::string error_msg = (boost::format(
-          "FastWaypointMap::waypoint(): "
-          "the distance between query location and closest location > %1%") % resolution_).str();
-      std::string location_msg = (
-          boost::format("query location x:%1% y:%2% z:%3%\n")
-          % location.x % location.y % location.z).str();
-      std::string target_location_msg = (
-          boost::format("closest location x:%1% y:%2% z:%3%\n")
-          % target_location.x % target_location.y % target_location.z).str();
+          "FastWaypointMap::curvature(): "
+          "road %1% of the query waypoint is not in the map.\n")
+          % road_id).str();
+      throw std::runtime_error(error_msg);
     }
 
-    return iter->second;
+    const CurvatureTable& table = iter->second;
+    const size_t index = std::min(
+        static_cast<size_t>(std::round(std::max(s, 0.0)/resolution_)),
+        table.size-1);
+
+    if (lane_id >= 0) return table.curvatures[index];
+    else return -table.curvatures[index];
   }
 
-  boost::shared_ptr<CarlaWaypoint> waypoint(
-      const CarlaTransform& transform) const {
-    return waypoint(transform.location);
+  /// Precompute the curvature tables for all roads with waypoints.
+  void buildCurvatureTables() {
+
+    // The offset and size of the table of each road in the storage.
+    std::vector<std::pair<size_t, std::pair<size_t, size_t>>> tables;
+    std::unordered_map<size_t, size_t> road_tables;
+
+    for (const auto& waypoint : waypoints_) {
+      const size_t road_id = waypoint->GetRoadId();
+      if (road_tables.count(road_id) != 0) continue;
+      road_tables[road_id] = tables.size();
+
+      const carla::road::Road& road = map_->GetMap().GetMap().GetRoad(road_id);
+      const size_t samples = static_cast<size_t>(std::ceil(road.GetLength()/resolution_)) + 1;
+
+      tables.emplace_back(road_id, std::make_pair(curvatures_storage_.size(), samples));
+      for (size_t i = 0; i < samples; ++i) {
+        const double s = std::min(i*resolution_, road.GetLength());
+        curvatures_storage_.push_back(curvatureAtRoadDistance(road, s));
+      }
+    }
+
+    // The storage is complete, so that the pointers are no longer invalidated.
+    for (const auto& table : tables) {
+      road_to_curvatures_table_[table.first] = CurvatureTable{
+        curvatures_storage_.data()+table.second.first, table.second.second};
+    }
+
+    return;
   }
 
-protected:
+  /// Round the offset in the cache file up to a multiple of 8 bytes.
+  static size_t align8(const size_t offset) { return (offset+7) / 8 * 8; }
+
+  /// Generate all waypoints on the map and build the grid index.
+  void generateWaypoints() {
+
+    // Generate waypoints on the map with the given resolution.
+    waypoints_ = map_->GenerateWaypoints(resolution_);
+
+    // Build a grid index with all waypoint locations.
+    // The cell size is chosen so that a cell contains a handful of
+    // waypoints on each lane passing through it.
+    std::vector<CarlaLocation> locations;
+    locations.reserve(waypoints_.size());
+    for (const auto& waypoint : waypoints_)
+      locations.push_back(waypoint->GetTransform().location);
+    grid_ = boost::make_shared<LocationGrid>(locations, std::max(1.0, 10.0*resolution_));
+
+    return;
+  }
+
+  /// Get the path of the cache file with the map name and the resolution.
+  std::string cachePath(const std::string& cache_directory) const {
+    std::string name = map_->GetName();
+    std::replace(name.begin(), name.end(), '/', '_');
+    return (boost::format("%1%/%2%_%3$.3f.fwm")
+        % cache_directory % name % resolution_).str();
+  }
 
-  pcl::PointXYZ carlaLocationToPointXYZ(const CarlaLocation& location) const {
-    pcl::PointXYZ point;
-    point.x = location.x;
-    point.y = location.y;
-    point.z = location.z;
-    return point;
+  /**
+   * \brief Load the waypoints and the grid index from the cache file.
+   *
+   * \param[in] path Path to the cache file.
+   * \param[in] opendrive_hash The hash of the OpenDRIVE description of the map.
+   * \return False if the cache file does not exist, or is invalid or outdated.
+   */
+  bool loadCache(const std::string& path, const uint64_t opendrive_hash) {
+
+    boost::shared_ptr<MappedFile> cache = nullptr;
+    try {
+      cache = boost::make_shared<MappedFile>(path);
+    } catch (const std::runtime_error&) {
+      return false;
+    }
+
+    if (cache->size() < sizeof(CacheHeader)) return false;
+    CacheHeader header;
+    std::memcpy(&header, cache->data(), sizeof(CacheHeader));
+
+    if (std::memcmp(header.magic, "CLPFWMAP", sizeof(header.magic)) != 0 ||
+        header.version        != kCacheVersion_ ||
+        header.resolution     != resolution_    ||
+        header.opendrive_hash != opendrive_hash ||
+        header.x_cells   <= 0 ||
+        header.y_cells   <= 0 ||
+        header.num_waypoints >= std::numeric_limits<WaypointHandle>::max()) {
+      return false;
+    }
+
+    const size_t num_waypoints = header.num_waypoints;
+    const size_t num_cells = static_cast<size_t>(header.x_cells) * header.y_cells;
+    const size_t records_offset   = sizeof(CacheHeader);
+    const size_t offsets_offset   = records_offset + num_waypoints*sizeof(WaypointRecord);
+    const size_t locations_offset = offsets_offset + (num_cells+1)*sizeof(uint32_t);
+    const size_t indices_offset   = locations_offset + num_waypoints*sizeof(CarlaLocation);
+    const size_t roads_offset     = align8(indices_offset + num_waypoints*sizeof(WaypointHandle));
+    const size_t curvatures_offset = roads_offset + header.num_roads*sizeof(RoadRecord);
+    const size_t file_size        = curvatures_offset + header.num_curvatures*sizeof(double);
+    if (cache->size() != file_size) return false;
+
+    const uint32_t* cell_offsets =
+      reinterpret_cast<const uint32_t*>(cache->data()+offsets_offset);
+    if (cell_offsets[num_cells] != num_waypoints) return false;
+
+    records_ = reinterpret_cast<const WaypointRecord*>(cache->data()+records_offset);
+    grid_ = boost::make_shared<LocationGrid>(
+        header.cell_size, header.min_x, header.min_y,
+        header.x_cells, header.y_cells, num_waypoints, cell_offsets,
+        reinterpret_cast<const CarlaLocation*>(cache->data()+locations_offset),
+        reinterpret_cast<const WaypointHandle*>(cache->data()+indices_offset));
+
+    // The curvature tables point into the cache file.
+    const RoadRecord* roads = reinterpret_cast<const RoadRecord*>(cache->data()+roads_offset);
+    const double* curvatures = reinterpret_cast<const double*>(cache->data()+curvatures_offset);
+    for (size_t i = 0; i < header.num_roads; ++i) {
+      if (roads[i].size == 0 || roads[i].offset+roads[i].size > header.num_curvatures) {
+        road_to_curvatures_table_.clear();
+        return false;
+      }
+      road_to_curvatures_table_[roads[i].road_id] =
+        CurvatureTable{curvatures+roads[i].offset, roads[i].size};
+    }
+
+    waypoints_.resize(num_waypoints);
+    cache_ = cache;
+
+    return true;
+  }
+
+  /**
+   * \brief Save the waypoints and the grid index into the cache file.
+   *
+   * The file is first written with a temporary name and then renamed,
+   * so that other processes never see a partially written cache.
+   *
+   * \param[in] directory The directory of the cache file, which is created
+   *                      if it does not exist.
+   * \param[in] path Path to the cache file.
+   * \param[in] opendrive_hash The hash of the OpenDRIVE description of the map.
+   * \return False if the cache file cannot be written.
+   */
+  bool saveCache(const std::string& directory,
+                 const std::string& path,
+                 const uint64_t opendrive_hash) const {
+
+    mkdir(directory.c_str(), 0755);
+    const std::string tmp_path = (boost::format("%1%.%2%.tmp") % path % getpid()).str();
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(CacheHeader));
+    std::memcpy(header.magic, "CLPFWMAP", sizeof(header.magic));
+    header.version        = kCacheVersion_;
+    header.resolution     = resolution_;
+    header.opendrive_hash = opendrive_hash;
+    header.cell_size      = grid_->cellSize();
+    header.min_x          = grid_->minX();
+    header.min_y          = grid_->minY();
+    header.x_cells        = grid_->xCells();
+    header.y_cells        = grid_->yCells();
+    header.num_waypoints  = waypoints_.size();
+    header.num_roads      = road_to_curvatures_table_.size();
+    header.num_curvatures = curvatures_storage_.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+
+    for (const auto& waypoint : waypoints_) {
+      const CarlaTransform& transform = waypoint->GetTransform();
+      WaypointRecord record;
+      std::memset(&record, 0, sizeof(WaypointRecord));
+      record.location[0] = transform.location.x;
+      record.location[1] = transform.location.y;
+      record.location[2] = transform.location.z;
+      record.rotation[0] = transform.rotation.pitch;
+      record.rotation[1] = transform.rotation.yaw;
+      record.rotation[2] = transform.rotation.roll;
+      record.road_id     = waypoint->GetRoadId();
+      record.section_id  = waypoint->GetSectionId();
+      record.lane_id     = waypoint->GetLaneId();
+      record.curvature   = curvature(waypoint);
+      record.s           = waypoint->GetDistance();
+      record.lane_change = static_cast<uint32_t>(waypoint->GetLaneChange());
+      file.write(reinterpret_cast<const char*>(&record), sizeof(WaypointRecord));
+    }
+
+    // An empty grid has no cell offsets, write the single zero offset.
+    const uint32_t zero_offset = 0;
+    if (grid_->size() == 0)
+      file.write(reinterpret_cast<const char*>(&zero_offset), sizeof(uint32_t));
+    else
+      file.write(reinterpret_cast<const char*>(grid_->cellOffsets()),
+                 (grid_->numCells()+1)*sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(grid_->cellLocations()),
+               grid_->size()*sizeof(CarlaLocation));
+    file.write(reinterpret_cast<const char*>(grid_->cellIndices()),
+               grid_->size()*sizeof(WaypointHandle));
+
+    // Pad the curvature tables to 8 bytes.
+    const size_t indices_end = static_cast<size_t>(file.tellp());
+    const char padding[8] = {0};
+    file.write(padding, align8(indices_end)-indices_end);
+
+    for (const auto& table : road_to_curvatures_table_) {
+      RoadRecord road;
+      std::memset(&road, 0, sizeof(RoadRecord));
+      road.road_id = table.first;
+      road.offset  = table.second.curvatures - curvatures_storage_.data();
+      road.size    = table.second.size;
+      file.write(reinterpret_cast<const char*>(&road), sizeof(RoadRecord));
+    }
+    file.write(reinterpret_cast<const char*>(curvatures_storage_.data()),
+               curvatures_storage_.size()*sizeof(double));
+
+    file.close();
+    if (!file || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * \brief Create the carla waypoint of a record in the cache file.
+   *
+   * The waypoint is found by projecting the recorded location onto the map.
+   * Within junctions, lanes overlap and the projection may end up on another
+   * lane, in which case the waypoint is found by moving forward from the
+   * start of the recorded lane.
+   */
+  boost::shared_ptr<CarlaWaypoint> recordWaypoint(const WaypointRecord& record) const {
+
+    auto matchRecord = [this, &record](const boost::shared_ptr<CarlaWaypoint>& waypoint)->bool{
+      return waypoint &&
+             waypoint->GetRoadId()    == record.road_id    &&
+             waypoint->GetSectionId() == record.section_id &&
+             waypoint->GetLaneId()    == record.lane_id    &&
+             std::abs(waypoint->GetDistance()-record.s) < 0.5*resolution_;
+    };
+
+    const CarlaLocation location(
+        record.location[0], record.location[1], record.location[2]);
+    boost::shared_ptr<CarlaWaypoint> waypoint = map_->GetWaypoint(location);
+    if (matchRecord(waypoint)) return waypoint;
+
+    const boost::shared_ptr<CarlaWaypoint> lane_start = laneStart(
+        record.road_id, record.section_id, record.lane_id);
+    if (lane_start) {
+      const double distance = std::abs(record.s - lane_start->GetDistance());
+      if (matchRecord(lane_start)) return lane_start;
+      for (const auto& next : lane_start->GetNext(distance))
+        if (matchRecord(next)) return next;
+    }
+
+    std::string error_msg = (boost::format(
+        "FastWaypointMap::recordWaypoint(): "
+        "cannot recover waypoint road:%1% section:%2% lane:%3% s:%4% from the cache.\n")
+        % record.road_id % record.section_id % record.lane_id % record.s).str();
+    throw std::runtime_error(error_msg);
+  }
+
+  /// Find the waypoint at the start of a lane with the map topology.
+  boost::shared_ptr<CarlaWaypoint> laneStart(const uint32_t road_id,
+                                            const uint32_t section_id,
+                                            const int32_t lane_id) const {
+    std::lock_guard<std::mutex> lock(lane_start_table_mutex_);
+
+    if (lane_start_table_.empty()) {
+      for (const auto& segment : map_->GetTopology()) {
+        for (const auto& waypoint : {segment.first, segment.second}) {
+          size_t key = 0;
+          hashCombine(key, waypoint->GetRoadId(), waypoint->GetSectionId(), waypoint->GetLaneId());
+          lane_start_table_[key] = waypoint;
+        }
+      }
+    }
+
+    size_t key = 0;
+    hashCombine(key, road_id, section_id, lane_id);
+    const auto iter = lane_start_table_.find(key);
+    if (iter == lane_start_table_.end()) return nullptr;
+    else return iter->second;
+  }
+
+  /// FNV-1a hash, which is stable across processes and platforms.
+  static uint64_t fnv1aHash(const std::string& str) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : str) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ull;
+    }
+    return hash;
   }
 
 }; // End class FastWaypointMap.
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <boost/smart_ptr.hpp>
+#include <boost/core/noncopyable.hpp>
+
+namespace planner {
+
+/**
+ * \brief GraphArena is a monotonic arena for the graph objects created
+ *        within a planning cycle.
+ *
+ * Allocation bumps a pointer in the current block, and a new block is only
+ * requested from the heap once the current one is used up. Nothing is freed
+ * individually. All blocks are released together when the arena is
+ * destroyed.
+ *
+ * The arena is always managed by a shared pointer, and is kept alive by the
+ * \c GraphAllocator copies held by the objects allocated from it. Therefore,
+ * a planner can start a new arena in each cycle, while the graph objects
+ * of the last cycle, e.g. the ones still referred to by the new graph,
+ * release the old arena once they are dropped.
+ *
+ * The arena is safe to be used from multiple threads.
+ */
+class GraphArena : private boost::noncopyable {
+
+protected:
+
+  /// Default size of the blocks (bytes).
+  static constexpr size_t kDefaultBlockSize_ = 64 * 1024;
+
+  /// Size of the blocks requested from the heap (bytes).
+  size_t block_size_;
+
+  /// The blocks owned by the arena.
+  std::vector<std::unique_ptr<unsigned char[]>> blocks_;
+
+  /// The next free byte in the current block.
+  unsigned char* head_ = nullptr;
+
+  /// Number of free bytes left in the current block.
+  size_t remaining_ = 0;
+
+  /// Number of bytes handed out.
+  size_t allocated_ = 0;
+
+  /// Number of bytes requested from the heap.
+  size_t reserved_ = 0;
+
+  /// Protects all of the above.
+  mutable std::mutex mutex_;
+
+public:
+
+  /**
+   * \brief Class constructor.
+   * \param[in] block_size Size of the blocks requested from the heap (bytes).
+   */
+  GraphArena(const size_t block_size = kDefaultBlockSize_) :
+    block_size_(block_size) {}
+
+  /**
+   * \brief Allocate memory from the arena.
+   *
+   * \param[in] bytes Number of bytes to allocate.
+   * \param[in] alignment Alignment of the memory, which must be a power of two.
+   * \return Pointer to the allocated memory, which is valid until the arena is destroyed.
+   */
+  void* allocate(const size_t bytes, const size_t alignment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t padding = alignmentPadding(head_, alignment);
+    if (padding+bytes > remaining_) {
+      // Objects larger than a block get a block of their own.
+      const size_t size = std::max(block_size_, bytes+alignment);
+      blocks_.emplace_back(new unsigned char[size]);
+      head_ = blocks_.back().get();
+      remaining_ = size;
+      reserved_ += size;
+      padding = alignmentPadding(head_, alignment);
+    }
+
+    unsigned char* memory = head_ + padding;
+    head_ += padding + bytes;
+    remaining_ -= padding + bytes;
+    allocated_ += bytes;
+    return memory;
+  }
+
+  /// Number of bytes handed out by the arena.
+  const size_t allocatedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocated_;
+  }
+
+  /// Number of bytes the arena requested from the heap.
+  const size_t reservedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reserved_;
+  }
+
+protected:
+
+  static size_t alignmentPadding(const unsigned char* ptr, const size_t alignment) {
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(ptr);
+    return (alignment - address%alignment) % alignment;
+  }
+
+}; // End class GraphArena.
+
+/**
+ * \brief GraphAllocator allocates from a \c GraphArena, which it shares
+ *        the ownership of.
+ *
+ * It is meant to be used with \c boost::allocate_shared(), so that both the
+ * object and its reference count are placed in the arena. Deallocation is
+ * a no-op, the memory is reclaimed once the arena is destroyed.
+ */
+template<typename T>
+class GraphAllocator {
+
+  template<typename U> friend class GraphAllocator;
+
+protected:
+
+  boost::shared_ptr<GraphArena> arena_;
+
+public:
+
+  using value_type = T;
+
+  template<typename U>
+  struct rebind { using other = GraphAllocator<U>; };
+
+  GraphAllocator(const boost::shared_ptr<GraphArena>& arena) : arena_(arena) {}
+
+  template<typename U>
+  GraphAllocator(const GraphAllocator<U>& other) : arena_(other.arena_) {}
+
+  T* allocate(const size_t n) {
+    return static_cast<T*>(arena_->allocate(n*sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, const size_t) {}
+
+  template<typename U>
+  bool operator==(const GraphAllocator<U>& other) const { return arena_ == other.arena_; }
+
+  template<typename U>
+  bool operator!=(const GraphAllocator<U>& other) const { return arena_ != other.arena_; }
+
+}; // End class GraphAllocator.
+
+} // End namespace planner.
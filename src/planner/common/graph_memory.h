@@ -0,0 +1,177 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <unordered_map>
+
+#include <planner/common/snapshot.h>
+#include <planner/common/graph_arena.h>
+
+namespace planner {
+
+/**
+ * \brief GraphMemory keeps track of the memory used by the graph of a planner
+ *        within a planning cycle.
+ *
+ * The memory consists of the graph objects, e.g. the vertices, allocated from
+ * the \c GraphArena of the cycle, and the agent tables and traffic lattices of
+ * the snapshots stored in the graph objects. Since the snapshots share their
+ * tables as long as they are not modified, each table is only counted once,
+ * and released once none of the snapshots counted refers to it.
+ *
+ * A cap can be set on the memory, so that the planner can degrade gracefully,
+ * e.g. by stopping the graph construction, once the cap is exceeded.
+ *
+ * The object is not thread safe. Snapshots should be added in the serial
+ * merge steps of the graph construction.
+ */
+class GraphMemory {
+
+protected:
+
+  /// The cap of the memory (bytes).
+  size_t cap_ = std::numeric_limits<size_t>::max();
+
+  /// The arena of the graph objects in the current cycle.
+  boost::shared_ptr<const GraphArena> arena_ = nullptr;
+
+  /// The agent tables and traffic lattices which have been counted, together
+  /// with the number of the snapshots referring to each of them and its bytes.
+  std::unordered_map<const void*, std::pair<size_t, size_t>> tables_;
+
+  /// Number of the snapshots added, i.e. the distinct traffic lattices.
+  size_t snapshots_ = 0;
+
+  /// Bytes of the agent tables and the traffic lattices counted.
+  size_t snapshot_bytes_ = 0;
+
+  /// The maximum bytes in the current cycle.
+  size_t peak_bytes_ = 0;
+
+public:
+
+  GraphMemory() = default;
+
+  /// The cap of the memory (bytes), which is not limited by default.
+  const size_t cap() const { return cap_; }
+  size_t& cap() { return cap_; }
+
+  /// Whether the memory is limited.
+  const bool limited() const { return cap_ != std::numeric_limits<size_t>::max(); }
+
+  /**
+   * \brief Start the accounting of a new planning cycle.
+   * \param[in] arena The arena of the graph objects created in the cycle.
+   */
+  void reset(const boost::shared_ptr<const GraphArena>& arena) {
+    arena_ = arena;
+    peak_bytes_ = 0;
+    clearSnapshots();
+    return;
+  }
+
+  /**
+   * \brief Forget about all the snapshots counted so far.
+   *
+   * This is used to count the snapshots from scratch, e.g. at the start of
+   * a planning cycle.
+   */
+  void clearSnapshots() {
+    tables_.clear();
+    snapshots_ = 0;
+    snapshot_bytes_ = 0;
+    return;
+  }
+
+  /// Count the memory of a snapshot, unless its tables have been counted.
+  void addSnapshot(const Snapshot& snapshot) {
+    const VehicleTable& agents = snapshot.agents();
+    if (!addReference(&agents)) addTable(&agents, agents.memoryUsage());
+
+    const boost::shared_ptr<const TrafficLattice> lattice = snapshot.trafficLattice();
+    if (!addReference(lattice.get())) {
+      addTable(lattice.get(), lattice->memoryUsage());
+      ++snapshots_;
+    }
+
+    peak_bytes_ = std::max(peak_bytes_, bytes());
+    return;
+  }
+
+  /**
+   * \brief Release a snapshot added before, e.g. once it is removed from the graph.
+   *
+   * The memory of its tables is released once no other snapshot counted
+   * refers to them.
+   */
+  void removeSnapshot(const Snapshot& snapshot) {
+    removeReference(&snapshot.agents());
+    if (removeReference(snapshot.trafficLattice().get())) --snapshots_;
+    return;
+  }
+
+  /// Number of the distinct snapshots counted.
+  const size_t snapshots() const { return snapshots_; }
+
+  /// Bytes of the agent tables and the traffic lattices counted.
+  const size_t snapshotBytes() const { return snapshot_bytes_; }
+
+  /// Bytes of the graph objects allocated from the arena.
+  const size_t graphObjectBytes() const {
+    return arena_ ? arena_->allocatedBytes() : 0;
+  }
+
+  /// Total bytes of the graph.
+  const size_t bytes() const { return graphObjectBytes() + snapshot_bytes_; }
+
+  /// The maximum total bytes in the current cycle.
+  const size_t peakBytes() const { return std::max(peak_bytes_, bytes()); }
+
+  /// Whether the memory exceeds the cap.
+  const bool exceeded() const { return bytes() > cap_; }
+
+protected:
+
+  /// Add a reference to a table, return false if the table is not counted yet.
+  const bool addReference(const void* table) {
+    auto iter = tables_.find(table);
+    if (iter == tables_.end()) return false;
+    ++iter->second.first;
+    return true;
+  }
+
+  /// Count a new table with its bytes.
+  void addTable(const void* table, const size_t bytes) {
+    tables_.emplace(table, std::make_pair(1, bytes));
+    snapshot_bytes_ += bytes;
+    return;
+  }
+
+  /// Remove a reference to a table, return true if the table is released.
+  const bool removeReference(const void* table) {
+    auto iter = tables_.find(table);
+    if (iter == tables_.end() || --iter->second.first > 0) return false;
+    snapshot_bytes_ -= iter->second.second;
+    tables_.erase(iter);
+    return true;
+  }
+
+}; // End class GraphMemory.
+
+} // End namespace planner.
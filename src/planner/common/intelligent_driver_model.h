@@ -15,6 +15,9 @@
 #pragma once
 
 #include <cmath>
+#include <limits>
+#include <algorithm>
+#include <Eigen/Core>
 #include <boost/optional.hpp>
 
 namespace planner {
@@ -127,8 +130,99 @@ public:
     return saturateAccel(accel);
   }
 
+  /**
+   * \brief Compute the accelerations of a batch of vehicles in one sweep.
+   *
+   * The inputs are arrays of the same length, one entry for each vehicle.
+   * A vehicle without a lead should have its distance set to infinity, in
+   * which case its lead speed is ignored. The speeds are assumed to be
+   * non-negative.
+   *
+   * \param[in] ego_v Speeds of the vehicles.
+   * \param[in] ego_v0 The desired speeds of the vehicles.
+   * \param[in] lead_v The speeds of the lead vehicles.
+   * \param[in] s The (positive) distances between the vehicles and their leads.
+   * \param[in] num The number of vehicles.
+   * \param[out] accel The accelerations to be applied for the vehicles.
+   */
+  virtual void idm(
+      const double* ego_v,
+      const double* ego_v0,
+      const double* lead_v,
+      const double* s,
+      const size_t num,
+      double* accel) const {
+    forEachBlock(ego_v, ego_v0, lead_v, s, num, accel,
+        [this](const Block& v, const Block& v0, const Block& lv, const Block& gap)->Block{
+          return this->BasicIntelligentDriverModel::idmBlock(v, v0, lv, gap);
+        });
+    return;
+  }
+
 protected:
 
+  /// Number of vehicles processed together by the batched \c idm().
+  static constexpr int kBlockSize_ = 8;
+
+  /// Fixed-size array, which lives on the stack and is vectorized by Eigen.
+  using Block = Eigen::Array<double, kBlockSize_, 1>;
+
+  /**
+   * \brief Go through the vehicles block by block.
+   *
+   * The last block is padded with vehicles at rest without a lead.
+   *
+   * \param[in] kernel Computes the accelerations of a block of vehicles.
+   */
+  template<typename Kernel>
+  static void forEachBlock(
+      const double* ego_v, const double* ego_v0,
+      const double* lead_v, const double* s,
+      const size_t num, double* accel, const Kernel& kernel) {
+
+    Block v, v0, lv, gap;
+    for (size_t begin = 0; begin < num; begin += kBlockSize_) {
+      const size_t size = std::min<size_t>(kBlockSize_, num-begin);
+      if (size < kBlockSize_) {
+        v.setZero(); v0.setOnes(); lv.setZero();
+        gap.setConstant(std::numeric_limits<double>::infinity());
+      }
+
+      v.head(size)   = Eigen::Map<const Eigen::ArrayXd>(ego_v+begin, size);
+      v0.head(size)  = Eigen::Map<const Eigen::ArrayXd>(ego_v0+begin, size);
+      lv.head(size)  = Eigen::Map<const Eigen::ArrayXd>(lead_v+begin, size);
+      gap.head(size) = Eigen::Map<const Eigen::ArrayXd>(s+begin, size);
+
+      Eigen::Map<Eigen::ArrayXd>(accel+begin, size) = kernel(v, v0, lv, gap).head(size);
+    }
+    return;
+  }
+
+  /// Batched version of \c idm() for a block of vehicles.
+  Block idmBlock(const Block& ego_v, const Block& ego_v0,
+                 const Block& lead_v, const Block& s) const {
+    const Block s_ratio = sRatio(ego_v, lead_v, s);
+    return saturateAccel(
+        comfort_accel_ * (1.0 - power(ego_v/ego_v0, accel_exp_) - s_ratio.square()));
+  }
+
+  /// x^y computed as exp(y*log(x)) so that it is vectorized, assuming x >= 0.
+  template<typename Base, typename Exp>
+  static Block power(const Base& x, const Exp& y) {
+    return (y * x.log()).exp();
+  }
+
+  /**
+   * \brief Compute the ratio between the desired and actual following distance
+   *        for a block of vehicles, which is 0 for the vehicles without a lead.
+   */
+  Block sRatio(const Block& ego_v, const Block& lead_v, const Block& s) const {
+    const double braking_coeff = 2.0 * std::sqrt(comfort_accel_ * comfort_decel_);
+    const Block distance = (ego_v*time_gap_ + ego_v*(ego_v-lead_v)/braking_coeff).max(0.0);
+    return (s < std::numeric_limits<double>::infinity()).select(
+        (distance_gap_ + distance) / s, 0.0);
+  }
+
   /**
    * \brief Compute the desired following distance between the ego and lead vehicle.
    * \param[in] ego_v Speed of the ego vehicle.
@@ -147,6 +241,10 @@ protected:
     return accel;
   }
 
+  Block saturateAccel(const Block& accel) const {
+    return accel.min(max_accel_).max(-max_decel_);
+  }
+
 }; // End class BasicIntelligentDriverModel.
 
 
@@ -205,8 +303,39 @@ public:
     return saturateAccel(accel);
   }
 
+  virtual void idm(
+      const double* ego_v,
+      const double* ego_v0,
+      const double* lead_v,
+      const double* s,
+      const size_t num,
+      double* accel) const override {
+    forEachBlock(ego_v, ego_v0, lead_v, s, num, accel,
+        [this](const Block& v, const Block& v0, const Block& lv, const Block& gap)->Block{
+          return this->ImprovedIntelligentDriverModel::idmBlock(v, v0, lv, gap);
+        });
+    return;
+  }
+
 protected:
 
+  Block idmBlock(const Block& ego_v, const Block& ego_v0,
+                 const Block& lead_v, const Block& s) const {
+
+    const Block accel_free = freeAccel(ego_v, ego_v0);
+    // Vehicles without a lead have s_ratio = 0, which are left with the free acceleration.
+    const Block s_ratio = sRatio(ego_v, lead_v, s);
+    const Block accel_interact = comfort_accel_ * (1.0 - s_ratio.square());
+
+    // The exponent is only used (and only positive) when ego_v < ego_v0.
+    const Block accel_low = (s_ratio >= 1.0).select(
+        accel_interact, accel_free * (1.0 - power(s_ratio, 2.0*comfort_accel_/accel_free)));
+    const Block accel_high = (s_ratio >= 1.0).select(
+        accel_free + accel_interact, accel_free);
+
+    return saturateAccel((ego_v < ego_v0).select(accel_low, accel_high));
+  }
+
   double freeAccel(const double ego_v, const double ego_v0) const {
     // There is no lead vehicle, thus we use the free acceleration model. Eq 11.22
     double accel{0.0};
@@ -218,6 +347,16 @@ protected:
     return accel;
   }
 
+  Block freeAccel(const Block& ego_v, const Block& ego_v0) const {
+    // Both cases share the same power of the speed ratio, with different exponents,
+    // i.e. (ego_v0/ego_v)^e = (ego_v/ego_v0)^(-e).
+    const Block exp = (ego_v <= ego_v0).select(
+        Block::Constant(accel_exp_), Block::Constant(-comfort_accel_*accel_exp_/comfort_decel_));
+    const Block coeff = (ego_v <= ego_v0).select(
+        Block::Constant(comfort_accel_), Block::Constant(-comfort_decel_));
+    return coeff * (1.0 - power(ego_v/ego_v0, exp));
+  }
+
 }; // End Class ImprovedIntelligentDriverModel
 
 /**
@@ -263,7 +402,7 @@ public:
   double idm(const double ego_v,
              const double ego_v0,
              const boost::optional<double> lead_v = boost::none,
-             const boost::optional<double> s = boost::none) const {
+             const boost::optional<double> s = boost::none) const override {
 
     double lead_v_dot = 0.0;
     double accel {0.0};
@@ -284,8 +423,45 @@ public:
     return saturateAccel(accel);
   }
 
+  void idm(const double* ego_v,
+           const double* ego_v0,
+           const double* lead_v,
+           const double* s,
+           const size_t num,
+           double* accel) const override {
+    forEachBlock(ego_v, ego_v0, lead_v, s, num, accel,
+        [this](const Block& v, const Block& v0, const Block& lv, const Block& gap)->Block{
+          return this->AdaptiveCruiseControl::idmBlock(v, v0, lv, gap);
+        });
+    return;
+  }
+
 protected:
 
+  Block idmBlock(const Block& v, const Block& v0,
+                 const Block& lv, const Block& gap) const {
+
+    const Block a_iidm = ImprovedIntelligentDriverModel::idmBlock(v, v0, lv, gap);
+
+    const double lead_v_dot = 0.0;
+    const double a_tilde = std::min(lead_v_dot, comfort_accel_);
+
+    // Implement Equation 11.25
+    const Block v_diff = v - lv;
+    const Block acah = (lv*v_diff < -2.0*gap*a_tilde).select(
+        v.square()*a_tilde / (lv.square() - 2.0*gap*a_tilde),
+        a_tilde - v_diff.max(0.0).square() / (2.0*gap));
+
+    // Implement Equation 11.26, where tanh(x) = 1 - 2/(exp(2x)+1) to be vectorized.
+    const Block tanh_term = 1.0 - 2.0 / ((2.0*(a_iidm-acah)/comfort_decel_).exp() + 1.0);
+    const Block accel_blend = (1.0-coolness_factor_) * a_iidm +
+      coolness_factor_ * (acah + comfort_decel_ * tanh_term);
+
+    // Vehicles without a lead are left with the IIDM acceleration.
+    return saturateAccel(
+        (gap < std::numeric_limits<double>::infinity() && a_iidm < acah).select(accel_blend, a_iidm));
+  }
+
   /**
    * Compute the Constant Acceleration Heuristic Acceleration (ACAH)
    * @return The ACAH value.
@@ -16,12 +16,14 @@
 #define KN_PATH_GEN_KN_PATH_GEN_H
 
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <string>
 #include <cassert>
 #include <Eigen/Dense>
 //#include <json/json.h>
 #include <boost/format.hpp>
+#include <boost/optional.hpp>
 
 //using namespace Eigen;
 
@@ -84,6 +86,11 @@ class NonHolonomicPath {
 
   double sf{0.0}; // The total length of the path in meters.
 
+  unsigned num_iterations{0}; // Newton iterations taken by the last optimization.
+
+  /// Number of samples used to integrate along the path.
+  static constexpr int kQuadratureSamples_ = 101;
+
   /// Default constructor.
   NonHolonomicPath() = default;
 
@@ -127,18 +134,9 @@ class NonHolonomicPath {
         c * pow(s, 3) / 3 + d * pow(s, 4) / 4; // Th(s) = a*s + b*s^2/2 + c*s^3/3 + d * s^4/4
 
     // Now Approximate X, and Y via Simpson's rule.
-    double x = 0.0;
-    double y = 0.0;
-    double N = 101;
-
-    // Eigen Arrays here for coefficient wise operations.
-    Eigen::ArrayXd s_arr = Eigen::ArrayXd::LinSpaced(N, 0, s);
-    Eigen::ArrayXd theta_arr = a * s_arr + b * s_arr.pow(2) / 2 + c * s_arr.pow(3) / 3 + d * s_arr.pow(4) / 4;
-    Eigen::ArrayXd cos_arr = theta_arr.cos();
-    Eigen::ArrayXd sin_arr = theta_arr.sin();
-
-    x = simpsonsRule(cos_arr, s_arr);
-    y = simpsonsRule(sin_arr, s_arr);
+    const Moments<0> moments = integrate<kQuadratureSamples_, 0>(s);
+    double x = moments.cos[0];
+    double y = moments.sin[0];
 
     // Transform to Global Frame
     Eigen::Matrix3d R; // Homogenous Coordinates Transformation
@@ -152,30 +150,115 @@ class NonHolonomicPath {
   }
 
   /**
-   * Computes a simple method for Simpson's Rule for numerical integration.
-   * @param f The function evaluated at the discrete points.
-   * @param dx The points where the function is evaluated at. Note that this simply extracts the start, end, and width
-   * of the interval.
-   * @return The approximate value of the definite integral evaluated according to Simpson's rule.
+   * Evaluate the waypoints along the path at s0, s0+ds, s0+2*ds, ..., and at sf.
+   *
+   * The waypoints agree with the ones from evaluate(). However, instead of
+   * integrating the path from the start for every waypoint, the positions are
+   * accumulated from one waypoint to the next with Simpson's rule, so that
+   * the cost is linear in the number of waypoints.
+   *
+   * @param x0 The initial state to evaluate the curve with respect to.
+   * @param s0 The arc length of the first waypoint.
+   * @param ds The arc length between the waypoints.
+   * @return The waypoints, which are empty if s0 is beyond the path.
+   */
+  std::vector<State> sample(State x0, double s0, double ds) const {
+
+    // Verify the Path curvature matches the initial condition.
+    if (std::abs(a-x0.kappa) > 1e-5) {
+      std::string error_msg(
+          "NonHolonomicPath::sample():"
+          "invalid curvature for the initial state.\n");
+      error_msg += (boost::format("path a:%1% x.kappa:%2%\n") % a % x0.kappa).str();
+      throw std::runtime_error(error_msg);
+    }
+
+    std::vector<State> states;
+    if (s0 > sf || ds <= 0.0) return states;
+    states.reserve(static_cast<size_t>((sf-s0) / ds) + 2);
+
+    auto theta = [this](const double s)->double{
+      return s * (a + s * (b/2 + s * (c/3 + s * d/4)));
+    };
+    auto kappa = [this](const double s)->double{
+      return a + s * (b + s * (c + s * d));
+    };
+
+    // The integrals of evaluate() are scaled by (N-1)/N, see integrate().
+    const double scale = static_cast<double>(kQuadratureSamples_-1) / kQuadratureSamples_;
+    const double cos_theta0 = std::cos(x0.theta);
+    const double sin_theta0 = std::sin(x0.theta);
+
+    // Position in the frame of the initial state.
+    const Moments<0> moments = integrate<kQuadratureSamples_, 0>(s0);
+    double x = moments.cos[0];
+    double y = moments.sin[0];
+
+    auto addState = [&](const double s) {
+      states.emplace_back(x0.x + cos_theta0*x - sin_theta0*y,
+                          x0.y + sin_theta0*x + cos_theta0*y,
+                          unrollAngle(theta(s) + x0.theta),
+                          kappa(s));
+    };
+    addState(s0);
+
+    double s = s0;
+    double cos_theta = std::cos(theta(s));
+    double sin_theta = std::sin(theta(s));
+    for (size_t i = 1; s < sf; ++i) {
+      // The last waypoint is at sf, which is not duplicated by the ones next to it.
+      double next_s = s0 + ds*i;
+      if (next_s > sf - 1e-6) next_s = sf;
+
+      const double h = next_s - s;
+      const double mid_theta = theta(s + 0.5*h);
+      const double next_cos_theta = std::cos(theta(next_s));
+      const double next_sin_theta = std::sin(theta(next_s));
+      x += scale * h / 6.0 * (cos_theta + 4.0*std::cos(mid_theta) + next_cos_theta);
+      y += scale * h / 6.0 * (sin_theta + 4.0*std::sin(mid_theta) + next_sin_theta);
+
+      s = next_s;
+      cos_theta = next_cos_theta;
+      sin_theta = next_sin_theta;
+      addState(s);
+    }
+
+    return states;
+  }
+
+  /**
+   * Evaluate a waypoint along the path from a known waypoint before it.
+   *
+   * Only the segment between the two waypoints is integrated, with one step
+   * of Simpson's rule, so that the cost does not grow with s. The known
+   * waypoint is typically one of the waypoints returned by sample().
+   *
+   * @param xi The waypoint at the arc length si.
+   * @param si The arc length of the known waypoint.
+   * @param s The arc length along the path, which should be close to si.
+   * @return The resulting state.
    */
-  double simpsonsRule(const Eigen::ArrayXd &f, const Eigen::ArrayXd &dx) const {
-    int N = dx.size();
-    double a = dx(0);
-    double b = dx(N - 1);
-    double h = (b - a) / N;
-
-    // Compute the weights W.
-    Eigen::ArrayXd W = Eigen::ArrayXd::Ones(N);
-    //std::cout <<"Before modifying " << W << std::endl;
-    Eigen::Map<Eigen::ArrayXd, 0, Eigen::InnerStride<2>> even(W.data() + 2, W.size() / 2 - 1);
-    Eigen::Map<Eigen::ArrayXd, 0, Eigen::InnerStride<2>> odd(W.data() + 1, W.size() / 2);
-    even = even * 2;
-    odd = odd * 4;
-    //std::cout <<"After modifying" << W << std::endl;
-
-    double result = h / 3 * W.matrix().transpose() * f.matrix(); // Compute the Simpson's Rule result.
-
-    return result;
+  State evaluate(const State& xi, double si, double s) const {
+
+    auto theta = [this](const double s)->double{
+      return s * (a + s * (b/2 + s * (c/3 + s * d/4)));
+    };
+
+    // Heading offset between the inertial frame and the frame of the path.
+    const double theta0 = xi.theta - theta(si);
+    const double kappa = a + s * (b + s * (c + s * d));
+
+    // The integrals of evaluate() are scaled by (N-1)/N, see integrate().
+    const double scale = static_cast<double>(kQuadratureSamples_-1) / kQuadratureSamples_;
+    const double h = s - si;
+    const double mid_theta = theta0 + theta(si + 0.5*h);
+    const double end_theta = theta0 + theta(s);
+    const double x = xi.x + scale * h / 6.0 *
+      (std::cos(xi.theta) + 4.0*std::cos(mid_theta) + std::cos(end_theta));
+    const double y = xi.y + scale * h / 6.0 *
+      (std::sin(xi.theta) + 4.0*std::sin(mid_theta) + std::sin(end_theta));
+
+    return {x, y, unrollAngle(end_theta), kappa};
   }
 
   /**
@@ -187,6 +270,22 @@ class NonHolonomicPath {
   * @return True if the optimization has converged.
   */
   bool optimizePath(const State &x0, const State &xf, unsigned iterations = 100) {
+    return optimizePath(x0, xf, boost::none, iterations);
+  }
+
+  /**
+  * Optimize the path starting from the given initial guess.
+  * @param x0 The initial state constraint.
+  * @param xf The final state constraint.
+  * @param initial_guess The initial guess of b, c, d, and sf, which should be
+  *        obtained in the local frame of x0. If not provided, the heuristic
+  *        guess from \c initialGuess() is used.
+  * @param iterations The maximum number of iterations.
+  * @return True if the optimization has converged.
+  */
+  bool optimizePath(const State &x0, const State &xf,
+                    const boost::optional<NonHolonomicPath>& initial_guess,
+                    unsigned iterations = 100) {
 
     bool result = true;
 
@@ -200,20 +299,24 @@ class NonHolonomicPath {
     Eigen::Vector3d x2 = R.inverse() * x1;
     State xf_L {x2[0], x2[1], unrollAngle(xf.theta - x0.theta), xf.kappa};
 
-    NonHolonomicPath initial_guess = initialGuess(x0_L, xf_L);
-    a = initial_guess.a;
-    b = initial_guess.b;
-    c = initial_guess.c;
-    d = initial_guess.d;
-    sf = initial_guess.sf;
+    const NonHolonomicPath heuristic_guess = initialGuess(x0_L, xf_L);
+    const NonHolonomicPath& guess =
+      (initial_guess && initial_guess->sf > 0.0) ? *initial_guess : heuristic_guess;
+    a = x0_L.kappa;
+    b = guess.b;
+    c = guess.c;
+    d = guess.d;
+    sf = guess.sf;
 
     using std::pow;
     size_t counter = 0;
     for (; counter < iterations; ++counter) {
       Eigen::Vector4d old_path{b, c, d, sf};
 
-      Eigen::Matrix4d J = boundaryConstraintJacobian(x0_L, xf_L);
-      Eigen::Vector4d g = boundaryConstraint(x0_L, xf_L);
+      // The same integrals are shared by the constraints and their Jacobian.
+      const Moments<4> moments = integrate<kQuadratureSamples_, 4>(sf);
+      Eigen::Matrix4d J = boundaryConstraintJacobian(moments);
+      Eigen::Vector4d g = boundaryConstraint(moments, xf_L);
 
       Eigen::Vector4d dq = J.colPivHouseholderQr().solve(-g);
       b += dq[0];
@@ -238,6 +341,8 @@ class NonHolonomicPath {
       }
     }
 
+    num_iterations = std::min<size_t>(counter+1, iterations);
+
     // If max iteration reached, the optimization has probably diverged.
     if (counter >= iterations) return false;
 
@@ -253,15 +358,79 @@ class NonHolonomicPath {
   }
  private:
 
+  /**
+   * Integrals of s^k*cos(theta(s)) and s^k*sin(theta(s)) from 0 to s for k = 0, ..., K,
+   * where theta(s) is the heading along the path starting with 0.
+   */
+  template <int K>
+  struct Moments {
+    double cos[K+1];
+    double sin[K+1];
+  };
+
+  /**
+   * Simpson's rule weights (1, 4, 2, 4, ..., 2, 4, 1) for N samples.
+   * The weights are only computed once for each sample count.
+   */
+  template <int N>
+  static const Eigen::Array<double, N, 1>& simpsonsWeights() {
+    static_assert(N >= 3 && N % 2 == 1, "Simpson's rule requires an odd number of samples.");
+    static const Eigen::Array<double, N, 1> weights = []() {
+      Eigen::Array<double, N, 1> w;
+      for (int i = 0; i < N; ++i) w[i] = (i == 0 || i == N-1) ? 1.0 : (i % 2 ? 4.0 : 2.0);
+      return w;
+    }();
+    return weights;
+  }
+
+  /**
+   * Integrate the moments of the path up to s with Simpson's rule on N samples.
+   *
+   * All samples are kept in fixed-size arrays, so no memory is allocated on the heap.
+   * The sine and cosine of each sample are computed together.
+   *
+   * @param s The upper limit of the integrals.
+   * @return The integrals for k = 0, ..., K.
+   */
+  template <int N, int K>
+  Moments<K> integrate(const double s) const {
+
+    const Eigen::Array<double, N, 1>& weights = simpsonsWeights<N>();
+    const double ds = s / (N-1);
+
+    Eigen::Array<double, N, 1> cos_arr;
+    Eigen::Array<double, N, 1> sin_arr;
+    for (int i = 0; i < N; ++i) {
+      const double si = ds * i;
+      const double theta = si * (a + si * (b/2 + si * (c/3 + si * d/4)));
+      cos_arr[i] = weights[i] * std::cos(theta);
+      sin_arr[i] = weights[i] * std::sin(theta);
+    }
+
+    // Note the step is s/N instead of s/(N-1), which is kept consistent with
+    // the paths optimized previously.
+    const double h = s / N;
+    Moments<K> moments;
+    for (int k = 0; k <= K; ++k) {
+      moments.cos[k] = h / 3 * cos_arr.sum();
+      moments.sin[k] = h / 3 * sin_arr.sum();
+      if (k == K) break;
+      for (int i = 0; i < N; ++i) {
+        cos_arr[i] *= ds * i;
+        sin_arr[i] *= ds * i;
+      }
+    }
+
+    return moments;
+  }
+
   /**
    * Compute the Jacobian matrix of the boundary constraint set with respect to the initial and final constraints.
-   * @param x0 The initial constraint.
-   * @param xf The final constraint.
+   * @param moments The integrals of the path from the initial state, which is at the origin.
    * @return The resulting Jacobian matrix.
    */
-  Eigen::Matrix4d boundaryConstraintJacobian(const State &x0, const State &xf) const {
+  Eigen::Matrix4d boundaryConstraintJacobian(const Moments<4>& moments) const {
 
-    double N = 101;
     Eigen::Matrix4d jacobian = Eigen::Matrix4d::Zero();
 
     using std::pow; // For convenience.
@@ -271,28 +440,16 @@ class NonHolonomicPath {
     double theta_f = a * sf + b * pow(sf, 2) / 2 +
         c * pow(sf, 3) / 3 + d * pow(sf, 4) / 4; // Th(sf) = a*sf + b*sf^2/2 + c*sf^3/3 + d * sf^4/4
 
-    // Eigen Arrays here for coefficient wise operations.
-    Eigen::ArrayXd s_arr = Eigen::ArrayXd::LinSpaced(N, 0, sf);
-    Eigen::ArrayXd theta_arr = a * s_arr + b * s_arr.pow(2) / 2 + c * s_arr.pow(3) / 3 + d * s_arr.pow(4) / 4;
-
-    Eigen::ArrayXd cos2_arr = s_arr.pow(2) * theta_arr.cos();
-    Eigen::ArrayXd cos3_arr = s_arr * cos2_arr;
-    Eigen::ArrayXd cos4_arr = s_arr * cos3_arr;
-
-    Eigen::ArrayXd sin2_arr = s_arr.pow(2) * theta_arr.sin();
-    Eigen::ArrayXd sin3_arr = s_arr * sin2_arr;
-    Eigen::ArrayXd sin4_arr = s_arr * sin3_arr;
-
     // dx/dq
-    double S2 = simpsonsRule(sin2_arr, s_arr);
-    double S3 = simpsonsRule(sin3_arr, s_arr);
-    double S4 = simpsonsRule(sin4_arr, s_arr);
+    double S2 = moments.sin[2];
+    double S3 = moments.sin[3];
+    double S4 = moments.sin[4];
     jacobian.row(0) << -S2 / 2, -S3 / 3, -S4 / 4, std::cos(theta_f);
 
     // dy/dq
-    double C2 = simpsonsRule(cos2_arr, s_arr);
-    double C3 = simpsonsRule(cos3_arr, s_arr);
-    double C4 = simpsonsRule(cos4_arr, s_arr);
+    double C2 = moments.cos[2];
+    double C3 = moments.cos[3];
+    double C4 = moments.cos[4];
     jacobian.row(1) << C2 / 2, C3 / 3, C4 / 4, std::sin(theta_f);
 
     // dth/dq
@@ -306,12 +463,16 @@ class NonHolonomicPath {
 
   /**
    * Evaluate the boundary constraint values of the current path given the initial and final constraints.
-   * @param x0 The initial constraint.
+   * @param moments The integrals of the path from the initial state, which is at the origin.
    * @param xf The final constraint.
    * @return A vector representing the value of all constraints.
    */
-  Eigen::Vector4d boundaryConstraint(const State &x0, const State &xf) const {
-    State xf_g = evaluate(x0, sf); // The endpoint of the current path.
+  Eigen::Vector4d boundaryConstraint(const Moments<4>& moments, const State &xf) const {
+    using std::pow;
+    // The endpoint of the current path.
+    const State xf_g(moments.cos[0], moments.sin[0],
+        unrollAngle(a * sf + b * pow(sf, 2) / 2 + c * pow(sf, 3) / 3 + d * pow(sf, 4) / 4),
+        a + b * sf + c * pow(sf, 2) + d * pow(sf, 3));
 
     Eigen::Vector4d g = xf_g.toVector() - xf.toVector();
     g[2] = shortestAngle(xf_g.theta, xf.theta); // Deal with Angle wrap-around issues.
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <boost/optional.hpp>
+#include <boost/core/noncopyable.hpp>
+
+namespace utils {
+
+/**
+ * \brief LatestMailbox is a single-slot mailbox keeping only the latest value.
+ *
+ * A value put into the mailbox replaces the one not taken yet, so that the
+ * consumer always works on the freshest value, e.g. the latest traffic
+ * snapshot, and never on a backlog. Both \c put() and \c take() are a single
+ * atomic exchange of the slot, which is lock-free wherever \c std::atomic
+ * of a pointer is. A value is owned by whoever holds its pointer, so any
+ * number of producers and consumers may share the mailbox.
+ *
+ * The mailbox does not block, a consumer waiting for a value should
+ * sleep on its own, see \c empty().
+ */
+template<typename T>
+class LatestMailbox : private boost::noncopyable {
+
+protected:
+
+  /// The value not taken yet, \c nullptr if there is none.
+  std::atomic<T*> slot_{nullptr};
+
+public:
+
+  LatestMailbox() = default;
+
+  ~LatestMailbox() { delete slot_.exchange(nullptr); }
+
+  /**
+   * \brief Put a value into the mailbox.
+   * \return True if a value not taken yet is replaced.
+   */
+  bool put(T value) {
+    std::unique_ptr<T> replaced(
+        slot_.exchange(new T(std::move(value)), std::memory_order_acq_rel));
+    return static_cast<bool>(replaced);
+  }
+
+  /// Take the value out of the mailbox, \c boost::none if there is none.
+  boost::optional<T> take() {
+    std::unique_ptr<T> value(slot_.exchange(nullptr, std::memory_order_acq_rel));
+    if (!value) return boost::none;
+    return std::move(*value);
+  }
+
+  /// Whether there is no value to be taken.
+  bool empty() const { return slot_.load(std::memory_order_acquire) == nullptr; }
+
+}; // End class LatestMailbox.
+
+} // End namespace utils.
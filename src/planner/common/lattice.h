@@ -14,13 +14,21 @@
 
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <vector>
+#include <deque>
 #include <queue>
 #include <unordered_map>
 #include <string>
+#include <cmath>
+#include <utility>
+#include <stdexcept>
 
+#include <boost/format.hpp>
 #include <boost/smart_ptr.hpp>
 #include <boost/pointer_cast.hpp>
+#include <boost/core/noncopyable.hpp>
 
 #include <carla/client/World.h>
 #include <carla/client/Map.h>
@@ -30,19 +38,33 @@
 #include <carla/road/Lane.h>
 
 #include <router/common/router.h>
+#include <planner/common/memory_usage.h>
+#include <planner/common/fast_waypoint_map.h>
 
 namespace planner {
 
+/// Index used to indicate a missing node in a \c LatticeNodeArena.
+constexpr uint32_t kNullNodeIndex = std::numeric_limits<uint32_t>::max();
+
+template<typename Node>
+class LatticeNodeArena;
+
 /**
  * \brief LatticeNode is supposed to be the base class of all nodes
  *        to be used with the the Lattice class.
  *
  * This class provides the interface for accessing and setting the
  * nodes around a node object.
+ *
+ * The nodes are stored in a \c LatticeNodeArena. The neighbors of a node
+ * are kept as indices into the same arena, which are resolved into pointers
+ * only when they are queried through the const accessors.
  */
 template<typename Derived>
 class LatticeNode {
 
+  friend class LatticeNodeArena<Derived>;
+
 protected:
 
   using CarlaMap      = carla::client::Map;
@@ -54,24 +76,31 @@ protected:
   boost::shared_ptr<const CarlaWaypoint> waypoint_ = nullptr;
 
   /**
-   * The distance of this waypoint in the lattice.
+   * The distance of this waypoint in the lattice, relative to the
+   * origin of the arena. See \c LatticeNodeArena::origin().
    *
    * Note this is different than the \c s attribute of a carla waypoint,
    * which is the distance of the waypoint on the road it belongs to.
    */
   double distance_ = 0.0;
 
-  /// Front node.
-  boost::weak_ptr<Derived> front_;
+  /// The arena storing this node.
+  const LatticeNodeArena<Derived>* arena_ = nullptr;
 
-  /// Back node.
-  boost::weak_ptr<Derived> back_;
+  /// Index of this node in the arena.
+  uint32_t index_ = kNullNodeIndex;
 
-  /// Left node.
-  boost::weak_ptr<Derived> left_;
+  /// Index of the front node.
+  uint32_t front_ = kNullNodeIndex;
 
-  /// Right node.
-  boost::weak_ptr<Derived> right_;
+  /// Index of the back node.
+  uint32_t back_ = kNullNodeIndex;
+
+  /// Index of the left node.
+  uint32_t left_ = kNullNodeIndex;
+
+  /// Index of the right node.
+  uint32_t right_ = kNullNodeIndex;
 
 public:
 
@@ -91,6 +120,9 @@ public:
     return waypoint_->GetId();
   }
 
+  /// Get the index of the node in the arena.
+  const uint32_t index() const { return index_; }
+
   /// Get or set the pointer to the carla waypoint of the node.
   boost::shared_ptr<const CarlaWaypoint>& waypoint() {
     return waypoint_;
@@ -101,40 +133,39 @@ public:
     return boost::const_pointer_cast<const CarlaWaypoint>(waypoint_);
   }
 
-  /// Get the curvature at the node.
-  const double curvature(const boost::shared_ptr<CarlaMap>& map) const {
-    return utils::curvatureAtWaypoint(waypoint_, map);
+  /// Get the curvature at the node from the precomputed table of the map.
+  const double curvature(const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) const {
+    return fast_map->curvature(waypoint_);
   }
 
-  /// Get or set the distance of the node.
-  double& distance() { return distance_; }
+  /// Get the distance of the node.
+  const double distance() const {
+    return arena_ ? distance_ - arena_->origin() : distance_;
+  }
 
-  // Get the distance of the node.
-  const double distance() const { return distance_; }
+  /// Set the distance of the node.
+  void setDistance(const double distance) {
+    distance_ = arena_ ? distance + arena_->origin() : distance;
+  }
 
-  /** @name Accessors
+  /** @name Index Accessors
    *
-   * front(), back(), left(), right() returns reference
-   * of the boost weak pointers stored in the object, so that one can
-   * update the weak pointers directly.
+   * frontIndex(), backIndex(), leftIndex(), rightIndex() returns the
+   * indices of the neighbor nodes in the arena, so that one can update
+   * the connections directly. \c kNullNodeIndex indicates there is no
+   * such neighbor.
    */
   /// @{
 
-  boost::weak_ptr<Derived>& front() {
-    return front_;
-  }
-
-  boost::weak_ptr<Derived>& back() {
-    return back_;
-  }
-
-  boost::weak_ptr<Derived>& left() {
-    return left_;
-  }
+  uint32_t& frontIndex() { return front_; }
+  uint32_t& backIndex()  { return back_; }
+  uint32_t& leftIndex()  { return left_; }
+  uint32_t& rightIndex() { return right_; }
 
-  boost::weak_ptr<Derived>& right() {
-    return right_;
-  }
+  const uint32_t frontIndex() const { return front_; }
+  const uint32_t backIndex()  const { return back_; }
+  const uint32_t leftIndex()  const { return left_; }
+  const uint32_t rightIndex() const { return right_; }
 
   /// @}
 
@@ -145,25 +176,250 @@ public:
    */
   /// @{
 
-  boost::shared_ptr<const Derived> front() const {
-    return boost::const_pointer_cast<const Derived>(front_.lock());
+  boost::shared_ptr<const Derived> front() const { return arena_->node(front_); }
+  boost::shared_ptr<const Derived> back()  const { return arena_->node(back_); }
+  boost::shared_ptr<const Derived> left()  const { return arena_->node(left_); }
+  boost::shared_ptr<const Derived> right() const { return arena_->node(right_); }
+
+  /// @}
+
+}; // End class LatticeNode.
+
+/**
+ * \brief LatticeNodeArena owns all the nodes of a lattice.
+ *
+ * The nodes are stored in chunks of contiguous memory, and are referred
+ * to by their indices in the arena. The slots of the removed nodes are
+ * recycled when new nodes are added.
+ *
+ * The arena is always managed by a shared pointer. Nodes handed out to the
+ * users of a lattice are aliasing shared pointers of the arena. They are
+ * valid as long as the corresponding nodes are not removed from the lattice.
+ *
+ * The distances of the nodes are stored relative to a moving origin. When
+ * the lattice is shortened from the back, only the origin is moved forward,
+ * instead of updating the distances of all the remaining nodes.
+ *
+ * \note \c std::deque is used instead of \c std::vector, since the existing
+ *       nodes are never relocated when new nodes are appended. Otherwise,
+ *       the node pointers held by the users would be invalidated every time
+ *       the lattice is extended.
+ */
+template<typename Node>
+class LatticeNodeArena :
+  public boost::enable_shared_from_this<LatticeNodeArena<Node>>,
+  private boost::noncopyable {
+
+protected:
+
+  using CarlaWaypoint = carla::client::Waypoint;
+
+protected:
+
+  /// Storage of the nodes.
+  std::deque<Node> nodes_;
+
+  /// Slots in \c nodes_ which are not used by any node.
+  std::vector<uint32_t> free_slots_;
+
+  /// The stored distance of a node which is reported as distance 0.
+  double origin_ = 0.0;
+
+public:
+
+  LatticeNodeArena() = default;
+
+  /**
+   * \brief Create a deep copy of the arena.
+   *
+   * Since the connections between nodes are indices, no redirection of
+   * the neighbor nodes is required.
+   */
+  boost::shared_ptr<LatticeNodeArena> clone() const {
+    boost::shared_ptr<LatticeNodeArena> arena = boost::make_shared<LatticeNodeArena>();
+    arena->nodes_ = nodes_;
+    arena->free_slots_ = free_slots_;
+    arena->origin_ = origin_;
+    for (auto& node : arena->nodes_) node.arena_ = arena.get();
+    return arena;
+  }
+
+  /// Number of nodes in the arena.
+  const size_t size() const { return nodes_.size() - free_slots_.size(); }
+
+  /// The origin of the node distances.
+  const double origin() const { return origin_; }
+
+  /// Approximate number of bytes used by the arena.
+  const size_t memoryUsage() const {
+    return sizeof(*this) + utils::memoryUsage(nodes_) + utils::memoryUsage(free_slots_);
+  }
+
+  /// Move the origin of the node distances forward, i.e. the distances of
+  /// all nodes are reduced by \c distance.
+  void shiftOrigin(const double distance) { origin_ += distance; }
+
+  /**
+   * \brief Add a new node to the arena.
+   * \param[in] waypoint The carla waypoint of the new node.
+   * \return The index of the new node.
+   */
+  uint32_t allocate(const boost::shared_ptr<const CarlaWaypoint>& waypoint) {
+    uint32_t index = kNullNodeIndex;
+    if (!free_slots_.empty()) {
+      index = free_slots_.back();
+      free_slots_.pop_back();
+      nodes_[index] = Node(waypoint);
+    } else {
+      index = static_cast<uint32_t>(nodes_.size());
+      nodes_.emplace_back(waypoint);
+    }
+
+    nodes_[index].arena_ = this;
+    nodes_[index].index_ = index;
+    return index;
   }
 
-  boost::shared_ptr<const Derived> back() const {
-    return boost::const_pointer_cast<const Derived>(back_.lock());
+  /**
+   * \brief Remove a node from the arena.
+   * \param[in] index The index of the node to be removed.
+   */
+  void release(const uint32_t index) {
+    nodes_[index] = Node();
+    free_slots_.push_back(index);
+    return;
   }
 
-  boost::shared_ptr<const Derived> left() const {
-    return boost::const_pointer_cast<const Derived>(left_.lock());
+  /// Access the node at the given index.
+  Node& operator[](const uint32_t index) { return nodes_[index]; }
+  const Node& operator[](const uint32_t index) const { return nodes_[index]; }
+
+  /// Get the node at the given index, \c nullptr if the index is \c kNullNodeIndex.
+  boost::shared_ptr<Node> node(const uint32_t index) {
+    if (index == kNullNodeIndex) return nullptr;
+    return boost::shared_ptr<Node>(this->shared_from_this(), &nodes_[index]);
   }
 
-  boost::shared_ptr<const Derived> right() const {
-    return boost::const_pointer_cast<const Derived>(right_.lock());
+  /// Get the node at the given index, \c nullptr if the index is \c kNullNodeIndex.
+  boost::shared_ptr<const Node> node(const uint32_t index) const {
+    if (index == kNullNodeIndex) return nullptr;
+    return boost::shared_ptr<const Node>(this->shared_from_this(), &nodes_[index]);
   }
 
-  /// @}
+}; // End class LatticeNodeArena.
+
+/**
+ * \brief LatticeResolution defines the longitudinal resolution of a lattice,
+ *        i.e. the distance between two connected nodes on the same lane,
+ *        as a function of the distance of the nodes on the lattice.
+ *
+ * The resolution is kept as a sequence of levels. Each level starts at a
+ * distance, and applies up to the start of the next level. The resolution
+ * is the finest at the start of the lattice, and coarser further ahead,
+ * where the planners do not need as many nodes.
+ *
+ * The resolutions of all levels are required to be multiples of the finest
+ * one. Therefore, the nodes of a coarse level are always at the distances
+ * the nodes of the finer levels would be at, and the nodes on the adjacent
+ * lanes, which share the same distances, are still left and right to each
+ * other.
+ */
+class LatticeResolution {
+
+protected:
+
+  /// Levels of the resolution sorted by the distance, each as
+  /// the start distance of the level and the resolution of the level.
+  std::vector<std::pair<double, double>> levels_;
 
-}; // End class WaypointNode.
+public:
+
+  /**
+   * \brief Construct a uniform resolution over the whole lattice.
+   * \param[in] resolution The distance between two connected nodes.
+   */
+  LatticeResolution(const double resolution = 1.0) :
+    levels_(1, std::make_pair(0.0, resolution)) {
+    if (resolution <= 0.0) {
+      std::string error_msg = (boost::format(
+            "LatticeResolution::LatticeResolution(): "
+            "resolution [%1%] <= 0.0.\n") % resolution).str();
+      throw std::runtime_error(error_msg);
+    }
+  }
+
+  /**
+   * \brief Construct a multi-resolution lattice.
+   * \param[in] levels The start distance and the resolution of each level.
+   *                   The first level should start at 0.0, and the levels
+   *                   should be sorted by their start distances.
+   */
+  LatticeResolution(const std::vector<std::pair<double, double>>& levels) :
+    levels_(levels) {
+
+    if (levels_.empty() || levels_.front().first != 0.0) {
+      throw std::runtime_error(
+          "LatticeResolution::LatticeResolution(): "
+          "the first level should start at 0.0.\n");
+    }
+
+    for (size_t i = 0; i < levels_.size(); ++i) {
+      const double resolution = levels_[i].second;
+      const double ratio = resolution / levels_.front().second;
+
+      if (resolution <= 0.0 || std::fabs(ratio-std::round(ratio)) > 1.0e-6) {
+        std::string error_msg = (boost::format(
+              "LatticeResolution::LatticeResolution(): "
+              "resolution [%1%] of level %2% is not a positive multiple of %3%.\n")
+            % resolution % i % levels_.front().second).str();
+        throw std::runtime_error(error_msg);
+      }
+
+      if (i == 0) continue;
+      if (levels_[i].first <= levels_[i-1].first || resolution < levels_[i-1].second) {
+        std::string error_msg = (boost::format(
+              "LatticeResolution::LatticeResolution(): "
+              "level %1% [%2%, %3%] does not follow a closer and finer level.\n")
+            % i % levels_[i].first % resolution).str();
+        throw std::runtime_error(error_msg);
+      }
+    }
+  }
+
+  /// Get the levels of the resolution.
+  const std::vector<std::pair<double, double>>& levels() const { return levels_; }
+
+  /// Whether the resolution is the same over the whole lattice.
+  const bool uniform() const { return levels_.size() == 1; }
+
+  /// The resolution at the start of the lattice.
+  const double finest() const { return levels_.front().second; }
+
+  /// The resolution of the last level.
+  const double coarsest() const { return levels_.back().second; }
+
+  /// The distance beyond which the resolution is the coarsest.
+  const double coarsestDistance() const { return levels_.back().first; }
+
+  /// The resolution at the given distance on the lattice.
+  const double at(const double distance) const {
+    for (auto level = levels_.rbegin(); level != levels_.rend(); ++level) {
+      if (distance >= level->first) return level->second;
+    }
+    return levels_.front().second;
+  }
+
+  /// Get the string describing the resolution.
+  std::string string(const std::string& prefix="") const {
+    std::string msg = prefix;
+    for (const auto& level : levels_) {
+      msg += (boost::format("resolution %1% beyond distance %2%.\n")
+          % level.second % level.first).str();
+    }
+    return msg;
+  }
+
+}; // End class LatticeResolution.
 
 /**
  * \brief Lattice is a 2-D graph compliant to the road structure.
@@ -192,14 +448,19 @@ protected:
   /// Router used to query the roads and front waypoints.
   boost::shared_ptr<router::Router> router_;
 
+  /// Arena storing all nodes of the lattice.
+  boost::shared_ptr<LatticeNodeArena<Node>> arena_ =
+    boost::make_shared<LatticeNodeArena<Node>>();
+
   /// Entry nodes of the lattice (nodes that do not have back nodes).
-  std::vector<boost::weak_ptr<Node>> lattice_entries_;
+  std::vector<uint32_t> lattice_entries_;
 
   /// Exit nodes of the lattice (nodes that do not have front nodes).
-  std::vector<boost::weak_ptr<Node>> lattice_exits_;
+  std::vector<uint32_t> lattice_exits_;
 
-  /// A mapping from carla waypoint ID to the corresponding node in the lattice.
-  std::unordered_map<size_t, boost::shared_ptr<Node>> waypoint_to_node_table_;
+  /// A mapping from carla waypoint ID to the index of the corresponding
+  /// node in the arena.
+  std::unordered_map<size_t, uint32_t> waypoint_to_node_table_;
 
   /**
    * A mapping from road+lane IDs to the carla waypoint IDs on this road+lane.
@@ -208,12 +469,15 @@ protected:
    *
    * For each element in the map, the key is the hash value combining the road
    * ID and the lane ID, the value is the waypoints on this road and lane.
+   * Since the lattice is extended at the front and shortened at the back,
+   * the waypoints of a lane are kept in a ring buffer, where new waypoints
+   * are pushed at the back and the removed ones are usually at the front.
    */
-  std::unordered_map<size_t, std::vector<size_t>> roadlane_to_waypoints_table_;
+  std::unordered_map<size_t, std::deque<size_t>> roadlane_to_waypoints_table_;
 
   /// Range resolution (distance between two connected nodes) in the
-  /// longitudinal direction.
-  double longitudinal_resolution_;
+  /// longitudinal direction, which may be coarser further ahead.
+  LatticeResolution resolution_;
 
 public:
 
@@ -222,16 +486,23 @@ public:
    *
    * \param[in] start The starting point of the lattice.
    * \param[in] range The desired range of the lattice.
-   * \param[in] longitudinal_resolution
+   * \param[in] resolution
    *            The distance between two consecutive nodes of the lattice on the same lane.
+   *            A single value results in a uniform lattice.
    * \param[in] router Used to tell roads and waypoints.
    */
   Lattice(const boost::shared_ptr<const CarlaWaypoint>& start,
           const double range,
-          const double longitudinal_resolution,
+          const LatticeResolution& resolution,
           const boost::shared_ptr<router::Router>& router);
 
-  /// Copy constructor.
+  /**
+   * \brief Copy constructor.
+   *
+   * Since the nodes are connected through indices, copying the lattice
+   * only requires copying the arena and the tables, without redirecting
+   * any of the node connections.
+   */
   Lattice(const Lattice& other);
 
   /// Copy assignment operator.
@@ -240,19 +511,31 @@ public:
     return *this;
   }
 
-  const double longitudinalResolution() const { return longitudinal_resolution_; }
+  /// Get the finest longitudinal resolution, i.e. the one at the start of the lattice.
+  const double longitudinalResolution() const { return resolution_.finest(); }
+
+  /// Get the longitudinal resolution at the given distance on the lattice.
+  const double longitudinalResolution(const double distance) const {
+    return resolution_.at(distance);
+  }
+
+  /// Get the levels of the longitudinal resolution.
+  const LatticeResolution& resolution() const { return resolution_; }
+
+  /// Get the router used to find the front waypoints.
+  const boost::shared_ptr<router::Router>& router() const { return router_; }
 
   /// Get the entry nodes of the lattice.
   std::vector<boost::shared_ptr<const Node>> latticeEntries() const {
     std::vector<boost::shared_ptr<const Node>> output;
-    for (const auto& node : lattice_entries_) output.push_back(node.lock());
+    for (const uint32_t node : lattice_entries_) output.push_back(arena_->node(node));
     return output;
   }
 
   /// Get the exit nodes of the lattice.
   std::vector<boost::shared_ptr<const Node>> latticeExits() const {
     std::vector<boost::shared_ptr<const Node>> output;
-    for (const auto& node : lattice_exits_) output.push_back(node.lock());
+    for (const uint32_t node : lattice_exits_) output.push_back(arena_->node(node));
     return output;
   }
 
@@ -274,6 +557,14 @@ public:
    */
   double range() const;
 
+  /**
+   * \brief Approximate number of bytes used by the lattice.
+   *
+   * The carla waypoints are not counted, since they are shared with
+   * the fast waypoint map and the other lattices.
+   */
+  const size_t memoryUsage() const;
+
   /**
    * \brief Extend the range of the lattice.
    *
@@ -288,7 +579,8 @@ public:
   /**
    * \brief Shorten the range of the current lattice.
    *
-   * The lattice will always be shortened from the back.
+   * The lattice will always be shortened from the back. The nodes moved
+   * into a finer level of the resolution are refined, see \c refine().
    *
    * \param[in] range The new range of the lattice. If this is more than
    *                  the current range, no operation is performed.
@@ -300,6 +592,11 @@ public:
    *
    * The forward direction is defined by the road sequence in the router.
    *
+   * Only the nodes added at the front and removed at the back are visited.
+   * The slots of the removed nodes are recycled for the new ones, and the
+   * distances of the untouched nodes are updated by moving the origin of
+   * the arena.
+   *
    * \param[in] movement How much distance to shift the lattice forward.
    */
   void shift(const double movement) {
@@ -325,9 +622,7 @@ public:
   boost::shared_ptr<const Node> closestNode(
       const boost::shared_ptr<const CarlaWaypoint>& waypoint,
       const double tolerance) const {
-
-    Lattice* unconst_this = const_cast<Lattice*>(this);
-    return unconst_this->closestNode(waypoint, tolerance);
+    return arena_->node(closestNodeIndex(waypoint, tolerance));
   }
 
   /**
@@ -428,22 +723,29 @@ protected:
   /**
    * \brief Add new element to the \c waypoint_to_node_ table.
    * \param[in] waypoint_id The id of the carla waypoint.
-   * \param[in] node The node corresponding to the waypoint.
+   * \param[in] node The index of the node corresponding to the waypoint.
    */
   void augmentWaypointToNodeTable(
       const size_t waypoint_id,
-      const boost::shared_ptr<Node>& node) {
+      const uint32_t node) {
     waypoint_to_node_table_[waypoint_id] = node;
     return;
   }
 
   /**
    * \brief Remove a node from the \c waypoint_to_node table.
+   *
+   * The node is also released from the arena.
+   *
    * \param[in] waypoint_id The ID of the waypoint contained within
    *                        the node to be removed.
    */
   void reduceWaypointToNodeTable(const size_t waypoint_id) {
-    waypoint_to_node_table_.erase(waypoint_id);
+    typename std::unordered_map<size_t, uint32_t>::iterator iter =
+      waypoint_to_node_table_.find(waypoint_id);
+    if (iter == waypoint_to_node_table_.end()) return;
+    arena_->release(iter->second);
+    waypoint_to_node_table_.erase(iter);
     return;
   }
 
@@ -476,11 +778,35 @@ protected:
    */
   boost::shared_ptr<Node> closestNode(
       const boost::shared_ptr<const CarlaWaypoint>& waypoint,
-      const double tolerance);
+      const double tolerance) {
+    return arena_->node(closestNodeIndex(waypoint, tolerance));
+  }
+
+  /**
+   * \brief Same as \c closestNode(), but returns the index of the node.
+   * \return The index of the closest node, or \c kNullNodeIndex if such
+   *         node cannot be found.
+   */
+  uint32_t closestNodeIndex(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+      const double tolerance) const;
 
   /// Find the entry and exit nodes on the lattice.
   void findLatticeEntriesAndExits();
 
+  /**
+   * \brief Update the entry and exit nodes on the lattice, assuming
+   *        only the given nodes, together with the current entries and
+   *        exits, may have changed.
+   *
+   * Different from \c findLatticeEntriesAndExits(), the function does not
+   * go through all nodes on the lattice.
+   *
+   * \param[in] candidates Indices of the nodes which are new or whose
+   *                       connections have changed.
+   */
+  void updateLatticeEntriesAndExits(const std::vector<uint32_t>& candidates);
+
   /**
    * \brief Find the front waypoint of the query waypoint.
    * \param[in] waypoint The query waypoint.
@@ -495,62 +821,99 @@ protected:
   /// Find the left waypoint of the query one.
   boost::shared_ptr<CarlaWaypoint> findLeftWaypoint(
       const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
-    return waypoint->GetLeft();
+    return router_->leftWaypoint(waypoint);
   }
 
   /// Find the right waypoint of the query one.
   boost::shared_ptr<CarlaWaypoint> findRightWaypoint(
       const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
-    return waypoint->GetRight();
+    return router_->rightWaypoint(waypoint);
+  }
+
+  /**
+   * \brief Find where the lattice should start.
+   *
+   * If the router has sampled the route in advance, the lattice is started
+   * at the sampled waypoint right before the requested start, and the range
+   * is extended accordingly. The nodes of all lattices are then on the same
+   * sampled waypoints, whose front, left, and right waypoints are looked up
+   * by the router without querying the map.
+   *
+   * \param[in] start The requested start of the lattice.
+   * \param[in,out] range The range of the lattice.
+   * \return The start of the lattice.
+   */
+  boost::shared_ptr<const CarlaWaypoint> latticeStart(
+      const boost::shared_ptr<const CarlaWaypoint>& start, double& range) const {
+    boost::optional<std::pair<boost::shared_ptr<CarlaWaypoint>, double>> sampled =
+      router_->latticeStartWaypoint(start, resolution_.finest());
+    if (!sampled) return start;
+    range += sampled->second;
+    return sampled->first;
   }
 
+  /**
+   * \brief Explore the nodes in the queue and the new nodes found from them,
+   *        adding their front, left, and right nodes to the lattice.
+   *
+   * \param[in] range The range of the lattice.
+   * \param[in,out] nodes_queue The nodes to be explored.
+   * \param[out] explored_nodes All the nodes that have been explored are appended.
+   */
+  void explore(const double range,
+               std::queue<uint32_t>& nodes_queue,
+               std::vector<uint32_t>& explored_nodes);
+
+  /**
+   * \brief Insert nodes between the nodes whose spacing is coarser than
+   *        the resolution at their distances.
+   *
+   * This happens once the lattice is shortened, where the nodes created in
+   * a coarse level are moved into a finer one. Only the nodes before the
+   * coarsest level are visited. The inserted nodes are connected to the ones
+   * inserted on the adjacent lanes at the same distances.
+   */
+  void refine();
+
   /**
    * \brief Extend the lattice in the forward direction.
    *
-   * Used by \c extend() function.
+   * Used by \c extend() function. The front node is found at the
+   * resolution of the distance of the given node.
    *
-   * \param[in] node The node of which a front node is added to the lattice.
+   * \param[in] node The index of the node of which a front node is added to the lattice.
    * \param[in] range The range of the lattice.
    * \param[out] nodes_queue If the distance of the front node is within range
    *                         the lattice, and this front node is actually a new
    *                         node, it will be pushed into this queue.
    */
-  void extendFront(const boost::shared_ptr<Node>& node,
+  void extendFront(const uint32_t node,
                    const double range,
-                   std::queue<boost::shared_ptr<Node>>& nodes_queue);
+                   std::queue<uint32_t>& nodes_queue);
 
   /**
    * \brief Extend the lattice to the left.
    *
    * Used by \c extend() function.
    *
-   * \param[in] node The node of which a left node is added to the lattice.
+   * \param[in] node The index of the node of which a left node is added to the lattice.
    * \param[out] nodes_queue If the found left node is new, it will be pushed
    *                         into this queue.
    */
-  void extendLeft(const boost::shared_ptr<Node>& node,
-                  std::queue<boost::shared_ptr<Node>>& nodes_queue);
+  void extendLeft(const uint32_t node,
+                  std::queue<uint32_t>& nodes_queue);
 
   /**
    * \brief Extend the lattice to the right.
    *
    * Used by \c extend() function.
    *
-   * \param[in] node The node of which a right node is added to the lattice.
+   * \param[in] node The index of the node of which a right node is added to the lattice.
    * \param[out] nodes_queue If the found right node is new, it will be pushed
    *                         into this queue.
    */
-  void extendRight(const boost::shared_ptr<Node>& node,
-                   std::queue<boost::shared_ptr<Node>>& nodes_queue);
-
-  /**
-   * \brief Update the distance of all nodes.
-   *
-   * This function is only used by the \c shorten() function. After which,
-   * the distance of the nodes requires to be updated. After updating, the
-   * minimum distance of all nodes is always 0.
-   */
-  void updateNodeDistance();
+  void extendRight(const uint32_t node,
+                   std::queue<uint32_t>& nodes_queue);
 
 }; // End class Lattice.
 } // End namespace planner.
@@ -23,6 +23,7 @@
 #include <boost/format.hpp>
 
 #include <planner/common/lattice.h>
+#include <planner/common/profiler.h>
 
 namespace planner {
 
@@ -30,30 +31,34 @@ template<typename Node>
 Lattice<Node>::Lattice(
   const boost::shared_ptr<const CarlaWaypoint>& start,
   const double range,
-  const double longitudinal_resolution,
+  const LatticeResolution& resolution,
   const boost::shared_ptr<router::Router>& router) :
     router_(router),
-    longitudinal_resolution_(longitudinal_resolution) {
+    resolution_(resolution) {
 
-  if (range <= longitudinal_resolution_) {
+  if (range <= resolution_.finest()) {
     std::string error_msg = (boost::format(
             "Lattice::Lattice(): "
             "range [%1%] < longitudinal resolution [%2%].\n")
           % range
-          % longitudinal_resolution).str();
+          % resolution_.finest()).str();
     throw std::runtime_error(error_msg);
   }
 
   // Create the start node.
-  boost::shared_ptr<Node> start_node = boost::make_shared<Node>(start);
-  start_node->distance() = 0.0;
+  double lattice_range = range;
+  const boost::shared_ptr<const CarlaWaypoint> lattice_start =
+    latticeStart(start, lattice_range);
+
+  const uint32_t start_node = arena_->allocate(lattice_start);
+  (*arena_)[start_node].setDistance(0.0);
   lattice_exits_.push_back(start_node);
 
-  augmentWaypointToNodeTable(start->GetId(), start_node);
-  augmentRoadlaneToWaypointsTable(start);
+  augmentWaypointToNodeTable(lattice_start->GetId(), start_node);
+  augmentRoadlaneToWaypointsTable(lattice_start);
 
   // Construct the lattice.
-  extend(range);
+  extend(lattice_range);
 
   return;
 }
@@ -61,55 +66,22 @@ Lattice<Node>::Lattice(
 template<typename Node>
 Lattice<Node>::Lattice(const Lattice<Node>& other) :
   router_(other.router_),
+  arena_(other.arena_->clone()),
   lattice_entries_(other.lattice_entries_),
   lattice_exits_(other.lattice_exits_),
+  waypoint_to_node_table_(other.waypoint_to_node_table_),
   roadlane_to_waypoints_table_(other.roadlane_to_waypoints_table_),
-  longitudinal_resolution_(other.longitudinal_resolution_) {
-
-  // Copy the \c waypoint_to_node_table_. Make sure this object
-  // owns its own copy of the nodes pointed by shared pointers.
-  for (const auto& item : other.waypoint_to_node_table_) {
-    waypoint_to_node_table_[item.first] = boost::make_shared<Node>(*(item.second));
-  }
-
-  // For each node in the table, make sure the connected nodes are pointing
-  // to the copy stored within this object.
-  for (auto& item : waypoint_to_node_table_) {
-    if (item.second->front().lock()) {
-      const size_t front_node = item.second->front().lock()->waypoint()->GetId();
-      item.second->front() = waypoint_to_node_table_[front_node];
-    }
-    if (item.second->back().lock()) {
-      const size_t back_node = item.second->back().lock()->waypoint()->GetId();
-      item.second->back() = waypoint_to_node_table_[back_node];
-    }
-    if (item.second->left().lock()) {
-      const size_t left_node = item.second->left().lock()->waypoint()->GetId();
-      item.second->left() = waypoint_to_node_table_[left_node];
-    }
-    if (item.second->right().lock()) {
-      const size_t right_node = item.second->right().lock()->waypoint()->GetId();
-      item.second->right() = waypoint_to_node_table_[right_node];
-    }
-  }
-
-  // Redirect the entry and exit pointers.
-  for (auto& entry : lattice_entries_)
-    entry = waypoint_to_node_table_[entry.lock()->waypoint()->GetId()];
-  for (auto& exit : lattice_exits_)
-    exit = waypoint_to_node_table_[exit.lock()->waypoint()->GetId()];
-
-  return;
-}
+  resolution_(other.resolution_) {}
 
 template<typename Node>
 void Lattice<Node>::swap(Lattice<Node>& other) {
 
+  std::swap(arena_, other.arena_);
   std::swap(lattice_entries_, other.lattice_entries_);
   std::swap(lattice_exits_, other.lattice_exits_);
   std::swap(waypoint_to_node_table_, other.waypoint_to_node_table_);
   std::swap(roadlane_to_waypoints_table_, other.roadlane_to_waypoints_table_);
-  std::swap(longitudinal_resolution_, other.longitudinal_resolution_);
+  std::swap(resolution_, other.resolution_);
   std::swap(router_, other.router_);
 
   return;
@@ -124,11 +96,6 @@ void Lattice<Node>::augmentRoadlaneToWaypointsTable(
   size_t roadlane_id = 0;
   utils::hashCombine(roadlane_id, waypoint->GetRoadId(), waypoint->GetLaneId());
 
-  // Initialize this entry in the table.
-  if (roadlane_to_waypoints_table_.find(roadlane_id) ==
-      roadlane_to_waypoints_table_.end())
-    roadlane_to_waypoints_table_[roadlane_id] = std::vector<size_t>();
-
   // Add the waypoint ID to this road+lane.
   roadlane_to_waypoints_table_[roadlane_id].push_back(waypoint->GetId());
   return;
@@ -141,17 +108,26 @@ void Lattice<Node>::reduceRoadlaneToWaypointsTable(
   size_t roadlane_id = 0;
   utils::hashCombine(roadlane_id, waypoint->GetRoadId(), waypoint->GetLaneId());
 
-  if (roadlane_to_waypoints_table_.find(roadlane_id) !=
-      roadlane_to_waypoints_table_.end()) {
-    std::vector<size_t>& waypoints = roadlane_to_waypoints_table_[roadlane_id];
-    std::vector<size_t>::iterator end_iter = std::remove_if(
+  auto roadlane_iter = roadlane_to_waypoints_table_.find(roadlane_id);
+  if (roadlane_iter == roadlane_to_waypoints_table_.end()) return;
+  std::deque<size_t>& waypoints = roadlane_iter->second;
+
+  // The lattice is shortened from the back, where the oldest waypoints of
+  // the lane are. Only search through the lane if this is not the case.
+  if (!waypoints.empty() && waypoints.front() == waypoint->GetId()) {
+    waypoints.pop_front();
+  } else if (!waypoints.empty() && waypoints.back() == waypoint->GetId()) {
+    waypoints.pop_back();
+  } else {
+    std::deque<size_t>::iterator end_iter = std::remove_if(
         waypoints.begin(), waypoints.end(),
         [&waypoint](const size_t id)->bool{
           return (id == waypoint->GetId());
         });
-
     waypoints.erase(end_iter, waypoints.end());
   }
+
+  if (waypoints.empty()) roadlane_to_waypoints_table_.erase(roadlane_iter);
   return;
 }
 
@@ -161,7 +137,7 @@ std::unordered_map<size_t, boost::shared_ptr<const Node>>
 
   std::unordered_map<size_t, boost::shared_ptr<const Node>> nodes;
   for (const auto& item : waypoint_to_node_table_)
-    nodes[item.first] = item.second;
+    nodes[item.first] = arena_->node(item.second);
 
   return nodes;
 }
@@ -173,27 +149,23 @@ std::vector<std::pair<size_t, size_t>>
   std::vector<std::pair<size_t, size_t>> edges;
 
   for (const auto& item : waypoint_to_node_table_) {
-    const boost::shared_ptr<const Node> this_node = item.second;
+    const Node& this_node = (*arena_)[item.second];
 
-    if (this_node->front())
+    if (this_node.frontIndex() != kNullNodeIndex)
       edges.push_back(std::make_pair(
-            this_node->waypoint()->GetId(),
-            this_node->front()->waypoint()->GetId()));
+            this_node.id(), (*arena_)[this_node.frontIndex()].id()));
 
-    if (this_node->left())
+    if (this_node.leftIndex() != kNullNodeIndex)
       edges.push_back(std::make_pair(
-            this_node->waypoint()->GetId(),
-            this_node->left()->waypoint()->GetId()));
+            this_node.id(), (*arena_)[this_node.leftIndex()].id()));
 
-    if (this_node->right())
+    if (this_node.rightIndex() != kNullNodeIndex)
       edges.push_back(std::make_pair(
-            this_node->waypoint()->GetId(),
-            this_node->right()->waypoint()->GetId()));
+            this_node.id(), (*arena_)[this_node.rightIndex()].id()));
 
-    if (this_node->back())
+    if (this_node.backIndex() != kNullNodeIndex)
       edges.push_back(std::make_pair(
-            this_node->waypoint()->GetId(),
-            this_node->back()->waypoint()->GetId()));
+            this_node.id(), (*arena_)[this_node.backIndex()].id()));
   }
 
   return edges;
@@ -207,20 +179,33 @@ double Lattice<Node>::range() const {
   double entry_distance = std::numeric_limits<double>::max();
   double exit_distance = 0.0;
 
-  for (const auto& entry : lattice_entries_) {
-    if (entry.lock()->distance() < entry_distance)
-      entry_distance = entry.lock()->distance();
+  for (const uint32_t entry : lattice_entries_) {
+    if ((*arena_)[entry].distance() < entry_distance)
+      entry_distance = (*arena_)[entry].distance();
   }
-  for (const auto& exit : lattice_exits_) {
-    if (exit.lock()->distance() > exit_distance)
-      exit_distance = exit.lock()->distance();
+  for (const uint32_t exit : lattice_exits_) {
+    if ((*arena_)[exit].distance() > exit_distance)
+      exit_distance = (*arena_)[exit].distance();
   }
 
   return exit_distance - entry_distance;
 }
 
+template<typename Node>
+const size_t Lattice<Node>::memoryUsage() const {
+  size_t bytes = sizeof(*this) + arena_->memoryUsage();
+  bytes += utils::memoryUsage(lattice_entries_);
+  bytes += utils::memoryUsage(lattice_exits_);
+  bytes += utils::memoryUsage(waypoint_to_node_table_);
+  bytes += utils::memoryUsage(roadlane_to_waypoints_table_);
+  for (const auto& waypoints : roadlane_to_waypoints_table_)
+    bytes += utils::memoryUsage(waypoints.second);
+  return bytes;
+}
+
 template<typename Node>
 void Lattice<Node>::extend(double range) {
+  CLP_PROFILE_SCOPE("Lattice::extend");
 
   if (range <= 0.0) {
     std::string error_msg = (boost::format(
@@ -237,22 +222,37 @@ void Lattice<Node>::extend(double range) {
 
   // A queue of nodes to be explored.
   // The queue is started from the lattice exits.
-  std::queue<boost::shared_ptr<Node>> nodes_queue;
-  for (auto& exit : lattice_exits_) nodes_queue.push(exit.lock());
+  std::queue<uint32_t> nodes_queue;
+  for (const uint32_t exit : lattice_exits_) nodes_queue.push(exit);
+
+  // All the explored nodes, which are the only ones whose
+  // connections may be changed.
+  std::vector<uint32_t> explored_nodes;
+  explore(range, nodes_queue, explored_nodes);
+
+  // Update lattice entries and exits.
+  updateLatticeEntriesAndExits(explored_nodes);
+
+  return;
+}
+
+template<typename Node>
+void Lattice<Node>::explore(
+    const double range,
+    std::queue<uint32_t>& nodes_queue,
+    std::vector<uint32_t>& explored_nodes) {
 
   while (!nodes_queue.empty()) {
     // Get the next node to explore and remove it from the queue.
-    boost::shared_ptr<Node> node = nodes_queue.front();
+    const uint32_t node = nodes_queue.front();
     nodes_queue.pop();
+    explored_nodes.push_back(node);
 
     extendFront(node, range, nodes_queue);
     extendLeft(node, nodes_queue);
     extendRight(node, nodes_queue);
   }
 
-  // Update lattice entries and exits.
-  findLatticeEntriesAndExits();
-
   return;
 }
 
@@ -277,179 +277,202 @@ void Lattice<Node>::shorten(double range) {
   // Save the ids for the waypoint to be removed.
   std::unordered_set<size_t> removed_waypoint_ids;
   // Save the nodes to be processed.
-  std::queue<boost::shared_ptr<Node>> nodes_queue;
+  std::queue<uint32_t> nodes_queue;
 
-  for (auto& entry : lattice_entries_) {
-    if (entry.lock()->distance() >= safe_distance) continue;
-    removed_waypoint_ids.insert(entry.lock()->waypoint()->GetId());
-    nodes_queue.push(entry.lock());
+  for (const uint32_t entry : lattice_entries_) {
+    if ((*arena_)[entry].distance() >= safe_distance) continue;
+    removed_waypoint_ids.insert((*arena_)[entry].id());
+    nodes_queue.push(entry);
   }
 
+  // Add the given neighbor node to the queue if it is not recorded yet.
+  auto addNeighbor = [this, &removed_waypoint_ids, &nodes_queue](
+      const uint32_t neighbor)->void{
+    if (neighbor == kNullNodeIndex) return;
+    const size_t neighbor_id = (*arena_)[neighbor].id();
+    if (removed_waypoint_ids.count(neighbor_id) != 0) return;
+    removed_waypoint_ids.insert(neighbor_id);
+    nodes_queue.push(neighbor);
+  };
+
   while (!nodes_queue.empty()) {
     // Get the next node to be processed.
-    boost::shared_ptr<Node> node = nodes_queue.front();
+    const Node& node = (*arena_)[nodes_queue.front()];
     nodes_queue.pop();
 
-    // Add the left node.
-    if (node->left().lock()) {
-      boost::shared_ptr<Node> left_node = node->left().lock();
-      if (removed_waypoint_ids.count(left_node->waypoint()->GetId()) == 0) {
-        removed_waypoint_ids.insert(left_node->waypoint()->GetId());
-        nodes_queue.push(left_node);
-      }
-    }
-
-    // Add the right node.
-    if (node->right().lock()) {
-      boost::shared_ptr<Node> right_node = node->right().lock();
-      if (removed_waypoint_ids.count(right_node->waypoint()->GetId()) == 0) {
-        removed_waypoint_ids.insert(right_node->waypoint()->GetId());
-        nodes_queue.push(right_node);
-      }
-    }
-
-    // Add the back node.
-    if (node->back().lock()) {
-      boost::shared_ptr<Node> back_node = node->back().lock();
-      if (removed_waypoint_ids.count(back_node->waypoint()->GetId()) == 0) {
-        removed_waypoint_ids.insert(back_node->waypoint()->GetId());
-        nodes_queue.push(back_node);
-      }
-    }
+    // Add the left, right, and back nodes.
+    addNeighbor(node.leftIndex());
+    addNeighbor(node.rightIndex());
+    addNeighbor(node.backIndex());
 
     // Some special care is required for the front node.
     // We need to determine when to stop.
-    if (node->front().lock()) {
-      boost::shared_ptr<Node> front_node = node->front().lock();
-      if (front_node->distance() < safe_distance &&
-          removed_waypoint_ids.count(front_node->waypoint()->GetId()) == 0) {
-        removed_waypoint_ids.insert(front_node->waypoint()->GetId());
-        nodes_queue.push(front_node);
-      }
+    if (node.frontIndex() != kNullNodeIndex &&
+        (*arena_)[node.frontIndex()].distance() < safe_distance)
+      addNeighbor(node.frontIndex());
+  }
+
+  // Disconnect the remaining nodes from the removed ones. Only the
+  // neighbors of the removed nodes can be connected to them.
+  std::vector<uint32_t> disconnected_nodes;
+  for (const size_t waypoint_id : removed_waypoint_ids) {
+    const uint32_t removed = waypoint_to_node_table_[waypoint_id];
+    const Node& removed_node = (*arena_)[removed];
+
+    for (const uint32_t neighbor : {removed_node.frontIndex(), removed_node.backIndex(),
+                                    removed_node.leftIndex(), removed_node.rightIndex()}) {
+      if (neighbor == kNullNodeIndex) continue;
+      Node& node = (*arena_)[neighbor];
+      if (removed_waypoint_ids.count(node.id()) != 0) continue;
+
+      if (node.frontIndex() == removed) node.frontIndex() = kNullNodeIndex;
+      if (node.backIndex()  == removed) node.backIndex()  = kNullNodeIndex;
+      if (node.leftIndex()  == removed) node.leftIndex()  = kNullNodeIndex;
+      if (node.rightIndex() == removed) node.rightIndex() = kNullNodeIndex;
+      disconnected_nodes.push_back(neighbor);
     }
   }
 
   // Removed the nodes that have been recorded.
   for (const size_t waypoint_id : removed_waypoint_ids) {
-    reduceRoadlaneToWaypointsTable(waypoint_to_node_table_[waypoint_id]->waypoint());
+    const uint32_t node = waypoint_to_node_table_[waypoint_id];
+    reduceRoadlaneToWaypointsTable((*arena_)[node].waypoint());
     reduceWaypointToNodeTable(waypoint_id);
   }
 
   // Update the entries and exits of the lattic.
-  findLatticeEntriesAndExits();
+  updateLatticeEntriesAndExits(disconnected_nodes);
+
+  // Move the origin of the distances to the closest remaining entry,
+  // so that the minimum distance of all nodes is 0 again.
+  if (!lattice_entries_.empty()) {
+    double shift_distance = (*arena_)[lattice_entries_[0]].distance();
+    for (const uint32_t entry : lattice_entries_) {
+      if ((*arena_)[entry].distance() >= shift_distance) continue;
+      shift_distance = (*arena_)[entry].distance();
+    }
+    arena_->shiftOrigin(shift_distance);
+  }
 
-  // Update the distance of all remaining nodes.
-  updateNodeDistance();
+  // Some of the remaining nodes may now be in a finer level of the resolution.
+  refine();
 
   return;
 }
 
 template<typename Node>
-void Lattice<Node>::updateNodeDistance() {
-
-  // Find the existing lattice entry with the smallest distance.
-  // The distance of all nodes will be reduced by this much.
-  double shift_distance = lattice_entries_[0].lock()->distance();
-  for (auto& entry : lattice_entries_) {
-    if (entry.lock()->distance() >= shift_distance) continue;
-    shift_distance = entry.lock()->distance();
-  }
+void Lattice<Node>::refine() {
 
-  // Put all existing entries into the queue.
-  std::unordered_set<size_t> updated_waypoint_ids;
-  std::queue<boost::shared_ptr<Node>> nodes_queue;
+  if (resolution_.uniform()) return;
+  CLP_PROFILE_SCOPE("Lattice::refine");
 
-  for (auto& entry : lattice_entries_) {
-    entry.lock()->distance() -= shift_distance;
-    nodes_queue.push(entry.lock());
-    updated_waypoint_ids.insert(entry.lock()->waypoint()->GetId());
-  }
+  // Tolerance of the node spacing, since the distances of the nodes
+  // are only accumulated from the resolutions.
+  const double tolerance = 0.5 * resolution_.finest();
 
-  while (!nodes_queue.empty()) {
-    // Get the next node to be processed.
-    boost::shared_ptr<Node> node = nodes_queue.front();
-    nodes_queue.pop();
+  // Insert nodes along each lane, starting from the entries of the lattice.
+  // The lanes are only walked up to the coarsest level, beyond which
+  // the spacing of the nodes is never changed.
+  std::vector<uint32_t> inserted_nodes;
+  std::unordered_set<uint32_t> visited_nodes;
 
-    // Update the left node.
-    if (node->left().lock()) {
-      boost::shared_ptr<Node> left_node = node->left().lock();
-      if (updated_waypoint_ids.count(left_node->waypoint()->GetId()) == 0) {
-        updated_waypoint_ids.insert(left_node->waypoint()->GetId());
-        nodes_queue.push(left_node);
-        left_node->distance() = node->distance();
-      }
-    }
+  for (const uint32_t entry : lattice_entries_) {
+    uint32_t node = entry;
+    while ((*arena_)[node].distance() < resolution_.coarsestDistance()) {
+      // Stop if this part of the lane has been visited from another entry.
+      if (!visited_nodes.insert(node).second) break;
 
-    // Update the right node.
-    if (node->right().lock()) {
-      boost::shared_ptr<Node> right_node = node->right().lock();
-      if (updated_waypoint_ids.count(right_node->waypoint()->GetId()) == 0) {
-        updated_waypoint_ids.insert(right_node->waypoint()->GetId());
-        nodes_queue.push(right_node);
-        right_node->distance() = node->distance();
-      }
-    }
+      const uint32_t front_node = (*arena_)[node].frontIndex();
+      if (front_node == kNullNodeIndex) break;
 
-    // Update the front node.
-    if (node->front().lock()) {
-      boost::shared_ptr<Node> front_node = node->front().lock();
-      if (updated_waypoint_ids.count(front_node->waypoint()->GetId()) == 0) {
-        updated_waypoint_ids.insert(front_node->waypoint()->GetId());
-        nodes_queue.push(front_node);
-        front_node->distance() = node->distance() + longitudinal_resolution_;
+      const double distance = (*arena_)[node].distance();
+      const double resolution = resolution_.at(distance);
+
+      // Move on to the front node if the spacing is fine enough.
+      if ((*arena_)[front_node].distance()-distance < resolution+tolerance) {
+        node = front_node;
+        continue;
       }
-    }
 
-    // Update the back node.
-    if (node->back().lock()) {
-      boost::shared_ptr<Node> back_node = node->back().lock();
-      if (updated_waypoint_ids.count(back_node->waypoint()->GetId()) == 0) {
-        updated_waypoint_ids.insert(back_node->waypoint()->GetId());
-        nodes_queue.push(back_node);
-        back_node->distance() = node->distance() - longitudinal_resolution_;
+      boost::shared_ptr<CarlaWaypoint> waypoint =
+        findFrontWaypoint((*arena_)[node].waypoint(), resolution);
+      if (!waypoint) break;
+
+      // Insert the new node between this node and the front node.
+      uint32_t middle_node = closestNodeIndex(waypoint, 0.2);
+      if (middle_node == kNullNodeIndex) {
+        middle_node = arena_->allocate(waypoint);
+        (*arena_)[middle_node].setDistance(distance + resolution);
+        augmentWaypointToNodeTable(waypoint->GetId(), middle_node);
+        augmentRoadlaneToWaypointsTable(waypoint);
+        inserted_nodes.push_back(middle_node);
       }
+      if (middle_node == front_node) {
+        node = front_node;
+        continue;
+      }
+
+      (*arena_)[node].frontIndex() = middle_node;
+      (*arena_)[middle_node].backIndex() = node;
+      (*arena_)[middle_node].frontIndex() = front_node;
+      (*arena_)[front_node].backIndex() = middle_node;
+      node = middle_node;
     }
   }
 
+  if (inserted_nodes.empty()) return;
+
+  // Connect the inserted nodes with their left and right nodes, which
+  // have been inserted on the adjacent lanes at the same distances.
+  // Left and right nodes which are not on the lattice yet, e.g. where
+  // a lane starts, are explored the same as in \c extend().
+  std::queue<uint32_t> nodes_queue;
+  for (const uint32_t node : inserted_nodes) {
+    extendLeft(node, nodes_queue);
+    extendRight(node, nodes_queue);
+  }
+
+  std::vector<uint32_t> explored_nodes;
+  explore(this->range(), nodes_queue, explored_nodes);
+  CLP_PROFILE_COUNT("Lattice::refine/inserted_nodes", inserted_nodes.size());
+
+  updateLatticeEntriesAndExits(explored_nodes);
   return;
 }
 
 template<typename Node>
 void Lattice<Node>::extendFront(
-    const boost::shared_ptr<Node>& node,
+    const uint32_t node,
     const double range,
-    std::queue<boost::shared_ptr<Node>>& nodes_queue) {
+    std::queue<uint32_t>& nodes_queue) {
 
-  // Find the front waypoint.
+  // Find the front waypoint at the resolution of where the node is.
+  const double resolution = resolution_.at((*arena_)[node].distance());
   boost::shared_ptr<CarlaWaypoint> front_waypoint =
-    findFrontWaypoint(node->waypoint(), longitudinal_resolution_);
+    findFrontWaypoint((*arena_)[node].waypoint(), resolution);
 
   if (front_waypoint) {
     // Find the front node correspoinding to the front waypoint if it exists.
-    boost::shared_ptr<Node> front_node = closestNode(front_waypoint, 0.2);
+    uint32_t front_node = closestNodeIndex(front_waypoint, 0.2);
 
-    if (!front_node) {
+    if (front_node == kNullNodeIndex) {
       // This front node does not exist yet.
-      front_node = boost::make_shared<Node>(front_waypoint);
-      front_node->distance() = node->distance() + longitudinal_resolution_;
-
-      // Add this new node to the queue if it is not beyond the max range.
-      if (front_node->distance() <= range) {
-        // Add the new node to the tables.
-        augmentWaypointToNodeTable(front_waypoint->GetId(), front_node);
-        augmentRoadlaneToWaypointsTable(front_waypoint);
-        // Add the new node to the queue.
-        nodes_queue.push(front_node);
-      }
+      // Add this new node if it is not beyond the max range.
+      const double front_distance = (*arena_)[node].distance() + resolution;
+      if (front_distance > range) return;
+
+      // Add the new node to the tables.
+      front_node = arena_->allocate(front_waypoint);
+      (*arena_)[front_node].setDistance(front_distance);
+      augmentWaypointToNodeTable(front_waypoint->GetId(), front_node);
+      augmentRoadlaneToWaypointsTable(front_waypoint);
+      // Add the new node to the queue.
+      nodes_queue.push(front_node);
     }
 
-    // If this front node is added to the graph, it is set to the
-    // front node of the current node.
-    if (waypoint_to_node_table_.find(front_node->waypoint()->GetId()) !=
-        waypoint_to_node_table_.end()) {
-      node->front() = front_node;
-      front_node->back() = node;
-    }
+    // The front node is set to the front node of the current node.
+    (*arena_)[node].frontIndex() = front_node;
+    (*arena_)[front_node].backIndex() = node;
   }
 
   return;
@@ -457,11 +480,11 @@ void Lattice<Node>::extendFront(
 
 template<typename Node>
 void Lattice<Node>::extendLeft(
-    const boost::shared_ptr<Node>& node,
-    std::queue<boost::shared_ptr<Node>>& nodes_queue) {
+    const uint32_t node,
+    std::queue<uint32_t>& nodes_queue) {
   // Find the left waypoint.
   boost::shared_ptr<CarlaWaypoint> left_waypoint =
-    findLeftWaypoint(node->waypoint());
+    findLeftWaypoint((*arena_)[node].waypoint());
 
   // Return if there is no left waypoint.
   if (!left_waypoint) return;
@@ -470,12 +493,12 @@ void Lattice<Node>::extendLeft(
   if(left_waypoint->GetType() != carla::road::Lane::LaneType::Driving) return;
 
   // Find the left node corresponds to the waypoint.
-  boost::shared_ptr<Node> left_node = closestNode(left_waypoint, 0.2);
+  uint32_t left_node = closestNodeIndex(left_waypoint, 0.2);
 
-  if (!left_node) {
+  if (left_node == kNullNodeIndex) {
     // This left node does not exist yet, add it to the tables and queue.
-    left_node = boost::make_shared<Node>(left_waypoint);
-    left_node->distance() = node->distance();
+    left_node = arena_->allocate(left_waypoint);
+    (*arena_)[left_node].setDistance((*arena_)[node].distance());
 
     augmentWaypointToNodeTable(left_waypoint->GetId(), left_node);
     augmentRoadlaneToWaypointsTable(left_waypoint);
@@ -484,13 +507,12 @@ void Lattice<Node>::extendLeft(
 
   // The left node is set to the left of this node
   // if one can do a left lane change here.
-  if ((node->waypoint()->GetLaneChange() ==
-       carla::road::element::LaneMarking::LaneChange::Left) ||
-      (node->waypoint()->GetLaneChange() ==
-       carla::road::element::LaneMarking::LaneChange::Both)) {
-    node->left() = left_node;
+  const auto lane_change = (*arena_)[node].waypoint()->GetLaneChange();
+  if ((lane_change == carla::road::element::LaneMarking::LaneChange::Left) ||
+      (lane_change == carla::road::element::LaneMarking::LaneChange::Both)) {
+    (*arena_)[node].leftIndex() = left_node;
   } else {
-    node->left().reset();
+    (*arena_)[node].leftIndex() = kNullNodeIndex;
   }
 
   return;
@@ -498,12 +520,12 @@ void Lattice<Node>::extendLeft(
 
 template<typename Node>
 void Lattice<Node>::extendRight(
-    const boost::shared_ptr<Node>& node,
-    std::queue<boost::shared_ptr<Node>>& nodes_queue) {
+    const uint32_t node,
+    std::queue<uint32_t>& nodes_queue) {
 
   // Find the right waypoint.
   boost::shared_ptr<CarlaWaypoint> right_waypoint =
-    findRightWaypoint(node->waypoint());
+    findRightWaypoint((*arena_)[node].waypoint());
 
   // Return if there is no right waypoint.
   if (!right_waypoint) return;
@@ -512,12 +534,12 @@ void Lattice<Node>::extendRight(
   if(right_waypoint->GetType() != carla::road::Lane::LaneType::Driving) return;
 
   // Find the right node corresponds to the waypoint.
-  boost::shared_ptr<Node> right_node = closestNode(right_waypoint, 0.2);
+  uint32_t right_node = closestNodeIndex(right_waypoint, 0.2);
 
-  if (!right_node) {
+  if (right_node == kNullNodeIndex) {
     // This right node does not exist yet, add it to the tables and queue.
-    right_node = boost::make_shared<Node>(right_waypoint);
-    right_node->distance() = node->distance();
+    right_node = arena_->allocate(right_waypoint);
+    (*arena_)[right_node].setDistance((*arena_)[node].distance());
 
     augmentWaypointToNodeTable(right_waypoint->GetId(), right_node);
     augmentRoadlaneToWaypointsTable(right_waypoint);
@@ -526,13 +548,12 @@ void Lattice<Node>::extendRight(
 
   // The right node is set to the right of this node
   // if one can do a right lane change here.
-  if ((node->waypoint()->GetLaneChange() ==
-       carla::road::element::LaneMarking::LaneChange::Right) ||
-      (node->waypoint()->GetLaneChange() ==
-       carla::road::element::LaneMarking::LaneChange::Both)) {
-    node->right() = right_node;
+  const auto lane_change = (*arena_)[node].waypoint()->GetLaneChange();
+  if ((lane_change == carla::road::element::LaneMarking::LaneChange::Right) ||
+      (lane_change == carla::road::element::LaneMarking::LaneChange::Both)) {
+    (*arena_)[node].rightIndex() = right_node;
   } else {
-    node->right().reset();
+    (*arena_)[node].rightIndex() = kNullNodeIndex;
   }
 
   return;
@@ -546,20 +567,20 @@ boost::shared_ptr<const Node> Lattice<Node>::front(
   // Find the node on the lattice that is closest to the given way point.
   // If we cannot find node on the lattice that is close enough,
   // the query waypoint is too far from the lattice, and we return nullptr.
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
-  if (!node) return nullptr;
+  uint32_t node = closestNodeIndex(query, resolution_.finest());
+  if (node == kNullNodeIndex) return nullptr;
 
   // Start from the found node, we search forward until the given range is met.
-  const double start_distance = node->distance();
+  const double start_distance = (*arena_)[node].distance();
   double current_range = 0.0;
   while (current_range < range) {
-    node = node->front();
+    node = (*arena_)[node].frontIndex();
     // There is no futher front node, the given range exceeds the lattice.
-    if (!node) return nullptr;
-    current_range = node->distance() - start_distance;
+    if (node == kNullNodeIndex) return nullptr;
+    current_range = (*arena_)[node].distance() - start_distance;
   }
 
-  return node;
+  return arena_->node(node);
 }
 
 template<typename Node>
@@ -570,20 +591,20 @@ boost::shared_ptr<const Node> Lattice<Node>::back(
   // Find the node on the lattice that is closest to the given way point.
   // If we cannot find node on the lattice that is close enough,
   // the query waypoint is too far from the lattice, and we return nullptr.
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
-  if (!node) return nullptr;
+  uint32_t node = closestNodeIndex(query, resolution_.finest());
+  if (node == kNullNodeIndex) return nullptr;
 
   // Start from the found node, we search backwards until the given range is met.
-  const double start_distance = node->distance();
+  const double start_distance = (*arena_)[node].distance();
   double current_range = 0.0;
   while (current_range < range) {
-    node = node->back();
+    node = (*arena_)[node].backIndex();
     // There is no futher back node, the given range exceeds the lattice.
-    if (!node) return nullptr;
-    current_range = start_distance - node->distance();
+    if (node == kNullNodeIndex) return nullptr;
+    current_range = start_distance - (*arena_)[node].distance();
   }
 
-  return node;
+  return arena_->node(node);
 }
 
 template<typename Node>
@@ -591,7 +612,7 @@ boost::shared_ptr<const Node> Lattice<Node>::leftFront(
     const boost::shared_ptr<const CarlaWaypoint>& query,
     const double range) const {
 
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
+  boost::shared_ptr<const Node> node = closestNode(query, resolution_.finest());
   if (!node) return nullptr;
 
   // Get the left node of the founded one, and search forward from that.
@@ -606,7 +627,7 @@ boost::shared_ptr<const Node> Lattice<Node>::frontLeft(
     const boost::shared_ptr<const CarlaWaypoint>& query,
     const double range) const {
 
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
+  boost::shared_ptr<const Node> node = closestNode(query, resolution_.finest());
   if (!node) return nullptr;
 
   // Get the front node of the founded one, and return the left of that.
@@ -621,7 +642,7 @@ boost::shared_ptr<const Node> Lattice<Node>::leftBack(
     const boost::shared_ptr<const CarlaWaypoint>& query,
     const double range) const {
 
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
+  boost::shared_ptr<const Node> node = closestNode(query, resolution_.finest());
   if (!node) return nullptr;
 
   // Get the left node of the founded one, and search bacwards from that.
@@ -636,7 +657,7 @@ boost::shared_ptr<const Node> Lattice<Node>::backLeft(
     const boost::shared_ptr<const CarlaWaypoint>& query,
     const double range) const {
 
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
+  boost::shared_ptr<const Node> node = closestNode(query, resolution_.finest());
   if (!node) return nullptr;
 
   // Get the back node of the founded one, and return the left of that.
@@ -651,7 +672,7 @@ boost::shared_ptr<const Node> Lattice<Node>::rightFront(
     const boost::shared_ptr<const CarlaWaypoint>& query,
     const double range) const {
 
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
+  boost::shared_ptr<const Node> node = closestNode(query, resolution_.finest());
   if (!node) return nullptr;
 
   // Get the right node of the founded one, and search forward from that.
@@ -666,7 +687,7 @@ boost::shared_ptr<const Node> Lattice<Node>::frontRight(
     const boost::shared_ptr<const CarlaWaypoint>& query,
     const double range) const {
 
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
+  boost::shared_ptr<const Node> node = closestNode(query, resolution_.finest());
   if (!node) return nullptr;
 
   // Get the front node of the found one, and return the right of that.
@@ -681,7 +702,7 @@ boost::shared_ptr<const Node> Lattice<Node>::rightBack(
     const boost::shared_ptr<const CarlaWaypoint>& query,
     const double range) const {
 
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
+  boost::shared_ptr<const Node> node = closestNode(query, resolution_.finest());
   if (!node) return nullptr;
 
   // Get the right node of the founded one, and search backwards from that.
@@ -696,7 +717,7 @@ boost::shared_ptr<const Node> Lattice<Node>::backRight(
     const boost::shared_ptr<const CarlaWaypoint>& query,
     const double range) const {
 
-  boost::shared_ptr<const Node> node = closestNode(query, longitudinal_resolution_);
+  boost::shared_ptr<const Node> node = closestNode(query, resolution_.finest());
   if (!node) return nullptr;
 
   // Get the back node of the found one, and return the right of that.
@@ -712,28 +733,50 @@ void Lattice<Node>::findLatticeEntriesAndExits() {
   lattice_entries_.clear();
   lattice_exits_.clear();
 
-  for (auto& item : waypoint_to_node_table_) {
-    if (!(item.second->back().lock())) lattice_entries_.push_back(item.second);
-    if (!(item.second->front().lock())) lattice_exits_.push_back(item.second);
+  for (const auto& item : waypoint_to_node_table_) {
+    const Node& node = (*arena_)[item.second];
+    if (node.backIndex()  == kNullNodeIndex) lattice_entries_.push_back(item.second);
+    if (node.frontIndex() == kNullNodeIndex) lattice_exits_.push_back(item.second);
+  }
+
+  return;
+}
+
+template<typename Node>
+void Lattice<Node>::updateLatticeEntriesAndExits(
+    const std::vector<uint32_t>& candidates) {
+
+  std::unordered_set<uint32_t> nodes(candidates.begin(), candidates.end());
+  nodes.insert(lattice_entries_.begin(), lattice_entries_.end());
+  nodes.insert(lattice_exits_.begin(), lattice_exits_.end());
+
+  lattice_entries_.clear();
+  lattice_exits_.clear();
+
+  for (const uint32_t index : nodes) {
+    const Node& node = (*arena_)[index];
+    // Skip the nodes which have been removed from the lattice.
+    if (!node.waypoint()) continue;
+    if (node.backIndex()  == kNullNodeIndex) lattice_entries_.push_back(index);
+    if (node.frontIndex() == kNullNodeIndex) lattice_exits_.push_back(index);
   }
 
   return;
 }
 
 template<typename Node>
-boost::shared_ptr<Node> Lattice<Node>::closestNode(
+uint32_t Lattice<Node>::closestNodeIndex(
     const boost::shared_ptr<const CarlaWaypoint>& waypoint,
-    const double tolerance) {
+    const double tolerance) const {
 
   // Return nullptr is the input waypoint is invalid.
-  if (!waypoint) return nullptr;
+  if (!waypoint) return kNullNodeIndex;
 
   // If there is a node in the lattice exactly matches the given waypoint,
   // just return the node.
-  if (waypoint_to_node_table_.find(waypoint->GetId()) !=
-      waypoint_to_node_table_.end()) {
-    return waypoint_to_node_table_.find(waypoint->GetId())->second;
-  }
+  typename std::unordered_map<size_t, uint32_t>::const_iterator node_iter =
+    waypoint_to_node_table_.find(waypoint->GetId());
+  if (node_iter != waypoint_to_node_table_.end()) return node_iter->second;
 
   // Otherwise, we have to do a bit more work.
   // Compare the given waypoint with the waypoints on the same road+lane.
@@ -741,20 +784,20 @@ boost::shared_ptr<Node> Lattice<Node>::closestNode(
   size_t roadlane_id = 0;
   utils::hashCombine(roadlane_id, waypoint->GetRoadId(), waypoint->GetLaneId());
 
-  if (roadlane_to_waypoints_table_.find(roadlane_id) !=
-      roadlane_to_waypoints_table_.end()) {
+  typename std::unordered_map<size_t, std::deque<size_t>>::const_iterator roadlane_iter =
+    roadlane_to_waypoints_table_.find(roadlane_id);
+  if (roadlane_iter != roadlane_to_waypoints_table_.end()) {
 
     // Candidate waypoints on the same road and lane.
-    const std::vector<size_t>& candidate_waypoint_ids =
-      roadlane_to_waypoints_table_.find(roadlane_id)->second;
+    const std::deque<size_t>& candidate_waypoint_ids = roadlane_iter->second;
 
     // Find the closest waypoint node.
     double closest_distance = std::numeric_limits<double>::max();
-    boost::shared_ptr<Node> closest_node = nullptr;
+    uint32_t closest_node = kNullNodeIndex;
     for (const size_t id : candidate_waypoint_ids) {
-      const boost::shared_ptr<Node> node = waypoint_to_node_table_.find(id)->second;
+      const uint32_t node = waypoint_to_node_table_.find(id)->second;
       const double distance = std::fabs(
-          node->waypoint()->GetDistance() - waypoint->GetDistance());
+          (*arena_)[node].waypoint()->GetDistance() - waypoint->GetDistance());
 
       if (distance < closest_distance) {
         closest_distance = distance;
@@ -770,12 +813,12 @@ boost::shared_ptr<Node> Lattice<Node>::closestNode(
   // Now, we really have to pull out the big gun, searching through all
   // nodes on the lattice in order to find the closest node.
   double closest_distance = std::numeric_limits<double>::max();
-  boost::shared_ptr<Node> closest_node = nullptr;
+  uint32_t closest_node = kNullNodeIndex;
 
   for (const auto& item : waypoint_to_node_table_) {
 
     const double distance = (
-        item.second->waypoint()->GetTransform().location -
+        (*arena_)[item.second].waypoint()->GetTransform().location -
         waypoint->GetTransform().location).Length();
 
     if (distance < closest_distance) {
@@ -787,28 +830,25 @@ boost::shared_ptr<Node> Lattice<Node>::closestNode(
   //std::printf("closest distance:%f tolerance:%f\n", closest_distance, tolerance);
 
   if (closest_distance < tolerance) return closest_node;
-  else return nullptr;
+  else return kNullNodeIndex;
   //return nullptr;
 }
 
 template<typename Node>
 std::string Lattice<Node>::string(const std::string& prefix) const {
 
-  std::string lattice_msg = (boost::format(
-        "lattice longitudinal resolution: %1%.\n"
-        "lattice node #: %2%\n")
-      % longitudinal_resolution_
-      % waypoint_to_node_table_.size()).str();
+  std::string lattice_msg = resolution_.string("lattice longitudinal resolution:\n") +
+    (boost::format("lattice node #: %1%\n") % waypoint_to_node_table_.size()).str();
 
   std::string lattice_entries_msg = (boost::format(
         "%1% lattice entries:\n") % lattice_entries_.size()).str();
-  for (const auto& entry : lattice_entries_)
-    lattice_entries_msg += entry.lock()->string();
+  for (const uint32_t entry : lattice_entries_)
+    lattice_entries_msg += (*arena_)[entry].string();
 
   std::string lattice_exits_msg = (boost::format(
         "%1% lattice exits:\n") % lattice_exits_.size()).str();
-  for (const auto& exit : lattice_exits_)
-    lattice_exits_msg += exit.lock()->string();
+  for (const uint32_t exit : lattice_exits_)
+    lattice_exits_msg += (*arena_)[exit].string();
 
   return prefix + lattice_msg + lattice_entries_msg + lattice_exits_msg;
 }
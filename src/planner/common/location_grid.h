@@ -0,0 +1,327 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <carla/geom/Location.h>
+
+namespace utils {
+
+/**
+ * \brief LocationGrid is a uniform 2-D grid used to find the closest one
+ *        among a fixed set of locations.
+ *
+ * The locations are bucketed into square cells based on their x and y
+ * coordinates. The buckets are stored in flat arrays, i.e. all locations
+ * sorted by their cells together with the offset of each cell, so that
+ * queries are cache friendly and never allocate memory.
+ *
+ * A query searches the cell containing the query location first, and then
+ * the rings of cells around it, until it is guaranteed that no cell further
+ * away can contain a closer location.
+ *
+ * The flat arrays are either owned by the grid, or provided externally,
+ * e.g. mapped from a file, in which case they must outlive the grid.
+ */
+class LocationGrid : private boost::noncopyable {
+
+public:
+
+  using CarlaLocation = carla::geom::Location;
+
+  /// Index of a location, i.e. the order of the location in the
+  /// vector used to construct the grid.
+  using Index = uint32_t;
+
+protected:
+
+  /// Side length of the cells.
+  double cell_size_;
+
+  /// Minimum x and y coordinates of all locations.
+  double min_x_ = 0.0;
+  double min_y_ = 0.0;
+
+  /// Number of cells along the x and y axes.
+  int32_t x_cells_ = 0;
+  int32_t y_cells_ = 0;
+
+  /// Number of locations stored in the grid.
+  size_t num_locations_ = 0;
+
+  /**
+   * The offset of each cell into \c cell_locations_ and \c cell_indices_.
+   *
+   * Locations within cell \c i are stored within
+   * [cell_offsets_[i], cell_offsets_[i+1]).
+   */
+  const uint32_t* cell_offsets_ = nullptr;
+
+  /// Locations sorted by their cells.
+  const CarlaLocation* cell_locations_ = nullptr;
+
+  /// Indices of the locations in \c cell_locations_.
+  const Index* cell_indices_ = nullptr;
+
+  /// Storage of the above arrays if they are owned by the grid.
+  std::vector<uint32_t> cell_offsets_storage_;
+  std::vector<CarlaLocation> cell_locations_storage_;
+  std::vector<Index> cell_indices_storage_;
+
+public:
+
+  /**
+   * \brief Construct the grid with the given locations.
+   * \param[in] locations The locations to be stored in the grid.
+   * \param[in] cell_size The side length of the grid cells.
+   */
+  LocationGrid(const std::vector<CarlaLocation>& locations,
+               const double cell_size = 1.0) :
+    cell_size_(cell_size) {
+
+    if (cell_size_ <= 0.0) {
+      std::string error_msg = (boost::format(
+          "LocationGrid::LocationGrid(): "
+          "invalid cell size %1%.\n") % cell_size_).str();
+      throw std::runtime_error(error_msg);
+    }
+
+    if (locations.size() >= std::numeric_limits<Index>::max()) {
+      std::string error_msg = (boost::format(
+          "LocationGrid::LocationGrid(): "
+          "too many locations %1%.\n") % locations.size()).str();
+      throw std::runtime_error(error_msg);
+    }
+
+    if (locations.empty()) return;
+
+    // Find the extent of the grid.
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+    min_x_ = std::numeric_limits<double>::max();
+    min_y_ = std::numeric_limits<double>::max();
+
+    for (const auto& location : locations) {
+      min_x_ = std::min<double>(min_x_, location.x);
+      min_y_ = std::min<double>(min_y_, location.y);
+      max_x  = std::max<double>(max_x,  location.x);
+      max_y  = std::max<double>(max_y,  location.y);
+    }
+
+    x_cells_ = static_cast<int32_t>(std::floor((max_x-min_x_)/cell_size_)) + 1;
+    y_cells_ = static_cast<int32_t>(std::floor((max_y-min_y_)/cell_size_)) + 1;
+
+    // Bucket the locations into the cells (counting sort).
+    std::vector<uint32_t> location_cells(locations.size());
+    cell_offsets_storage_.assign(numCells()+1, 0);
+
+    for (size_t i = 0; i < locations.size(); ++i) {
+      int32_t x = 0, y = 0;
+      cellCoordinates(locations[i], x, y);
+      location_cells[i] = cellId(x, y);
+      ++cell_offsets_storage_[location_cells[i]+1];
+    }
+
+    for (size_t i = 1; i < cell_offsets_storage_.size(); ++i)
+      cell_offsets_storage_[i] += cell_offsets_storage_[i-1];
+
+    cell_locations_storage_.resize(locations.size());
+    cell_indices_storage_.resize(locations.size());
+    std::vector<uint32_t> cell_fills(
+        cell_offsets_storage_.begin(), cell_offsets_storage_.end()-1);
+
+    for (size_t i = 0; i < locations.size(); ++i) {
+      const uint32_t slot = cell_fills[location_cells[i]]++;
+      cell_locations_storage_[slot] = locations[i];
+      cell_indices_storage_[slot] = static_cast<Index>(i);
+    }
+
+    num_locations_  = locations.size();
+    cell_offsets_   = cell_offsets_storage_.data();
+    cell_locations_ = cell_locations_storage_.data();
+    cell_indices_   = cell_indices_storage_.data();
+
+    return;
+  }
+
+  /**
+   * \brief Construct the grid as a view of externally stored arrays.
+   *
+   * The arrays should be the ones returned by the accessors of a grid
+   * constructed with the same parameters. No copy of the arrays is made.
+   */
+  LocationGrid(const double cell_size,
+               const double min_x,
+               const double min_y,
+               const int32_t x_cells,
+               const int32_t y_cells,
+               const size_t num_locations,
+               const uint32_t* cell_offsets,
+               const CarlaLocation* cell_locations,
+               const Index* cell_indices) :
+    cell_size_(cell_size), min_x_(min_x), min_y_(min_y),
+    x_cells_(x_cells), y_cells_(y_cells),
+    num_locations_(num_locations),
+    cell_offsets_(cell_offsets),
+    cell_locations_(cell_locations),
+    cell_indices_(cell_indices) {
+
+    if (num_locations_ > 0 && (cell_size_ <= 0.0 || x_cells_ <= 0 || y_cells_ <= 0 ||
+        cell_offsets_[numCells()] != num_locations_)) {
+      throw std::runtime_error(
+          "LocationGrid::LocationGrid(): "
+          "inconsistent grid arrays.\n");
+    }
+    return;
+  }
+
+  /// Get the side length of the cells.
+  const double cellSize() const { return cell_size_; }
+
+  /// Get the minimum x and y coordinates of the grid.
+  const double minX() const { return min_x_; }
+  const double minY() const { return min_y_; }
+
+  /// Get the number of cells along the x and y axes.
+  const int32_t xCells() const { return x_cells_; }
+  const int32_t yCells() const { return y_cells_; }
+
+  /// Get the total number of cells.
+  const size_t numCells() const { return static_cast<size_t>(x_cells_)*y_cells_; }
+
+  /// Get the number of locations stored in the grid.
+  const size_t size() const { return num_locations_; }
+
+  /// Get the flat arrays of the grid, with \c numCells()+1 cell
+  /// offsets, and \c size() cell locations and cell indices.
+  const uint32_t* cellOffsets() const { return cell_offsets_; }
+  const CarlaLocation* cellLocations() const { return cell_locations_; }
+  const Index* cellIndices() const { return cell_indices_; }
+
+  /**
+   * \brief Find the closest location to the query.
+   *
+   * \param[in] query The query location.
+   * \param[out] sqr_distance The squared distance between the query and
+   *                          the closest location.
+   * \return The index of the closest location.
+   */
+  Index closest(const CarlaLocation& query, double& sqr_distance) const {
+
+    if (num_locations_ == 0) {
+      throw std::runtime_error(
+          "LocationGrid::closest(): "
+          "there is no location in the grid.\n");
+    }
+
+    int32_t qx = 0, qy = 0;
+    cellCoordinates(query, qx, qy);
+
+    // The largest ring which still overlaps with the grid.
+    const int32_t max_ring = std::max(
+        std::max(std::abs(qx), std::abs(x_cells_-1-qx)),
+        std::max(std::abs(qy), std::abs(y_cells_-1-qy)));
+
+    Index closest_index = 0;
+    sqr_distance = std::numeric_limits<double>::max();
+
+    for (int32_t ring = 0; ring <= max_ring; ++ring) {
+      // All locations in this ring (and beyond) are at least
+      // (ring-1)*cell_size away from the query.
+      if (ring > 0) {
+        const double bound = (ring-1) * cell_size_;
+        if (sqr_distance <= bound*bound) break;
+      }
+
+      for (int32_t dy = -ring; dy <= ring; ++dy) {
+        const int32_t y = qy + dy;
+        if (y < 0 || y >= y_cells_) continue;
+
+        // Only the first and last rows of the ring are fully scanned.
+        const int32_t step = (dy==-ring || dy==ring) ? 1 : std::max(2*ring, 1);
+        for (int32_t dx = -ring; dx <= ring; dx += step) {
+          const int32_t x = qx + dx;
+          if (x < 0 || x >= x_cells_) continue;
+          searchCell(cellId(x, y), query, closest_index, sqr_distance);
+        }
+      }
+    }
+
+    return closest_index;
+  }
+
+  /// Find the closest location to the query.
+  Index closest(const CarlaLocation& query) const {
+    double sqr_distance = 0.0;
+    return closest(query, sqr_distance);
+  }
+
+  /**
+   * \brief Find the closest locations for a batch of queries.
+   *
+   * \param[in] queries Pointer to the first query location.
+   * \param[in] num The number of queries.
+   * \param[out] indices Pointer to the first element of the output, which
+   *                     should have space for at least \c num indices.
+   */
+  void closest(const CarlaLocation* queries, const size_t num, Index* indices) const {
+    for (size_t i = 0; i < num; ++i) indices[i] = closest(queries[i]);
+    return;
+  }
+
+protected:
+
+  /// Get the coordinates of the cell containing the location.
+  /// The coordinates might be outside the grid.
+  void cellCoordinates(const CarlaLocation& location, int32_t& x, int32_t& y) const {
+    x = static_cast<int32_t>(std::floor((location.x-min_x_)/cell_size_));
+    y = static_cast<int32_t>(std::floor((location.y-min_y_)/cell_size_));
+    return;
+  }
+
+  /// Get the ID of the cell with the given coordinates.
+  uint32_t cellId(const int32_t x, const int32_t y) const {
+    return static_cast<uint32_t>(y)*x_cells_ + static_cast<uint32_t>(x);
+  }
+
+  /// Update the closest location with the locations in the given cell.
+  void searchCell(const uint32_t cell,
+                  const CarlaLocation& query,
+                  Index& closest_index,
+                  double& sqr_distance) const {
+    for (uint32_t i = cell_offsets_[cell]; i < cell_offsets_[cell+1]; ++i) {
+      const double dx = cell_locations_[i].x - query.x;
+      const double dy = cell_locations_[i].y - query.y;
+      const double dz = cell_locations_[i].z - query.z;
+      const double d = dx*dx + dy*dy + dz*dz;
+      if (d < sqr_distance) {
+        sqr_distance = d;
+        closest_index = cell_indices_[i];
+      }
+    }
+    return;
+  }
+
+}; // End class LocationGrid.
+
+} // End namespace utils.
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace utils {
+
+/**
+ * \brief MappedFile maps a file into memory as read-only.
+ *
+ * The pages are shared with all other processes mapping the same file.
+ * The file is unmapped once the object is destroyed.
+ */
+class MappedFile : private boost::noncopyable {
+
+protected:
+
+  /// Start of the mapped memory.
+  void* data_ = nullptr;
+
+  /// Size of the mapped memory in bytes.
+  size_t size_ = 0;
+
+public:
+
+  /**
+   * \brief Map the given file.
+   *
+   * An exception is thrown if the file cannot be opened or mapped.
+   *
+   * \param[in] path Path to the file.
+   */
+  MappedFile(const std::string& path) {
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::string error_msg = (boost::format(
+          "MappedFile::MappedFile(): "
+          "cannot open file %1%.\n") % path).str();
+      throw std::runtime_error(error_msg);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+      close(fd);
+      std::string error_msg = (boost::format(
+          "MappedFile::MappedFile(): "
+          "cannot get the size of file %1%.\n") % path).str();
+      throw std::runtime_error(error_msg);
+    }
+
+    size_ = static_cast<size_t>(file_stat.st_size);
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after closing the file descriptor.
+    close(fd);
+
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      std::string error_msg = (boost::format(
+          "MappedFile::MappedFile(): "
+          "cannot map file %1%.\n") % path).str();
+      throw std::runtime_error(error_msg);
+    }
+
+    return;
+  }
+
+  ~MappedFile() {
+    if (data_) munmap(data_, size_);
+    return;
+  }
+
+  /// Get the start of the mapped memory.
+  const char* data() const { return static_cast<const char*>(data_); }
+
+  /// Get the size of the mapped memory in bytes.
+  const size_t size() const { return size_; }
+
+}; // End class MappedFile.
+
+} // End namespace utils.
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+namespace utils {
+
+/**
+ * \name Approximate number of bytes allocated by the standard containers.
+ *
+ * The estimates only count the heap memory owned by the containers
+ * themselves, i.e. not the memory owned by the elements, and are based
+ * on the layout of libstdc++. They are meant to track the memory usage
+ * of the planners, rather than to be exact.
+ */
+/// @{
+template<typename T, typename Alloc>
+size_t memoryUsage(const std::vector<T, Alloc>& vector) {
+  return vector.capacity() * sizeof(T);
+}
+
+template<typename T, typename Alloc>
+size_t memoryUsage(const std::deque<T, Alloc>& deque) {
+  // The elements are stored in blocks of 512 bytes, together with a map
+  // of the block pointers. There is at least one block allocated.
+  constexpr size_t kBlockSize = 512;
+  const size_t block_elements = sizeof(T) < kBlockSize ? kBlockSize/sizeof(T) : 1;
+  const size_t blocks = deque.size()/block_elements + 1;
+  return blocks * (std::max(kBlockSize, sizeof(T)) + sizeof(void*));
+}
+
+template<typename Key, typename T, typename Hash, typename Pred, typename Alloc>
+size_t memoryUsage(const std::unordered_map<Key, T, Hash, Pred, Alloc>& map) {
+  // Each element is a node with the next pointer and possibly the cached hash.
+  using Map = std::unordered_map<Key, T, Hash, Pred, Alloc>;
+  return map.size() * (sizeof(typename Map::value_type) + 2*sizeof(void*)) +
+         map.bucket_count() * sizeof(void*);
+}
+
+template<typename Key, typename T, typename Compare, typename Alloc>
+size_t memoryUsage(const std::map<Key, T, Compare, Alloc>& map) {
+  // Each element is a tree node with the color and three pointers.
+  using Map = std::map<Key, T, Compare, Alloc>;
+  return map.size() * (sizeof(typename Map::value_type) + 4*sizeof(void*));
+}
+/// @}
+
+} // End namespace utils.
@@ -0,0 +1,290 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <carla/client/Map.h>
+
+#include <planner/common/snapshot.h>
+#include <planner/common/vehicle_path.h>
+#include <planner/common/thread_pool.h>
+#include <planner/common/fast_waypoint_map.h>
+#include <planner/common/cost_model.h>
+#include <planner/common/intelligent_driver_model.h>
+
+namespace planner {
+
+/**
+ * \brief AgentHypotheses stores a number of sampled hypotheses of the
+ *        behaviours of the agents in a snapshot.
+ *
+ * Each hypothesis, i.e. sample, consists of the policy speeds of all agents,
+ * and the IDM parameters (time gap and distance gap) used by the agents.
+ * The samples are stored as a structure of arrays, where the policy speeds
+ * of a sample are contiguous and ordered by the slots of the agents in the
+ * snapshot, so that they can be copied into a snapshot directly.
+ */
+class AgentHypotheses {
+
+protected:
+
+  /// Number of samples.
+  size_t samples_ = 0;
+
+  /// IDs of the agents, in the order of their slots in the snapshot.
+  std::vector<size_t> agent_ids_;
+
+  /// The policy speed of the agent at \c slot in sample \c k is
+  /// stored at \c k*agent_ids_.size()+slot.
+  std::vector<double> policy_speeds_;
+
+  /// IDM parameters of the samples.
+  std::vector<double> time_gaps_;
+  std::vector<double> distance_gaps_;
+
+public:
+
+  AgentHypotheses() = default;
+
+  /**
+   * \brief Sample the hypotheses around the agents in the snapshot.
+   *
+   * The policy speeds are perturbed with gaussian noise, and the IDM parameters
+   * are perturbed uniformly around the defaults of \c IntelligentDriverModel,
+   * in the same way as the agents are randomized by the agents planner.
+   *
+   * \param[in] snapshot The snapshot whose agents are to be sampled.
+   * \param[in] samples The number of samples.
+   * \param[in,out] rand_gen The random engine.
+   * \param[in] policy_speed_sigma The std of the policy speed noise (m/s).
+   * \param[in] time_gap_noise The half range of the time gap noise (s).
+   * \param[in] distance_gap_noise The half range of the distance gap noise (m).
+   */
+  AgentHypotheses(const Snapshot& snapshot,
+                  const size_t samples,
+                  std::mt19937& rand_gen,
+                  const double policy_speed_sigma = 1.0,
+                  const double time_gap_noise = 0.2,
+                  const double distance_gap_noise = 1.0) :
+    samples_(samples),
+    agent_ids_(snapshot.agents().ids().begin(), snapshot.agents().ids().end()) {
+
+    const IntelligentDriverModel default_idm;
+    const std::vector<double>& policy_speeds = snapshot.agents().policySpeeds();
+
+    std::normal_distribution<double> policy_speed_dist(0.0, policy_speed_sigma);
+    std::uniform_real_distribution<double> time_gap_dist(-time_gap_noise, time_gap_noise);
+    std::uniform_real_distribution<double> distance_gap_dist(-distance_gap_noise, distance_gap_noise);
+
+    policy_speeds_.reserve(samples_*agent_ids_.size());
+    time_gaps_.reserve(samples_);
+    distance_gaps_.reserve(samples_);
+
+    // The policy speeds are kept positive, which the IDM divides by.
+    const double min_policy_speed = kMinPolicySpeed_;
+
+    for (size_t k = 0; k < samples_; ++k) {
+      for (size_t slot = 0; slot < agent_ids_.size(); ++slot) {
+        policy_speeds_.push_back(std::max(
+              policy_speeds[slot]+policy_speed_dist(rand_gen), min_policy_speed));
+      }
+      time_gaps_.push_back(default_idm.timeGap() + time_gap_dist(rand_gen));
+      distance_gaps_.push_back(default_idm.distanceGap() + distance_gap_dist(rand_gen));
+    }
+
+    return;
+  }
+
+  const size_t size() const { return samples_; }
+
+  const std::vector<size_t>& agentIds() const { return agent_ids_; }
+
+  /// The policy speeds of the agents in sample \c k, ordered by the agent slots.
+  const double* policySpeeds(const size_t k) const {
+    return policy_speeds_.data() + k*agent_ids_.size();
+  }
+  double* policySpeeds(const size_t k) {
+    return policy_speeds_.data() + k*agent_ids_.size();
+  }
+
+  const double timeGap(const size_t k) const { return time_gaps_[k]; }
+  double& timeGap(const size_t k) { return time_gaps_[k]; }
+
+  const double distanceGap(const size_t k) const { return distance_gaps_[k]; }
+  double& distanceGap(const size_t k) { return distance_gaps_[k]; }
+
+protected:
+
+  /// The minimum policy speed (m/s) of the sampled agents.
+  static constexpr double kMinPolicySpeed_ = 1.0;
+
+}; // End class AgentHypotheses.
+
+/**
+ * \brief MonteCarloRollouts evaluates an ego path against a number of
+ *        sampled hypotheses of the agent behaviours.
+ *
+ * All samples start from the same snapshot. Since the snapshots share their
+ * agent tables and traffic lattices until modified, a sample only copies the
+ * agent table to write its policy speeds, and the lattice is only copied once
+ * the sample starts to move. The samples are simulated on the thread pool if
+ * one is given.
+ *
+ * \c Simulator should be one of the IDM based traffic simulators, which allow
+ * the agents to be simulated with a separate IDM through \c agentIdm().
+ */
+template<typename Simulator>
+class MonteCarloRollouts : private boost::noncopyable {
+
+public:
+
+  using CarlaMap = carla::client::Map;
+
+  /// The statistics of the simulations of all samples.
+  struct Result {
+    /// Number of samples.
+    size_t samples = 0;
+    /// Number of samples with a collision, or which failed to be simulated.
+    size_t collisions = 0;
+    /// The mean and the maximum cost over the samples without a collision.
+    double expected_cost = std::numeric_limits<double>::infinity();
+    double worst_cost = std::numeric_limits<double>::infinity();
+    /// The mean simulated time over the samples without a collision.
+    double expected_time = 0.0;
+
+    const double collisionRate() const {
+      return samples > 0 ? static_cast<double>(collisions)/samples : 0.0;
+    }
+  }; // End struct Result.
+
+protected:
+
+  boost::shared_ptr<CarlaMap> map_ = nullptr;
+
+  boost::shared_ptr<const utils::FastWaypointMap> fast_map_ = nullptr;
+
+  /// Thread pool on which the samples are simulated, serially if \c nullptr.
+  boost::shared_ptr<utils::ThreadPool> thread_pool_ = nullptr;
+
+  /// Costs of the simulations of the samples.
+  boost::shared_ptr<const CostModel> cost_model_ = CostModel::defaultModel();
+
+public:
+
+  MonteCarloRollouts(const boost::shared_ptr<CarlaMap>& map,
+                     const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+                     const boost::shared_ptr<utils::ThreadPool>& thread_pool = nullptr) :
+    map_(map), fast_map_(fast_map), thread_pool_(thread_pool) {}
+
+  const boost::shared_ptr<const utils::ThreadPool> threadPool() const { return thread_pool_; }
+  boost::shared_ptr<utils::ThreadPool>& threadPool() { return thread_pool_; }
+
+  const boost::shared_ptr<const CostModel> costModel() const { return cost_model_; }
+  boost::shared_ptr<const CostModel>& costModel() { return cost_model_; }
+
+  /**
+   * \brief Simulate the ego along the path under all hypotheses.
+   *
+   * The samples with a collision are only counted in \c Result::collisions,
+   * and are excluded from the costs.
+   *
+   * \param[in] snapshot The snapshot at the start of the path.
+   * \param[in] hypotheses The hypotheses sampled from \c snapshot.
+   * \param[in] path The path to be executed by the ego vehicle.
+   * \param[in] default_dt The default simulation time step.
+   * \param[in] max_time The maximum duration to simulate.
+   * \return The statistics over the samples. The costs are infinity if
+   *         all samples collide.
+   */
+  Result simulate(const Snapshot& snapshot,
+                  const AgentHypotheses& hypotheses,
+                  const ContinuousPath& path,
+                  const double default_dt,
+                  const double max_time) const {
+
+    if (hypotheses.agentIds() != snapshot.agents().ids()) {
+      throw std::runtime_error(
+          "MonteCarloRollouts::simulate(): "
+          "the hypotheses are not sampled from the snapshot.\n");
+    }
+
+    // The simulated time and cost of every sample, infinity for collisions.
+    std::vector<double> times(hypotheses.size(), 0.0);
+    std::vector<double> costs(hypotheses.size(), std::numeric_limits<double>::infinity());
+
+    auto simulateSample = [this, &snapshot, &hypotheses, &path,
+                           default_dt, max_time, &times, &costs](const size_t k)->void{
+      Snapshot sample = snapshot;
+      std::vector<double>& policy_speeds = sample.agents().policySpeeds();
+      std::copy(hypotheses.policySpeeds(k),
+                hypotheses.policySpeeds(k)+policy_speeds.size(),
+                policy_speeds.begin());
+
+      Simulator simulator(sample, map_, fast_map_);
+      simulator.costModel() = cost_model_;
+      simulator.agentIdm() = boost::make_shared<IntelligentDriverModel>(
+          hypotheses.timeGap(k), hypotheses.distanceGap(k));
+
+      double time = 0.0; double cost = 0.0;
+      try {
+        if (!simulator.simulate(path, default_dt, max_time, time, cost)) return;
+      } catch (const std::exception& e) {
+        std::printf("MonteCarloRollouts::simulate(): WARNING\n%s", e.what());
+        return;
+      }
+      times[k] = time;
+      costs[k] = cost;
+    };
+
+    if (thread_pool_) thread_pool_->parallelFor(hypotheses.size(), simulateSample);
+    else for (size_t k = 0; k < hypotheses.size(); ++k) simulateSample(k);
+
+    Result result;
+    result.samples = hypotheses.size();
+
+    double total_cost = 0.0;
+    double total_time = 0.0;
+    double worst_cost = std::numeric_limits<double>::lowest();
+    for (size_t k = 0; k < hypotheses.size(); ++k) {
+      if (std::isinf(costs[k])) { ++result.collisions; continue; }
+      total_cost += costs[k];
+      total_time += times[k];
+      worst_cost = std::max(worst_cost, costs[k]);
+    }
+
+    const size_t valid_samples = result.samples - result.collisions;
+    if (valid_samples > 0) {
+      result.expected_cost = total_cost / valid_samples;
+      result.expected_time = total_time / valid_samples;
+      result.worst_cost = worst_cost;
+    }
+
+    return result;
+  }
+
+}; // End class MonteCarloRollouts.
+
+} // End namespace planner.
@@ -0,0 +1,323 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/format.hpp>
+#include <boost/optional.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <planner/common/kn_path_gen.h>
+
+namespace planner {
+
+/**
+ * \brief PathWarmStartTable stores optimized Kelly-Nagy paths on a grid of
+ *        boundary conditions, which are used as initial guesses of the
+ *        path optimization.
+ *
+ * The grid is over the pose of the end relative to the start (dx, dy, dtheta)
+ * and the curvatures at both ends (kappa0, kappaf), all in the right handed
+ * local frame of the start. Each grid point is optimized starting from the
+ * heuristic guess of \c NonHolonomicPath, or from the solution at the
+ * neighboring grid point if the heuristic guess diverges.
+ *
+ * Generating the table takes a while. If a cache directory is provided,
+ * the table is saved the first time it is generated, and loaded afterwards.
+ */
+class PathWarmStartTable : private boost::noncopyable {
+
+public:
+
+  /// Uniform samples of one dimension of the table.
+  struct Axis {
+    double min;
+    double max;
+    uint32_t num;
+
+    /// The value of the i-th sample.
+    double value(const uint32_t i) const {
+      return num > 1 ? min + (max-min)*i/(num-1) : min;
+    }
+
+    /// The index of the sample closest to the value, or -1 if the value is
+    /// more than half a step outside the range.
+    int index(const double v) const {
+      if (num <= 1) return v == min ? 0 : -1;
+      const double i = std::round((v-min) / (max-min) * (num-1));
+      if (i < 0.0 || i > num-1) return -1;
+      return static_cast<int>(i);
+    }
+
+    bool operator==(const Axis& other) const {
+      return min == other.min && max == other.max && num == other.num;
+    }
+  };
+
+  /// Axes of dx, dy, dtheta, kappa0, and kappaf, in this order.
+  using Axes = std::array<Axis, 5>;
+
+protected:
+
+  /// Header of the cache file.
+  struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    double axes[5][3];
+    uint64_t num_entries;
+  };
+
+  /// Coefficients of an optimized path. \c sf is 0 if the optimization diverges.
+  struct Entry {
+    double b;
+    double c;
+    double d;
+    double sf;
+  };
+
+  /// Version of the cache file format.
+  static constexpr uint32_t kCacheVersion_ = 1;
+
+  /// Samples of the boundary conditions.
+  Axes axes_;
+
+  /// Stored with dx changing the fastest and kappaf the slowest.
+  std::vector<Entry> entries_;
+
+  /// Whether the table is loaded from a cache file.
+  bool cached_ = false;
+
+public:
+
+  /**
+   * \brief Default axes of the table, covering the lane keeping and lane
+   *        changing paths created by the lattice planners.
+   */
+  static Axes defaultAxes() {
+    return Axes{{
+      Axis{ 5.0,  60.0, 12},   // dx (m)
+      Axis{-5.0,   5.0, 11},   // dy (m)
+      Axis{-0.3,   0.3,  7},   // dtheta (rad)
+      Axis{-0.04,  0.04, 5},   // kappa0 (1/m)
+      Axis{-0.04,  0.04, 5}}}; // kappaf (1/m)
+  }
+
+  /**
+   * \brief Class constructor.
+   * \param[in] cache_directory Directory to load or store the table. If empty,
+   *                            the table is always generated.
+   * \param[in] axes Samples of the boundary conditions.
+   */
+  PathWarmStartTable(const std::string& cache_directory = "",
+                     const Axes& axes = defaultAxes()) :
+    axes_(axes) {
+
+    for (const Axis& axis : axes_) {
+      if (axis.num == 0 || axis.max < axis.min) {
+        throw std::runtime_error(
+            "PathWarmStartTable::PathWarmStartTable(): invalid table axis.\n");
+      }
+    }
+
+    const std::string cache_path = cache_directory.empty() ?
+      std::string() : cache_directory + "/path_warm_start_table.pwt";
+
+    if (cache_path.empty() || !loadCache(cache_path)) {
+      generate();
+      if (!cache_path.empty()) saveCache(cache_directory, cache_path);
+    }
+    return;
+  }
+
+  /// Get the axes of the table.
+  const Axes& axes() const { return axes_; }
+
+  /// Get the number of grid points in the table.
+  const size_t size() const { return entries_.size(); }
+
+  /// Get the number of grid points where the optimization converges.
+  const size_t validSize() const {
+    size_t num = 0;
+    for (const Entry& entry : entries_) if (entry.sf > 0.0) ++num;
+    return num;
+  }
+
+  /// Check if the table is loaded from a cache file.
+  const bool cached() const { return cached_; }
+
+  /**
+   * \brief Get the initial guess for the given boundary conditions, which
+   *        is the path stored at the closest grid point.
+   *
+   * All inputs are in the right handed local frame of the start.
+   *
+   * \return The initial guess, or nothing if the boundary conditions are
+   *         outside the table or the closest grid point has no valid path.
+   */
+  boost::optional<NonHolonomicPath> guess(const double dx,
+                                          const double dy,
+                                          const double dtheta,
+                                          const double kappa0,
+                                          const double kappaf) const {
+    const std::array<double, 5> values{{dx, dy, dtheta, kappa0, kappaf}};
+    size_t index = 0;
+    size_t stride = 1;
+    for (size_t i = 0; i < 5; ++i) {
+      const int idx = axes_[i].index(values[i]);
+      if (idx < 0) return boost::none;
+      index += stride * idx;
+      stride *= axes_[i].num;
+    }
+
+    const Entry& entry = entries_[index];
+    if (entry.sf <= 0.0) return boost::none;
+    return NonHolonomicPath(kappa0, entry.b, entry.c, entry.d, entry.sf);
+  }
+
+protected:
+
+  /// Optimize the paths at all grid points.
+  void generate() {
+
+    size_t num_entries = 1;
+    for (const Axis& axis : axes_) num_entries *= axis.num;
+    entries_.assign(num_entries, Entry{0.0, 0.0, 0.0, 0.0});
+
+    for (size_t index = 0; index < num_entries; ++index) {
+
+      // Recover the boundary conditions of this grid point.
+      std::array<uint32_t, 5> idx;
+      size_t remainder = index;
+      for (size_t i = 0; i < 5; ++i) {
+        idx[i] = remainder % axes_[i].num;
+        remainder /= axes_[i].num;
+      }
+
+      const NonHolonomicPath::State start(0.0, 0.0, 0.0, axes_[3].value(idx[3]));
+      const NonHolonomicPath::State end(axes_[0].value(idx[0]),
+                                        axes_[1].value(idx[1]),
+                                        axes_[2].value(idx[2]),
+                                        axes_[4].value(idx[4]));
+
+      // The neighbor with smaller dx, or smaller dy, which has been solved already.
+      boost::optional<NonHolonomicPath> neighbor = boost::none;
+      const size_t neighbor_index =
+        idx[0] > 0 ? index-1 : (idx[1] > 0 ? index-axes_[0].num : index);
+      if (neighbor_index != index && entries_[neighbor_index].sf > 0.0) {
+        const Entry& entry = entries_[neighbor_index];
+        neighbor = NonHolonomicPath(start.kappa, entry.b, entry.c, entry.d, entry.sf);
+      }
+
+      NonHolonomicPath path;
+      bool success = path.optimizePath(start, end);
+      if (!success && neighbor) success = path.optimizePath(start, end, neighbor);
+      if (success) entries_[index] = Entry{path.b, path.c, path.d, path.sf};
+    }
+
+    cached_ = false;
+    return;
+  }
+
+  /**
+   * \brief Load the table from the cache file.
+   * \param[in] path Path to the cache file.
+   * \return False if the cache file does not exist, or is invalid or outdated.
+   */
+  bool loadCache(const std::string& path) {
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    CacheHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(CacheHeader));
+    if (!file ||
+        std::memcmp(header.magic, "CLPPWTAB", sizeof(header.magic)) != 0 ||
+        header.version != kCacheVersion_) {
+      return false;
+    }
+
+    size_t num_entries = 1;
+    for (size_t i = 0; i < 5; ++i) {
+      const Axis axis{header.axes[i][0], header.axes[i][1],
+                      static_cast<uint32_t>(header.axes[i][2])};
+      if (!(axis == axes_[i])) return false;
+      num_entries *= axis.num;
+    }
+    if (header.num_entries != num_entries) return false;
+
+    std::vector<Entry> entries(num_entries);
+    file.read(reinterpret_cast<char*>(entries.data()), num_entries*sizeof(Entry));
+    if (!file) return false;
+
+    entries_.swap(entries);
+    cached_ = true;
+    return true;
+  }
+
+  /**
+   * \brief Save the table into the cache file.
+   *
+   * The file is first written with a temporary name and then renamed,
+   * so that other processes never see a partially written table.
+   *
+   * \param[in] directory The directory of the cache file, which is created
+   *                      if it does not exist.
+   * \param[in] path Path to the cache file.
+   * \return False if the cache file cannot be written.
+   */
+  bool saveCache(const std::string& directory, const std::string& path) const {
+
+    mkdir(directory.c_str(), 0755);
+    const std::string tmp_path = (boost::format("%1%.%2%.tmp") % path % getpid()).str();
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(CacheHeader));
+    std::memcpy(header.magic, "CLPPWTAB", sizeof(header.magic));
+    header.version = kCacheVersion_;
+    for (size_t i = 0; i < 5; ++i) {
+      header.axes[i][0] = axes_[i].min;
+      header.axes[i][1] = axes_[i].max;
+      header.axes[i][2] = axes_[i].num;
+    }
+    header.num_entries = entries_.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+    file.write(reinterpret_cast<const char*>(entries_.data()), entries_.size()*sizeof(Entry));
+
+    file.close();
+    if (!file || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+}; // End class PathWarmStartTable.
+
+} // End namespace planner.
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <boost/optional.hpp>
+
+namespace planner {
+
+/**
+ * \brief PlanningDeadline keeps track of the time budget of a planning cycle.
+ *
+ * The graph construction within a planner is broken into steps, e.g.
+ * expanding a vertex or a layer of stations. A step is only started if it is
+ * expected to finish before the deadline, where the expected time is
+ * predicted from the most expensive step finished so far.
+ *
+ * The first step is always allowed, so that the planner can return at least
+ * some path even if the budget is too small.
+ */
+class PlanningDeadline {
+
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+protected:
+
+  /// The deadline, or \c boost::none if the planning time is not limited.
+  boost::optional<Clock::time_point> deadline_ = boost::none;
+
+  /// The start of the current step.
+  Clock::time_point step_start_;
+
+  /// The time (s) of the most expensive work item in the finished steps.
+  /// This is \c boost::none if no step has been finished yet.
+  boost::optional<double> item_time_ = boost::none;
+
+public:
+
+  /// Create a deadline which never expires.
+  PlanningDeadline() {}
+
+  /**
+   * \brief Start the clock with the given time budget.
+   * \param[in] time_budget The time budget (s). The deadline never expires
+   *                        if the budget is infinity.
+   */
+  explicit PlanningDeadline(const double time_budget) {
+    if (!std::isfinite(time_budget)) return;
+    deadline_ = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(time_budget));
+    return;
+  }
+
+  /// Whether the planning time is limited.
+  const bool limited() const { return static_cast<bool>(deadline_); }
+
+  /// The time (s) left before the deadline, which is infinity if not limited.
+  const double remainingTime() const {
+    if (!deadline_) return std::numeric_limits<double>::infinity();
+    return std::chrono::duration<double>(*deadline_-Clock::now()).count();
+  }
+
+  /// Mark the start of a step.
+  void startStep() { step_start_ = Clock::now(); }
+
+  /**
+   * \brief Mark the end of the current step.
+   * \param[in] items The number of work items, e.g. vertices, in the step.
+   */
+  void finishStep(const size_t items = 1) {
+    const double step_time =
+      std::chrono::duration<double>(Clock::now()-step_start_).count();
+    const double item_time = step_time / static_cast<double>(std::max<size_t>(items, 1));
+    item_time_ = item_time_ ? std::max(*item_time_, item_time) : item_time;
+    return;
+  }
+
+  /**
+   * \brief Check whether the next step is expected to finish before the deadline.
+   * \param[in] items The number of work items in the next step.
+   */
+  const bool allowsNextStep(const size_t items = 1) const {
+    if (!deadline_ || !item_time_) return true;
+    return remainingTime() > *item_time_ * static_cast<double>(items);
+  }
+
+}; // End class PlanningDeadline.
+
+} // End namespace planner.
@@ -0,0 +1,342 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <unistd.h>
+
+namespace utils {
+
+/**
+ * \brief Profiler collects the scoped timers and counters of a planning cycle.
+ *
+ * The timers and counters are placed in the planners with \c CLP_PROFILE_SCOPE()
+ * and \c CLP_PROFILE_COUNT(), which are compiled out unless \c CLP_PROFILING
+ * is defined (the \c CLP_PROFILING CMake option).
+ *
+ * Only the scopes in between \c beginCycle() and \c endCycle() are recorded,
+ * so that processes which never start a cycle, e.g. the simulator, pay no
+ * more than an atomic load per scope. Each thread records into its own buffer.
+ * The cycle should be started and ended while no other thread is in a scope,
+ * which holds for the thread pool used by the planners since it is idle in
+ * between the planning cycles.
+ */
+class Profiler : private boost::noncopyable {
+
+public:
+
+  /// Whether the scoped timers and counters are compiled in.
+#ifdef CLP_PROFILING
+  static constexpr bool kEnabled = true;
+#else
+  static constexpr bool kEnabled = false;
+#endif
+
+  /// A scope entered in the cycle.
+  struct Event {
+    /// Name of the scope, which must be a string literal.
+    const char* name;
+    /// Index of the enclosing scope in the same thread, -1 if there is none.
+    int32_t parent;
+    /// Start and end time (ns) since the profiler is created.
+    int64_t start;
+    int64_t end;
+  };
+
+  /// Aggregated time of all the scopes with the same path in the cycle.
+  struct Entry {
+    /// Names of the nested scopes joined by '/'.
+    std::string path;
+    /// Number of times the scope is entered.
+    size_t calls = 0;
+    /// Total wall time (s).
+    double time = 0.0;
+  };
+
+protected:
+
+  struct ThreadBuffer {
+    /// Index of the thread, in the order the threads first enter a scope.
+    uint32_t thread = 0;
+    std::vector<Event> events;
+    /// Index of the innermost open scope.
+    int32_t current = -1;
+    std::unordered_map<const char*, int64_t> counters;
+  };
+
+  /// The buffers of all the threads, which are never released.
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+
+  /// Protects \c buffers_.
+  mutable std::mutex buffers_mutex_;
+
+  /// Set in between \c beginCycle() and \c endCycle().
+  std::atomic<bool> active_{false};
+
+  const std::chrono::steady_clock::time_point epoch_ = std::chrono::steady_clock::now();
+
+  int64_t cycle_start_ = 0;
+  int64_t cycle_end_ = 0;
+
+public:
+
+  /// The profiler shared by all the planners in the process.
+  static Profiler& instance() {
+    static Profiler profiler;
+    return profiler;
+  }
+
+  /// Whether a cycle is being recorded.
+  bool active() const { return active_.load(std::memory_order_relaxed); }
+
+  /// Clear the records of the last cycle, and start recording.
+  void beginCycle() {
+    std::lock_guard<std::mutex> buffers_lock(buffers_mutex_);
+    for (const auto& buffer : buffers_) {
+      buffer->events.clear();
+      buffer->current = -1;
+      buffer->counters.clear();
+    }
+    cycle_start_ = now();
+    cycle_end_ = cycle_start_;
+    active_.store(true);
+    return;
+  }
+
+  /// Stop recording.
+  void endCycle() {
+    active_.store(false);
+    cycle_end_ = now();
+    return;
+  }
+
+  /// Wall time of the last cycle (s).
+  double cycleTime() const { return (cycle_end_-cycle_start_) * 1.0e-9; }
+
+  /// Enter a scope, returning the index of the event, or -1 if not recording.
+  int32_t begin(const char* name) {
+    if (!active()) return -1;
+    ThreadBuffer& buffer = threadBuffer();
+    buffer.events.push_back(Event{name, buffer.current, now(), 0});
+    buffer.current = buffer.events.size() - 1;
+    return buffer.current;
+  }
+
+  /// Leave the scope returned by \c begin().
+  void end(const int32_t index) {
+    if (index < 0 || !active()) return;
+    ThreadBuffer& buffer = threadBuffer();
+    buffer.events[index].end = now();
+    buffer.current = buffer.events[index].parent;
+    return;
+  }
+
+  /// Add to a counter.
+  void count(const char* name, const int64_t n = 1) {
+    if (!active()) return;
+    threadBuffer().counters[name] += n;
+    return;
+  }
+
+  /**
+   * \brief Aggregate the scopes of the last cycle by their paths.
+   *
+   * The scopes entered on a worker thread have no enclosing scope, since
+   * they are not nested in the scopes of the thread submitting the task.
+   *
+   * \return The entries sorted by path, so that a scope is followed by its
+   *         nested scopes.
+   */
+  std::vector<Entry> breakdown() const {
+    std::lock_guard<std::mutex> buffers_lock(buffers_mutex_);
+
+    std::map<std::string, Entry> entries;
+    for (const auto& buffer : buffers_) {
+      // The enclosing scope always comes before the nested ones.
+      std::vector<std::string> paths(buffer->events.size());
+      for (size_t i = 0; i < buffer->events.size(); ++i) {
+        const Event& event = buffer->events[i];
+        paths[i] = event.parent < 0 ?
+          std::string(event.name) : paths[event.parent] + "/" + event.name;
+        if (event.end < event.start) continue;
+
+        Entry& entry = entries[paths[i]];
+        entry.path = paths[i];
+        ++entry.calls;
+        entry.time += (event.end-event.start) * 1.0e-9;
+      }
+    }
+
+    std::vector<Entry> breakdown;
+    breakdown.reserve(entries.size());
+    for (const auto& entry : entries) breakdown.push_back(entry.second);
+    return breakdown;
+  }
+
+  /// The counters of the last cycle summed over all the threads, sorted by name.
+  std::vector<std::pair<std::string, int64_t>> counters() const {
+    std::lock_guard<std::mutex> buffers_lock(buffers_mutex_);
+    const std::map<std::string, int64_t> counters = sumCounters();
+    return std::vector<std::pair<std::string, int64_t>>(counters.begin(), counters.end());
+  }
+
+  /**
+   * \brief Write the scopes and counters of the last cycle as the events of a
+   *        Chrome trace (chrome://tracing), in the JSON array format.
+   * \param[in] os The output stream.
+   * \param[in] first Whether no event has been written to the stream, in
+   *                  which case the events are not preceded by a comma.
+   * \return Whether any event is written.
+   */
+  bool writeChromeTrace(std::ostream& os, const bool first) const {
+    std::lock_guard<std::mutex> buffers_lock(buffers_mutex_);
+
+    const int pid = ::getpid();
+    bool written = false;
+    for (const auto& buffer : buffers_) {
+      for (const Event& event : buffer->events) {
+        if (event.end < event.start) continue;
+        if (written || !first) os << ",\n";
+        os << boost::format(
+            "{\"name\":\"%1%\",\"ph\":\"X\",\"ts\":%2$.3f,\"dur\":%3$.3f,\"pid\":%4%,\"tid\":%5%}")
+          % event.name % (event.start*1.0e-3) % ((event.end-event.start)*1.0e-3)
+          % pid % buffer->thread;
+        written = true;
+      }
+    }
+
+    for (const auto& counter : sumCounters()) {
+      if (written || !first) os << ",\n";
+      os << boost::format(
+          "{\"name\":\"%1%\",\"ph\":\"C\",\"ts\":%2$.3f,\"pid\":%3%,\"args\":{\"count\":%4%}}")
+        % counter.first % (cycle_end_*1.0e-3) % pid % counter.second;
+      written = true;
+    }
+    return written;
+  }
+
+protected:
+
+  Profiler() = default;
+
+  /// Sum the counters over the threads. \c buffers_mutex_ should be locked.
+  std::map<std::string, int64_t> sumCounters() const {
+    std::map<std::string, int64_t> counters;
+    for (const auto& buffer : buffers_) {
+      for (const auto& counter : buffer->counters)
+        counters[counter.first] += counter.second;
+    }
+    return counters;
+  }
+
+  int64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now()-epoch_).count();
+  }
+
+  ThreadBuffer& threadBuffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+      std::lock_guard<std::mutex> buffers_lock(buffers_mutex_);
+      buffers_.emplace_back(new ThreadBuffer());
+      buffer = buffers_.back().get();
+      buffer->thread = buffers_.size() - 1;
+    }
+    return *buffer;
+  }
+
+}; // End class Profiler.
+
+/// Records the time from its construction to its destruction as a scope.
+class ScopedTimer : private boost::noncopyable {
+
+protected:
+
+  const int32_t index_;
+
+public:
+
+  ScopedTimer(const char* name) : index_(Profiler::instance().begin(name)) {}
+
+  ~ScopedTimer() { Profiler::instance().end(index_); }
+
+}; // End class ScopedTimer.
+
+/**
+ * \brief ChromeTraceWriter streams the planning cycles into a Chrome trace file.
+ *
+ * The file is valid once the writer is destroyed. Chrome can also load the
+ * file before that, since the closing bracket of the JSON array format is optional.
+ */
+class ChromeTraceWriter : private boost::noncopyable {
+
+protected:
+
+  std::ofstream file_;
+
+  /// Whether no event has been written.
+  bool first_ = true;
+
+public:
+
+  ChromeTraceWriter(const std::string& path) : file_(path, std::ios::trunc) {
+    if (!file_.is_open()) {
+      throw std::runtime_error((boost::format(
+            "ChromeTraceWriter::ChromeTraceWriter(): "
+            "cannot open %1% for writing.\n") % path).str());
+    }
+    file_ << "[\n";
+  }
+
+  ~ChromeTraceWriter() { file_ << "\n]\n"; }
+
+  /// Append the last cycle of the profiler.
+  void write(const Profiler& profiler) {
+    if (profiler.writeChromeTrace(file_, first_)) first_ = false;
+    file_.flush();
+    return;
+  }
+
+}; // End class ChromeTraceWriter.
+
+} // End namespace utils.
+
+#define CLP_PROFILE_CONCAT_IMPL(a, b) a##b
+#define CLP_PROFILE_CONCAT(a, b) CLP_PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef CLP_PROFILING
+/// Time the rest of the enclosing scope. The name must be a string literal.
+#define CLP_PROFILE_SCOPE(name) \
+  ::utils::ScopedTimer CLP_PROFILE_CONCAT(clp_scoped_timer_, __LINE__)(name)
+/// Add to a counter. The name must be a string literal.
+#define CLP_PROFILE_COUNT(name, n) ::utils::Profiler::instance().count(name, n)
+#else
+#define CLP_PROFILE_SCOPE(name) do {} while (false)
+#define CLP_PROFILE_COUNT(name, n) do {} while (false)
+#endif
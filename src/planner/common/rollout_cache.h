@@ -0,0 +1,252 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <boost/optional.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <planner/common/snapshot.h>
+
+namespace planner {
+
+/**
+ * \brief RolloutCache keeps the traffic simulations of the graph edges
+ *        across planning cycles.
+ *
+ * In a receding horizon, consecutive planning cycles rebuild mostly the same
+ * graph. The edges between two stations are simulated from almost the same
+ * snapshots in every cycle, except the ones from the root and the ones at the
+ * end of the lattice, which is the new frontier.
+ *
+ * An edge is identified by the node of its start station, the target node,
+ * and an option, e.g. the lane change type and the ego acceleration. A cached
+ * simulation of the edge is reused if the snapshot at its start is within the
+ * tolerances of the query snapshot, i.e. the ego and every agent are at almost
+ * the same states. Since a reused edge leads to the cached end snapshot, the
+ * edges further down the graph are then likely to be reused as well.
+ *
+ * The cache only remembers the simulations used in the current and the last
+ * planning cycles. The rest are dropped at \c nextCycle().
+ *
+ * The cache is safe to be used from multiple threads.
+ */
+class RolloutCache : private boost::noncopyable {
+
+public:
+
+  /**
+   * \brief The result of simulating an edge.
+   *
+   * The pair stores the snapshot at the end of the simulation and the stage
+   * cost. It is \c boost::none if the simulation fails, e.g. collision.
+   */
+  using Rollout = boost::optional<std::pair<Snapshot, double>>;
+
+  /// Identifies an edge on the graph.
+  struct Key {
+    size_t start_node;
+    size_t target_node;
+    size_t option;
+
+    bool operator==(const Key& other) const {
+      return start_node  == other.start_node  &&
+             target_node == other.target_node &&
+             option      == other.option;
+    }
+  };
+
+protected:
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      size_t seed = 0;
+      boost::hash_combine(seed, key.start_node);
+      boost::hash_combine(seed, key.target_node);
+      boost::hash_combine(seed, key.option);
+      return seed;
+    }
+  };
+
+  /// Stores the snapshot at the start of an edge and the simulation result.
+  using Entry = std::pair<Snapshot, Rollout>;
+  using Table = std::unordered_map<Key, std::vector<Entry>, KeyHash>;
+
+protected:
+
+  /// Maximum number of simulations kept for the same edge in a cycle.
+  static constexpr size_t kMaxEntriesPerKey_ = 4;
+
+  /// Tolerance of the vehicle positions (m).
+  double position_tolerance_;
+
+  /// Tolerance of the vehicle speeds (m/s).
+  double speed_tolerance_;
+
+  /// Tolerance of the vehicle accelerations (m/s^2).
+  double acceleration_tolerance_;
+
+  /// Simulations used in the current cycle.
+  Table current_;
+
+  /// Simulations used in the last cycle.
+  Table previous_;
+
+  /// Number of simulations served from the cache.
+  size_t hits_ = 0;
+
+  /// Number of simulations which have to be run.
+  size_t misses_ = 0;
+
+  /// Protects all of the above.
+  mutable std::mutex mutex_;
+
+public:
+
+  /**
+   * \brief Class constructor.
+   * \param[in] position_tolerance Tolerance of the vehicle positions (m).
+   * \param[in] speed_tolerance Tolerance of the vehicle speeds (m/s).
+   * \param[in] acceleration_tolerance Tolerance of the vehicle accelerations (m/s^2).
+   */
+  RolloutCache(const double position_tolerance = 0.5,
+               const double speed_tolerance = 0.2,
+               const double acceleration_tolerance = 0.2) :
+    position_tolerance_(position_tolerance),
+    speed_tolerance_(speed_tolerance),
+    acceleration_tolerance_(acceleration_tolerance) {}
+
+  /**
+   * \brief Get the simulation result of an edge starting from the given snapshot.
+   *
+   * \param[in] key The edge to be simulated.
+   * \param[in] snapshot The snapshot at the start of the edge.
+   * \param[in] simulate Called as \c simulate() to run the simulation if no
+   *                     cached result can be reused. This is run without
+   *                     holding the lock.
+   * \return The simulation result.
+   */
+  template<typename Simulate>
+  Rollout rollout(const Key& key, const Snapshot& snapshot, const Simulate& simulate) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const Rollout* cached = find(current_, key, snapshot);
+      if (cached) {
+        ++hits_;
+        return *cached;
+      }
+
+      cached = find(previous_, key, snapshot);
+      if (cached) {
+        ++hits_;
+        const Rollout rollout = *cached;
+        insert(key, snapshot, rollout);
+        return rollout;
+      }
+      ++misses_;
+    }
+
+    const Rollout rollout = simulate();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert(key, snapshot, rollout);
+    return rollout;
+  }
+
+  /// Start a new planning cycle, forgetting the simulations not used in the last one.
+  void nextCycle() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    previous_.swap(current_);
+    current_.clear();
+    return;
+  }
+
+  /// Number of simulations served from the cache.
+  size_t hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+  }
+
+  /// Number of simulations which have to be run.
+  size_t misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+  }
+
+  /// Remove all simulations from the cache and reset the counters.
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_.clear();
+    previous_.clear();
+    hits_ = 0;
+    misses_ = 0;
+    return;
+  }
+
+  /// Check whether two snapshots are within the tolerances of each other.
+  const bool similar(const Snapshot& snapshot1, const Snapshot& snapshot2) const {
+    if (!similar(snapshot1.ego(), snapshot2.ego())) return false;
+
+    const VehicleTable& agents1 = snapshot1.agents();
+    const VehicleTable& agents2 = snapshot2.agents();
+    // Copies of the same snapshot share the agents.
+    if (&agents1 == &agents2) return true;
+    if (agents1.size() != agents2.size()) return false;
+
+    for (size_t i = 0; i < agents1.size(); ++i) {
+      const size_t j = agents2.slot(agents1.ids()[i]);
+      if (j >= agents2.size()) return false;
+      if (!similar(agents1.vehicle(i), agents2.vehicle(j))) return false;
+    }
+
+    return true;
+  }
+
+protected:
+
+  template<typename T1, typename T2>
+  const bool similar(const T1& vehicle1, const T2& vehicle2) const {
+    return vehicle1.transform().location.Distance(
+             vehicle2.transform().location) <= position_tolerance_ &&
+           std::fabs(vehicle1.speed()-vehicle2.speed()) <= speed_tolerance_ &&
+           std::fabs(vehicle1.acceleration()-vehicle2.acceleration()) <=
+             acceleration_tolerance_ &&
+           vehicle1.policySpeed() == vehicle2.policySpeed();
+  }
+
+  const Rollout* find(const Table& table, const Key& key, const Snapshot& snapshot) const {
+    auto iter = table.find(key);
+    if (iter == table.end()) return nullptr;
+    for (const Entry& entry : iter->second) {
+      if (similar(entry.first, snapshot)) return &(entry.second);
+    }
+    return nullptr;
+  }
+
+  void insert(const Key& key, const Snapshot& snapshot, const Rollout& rollout) {
+    std::vector<Entry>& entries = current_[key];
+    if (entries.size() >= kMaxEntriesPerKey_) entries.erase(entries.begin());
+    entries.emplace_back(snapshot, rollout);
+    return;
+  }
+
+}; // End class RolloutCache.
+
+} // End namespace planner.
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <limits>
+#include <string>
+
+namespace utils {
+
+/**
+ * \brief CounterRandomEngine is a counter-based random number engine.
+ *
+ * The n-th number of the engine is a hash of its key and n, so that engines
+ * with different keys are independent streams, and an engine can be created
+ * anywhere with just its key. The hash is the finalizer of SplitMix64.
+ *
+ * The engine meets the requirements of a uniform random bit generator,
+ * so it works with the distributions in \c <random>.
+ */
+class CounterRandomEngine {
+
+public:
+
+  using result_type = uint64_t;
+
+protected:
+
+  uint64_t key_ = 0;
+  uint64_t counter_ = 0;
+
+public:
+
+  CounterRandomEngine(const uint64_t key = 0) : key_(key) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  result_type operator()() { return mix(key_ + 0x9e3779b97f4a7c15ull*(++counter_)); }
+
+  /// Skip the next n numbers.
+  void discard(const uint64_t n) { counter_ += n; }
+
+  const uint64_t key() const { return key_; }
+
+  static uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+}; // End class CounterRandomEngine.
+
+/**
+ * \brief ScenarioSeed derives the random streams of a scenario from one seed.
+ *
+ * Every component, e.g. the traffic spawner or the agent policies, asks for
+ * its own streams by name and index (typically the vehicle), so that the
+ * random numbers of a component do not depend on how many numbers the other
+ * components have drawn. Running a scenario with the same master seed
+ * therefore reproduces the same traffic.
+ */
+class ScenarioSeed {
+
+protected:
+
+  uint64_t seed_ = 0;
+
+public:
+
+  ScenarioSeed(const uint64_t seed = 0) : seed_(seed) {}
+
+  /// Create the seed from a parameter, where a negative value means
+  /// a seed from the clock, i.e. the scenario differs every run.
+  /// The seed from the clock is within [0, INT_MAX], so that it can be
+  /// set back as a (32-bit) ROS parameter to replay the scenario.
+  static ScenarioSeed fromParam(const int64_t seed) {
+    if (seed >= 0) return ScenarioSeed(seed);
+    return ScenarioSeed(CounterRandomEngine::mix(
+          std::chrono::system_clock::now().time_since_epoch().count()) &
+        static_cast<uint64_t>(std::numeric_limits<int>::max()));
+  }
+
+  /// The master seed, which should be logged to replay the scenario.
+  const uint64_t seed() const { return seed_; }
+
+  /// Get the random stream with the given name and index.
+  CounterRandomEngine stream(const std::string& name, const uint64_t index = 0) const {
+    // FNV-1a hash of the name, which is stable across platforms and runs
+    // unlike std::hash.
+    uint64_t name_hash = 0xcbf29ce484222325ull;
+    for (const char c : name) {
+      name_hash ^= static_cast<unsigned char>(c);
+      name_hash *= 0x100000001b3ull;
+    }
+
+    const uint64_t key = CounterRandomEngine::mix(
+        CounterRandomEngine::mix(seed_ ^ name_hash) + index);
+    return CounterRandomEngine(key);
+  }
+
+}; // End class ScenarioSeed.
+
+} // End namespace utils.
@@ -13,32 +13,55 @@
 */
 
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <stdexcept>
 #include <unordered_set>
 #include <boost/format.hpp>
 
 #include <planner/common/snapshot.h>
+#include <planner/common/profiler.h>
 
 namespace planner {
 
+namespace {
+
+/// The farthest distance a vehicle can travel within the horizon, by
+/// accelerating at \c accel until its speed reaches \c max_speed.
+double maxTravelDistance(const double speed, const double max_speed,
+                         const double accel, const double horizon) {
+  if (speed >= max_speed) return speed * horizon;
+  const double accel_time = std::min((max_speed-speed)/accel, horizon);
+  return speed*accel_time + 0.5*accel*accel_time*accel_time +
+         max_speed*(horizon-accel_time);
+}
+
+} // End anonymous namespace.
+
 Snapshot::Snapshot(
     const Vehicle& ego,
     const std::unordered_map<size_t, Vehicle>& agents,
     const boost::shared_ptr<router::Router>& router,
     const boost::shared_ptr<CarlaMap>& map,
-    const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+    const boost::shared_ptr<utils::ThreadPool>& thread_pool) :
   ego_(ego),
-  agents_(agents) {
+  agents_(boost::make_shared<VehicleTable>(agents)) {
+  CLP_PROFILE_SCOPE("Snapshot::Snapshot");
 
   // Collect all vehicles into an array of tuples.
   std::vector<std::tuple<size_t, CarlaTransform, CarlaBoundingBox>> vehicles;
   vehicles.push_back(ego_.tuple());
-  for (const auto& agent : agents_) vehicles.push_back(agent.second.tuple());
+  for (const ConstVehicleView agent : *agents_) vehicles.push_back(agent.tuple());
+
+  // Resolve the waypoints of the vehicles before generating the waypoint lattice.
+  const std::unordered_map<size_t, TrafficLattice::VehicleWaypoints> vehicle_waypoints =
+    TrafficLattice::resolveVehicleWaypoints(vehicles, fast_map, thread_pool);
 
   // Generate the waypoint lattice.
   std::unordered_set<size_t> disappear_vehicles;
   traffic_lattice_ = boost::make_shared<TrafficLattice>(
-      vehicles, map, fast_map, router, disappear_vehicles);
+      vehicles, vehicle_waypoints, map, fast_map, router, disappear_vehicles);
 
   // Remove the disappeared vehicles.
   if (disappear_vehicles.count(ego_.id()) != 0) {
@@ -50,7 +73,7 @@ Snapshot::Snapshot(
   }
 
   for (const size_t agent : disappear_vehicles)
-    agents_.erase(agent);
+    agents_->erase(agent);
 
   return;
 }
@@ -58,49 +81,184 @@ Snapshot::Snapshot(
 Snapshot::Snapshot(const Snapshot& other) :
   ego_(other.ego_),
   agents_(other.agents_),
-  traffic_lattice_(boost::make_shared<TrafficLattice>(*(other.traffic_lattice_))) {}
+  traffic_lattice_(other.traffic_lattice_) {}
 
 Snapshot& Snapshot::operator=(const Snapshot& other) {
   ego_ = other.ego_;
   agents_ = other.agents_;
-  traffic_lattice_ = boost::make_shared<TrafficLattice>(*(other.traffic_lattice_));
+  traffic_lattice_ = other.traffic_lattice_;
   return *this;
 }
 
-const Vehicle& Snapshot::agent(const size_t id) const {
-  std::unordered_map<size_t, Vehicle>::const_iterator iter = agents_.find(id);
-  if (iter == agents_.end()) {
+void Snapshot::detachAgents() {
+  CLP_PROFILE_SCOPE("Snapshot::detachAgents");
+
+  if (agents_.use_count() > 1)
+    agents_ = boost::make_shared<VehicleTable>(*agents_);
+  return;
+}
+
+void Snapshot::detachTrafficLattice() {
+  CLP_PROFILE_SCOPE("Snapshot::detachTrafficLattice");
+
+  if (traffic_lattice_.use_count() > 1)
+    traffic_lattice_ = boost::make_shared<TrafficLattice>(*traffic_lattice_);
+  return;
+}
+
+ConstVehicleView Snapshot::agent(const size_t id) const {
+  const size_t slot = agents_->slot(id);
+  if (slot == agents_->size()) {
     std::string error_msg = (boost::format(
           "Snapshot::agent(): "
           "the required agent %1% does not exist in the snapshot.\n") % id).str();
     std::string snapshot_msg = this->string();
     throw std::runtime_error(error_msg + snapshot_msg);
   }
-  return iter->second;
+  return static_cast<const VehicleTable&>(*agents_).vehicle(slot);
 }
 
-Vehicle& Snapshot::agent(const size_t id) {
-  std::unordered_map<size_t, Vehicle>::iterator iter = agents_.find(id);
-  if (iter == agents_.end()) {
+VehicleView Snapshot::agent(const size_t id) {
+  detachAgents();
+  const size_t slot = agents_->slot(id);
+  if (slot == agents_->size()) {
     std::string error_msg = (boost::format(
           "Snapshot::agent(): "
           "the required agent %1% does not exist in the snapshot.\n") % id).str();
     std::string snapshot_msg = this->string();
     throw std::runtime_error(error_msg + snapshot_msg);
   }
-  return iter->second;
+  return agents_->vehicle(slot);
 }
 
-const Vehicle& Snapshot::vehicle(const size_t id) const {
-  if (id == ego_.id()) return ego_;
+ConstVehicleView Snapshot::vehicle(const size_t id) const {
+  if (id == ego_.id()) return vehicleView(ego_);
   else return agent(id);
 }
 
-Vehicle& Snapshot::vehicle(const size_t id) {
-  if (id == ego_.id()) return ego_;
+VehicleView Snapshot::vehicle(const size_t id) {
+  if (id == ego_.id()) return vehicleView(ego_);
   else return agent(id);
 }
 
+const size_t Snapshot::cullAgents(
+    const double horizon, const IntelligentDriverModel& idm) {
+  CLP_PROFILE_SCOPE("Snapshot::cullAgents");
+
+  // The range of the lattice the ego may reach over the horizon,
+  // including the gap it keeps to a leader.
+  const boost::optional<std::pair<double, double>> ego_span =
+    traffic_lattice_->vehicleSpan(ego_.id());
+  if (!ego_span) {
+    std::string error_msg(
+        "Snapshot::cullAgents(): "
+        "the ego vehicle is not on the traffic lattice.\n");
+    std::string snapshot_msg = this->string();
+    throw std::runtime_error(error_msg + snapshot_msg);
+  }
+
+  const double ego_max_speed = std::max(ego_.speed(), ego_.policySpeed());
+  const double ego_back = ego_span->first;
+  const double ego_front = ego_span->second +
+    maxTravelDistance(ego_.speed(), ego_max_speed, idm.maxAccel(), horizon) +
+    idm.distanceGap() + idm.timeGap()*ego_max_speed;
+
+  // Find the agents whose reachable range overlaps with the one of the ego.
+  std::unordered_set<size_t> relevant_vehicles;
+  relevant_vehicles.insert(ego_.id());
+  for (const ConstVehicleView agent : *agents_) {
+    const boost::optional<std::pair<double, double>> span =
+      traffic_lattice_->vehicleSpan(agent.id());
+    // Agents should always be on the lattice, keep the ones that are not.
+    if (!span) { relevant_vehicles.insert(agent.id()); continue; }
+
+    const double max_speed = std::max(agent.speed(), agent.policySpeed());
+    const double back = span->first;
+    const double front = span->second +
+      maxTravelDistance(agent.speed(), max_speed, idm.maxAccel(), horizon) +
+      idm.distanceGap() + idm.timeGap()*max_speed;
+    if (front >= ego_back && back <= ego_front) relevant_vehicles.insert(agent.id());
+  }
+
+  // Keep the leaders of the relevant vehicles.
+  std::vector<size_t> leaders;
+  for (const size_t vehicle : relevant_vehicles) {
+    if (!traffic_lattice_->vehicleSpan(vehicle)) continue;
+    const boost::optional<std::pair<size_t, double>> leader =
+      traffic_lattice_->front(vehicle);
+    if (leader) leaders.push_back(leader->first);
+  }
+  relevant_vehicles.insert(leaders.begin(), leaders.end());
+
+  std::vector<size_t> culled_agents;
+  for (const size_t agent : agents_->ids()) {
+    if (relevant_vehicles.count(agent) == 0) culled_agents.push_back(agent);
+  }
+  CLP_PROFILE_COUNT("Snapshot::culledAgents", static_cast<int64_t>(culled_agents.size()));
+  if (culled_agents.empty()) return 0;
+
+  // The agent table and the traffic lattice are about to be modified.
+  detachAgents();
+  detachTrafficLattice();
+  for (const size_t agent : culled_agents) {
+    agents_->erase(agent);
+    traffic_lattice_->deleteVehicle(agent);
+  }
+
+  return culled_agents.size();
+}
+
+const size_t Snapshot::restoreCulledAgents(const Snapshot& start, const double time) {
+  CLP_PROFILE_SCOPE("Snapshot::restoreCulledAgents");
+
+  std::vector<Vehicle> culled_agents;
+  for (const ConstVehicleView agent : start.agents()) {
+    if (agent.id() == ego_.id() || agents_->count(agent.id()) != 0) continue;
+    culled_agents.push_back(agent);
+  }
+  if (culled_agents.empty()) return 0;
+
+  // The agent table and the traffic lattice are about to be modified.
+  detachAgents();
+  detachTrafficLattice();
+
+  const boost::shared_ptr<router::Router>& router = traffic_lattice_->router();
+  const boost::shared_ptr<const utils::FastWaypointMap>& fast_map = traffic_lattice_->fastMap();
+
+  size_t restored_agents = 0;
+  for (Vehicle& agent : culled_agents) {
+    // The agent keeps its acceleration until it stops.
+    double movement = 0.0;
+    double speed = agent.speed() + agent.acceleration()*time;
+    if (speed < 0.0) {
+      movement = -0.5*agent.speed()*agent.speed()/agent.acceleration();
+      speed = 0.0;
+    } else {
+      movement = agent.speed()*time + 0.5*agent.acceleration()*time*time;
+    }
+
+    // Move the agent along its lane, preferring the route as the simulations do.
+    boost::shared_ptr<CarlaWaypoint> waypoint = fast_map->waypoint(agent.transform().location);
+    if (!waypoint) continue;
+    if (movement > 0.0) {
+      boost::shared_ptr<CarlaWaypoint> next_waypoint = router->tryFrontWaypoint(waypoint, movement);
+      if (!next_waypoint) next_waypoint = router->nextWaypoint(waypoint, movement);
+      if (!next_waypoint) continue;
+      waypoint = next_waypoint;
+    }
+
+    agent.transform() = waypoint->GetTransform();
+    agent.speed() = speed;
+    agent.curvature() = fast_map->curvature(waypoint);
+
+    if (traffic_lattice_->addVehicle(vehicleView(agent).tuple()) != 1) continue;
+    agents_->insert(agent);
+    ++restored_agents;
+  }
+
+  return restored_agents;
+}
+
 bool Snapshot::updateTraffic(
     const std::vector<std::tuple<size_t, CarlaTransform, double, double, double>>& updates) {
 
@@ -111,6 +269,10 @@ bool Snapshot::updateTraffic(
   for (const auto& update : updates)
     updated_vehicles.insert(std::get<0>(update));
 
+  // The agent table and the traffic lattice are about to be modified.
+  detachAgents();
+  detachTrafficLattice();
+
   // Update the transform, speed, and acceleration for all vehicles.
   for (const auto& update : updates) {
     size_t id; CarlaTransform update_transform;
@@ -127,21 +289,24 @@ bool Snapshot::updateTraffic(
     }
 
     // Update the status for the agent vehicles.
-    std::unordered_map<size_t, Vehicle>::iterator agent_iter = agents_.find(id);
+    const size_t slot = agents_->slot(id);
     // This vehicle is not in the snapshot.
-    if (agent_iter == agents_.end()) continue;
+    if (slot == agents_->size()) continue;
 
-    agent_iter->second.transform() = update_transform;
-    agent_iter->second.speed() = update_speed;
-    agent_iter->second.acceleration() = update_acceleration;
-    agent_iter->second.curvature() = update_curvature;
+    agents_->transforms()[slot] = update_transform;
+    agents_->speeds()[slot] = update_speed;
+    agents_->accelerations()[slot] = update_acceleration;
+    agents_->curvatures()[slot] = update_curvature;
   }
 
   // Update the traffic lattice.
   std::vector<std::tuple<size_t, CarlaTransform, CarlaBoundingBox>> vehicles;
+  vehicles.reserve(agents_->size()+1);
   vehicles.push_back(ego_.tuple());
-  for (const auto& agent : agents_)
-    vehicles.push_back(agent.second.tuple());
+  for (size_t slot = 0; slot < agents_->size(); ++slot) {
+    vehicles.push_back(std::make_tuple(agents_->ids()[slot],
+          agents_->transforms()[slot], agents_->boundingBoxes()[slot]));
+  }
 
   std::unordered_set<size_t> disappear_vehicles;
   const bool no_collision = traffic_lattice_->moveTrafficForward(vehicles, disappear_vehicles);
@@ -156,7 +321,7 @@ bool Snapshot::updateTraffic(
   }
 
   for (const size_t disappear_vehicle : disappear_vehicles)
-    agents_.erase(disappear_vehicle);
+    agents_->erase(disappear_vehicle);
 
   return no_collision;
 }
@@ -21,7 +21,9 @@
 
 #include <router/common/router.h>
 #include <planner/common/vehicle.h>
+#include <planner/common/vehicle_table.h>
 #include <planner/common/traffic_lattice.h>
+#include <planner/common/intelligent_driver_model.h>
 
 namespace planner {
 
@@ -31,6 +33,12 @@ namespace planner {
  *
  * The snapshot objects uses TrafficLattice to bookkeep the relative locations
  * of the vehicles.
+ *
+ * Copying a snapshot is cheap. The agent table and the traffic lattice are
+ * shared among the copies (copy-on-write), and are only duplicated by the
+ * snapshot which is about to modify them, e.g. through the non-const accessors
+ * or \c updateTraffic(). Snapshots which are only read, such as the ones stored
+ * in the vertices/stations of the planners, never pay for the deep copy.
  */
 class Snapshot {
 
@@ -38,6 +46,7 @@ protected:
 
   using CarlaMap         = carla::client::Map;
   using CarlaVehicle     = carla::client::Vehicle;
+  using CarlaWaypoint    = carla::client::Waypoint;
   using CarlaTransform   = carla::geom::Transform;
   using CarlaBoundingBox = carla::geom::BoundingBox;
 
@@ -47,20 +56,30 @@ protected:
   Vehicle ego_;
 
   /// Agents in the micro traffic, i.e. all vechiles other than the ego.
-  //std::vector<Vehicle> agents_;
-  std::unordered_map<size_t, Vehicle> agents_;
+  /// The states are stored as structure of arrays, see \c VehicleTable.
+  /// The table may be shared with other snapshots, see \c detachAgents().
+  boost::shared_ptr<VehicleTable> agents_;
 
   /// Traffic lattice which is used to keep track of the relative
   /// location among the vehicles.
+  /// The lattice may be shared with other snapshots, see \c detachTrafficLattice().
   boost::shared_ptr<TrafficLattice> traffic_lattice_;
 
 public:
 
+  /**
+   * \brief Class constructor.
+   *
+   * With a \c thread_pool, the waypoints of the vehicles are resolved
+   * concurrently before the traffic lattice is built, which pays off
+   * in dense traffic.
+   */
   Snapshot(const Vehicle& ego,
            const std::unordered_map<size_t, Vehicle>& agents,
            const boost::shared_ptr<router::Router>& router,
            const boost::shared_ptr<CarlaMap>& map,
-           const boost::shared_ptr<utils::FastWaypointMap>& fast_map);
+           const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+           const boost::shared_ptr<utils::ThreadPool>& thread_pool = nullptr);
 
   Snapshot(const Snapshot& other);
 
@@ -69,34 +88,82 @@ public:
   const Vehicle& ego() const { return ego_; }
   Vehicle& ego() { return ego_; }
 
-  const std::unordered_map<size_t, Vehicle>& agents() const { return agents_; }
-  std::unordered_map<size_t, Vehicle>& agents() { return agents_; }
+  const VehicleTable& agents() const { return *agents_; }
+  VehicleTable& agents() { detachAgents(); return *agents_; }
 
-  const Vehicle& agent(const size_t id) const;
-  Vehicle& agent(const size_t id);
+  /// The returned views are invalidated once agents are added or removed,
+  /// e.g. by \c updateTraffic().
+  ConstVehicleView agent(const size_t id) const;
+  VehicleView agent(const size_t id);
 
-  const Vehicle& vehicle(const size_t id) const;
-  Vehicle& vehicle(const size_t id);
+  ConstVehicleView vehicle(const size_t id) const;
+  VehicleView vehicle(const size_t id);
 
   const boost::shared_ptr<const TrafficLattice>
     trafficLattice() const { return traffic_lattice_; }
   const boost::shared_ptr<TrafficLattice>
-    trafficLattice() { return traffic_lattice_; }
+    trafficLattice() { detachTrafficLattice(); return traffic_lattice_; }
 
   // The input \c new_transforms should cover every vehicle in the snapshot.
   // The tuple consists of the vehicle ID, transform, speed, acceleration, curvature.
   bool updateTraffic(
       const std::vector<std::tuple<size_t, CarlaTransform, double, double, double>>& transforms);
 
+  /**
+   * \brief Remove the agents which cannot interact with the ego within a time horizon.
+   *
+   * Over the horizon, the ego may occupy the lattice from its current rear
+   * to its current head plus the farthest distance it can travel, and the same
+   * for each agent. The speeds are bounded by the larger of the current and
+   * policy speeds, and the accelerations by \c idm. An agent is kept if its
+   * range, extended by the IDM gap in front of it, overlaps with the range of
+   * the ego extended by the same gap. The leaders of the kept vehicles are kept
+   * as well, since the kept vehicles react to them.
+   *
+   * The traffic lattice itself is not shrunk, so that the lattice is not
+   * rebuilt by the following updates.
+   *
+   * \param[in] horizon The time horizon (s).
+   * \param[in] idm The driver model bounding the motion of the vehicles.
+   * \return The number of removed agents.
+   */
+  const size_t cullAgents(
+      const double horizon,
+      const IntelligentDriverModel& idm = IntelligentDriverModel());
+
+  /**
+   * \brief Add back the agents culled from the snapshot a simulation starts with.
+   *
+   * The snapshot should be the result of simulating a culled copy of \c start,
+   * see \c cullAgents(). Since the culled agents cannot interact with the ego
+   * within the horizon, they are not simulated, but moved along their lanes
+   * with their current speeds and accelerations over the simulated time. The
+   * same as in the simulations, an agent is dropped if it cannot be put back
+   * onto the traffic lattice, e.g. it has left the lattice.
+   *
+   * \param[in] start The snapshot before culling the agents.
+   * \param[in] time The simulated time (s).
+   * \return The number of agents added back.
+   */
+  const size_t restoreCulledAgents(const Snapshot& start, const double time);
+
   std::string string(const std::string& prefix = "") const {
     std::string output = prefix;
     output += ego_.string("ego ");
-    for (const auto& agent : agents_)
-      output += agent.second.string("agent ");
+    for (const ConstVehicleView agent : *agents_)
+      output += agent.string("agent ");
     output += "waypoint lattice range: " + std::to_string(traffic_lattice_->range()) + "\n";
     return output;
   }
 
+protected:
+
+  /// Make sure the agent table is owned exclusively by this snapshot.
+  void detachAgents();
+
+  /// Make sure the traffic lattice is owned exclusively by this snapshot.
+  void detachTrafficLattice();
+
 };
 } // End namespace planner.
 
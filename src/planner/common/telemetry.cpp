@@ -0,0 +1,131 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <boost/format.hpp>
+
+#include <planner/common/telemetry.h>
+
+namespace planner {
+
+namespace {
+
+const char kMagic[8] = {'C', 'L', 'P', 'T', 'E', 'L', 'E', 'M'};
+
+template<typename T>
+void write(std::ofstream& file, const T& value) {
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+} // End anonymous namespace.
+
+constexpr uint32_t TelemetryLog::kVersion;
+constexpr size_t TelemetryLog::kNameLength;
+constexpr size_t TelemetryLog::kNumColumns;
+constexpr int TelemetrySink::kDrainIntervalMs_;
+
+const std::array<TelemetryLog::Column, TelemetryLog::kNumColumns>&
+TelemetryLog::columns() {
+  static const std::array<Column, kNumColumns> columns{{
+    {"simulation_time",   'f', offsetof(TelemetryRecord, simulation_time)},
+    {"ego_speed",         'f', offsetof(TelemetryRecord, ego_speed)},
+    {"ego_acceleration",  'f', offsetof(TelemetryRecord, ego_acceleration)},
+    {"ego_policy_speed",  'f', offsetof(TelemetryRecord, ego_policy_speed)},
+    {"front_distance",    'f', offsetof(TelemetryRecord, front_distance)},
+    {"back_distance",     'f', offsetof(TelemetryRecord, back_distance)},
+    {"ttc",               'f', offsetof(TelemetryRecord, ttc)},
+    {"planning_time",     'f', offsetof(TelemetryRecord, planning_time)},
+    {"path_type",         'i', offsetof(TelemetryRecord, path_type)},
+    {"expanded_vertices", 'i', offsetof(TelemetryRecord, expanded_vertices)},
+    {"graph_vertices",    'i', offsetof(TelemetryRecord, graph_vertices)},
+    {"collisions",        'i', offsetof(TelemetryRecord, collisions)}}};
+  return columns;
+}
+
+TelemetrySink::TelemetrySink(const std::string& path, const size_t capacity) :
+  file_(path, std::ios::binary | std::ios::trunc) {
+
+  if (!file_) {
+    throw std::runtime_error((boost::format(
+            "TelemetrySink::TelemetrySink(): "
+            "cannot open %1%.\n") % path).str());
+  }
+
+  // Round the capacity up to a power of two.
+  size_t size = 1;
+  while (size < capacity) size <<= 1;
+  buffer_.resize(size);
+
+  TelemetryLog::FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = TelemetryLog::kVersion;
+  header.num_columns = TelemetryLog::kNumColumns;
+  write(file_, header);
+
+  for (const TelemetryLog::Column& column : TelemetryLog::columns()) {
+    char name[TelemetryLog::kNameLength] = {0};
+    std::strncpy(name, column.name, TelemetryLog::kNameLength-1);
+    file_.write(name, TelemetryLog::kNameLength);
+    write(file_, column.type);
+  }
+  file_.flush();
+
+  drainer_ = std::thread([this](){ drainLoop(); });
+  return;
+}
+
+TelemetrySink::~TelemetrySink() {
+  stop_.store(true, std::memory_order_release);
+  drainer_.join();
+  return;
+}
+
+void TelemetrySink::drainLoop() {
+  while (!stop_.load(std::memory_order_acquire)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kDrainIntervalMs_));
+    drain();
+  }
+  // Write what is pushed before the sink is destroyed.
+  drain();
+  return;
+}
+
+void TelemetrySink::drain() {
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  const size_t head = head_.load(std::memory_order_acquire);
+  if (head == tail) return;
+
+  // Write the records column by column. The slots are only released
+  // once the whole block is written.
+  const uint32_t num = head - tail;
+  write(file_, num);
+
+  std::vector<char> column_data(num*8);
+  for (const TelemetryLog::Column& column : TelemetryLog::columns()) {
+    for (size_t i = 0; i < num; ++i) {
+      const TelemetryRecord& record = buffer_[(tail+i) & (buffer_.size()-1)];
+      std::memcpy(column_data.data()+i*8,
+                  reinterpret_cast<const char*>(&record)+column.offset, 8);
+    }
+    file_.write(column_data.data(), column_data.size());
+  }
+  file_.flush();
+
+  tail_.store(head, std::memory_order_release);
+  return;
+}
+
+} // End namespace planner.
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/core/noncopyable.hpp>
+
+namespace planner {
+
+/**
+ * \brief TelemetryRecord stores the metrics of the experiment at one tick.
+ *
+ * Every field is 8 bytes, so that the records are stored column by column
+ * without any conversion, see \c TelemetryLog.
+ */
+struct TelemetryRecord {
+  double simulation_time = 0.0;
+
+  double ego_speed = 0.0;
+  double ego_acceleration = 0.0;
+  double ego_policy_speed = 0.0;
+
+  /// Distance to the leading and following vehicles, -1 if there is none.
+  double front_distance = -1.0;
+  double back_distance = -1.0;
+
+  /// Time to collision with the leading vehicle, -1 if the ego is not closing in.
+  double ttc = -1.0;
+
+  double planning_time = 0.0;
+
+  /// The type of the planned path, see the result of the EgoPlan action.
+  int64_t path_type = 0;
+
+  /// Vertices expanded and kept in the graph of the planner in this cycle.
+  int64_t expanded_vertices = 0;
+  int64_t graph_vertices = 0;
+
+  /// Number of collisions detected in the traffic since the last record.
+  int64_t collisions = 0;
+};
+
+/**
+ * \brief TelemetryLog defines the binary format of the telemetry logs
+ *        written by \c TelemetrySink.
+ *
+ * The file starts with a \c FileHeader, followed by the description of
+ * \c kNumColumns columns, each of which is the name of the column padded
+ * to 31 bytes with zeros, and its type, 'f' for double or 'i' for int64.
+ * The rest of the file is a sequence of blocks. A block starts with the
+ * number of records N in it (uint32), followed by one array of N values
+ * for every column, in the order of the description. The format is little
+ * endian, which is the byte order of the machines this package runs on.
+ *
+ * \c scripts/telemetry_log.py is the python reader of the format.
+ */
+struct TelemetryLog {
+
+  /// Header of the log file.
+  struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_columns;
+  };
+
+  /// Description of a column.
+  struct Column {
+    const char* name;
+    char type;
+    size_t offset;
+  };
+
+  /// Version of the log file format.
+  static constexpr uint32_t kVersion = 1;
+
+  /// Length of the column names in the file.
+  static constexpr size_t kNameLength = 31;
+
+  static constexpr size_t kNumColumns = 12;
+
+  /// The columns, which are the fields of \c TelemetryRecord.
+  static const std::array<Column, kNumColumns>& columns();
+
+}; // End struct TelemetryLog.
+
+/**
+ * \brief TelemetrySink records \c TelemetryRecord objects into a telemetry
+ *        log, see \c TelemetryLog for the format.
+ *
+ * The records are pushed into a lock-free ring buffer, which is drained to
+ * the file by a background thread, so that the thread pushing the records,
+ * e.g. the one ticking the simulation, never formats or writes anything.
+ * The ring buffer supports a single thread pushing the records. If the
+ * buffer is full, the pushed record is dropped and counted.
+ */
+class TelemetrySink : private boost::noncopyable {
+
+protected:
+
+  /// Interval between draining the buffer.
+  static constexpr int kDrainIntervalMs_ = 100;
+
+  std::ofstream file_;
+
+  /// The ring buffer, whose size is a power of two.
+  std::vector<TelemetryRecord> buffer_;
+
+  /// Number of records pushed and popped so far. The slot of a record
+  /// in the buffer is the counter modulo the size of the buffer.
+  std::atomic<size_t> head_{0};
+  std::atomic<size_t> tail_{0};
+
+  /// Number of records dropped since the buffer is full.
+  std::atomic<size_t> dropped_{0};
+
+  /// Set when the sink is destroyed.
+  std::atomic<bool> stop_{false};
+
+  /// The thread draining the buffer.
+  std::thread drainer_;
+
+public:
+
+  /**
+   * \brief Open the file at \c path, which is truncated if it exists.
+   * \param[in] path The path of the telemetry log.
+   * \param[in] capacity The least number of records the buffer holds.
+   */
+  TelemetrySink(const std::string& path, const size_t capacity = 4096);
+
+  /// The records still in the buffer are written before the sink stops.
+  ~TelemetrySink();
+
+  /**
+   * \brief Push a record into the buffer.
+   * \return false If the buffer is full and the record is dropped.
+   */
+  bool push(const TelemetryRecord& record) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= buffer_.size()) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    buffer_[head & (buffer_.size()-1)] = record;
+    head_.store(head+1, std::memory_order_release);
+    return true;
+  }
+
+  /// Number of records dropped since the buffer is full.
+  const size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+protected:
+
+  void drainLoop();
+
+  /// Write the records in the buffer as one block.
+  void drain();
+
+}; // End class TelemetrySink.
+
+} // End namespace planner.
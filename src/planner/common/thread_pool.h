@@ -0,0 +1,172 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <boost/smart_ptr.hpp>
+#include <boost/core/noncopyable.hpp>
+
+namespace utils {
+
+/**
+ * \brief ThreadPool runs tasks with a fixed number of worker threads.
+ *
+ * The pool is meant for fork-join parallelism through \c parallelFor(),
+ * where the calling thread also takes part in running the tasks. Therefore,
+ * \c parallelFor() can be called from within a task without a deadlock,
+ * and a pool with no worker thread simply runs everything serially.
+ */
+class ThreadPool : private boost::noncopyable {
+
+protected:
+
+  /// The worker threads.
+  std::vector<std::thread> workers_;
+
+  /// Tasks waiting to be picked up by the workers.
+  std::queue<std::function<void()>> tasks_;
+
+  /// Protects \c tasks_ and \c stop_.
+  std::mutex tasks_mutex_;
+
+  /// Wakes up the workers when there are new tasks.
+  std::condition_variable tasks_cv_;
+
+  /// Set when the pool is destroyed.
+  bool stop_ = false;
+
+public:
+
+  /**
+   * \brief Construct the pool.
+   * \param[in] num_workers The number of worker threads. If 0, all tasks
+   *                        are run serially by the calling thread.
+   */
+  ThreadPool(const size_t num_workers) {
+    workers_.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i)
+      workers_.emplace_back([this](){ workerLoop(); });
+    return;
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex_);
+      stop_ = true;
+    }
+    tasks_cv_.notify_all();
+    for (auto& worker : workers_) worker.join();
+    return;
+  }
+
+  /// Get the number of worker threads.
+  const size_t size() const { return workers_.size(); }
+
+  /**
+   * \brief Run \c func(i) for all i in [0, num) and wait for all of them.
+   *
+   * The order in which the indices are run is unspecified. If any of the
+   * calls throws, the exception of the smallest index is rethrown after
+   * all calls are finished.
+   *
+   * \param[in] num The number of indices.
+   * \param[in] func The function to be called with every index.
+   */
+  template<typename Func>
+  void parallelFor(const size_t num, const Func& func) {
+
+    if (num == 0) return;
+    if (workers_.empty() || num == 1) {
+      for (size_t i = 0; i < num; ++i) func(i);
+      return;
+    }
+
+    // The states shared between the calling thread and the workers.
+    // A worker may start after all indices are finished, in which case
+    // it only touches the job, which is kept alive by the shared pointer.
+    struct Job {
+      std::atomic<size_t> next {0};
+      std::atomic<size_t> finished {0};
+      std::vector<std::exception_ptr> exceptions;
+      std::mutex mutex;
+      std::condition_variable cv;
+    };
+
+    boost::shared_ptr<Job> job = boost::make_shared<Job>();
+    job->exceptions.resize(num);
+
+    auto run = [job, &func, num]() {
+      for (size_t i = job->next++; i < num; i = job->next++) {
+        try {
+          func(i);
+        } catch (...) {
+          job->exceptions[i] = std::current_exception();
+        }
+        if (++(job->finished) == num) {
+          std::lock_guard<std::mutex> lock(job->mutex);
+          job->cv.notify_all();
+        }
+      }
+    };
+
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex_);
+      for (size_t i = 0; i < std::min(workers_.size(), num-1); ++i)
+        tasks_.push(run);
+    }
+    tasks_cv_.notify_all();
+
+    // Take part in running the tasks, and wait for the rest to finish.
+    run();
+    {
+      std::unique_lock<std::mutex> lock(job->mutex);
+      job->cv.wait(lock, [&job, num](){ return job->finished == num; });
+    }
+
+    for (const auto& exception : job->exceptions)
+      if (exception) std::rethrow_exception(exception);
+
+    return;
+  }
+
+protected:
+
+  /// The loop run by each worker thread.
+  void workerLoop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(tasks_mutex_);
+        tasks_cv_.wait(lock, [this](){ return stop_ || !tasks_.empty(); });
+        if (stop_ && tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+      task();
+    }
+  }
+
+}; // End class ThreadPool.
+
+} // End namespace utils.
@@ -16,6 +16,7 @@
 
 #include <cmath>
 #include <deque>
+#include <limits>
 #include <unordered_map>
 #include <algorithm>
 #include <stdexcept>
@@ -27,68 +28,24 @@ namespace planner {
 TrafficLattice::TrafficLattice(
     const std::vector<VehicleTuple>& vehicles,
     const boost::shared_ptr<CarlaMap>& map,
-    const boost::shared_ptr<utils::FastWaypointMap>& fast_map,
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
     const boost::shared_ptr<router::Router>& router,
     boost::optional<std::unordered_set<size_t>&> disappear_vehicles) :
   map_(map), fast_map_(fast_map) {
 
-  this->router_ = router;
-
   // Find the waypoints each of the input vehicle.
-  std::unordered_map<size_t, VehicleWaypoints>
-    vehicle_waypoints = vehicleWaypoints(vehicles);
-
-  // Find the start waypoint and range of the lattice based
-  // on the given vehicles.
-  boost::shared_ptr<CarlaWaypoint> start_waypoint = nullptr;
-  double range = 0.0;
-  latticeStartAndRange(vehicles, vehicle_waypoints, start_waypoint, range);
-
-  // Now we can construct the lattice.
-  // FIXME: The following is just a copy of the Lattice custom constructor.
-  //        Can we avoid this code duplication?
-  baseConstructor(start_waypoint, range, 1.0, router);
-
-  // Register the vehicles onto the lattice nodes.
-  std::unordered_set<size_t> remove_vehicles;
-  if(!registerVehicles(vehicles, vehicle_waypoints, remove_vehicles)) {
-    std::string error_msg(
-        "TrafficLattice::TrafficLattice(): "
-        "collision detected within the given vehicles.\n");
-
-    std::string vehicle_msg;
-    boost::format vehicle_format("vehicle %1%: x:%2% y:%3% z:%4% r:%5% p:%6% y:%7%.\n");
-
-    for (const auto& vehicle : vehicles) {
-      size_t id; CarlaTransform transform;
-      std::tie(id, transform, std::ignore) = vehicle;
-      vehicle_msg += (vehicle_format
-          % id
-          % transform.location.x
-          % transform.location.y
-          % transform.location.z
-          % transform.rotation.roll
-          % transform.rotation.pitch
-          % transform.rotation.yaw).str();
-    }
-
-    throw std::runtime_error(error_msg + vehicle_msg);
-  }
-  if (disappear_vehicles) *disappear_vehicles = remove_vehicles;
-
+  registerConstructor(vehicles, vehicleWaypoints(vehicles), router, disappear_vehicles);
   return;
 }
 
 TrafficLattice::TrafficLattice(
     const std::vector<boost::shared_ptr<const CarlaVehicle>>& vehicles,
     const boost::shared_ptr<CarlaMap>& map,
-    const boost::shared_ptr<utils::FastWaypointMap>& fast_map,
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
     const boost::shared_ptr<router::Router>& router,
     boost::optional<std::unordered_set<size_t>&> disappear_vehicles) :
   map_(map), fast_map_(fast_map) {
 
-  this->router_ = router;
-
   std::vector<VehicleTuple> vehicle_tuples;
   for (const auto& vehicle : vehicles) {
     vehicle_tuples.push_back(std::make_tuple(
@@ -98,23 +55,55 @@ TrafficLattice::TrafficLattice(
   }
 
   // Find waypoints for each of the input vehicle.
-  std::unordered_map<size_t, VehicleWaypoints>
-    vehicle_waypoints = vehicleWaypoints(vehicle_tuples);
+  registerConstructor(
+      vehicle_tuples, vehicleWaypoints(vehicle_tuples), router, disappear_vehicles);
+  return;
+}
+
+TrafficLattice::TrafficLattice(
+    const std::vector<VehicleTuple>& vehicles,
+    const std::unordered_map<size_t, VehicleWaypoints>& vehicle_waypoints,
+    const boost::shared_ptr<CarlaMap>& map,
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+    const boost::shared_ptr<router::Router>& router,
+    boost::optional<std::unordered_set<size_t>&> disappear_vehicles) :
+  map_(map), fast_map_(fast_map) {
+
+  for (const auto& vehicle : vehicles) {
+    if (vehicle_waypoints.count(std::get<0>(vehicle)) != 0) continue;
+    std::string error_msg = (boost::format(
+          "TrafficLattice::TrafficLattice(): "
+          "the waypoints of vehicle %1% are not given.\n") % std::get<0>(vehicle)).str();
+    throw std::runtime_error(error_msg);
+  }
+
+  registerConstructor(vehicles, vehicle_waypoints, router, disappear_vehicles);
+  return;
+}
+
+void TrafficLattice::registerConstructor(
+    const std::vector<VehicleTuple>& vehicles,
+    const std::unordered_map<size_t, VehicleWaypoints>& vehicle_waypoints,
+    const boost::shared_ptr<router::Router>& router,
+    boost::optional<std::unordered_set<size_t>&> disappear_vehicles) {
+
+  this->router_ = router;
 
   // Find the start waypoint and range of the lattice based
   // on the given vehicles.
   boost::shared_ptr<CarlaWaypoint> start_waypoint = nullptr;
   double range = 0.0;
-  latticeStartAndRange(vehicle_tuples, vehicle_waypoints, start_waypoint, range);
+  latticeStartAndRange(vehicles, vehicle_waypoints, start_waypoint, range);
 
   // Now we can construct the lattice.
   // FIXME: The following is just a copy of the Lattice custom constructor.
   //        Can we avoid this code duplication?
   baseConstructor(start_waypoint, range, 1.0, router);
+  updateLaneEndsTable();
 
   // Register the vehicles onto the lattice nodes.
   std::unordered_set<size_t> remove_vehicles;
-  if(!registerVehicles(vehicle_tuples, vehicle_waypoints, remove_vehicles)) {
+  if(!registerVehicles(vehicles, vehicle_waypoints, remove_vehicles)) {
     std::string error_msg(
         "TrafficLattice::TrafficLattice(): "
         "collision detected within the given vehicles.\n");
@@ -122,7 +111,7 @@ TrafficLattice::TrafficLattice(
     std::string vehicle_msg;
     boost::format vehicle_format("vehicle %1%: x:%2% y:%3% z:%4% r:%5% p:%6% y:%7%.\n");
 
-    for (const auto& vehicle : vehicle_tuples) {
+    for (const auto& vehicle : vehicles) {
       size_t id; CarlaTransform transform;
       std::tie(id, transform, std::ignore) = vehicle;
       vehicle_msg += (vehicle_format
@@ -145,15 +134,10 @@ TrafficLattice::TrafficLattice(
 TrafficLattice::TrafficLattice(const TrafficLattice& other) :
   Base(other) {
 
-  // Make sure the weak pointers point to the stuff within this object.
+  // The nodes are referred by indices, which stay valid in the copied arena.
   vehicle_to_nodes_table_ = other.vehicle_to_nodes_table_;
-
-  for (auto& vehicle : vehicle_to_nodes_table_) {
-    for (auto& node : vehicle.second) {
-      const size_t id = node.lock()->waypoint()->GetId();
-      node = this->waypoint_to_node_table_[id];
-    }
-  }
+  lane_to_vehicle_nodes_table_ = other.lane_to_vehicle_nodes_table_;
+  lane_ends_table_ = other.lane_ends_table_;
 
   // Carla map and fast map won't be copied. \c map_ of different objects point to the
   // same piece of memory.
@@ -167,6 +151,8 @@ void TrafficLattice::swap(TrafficLattice& other) {
 
   Base::swap(other);
   std::swap(vehicle_to_nodes_table_, other.vehicle_to_nodes_table_);
+  std::swap(lane_to_vehicle_nodes_table_, other.lane_to_vehicle_nodes_table_);
+  std::swap(lane_ends_table_, other.lane_ends_table_);
   std::swap(map_, other.map_);
   std::swap(fast_map_, other.fast_map_);
 
@@ -373,6 +359,16 @@ std::unordered_set<size_t> TrafficLattice::vehicles() const {
   return vehicles;
 }
 
+boost::optional<std::pair<double, double>>
+  TrafficLattice::vehicleSpan(const size_t vehicle) const {
+  std::unordered_map<size_t, std::vector<uint32_t>>::const_iterator iter =
+    vehicle_to_nodes_table_.find(vehicle);
+  if (iter == vehicle_to_nodes_table_.end()) return boost::none;
+
+  return std::make_pair(this->arena_->node(iter->second.front())->distance(),
+                        this->arena_->node(iter->second.back())->distance());
+}
+
 int32_t TrafficLattice::isChangingLane(const size_t vehicle) const {
   if (vehicle_to_nodes_table_.count(vehicle) == 0) {
     std::string error_msg = (boost::format(
@@ -422,9 +418,10 @@ int32_t TrafficLattice::deleteVehicle(const size_t vehicle) {
 
   // Otherwise, we have to first unregister the vehicle at the
   // corresponding nodes. Then remove the vehicle from the table.
-  for (auto& node : vehicle_to_nodes_table_[vehicle])
-    if (node.lock()) node.lock()->vehicle() = boost::none;
+  for (const uint32_t node : vehicle_to_nodes_table_[vehicle])
+    (*this->arena_)[node].vehicle() = boost::none;
 
+  reduceLaneToVehicleNodesTable(vehicle_to_nodes_table_[vehicle]);
   vehicle_to_nodes_table_.erase(vehicle);
   return 1;
 }
@@ -469,15 +466,17 @@ int32_t TrafficLattice::addVehicle(
   boost::shared_ptr<const CarlaWaypoint> mid_waypoint  = waypoints[1];
 
   // Find the nodes occupied by this vehicle.
-  boost::shared_ptr<Node> head_node = this->closestNode(
-      head_waypoint, this->longitudinal_resolution_);
-  boost::shared_ptr<Node> rear_node = this->closestNode(
-      rear_waypoint, this->longitudinal_resolution_);
-  boost::shared_ptr<Node> mid_node = this->closestNode(
-      mid_waypoint, this->longitudinal_resolution_);
+  const uint32_t head_node = this->closestNodeIndex(
+      head_waypoint, this->longitudinalResolution());
+  const uint32_t rear_node = this->closestNodeIndex(
+      rear_waypoint, this->longitudinalResolution());
+  const uint32_t mid_node = this->closestNodeIndex(
+      mid_waypoint, this->longitudinalResolution());
 
   // If we can not add the whole vehicle onto the lattice, we won't add it.
-  if (!head_node || !rear_node || !mid_node) {
+  if (head_node == kNullNodeIndex ||
+      rear_node == kNullNodeIndex ||
+      mid_node  == kNullNodeIndex) {
     //if (!head_node) std::printf("Cannot find vehicle head.\n");
     //if (!rear_node) std::printf("Cannot find vehicle rear.\n");
     //if (!mid_node)  std::printf("Cannot find vehicle mid.\n");
@@ -501,62 +500,63 @@ int32_t TrafficLattice::addVehicle(
   // case, two portions, separated by the mid node, of the vehicles are
   // on different lanes.
 
-  std::vector<boost::weak_ptr<Node>> rear_node_forward;
-  boost::shared_ptr<Node> next_node = rear_node;
+  // Since nodes are referred by their indices in the arena, the mid node
+  // and its neighbors can be compared with the indices directly.
+  const Node& mid = (*this->arena_)[mid_node];
+  auto isMidNode = [&mid, mid_node](const uint32_t node)->bool{
+    return node == mid_node || node == mid.leftIndex() || node == mid.rightIndex();
+  };
+
+  std::vector<uint32_t> rear_node_forward;
+  uint32_t next_node = rear_node;
   while (true) {
-    if (next_node->id() == mid_node->id()) break;
-    if (mid_node->left().lock() &&
-        next_node->id() == mid_node->left().lock()->id()) break;
-    if (mid_node->right().lock() &&
-        next_node->id() == mid_node->right().lock()->id()) break;
-
-    rear_node_forward.emplace_back(next_node);
-    if (!next_node->front().lock()) break;
-    next_node = next_node->front().lock();
+    if (isMidNode(next_node)) break;
+
+    rear_node_forward.push_back(next_node);
+    if ((*this->arena_)[next_node].frontIndex() == kNullNodeIndex) break;
+    next_node = (*this->arena_)[next_node].frontIndex();
   }
 
-  std::vector<boost::weak_ptr<Node>> head_node_backward;
+  std::vector<uint32_t> head_node_backward;
   next_node = head_node;
   while (true) {
-    if (next_node->id() == mid_node->id()) break;
-    if (mid_node->left().lock() &&
-        next_node->id() == mid_node->left().lock()->id()) break;
-    if (mid_node->right().lock() &&
-        next_node->id() == mid_node->right().lock()->id()) break;
-
-    head_node_backward.emplace_back(next_node);
-    if (!next_node->back().lock()) break;
-    next_node = next_node->back().lock();
+    if (isMidNode(next_node)) break;
+
+    head_node_backward.push_back(next_node);
+    if ((*this->arena_)[next_node].backIndex() == kNullNodeIndex) break;
+    next_node = (*this->arena_)[next_node].backIndex();
   }
   std::reverse(head_node_backward.begin(), head_node_backward.end());
 
-  std::vector<boost::weak_ptr<Node>> nodes;
+  std::vector<uint32_t> nodes;
   nodes.insert(nodes.end(), rear_node_forward.begin(), rear_node_forward.end());
-  nodes.emplace_back(mid_node);
+  nodes.push_back(mid_node);
   nodes.insert(nodes.end(), head_node_backward.begin(), head_node_backward.end());
 
   // If there is already a vehicle on any of the found nodes,
   // it indicates there is a collision.
   bool collision_flag = false;
-  for (auto& node : nodes) {
-    if (node.lock()->vehicle()) {
+  for (const uint32_t node : nodes) {
+    if ((*this->arena_)[node].vehicle()) {
       collision_flag = true;
       break;
     }
-    else node.lock()->vehicle() = id;
+    else (*this->arena_)[node].vehicle() = id;
   }
 
   if (!collision_flag) {
     // If there is no collision, we can add the vehicle successfully.
+    augmentLaneToVehicleNodesTable(nodes);
     vehicle_to_nodes_table_[id] = nodes;
     return 1;
   } else {
     // If there is a collision, we should erase the vehicle on the touched nodes,
     // and leave the object in a valid state.
-    for (auto& node : nodes) {
-      if (!(node.lock()->vehicle())) continue;
-      if (*(node.lock()->vehicle()) != id) continue;
-      node.lock()->vehicle() = boost::none;
+    for (const uint32_t node : nodes) {
+      boost::optional<size_t>& node_vehicle = (*this->arena_)[node].vehicle();
+      if (!node_vehicle) continue;
+      if (*node_vehicle != id) continue;
+      node_vehicle = boost::none;
     }
     return -1;
   }
@@ -594,13 +594,20 @@ bool TrafficLattice::moveTrafficForward(
     throw std::runtime_error(error_msg + existing_vehicles_msg + update_vehicles_msg);
   }
 
-  // Clear all vehicles for the moment, will add them back later.
-  for (auto& item : vehicle_to_nodes_table_) {
-    for (auto& node : item.second) {
-      if (node.lock()) node.lock()->vehicle() = boost::none;
+  // Most of the time vehicles only move a few nodes along their lanes,
+  // in which case the lattice does not have to be rebuilt.
+  {
+    std::unordered_set<size_t> remove_vehicles;
+    const boost::optional<bool> valid =
+      moveTrafficForwardIncrementally(vehicles, remove_vehicles);
+    if (valid) {
+      if (disappear_vehicles) *disappear_vehicles = remove_vehicles;
+      return *valid;
     }
   }
-  vehicle_to_nodes_table_.clear();
+
+  // Clear all vehicles for the moment, will add them back later.
+  clearVehicles();
 
   // Find waypoints for each of the input vehicle.
   std::unordered_map<size_t, VehicleWaypoints>
@@ -613,7 +620,7 @@ bool TrafficLattice::moveTrafficForward(
 
   // Modify the lattice to agree with the new start and range.
   boost::shared_ptr<Node> update_start_node = this->closestNode(
-      update_start, this->longitudinal_resolution_);
+      update_start, this->longitudinalResolution());
 
   if (!update_start_node) {
     std::string error_msg(
@@ -637,6 +644,7 @@ bool TrafficLattice::moveTrafficForward(
 
   this->shorten(this->range()-update_start_node->distance());
   this->extend(update_range);
+  updateLaneEndsTable();
 
   // Register the vehicles onto the lattice.
   std::unordered_set<size_t> remove_vehicles;
@@ -666,16 +674,206 @@ bool TrafficLattice::moveTrafficForward(
   return valid;
 }
 
+boost::optional<bool> TrafficLattice::moveTrafficForwardIncrementally(
+    const std::vector<VehicleTuple>& vehicles,
+    std::unordered_set<size_t>& disappear_vehicles) {
+
+  // Find the waypoints of all vehicles in one batch.
+  const std::unordered_map<size_t, VehicleWaypoints>
+    vehicle_waypoints = vehicleWaypoints(vehicles);
+
+  // Slide the vehicles staying in their lanes, and collect the others.
+  std::unordered_map<size_t, std::vector<uint32_t>> slid_vehicles;
+  slid_vehicles.reserve(vehicles.size());
+  std::vector<VehicleTuple> lane_change_vehicles;
+
+  auto slideVehicles = [this, &vehicle_waypoints, &slid_vehicles](
+      const std::vector<VehicleTuple>& vehicles,
+      std::vector<VehicleTuple>& failed_vehicles)->void{
+    for (const auto& vehicle : vehicles) {
+      std::vector<uint32_t> nodes;
+      const VehicleWaypoints& waypoints =
+        vehicle_waypoints.find(std::get<0>(vehicle))->second;
+      if (slideVehicle(vehicle, waypoints, nodes))
+        slid_vehicles[std::get<0>(vehicle)] = std::move(nodes);
+      else
+        failed_vehicles.push_back(vehicle);
+    }
+  };
+  slideVehicles(vehicles, lane_change_vehicles);
+
+  // Some vehicles may have moved beyond the front of the lattice, e.g. after
+  // a long simulation step. Extend the lattice to cover them and try again.
+  double required_range = 0.0;
+  for (const auto& vehicle : lane_change_vehicles) {
+    const size_t id = std::get<0>(vehicle);
+    const boost::shared_ptr<CarlaWaypoint>& head_waypoint = vehicle_waypoints.find(id)->second[2];
+    if (!head_waypoint) continue;
+    const Node& head_node = (*this->arena_)[vehicle_to_nodes_table_.find(id)->second.back()];
+    required_range = std::max(required_range, head_node.distance() + kFrontMargin_ +
+        head_node.waypoint()->GetTransform().location.Distance(
+          head_waypoint->GetTransform().location));
+  }
+
+  if (required_range > this->range()) {
+    this->extend(required_range);
+    std::vector<VehicleTuple> failed_vehicles;
+    slideVehicles(lane_change_vehicles, failed_vehicles);
+    lane_change_vehicles.swap(failed_vehicles);
+  }
+
+  // Find the range of nodes occupied by all vehicles.
+  uint32_t start_node = kNullNodeIndex;
+  double start_distance = std::numeric_limits<double>::max();
+  auto updateStart = [this, &start_node, &start_distance](const uint32_t node)->void{
+    if ((*this->arena_)[node].distance() >= start_distance) return;
+    start_distance = (*this->arena_)[node].distance();
+    start_node = node;
+  };
+
+  for (const auto& vehicle : slid_vehicles) updateStart(vehicle.second.front());
+  for (const auto& vehicle : lane_change_vehicles) {
+    for (const auto& waypoint : vehicle_waypoints.find(std::get<0>(vehicle))->second) {
+      const uint32_t node = this->closestNodeIndex(
+          waypoint, this->longitudinalResolution());
+      if (node == kNullNodeIndex) return boost::none;
+      updateStart(node);
+    }
+  }
+  if (start_node == kNullNodeIndex) return boost::none;
+
+  // From here on, the object is modified.
+  clearVehicles();
+
+  // Remove the nodes behind all vehicles. The nodes occupied by the vehicles
+  // are kept, so that their indices are still valid.
+  this->shorten(this->range()-start_distance);
+
+  for (auto& vehicle : slid_vehicles) {
+    for (const uint32_t node : vehicle.second) {
+      if ((*this->arena_)[node].vehicle()) return false;
+      (*this->arena_)[node].vehicle() = vehicle.first;
+    }
+    augmentLaneToVehicleNodesTable(vehicle.second);
+    vehicle_to_nodes_table_[vehicle.first] = std::move(vehicle.second);
+  }
+
+  for (const auto& vehicle : lane_change_vehicles) {
+    const size_t id = std::get<0>(vehicle);
+    const int32_t valid = addVehicle(vehicle, vehicle_waypoints.find(id)->second);
+    if (valid == 0) disappear_vehicles.insert(id);
+    else if (valid == -1) return false;
+  }
+
+  // Extend the lattice with some margin, so that vehicles do not run out
+  // of the lattice in the next few updates.
+  double end_distance = 0.0;
+  for (const auto& vehicle : vehicle_to_nodes_table_) {
+    end_distance = std::max(
+        end_distance, (*this->arena_)[vehicle.second.back()].distance());
+  }
+  if (end_distance+kFrontMargin_ > this->range())
+    this->extend(end_distance+2.0*kFrontMargin_);
+  updateLaneEndsTable();
+
+  return true;
+}
+
+bool TrafficLattice::slideVehicle(
+    const VehicleTuple& vehicle,
+    const VehicleWaypoints& waypoints,
+    std::vector<uint32_t>& nodes) const {
+
+  // The vehicle should currently occupy a single lane.
+  const std::vector<uint32_t>& existing_nodes =
+    vehicle_to_nodes_table_.find(std::get<0>(vehicle))->second;
+  for (size_t i = 1; i < existing_nodes.size(); ++i) {
+    if ((*this->arena_)[existing_nodes[i-1]].frontIndex() != existing_nodes[i])
+      return false;
+  }
+
+  // Slide the rear, middle, and head of the vehicle in sequence.
+  const uint32_t rear_node = slideNode(existing_nodes.front(), waypoints[0]);
+  if (rear_node == kNullNodeIndex) return false;
+  const uint32_t mid_node = slideNode(rear_node, waypoints[1]);
+  if (mid_node == kNullNodeIndex) return false;
+  const uint32_t head_node = slideNode(mid_node, waypoints[2]);
+  if (head_node == kNullNodeIndex) return false;
+
+  // Collect the nodes from the rear to the head, which should pass the middle.
+  nodes.clear();
+  bool pass_mid_node = false;
+  uint32_t node = rear_node;
+  while (true) {
+    nodes.push_back(node);
+    if (node == mid_node) pass_mid_node = true;
+    if (node == head_node) break;
+    node = (*this->arena_)[node].frontIndex();
+    if (node == kNullNodeIndex || nodes.size() > kMaxSlideNodes_) return false;
+  }
+
+  return pass_mid_node;
+}
+
+uint32_t TrafficLattice::slideNode(
+    const uint32_t start,
+    const boost::shared_ptr<CarlaWaypoint>& waypoint) const {
+
+  if (!waypoint) return kNullNodeIndex;
+
+  // Distance from the waypoint to the node along the lane, or a
+  // negative number if the node is not on the lane of the waypoint.
+  auto laneDistance = [this, &waypoint](const uint32_t node)->double{
+    if (node == kNullNodeIndex) return -1.0;
+    const CarlaWaypoint& node_waypoint = *((*this->arena_)[node].waypoint());
+    if (node_waypoint.GetRoadId() != waypoint->GetRoadId() ||
+        node_waypoint.GetLaneId() != waypoint->GetLaneId()) return -1.0;
+    return std::fabs(node_waypoint.GetDistance()-waypoint->GetDistance());
+  };
+
+  // Move forward until the node is on the same lane with the waypoint,
+  // in case the vehicle has entered the next road.
+  uint32_t node = start;
+  double distance = laneDistance(node);
+  for (size_t i = 0; distance < 0.0; ++i) {
+    if (i >= kMaxSlideNodes_) return kNullNodeIndex;
+    node = (*this->arena_)[node].frontIndex();
+    if (node == kNullNodeIndex) return kNullNodeIndex;
+    distance = laneDistance(node);
+  }
+
+  // Move along the lane as long as the distance decreases.
+  for (size_t i = 0; i < kMaxSlideNodes_; ++i) {
+    const uint32_t front_node = (*this->arena_)[node].frontIndex();
+    const uint32_t back_node = (*this->arena_)[node].backIndex();
+    const double front_distance = laneDistance(front_node);
+    const double back_distance = laneDistance(back_node);
+
+    if (front_distance >= 0.0 && front_distance < distance) {
+      node = front_node;
+      distance = front_distance;
+    } else if (back_distance >= 0.0 && back_distance < distance) {
+      node = back_node;
+      distance = back_distance;
+    } else {
+      // Use the same tolerance as adding the vehicle onto the lattice.
+      return distance < this->longitudinalResolution() ? node : kNullNodeIndex;
+    }
+  }
+
+  return kNullNodeIndex;
+}
+
 void TrafficLattice::baseConstructor(
     const boost::shared_ptr<const CarlaWaypoint>& start,
     const double range,
     const double longitudinal_resolution,
     const boost::shared_ptr<router::Router>& router) {
 
-  this->longitudinal_resolution_ = longitudinal_resolution;
+  this->resolution_ = LatticeResolution(longitudinal_resolution);
   this->router_ = router;
 
-  if (range <= this->longitudinal_resolution_) {
+  if (range <= this->longitudinalResolution()) {
     std::string error_msg = (boost::format(
             "TrafficLattice::baseConstructor(): "
             "range [%1%] < longitudinal resolution [%2%].\n")
@@ -685,15 +883,19 @@ void TrafficLattice::baseConstructor(
   }
 
   // Create the start node.
-  boost::shared_ptr<Node> start_node = boost::make_shared<Node>(start);
-  start_node->distance() = 0.0;
+  double lattice_range = range;
+  const boost::shared_ptr<const CarlaWaypoint> lattice_start =
+    this->latticeStart(start, lattice_range);
+
+  const uint32_t start_node = this->arena_->allocate(lattice_start);
+  (*this->arena_)[start_node].setDistance(0.0);
   this->lattice_exits_.push_back(start_node);
 
-  this->augmentWaypointToNodeTable(start->GetId(), start_node);
-  this->augmentRoadlaneToWaypointsTable(start);
+  this->augmentWaypointToNodeTable(lattice_start->GetId(), start_node);
+  this->augmentRoadlaneToWaypointsTable(lattice_start);
 
   // Construct the lattice.
-  this->extend(range);
+  this->extend(lattice_range);
 
   return;
 }
@@ -844,8 +1046,8 @@ bool TrafficLattice::registerVehicles(
     const std::unordered_map<size_t, VehicleWaypoints>& vehicle_waypoints,
     boost::optional<std::unordered_set<size_t>&> disappear_vehicles) {
 
-  // Clear the \c vehicle_to_node_table_.
-  vehicle_to_nodes_table_.clear();
+  // Clear the vehicles registered before.
+  clearVehicles();
 
   // Add vehicles onto the lattice, keep track of the disappearred/removed vehicles as well.
   std::unordered_set<size_t> removed_vehicles;
@@ -947,10 +1149,9 @@ std::deque<size_t> TrafficLattice::sortRoads(
   return sorted_roads;
 }
 
-boost::shared_ptr<typename TrafficLattice::CarlaWaypoint>
-  TrafficLattice::vehicleHeadWaypoint(
+carla::geom::Location TrafficLattice::vehicleHeadLocation(
     const CarlaTransform& transform,
-    const CarlaBoundingBox& bounding_box) const {
+    const CarlaBoundingBox& bounding_box) {
 
   const double sin = std::sin(transform.rotation.yaw/180.0*M_PI);
   const double cos = std::cos(transform.rotation.yaw/180.0*M_PI);
@@ -967,33 +1168,72 @@ boost::shared_ptr<typename TrafficLattice::CarlaWaypoint>
   //std::printf("head waypoint location: x:%f y:%f z:%f\n",
   //    waypoint_location.x, waypoint_location.y, waypoint_location.z);
 
-  //return map_->GetWaypoint(waypoint_location);
-  return fast_map_->waypoint(waypoint_location);
+  return waypoint_location;
 }
 
 std::unordered_map<size_t, typename TrafficLattice::VehicleWaypoints>
   TrafficLattice::vehicleWaypoints(
     const std::vector<VehicleTuple>& vehicles) const {
+  return resolveVehicleWaypoints(vehicles, fast_map_);
+}
 
-  std::unordered_map<size_t, VehicleWaypoints> vehicle_waypoints;
+std::unordered_map<size_t, typename TrafficLattice::VehicleWaypoints>
+  TrafficLattice::resolveVehicleWaypoints(
+    const std::vector<VehicleTuple>& vehicles,
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+    const boost::shared_ptr<utils::ThreadPool>& thread_pool) {
+
+  // Vehicles are resolved in chunks, small enough to spread over the threads,
+  // and large enough to amortize the batched queries into the fast map.
+  static constexpr size_t kChunkSize = 32;
+  const size_t num_chunks = (vehicles.size()+kChunkSize-1) / kChunkSize;
+
+  // Every chunk writes its own range of the array, so that no
+  // synchronization is required between the chunks.
+  std::vector<VehicleWaypoints> waypoints(vehicles.size());
+
+  auto resolveChunk = [&vehicles, &fast_map, &waypoints](const size_t chunk)->void{
+    const size_t begin = chunk * kChunkSize;
+    const size_t end = std::min(begin+kChunkSize, vehicles.size());
+
+    // Collect the rear, center, and head locations of the vehicles,
+    // so that the waypoints can be queried in one batch.
+    std::vector<carla::geom::Location> locations;
+    locations.reserve((end-begin)*3);
+
+    for (size_t i = begin; i < end; ++i) {
+      CarlaTransform transform; CarlaBoundingBox bounding_box;
+      std::tie(std::ignore, transform, bounding_box) = vehicles[i];
+
+      locations.push_back(vehicleRearLocation(transform, bounding_box));
+      locations.push_back(transform.location);
+      locations.push_back(vehicleHeadLocation(transform, bounding_box));
+    }
 
-  for (const auto& vehicle : vehicles) {
-    size_t id; CarlaTransform transform; CarlaBoundingBox bounding_box;
-    std::tie(id, transform, bounding_box) = vehicle;
+    std::vector<utils::FastWaypointMap::WaypointHandle> handles(locations.size());
+    fast_map->waypoints(locations.data(), locations.size(), handles.data());
 
-    vehicle_waypoints[id] = VehicleWaypoints();
-    vehicle_waypoints[id][0] = vehicleRearWaypoint(transform, bounding_box);
-    vehicle_waypoints[id][1] = vehicleWaypoint(transform);
-    vehicle_waypoints[id][2] = vehicleHeadWaypoint(transform, bounding_box);
-  }
+    for (size_t i = begin; i < end; ++i) {
+      for (size_t j = 0; j < 3; ++j)
+        waypoints[i][j] = fast_map->waypoint(handles[(i-begin)*3+j]);
+    }
+  };
+
+  if (thread_pool) thread_pool->parallelFor(num_chunks, resolveChunk);
+  else for (size_t chunk = 0; chunk < num_chunks; ++chunk) resolveChunk(chunk);
+
+  // Commit the waypoints into the map sequentially.
+  std::unordered_map<size_t, VehicleWaypoints> vehicle_waypoints;
+  vehicle_waypoints.reserve(vehicles.size());
+  for (size_t i = 0; i < vehicles.size(); ++i)
+    vehicle_waypoints[std::get<0>(vehicles[i])] = std::move(waypoints[i]);
 
   return vehicle_waypoints;
 }
 
-boost::shared_ptr<typename TrafficLattice::CarlaWaypoint>
-  TrafficLattice::vehicleRearWaypoint(
+carla::geom::Location TrafficLattice::vehicleRearLocation(
     const CarlaTransform& transform,
-    const CarlaBoundingBox& bounding_box) const {
+    const CarlaBoundingBox& bounding_box) {
 
   const double sin = std::sin(transform.rotation.yaw/180.0*M_PI);
   const double cos = std::cos(transform.rotation.yaw/180.0*M_PI);
@@ -1009,8 +1249,60 @@ boost::shared_ptr<typename TrafficLattice::CarlaWaypoint>
   //    transform.location.x, transform.location.y, transform.location.z);
   //std::printf("rear waypoint location: x:%f y:%f z:%f\n",
   //    waypoint_location.x, waypoint_location.y, waypoint_location.z);
-  //return map_->GetWaypoint(waypoint_location);
-  return fast_map_->waypoint(waypoint_location);
+  return waypoint_location;
+}
+
+void TrafficLattice::augmentLaneToVehicleNodesTable(
+    const std::vector<uint32_t>& nodes) {
+  for (const uint32_t node : nodes) {
+    const Node& vehicle_node = (*this->arena_)[node];
+    lane_to_vehicle_nodes_table_[laneId(vehicle_node)][arenaDistance(vehicle_node)] = node;
+  }
+  return;
+}
+
+void TrafficLattice::reduceLaneToVehicleNodesTable(
+    const std::vector<uint32_t>& nodes) {
+  for (const uint32_t node : nodes) {
+    const Node& vehicle_node = (*this->arena_)[node];
+    auto lane_iter = lane_to_vehicle_nodes_table_.find(laneId(vehicle_node));
+    if (lane_iter == lane_to_vehicle_nodes_table_.end()) continue;
+
+    lane_iter->second.erase(arenaDistance(vehicle_node));
+    if (lane_iter->second.empty()) lane_to_vehicle_nodes_table_.erase(lane_iter);
+  }
+  return;
+}
+
+void TrafficLattice::clearVehicles() {
+  for (const auto& item : vehicle_to_nodes_table_) {
+    for (const uint32_t node : item.second)
+      (*this->arena_)[node].vehicle() = boost::none;
+  }
+  vehicle_to_nodes_table_.clear();
+  lane_to_vehicle_nodes_table_.clear();
+  return;
+}
+
+void TrafficLattice::updateLaneEndsTable() {
+  lane_ends_table_.clear();
+
+  for (const auto& item : this->waypoint_to_node_table_) {
+    const uint32_t node = item.second;
+    const double distance = (*this->arena_)[node].distance();
+
+    auto lane_iter = lane_ends_table_.find(laneId((*this->arena_)[node]));
+    if (lane_iter == lane_ends_table_.end()) {
+      lane_ends_table_[laneId((*this->arena_)[node])] = std::make_pair(node, node);
+      continue;
+    }
+
+    std::pair<uint32_t, uint32_t>& ends = lane_iter->second;
+    if (distance < (*this->arena_)[ends.first].distance())  ends.first  = node;
+    if (distance > (*this->arena_)[ends.second].distance()) ends.second = node;
+  }
+
+  return;
 }
 
 boost::optional<std::pair<size_t, double>>
@@ -1024,13 +1316,36 @@ boost::optional<std::pair<size_t, double>>
     throw std::runtime_error(error_msg);
   }
 
-  boost::shared_ptr<const Node> front = start->front();
-  while (front) {
-    // If we found a vehicle at the front node, this is it.
-    if (front->vehicle())
-      return std::make_pair(*(front->vehicle()), front->distance()-start->distance());
-    // Otherwise, keep moving forward.
-    front = front->front();
+  // Search the lanes from the lane of the start node. On the lane of the
+  // start node, the vehicle should be strictly in front of the node. On the
+  // following lanes, the vehicle can be at the node the lane is entered.
+  uint32_t lane_start = start->index();
+  bool include_lane_start = false;
+
+  // Every lane is visited at most once, which guards against loops.
+  for (size_t i = 0; i <= lane_ends_table_.size(); ++i) {
+    const Node& lane_start_node = (*this->arena_)[lane_start];
+    const size_t lane = laneId(lane_start_node);
+    const double distance = arenaDistance(lane_start_node);
+
+    auto lane_iter = lane_to_vehicle_nodes_table_.find(lane);
+    if (lane_iter != lane_to_vehicle_nodes_table_.end()) {
+      const std::map<double, uint32_t>& vehicle_nodes = lane_iter->second;
+      auto node_iter = include_lane_start ?
+        vehicle_nodes.lower_bound(distance) : vehicle_nodes.upper_bound(distance);
+      // If we found a vehicle on this lane, this is it.
+      if (node_iter != vehicle_nodes.end()) {
+        const Node& front_node = (*this->arena_)[node_iter->second];
+        return std::make_pair(*(front_node.vehicle()), front_node.distance()-start->distance());
+      }
+    }
+
+    // Otherwise, move on to the lane of the front node of the last node on this lane.
+    auto ends_iter = lane_ends_table_.find(lane);
+    if (ends_iter == lane_ends_table_.end()) break;
+    lane_start = (*this->arena_)[ends_iter->second.second].frontIndex();
+    if (lane_start == kNullNodeIndex) break;
+    include_lane_start = true;
   }
 
   // There is no front vehicle from the given node.
@@ -1048,13 +1363,35 @@ boost::optional<std::pair<size_t, double>>
     throw std::runtime_error(error_msg);
   }
 
-  boost::shared_ptr<const Node> back = start->back();
-  while (back) {
-    // If we found a vehicle at the front node, this is it.
-    if (back->vehicle())
-      return std::make_pair(*(back->vehicle()), start->distance()-back->distance());
-    // Otherwise, keep moving backward.
-    back = back->back();
+  // Search the lanes from the lane of the start node backwards,
+  // the same as \c frontVehicle().
+  uint32_t lane_start = start->index();
+  bool include_lane_start = false;
+
+  for (size_t i = 0; i <= lane_ends_table_.size(); ++i) {
+    const Node& lane_start_node = (*this->arena_)[lane_start];
+    const size_t lane = laneId(lane_start_node);
+    const double distance = arenaDistance(lane_start_node);
+
+    auto lane_iter = lane_to_vehicle_nodes_table_.find(lane);
+    if (lane_iter != lane_to_vehicle_nodes_table_.end()) {
+      const std::map<double, uint32_t>& vehicle_nodes = lane_iter->second;
+      // The first node after the ones at or behind the start node.
+      auto node_iter = include_lane_start ?
+        vehicle_nodes.upper_bound(distance) : vehicle_nodes.lower_bound(distance);
+      // If we found a vehicle on this lane, this is it.
+      if (node_iter != vehicle_nodes.begin()) {
+        const Node& back_node = (*this->arena_)[(--node_iter)->second];
+        return std::make_pair(*(back_node.vehicle()), start->distance()-back_node.distance());
+      }
+    }
+
+    // Otherwise, move on to the lane of the back node of the first node on this lane.
+    auto ends_iter = lane_ends_table_.find(lane);
+    if (ends_iter == lane_ends_table_.end()) break;
+    lane_start = (*this->arena_)[ends_iter->second.first].backIndex();
+    if (lane_start == kNullNodeIndex) break;
+    include_lane_start = true;
   }
 
   // There is no back vehicle from the given node.
@@ -1068,8 +1405,8 @@ std::string TrafficLattice::string(const std::string& prefix) const {
   std::string vehicles_msg;
   for (const auto& vehicle : vehicle_to_nodes_table_) {
     std::string vehicle_msg = (boost::format("vehicle %1%:\n") % vehicle.first).str();
-    for (const auto& node : vehicle.second)
-      vehicle_msg += node.lock()->string();
+    for (const uint32_t node : vehicle.second)
+      vehicle_msg += (*this->arena_)[node].string();
     vehicles_msg += vehicle_msg;
   }
 
@@ -17,6 +17,7 @@
 #include <cstdint>
 #include <tuple>
 #include <array>
+#include <map>
 #include <string>
 
 #include <boost/format.hpp>
@@ -27,6 +28,7 @@
 
 #include <planner/common/utils.h>
 #include <planner/common/fast_waypoint_map.h>
+#include <planner/common/thread_pool.h>
 #include <planner/common/waypoint_lattice.h>
 #include <router/common/router.h>
 
@@ -87,7 +89,7 @@ public:
         % this->waypoint_->GetRoadId()
         % this->waypoint_->GetLaneId()).str();
 
-    std::string distance_msg = (boost::format("node distance: %1%\n") % this->distance_).str();
+    std::string distance_msg = (boost::format("node distance: %1%\n") % this->distance()).str();
 
     std::string vehicle_msg;
     if (!vehicle_)
@@ -126,6 +128,9 @@ protected:
   using CarlaMapData     = carla::road::MapData;
 
   using Node = WaypointNodeWithVehicle;
+
+public:
+
   /// FIXME: Don't really want to define a new struct for this.
   ///        Is there a better solution than \c tuple?
   using VehicleTuple = std::tuple<size_t, CarlaTransform, CarlaBoundingBox>;
@@ -142,19 +147,49 @@ private:
 
 protected:
 
+  /// When the traffic is moved forward incrementally, the lattice is kept at
+  /// least this long (m) ahead of the front-most node occupied by a vehicle.
+  static constexpr double kFrontMargin_ = 5.0;
+
+  /// The maximum number of nodes a vehicle can slide in one update.
+  static constexpr size_t kMaxSlideNodes_ = 50;
+
   /**
    * A mapping from vehicle ID to its occupied nodes in the lattice.
    *
    * For each entry, the key is the vehicle ID, the value is the nodes
-   * occupied by the vehicle. The nodes are sorted from the vehicle rear to head.
+   * occupied by the vehicle (as indices in the node arena). The nodes are sorted
+   * from the vehicle rear to head.
+   */
+  std::unordered_map<size_t, std::vector<uint32_t>> vehicle_to_nodes_table_;
+
+  /**
+   * A mapping from lanes to the nodes occupied by vehicles on the lanes.
+   *
+   * For each entry, the key is the lane ID, see \c laneId(). The value maps the
+   * distances of the occupied nodes on the lane, relative to the origin of
+   * the arena, to the indices of the nodes. The distances relative to the
+   * origin are not changed by shortening the lattice.
+   *
+   * This table is used to find the front and back vehicles of a node with a
+   * binary search, instead of walking through the empty nodes in between.
+   */
+  std::unordered_map<size_t, std::map<double, uint32_t>> lane_to_vehicle_nodes_table_;
+
+  /**
+   * A mapping from lanes to the first and last nodes of the lanes on the lattice.
+   *
+   * A search for the front (back) vehicle continues on the lane of the front
+   * (back) node of the last (first) node of the current lane. This table
+   * only changes with the shape of the lattice, see \c updateLaneEndsTable().
    */
-  std::unordered_map<size_t, std::vector<boost::weak_ptr<Node>>> vehicle_to_nodes_table_;
+  std::unordered_map<size_t, std::pair<uint32_t, uint32_t>> lane_ends_table_;
 
   /// Carla map, used to road and lanes.
   boost::shared_ptr<CarlaMap> map_;
 
   /// Fast waypoint map, used to find carla waypoints based on locations.
-  boost::shared_ptr<utils::FastWaypointMap> fast_map_;
+  boost::shared_ptr<const utils::FastWaypointMap> fast_map_;
 
 public:
 
@@ -171,7 +206,7 @@ public:
   TrafficLattice(
       const std::vector<boost::shared_ptr<const CarlaVehicle>>& vehicles,
       const boost::shared_ptr<CarlaMap>& map,
-      const boost::shared_ptr<utils::FastWaypointMap>& fast_map,
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
       const boost::shared_ptr<router::Router>& router,
       boost::optional<std::unordered_set<size_t>&> disappear_vehicles = boost::none);
 
@@ -188,7 +223,29 @@ public:
   TrafficLattice(
       const std::vector<VehicleTuple>& vehicles,
       const boost::shared_ptr<CarlaMap>& map,
-      const boost::shared_ptr<utils::FastWaypointMap>& fast_map,
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+      const boost::shared_ptr<router::Router>& router,
+      boost::optional<std::unordered_set<size_t>&> disappear_vehicles = boost::none);
+
+  /**
+   * \brief Class constructor with the waypoints of the vehicles resolved already.
+   *
+   * This allows the waypoints of a large set of vehicles to be resolved
+   * concurrently with \c resolveVehicleWaypoints(), leaving only the
+   * registration of the vehicles to the lattice construction.
+   *
+   * \param[in] vehicles Vehicles to be registered onto the lattice.
+   * \param[in] vehicle_waypoints The waypoints of every vehicle in \c vehicles.
+   * \param[in] map The carla map used to find roads and lanes.
+   * \param[in] fast_map Fast waypoint map used to find waypoints based on locations.
+   * \param[in] router A router object used to find road sequences.
+   * \param[out] disappear_vehicles The vehicles that cannot be registered onto the lattice.
+   */
+  TrafficLattice(
+      const std::vector<VehicleTuple>& vehicles,
+      const std::unordered_map<size_t, VehicleWaypoints>& vehicle_waypoints,
+      const boost::shared_ptr<CarlaMap>& map,
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
       const boost::shared_ptr<router::Router>& router,
       boost::optional<std::unordered_set<size_t>&> disappear_vehicles = boost::none);
 
@@ -229,6 +286,31 @@ public:
   /// Return the IDs of the vehicles that are currently being tracked.
   std::unordered_set<size_t> vehicles() const;
 
+  /// Get the fast waypoint map used to find the waypoints of the vehicles.
+  const boost::shared_ptr<const utils::FastWaypointMap>& fastMap() const { return fast_map_; }
+
+  /**
+   * \brief Get the longitudinal span of a vehicle on the lattice.
+   * \param[in] vehicle The ID of the query vehicle.
+   * \return The distances of the rear and head nodes of the vehicle from
+   *         the start of the lattice, or \c boost::none if the vehicle is
+   *         not on the lattice.
+   */
+  boost::optional<std::pair<double, double>> vehicleSpan(const size_t vehicle) const;
+
+  /// Approximate number of bytes used by the lattice, see \c Lattice::memoryUsage().
+  const size_t memoryUsage() const {
+    size_t bytes = Base::memoryUsage() - sizeof(Base) + sizeof(*this);
+    bytes += utils::memoryUsage(vehicle_to_nodes_table_);
+    for (const auto& nodes : vehicle_to_nodes_table_)
+      bytes += utils::memoryUsage(nodes.second);
+    bytes += utils::memoryUsage(lane_to_vehicle_nodes_table_);
+    for (const auto& nodes : lane_to_vehicle_nodes_table_)
+      bytes += utils::memoryUsage(nodes.second);
+    bytes += utils::memoryUsage(lane_ends_table_);
+    return bytes;
+  }
+
   /**
    * \brief Check if a vehicle is in the process of lane changing.
    *
@@ -288,6 +370,11 @@ public:
    *
    * The lattice may be modified to accomodate the updated locations of all vehicles.
    *
+   * Vehicles staying in their lanes are slid along their node chains, which
+   * costs O(moved nodes) without searching the lattice. Vehicles changing lanes
+   * are deleted and added back with their waypoints. Only if a vehicle leaves
+   * the existing lattice, the lattice is rebuilt around all vehicles.
+   *
    * \param[in] vehicles Contains the updated states of the vehicles. The IDs of the
    *                     input vehicles should match exactly the vehicles on the lattice.
    * \param[out] disappear_vehicles The vehicles that are no longer on the lattice.
@@ -313,6 +400,26 @@ public:
       const std::vector<boost::shared_ptr<const CarlaVehicle>>& vehicles,
       boost::optional<std::unordered_set<size_t>&> disappear_vehicles = boost::none);
 
+  /**
+   * \brief Find the three waypoints for each of the input vehicles.
+   *
+   * The function does not touch any lattice, so that it can run before a
+   * lattice is constructed, see the constructor taking \c vehicle_waypoints.
+   * With a \c thread_pool, the vehicles are split into chunks whose
+   * waypoints are resolved concurrently through the fast map. Only the
+   * final insertion into the returned map is sequential.
+   *
+   * \param[in] vehicles The vehicles to find waypoints for.
+   * \param[in] fast_map Fast waypoint map used to find waypoints based on locations.
+   * \param[in] thread_pool The threads used to resolve the waypoints, optional.
+   * \return An unordered map with keys as vehicle IDs, and values as the
+   *         waypoints for the correspoinding vehicle from rear to head.
+   */
+  static std::unordered_map<size_t, VehicleWaypoints> resolveVehicleWaypoints(
+      const std::vector<VehicleTuple>& vehicles,
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+      const boost::shared_ptr<utils::ThreadPool>& thread_pool = nullptr);
+
   /// Get the string describing the lattice.
   std::string string(const std::string& prefix="") const;
 
@@ -349,6 +456,45 @@ protected:
    */
   void swap(TrafficLattice& other);
 
+  /**
+   * \brief Move the traffic forward without rebuilding the lattice.
+   *
+   * \param[in] vehicles The updated states of all vehicles on the lattice.
+   * \param[out] disappear_vehicles The vehicles that are no longer on the lattice.
+   * \return
+   *  - \c boost::none If a vehicle is not on the existing lattice any more.
+   *    The object is left untouched in this case.
+   *  - False if a collision is detected, in which case the object is invalid.
+   *  - True if all vehicles are updated.
+   */
+  boost::optional<bool> moveTrafficForwardIncrementally(
+      const std::vector<VehicleTuple>& vehicles,
+      std::unordered_set<size_t>& disappear_vehicles);
+
+  /**
+   * \brief Find the nodes occupied by a vehicle by sliding its current nodes
+   *        along the lane.
+   *
+   * \param[in] vehicle The updated state of the vehicle.
+   * \param[in] waypoints The rear, middle, and head waypoints of the vehicle.
+   * \param[out] nodes The nodes occupied by the vehicle from the rear to head.
+   * \return False if the vehicle is changing lanes, or cannot be slid onto
+   *         the nodes within \c kMaxSlideNodes_ on its lane.
+   */
+  bool slideVehicle(const VehicleTuple& vehicle,
+                    const VehicleWaypoints& waypoints,
+                    std::vector<uint32_t>& nodes) const;
+
+  /**
+   * \brief Slide from the given node along the lane to the node closest to the waypoint.
+   * \param[in] start The node to start from.
+   * \param[in] waypoint The waypoint to slide to.
+   * \return The closest node, or \c kNullNodeIndex if the waypoint is not
+   *         on the lane, or no such node can be found.
+   */
+  uint32_t slideNode(const uint32_t start,
+                     const boost::shared_ptr<CarlaWaypoint>& waypoint) const;
+
   /**
    * \brief Find the start waypint and range of the lattice using
    *        the given vehicles.
@@ -364,6 +510,20 @@ protected:
       boost::shared_ptr<CarlaWaypoint>& start,
       double& range) const;
 
+  /**
+   * \brief Build the lattice around the given vehicles and register them.
+   *
+   * \param[in] vehicles The vehicles to be registered onto the lattice.
+   * \param[in] vehicle_waypoints The waypoints on each vehicle.
+   * \param[in] router A router object used to find road sequences.
+   * \param[out] disappear_vehicles The vehicles that cannot be registered.
+   */
+  void registerConstructor(
+      const std::vector<VehicleTuple>& vehicles,
+      const std::unordered_map<size_t, VehicleWaypoints>& vehicle_waypoints,
+      const boost::shared_ptr<router::Router>& router,
+      boost::optional<std::unordered_set<size_t>&> disappear_vehicles);
+
   void baseConstructor(
       const boost::shared_ptr<const CarlaWaypoint>& start,
       const double range,
@@ -405,7 +565,19 @@ protected:
    */
   boost::shared_ptr<CarlaWaypoint> vehicleHeadWaypoint(
       const CarlaTransform& transform,
-      const CarlaBoundingBox& bounding_box) const;
+      const CarlaBoundingBox& bounding_box) const {
+    return fast_map_->waypoint(vehicleHeadLocation(transform, bounding_box));
+  }
+
+  /**
+   * \brief Find the location at the head of the vehicle.
+   * \param[in] transform The carla transform of the vehicle.
+   * \param[in] bounding_box The bounding box of the vehicle.
+   * \return The location at the head of the vehicle.
+   */
+  static carla::geom::Location vehicleHeadLocation(
+      const CarlaTransform& transform,
+      const CarlaBoundingBox& bounding_box);
 
   /**
    * \brief Find the waypoint at the rear of the vehicle.
@@ -416,7 +588,19 @@ protected:
    */
   boost::shared_ptr<CarlaWaypoint> vehicleRearWaypoint(
       const CarlaTransform& transform,
-      const CarlaBoundingBox& bounding_box) const;
+      const CarlaBoundingBox& bounding_box) const {
+    return fast_map_->waypoint(vehicleRearLocation(transform, bounding_box));
+  }
+
+  /**
+   * \brief Find the location at the rear of the vehicle.
+   * \param[in] transform The carla transform of the vehicle.
+   * \param[in] bounding_box The bounding box of the vehicle.
+   * \return The location at the rear of the vehicle.
+   */
+  static carla::geom::Location vehicleRearLocation(
+      const CarlaTransform& transform,
+      const CarlaBoundingBox& bounding_box);
 
   /**
    * \brief Find the three waypoints for each of the input vehicle.
@@ -484,8 +668,56 @@ protected:
     else return waypoint->GetDistance();
   }
 
+  /**
+   * \brief Get the ID of the lane a node is on.
+   *
+   * Different from the road+lane IDs used by \c Lattice, the lane section
+   * is also considered, since the same lane ID may refer to different lanes
+   * in different sections of a road.
+   */
+  size_t laneId(const Node& node) const {
+    size_t lane_id = 0;
+    utils::hashCombine(lane_id,
+                       node.waypoint()->GetRoadId(),
+                       node.waypoint()->GetSectionId(),
+                       node.waypoint()->GetLaneId());
+    return lane_id;
+  }
+
+  /// Get the distance of a node relative to the origin of the arena.
+  double arenaDistance(const Node& node) const {
+    return node.distance() + this->arena_->origin();
+  }
+
+  /// Add the nodes occupied by a vehicle to the \c lane_to_vehicle_nodes_table_.
+  void augmentLaneToVehicleNodesTable(const std::vector<uint32_t>& nodes);
+
+  /// Remove the nodes occupied by a vehicle from the \c lane_to_vehicle_nodes_table_.
+  void reduceLaneToVehicleNodesTable(const std::vector<uint32_t>& nodes);
+
+  /**
+   * \brief Unregister all vehicles from the nodes and the tables.
+   *
+   * The lattice itself is left untouched.
+   */
+  void clearVehicles();
+
+  /**
+   * \brief Find the first and last nodes of every lane on the lattice.
+   *
+   * The function should be called whenever the lattice is extended or shortened.
+   */
+  void updateLaneEndsTable();
+
   /**
    * \brief Find a front vehicle starting from a given node.
+   *
+   * The vehicle is searched in \c lane_to_vehicle_nodes_table_ lane by lane,
+   * which costs O(log n) per lane with n occupied nodes on the lane.
+   * Since the nodes of a lane are searched before moving to the next lane,
+   * a vehicle on the same lane is found even if the front node of a merging
+   * lane points into the middle of the lane.
+   *
    * \param[in] start The query node
    * \return \c nullptr if a front vehicle does not exist on the lattice.
    */
@@ -494,6 +726,9 @@ protected:
 
   /**
    * \brief Find a back vehicle starting from a given node.
+   *
+   * The vehicle is searched the same as \c frontVehicle().
+   *
    * \param[in] start The query node
    * \return \c nullptr if a back vehicle does not exist on the lattice.
    */
@@ -506,7 +741,7 @@ protected:
    * \return The node on the lattice corresponds to the head of the vehicle.
    */
   boost::shared_ptr<const Node> vehicleHeadNode(const size_t vehicle) const {
-    return vehicle_to_nodes_table_.find(vehicle)->second.back().lock();
+    return this->arena_->node(vehicle_to_nodes_table_.find(vehicle)->second.back());
   }
 
   /**
@@ -515,7 +750,7 @@ protected:
    * \return The node on the lattice corresponds to the rear of the vehicle.
    */
   boost::shared_ptr<const Node> vehicleRearNode(const size_t vehicle) const {
-    return vehicle_to_nodes_table_.find(vehicle)->second.front().lock();
+    return this->arena_->node(vehicle_to_nodes_table_.find(vehicle)->second.front());
   }
 
 }; // End class TrafficLattice.
@@ -0,0 +1,307 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <boost/format.hpp>
+
+#include <planner/common/traffic_log.h>
+
+namespace planner {
+
+namespace {
+
+const char kMagic[8] = {'C', 'L', 'P', 'T', 'R', 'L', 'O', 'G'};
+
+template<typename T>
+void append(std::string& buffer, const T& value) {
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+T extract(const std::string& buffer, size_t& offset) {
+  if (offset+sizeof(T) > buffer.size()) {
+    throw std::runtime_error(
+        "TrafficLogReader::read(): the record is shorter than its content.\n");
+  }
+  T value;
+  std::memcpy(&value, buffer.data()+offset, sizeof(T));
+  offset += sizeof(T);
+  return value;
+}
+
+} // End anonymous namespace.
+
+constexpr uint32_t TrafficLog::kVersion;
+constexpr size_t TrafficLog::kNumFields;
+constexpr std::array<double, TrafficLog::kNumFields> TrafficLog::kResolutions;
+constexpr size_t TrafficLogWriter::kFlushInterval_;
+
+TrafficLog::State TrafficLog::quantize(const Vehicle& vehicle) {
+  const std::array<double, kNumFields> values{{
+    vehicle.transform().location.x,
+    vehicle.transform().location.y,
+    vehicle.transform().location.z,
+    vehicle.transform().rotation.roll,
+    vehicle.transform().rotation.pitch,
+    vehicle.transform().rotation.yaw,
+    vehicle.speed(),
+    vehicle.acceleration(),
+    vehicle.curvature(),
+    vehicle.policySpeed()}};
+
+  State state;
+  for (size_t i = 0; i < kNumFields; ++i)
+    state[i] = std::llround(values[i] / kResolutions[i]);
+  return state;
+}
+
+void TrafficLog::dequantize(const State& state, Vehicle& vehicle) {
+  vehicle.transform().location.x    = state[0] * kResolutions[0];
+  vehicle.transform().location.y    = state[1] * kResolutions[1];
+  vehicle.transform().location.z    = state[2] * kResolutions[2];
+  vehicle.transform().rotation.roll  = state[3] * kResolutions[3];
+  vehicle.transform().rotation.pitch = state[4] * kResolutions[4];
+  vehicle.transform().rotation.yaw   = state[5] * kResolutions[5];
+  vehicle.speed()        = state[6] * kResolutions[6];
+  vehicle.acceleration() = state[7] * kResolutions[7];
+  vehicle.curvature()    = state[8] * kResolutions[8];
+  vehicle.policySpeed()  = state[9] * kResolutions[9];
+  return;
+}
+
+bool TrafficLog::isTrafficLog(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  FileHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader))) return false;
+  return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+TrafficLogWriter::TrafficLogWriter(const std::string& path) :
+  file_(path, std::ios::binary | std::ios::trunc) {
+
+  if (!file_.is_open()) {
+    throw std::runtime_error((boost::format(
+          "TrafficLogWriter::TrafficLogWriter(): "
+          "cannot open %1% for writing.\n") % path).str());
+  }
+
+  TrafficLog::FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = TrafficLog::kVersion;
+  header.reserved = 0;
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(TrafficLog::FileHeader));
+  return;
+}
+
+void TrafficLogWriter::write(
+    const double simulation_time,
+    const Vehicle& ego,
+    const std::unordered_map<size_t, Vehicle>& agents) {
+
+  // The ego comes first, followed by the agents sorted by their IDs,
+  // so that the order of the vehicles is stable across the records.
+  std::vector<const Vehicle*> vehicles;
+  vehicles.reserve(agents.size()+1);
+  vehicles.push_back(&ego);
+  for (const auto& agent : agents) vehicles.push_back(&(agent.second));
+  std::sort(vehicles.begin()+1, vehicles.end(),
+      [](const Vehicle* v0, const Vehicle* v1) { return v0->id() < v1->id(); });
+
+  std::vector<size_t> ids(vehicles.size());
+  std::vector<TrafficLog::State> states(vehicles.size());
+  for (size_t i = 0; i < vehicles.size(); ++i) {
+    ids[i] = vehicles[i]->id();
+    states[i] = TrafficLog::quantize(*(vehicles[i]));
+  }
+  const bool same_ids = ids == ids_;
+
+  // Find the states of the vehicles in the last record.
+  std::vector<const TrafficLog::State*> last_states(vehicles.size(), nullptr);
+  if (same_ids) {
+    for (size_t i = 0; i < states_.size(); ++i) last_states[i] = &(states_[i]);
+  } else {
+    std::unordered_map<size_t, size_t> last_indices;
+    for (size_t i = 0; i < ids_.size(); ++i) last_indices[ids_[i]] = i;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      auto iter = last_indices.find(ids[i]);
+      if (iter != last_indices.end()) last_states[i] = &(states_[iter->second]);
+    }
+  }
+
+  std::string buffer;
+  buffer.reserve(32 + vehicles.size()*(8+TrafficLog::kNumFields*4));
+
+  append<double>(buffer, simulation_time);
+  append<uint32_t>(buffer, vehicles.size());
+  append<uint32_t>(buffer, same_ids);
+  if (!same_ids) {
+    for (const size_t id : ids) append<uint64_t>(buffer, id);
+  }
+
+  // Bounding boxes of the new vehicles.
+  const uint32_t new_vehicles = std::count(
+      last_states.begin(), last_states.end(), nullptr);
+  append<uint32_t>(buffer, new_vehicles);
+  for (size_t i = 0; i < vehicles.size(); ++i) {
+    if (last_states[i]) continue;
+    const carla::geom::BoundingBox& box = vehicles[i]->boundingBox();
+    append<double>(buffer, box.extent.x);
+    append<double>(buffer, box.extent.y);
+    append<double>(buffer, box.extent.z);
+    append<double>(buffer, box.location.x);
+    append<double>(buffer, box.location.y);
+    append<double>(buffer, box.location.z);
+  }
+
+  // The quantities, one column at a time.
+  for (size_t field = 0; field < TrafficLog::kNumFields; ++field) {
+    for (size_t i = 0; i < vehicles.size(); ++i) {
+      const int64_t delta = last_states[i] ?
+        states[i][field] - (*last_states[i])[field] : states[i][field];
+      if (delta > std::numeric_limits<int32_t>::max() ||
+          delta < std::numeric_limits<int32_t>::min()) {
+        throw std::runtime_error((boost::format(
+              "TrafficLogWriter::write(): "
+              "quantity %1% of vehicle %2% is out of the range of the log.\n")
+            % field % ids[i]).str());
+      }
+      append<int32_t>(buffer, static_cast<int32_t>(delta));
+    }
+  }
+
+  const uint32_t size = buffer.size();
+  file_.write(reinterpret_cast<const char*>(&size), sizeof(uint32_t));
+  file_.write(buffer.data(), buffer.size());
+
+  ids_ = std::move(ids);
+  states_ = std::move(states);
+
+  if (++records_ % kFlushInterval_ == 0) file_.flush();
+  return;
+}
+
+TrafficLogReader::TrafficLogReader(const std::string& path) :
+  file_(path, std::ios::binary) {
+
+  TrafficLog::FileHeader header;
+  if (!file_.read(reinterpret_cast<char*>(&header), sizeof(TrafficLog::FileHeader)) ||
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error((boost::format(
+          "TrafficLogReader::TrafficLogReader(): "
+          "%1% is not a traffic log.\n") % path).str());
+  }
+
+  if (header.version != TrafficLog::kVersion) {
+    throw std::runtime_error((boost::format(
+          "TrafficLogReader::TrafficLogReader(): "
+          "unsupported version %1% of %2%.\n") % header.version % path).str());
+  }
+  return;
+}
+
+bool TrafficLogReader::read(TrafficLogFrame& frame) {
+
+  uint32_t size = 0;
+  if (!file_.read(reinterpret_cast<char*>(&size), sizeof(uint32_t))) return false;
+  std::string buffer(size, '\0');
+  if (!file_.read(&buffer[0], size)) return false;
+
+  size_t offset = 0;
+  frame.simulation_time = extract<double>(buffer, offset);
+  const uint32_t num_vehicles = extract<uint32_t>(buffer, offset);
+  const bool same_ids = extract<uint32_t>(buffer, offset);
+
+  if (num_vehicles == 0) {
+    throw std::runtime_error(
+        "TrafficLogReader::read(): the record has no ego vehicle.\n");
+  }
+
+  std::vector<size_t> ids;
+  if (same_ids) {
+    if (ids_.size() != num_vehicles) {
+      throw std::runtime_error(
+          "TrafficLogReader::read(): "
+          "the record reuses the IDs of the last record with a different size.\n");
+    }
+    ids = ids_;
+  } else {
+    ids.resize(num_vehicles);
+    for (size_t& id : ids) id = extract<uint64_t>(buffer, offset);
+  }
+
+  // Find the vehicles in the last record.
+  std::vector<int64_t> last_indices(num_vehicles, -1);
+  if (same_ids) {
+    for (size_t i = 0; i < num_vehicles; ++i) last_indices[i] = i;
+  } else {
+    std::unordered_map<size_t, size_t> indices;
+    for (size_t i = 0; i < ids_.size(); ++i) indices[ids_[i]] = i;
+    for (size_t i = 0; i < num_vehicles; ++i) {
+      auto iter = indices.find(ids[i]);
+      if (iter != indices.end()) last_indices[i] = iter->second;
+    }
+  }
+
+  const uint32_t new_vehicles = extract<uint32_t>(buffer, offset);
+  if (new_vehicles != std::count(last_indices.begin(), last_indices.end(), -1)) {
+    throw std::runtime_error(
+        "TrafficLogReader::read(): "
+        "the number of new vehicles does not match the IDs.\n");
+  }
+
+  std::vector<carla::geom::BoundingBox> bounding_boxes(num_vehicles);
+  for (size_t i = 0; i < num_vehicles; ++i) {
+    if (last_indices[i] >= 0) {
+      bounding_boxes[i] = bounding_boxes_[last_indices[i]];
+      continue;
+    }
+    carla::geom::BoundingBox& box = bounding_boxes[i];
+    box.extent.x   = extract<double>(buffer, offset);
+    box.extent.y   = extract<double>(buffer, offset);
+    box.extent.z   = extract<double>(buffer, offset);
+    box.location.x = extract<double>(buffer, offset);
+    box.location.y = extract<double>(buffer, offset);
+    box.location.z = extract<double>(buffer, offset);
+  }
+
+  std::vector<TrafficLog::State> states(num_vehicles);
+  for (size_t field = 0; field < TrafficLog::kNumFields; ++field) {
+    for (size_t i = 0; i < num_vehicles; ++i) {
+      const int64_t delta = extract<int32_t>(buffer, offset);
+      states[i][field] = last_indices[i] >= 0 ?
+        states_[last_indices[i]][field] + delta : delta;
+    }
+  }
+
+  // Fill in the frame.
+  frame.agents.clear();
+  for (size_t i = 0; i < num_vehicles; ++i) {
+    Vehicle& vehicle = i == 0 ? frame.ego : frame.agents[ids[i]];
+    vehicle.id() = ids[i];
+    vehicle.boundingBox() = bounding_boxes[i];
+    TrafficLog::dequantize(states[i], vehicle);
+  }
+
+  ids_ = std::move(ids);
+  states_ = std::move(states);
+  bounding_boxes_ = std::move(bounding_boxes);
+  ++records_;
+  return true;
+}
+
+} // End namespace planner.
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <boost/core/noncopyable.hpp>
+
+#include <planner/common/vehicle.h>
+
+namespace planner {
+
+/// The traffic at one simulation tick.
+struct TrafficLogFrame {
+  double simulation_time = 0.0;
+  Vehicle ego;
+  std::unordered_map<size_t, Vehicle> agents;
+};
+
+/**
+ * \brief TrafficLog defines the binary format of the traffic logs written
+ *        by \c TrafficLogWriter and read by \c TrafficLogReader.
+ *
+ * The file starts with a \c FileHeader, followed by one record per tick.
+ * A record starts with its size in bytes (uint32), so that a reader may
+ * skip it without decoding, and then contains
+ *   - the simulation time (double),
+ *   - the number of vehicles N (uint32), with the ego always the first,
+ *   - whether the vehicle IDs are the same as the previous record (uint32),
+ *   - the vehicle IDs (N x uint64), only if they have changed,
+ *   - the number of vehicles M not in the previous record (uint32),
+ *   - the bounding boxes of these vehicles (M x 6 doubles), in the order of the IDs,
+ *   - one column of N int32 for each of the \c kNumFields quantities.
+ *
+ * Each quantity is quantized with its resolution in \c kResolutions, and
+ * stored as the difference from the value of the same vehicle in the
+ * previous record, or as the quantized value itself for a new vehicle.
+ * The format is little endian, which is the byte order of the machines
+ * this package runs on.
+ *
+ * \c scripts/traffic_log.py is the python reader of the format.
+ */
+struct TrafficLog {
+
+  /// Header of the log file.
+  struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+  };
+
+  /// Version of the log file format.
+  static constexpr uint32_t kVersion = 1;
+
+  /// The quantities stored for each vehicle at every tick, in this order:
+  /// x, y, z (m), roll, pitch, yaw (deg), speed (m/s), acceleration (m/s^2),
+  /// curvature (1/m) and policy speed (m/s).
+  static constexpr size_t kNumFields = 10;
+
+  /// Resolution of the quantities.
+  static constexpr std::array<double, kNumFields> kResolutions{{
+    1.0e-4, 1.0e-4, 1.0e-4,
+    1.0e-4, 1.0e-4, 1.0e-4,
+    1.0e-4, 1.0e-4, 1.0e-7, 1.0e-4}};
+
+  /// Quantized quantities of a vehicle.
+  using State = std::array<int64_t, kNumFields>;
+
+  /// Get the quantized quantities of a vehicle.
+  static State quantize(const Vehicle& vehicle);
+
+  /// Set the quantities of a vehicle from the quantized ones.
+  static void dequantize(const State& state, Vehicle& vehicle);
+
+  /// Check if a file starts with the header of a traffic log.
+  static bool isTrafficLog(const std::string& path);
+
+}; // End struct TrafficLog.
+
+/**
+ * \brief TrafficLogWriter records the traffic at every simulation tick
+ *        into a traffic log, see \c TrafficLog for the format.
+ */
+class TrafficLogWriter : private boost::noncopyable {
+
+protected:
+
+  /// Number of records between flushing the file.
+  static constexpr size_t kFlushInterval_ = 100;
+
+  std::ofstream file_;
+
+  /// Vehicle IDs in the last record.
+  std::vector<size_t> ids_;
+
+  /// Quantized quantities of the vehicles in the last record.
+  std::vector<TrafficLog::State> states_;
+
+  /// Number of records written so far.
+  size_t records_ = 0;
+
+public:
+
+  /// Open the file at \c path, which is truncated if it exists.
+  TrafficLogWriter(const std::string& path);
+
+  ~TrafficLogWriter() { file_.flush(); }
+
+  /// Number of records written so far.
+  const size_t records() const { return records_; }
+
+  /**
+   * \brief Append the traffic at a tick to the log.
+   * \param[in] simulation_time The simulation time of the tick.
+   * \param[in] ego The ego vehicle.
+   * \param[in] agents The agent vehicles.
+   */
+  void write(const double simulation_time,
+             const Vehicle& ego,
+             const std::unordered_map<size_t, Vehicle>& agents);
+
+  /// Flush the written records to the file.
+  void flush() { file_.flush(); }
+
+}; // End class TrafficLogWriter.
+
+/**
+ * \brief TrafficLogReader reads a traffic log one record at a time, so that
+ *        the memory usage does not grow with the length of the log.
+ */
+class TrafficLogReader : private boost::noncopyable {
+
+protected:
+
+  std::ifstream file_;
+
+  /// Vehicle IDs in the last record.
+  std::vector<size_t> ids_;
+
+  /// Quantized quantities of the vehicles in the last record.
+  std::vector<TrafficLog::State> states_;
+
+  /// Bounding boxes of the vehicles in the last record.
+  std::vector<carla::geom::BoundingBox> bounding_boxes_;
+
+  /// Number of records read so far.
+  size_t records_ = 0;
+
+public:
+
+  /// Open the log at \c path.
+  TrafficLogReader(const std::string& path);
+
+  /// Number of records read so far.
+  const size_t records() const { return records_; }
+
+  /**
+   * \brief Read the next record of the log.
+   *
+   * A truncated record at the end of the log, e.g. if the recording
+   * process is killed, is treated as the end of the log.
+   *
+   * \param[out] frame The traffic of the record.
+   * \return false if there is no more record in the log.
+   */
+  bool read(TrafficLogFrame& frame);
+
+}; // End class TrafficLogReader.
+
+} // End namespace planner.
@@ -27,7 +27,7 @@ TrafficManager::TrafficManager(
     const double range,
     const boost::shared_ptr<router::Router>& router,
     const boost::shared_ptr<CarlaMap>& map,
-    const boost::shared_ptr<utils::FastWaypointMap>& fast_map) {
+    const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) {
   // The \c longitudinal_resolution_ is fixed to 1.0m.
   this->map_ = map;
   this->fast_map_ = fast_map;
@@ -69,10 +69,9 @@ bool TrafficManager::moveTrafficForward(
   }
 
   // Clear all vehicles for the moment, will add them back later.
-  for (auto& item : this->vehicle_to_nodes_table_) {
-    for (auto& node : item.second) {
-      if (node.lock()) node.lock()->vehicle() = boost::none;
-    }
+  for (const auto& item : this->vehicle_to_nodes_table_) {
+    for (const uint32_t node : item.second)
+      (*this->arena_)[node].vehicle() = boost::none;
   }
   this->vehicle_to_nodes_table_.clear();
 
@@ -120,8 +119,8 @@ boost::optional<std::pair<
 
   // All lattice exits are candidates where we can spawn new vehicles.
   std::vector<boost::shared_ptr<const Node>> candidates;
-  for (auto& exit : this->lattice_exits_)
-    candidates.push_back(exit.lock());
+  for (const uint32_t exit : this->lattice_exits_)
+    candidates.push_back(this->arena_->node(exit));
 
   // Collect candidates that meet the requirement.
   std::vector<std::pair<double, boost::shared_ptr<const CarlaWaypoint>>> valid_candidates;
@@ -154,8 +153,8 @@ boost::optional<std::pair<
 
   // All lattice entries are candidates where we can spawn new vehicles.
   std::vector<boost::shared_ptr<const Node>> candidates;
-  for (auto& entry : this->lattice_entries_)
-    candidates.push_back(entry.lock());
+  for (const uint32_t entry : this->lattice_entries_)
+    candidates.push_back(this->arena_->node(entry));
 
   // Collect candidates that meet the requirement.
   std::vector<std::pair<double, boost::shared_ptr<const CarlaWaypoint>>> valid_candidates;
@@ -81,7 +81,7 @@ public:
                  const double range,
                  const boost::shared_ptr<router::Router>& router,
                  const boost::shared_ptr<CarlaMap>& map,
-                 const boost::shared_ptr<utils::FastWaypointMap>& fast_map);
+                 const boost::shared_ptr<const utils::FastWaypointMap>& fast_map);
 
   /**
    * \brief Update the the vehcile postions in the lattice.
@@ -25,6 +25,9 @@
 #include <router/loop_router/loop_router.h>
 #include <planner/common/vehicle_path.h>
 #include <planner/common/snapshot.h>
+#include <planner/common/profiler.h>
+#include <planner/common/collision_checker.h>
+#include <planner/common/cost_model.h>
 
 namespace planner {
 
@@ -37,6 +40,9 @@ namespace planner {
  * a paremeter, while the rest of the agents are assumed to be lane
  * followers.
  *
+ * This class is only the virtual interface of the simulators. The simulation
+ * loop is implemented by \c TrafficSimulatorCore, which the simulators should
+ * derive from, so that the policies are resolved at compile time.
  */
 class TrafficSimulator : private boost::noncopyable {
 
@@ -58,24 +64,35 @@ protected:
   boost::shared_ptr<CarlaMap> map_ = nullptr;
 
   /// Fast waypoint map.
-  boost::shared_ptr<utils::FastWaypointMap> fast_map_ = nullptr;
+  boost::shared_ptr<const utils::FastWaypointMap> fast_map_ = nullptr;
+
+  /// Costs of the simulation.
+  boost::shared_ptr<const CostModel> cost_model_ = CostModel::defaultModel();
+
+  /// Collision checker, together with its buffers of the vehicle footprints
+  /// at the start and end of a step.
+  CollisionChecker collision_checker_;
+  std::vector<CollisionChecker::Footprint> start_footprints_;
+  std::vector<CollisionChecker::Footprint> end_footprints_;
 
 public:
 
   TrafficSimulator(const Snapshot& snapshot,
                    const boost::shared_ptr<router::Router>& router,
                    const boost::shared_ptr<CarlaMap>& map,
-                   const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+                   const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
     snapshot_(snapshot),
     router_(router),
     map_(map),
     fast_map_(fast_map) {}
 
+  /// The router of the traffic lattice in the snapshot is used, so that
+  /// its route index, if there is one, is shared by the simulations.
   TrafficSimulator(const Snapshot& snapshot,
                    const boost::shared_ptr<CarlaMap>& map,
-                   const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+                   const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
     snapshot_(snapshot),
-    router_(boost::make_shared<router::LoopRouter>()),
+    router_(snapshot.trafficLattice()->router()),
     map_(map),
     fast_map_(fast_map) {}
 
@@ -84,6 +101,9 @@ public:
   const boost::shared_ptr<const router::Router> router() const { return router_; }
   boost::shared_ptr<router::Router>& router() { return router_; }
 
+  const boost::shared_ptr<const CostModel> costModel() const { return cost_model_; }
+  boost::shared_ptr<const CostModel>& costModel() { return cost_model_; }
+
   /**
    * \brief Simulate the traffic.
    *
@@ -105,16 +125,53 @@ public:
    */
   virtual const bool simulate(
       const ContinuousPath& path, const double default_dt, const double max_time,
-      double& time, double& cost);
+      double& time, double& cost) = 0;
 
 protected:
 
+  /**
+   * \brief Check whether the vehicles collide while moving from the snapshot
+   *        to the given updated status.
+   *
+   * The volumes swept by the vehicles are checked, so the collisions within
+   * a step are detected regardless of the step size and the resolution of the
+   * traffic lattice. This is much cheaper than updating the traffic lattice,
+   * which therefore only has to be done if there is no collision.
+   *
+   * \param[in] updated_tuples The updated status of the vehicles, see \c step().
+   *                           The ego should come first, followed by the agents
+   *                           in the order of their slots.
+   * \return true If a collision is detected.
+   */
+  const bool sweptCollision(
+      const std::vector<std::tuple<size_t, CarlaTransform, double, double, double>>& updated_tuples);
+
   /// Compute the acceleration of the ego vehicle given the current traffic scenario.
   virtual const double egoAcceleration() const = 0;
 
   /// Compute the acceleration of the agent vehicle given the current traffic scenario.
   virtual const double agentAcceleration(const size_t agent) const = 0;
 
+  /**
+   * \brief Compute the accelerations of all agent vehicles given the current
+   *        traffic scenario.
+   *
+   * By default, \c agentAcceleration() is called for every agent. Derived classes
+   * may override this function to evaluate all agents in one batch.
+   *
+   * \param[out] accels The accelerations of the agents, in the same order as
+   *                    the agents are stored in the snapshot, i.e. by their slots.
+   */
+  virtual void agentAccelerations(std::vector<double>& accels) const = 0;
+
+  /**
+   * \brief Collect the lead vehicles of all agent vehicles.
+   *
+   * \param[out] lead_speeds The speeds of the lead vehicles, 0 if there is no lead.
+   * \param[out] distances The distances to the lead vehicles, infinity if there is no lead.
+   */
+  void agentLeads(std::vector<double>& lead_speeds, std::vector<double>& distances) const;
+
   virtual const std::tuple<size_t, CarlaTransform, double, double, double>
     updatedAgentTuple(const size_t id, const double accel, const double dt) const;
 
@@ -122,13 +179,13 @@ protected:
   virtual const double ttcCost(const double ttc) const;
 
   /// Compute the ttc cost based on the ttc of the ego vehicle in the snapshot.
-  virtual const double ttcCost() const;
+  virtual const double ttcCost() const = 0;
 
   /// Compute the accel cost based on the input accel.
   virtual const double accelCost(const double accel) const;
 
   /// Compute the accel cost based on the accel of the vehicles in the snapshot.
-  virtual const double accelCost() const;
+  virtual const double accelCost() const = 0;
 
   /**
    * \brief This function is used to determine how much longer a vehicle can travel.
@@ -152,5 +209,227 @@ protected:
 
 }; // End class TrafficSimulator.
 
+/**
+ * \brief TrafficSimulatorCore implements the simulation loop of \c TrafficSimulator
+ *        with the policies of the derived simulator \c Derived.
+ *
+ * The policies, i.e. \c egoAcceleration(), \c agentAcceleration(), \c ttcCost(),
+ * \c accelCost(), and \c updatedAgentTuple(), are called with qualified names of
+ * \c Derived, so that they are bound at compile time and can be inlined into the
+ * loop, instead of being dispatched through the vtable for every vehicle at every
+ * step. The policies not declared in \c Derived fall back to the ones here and in
+ * \c TrafficSimulator. The cost tables are looked up from \c cost_model_, where
+ * the accel costs of the ego and its followers are evaluated in one batch by the
+ * default \c accelCost(). The virtual functions of \c TrafficSimulator remain valid,
+ * so that a simulator can still be used through the base class.
+ *
+ * A derived simulator should be declared as
+ * \code
+ * class MySimulator final : public TrafficSimulatorCore<MySimulator> {
+ *   friend class TrafficSimulatorCore<MySimulator>;
+ *   ...
+ * };
+ * \endcode
+ * where the friend declaration gives the core access to the protected policies.
+ */
+template<typename Derived>
+class TrafficSimulatorCore : public TrafficSimulator {
+
+private:
+
+  using Base = TrafficSimulator;
+  using This = TrafficSimulatorCore<Derived>;
+
+public:
+
+  TrafficSimulatorCore(const Snapshot& snapshot,
+                       const boost::shared_ptr<router::Router>& router,
+                       const boost::shared_ptr<CarlaMap>& map,
+                       const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
+    Base(snapshot, router, map, fast_map) {}
+
+  TrafficSimulatorCore(const Snapshot& snapshot,
+                       const boost::shared_ptr<CarlaMap>& map,
+                       const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
+    Base(snapshot, map, fast_map) {}
+
+  /// See \c TrafficSimulator::simulate().
+  virtual const bool simulate(
+      const ContinuousPath& path, const double default_dt, const double max_time,
+      double& time, double& cost) override;
+
+protected:
+
+  const Derived& derived() const { return static_cast<const Derived&>(*this); }
+
+  /**
+   * \brief Move all vehicles forward with constant accelerations.
+   *
+   * \param[in] path The path to be executed by the ego vehicle.
+   * \param[in] dt The duration of the step.
+   * \param[in] ego_accel The acceleration of the ego vehicle.
+   * \param[in] agent_accels The accelerations of the agents, indexed by their slots.
+   * \param[in,out] ego_distance The distance that the ego has travelled on the path.
+   * \return false If collision is detected.
+   */
+  const bool step(const ContinuousPath& path,
+                  const double dt,
+                  const double ego_accel,
+                  const std::vector<double>& agent_accels,
+                  double& ego_distance);
+
+  /// By default, \c agentAcceleration() of \c Derived is called for every agent.
+  virtual void agentAccelerations(std::vector<double>& accels) const override {
+    const VehicleTable& agents = snapshot_.agents();
+    accels.resize(agents.size());
+    for (size_t slot = 0; slot < agents.size(); ++slot)
+      accels[slot] = derived().Derived::agentAcceleration(agents.ids()[slot]);
+    return;
+  }
+
+  using Base::ttcCost;
+  using Base::accelCost;
+
+  virtual const double ttcCost() const override {
+    boost::optional<std::pair<size_t, double>> ego_lead =
+      snapshot_.trafficLattice()->front(snapshot_.ego().id());
+
+    if (!ego_lead) return derived().Derived::ttcCost(10.0);
+    else return derived().Derived::ttcCost(ego_lead->second/snapshot_.ego().speed());
+  }
+
+  virtual const double accelCost() const override {
+    // We consider four vehicles in computing the accel cost.
+    // The ego and the followers of the ego vehicle.
+    boost::optional<std::pair<size_t, double>> back =
+      snapshot_.trafficLattice()->back(snapshot_.ego().id());
+    boost::optional<std::pair<size_t, double>> left_back =
+      snapshot_.trafficLattice()->leftBack(snapshot_.ego().id());
+    boost::optional<std::pair<size_t, double>> right_back =
+      snapshot_.trafficLattice()->rightBack(snapshot_.ego().id());
+
+    // The costs of all four vehicles are looked up in one batch.
+    std::array<double, 4> accels;
+    size_t num = 0;
+    accels[num++] = snapshot_.ego().acceleration();
+    if (back)       accels[num++] = snapshot_.vehicle(back->first).acceleration();
+    if (left_back)  accels[num++] = snapshot_.vehicle(left_back->first).acceleration();
+    if (right_back) accels[num++] = snapshot_.vehicle(right_back->first).acceleration();
+
+    std::array<double, 4> costs;
+    cost_model_->accelCosts(accels.data(), num, costs.data());
+
+    double agent_brake_cost = 0.0;
+    for (size_t i = 1; i < num; ++i) agent_brake_cost += costs[i];
+
+    return costs[0] + cost_model_->followerAccelCostWeight()*agent_brake_cost;
+  }
+
+}; // End class TrafficSimulatorCore.
+
+template<typename Derived>
+const bool TrafficSimulatorCore<Derived>::step(
+    const ContinuousPath& path,
+    const double dt,
+    const double ego_accel,
+    const std::vector<double>& agent_accels,
+    double& ego_distance) {
+  CLP_PROFILE_SCOPE("TrafficSimulator::step");
+
+  // Used to store the updated status of all vehicles.
+  std::vector<std::tuple<size_t, CarlaTransform, double, double, double>> updated_tuples;
+  updated_tuples.reserve(snapshot_.agents().size()+1);
+
+  // Update the distance of the ego on the path.
+  ego_distance += snapshot_.ego().speed()*dt + 0.5*ego_accel*dt*dt;
+  if (ego_distance > path.range()) ego_distance = path.range();
+
+  // Store the updated status of the ego.
+  std::pair<CarlaTransform, double> ego_transform = path.transformAt(ego_distance);
+  updated_tuples.push_back(std::make_tuple(
+        snapshot_.ego().id(),
+        ego_transform.first,
+        snapshot_.ego().speed()+ego_accel*dt,
+        ego_accel,
+        ego_transform.second));
+
+  // Take care of the agents.
+  const VehicleTable& agents = snapshot_.agents();
+  for (size_t slot = 0; slot < agents.size(); ++slot) {
+    updated_tuples.push_back(derived().Derived::updatedAgentTuple(
+          agents.ids()[slot], agent_accels[slot], dt));
+  }
+
+  // Stop before updating the traffic lattice if the vehicles collide within the step.
+  if (sweptCollision(updated_tuples)) return false;
+
+  // Update the snapshot.
+  if (!snapshot_.updateTraffic(updated_tuples)) return false;
+
+  return true;
+}
+
+template<typename Derived>
+const bool TrafficSimulatorCore<Derived>::simulate(
+    const ContinuousPath& path, const double default_dt, const double max_time,
+    double& time, double& cost) {
+  CLP_PROFILE_SCOPE("TrafficSimulator::simulate");
+
+  // Reset the output to 0.
+  time = 0.0;
+  cost = 0.0;
+
+  // The actual simulation time step, which may vary for different iterations.
+  double dt = default_dt;
+  // The distance that ego has travelled on the input path.
+  double ego_distance = 0.0;
+
+  // FIXME: This is just a trial for defining the stage costs.
+  std::vector<double> ttc_cost;
+  std::vector<double> brake_cost;
+
+  // The accelerations of the agents, reused across iterations.
+  std::vector<double> agent_accels;
+
+  while (time < max_time && dt >= default_dt) {
+
+    // The acceleration to be applied by the ego vehicle.
+    const double ego_accel = derived().Derived::egoAcceleration();
+
+    // Compute the actual time step.
+    const double remaining_time = derived().Derived::remainingTime(
+        snapshot_.ego().speed(), ego_accel, path.range()-ego_distance);
+    dt = default_dt;
+    dt = dt <= remaining_time ? dt : remaining_time;
+    dt = dt <= max_time-time  ? dt : max_time-time;
+
+    // Move all vehicles forward.
+    derived().Derived::agentAccelerations(agent_accels);
+    if (!step(path, dt, ego_accel, agent_accels, ego_distance)) return false;
+
+    // TODO: Accumulate the cost.
+    ttc_cost.push_back(derived().Derived::ttcCost());
+    brake_cost.push_back(derived().Derived::accelCost());
+
+    // Tick the time.
+    time += dt;
+  }
+
+  // TODO: Should I use mean or max?
+  double average_ttc_cost = 0.0;
+  for (const auto c : ttc_cost) average_ttc_cost += c;
+  average_ttc_cost /= ttc_cost.size();
+
+  double average_brake_cost = 0.0;
+  for (const auto c : brake_cost) average_brake_cost += c;
+  average_brake_cost /= brake_cost.size();
+
+  cost = average_ttc_cost + average_brake_cost;
+  if (path.laneChangeType() != VehiclePath::LaneChangeType::KeepLane)
+    cost += cost_model_->laneChangeCost();
+
+  return true;
+}
+
 } // End namespace planner.
 
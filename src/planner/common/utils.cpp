@@ -13,6 +13,7 @@
 */
 
 #include <cmath>
+#include <algorithm>
 #include <stdexcept>
 #include <string>
 #include <boost/format.hpp>
@@ -58,16 +59,12 @@ carla::geom::Transform convertTransform(const carla::geom::Transform& in) {
   return out;
 }
 
-const double curvatureAtWaypoint(
-    const boost::shared_ptr<const carla::client::Waypoint>& waypoint,
-    const boost::shared_ptr<const carla::client::Map>& map) {
-  // Get the road.
-  const carla::road::Road& road =
-    map->GetMap().GetMap().GetRoad(waypoint->GetRoadId());
+const double curvatureAtRoadDistance(
+    const carla::road::Road& road, const double distance) {
 
   // Get the road geometry info.
   const carla::road::element::RoadInfoGeometry* road_info =
-    road.GetInfo<carla::road::element::RoadInfoGeometry>(waypoint->GetDistance());
+    road.GetInfo<carla::road::element::RoadInfoGeometry>(distance);
 
   // Get the actual geometry of the road.
   const carla::road::element::Geometry& geometry = road_info->GetGeometry();
@@ -84,27 +81,33 @@ const double curvatureAtWaypoint(
     curvature = geometry_arc.GetCurvature();
 
   } else if (geometry.GetType() == carla::road::element::GeometryType::SPIRAL) {
-    //FIXME: Not sure how to deal with this.
-    //       But there is no example for this road type from Town01 to Town07.
-    std::string error_msg(
-        "curvatureAtWaypoint(): "
-        "cannot get curvature for waypointa on spiral roads.\n");
-    boost::format format(
-        "waypoint %1% x:%2% y:%3% z:%4% r:%5% p:%6% y:%7% road:%8% lane:%9%\n");
-    format % waypoint->GetId()
-           % waypoint->GetTransform().location.x
-           % waypoint->GetTransform().location.y
-           % waypoint->GetTransform().location.z
-           % waypoint->GetTransform().rotation.roll
-           % waypoint->GetTransform().rotation.pitch
-           % waypoint->GetTransform().rotation.yaw
-           % waypoint->GetRoadId()
-           % waypoint->GetLaneId();
-
-    throw std::runtime_error(error_msg+format.str());
+    // The curvature of a spiral (clothoid) changes linearly with the distance.
+    const carla::road::element::GeometrySpiral& geometry_spiral =
+      dynamic_cast<const carla::road::element::GeometrySpiral&>(geometry);
+
+    double ratio = 0.0;
+    if (geometry_spiral.GetLength() > 0.0) {
+      ratio = (distance-geometry_spiral.GetStartOffset()) / geometry_spiral.GetLength();
+      ratio = std::min(std::max(ratio, 0.0), 1.0);
+    }
+    curvature = geometry_spiral.GetCurvatureStart() +
+      ratio * (geometry_spiral.GetCurvatureEnd()-geometry_spiral.GetCurvatureStart());
   } else {
   }
 
+  return curvature;
+}
+
+const double curvatureAtWaypoint(
+    const boost::shared_ptr<const carla::client::Waypoint>& waypoint,
+    const boost::shared_ptr<const carla::client::Map>& map) {
+  // Get the road.
+  const carla::road::Road& road =
+    map->GetMap().GetMap().GetRoad(waypoint->GetRoadId());
+
+  // Get the curvature of the road reference line.
+  const double curvature = curvatureAtRoadDistance(road, waypoint->GetDistance());
+
   // Fix the curvature based on the sign of the lane ID.
   if (waypoint->GetLaneId() >= 0) return curvature;
   else return -curvature;
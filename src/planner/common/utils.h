@@ -20,6 +20,7 @@
 #include <carla/client/Map.h>
 #include <carla/client/Waypoint.h>
 #include <carla/geom/Transform.h>
+#include <carla/road/Road.h>
 
 namespace utils {
 
@@ -75,6 +76,27 @@ void convertTransformInPlace(carla::geom::Transform& in);
 carla::geom::Transform convertTransform(const carla::geom::Transform& in);
 /**@}*/
 
+/**
+ * \brief Compute the curvature of a road at the given distance.
+ *
+ * The curvature is w.r.t. the reference line of the road, i.e. it is not
+ * corrected by the sign of any lane ID. On spiral geometries, the curvature
+ * is linearly interpolated between the start and end curvature.
+ *
+ * \param[in] road The query road.
+ * \param[in] distance The distance (\c s) along the road.
+ * \return The curvature of the road reference line at \c distance.
+ */
+const double curvatureAtRoadDistance(
+    const carla::road::Road& road, const double distance);
+
+/**
+ * \brief Compute the curvature at the given waypoint.
+ *
+ * \note This function queries the road geometry of the map every time
+ *       it is called. Prefer \c FastWaypointMap::curvature() in the
+ *       performance critical code, which uses a precomputed table.
+ */
 const double curvatureAtWaypoint(
     const boost::shared_ptr<const carla::client::Waypoint>& waypoint,
     const boost::shared_ptr<const carla::client::Map>& map);
@@ -14,12 +14,15 @@
 
 #include <string>
 #include <cmath>
+#include <limits>
 #include <stdexcept>
 #include <algorithm>
 #include <boost/format.hpp>
+#include <boost/make_shared.hpp>
 
 #include <planner/common/vehicle_path.h>
 #include <planner/common/utils.h>
+#include <planner/common/profiler.h>
 
 namespace planner {
 
@@ -101,6 +104,7 @@ ContinuousPath::ContinuousPath(
   Base  (lane_change_type),
   start_(start),
   end_  (end) {
+  CLP_PROFILE_SCOPE("ContinuousPath::optimizePath");
 
   // Convert the start and end to right handed coordinate system.
   const NonHolonomicPath::State start_state = carlaTransformToPathState(start_);
@@ -132,6 +136,7 @@ ContinuousPath::ContinuousPath(const DiscretePath& discrete_path) :
   Base  (discrete_path.laneChangeType()),
   start_(discrete_path.startTransform()),
   end_  (discrete_path.endTransform()) {
+  CLP_PROFILE_SCOPE("ContinuousPath::optimizePath");
 
   // Convert the start and end to right handed coordinate system.
   const NonHolonomicPath::State start_state = carlaTransformToPathState(start_);
@@ -159,6 +164,49 @@ ContinuousPath::ContinuousPath(const DiscretePath& discrete_path) :
   return;
 }
 
+ContinuousPath::ContinuousPath(
+    const std::pair<CarlaTransform, double>& start,
+    const std::pair<CarlaTransform, double>& end,
+    const LaneChangeType& lane_change_type,
+    const NonHolonomicPath& path) :
+  Base  (lane_change_type),
+  start_(start),
+  end_  (end),
+  path_ (path) {
+  CLP_PROFILE_COUNT("ContinuousPath::reusePath", 1);
+
+  // The constant coefficient has to agree with the start curvature exactly,
+  // which may differ slightly from the one the path is optimized with.
+  path_.a = carlaTransformToPathState(start_).kappa;
+  return;
+}
+
+void ContinuousPath::setSampleResolution(const double resolution) {
+  if (resolution <= 0.0) {
+    throw std::runtime_error((boost::format(
+            "ContinuousPath::setSampleResolution(): "
+            "invalid sample resolution %1%.\n") % resolution).str());
+  }
+
+  sample_resolution_ = resolution;
+  boost::atomic_store(&samples_,
+      boost::shared_ptr<const std::vector<NonHolonomicPath::State>>(nullptr));
+  return;
+}
+
+boost::shared_ptr<const std::vector<NonHolonomicPath::State>>
+ContinuousPath::cachedSamples() const {
+  boost::shared_ptr<const std::vector<NonHolonomicPath::State>> samples =
+    boost::atomic_load(&samples_);
+  if (samples) return samples;
+
+  CLP_PROFILE_SCOPE("ContinuousPath::cachedSamples");
+  samples = boost::make_shared<const std::vector<NonHolonomicPath::State>>(
+      path_.sample(carlaTransformToPathState(start_), 0.0, sample_resolution_));
+  boost::atomic_store(&samples_, samples);
+  return samples;
+}
+
 const std::pair<ContinuousPath::CarlaTransform, double>
 ContinuousPath::transformAt(const double s) const {
 
@@ -169,11 +217,16 @@ ContinuousPath::transformAt(const double s) const {
             % s % path_.sf).str());
   }
 
-  const NonHolonomicPath::State start_state = carlaTransformToPathState(start_);
-  const NonHolonomicPath::State state = path_.evaluate(start_state, s);
+  // Integrate from the closest sample before s. All samples are on the grid
+  // except the last one, which is at the end of the path.
+  const boost::shared_ptr<const std::vector<NonHolonomicPath::State>> samples = cachedSamples();
+  const size_t i = std::min(static_cast<size_t>(s/sample_resolution_), samples->size()-1);
+  const double si = i+1 == samples->size() ? path_.sf : i*sample_resolution_;
+  const NonHolonomicPath::State state = s == si ?
+    (*samples)[i] : path_.evaluate((*samples)[i], si, s);
 
   // Generate a base transform by interpolating start and end.
-  const double ratio = s / path_.sf;
+  const double ratio = path_.sf > 0.0 ? s / path_.sf : 1.0;
   std::pair<CarlaTransform, double> base_transform =
     interpolateTransform(start_, end_, 1.0-ratio);
 
@@ -206,15 +259,11 @@ DiscretePath::DiscretePath(
     const LaneChangeType& lane_change_type) :
   Base(lane_change_type) {
 
-  //std::printf("DiscretePath::DiscretePath():\n");
-
   // Convert the start and end to right handed coordinate system.
-  //std::printf("Convert carla transform to state.\n");
   const NonHolonomicPath::State start_state = carlaTransformToPathState(start);
   const NonHolonomicPath::State end_state = carlaTransformToPathState(end);
 
   // Compute the Kelly-Navy path.
-  //std::printf("Optimize path.\n");
   NonHolonomicPath path;
   const bool success = path.optimizePath(start_state, end_state);
   if (!success) {
@@ -239,113 +288,161 @@ DiscretePath::DiscretePath(
   }
 
   // Sample the path with pre-determined resolution.
-  //std::printf("Take samples on path.\n");
-  double s = 0.0;
-  for (; s <= path.sf; s += resolution_) {
-    const double ratio = s / path.sf;
-    std::pair<CarlaTransform, double> base_transform =
-      interpolateTransform(start, end, 1.0-ratio);
-
-    NonHolonomicPath::State state = path.evaluate(start_state, s);
-    samples_[s] = pathStateToCarlaTransform(state, base_transform.first);
-  }
-
-  //std::printf("Take a sample at the path end.\n");
-  if (s < path.sf) {
-    NonHolonomicPath::State state = path.evaluate(start_state, path.sf);
-    samples_[path.sf] = pathStateToCarlaTransform(state, end.first);
-  }
-
-  //std::printf("Check the number of samples.\n");
-  if (samples_.empty()) {
-    throw std::runtime_error(
-        "DiscretePath::DiscretePath(): empty discrete path.\n");
-  }
-
+  appendSamples(start, end, path);
   return;
 }
 
 DiscretePath::DiscretePath(const ContinuousPath& continuous_path) :
   Base(continuous_path.laneChangeType()) {
-
-  double s = 0.0;
-  for (; s <= continuous_path.range(); s += resolution_)
-    samples_[s] = continuous_path.transformAt(s);
-
-  if (s < continuous_path.range()) {
-    samples_[continuous_path.range()] =
-      continuous_path.transformAt(continuous_path.range());
-  }
-
-  if (samples_.empty()) {
-    throw std::runtime_error(
-        "DiscretePath::DiscretePath(): empty discrete path.\n");
-  }
-
+  appendSamples(continuous_path.startTransform(),
+                continuous_path.endTransform(),
+                continuous_path.nonHolonomicPath());
   return;
 }
 
 const std::pair<DiscretePath::CarlaTransform, double>
 DiscretePath::transformAt(const double s) const {
 
-  if (s < 0.0 || s > range()) {
+  if (s < 0.0 || s > range_) {
     throw std::runtime_error((boost::format(
             "DiscretePath::transformAt(): "
             "the input distance %1% is outside path range %2%.\n")
-            % s % range()).str());
+            % s % range_).str());
   }
 
-  if (s == 0.0) return samples_.begin()->second;
-  if (s == samples_.rbegin()->first) return samples_.rbegin()->second;
+  if (samples_.size() == 1) return samples_.front();
 
-  auto iter = std::find_if(samples_.begin(), samples_.end(),
-      [&s](const std::pair<double, std::pair<CarlaTransform, double>>& sample)->bool{
-        return sample.first > s;
-      });
+  // Find the samples before and after the given distance.
+  const size_t i = std::min(static_cast<size_t>(s/resolution_), samples_.size()-2);
+  const double s1 = i * resolution_;
+  const double s2 = i+2 == samples_.size() ? range_ : s1 + resolution_;
+  const double ratio = std::max(0.0, std::min(1.0, (s2-s) / (s2-s1)));
+  return interpolateTransform(samples_[i], samples_[i+1], ratio);
+}
 
-  if (iter==samples_.begin() || iter==samples_.end()) {
-    throw std::runtime_error((boost::format(
-            "DiscretePath::transformAt(): "
-            "the input distance %1% is outside path range %2%.\n")
-            % s % range()).str());
+const double DiscretePath::project(
+    const CarlaLocation& location, double& distance) const {
+
+  auto sampleDistance = [this](const size_t i)->double{
+    return i+1 == samples_.size() ? range_ : i*resolution_;
+  };
+
+  // The closest sample.
+  size_t closest = 0;
+  double closest_sqr_distance = std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < samples_.size(); ++i) {
+    const CarlaLocation& sample = samples_[i].first.location;
+    const double sqr_distance = std::pow(sample.x-location.x, 2.0) +
+                                std::pow(sample.y-location.y, 2.0) +
+                                std::pow(sample.z-location.z, 2.0);
+    if (sqr_distance >= closest_sqr_distance) continue;
+    closest = i;
+    closest_sqr_distance = sqr_distance;
+  }
+
+  double s = sampleDistance(closest);
+  distance = std::sqrt(closest_sqr_distance);
+
+  // Refine the projection on the segments before and after the closest sample.
+  for (size_t i = closest > 0 ? closest-1 : 0;
+       i < std::min(closest+1, samples_.size()-1); ++i) {
+    const CarlaLocation& start = samples_[i].first.location;
+    const CarlaLocation& end = samples_[i+1].first.location;
+    const double dx = end.x - start.x;
+    const double dy = end.y - start.y;
+    const double dz = end.z - start.z;
+    const double sqr_length = dx*dx + dy*dy + dz*dz;
+    if (sqr_length <= 0.0) continue;
+
+    const double ratio = std::max(0.0, std::min(1.0,
+          ((location.x-start.x)*dx + (location.y-start.y)*dy + (location.z-start.z)*dz) / sqr_length));
+    const double projection_distance = std::sqrt(
+        std::pow(start.x + ratio*dx - location.x, 2.0) +
+        std::pow(start.y + ratio*dy - location.y, 2.0) +
+        std::pow(start.z + ratio*dz - location.z, 2.0));
+    if (projection_distance >= distance) continue;
+
+    distance = projection_distance;
+    s = sampleDistance(i) + ratio*(sampleDistance(i+1)-sampleDistance(i));
   }
 
-  //std::printf("samples size: %lu\n", samples_.size());
-  //std::printf("movement: %f\n", s);
+  return s;
+}
+
+void DiscretePath::append(const DiscretePath& path) {
+  checkGap(path.startTransform());
+
+  // Resample the input path on the grid of this path.
+  const double offset = range_;
+  for (double s = trimEndSample(); s < path.range()-1e-6; s += resolution_)
+    samples_.push_back(path.transformAt(s));
+  samples_.push_back(path.endTransform());
 
-  auto iter1 = --iter;
-  auto iter2 = ++iter;
-  const double ratio = (iter2->first-s) / (iter2->first-iter1->first);
-  return interpolateTransform(iter1->second, iter2->second, ratio);
+  range_ = offset + path.range();
+  return;
 }
 
-//const std::vector<std::pair<DiscretePath::CarlaTransform, double>>
-//DiscretePath::samples() const {
-//  std::vector<std::pair<CarlaTransform, double>> samples;
-//  for (const auto& sample : samples_) samples.push_back(sample.second);
-//  return samples;
-//}
+void DiscretePath::append(const ContinuousPath& path) {
+  checkGap(path.startTransform());
+  appendSamples(path.startTransform(), path.endTransform(), path.nonHolonomicPath());
+  return;
+}
 
-void DiscretePath::append(const DiscretePath& path) {
+const double DiscretePath::trimEndSample() {
+  if (samples_.empty()) return 0.0;
+
+  const double last_grid = (samples_.size()-1) * resolution_;
+  if (range_ < last_grid-1e-6) {
+    samples_.pop_back();
+    return last_grid - range_;
+  }
+  return last_grid + resolution_ - range_;
+}
+
+void DiscretePath::appendSamples(
+    const std::pair<CarlaTransform, double>& start,
+    const std::pair<CarlaTransform, double>& end,
+    const NonHolonomicPath& path) {
+  CLP_PROFILE_SCOPE("DiscretePath::appendSamples");
+
+  // If the path is shorter than the distance to the next grid point,
+  // only the end of the path is sampled.
+  const double offset = range_;
+  const double range = path.sf;
+  const double s0 = std::min(trimEndSample(), range);
+
+  const std::vector<NonHolonomicPath::State> states =
+    path.sample(carlaTransformToPathState(start), s0, resolution_);
+
+  samples_.reserve(samples_.size() + states.size());
+  for (size_t i = 0; i < states.size(); ++i) {
+    // Generate a base transform by interpolating start and end.
+    const double s = i+1 == states.size() ? range : s0 + i*resolution_;
+    const std::pair<CarlaTransform, double> base_transform =
+      interpolateTransform(start, end, range > 0.0 ? 1.0-s/range : 0.0);
+    samples_.push_back(pathStateToCarlaTransform(states[i], base_transform.first));
+  }
+
+  if (samples_.empty()) {
+    throw std::runtime_error(
+        "DiscretePath::appendSamples(): empty discrete path.\n");
+  }
+
+  range_ = offset + range;
+  return;
+}
+
+void DiscretePath::checkGap(const std::pair<CarlaTransform, double>& start) const {
   // Check if the start of the input path matches the end of this path.
   // Only location is compared.
-  const double gap = (endTransform().first.location -
-                      path.startTransform().first.location).Length();
+  const double gap = (endTransform().first.location - start.first.location).Length();
 
   if (gap > resolution_) {
     throw std::runtime_error((boost::format(
-            "The gap [%1%] between paths is greater than %2%.\n")
+            "DiscretePath::append(): "
+            "the gap [%1%] between paths is greater than %2%.\n")
           % gap % resolution_).str());
   }
-
-  // Append the samples in the input path to this path.
-  // The first sample in the input path should be ignored.
-  const double offset = (--samples_.end())->first;
-  for (auto iter = ++(path.samples_.begin());
-       iter != path.samples_.end(); ++iter) {
-    samples_[iter->first+offset] = iter->second;
-  }
-
   return;
 }
 
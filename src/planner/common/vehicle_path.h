@@ -17,6 +17,7 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <boost/shared_ptr.hpp>
 #include <carla/geom/Transform.h>
 
 #include <planner/common/kn_path_gen.h>
@@ -40,6 +41,7 @@ public:
 protected:
 
   using CarlaTransform = carla::geom::Transform;
+  using CarlaLocation  = carla::geom::Location;
 
 protected:
 
@@ -107,6 +109,15 @@ protected:
 
   NonHolonomicPath path_;
 
+  /// Distance between the cached samples on the path.
+  double sample_resolution_ = 1.0;
+
+  /// Samples on the path at every \c sample_resolution_, in the right handed
+  /// coordinate system. The last sample is at the end of the path.
+  /// The table is built on the first query, and shared by the copies of this path.
+  /// It is only accessed with \c boost::atomic_load() and \c boost::atomic_store().
+  mutable boost::shared_ptr<const std::vector<NonHolonomicPath::State>> samples_ = nullptr;
+
 public:
 
   ContinuousPath(const std::pair<CarlaTransform, double>& start,
@@ -115,6 +126,24 @@ public:
 
   ContinuousPath(const DiscretePath& discrete_path);
 
+  /**
+   * \brief Create the path with already optimized polynomial coefficients.
+   *
+   * The coefficients of a Kelly-Nagy path are invariant to rigid transforms
+   * of the boundary states, so a path optimized for one pair of states can be
+   * reused for any other pair with the same relative pose. No optimization is
+   * performed by this constructor.
+   *
+   * \param[in] start The start transform and curvature.
+   * \param[in] end The end transform and curvature.
+   * \param[in] lane_change_type The lane change type of the path.
+   * \param[in] path The optimized path between the start and end.
+   */
+  ContinuousPath(const std::pair<CarlaTransform, double>& start,
+                 const std::pair<CarlaTransform, double>& end,
+                 const LaneChangeType& lane_change_type,
+                 const NonHolonomicPath& path);
+
   virtual ~ContinuousPath() {}
 
   virtual const std::pair<CarlaTransform, double>
@@ -125,15 +154,46 @@ public:
 
   virtual const double range() const override { return path_.sf; }
 
+  /// Get the underlying Kelly-Nagy path.
+  const NonHolonomicPath& nonHolonomicPath() const { return path_; }
+
+  /// Distance between the cached samples used by \c transformAt().
+  const double sampleResolution() const { return sample_resolution_; }
+
+  /// Set the distance between the cached samples, which drops the cache.
+  void setSampleResolution(const double resolution);
+
+  /**
+   * \brief Get the transform and curvature at s.
+   *
+   * The path is integrated from the closest cached sample before s, instead
+   * of from the start of the path. The samples are computed on the first call.
+   */
   virtual const std::pair<CarlaTransform, double>
     transformAt(const double s) const override;
 
   std::string string(const std::string& prefix="") const;
 
+protected:
+
+  /// Get the cached samples, which are computed if not available yet.
+  /// In case several threads get here at the same time, each of them
+  /// computes the same samples.
+  boost::shared_ptr<const std::vector<NonHolonomicPath::State>> cachedSamples() const;
+
 }; // End class ContinuousPath.
 
 /**
- * TODO: Complete the implementation for this class later.
+ * \brief DiscretePath stores the samples of a path with a fixed resolution.
+ *
+ * The samples are kept in one contiguous array. The i-th sample is at the
+ * distance i*resolution from the start of the path, except the last one,
+ * which is at the end of the path. The transform at any distance is therefore
+ * interpolated from the two samples around it, which are found in O(1), instead
+ * of integrating the path for every query as \c ContinuousPath does.
+ *
+ * Paths appended at the end are sampled on the same grid, so that the paths
+ * of a multi-stage trajectory are merged into one path.
  */
 class DiscretePath : public VehiclePath {
 
@@ -144,8 +204,11 @@ private:
 
 protected:
 
-  /// Stores the samples on path..
-  std::map<double, std::pair<CarlaTransform, double>> samples_;
+  /// Samples on the path, see the class description.
+  std::vector<std::pair<CarlaTransform, double>> samples_;
+
+  /// The range of the path, i.e. the distance of the last sample.
+  double range_ = 0.0;
 
   double resolution_ = 0.5;
 
@@ -161,34 +224,64 @@ public:
 
   virtual const std::pair<CarlaTransform, double>
     startTransform() const override {
-    return samples_.begin()->second;
+    return samples_.front();
   }
 
   virtual const std::pair<CarlaTransform, double>
     endTransform() const override {
-    return samples_.rbegin()->second;
+    return samples_.back();
   }
 
-  virtual const double range() const override {
-    return samples_.rbegin()->first;
-  }
+  virtual const double range() const override { return range_; }
+
+  /// Distance between the samples.
+  const double resolution() const { return resolution_; }
 
   virtual const std::pair<CarlaTransform, double>
     transformAt(const double s) const override;
 
-  //virtual const std::vector<std::pair<CarlaTransform, double>>
-  //  samples() const override;
-
+  /**
+   * \brief Project a location onto the path.
+   *
+   * This finds where a vehicle is on a path planned some time ago, e.g. by
+   * a planner running in the background.
+   *
+   * \param[in] location The query location.
+   * \param[out] distance The distance from the location to the path.
+   * \return The distance along the path of the projection.
+   */
+  const double project(const CarlaLocation& location, double& distance) const;
+
+  /// Append a path whose start matches the end of this path.
   virtual void append(const DiscretePath& path);
 
-  virtual void append(const ContinuousPath& path) {
-    DiscretePath discrete_path(path);
-    append(discrete_path);
-    return;
-  }
+  /// Append a path whose start matches the end of this path.
+  /// The path is sampled directly, without creating a \c DiscretePath for it.
+  virtual void append(const ContinuousPath& path);
 
   std::string string(const std::string& prefix="") const;
 
+protected:
+
+  /**
+   * \brief Prepare the samples to be extended beyond the current end.
+   *
+   * The last sample is removed if it is not on the grid, since it is
+   * replaced by the samples of the appended path.
+   *
+   * \return The distance of the next sample on the grid from the current end.
+   */
+  const double trimEndSample();
+
+  /// Sample the path between the start and end transforms,
+  /// which starts at the current end of this path.
+  void appendSamples(const std::pair<CarlaTransform, double>& start,
+                     const std::pair<CarlaTransform, double>& end,
+                     const NonHolonomicPath& path);
+
+  /// Check the start of the input path matches the end of this path.
+  void checkGap(const std::pair<CarlaTransform, double>& start) const;
+
 }; // End class DiscretePath.
 
 } // End namespace planner.
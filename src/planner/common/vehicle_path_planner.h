@@ -18,8 +18,15 @@
 #include <carla/client/Map.h>
 
 #include <planner/common/snapshot.h>
+#include <planner/common/lattice.h>
 #include <planner/common/fast_waypoint_map.h>
 #include <planner/common/vehicle_path.h>
+#include <planner/common/continuous_path_cache.h>
+#include <planner/common/planning_deadline.h>
+#include <planner/common/rollout_cache.h>
+#include <planner/common/graph_arena.h>
+#include <planner/common/cost_model.h>
+#include <planner/common/edge_screening.h>
 
 namespace planner {
 
@@ -38,7 +45,44 @@ protected:
   boost::shared_ptr<CarlaMap> map_ = nullptr;
 
   /// Fast waypoint map.
-  boost::shared_ptr<utils::FastWaypointMap> fast_map_ = nullptr;
+  boost::shared_ptr<const utils::FastWaypointMap> fast_map_ = nullptr;
+
+  /// Paths optimized in previous planning cycles.
+  boost::shared_ptr<ContinuousPathCache> path_cache_ =
+    boost::make_shared<ContinuousPathCache>();
+
+  /// Simulated graph edges kept across planning cycles.
+  /// Simulations are not reused if this is \c nullptr.
+  boost::shared_ptr<RolloutCache> rollout_cache_ = nullptr;
+
+  /// Costs of the simulations and the terminals.
+  /// The rollout cache should be cleared if this is changed between cycles,
+  /// since the cached stage costs are evaluated with the old costs.
+  boost::shared_ptr<const CostModel> cost_model_ = CostModel::defaultModel();
+
+  /// Time horizon (s) over which the agents interacting with the ego are kept
+  /// in the snapshots the simulations start with, see \c rolloutSnapshot().
+  /// The agents are not culled if this is not positive.
+  double relevance_horizon_ = 0.0;
+
+  /// Longitudinal resolution of the waypoint lattice of the planner.
+  /// The default is the uniform 1.0m resolution.
+  LatticeResolution lattice_resolution_ = LatticeResolution(1.0);
+
+  /// Arena of the graph objects created in the current planning cycle.
+  boost::shared_ptr<GraphArena> graph_arena_ = boost::make_shared<GraphArena>();
+
+  /// The deadline of the current planning cycle.
+  /// The graph construction should stop expanding once this is nearly expired.
+  PlanningDeadline deadline_;
+
+  /// Whether the graph construction in the last planning cycle is
+  /// stopped by the deadline before it is complete.
+  bool truncated_ = false;
+
+  /// Rejects the infeasible edges before their paths are optimized and
+  /// the traffic is simulated, and counts the rejected ones.
+  EdgeScreening edge_screening_;
 
 public:
 
@@ -48,7 +92,7 @@ public:
    * \param[in] fast_map The fast map used to retrieve waypoints based on locations.
    */
   VehiclePathPlanner(const boost::shared_ptr<CarlaMap>& map,
-                     const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+                     const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
     map_(map), fast_map_(fast_map) {}
 
   /// Class destructor.
@@ -65,9 +109,56 @@ public:
     fastWaypointMap() const { return fast_map_; }
 
   /// Get or set the fast waypoint map.
-  boost::shared_ptr<utils::FastWaypointMap>&
+  boost::shared_ptr<const utils::FastWaypointMap>&
     fastWaypointMap() { return fast_map_; }
 
+  /// Get the path cache.
+  const boost::shared_ptr<const ContinuousPathCache>
+    pathCache() const { return path_cache_; }
+
+  /// Get or set the path cache.
+  boost::shared_ptr<ContinuousPathCache>& pathCache() { return path_cache_; }
+
+  /// Get the rollout cache.
+  const boost::shared_ptr<const RolloutCache>
+    rolloutCache() const { return rollout_cache_; }
+
+  /// Get or set the rollout cache.
+  boost::shared_ptr<RolloutCache>& rolloutCache() { return rollout_cache_; }
+
+  /// Get the cost model.
+  const boost::shared_ptr<const CostModel> costModel() const { return cost_model_; }
+
+  /// Get or set the cost model.
+  boost::shared_ptr<const CostModel>& costModel() { return cost_model_; }
+
+  /// Get the time horizon (s) of culling the agents in the simulations.
+  const double relevanceHorizon() const { return relevance_horizon_; }
+
+  /// Get or set the time horizon (s) of culling the agents in the simulations.
+  /// The rollout cache should be cleared if this is changed between cycles.
+  double& relevanceHorizon() { return relevance_horizon_; }
+
+  /// Get the longitudinal resolution of the waypoint lattice.
+  const LatticeResolution& latticeResolution() const { return lattice_resolution_; }
+
+  /// Get or set the longitudinal resolution of the waypoint lattice,
+  /// which only takes effect when the waypoint lattice is created.
+  LatticeResolution& latticeResolution() { return lattice_resolution_; }
+
+  /// Get the arena of the graph objects created in the current planning cycle.
+  const boost::shared_ptr<const GraphArena>
+    graphArena() const { return graph_arena_; }
+
+  /// Whether the search of the last planning cycle is truncated by the deadline.
+  const bool truncated() const { return truncated_; }
+
+  /// Get the screening of the edges, with the counts of the last planning cycle.
+  const EdgeScreening& edgeScreening() const { return edge_screening_; }
+
+  /// Get or set the screening of the edges, e.g. to disable it.
+  EdgeScreening& edgeScreening() { return edge_screening_; }
+
   /**
    * \brief The main interface of the path planner.
    *
@@ -88,6 +179,140 @@ public:
     path = planPath(target, snapshot);
     return;
   }
-};
+
+  /**
+   * \brief The main interface of the path planner with a time budget.
+   *
+   * The graph construction stops expanding when the budget is nearly spent,
+   * and the best path among the terminals found so far is returned.
+   *
+   * \param[in] target The ID of the target vehicle.
+   * \param[in] snapshot Snapshot of the current traffic scenario.
+   * \param[in] time_budget The planning time budget (s), or infinity if not limited.
+   * \param[out] truncated Whether the search is truncated by the deadline.
+   * \return The planned path.
+   */
+  DiscretePath planPath(const size_t target,
+                        const Snapshot& snapshot,
+                        const double time_budget,
+                        bool& truncated) {
+    return planWithDeadline(time_budget, truncated,
+        [this, target, &snapshot]() { return planPath(target, snapshot); });
+  }
+
+protected:
+
+  /**
+   * \brief Simulate an edge of the graph, reusing the result of a previous
+   *        planning cycle if possible.
+   *
+   * \param[in] key The edge to be simulated.
+   * \param[in] snapshot The snapshot at the start of the edge.
+   * \param[in] simulate Runs the simulation if it cannot be reused.
+   * \return The snapshot at the end of the edge and the stage cost,
+   *         or \c boost::none if the simulation fails.
+   */
+  template<typename Simulate>
+  RolloutCache::Rollout simulateRollout(const RolloutCache::Key& key,
+                                        const Snapshot& snapshot,
+                                        const Simulate& simulate) const {
+    if (!rollout_cache_) return simulate();
+    return rollout_cache_->rollout(key, snapshot, simulate);
+  }
+
+  /**
+   * \brief Get the snapshot a simulation of a graph edge starts with.
+   *
+   * The agents which cannot interact with the ego within \c relevance_horizon_
+   * are removed from the returned copy, see \c Snapshot::cullAgents(). The
+   * input snapshot, e.g. the one of the root, still keeps all the agents.
+   */
+  const Snapshot rolloutSnapshot(const Snapshot& snapshot) const {
+    Snapshot rollout_snapshot(snapshot);
+    if (relevance_horizon_ > 0.0) rollout_snapshot.cullAgents(relevance_horizon_);
+    return rollout_snapshot;
+  }
+
+  /**
+   * \brief Get the snapshot at the end of a simulated graph edge, which
+   *        becomes the snapshot of the child vertex.
+   *
+   * The agents culled from the simulation by \c rolloutSnapshot() are added
+   * back, see \c Snapshot::restoreCulledAgents(), so that an agent culled on
+   * one edge can still interact with the ego further down the graph.
+   *
+   * \param[in] start The snapshot of the parent vertex, with all agents.
+   * \param[in] end The snapshot at the end of the simulation.
+   * \param[in] time The simulated time (s).
+   */
+  const Snapshot rolloutResult(const Snapshot& start,
+                               const Snapshot& end,
+                               const double time) const {
+    Snapshot result(end);
+    if (relevance_horizon_ > 0.0) result.restoreCulledAgents(start, time);
+    return result;
+  }
+
+  /**
+   * \brief Create a graph object, e.g. a vertex, in the arena of the current cycle.
+   *
+   * This can be called concurrently, as long as \c resetGraphArena() is not.
+   */
+  template<typename T, typename... Args>
+  boost::shared_ptr<T> makeGraphObject(Args&&... args) const {
+    return boost::allocate_shared<T>(
+        GraphAllocator<T>(graph_arena_), std::forward<Args>(args)...);
+  }
+
+  /**
+   * \brief Start a new arena for the graph objects of a new planning cycle.
+   *
+   * The arena of the last cycle is released together with the last of its
+   * objects, which happens once the old graph is pruned.
+   */
+  void resetGraphArena() {
+    graph_arena_ = boost::make_shared<GraphArena>();
+    return;
+  }
+
+  /**
+   * \brief Check whether a lane changing edge should be rejected before its
+   *        path is optimized, see \c EdgeScreening::laneChangeGapClear().
+   *
+   * The rejected edges are counted. This can be called concurrently.
+   *
+   * \return True if the edge is rejected.
+   */
+  const bool screenOutLaneChange(
+      const Snapshot& snapshot, const VehiclePath::LaneChangeType lane_change_type) const {
+    if (!edge_screening_.enabled()) return false;
+    if (EdgeScreening::laneChangeGapClear(snapshot, lane_change_type)) return false;
+    edge_screening_.addScreenedEdge();
+    return true;
+  }
+
+  /// Start a new planning cycle of the rollout cache, if there is one.
+  void nextRolloutCycle() {
+    if (rollout_cache_) rollout_cache_->nextCycle();
+    return;
+  }
+
+  /// Run the planning function \c plan with \c deadline_ set by the given budget.
+  template<typename Plan>
+  auto planWithDeadline(const double time_budget, bool& truncated, const Plan& plan)
+    -> decltype(plan()) {
+    deadline_ = PlanningDeadline(time_budget);
+    try {
+      auto result = plan();
+      deadline_ = PlanningDeadline();
+      truncated = truncated_;
+      return result;
+    } catch (...) {
+      deadline_ = PlanningDeadline();
+      throw;
+    }
+  }
+
+}; // End class VehiclePathPlanner.
 
 } // End namespace planner.
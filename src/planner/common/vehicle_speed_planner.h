@@ -62,7 +62,7 @@ public:
    */
   virtual const double planSpeed(const size_t target, const Snapshot& snapshot) {
     // Get the target vehicle.
-    const Vehicle target_vehicle = snapshot.vehicle(target);
+    const ConstVehicleView target_vehicle = snapshot.vehicle(target);
 
     // Get the lead vehicle of the target.
     boost::optional<std::pair<size_t, double>> lead =
@@ -0,0 +1,369 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <string>
+#include <tuple>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include <carla/geom/Transform.h>
+
+#include <planner/common/vehicle.h>
+#include <planner/common/memory_usage.h>
+
+namespace planner {
+
+/**
+ * \brief BasicVehicleView refers to the states of a vehicle stored elsewhere,
+ *        e.g. in a \c Vehicle object or a slot of a \c VehicleTable.
+ *
+ * The view provides the same accessors as \c Vehicle, so that the code
+ * reading or writing the vehicle states does not have to care about where
+ * the states are stored. A view is only valid as long as the storage it
+ * refers to is not modified structurally, i.e. vehicles are not added or
+ * removed from the table.
+ *
+ * \tparam T Either \c double for a mutable view, or \c const \c double
+ *           for a read-only view.
+ */
+template<typename T>
+class BasicVehicleView {
+
+protected:
+
+  using CarlaBoundingBox = carla::geom::BoundingBox;
+  using CarlaTransform   = carla::geom::Transform;
+
+  template<typename U>
+  using Ref = typename std::conditional<std::is_const<T>::value, const U, U>::type;
+
+protected:
+
+  const size_t* id_;
+  Ref<CarlaBoundingBox>* bounding_box_;
+  Ref<CarlaTransform>* transform_;
+  T* speed_;
+  T* policy_speed_;
+  T* acceleration_;
+  T* curvature_;
+
+public:
+
+  BasicVehicleView(const size_t* id,
+                   Ref<CarlaBoundingBox>* bounding_box,
+                   Ref<CarlaTransform>* transform,
+                   T* speed,
+                   T* policy_speed,
+                   T* acceleration,
+                   T* curvature) :
+    id_          (id),
+    bounding_box_(bounding_box),
+    transform_   (transform),
+    speed_       (speed),
+    policy_speed_(policy_speed),
+    acceleration_(acceleration),
+    curvature_   (curvature) {}
+
+  /// A mutable view can be used wherever a read-only view is expected.
+  template<typename U, typename = typename std::enable_if<
+    std::is_const<T>::value && std::is_same<const U, T>::value>::type>
+  BasicVehicleView(const BasicVehicleView<U>& other) :
+    BasicVehicleView(&other.id(), &other.boundingBox(), &other.transform(),
+                     &other.speed(), &other.policySpeed(),
+                     &other.acceleration(), &other.curvature()) {}
+
+  /// The ID of the vehicle is used to index the table, and cannot be changed.
+  const size_t& id() const { return *id_; }
+
+  Ref<CarlaBoundingBox>& boundingBox() const { return *bounding_box_; }
+
+  Ref<CarlaTransform>& transform() const { return *transform_; }
+
+  T& speed() const { return *speed_; }
+
+  T& policySpeed() const { return *policy_speed_; }
+
+  T& acceleration() const { return *acceleration_; }
+
+  T& curvature() const { return *curvature_; }
+
+  /// Copy the states into a standalone \c Vehicle object.
+  operator Vehicle() const {
+    return Vehicle(*id_, *bounding_box_, *transform_,
+        *speed_, *policy_speed_, *acceleration_, *curvature_);
+  }
+
+  /**
+   * \brief Get the vehicle ID, transform, and bounding box as a tuple.
+   */
+  std::tuple<size_t, CarlaTransform, CarlaBoundingBox> tuple() const {
+    return std::make_tuple(*id_, *transform_, *bounding_box_);
+  }
+
+  /**
+   * \brief Get a string containing the information of this vehicle.
+   */
+  std::string string(const std::string& prefix = "") const {
+    return static_cast<Vehicle>(*this).string(prefix);
+  }
+
+}; // End class BasicVehicleView.
+
+using VehicleView = BasicVehicleView<double>;
+using ConstVehicleView = BasicVehicleView<const double>;
+
+/// Create a view of a \c Vehicle object.
+inline VehicleView vehicleView(Vehicle& vehicle) {
+  return VehicleView(&vehicle.id(), &vehicle.boundingBox(), &vehicle.transform(),
+      &vehicle.speed(), &vehicle.policySpeed(),
+      &vehicle.acceleration(), &vehicle.curvature());
+}
+
+/// Create a read-only view of a \c Vehicle object.
+inline ConstVehicleView vehicleView(const Vehicle& vehicle) {
+  // The non-const accessors of \c Vehicle are only used to get the addresses.
+  return vehicleView(const_cast<Vehicle&>(vehicle));
+}
+
+/**
+ * \brief VehicleTable stores the states of a group of vehicles as
+ *        structure of arrays.
+ *
+ * Each type of state, e.g. speed or transform, is kept in a dense array,
+ * where the vehicles are identified by their slots. An additional table
+ * maps the vehicle IDs to the slots. Code that goes over all vehicles,
+ * such as the traffic simulation and the cost computation, can therefore
+ * stream through contiguous memory instead of hashing the ID of every
+ * vehicle. Removing a vehicle moves the last vehicle into its slot, so
+ * the slots are not stable over removals.
+ */
+class VehicleTable {
+
+protected:
+
+  using CarlaBoundingBox = carla::geom::BoundingBox;
+  using CarlaTransform   = carla::geom::Transform;
+
+protected:
+
+  std::vector<size_t> ids_;
+  std::vector<CarlaBoundingBox> bounding_boxes_;
+  std::vector<CarlaTransform> transforms_;
+  std::vector<double> speeds_;
+  std::vector<double> policy_speeds_;
+  std::vector<double> accelerations_;
+  std::vector<double> curvatures_;
+
+  /// Map from vehicle ID to its slot in the arrays.
+  std::unordered_map<size_t, size_t> slots_;
+
+public:
+
+  /**
+   * \brief Iterator going through the vehicles in the order of slots.
+   */
+  template<typename Table, typename View>
+  class Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = View;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = void;
+    using reference         = View;
+
+    Iterator(Table* table, const size_t slot) : table_(table), slot_(slot) {}
+
+    View operator*() const { return table_->vehicle(slot_); }
+    Iterator& operator++() { ++slot_; return *this; }
+    Iterator operator++(int) { Iterator iter(*this); ++slot_; return iter; }
+    bool operator==(const Iterator& other) const { return slot_ == other.slot_; }
+    bool operator!=(const Iterator& other) const { return slot_ != other.slot_; }
+
+  private:
+    Table* table_;
+    size_t slot_;
+  }; // End class Iterator.
+
+  using iterator       = Iterator<VehicleTable, VehicleView>;
+  using const_iterator = Iterator<const VehicleTable, ConstVehicleView>;
+
+public:
+
+  VehicleTable() = default;
+
+  VehicleTable(const std::unordered_map<size_t, Vehicle>& vehicles) {
+    reserve(vehicles.size());
+    for (const auto& vehicle : vehicles) insert(vehicle.second);
+  }
+
+  /// Number of vehicles in the table.
+  size_t size() const { return ids_.size(); }
+
+  bool empty() const { return ids_.empty(); }
+
+  void reserve(const size_t size) {
+    ids_.reserve(size);
+    bounding_boxes_.reserve(size);
+    transforms_.reserve(size);
+    speeds_.reserve(size);
+    policy_speeds_.reserve(size);
+    accelerations_.reserve(size);
+    curvatures_.reserve(size);
+    slots_.reserve(size);
+  }
+
+  /// Approximate number of bytes used by the table.
+  size_t memoryUsage() const {
+    return sizeof(*this) +
+           utils::memoryUsage(ids_) +
+           utils::memoryUsage(bounding_boxes_) +
+           utils::memoryUsage(transforms_) +
+           utils::memoryUsage(speeds_) +
+           utils::memoryUsage(policy_speeds_) +
+           utils::memoryUsage(accelerations_) +
+           utils::memoryUsage(curvatures_) +
+           utils::memoryUsage(slots_);
+  }
+
+  /// Number of vehicles with the given ID in the table, i.e. 0 or 1.
+  size_t count(const size_t id) const { return slots_.count(id); }
+
+  /**
+   * \brief Get the slot of a vehicle.
+   * \param[in] id The ID of the vehicle.
+   * \return The slot of the vehicle, or \c size() if the vehicle is not in the table.
+   */
+  size_t slot(const size_t id) const {
+    std::unordered_map<size_t, size_t>::const_iterator iter = slots_.find(id);
+    return iter == slots_.end() ? size() : iter->second;
+  }
+
+  /// Get the view of the vehicle at the given slot.
+  VehicleView vehicle(const size_t slot) {
+    return VehicleView(&ids_[slot], &bounding_boxes_[slot], &transforms_[slot],
+        &speeds_[slot], &policy_speeds_[slot], &accelerations_[slot], &curvatures_[slot]);
+  }
+
+  /// Get the read-only view of the vehicle at the given slot.
+  ConstVehicleView vehicle(const size_t slot) const {
+    return ConstVehicleView(&ids_[slot], &bounding_boxes_[slot], &transforms_[slot],
+        &speeds_[slot], &policy_speeds_[slot], &accelerations_[slot], &curvatures_[slot]);
+  }
+
+  /**
+   * \brief Add a vehicle to the end of the table.
+   *
+   * The function throws runtime error if the vehicle is already in the table.
+   */
+  void insert(const Vehicle& vehicle) {
+    if (!slots_.emplace(vehicle.id(), size()).second) {
+      std::string error_msg = (boost::format(
+            "VehicleTable::insert(): "
+            "vehicle %1% is already in the table.\n") % vehicle.id()).str();
+      throw std::runtime_error(error_msg);
+    }
+
+    ids_.push_back(vehicle.id());
+    bounding_boxes_.push_back(vehicle.boundingBox());
+    transforms_.push_back(vehicle.transform());
+    speeds_.push_back(vehicle.speed());
+    policy_speeds_.push_back(vehicle.policySpeed());
+    accelerations_.push_back(vehicle.acceleration());
+    curvatures_.push_back(vehicle.curvature());
+    return;
+  }
+
+  /**
+   * \brief Remove a vehicle from the table.
+   *
+   * The last vehicle in the table is moved into the slot of the removed one.
+   *
+   * \return The number of removed vehicles, i.e. 0 or 1.
+   */
+  size_t erase(const size_t id) {
+    std::unordered_map<size_t, size_t>::iterator iter = slots_.find(id);
+    if (iter == slots_.end()) return 0;
+
+    const size_t slot = iter->second;
+    const size_t last = size() - 1;
+    slots_.erase(iter);
+
+    if (slot != last) {
+      ids_[slot]            = ids_[last];
+      bounding_boxes_[slot] = bounding_boxes_[last];
+      transforms_[slot]     = transforms_[last];
+      speeds_[slot]         = speeds_[last];
+      policy_speeds_[slot]  = policy_speeds_[last];
+      accelerations_[slot]  = accelerations_[last];
+      curvatures_[slot]     = curvatures_[last];
+      slots_[ids_[slot]]    = slot;
+    }
+
+    ids_.pop_back();
+    bounding_boxes_.pop_back();
+    transforms_.pop_back();
+    speeds_.pop_back();
+    policy_speeds_.pop_back();
+    accelerations_.pop_back();
+    curvatures_.pop_back();
+    return 1;
+  }
+
+  void clear() {
+    ids_.clear();
+    bounding_boxes_.clear();
+    transforms_.clear();
+    speeds_.clear();
+    policy_speeds_.clear();
+    accelerations_.clear();
+    curvatures_.clear();
+    slots_.clear();
+  }
+
+  /// @name Dense arrays of the vehicle states, indexed by the slots.
+  /// @{
+  const std::vector<size_t>& ids() const { return ids_; }
+
+  const std::vector<CarlaBoundingBox>& boundingBoxes() const { return bounding_boxes_; }
+
+  const std::vector<CarlaTransform>& transforms() const { return transforms_; }
+  std::vector<CarlaTransform>& transforms() { return transforms_; }
+
+  const std::vector<double>& speeds() const { return speeds_; }
+  std::vector<double>& speeds() { return speeds_; }
+
+  const std::vector<double>& policySpeeds() const { return policy_speeds_; }
+  std::vector<double>& policySpeeds() { return policy_speeds_; }
+
+  const std::vector<double>& accelerations() const { return accelerations_; }
+  std::vector<double>& accelerations() { return accelerations_; }
+
+  const std::vector<double>& curvatures() const { return curvatures_; }
+  std::vector<double>& curvatures() { return curvatures_; }
+  /// @}
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, size()); }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size()); }
+
+}; // End class VehicleTable.
+
+} // End namespace planner.
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <utility>
+#include <boost/smart_ptr.hpp>
+
+#include <planner/common/thread_pool.h>
+#include <planner/common/planning_deadline.h>
+
+namespace planner {
+
+/**
+ * \brief Expand a graph layer by layer starting from the given queue.
+ *
+ * All nodes in the queue form the current layer. Each node in the layer can
+ * be expanded with \c num_options options, e.g. connecting to the front, left
+ * front, and right front nodes. The expansions of all nodes and options
+ * within the layer are independent, and are run in parallel if a thread
+ * pool is available. Afterwards, the results are merged into the graph
+ * serially, in the order of the nodes and then the options. The merge step
+ * pushes the nodes of the next layer into the queue.
+ *
+ * Since the merge order does not depend on the threads, the constructed
+ * graph is the same regardless of the number of threads.
+ *
+ * A layer is only started if it is expected to finish before the deadline.
+ * Otherwise, the expansion stops, and the nodes of the layer are left in the
+ * queue unexpanded.
+ *
+ * \param[in,out] queue The nodes to be expanded. The queue is empty when
+ *                      the function returns, unless stopped by the deadline.
+ * \param[in] num_options The number of expansion options per node.
+ * \param[in] thread_pool The thread pool to run the expansions. The
+ *                        expansions are run serially if \c nullptr.
+ * \param[in] expand Called as \c expand(node, option), which returns the
+ *                   result of expanding the node with the option. This may
+ *                   be called concurrently, so it must not modify the graph.
+ * \param[in] merge Called as \c merge(node, option, result, queue), which
+ *                  merges the result into the graph, and may push new nodes
+ *                  into the queue.
+ * \param[in,out] deadline The deadline of the expansion.
+ * \return \c false if the expansion is stopped by the deadline.
+ */
+template<typename Node, typename Expand, typename Merge>
+const bool expandWavefront(std::deque<boost::shared_ptr<Node>>& queue,
+                           const size_t num_options,
+                           const boost::shared_ptr<utils::ThreadPool>& thread_pool,
+                           const Expand& expand,
+                           const Merge& merge,
+                           PlanningDeadline& deadline) {
+
+  using Result = decltype(expand(std::declval<const boost::shared_ptr<Node>&>(), size_t(0)));
+
+  while (!queue.empty()) {
+    if (!deadline.allowsNextStep(queue.size())) return false;
+    deadline.startStep();
+
+    // Take all nodes in the queue as the current layer.
+    const std::vector<boost::shared_ptr<Node>> layer(queue.begin(), queue.end());
+    queue.clear();
+
+    // Expand all nodes in the layer with all options.
+    std::vector<Result> results(layer.size()*num_options);
+    auto expandTask = [&layer, &results, &expand, num_options](const size_t i) {
+      results[i] = expand(layer[i/num_options], i%num_options);
+    };
+
+    if (thread_pool) {
+      thread_pool->parallelFor(results.size(), expandTask);
+    } else {
+      for (size_t i = 0; i < results.size(); ++i) expandTask(i);
+    }
+
+    // Merge the results in order.
+    for (size_t i = 0; i < results.size(); ++i)
+      merge(layer[i/num_options], i%num_options, results[i], queue);
+
+    deadline.finishStep(layer.size());
+  }
+
+  return true;
+}
+
+} // End namespace planner.
@@ -0,0 +1,551 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <carla/client/Waypoint.h>
+#include <carla/road/element/LaneMarking.h>
+
+#include <planner/common/utils.h>
+#include <planner/common/memory_usage.h>
+#include <planner/common/fast_waypoint_map.h>
+
+namespace utils {
+
+/**
+ * \brief WaypointGraph connects the waypoints of a \c FastWaypointMap
+ *        into the lanes of the whole map.
+ *
+ * The waypoints of each lane (road, section, and lane IDs) are stored
+ * contiguously in the driving direction, so that moving along a lane is
+ * an offset in a flat array. At the end of a lane, the graph continues
+ * into the successor lanes found with the topology of the map. The left
+ * and right neighbors, and whether a lane change is permitted, are kept
+ * for every waypoint as well.
+ *
+ * Compared to \c carla::client::Waypoint::GetNext(), \c GetLeft(), and
+ * \c GetRight(), which create new waypoint objects and walk the map every
+ * time, the queries on the graph are index jumps without any allocation.
+ * The waypoints are returned as handles of the \c FastWaypointMap, and all
+ * users share the same waypoint objects retrieved from there.
+ *
+ * The graph is immutable once built, so it can be shared by threads.
+ */
+class WaypointGraph : private boost::noncopyable {
+
+protected:
+
+  using CarlaMap       = carla::client::Map;
+  using CarlaWaypoint  = carla::client::Waypoint;
+  using CarlaLaneChange = carla::road::element::LaneMarking::LaneChange;
+
+public:
+
+  using WaypointHandle = FastWaypointMap::WaypointHandle;
+
+  /// Handle indicating there is no such waypoint.
+  static constexpr WaypointHandle kNullHandle = std::numeric_limits<WaypointHandle>::max();
+
+protected:
+
+  /// The waypoints of a lane, and the lanes connected to it.
+  struct Lane {
+    uint32_t road_id;
+    uint32_t section_id;
+    int32_t lane_id;
+    /// The waypoints of the lane are \c [begin, end) in \c lane_waypoints_.
+    uint32_t begin;
+    uint32_t end;
+    /// The successor lanes are \c [successors_begin, successors_end)
+    /// in \c lane_successors_, and the same for the predecessor lanes.
+    uint32_t successors_begin;
+    uint32_t successors_end;
+    uint32_t predecessors_begin;
+    uint32_t predecessors_end;
+    /// Yaw (degree) at the first and last waypoints of the lane.
+    float begin_yaw;
+    float end_yaw;
+  };
+
+protected:
+
+  /// The map whose waypoints are connected.
+  boost::shared_ptr<const FastWaypointMap> fast_map_;
+
+  /// The lanes of the map.
+  std::vector<Lane> lanes_;
+
+  /// A mapping from the hash of road, section, and lane IDs to the lanes.
+  std::unordered_map<size_t, uint32_t> lane_table_;
+
+  /// Waypoint handles of all lanes, in the driving direction within each lane.
+  std::vector<WaypointHandle> lane_waypoints_;
+
+  /// Distance of each entry of \c lane_waypoints_ from the first waypoint of its lane.
+  std::vector<float> lane_distances_;
+
+  /// Lane of each entry of \c lane_waypoints_.
+  std::vector<uint32_t> position_lanes_;
+
+  /// Position of each waypoint in \c lane_waypoints_, indexed by the waypoint handles.
+  std::vector<uint32_t> positions_;
+
+  /// Left and right neighbors of each waypoint, indexed by the waypoint handles.
+  std::vector<WaypointHandle> lefts_;
+  std::vector<WaypointHandle> rights_;
+
+  /// Permitted lane change at each waypoint, indexed by the waypoint handles.
+  std::vector<uint8_t> lane_changes_;
+
+  /// Successor and predecessor lanes of all lanes, see \c Lane.
+  std::vector<uint32_t> lane_successors_;
+  std::vector<uint32_t> lane_predecessors_;
+
+public:
+
+  /**
+   * \brief Build the graph.
+   * \param[in] fast_map The map whose waypoints are to be connected.
+   */
+  WaypointGraph(const boost::shared_ptr<const FastWaypointMap>& fast_map) :
+    fast_map_(fast_map) {
+    buildLanes();
+    buildNeighbors();
+    buildTopology();
+    return;
+  }
+
+  /**
+   * \brief Get the graph of a map shared by all users within the process,
+   *        the same as \c FastWaypointMap::shared().
+   * \param[in] fast_map The map whose waypoints are to be connected.
+   */
+  static boost::shared_ptr<const WaypointGraph> shared(
+      const boost::shared_ptr<const FastWaypointMap>& fast_map) {
+
+    static std::mutex instances_mutex;
+    static std::unordered_map<const FastWaypointMap*, boost::weak_ptr<const WaypointGraph>> instances;
+
+    std::lock_guard<std::mutex> lock(instances_mutex);
+    boost::shared_ptr<const WaypointGraph> instance = instances[fast_map.get()].lock();
+    if (!instance) {
+      instance = boost::make_shared<const WaypointGraph>(fast_map);
+      instances[fast_map.get()] = instance;
+    }
+    return instance;
+  }
+
+  /// Get the map whose waypoints are connected.
+  const boost::shared_ptr<const FastWaypointMap>& fastMap() const { return fast_map_; }
+
+  /// Number of lanes in the graph.
+  const size_t lanes() const { return lanes_.size(); }
+
+  /// Approximate number of bytes used by the graph.
+  const size_t memoryUsage() const {
+    return sizeof(*this) +
+           utils::memoryUsage(lanes_) +
+           utils::memoryUsage(lane_table_) +
+           utils::memoryUsage(lane_waypoints_) +
+           utils::memoryUsage(lane_distances_) +
+           utils::memoryUsage(position_lanes_) +
+           utils::memoryUsage(positions_) +
+           utils::memoryUsage(lefts_) +
+           utils::memoryUsage(rights_) +
+           utils::memoryUsage(lane_changes_) +
+           utils::memoryUsage(lane_successors_) +
+           utils::memoryUsage(lane_predecessors_);
+  }
+
+  /**
+   * \brief Find the handle of a carla waypoint in the graph.
+   *
+   * The waypoint is located on its lane with a binary search, so that
+   * waypoints not created by the map, e.g. \c GetNext() of another waypoint,
+   * can be queried as well.
+   *
+   * \param[in] waypoint The query waypoint.
+   * \return The handle of the closest waypoint on the same lane, or
+   *         \c kNullHandle if the lane is not in the graph.
+   */
+  WaypointHandle handle(const CarlaWaypoint& waypoint) const {
+    const auto lane_iter = lane_table_.find(laneKey(
+          waypoint.GetRoadId(), waypoint.GetSectionId(), waypoint.GetLaneId()));
+    if (lane_iter == lane_table_.end()) return kNullHandle;
+
+    const Lane& lane = lanes_[lane_iter->second];
+    const double distance = std::fabs(
+        waypoint.GetDistance() - fast_map_->waypointInfo(lane_waypoints_[lane.begin]).s);
+    return lane_waypoints_[closestPosition(lane, distance)];
+  }
+
+  /// Get the carla waypoint of a handle, \c nullptr if the handle is \c kNullHandle.
+  boost::shared_ptr<CarlaWaypoint> waypoint(const WaypointHandle handle) const {
+    if (handle == kNullHandle) return nullptr;
+    return fast_map_->waypoint(handle);
+  }
+
+  /**
+   * @name Neighbor Query
+   *
+   * The successors (predecessors) of a waypoint are the next (previous)
+   * waypoint on its lane, or the first (last) waypoints of the successor
+   * (predecessor) lanes if the waypoint is at the end (start) of its lane.
+   *
+   * The left and right waypoints are on the adjacent lanes at the same
+   * distance of the road, regardless of the lane change permitted, which
+   * can be checked with \c leftChangePermitted() and \c rightChangePermitted().
+   * \c kNullHandle is returned if there is no such waypoint.
+   */
+  /// @{
+  const size_t successors(const WaypointHandle handle) const {
+    const uint32_t position = positions_[handle];
+    const Lane& lane = lanes_[position_lanes_[position]];
+    if (position+1 < lane.end) return 1;
+    return lane.successors_end - lane.successors_begin;
+  }
+
+  WaypointHandle successor(const WaypointHandle handle, const size_t i = 0) const {
+    const uint32_t position = positions_[handle];
+    const Lane& lane = lanes_[position_lanes_[position]];
+    if (position+1 < lane.end) return i == 0 ? lane_waypoints_[position+1] : static_cast<WaypointHandle>(kNullHandle);
+    if (lane.successors_begin+i >= lane.successors_end) return kNullHandle;
+    return lane_waypoints_[lanes_[lane_successors_[lane.successors_begin+i]].begin];
+  }
+
+  const size_t predecessors(const WaypointHandle handle) const {
+    const uint32_t position = positions_[handle];
+    const Lane& lane = lanes_[position_lanes_[position]];
+    if (position > lane.begin) return 1;
+    return lane.predecessors_end - lane.predecessors_begin;
+  }
+
+  WaypointHandle predecessor(const WaypointHandle handle, const size_t i = 0) const {
+    const uint32_t position = positions_[handle];
+    const Lane& lane = lanes_[position_lanes_[position]];
+    if (position > lane.begin) return i == 0 ? lane_waypoints_[position-1] : static_cast<WaypointHandle>(kNullHandle);
+    if (lane.predecessors_begin+i >= lane.predecessors_end) return kNullHandle;
+    return lane_waypoints_[lanes_[lane_predecessors_[lane.predecessors_begin+i]].end-1];
+  }
+
+  WaypointHandle left(const WaypointHandle handle) const { return lefts_[handle]; }
+
+  WaypointHandle right(const WaypointHandle handle) const { return rights_[handle]; }
+
+  const bool leftChangePermitted(const WaypointHandle handle) const {
+    const CarlaLaneChange lane_change = static_cast<CarlaLaneChange>(lane_changes_[handle]);
+    return lane_change == CarlaLaneChange::Left || lane_change == CarlaLaneChange::Both;
+  }
+
+  const bool rightChangePermitted(const WaypointHandle handle) const {
+    const CarlaLaneChange lane_change = static_cast<CarlaLaneChange>(lane_changes_[handle]);
+    return lane_change == CarlaLaneChange::Right || lane_change == CarlaLaneChange::Both;
+  }
+  /// @}
+
+  /**
+   * \brief Find the waypoint some distance ahead of the query one along the lanes.
+   *
+   * Where a lane splits, the successor lane on the same road is preferred,
+   * then the one whose road is preferred by \c prefer_road, e.g. the roads
+   * on a route, and then the one with the least change of the heading.
+   *
+   * \param[in] handle The query waypoint.
+   * \param[in] distance The distance to look for the front waypoint.
+   * \param[in] prefer_road A function returning whether a road ID is preferred.
+   * \return The waypoint closest to the front waypoint, or \c kNullHandle
+   *         if the lanes end before the given distance.
+   */
+  template<typename PreferRoad>
+  WaypointHandle front(const WaypointHandle handle,
+                       const double distance,
+                       const PreferRoad& prefer_road) const {
+    if (handle == kNullHandle || distance < 0.0) return kNullHandle;
+
+    const uint32_t position = positions_[handle];
+    uint32_t lane = position_lanes_[position];
+    double target = lane_distances_[position] + distance;
+
+    // Every lane is visited at most once, which guards against loops.
+    for (size_t i = 0; i <= lanes_.size(); ++i) {
+      const double length = laneLength(lanes_[lane]);
+      if (target < length) return lane_waypoints_[closestPosition(lanes_[lane], target)];
+
+      target -= length;
+      lane = successorLane(lane, prefer_road);
+      if (lane == kNullLane_) break;
+    }
+
+    return kNullHandle;
+  }
+
+  /// Same as above, without preferring any road.
+  WaypointHandle front(const WaypointHandle handle, const double distance) const {
+    return front(handle, distance, [](const size_t) { return false; });
+  }
+
+  /// The absolute difference (degree) between two yaws (degree), within [0, 180].
+  static double yawDifference(const double yaw1, const double yaw2) {
+    const double difference = std::fmod(std::fabs(yaw1-yaw2), 360.0);
+    return difference > 180.0 ? 360.0-difference : difference;
+  }
+
+protected:
+
+  /// Index indicating there is no such lane.
+  static constexpr uint32_t kNullLane_ = std::numeric_limits<uint32_t>::max();
+
+  /// Hash of road, section, and lane IDs.
+  static size_t laneKey(const uint32_t road_id, const uint32_t section_id, const int32_t lane_id) {
+    size_t key = 0;
+    hashCombine(key, road_id, section_id, lane_id);
+    return key;
+  }
+
+  /**
+   * \brief Length of a lane, i.e. the distance from its first waypoint
+   *        to the first waypoints of its successor lanes.
+   *
+   * The waypoints of a lane are at most one resolution of the map apart from
+   * its end, which is the start of the successor lanes.
+   */
+  const double laneLength(const Lane& lane) const {
+    return lane_distances_[lane.end-1] + fast_map_->resolution();
+  }
+
+  /// The position on a lane closest to the given distance from the first waypoint.
+  const uint32_t closestPosition(const Lane& lane, const double distance) const {
+    const std::vector<float>::const_iterator first = lane_distances_.begin() + lane.begin;
+    const std::vector<float>::const_iterator last  = lane_distances_.begin() + lane.end;
+    const std::vector<float>::const_iterator after = std::upper_bound(first, last, distance);
+
+    if (after == first) return lane.begin;
+    if (after == last) return lane.end-1;
+    const uint32_t position = static_cast<uint32_t>(after-lane_distances_.begin());
+    return *after-distance < distance-*(after-1) ? position : position-1;
+  }
+
+  /// Select the lane to continue into at the end of a lane, see \c front().
+  template<typename PreferRoad>
+  uint32_t successorLane(const uint32_t lane, const PreferRoad& prefer_road) const {
+    const Lane& current = lanes_[lane];
+    uint32_t best_lane = kNullLane_;
+    int best_rank = 0;
+    double best_yaw = 0.0;
+
+    for (uint32_t i = current.successors_begin; i < current.successors_end; ++i) {
+      const Lane& successor = lanes_[lane_successors_[i]];
+      const int rank = successor.road_id == current.road_id ? 0 :
+                       prefer_road(static_cast<size_t>(successor.road_id)) ? 1 : 2;
+      const double yaw = yawDifference(current.end_yaw, successor.begin_yaw);
+
+      if (best_lane == kNullLane_ || rank < best_rank ||
+          (rank == best_rank && yaw < best_yaw)) {
+        best_lane = lane_successors_[i];
+        best_rank = rank;
+        best_yaw = yaw;
+      }
+    }
+
+    return best_lane;
+  }
+
+  /// Group the waypoints of the map into lanes.
+  void buildLanes() {
+
+    const size_t num_waypoints = fast_map_->size();
+    if (num_waypoints >= kNullHandle) {
+      throw std::runtime_error((boost::format(
+              "WaypointGraph::buildLanes(): "
+              "too many waypoints %1% in the map.\n") % num_waypoints).str());
+    }
+
+    // Find the lane of every waypoint, and count the waypoints of each lane.
+    std::vector<FastWaypointMap::WaypointInfo> infos;
+    infos.reserve(num_waypoints);
+    std::vector<uint32_t> waypoint_lanes(num_waypoints);
+    std::vector<uint32_t> lane_sizes;
+
+    for (WaypointHandle handle = 0; handle < num_waypoints; ++handle) {
+      infos.push_back(fast_map_->waypointInfo(handle));
+      const FastWaypointMap::WaypointInfo& info = infos.back();
+
+      const size_t key = laneKey(info.road_id, info.section_id, info.lane_id);
+      auto lane_iter = lane_table_.find(key);
+      if (lane_iter == lane_table_.end()) {
+        lane_iter = lane_table_.emplace(key, lanes_.size()).first;
+        lanes_.push_back(Lane{info.road_id, info.section_id, info.lane_id,
+                              0, 0, 0, 0, 0, 0, 0.0f, 0.0f});
+        lane_sizes.push_back(0);
+      }
+      waypoint_lanes[handle] = lane_iter->second;
+      ++lane_sizes[lane_iter->second];
+    }
+
+    // Assign the ranges of the lanes in the flat arrays.
+    uint32_t offset = 0;
+    for (size_t i = 0; i < lanes_.size(); ++i) {
+      lanes_[i].begin = offset;
+      lanes_[i].end = offset;
+      offset += lane_sizes[i];
+    }
+
+    lane_waypoints_.resize(num_waypoints);
+    for (WaypointHandle handle = 0; handle < num_waypoints; ++handle)
+      lane_waypoints_[lanes_[waypoint_lanes[handle]].end++] = handle;
+
+    // Sort the waypoints of each lane in the driving direction, which is
+    // along the road for lanes with negative IDs, the same as carla.
+    lane_distances_.resize(num_waypoints);
+    position_lanes_.resize(num_waypoints);
+    positions_.resize(num_waypoints);
+
+    for (uint32_t i = 0; i < lanes_.size(); ++i) {
+      Lane& lane = lanes_[i];
+      const bool forward = lane.lane_id <= 0;
+      std::sort(lane_waypoints_.begin()+lane.begin, lane_waypoints_.begin()+lane.end,
+          [&infos, forward](const WaypointHandle a, const WaypointHandle b) {
+            return forward ? infos[a].s < infos[b].s : infos[a].s > infos[b].s;
+          });
+
+      const double start = infos[lane_waypoints_[lane.begin]].s;
+      for (uint32_t position = lane.begin; position < lane.end; ++position) {
+        const WaypointHandle handle = lane_waypoints_[position];
+        lane_distances_[position] = std::fabs(infos[handle].s - start);
+        position_lanes_[position] = i;
+        positions_[handle] = position;
+      }
+
+      lane.begin_yaw = infos[lane_waypoints_[lane.begin]].yaw;
+      lane.end_yaw = infos[lane_waypoints_[lane.end-1]].yaw;
+    }
+
+    lane_changes_.resize(num_waypoints);
+    for (WaypointHandle handle = 0; handle < num_waypoints; ++handle)
+      lane_changes_[handle] = infos[handle].lane_change;
+
+    return;
+  }
+
+  /**
+   * \brief Find the left and right neighbors of all waypoints.
+   *
+   * The neighbor lanes follow \c carla::road::Map::GetLeft() and \c GetRight(),
+   * i.e. the left lane of lane 1 or -1 is across the center of the road.
+   * Only the driving lanes are in the map, so neighbors on the other types
+   * of lanes are not found.
+   */
+  void buildNeighbors() {
+
+    lefts_.assign(lane_waypoints_.size(), static_cast<WaypointHandle>(kNullHandle));
+    rights_.assign(lane_waypoints_.size(), static_cast<WaypointHandle>(kNullHandle));
+
+    auto neighborLane = [this](const Lane& lane, const int32_t lane_id)->uint32_t{
+      const auto lane_iter = lane_table_.find(
+          laneKey(lane.road_id, lane.section_id, lane_id));
+      if (lane_iter == lane_table_.end()) return kNullLane_;
+      return lane_iter->second;
+    };
+
+    // Find the waypoint on the neighbor lane at the same distance of the road.
+    // The waypoints of the lanes in a section are sampled from the start of
+    // the section, so they are abreast within the resolution of the map.
+    auto connect = [this](const Lane& lane, const uint32_t neighbor_lane,
+                          std::vector<WaypointHandle>& neighbors)->void{
+      if (neighbor_lane == kNullLane_) return;
+      const Lane& neighbor = lanes_[neighbor_lane];
+      const double neighbor_start = fast_map_->waypointInfo(lane_waypoints_[neighbor.begin]).s;
+
+      for (uint32_t position = lane.begin; position < lane.end; ++position) {
+        const WaypointHandle handle = lane_waypoints_[position];
+        const double s = fast_map_->waypointInfo(handle).s;
+        const uint32_t neighbor_position =
+          closestPosition(neighbor, std::fabs(s-neighbor_start));
+        const WaypointHandle neighbor_handle = lane_waypoints_[neighbor_position];
+        if (std::fabs(fast_map_->waypointInfo(neighbor_handle).s - s) > fast_map_->resolution())
+          continue;
+        neighbors[handle] = neighbor_handle;
+      }
+    };
+
+    for (const Lane& lane : lanes_) {
+      const int32_t id = lane.lane_id;
+      const int32_t left_id = std::abs(id) == 1 ? -id : (id > 0 ? id-1 : id+1);
+      const int32_t right_id = id > 0 ? id+1 : id-1;
+      connect(lane, neighborLane(lane, left_id), lefts_);
+      connect(lane, neighborLane(lane, right_id), rights_);
+    }
+
+    return;
+  }
+
+  /// Connect the lanes with the topology of the map.
+  void buildTopology() {
+
+    // Each element of the topology connects the start of a lane
+    // to the start of one of its successor lanes.
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    for (const auto& segment : fast_map_->map()->GetTopology()) {
+      const auto from = lane_table_.find(laneKey(
+            segment.first->GetRoadId(), segment.first->GetSectionId(), segment.first->GetLaneId()));
+      const auto to = lane_table_.find(laneKey(
+            segment.second->GetRoadId(), segment.second->GetSectionId(), segment.second->GetLaneId()));
+      if (from == lane_table_.end() || to == lane_table_.end()) continue;
+      edges.emplace_back(from->second, to->second);
+    }
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    lane_successors_.clear();
+    for (const auto& edge : edges) lane_successors_.push_back(edge.second);
+    for (Lane& lane : lanes_) lane.successors_begin = lane.successors_end = 0;
+    for (size_t i = 0; i < edges.size(); ++i) {
+      Lane& lane = lanes_[edges[i].first];
+      if (lane.successors_begin == lane.successors_end) lane.successors_begin = i;
+      lane.successors_end = i+1;
+    }
+
+    // The predecessors are the same edges sorted by the destination.
+    for (auto& edge : edges) std::swap(edge.first, edge.second);
+    std::sort(edges.begin(), edges.end());
+
+    lane_predecessors_.clear();
+    for (const auto& edge : edges) lane_predecessors_.push_back(edge.second);
+    for (Lane& lane : lanes_) lane.predecessors_begin = lane.predecessors_end = 0;
+    for (size_t i = 0; i < edges.size(); ++i) {
+      Lane& lane = lanes_[edges[i].first];
+      if (lane.predecessors_begin == lane.predecessors_end) lane.predecessors_begin = i;
+      lane.predecessors_end = i+1;
+    }
+
+    return;
+  }
+
+}; // End class WaypointGraph.
+
+} // End namespace utils.
@@ -13,6 +13,7 @@
 */
 
 #include <list>
+#include <planner/common/profiler.h>
 #include <planner/idm_lattice_planner/idm_lattice_planner.h>
 
 namespace planner {
@@ -57,18 +58,37 @@ const double IDMTrafficSimulator::agentAcceleration(const size_t agent) const {
   if (lead) {
     const double lead_speed = snapshot_.vehicle(lead->first).speed();
     const double following_distance = lead->second;
-    accel = idm_->idm(snapshot_.vehicle(agent).speed(),
-                      snapshot_.vehicle(agent).policySpeed(),
-                      lead_speed,
-                      following_distance);
+    accel = agentModel().idm(snapshot_.vehicle(agent).speed(),
+                             snapshot_.vehicle(agent).policySpeed(),
+                             lead_speed,
+                             following_distance);
   } else {
-    accel = idm_->idm(snapshot_.vehicle(agent).speed(),
-                      snapshot_.vehicle(agent).policySpeed());
+    accel = agentModel().idm(snapshot_.vehicle(agent).speed(),
+                             snapshot_.vehicle(agent).policySpeed());
   }
 
   return accel;
 }
 
+void IDMTrafficSimulator::agentAccelerations(std::vector<double>& accels) const {
+
+  // We assume all agent vehicles are lane followers for now.
+  std::vector<double> lead_speeds;
+  std::vector<double> distances;
+  agentLeads(lead_speeds, distances);
+
+  const VehicleTable& agents = snapshot_.agents();
+  accels.resize(agents.size());
+  agentModel().idm(agents.speeds().data(),
+                   agents.policySpeeds().data(),
+                   lead_speeds.data(),
+                   distances.data(),
+                   agents.size(),
+                   accels.data());
+
+  return;
+}
+
 void Station::updateOptimalParent() {
 
   // Set the \c optimal_parent_ to an existing parent. It does not
@@ -238,6 +258,7 @@ std::vector<ContinuousPath> IDMLatticePlanner::edges() const {
 
 DiscretePath IDMLatticePlanner::planPath(
     const size_t ego, const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("IDMLatticePlanner::planPath");
 
   if (ego != snapshot.ego().id()) {
     std::string error_msg(
@@ -250,6 +271,13 @@ DiscretePath IDMLatticePlanner::planPath(
     throw std::runtime_error(error_msg + id_msg);
   }
 
+  // Forget the simulations which are not reused in the last cycle.
+  nextRolloutCycle();
+
+  // The graph objects of this cycle are created in a new arena.
+  resetGraphArena();
+  edge_screening_.reset();
+
   // Update the waypoint lattice.
   updateWaypointLattice(snapshot);
 
@@ -314,18 +342,19 @@ bool IDMLatticePlanner::immediateNextStationReached(
 }
 
 void IDMLatticePlanner::updateWaypointLattice(const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("IDMLatticePlanner::updateWaypointLattice");
 
   //std::printf("updateWaypointLattice(): \n");
 
   // If the waypoint lattice has not been initialized, a new one is created with
   // the start waypoint as where the ego currently is. Meanwhile, the range of
-  // the lattice is set to the spatial horizon. The resolution is hardcoded as 1.0m.
+  // the lattice is set to the spatial horizon. The resolution is \c lattice_resolution_.
   if (!waypoint_lattice_) {
     //std::printf("Create new waypoint lattice.\n");
     boost::shared_ptr<CarlaWaypoint> ego_waypoint =
       fast_map_->waypoint(snapshot.ego().transform().location);
     waypoint_lattice_ = boost::make_shared<WaypointLattice>(
-        ego_waypoint, spatial_horizon_+30.0, 1.0, router_);
+        ego_waypoint, spatial_horizon_+30.0, lattice_resolution_, router_);
     return;
   }
 
@@ -349,6 +378,7 @@ void IDMLatticePlanner::updateWaypointLattice(const Snapshot& snapshot) {
 
 std::deque<boost::shared_ptr<Station>>
   IDMLatticePlanner::pruneStationGraph(const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("IDMLatticePlanner::pruneStationGraph");
 
   //std::printf("pruneStationGraph(): \n");
 
@@ -363,7 +393,7 @@ std::deque<boost::shared_ptr<Station>>
 
     // Initialize the new root station.
     boost::shared_ptr<Station> root =
-      boost::make_shared<Station>(snapshot, waypoint_lattice_, fast_map_);
+      makeGraphObject<Station>(snapshot, waypoint_lattice_, fast_map_);
     node_to_station_table_[root->id()] = root;
     root_ = root;
 
@@ -377,7 +407,7 @@ std::deque<boost::shared_ptr<Station>>
 
   // Create the new root station.
   boost::shared_ptr<Station> new_root =
-    boost::make_shared<Station>(snapshot, waypoint_lattice_, fast_map_);
+    makeGraphObject<Station>(snapshot, waypoint_lattice_, fast_map_);
 
   // Read the immedinate next waypoint node to be reached.
   boost::shared_ptr<const WaypointNode> next_node =
@@ -434,6 +464,7 @@ std::deque<boost::shared_ptr<Station>>
 
 void IDMLatticePlanner::constructStationGraph(
     std::deque<boost::shared_ptr<Station>>& station_queue) {
+  CLP_PROFILE_SCOPE("IDMLatticePlanner::constructStationGraph");
 
   //std::printf("constructStationGraph(): \n");
 
@@ -448,34 +479,35 @@ void IDMLatticePlanner::constructStationGraph(
     }
   };
 
-  while (!station_queue.empty()) {
-    boost::shared_ptr<Station> station = station_queue.front();
-    station_queue.pop_front();
-
-    // Try to connect to the front node.
-    boost::shared_ptr<const WaypointNode> front_node =
-      waypoint_lattice_->front(station->node().lock()->waypoint(), 50.0);
-    boost::shared_ptr<Station> front_station =
-      connectStationToFrontNode(station, front_node);
-
-    addStationToTableAndQueue(front_station, front_node);
-
-    // Try to connect to the left front node.
-    boost::shared_ptr<const WaypointNode> left_front_node =
-      waypoint_lattice_->frontLeft(station->node().lock()->waypoint(), 50.0);
-    boost::shared_ptr<Station> left_front_station =
-      connectStationToLeftFrontNode(station, left_front_node);
-
-    addStationToTableAndQueue(left_front_station, left_front_node);
+  // Expand the stations layer by layer. Each station is connected to its
+  // front (option 0), left front (option 1), and right front (option 2) nodes.
+  auto expand = [this](const boost::shared_ptr<Station>& station,
+                       const size_t option)->StationRollout{
+    const boost::shared_ptr<const CarlaWaypoint> waypoint =
+      station->node().lock()->waypoint();
+    if (option == 0) {
+      return simulateStationToFrontNode(
+          station, waypoint_lattice_->front(waypoint, 50.0));
+    } else if (option == 1) {
+      return simulateStationToLeftFrontNode(
+          station, waypoint_lattice_->frontLeft(waypoint, 50.0));
+    } else {
+      return simulateStationToRightFrontNode(
+          station, waypoint_lattice_->frontRight(waypoint, 50.0));
+    }
+  };
 
-    // Try to connect to the right front node.
-    boost::shared_ptr<const WaypointNode> right_front_node =
-      waypoint_lattice_->frontRight(station->node().lock()->waypoint(), 50.0);
-    boost::shared_ptr<Station> right_front_station =
-      connectStationToRightFrontNode(station, right_front_node);
+  auto merge = [this, &addStationToTableAndQueue](
+      const boost::shared_ptr<Station>& station,
+      const size_t option,
+      const StationRollout& rollout,
+      std::deque<boost::shared_ptr<Station>>&)->void{
+    addStationToTableAndQueue(
+        mergeStationRollout(station, rollout, option), rollout.target_node);
+  };
 
-    addStationToTableAndQueue(right_front_station, right_front_node);
-  }
+  truncated_ = !expandWavefront(
+      station_queue, 3, thread_pool_, expand, merge, deadline_);
 
   //std::printf("station #: %lu\n", node_to_station_table_.size());
 
@@ -490,88 +522,77 @@ void IDMLatticePlanner::constructStationGraph(
 boost::shared_ptr<Station> IDMLatticePlanner::connectStationToFrontNode(
     const boost::shared_ptr<Station>& station,
     const boost::shared_ptr<const WaypointNode>& target_node) {
+  return mergeStationRollout(station, simulateStationToFrontNode(station, target_node), 0);
+}
+
+IDMLatticePlanner::StationRollout IDMLatticePlanner::simulateStationToFrontNode(
+    const boost::shared_ptr<Station>& station,
+    const boost::shared_ptr<const WaypointNode>& target_node) const {
 
-  //std::printf("connectStationToFrontNode(): \n");
+  //std::printf("simulateStationToFrontNode(): \n");
 
   // Return directly if the target node does not exist.
-  if (!target_node) return nullptr;
+  if (!target_node) return StationRollout();
 
   // Plan a path between the node at the current station to the target node.
   //std::printf("Compute Kelly-Nagy path.\n");
   boost::shared_ptr<ContinuousPath> path = nullptr;
   try {
-    path = boost::make_shared<ContinuousPath>(
+    path = path_cache_->path(
         std::make_pair(station->snapshot().ego().transform(),
                        station->snapshot().ego().curvature()),
         std::make_pair(target_node->waypoint()->GetTransform(),
-                       target_node->curvature(map_)),
+                       fast_map_->curvature(target_node->waypoint())),
         ContinuousPath::LaneChangeType::KeepLane);
   } catch (std::exception& e) {
     // If for whatever reason, the path cannot be created, the station
     // cannot be created either.
     std::printf("%s", e.what());
-    return nullptr;
-  }
-
-  // Now, simulate the traffic forward with ego following the created path.
-  //std::printf("Simulate the traffic.\n");
-  IDMTrafficSimulator simulator(station->snapshot(), map_, fast_map_);
-  double simulation_time = 0.0; double stage_cost = 0.0;
-  try {
-    const bool no_collision = simulator.simulate(
-        *path, sim_time_step_, 5.0, simulation_time, stage_cost);
-    // There a collision is detected in the simulation, this option is ignored.
-    if (!no_collision) return nullptr;
-  } catch(std::exception& e) {
-    std::printf("IDMLatticePlanner::connectStationToFrontNode(): WARNING\n"
-                "%s", e.what());
-    return nullptr;
+    return StationRollout();
   }
 
-  // Either create a new station or used the one has been already created.
-  //std::printf("Create child station.\n");
-  boost::shared_ptr<Station> next_station = boost::make_shared<Station>(
-      simulator.snapshot(), waypoint_lattice_, fast_map_);
-  if (node_to_station_table_.count(next_station->id()) != 0)
-    next_station = node_to_station_table_[next_station->id()];
-
-  // Set the child station of the parent station.
-  //std::printf("Update the child station of the input station.\n");
-  station->updateFrontChild(*path, stage_cost, next_station);
-
-  // Set the parent station of the child station.
-  //std::printf("Update the parent station of the new station.\n");
-  if (station->hasParent()) {
-    next_station->updateBackParent(
-        simulator.snapshot(), station->costToCome()+stage_cost, station);
-  } else {
-    next_station->updateBackParent(
-        simulator.snapshot(), stage_cost, station);
-  }
-
-  return next_station;
+  // Now, simulate the traffic forward with the ego following the created path.
+  const RolloutCache::Rollout result =
+    simulateStationAlongPath(station, target_node, *path, 0);
+  if (!result) return StationRollout();
+
+  // Create the station at the end of the simulation.
+  StationRollout rollout;
+  rollout.target_node = target_node;
+  rollout.path = path;
+  rollout.stage_cost = result->second;
+  rollout.station = makeGraphObject<Station>(
+      result->first, waypoint_lattice_, fast_map_);
+
+  return rollout;
 }
 
 boost::shared_ptr<Station> IDMLatticePlanner::connectStationToLeftFrontNode(
     const boost::shared_ptr<Station>& station,
     const boost::shared_ptr<const WaypointNode>& target_node) {
+  return mergeStationRollout(station, simulateStationToLeftFrontNode(station, target_node), 1);
+}
+
+IDMLatticePlanner::StationRollout IDMLatticePlanner::simulateStationToLeftFrontNode(
+    const boost::shared_ptr<Station>& station,
+    const boost::shared_ptr<const WaypointNode>& target_node) const {
 
-  //std::printf("connectStationToLeftFrontNode(): \n");
+  //std::printf("simulateStationToLeftFrontNode(): \n");
 
   // Return directly if the target node does not exisit.
-  if (!target_node) return nullptr;
+  if (!target_node) return StationRollout();
 
   // Return directly if the target node is already very close to the station.
   // It is not reasonable to change lane with this short distance.
   if (target_node->distance()-station->node().lock()->distance() < 20.0)
-    return nullptr;
+    return StationRollout();
 
   // If the ego is on the right of the lane center, connecting to the
   // left lane is forbidden.
   if (utils::distanceToLaneCenter(
         station->snapshot().ego().transform().location,
         station->node().lock()->waypoint()) > 0.5)
-    return nullptr;
+    return StationRollout();
 
   // Check the left front and left back vehicles.
   //
@@ -585,85 +606,73 @@ boost::shared_ptr<Station> IDMLatticePlanner::connectStationToLeftFrontNode(
   boost::optional<std::pair<size_t, double>> left_back =
     station->snapshot().trafficLattice()->leftBack(station->snapshot().ego().id());
 
-  if (left_front && left_front->second <= 0.0) return nullptr;
-  if (left_back  && left_back->second  <= 0.0) return nullptr;
+  if (left_front && left_front->second <= 0.0) return StationRollout();
+  if (left_back  && left_back->second  <= 0.0) return StationRollout();
+
+  // The edge is rejected before the path is optimized if the ego does not
+  // fit into the gap on the left lane.
+  if (screenOutLaneChange(station->snapshot(), ContinuousPath::LaneChangeType::LeftLaneChange))
+    return StationRollout();
 
   // Plan a path between the node at the current station to the target node.
   //std::printf("Compute Kelly-Nagy path.\n");
   boost::shared_ptr<ContinuousPath> path = nullptr;
   try {
-    path = boost::make_shared<ContinuousPath>(
+    path = path_cache_->path(
         std::make_pair(station->snapshot().ego().transform(),
                        station->snapshot().ego().curvature()),
         std::make_pair(target_node->waypoint()->GetTransform(),
-                       target_node->curvature(map_)),
+                       fast_map_->curvature(target_node->waypoint())),
         ContinuousPath::LaneChangeType::LeftLaneChange);
   } catch (const std::exception& e) {
     // If for whatever reason, the path cannot be created,
     // just ignore this option.
     std::printf("%s", e.what());
-    return nullptr;
-  }
-
-  // Now, simulate the traffic forward with ego following the created path.
-  //std::printf("Simulate the traffic.\n");
-  IDMTrafficSimulator simulator(station->snapshot(), map_, fast_map_);
-  double simulation_time = 0.0; double stage_cost = 0.0;
-  try {
-    const bool no_collision = simulator.simulate(
-        *path, sim_time_step_, 5.0, simulation_time, stage_cost);
-    // There a collision is detected in the simulation, this option is ignored.
-    if (!no_collision) return nullptr;
-  } catch (std::exception& e) {
-    std::printf("IDMLatticePlanner::connectStationToLeftFrontNode(): WARNING\n"
-                "%s", e.what());
-    return nullptr;
+    return StationRollout();
   }
 
-  // Either create a new station or used the one has been already created.
-  //std::printf("Create child station.\n");
-  boost::shared_ptr<Station> next_station = boost::make_shared<Station>(
-      simulator.snapshot(), waypoint_lattice_, fast_map_);
-  if (node_to_station_table_.count(next_station->id()) != 0)
-    next_station = node_to_station_table_[next_station->id()];
-
-  // Set the child station of the parent station.
-  //std::printf("Update the child station of the input station.\n");
-  station->updateLeftChild(*path, stage_cost, next_station);
-
-  // Set the parent station of the child station.
-  //std::printf("Update the parent station of the new station.\n");
-  if (station->hasParent()) {
-    next_station->updateRightParent(
-        simulator.snapshot(), station->costToCome()+stage_cost, station);
-  } else {
-    next_station->updateRightParent(
-        simulator.snapshot(), stage_cost, station);
-  }
-
-  return next_station;
+  // Now, simulate the traffic forward with the ego following the created path.
+  const RolloutCache::Rollout result =
+    simulateStationAlongPath(station, target_node, *path, 1);
+  if (!result) return StationRollout();
+
+  // Create the station at the end of the simulation.
+  StationRollout rollout;
+  rollout.target_node = target_node;
+  rollout.path = path;
+  rollout.stage_cost = result->second;
+  rollout.station = makeGraphObject<Station>(
+      result->first, waypoint_lattice_, fast_map_);
+
+  return rollout;
 }
 
 boost::shared_ptr<Station> IDMLatticePlanner::connectStationToRightFrontNode(
     const boost::shared_ptr<Station>& station,
     const boost::shared_ptr<const WaypointNode>& target_node) {
+  return mergeStationRollout(station, simulateStationToRightFrontNode(station, target_node), 2);
+}
+
+IDMLatticePlanner::StationRollout IDMLatticePlanner::simulateStationToRightFrontNode(
+    const boost::shared_ptr<Station>& station,
+    const boost::shared_ptr<const WaypointNode>& target_node) const {
 
-  //std::printf("connectStationToRightFrontNode(): \n");
+  //std::printf("simulateStationToRightFrontNode(): \n");
 
   // Return directly if the target node does not exisit.
-  if (!target_node) return nullptr;
+  if (!target_node) return StationRollout();
 
   // Return directly if the target node is already very close to the station.
   // It is not reasonable to change lane with this short distance.
   if (target_node->distance()-station->node().lock()->distance() < 20.0)
-    return nullptr;
+    return StationRollout();
 
   // If the ego is on the left of the lane center, connecting to the
   // right lane is forbidden.
   if (utils::distanceToLaneCenter(
         station->snapshot().ego().transform().location,
         station->node().lock()->waypoint()) < -0.5)
-    return nullptr;
+    return StationRollout();
 
   // Check the right front and right back vehicles.
   //
@@ -677,60 +686,104 @@ boost::shared_ptr<Station> IDMLatticePlanner::connectStationToRightFrontNode(
   boost::optional<std::pair<size_t, double>> right_back =
     station->snapshot().trafficLattice()->rightBack(station->snapshot().ego().id());
 
-  if (right_front && right_front->second <= 0.0) return nullptr;
-  if (right_back  && right_back->second  <= 0.0) return nullptr;
+  if (right_front && right_front->second <= 0.0) return StationRollout();
+  if (right_back  && right_back->second  <= 0.0) return StationRollout();
+
+  // The edge is rejected before the path is optimized if the ego does not
+  // fit into the gap on the right lane.
+  if (screenOutLaneChange(station->snapshot(), ContinuousPath::LaneChangeType::RightLaneChange))
+    return StationRollout();
 
   // Plan a path between the node at the current station to the target node.
   //std::printf("Compute Kelly-Nagy path.\n");
   boost::shared_ptr<ContinuousPath> path = nullptr;
   try {
-    path = boost::make_shared<ContinuousPath>(
+    path = path_cache_->path(
         std::make_pair(station->snapshot().ego().transform(),
                        station->snapshot().ego().curvature()),
         std::make_pair(target_node->waypoint()->GetTransform(),
-                       target_node->curvature(map_)),
+                       fast_map_->curvature(target_node->waypoint())),
         ContinuousPath::LaneChangeType::RightLaneChange);
   } catch (std::exception& e) {
     // If for whatever reason, the path cannot be created,
     // just ignore this option.
     std::printf("%s", e.what());
-    return nullptr;
+    return StationRollout();
   }
 
   // Now, simulate the traffic forward with the ego following the created path.
-  //std::printf("Simulate the traffic.\n");
-  IDMTrafficSimulator simulator(station->snapshot(), map_, fast_map_);
-  double simulation_time = 0.0; double stage_cost = 0.0;
-  try {
-    const bool no_collision = simulator.simulate(
-        *path, sim_time_step_, 5.0, simulation_time, stage_cost);
-    // There a collision is detected in the simulation, this option is ignored.
-    if (!no_collision) return nullptr;
-  } catch (std::exception& e) {
-    std::printf("IDMLatticePlanner::connectStationToRightFrontNode(): WARNING\n"
-                "%s", e.what());
-    return nullptr;
-  }
+  const RolloutCache::Rollout result =
+    simulateStationAlongPath(station, target_node, *path, 2);
+  if (!result) return StationRollout();
+
+  // Create the station at the end of the simulation.
+  StationRollout rollout;
+  rollout.target_node = target_node;
+  rollout.path = path;
+  rollout.stage_cost = result->second;
+  rollout.station = makeGraphObject<Station>(
+      result->first, waypoint_lattice_, fast_map_);
+
+  return rollout;
+}
+
+RolloutCache::Rollout IDMLatticePlanner::simulateStationAlongPath(
+    const boost::shared_ptr<Station>& station,
+    const boost::shared_ptr<const WaypointNode>& target_node,
+    const ContinuousPath& path,
+    const size_t option) const {
+
+  auto simulate = [this, &station, &path]()->RolloutCache::Rollout{
+    IDMTrafficSimulator simulator(rolloutSnapshot(station->snapshot()), map_, fast_map_);
+    simulator.costModel() = cost_model_;
+    double simulation_time = 0.0; double stage_cost = 0.0;
+    try {
+      const bool no_collision = simulator.simulate(
+          path, sim_time_step_, 5.0, simulation_time, stage_cost);
+      // There a collision is detected in the simulation, this option is ignored.
+      if (!no_collision) return boost::none;
+    } catch (std::exception& e) {
+      std::printf("IDMLatticePlanner::simulateStationAlongPath(): WARNING\n"
+                  "%s", e.what());
+      return boost::none;
+    }
+    return std::make_pair(
+        rolloutResult(station->snapshot(), simulator.snapshot(), simulation_time), stage_cost);
+  };
+
+  return simulateRollout(
+      RolloutCache::Key{station->id(), target_node->id(), option},
+      station->snapshot(), simulate);
+}
+
+boost::shared_ptr<Station> IDMLatticePlanner::mergeStationRollout(
+    const boost::shared_ptr<Station>& station,
+    const StationRollout& rollout,
+    const size_t option) {
+
+  if (!rollout.station) return nullptr;
 
   // Either create a new station or used the one has been already created.
-  //std::printf("Create child station.\n");
-  boost::shared_ptr<Station> next_station = boost::make_shared<Station>(
-      simulator.snapshot(), waypoint_lattice_, fast_map_);
+  boost::shared_ptr<Station> next_station = rollout.station;
   if (node_to_station_table_.count(next_station->id()) != 0)
     next_station = node_to_station_table_[next_station->id()];
 
-  // Set the child station of the parent station.
-  //std::printf("Update the child station of the input station.\n");
-  station->updateRightChild(*path, stage_cost, next_station);
-
-  // Set the parent station of the child station.
-  //std::printf("Update the parent station of the new station.\n");
-  if (station->hasParent()) {
-    next_station->updateLeftParent(
-        simulator.snapshot(), station->costToCome()+stage_cost, station);
+  // The snapshot at the end of the simulation.
+  const Snapshot snapshot = rollout.station->snapshot();
+  const double cost_to_come = station->hasParent() ?
+    station->costToCome()+rollout.stage_cost : rollout.stage_cost;
+
+  // Set the child station of the parent station,
+  // and the parent station of the child station.
+  if (option == 0) {
+    station->updateFrontChild(*(rollout.path), rollout.stage_cost, next_station);
+    next_station->updateBackParent(snapshot, cost_to_come, station);
+  } else if (option == 1) {
+    station->updateLeftChild(*(rollout.path), rollout.stage_cost, next_station);
+    next_station->updateRightParent(snapshot, cost_to_come, station);
   } else {
-    next_station->updateLeftParent(
-        simulator.snapshot(), stage_cost, station);
+    station->updateRightChild(*(rollout.path), rollout.stage_cost, next_station);
+    next_station->updateLeftParent(snapshot, cost_to_come, station);
   }
 
   return next_station;
@@ -746,11 +799,6 @@ const double IDMLatticePlanner::terminalSpeedCost(
     throw std::runtime_error(error_msg + station->string());
   }
 
-  static std::unordered_map<int, double> cost_map {
-    {0, 4.0}, {1, 4.0}, {2, 4.0}, {3, 3.0}, {4, 3.0},
-    {5, 2.0}, {6, 2.0}, {7, 1.0}, {8, 1.0}, {9, 0.0},
-  };
-
   const double ego_speed = station->snapshot().ego().speed();
   const double ego_policy_speed = station->snapshot().ego().policySpeed();
   if (ego_speed < 0.0 || ego_policy_speed < 0.0) {
@@ -773,7 +821,7 @@ const double IDMLatticePlanner::terminalSpeedCost(
 
   // There is no cost if the speed of the ego matches or exceeds the policy speed.
   if (speed_ratio >= 1.0) return 0.0;
-  else return cost_map[static_cast<int>(speed_ratio*10.0)];
+  else return cost_model_->terminalSpeedCost(speed_ratio);
 }
 
 const double IDMLatticePlanner::terminalDistanceCost(
@@ -786,15 +834,6 @@ const double IDMLatticePlanner::terminalDistanceCost(
     throw std::runtime_error(error_msg + station->string());
   }
 
-  static std::unordered_map<int, double> cost_map {
-    {0, 20.0}, {1, 20.0}, {2, 20.0}, {3, 20.0}, {4, 20.0},
-    {5, 20.0}, {6, 20.0}, {7, 20.0}, {8, 10.0},  {9, 5.0},
-  };
-  //static std::unordered_map<int, double> cost_map {
-  //  {0, 8.0}, {1, 7.0}, {2, 6.0}, {3, 5.0}, {4, 5.0},
-  //  {5, 3.0}, {6, 2.0}, {7, 2.0}, {8, 1.0}, {9, 1.0},
-  //};
-
   // Find the current spatial planning horizon.
   boost::shared_ptr<const Station> root_child;
   if (root_.lock()->hasFrontChild())
@@ -817,7 +856,7 @@ const double IDMLatticePlanner::terminalDistanceCost(
   //    distance, spatial_horizon, distance_ratio);
 
   if (distance_ratio >= 1.0) return 0.0;
-  else return cost_map[static_cast<int>(distance_ratio*10.0)];
+  else return cost_model_->terminalDistanceCost(distance_ratio);
 }
 
 const double IDMLatticePlanner::costFromRootToTerminal(
@@ -843,6 +882,7 @@ const double IDMLatticePlanner::costFromRootToTerminal(
 void IDMLatticePlanner::selectOptimalPath(
     std::list<ContinuousPath>& path_sequence,
     std::list<boost::weak_ptr<Station>>& station_sequence) const {
+  CLP_PROFILE_SCOPE("IDMLatticePlanner::selectOptimalPath");
 
   //std::printf("selectOptimalPath():\n");
 
@@ -950,6 +990,7 @@ void IDMLatticePlanner::selectOptimalPath(
 
 DiscretePath IDMLatticePlanner::mergePaths(
     const std::list<ContinuousPath>& paths) const {
+  CLP_PROFILE_SCOPE("IDMLatticePlanner::mergePaths");
 
   //std::printf("mergePaths(): \n");
   //std::printf("path #: %lu\n", paths.size());
@@ -30,6 +30,8 @@
 #include <planner/common/vehicle_path_planner.h>
 #include <planner/common/traffic_simulator.h>
 #include <planner/common/intelligent_driver_model.h>
+#include <planner/common/thread_pool.h>
+#include <planner/common/wavefront_expansion.h>
 
 namespace planner {
 namespace idm_lattice_planner {
@@ -42,36 +44,57 @@ namespace idm_lattice_planner {
  * (including the ego) follows the intelligent driver model, which adjust
  * acceleration adaptively based on the current traffic scenario.
  */
-class IDMTrafficSimulator : public TrafficSimulator {
+class IDMTrafficSimulator final : public TrafficSimulatorCore<IDMTrafficSimulator> {
 
 private:
 
-  using Base = TrafficSimulator;
+  using Base = TrafficSimulatorCore<IDMTrafficSimulator>;
   using This = IDMTrafficSimulator;
 
+  friend class TrafficSimulatorCore<IDMTrafficSimulator>;
+
 protected:
 
   /// Intelligent driver model.
   boost::shared_ptr<IntelligentDriverModel> idm_ = nullptr;
 
+  /// Intelligent driver model of the agents if they are simulated with
+  /// a different hypothesis, otherwise \c nullptr and \c idm_ is used.
+  boost::shared_ptr<IntelligentDriverModel> agent_idm_ = nullptr;
+
 public:
 
   IDMTrafficSimulator(
       const Snapshot& snapshot,
       const boost::shared_ptr<CarlaMap>& map,
-      const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
     Base(snapshot, map, fast_map),
     idm_(boost::make_shared<IntelligentDriverModel>()) {}
 
   const boost::shared_ptr<const IntelligentDriverModel> idm() const { return idm_; }
   boost::shared_ptr<IntelligentDriverModel>& idm() { return idm_; }
 
+  /// The model of the agents, which follows \c idm() unless set separately.
+  const boost::shared_ptr<const IntelligentDriverModel> agentIdm() const {
+    if (agent_idm_) return agent_idm_;
+    else return idm_;
+  }
+  /// Set to \c nullptr to simulate the agents with \c idm() again.
+  boost::shared_ptr<IntelligentDriverModel>& agentIdm() { return agent_idm_; }
+
 protected:
 
+  const IntelligentDriverModel& agentModel() const {
+    return agent_idm_ ? *agent_idm_ : *idm_;
+  }
+
   virtual const double egoAcceleration() const override;
 
   virtual const double agentAcceleration(const size_t agent) const override;
 
+  /// All agents are evaluated with one batched call of the IDM.
+  virtual void agentAccelerations(std::vector<double>& accels) const override;
+
 }; // End class IDMTrafficSimulator.
 
 /**
@@ -151,7 +174,7 @@ public:
 
   Station(const Snapshot& snapshot,
           const boost::shared_ptr<const WaypointLattice>& waypoint_lattice,
-          const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+          const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
     snapshot_(snapshot) {
     boost::shared_ptr<const WaypointNode> node = waypoint_lattice->closestNode(
         fast_map->waypoint(snapshot.ego().transform().location),
@@ -273,6 +296,19 @@ protected:
   using CarlaTransform   = carla::geom::Transform;
   using CarlaBoundingBox = carla::geom::BoundingBox;
 
+  /**
+   * \brief The result of simulating the traffic forward with the ego
+   *        following the path from a station to a target node.
+   *
+   * \c station is \c nullptr if the simulation fails for whatever reason.
+   */
+  struct StationRollout {
+    boost::shared_ptr<const WaypointNode> target_node = nullptr;
+    boost::shared_ptr<ContinuousPath> path = nullptr;
+    double stage_cost = 0.0;
+    boost::shared_ptr<Station> station = nullptr;
+  };
+
 protected:
 
   /// Simulation time step.
@@ -309,6 +345,10 @@ protected:
    */
   boost::weak_ptr<Station> cached_next_station_;
 
+  /// The thread pool used to expand the stations in parallel.
+  /// The stations are expanded serially if this is \c nullptr.
+  boost::shared_ptr<utils::ThreadPool> thread_pool_ = nullptr;
+
 public:
 
   /// Constructor of the class.
@@ -317,11 +357,13 @@ public:
       const double spatial_horizon,
       const boost::shared_ptr<router::Router>& router,
       const boost::shared_ptr<CarlaMap>& map,
-      const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+      const boost::shared_ptr<utils::ThreadPool>& thread_pool = nullptr) :
     Base(map, fast_map),
     sim_time_step_(sim_time_step),
     spatial_horizon_(spatial_horizon),
-    router_(router) {}
+    router_(router),
+    thread_pool_(thread_pool) {}
 
   /// Destructor of the class.
   virtual ~IDMLatticePlanner() {}
@@ -341,12 +383,32 @@ public:
   /// Get the router used by the planner.
   boost::shared_ptr<const router::Router> router() const { return router_; }
 
+  /// Get the spatial planning horizon.
+  const double spatialHorizon() const { return spatial_horizon_; }
+
+  /**
+   * \brief Set the spatial planning horizon.
+   *
+   * The waypoint lattice and the station graph of the last planning cycle are
+   * dropped, so that the lattice is recreated with the new range in the
+   * next planning cycle.
+   */
+  void setSpatialHorizon(const double spatial_horizon) {
+    spatial_horizon_ = spatial_horizon;
+    waypoint_lattice_ = nullptr;
+    node_to_station_table_.clear();
+    root_.reset();
+    cached_next_station_.reset();
+  }
+
   /// Get the nodes on the lattice, corresponding to the stations.
   std::vector<boost::shared_ptr<const WaypointNode>> nodes() const;
 
   /// Get the edges on the lattice, corresponding to the paths.
   std::vector<ContinuousPath> edges() const;
 
+  using Base::planPath;
+
   virtual DiscretePath planPath(const size_t ego, const Snapshot& snapshot) override;
 
 protected:
@@ -360,9 +422,18 @@ protected:
   /// Prune/update the station graph of last step.
   std::deque<boost::shared_ptr<Station>> pruneStationGraph(const Snapshot& snapshot);
 
-  /// Construct the station graph.
+  /**
+   * \brief Construct the station graph.
+   *
+   * The stations are expanded layer by layer with \c expandWavefront(),
+   * so that the graph does not depend on the number of threads. The expansion
+   * stops if the next layer cannot be finished before \c deadline_, in which
+   * case the unexpanded stations are left as terminals.
+   */
   void constructStationGraph(std::deque<boost::shared_ptr<Station>>& station_queue);
 
+  /// Connect a station to a target node, i.e. simulate and merge.
+
   boost::shared_ptr<Station> connectStationToFrontNode(
       const boost::shared_ptr<Station>& station,
       const boost::shared_ptr<const WaypointNode>& target_node);
@@ -373,6 +444,54 @@ protected:
       const boost::shared_ptr<Station>& station,
       const boost::shared_ptr<const WaypointNode>& target_node);
 
+  /// Simulate the traffic forward with the ego following the path from a
+  /// station to a target node. The station graph is not changed, so these
+  /// functions can be called concurrently.
+  StationRollout simulateStationToFrontNode(
+      const boost::shared_ptr<Station>& station,
+      const boost::shared_ptr<const WaypointNode>& target_node) const;
+  StationRollout simulateStationToLeftFrontNode(
+      const boost::shared_ptr<Station>& station,
+      const boost::shared_ptr<const WaypointNode>& target_node) const;
+  StationRollout simulateStationToRightFrontNode(
+      const boost::shared_ptr<Station>& station,
+      const boost::shared_ptr<const WaypointNode>& target_node) const;
+
+  /**
+   * \brief Simulate the traffic forward with the ego following the given path.
+   *
+   * The simulation is reused from the previous planning cycles through
+   * \c rolloutCache() if possible.
+   *
+   * \param[in] station The station where the simulation starts.
+   * \param[in] target_node The node where the path ends.
+   * \param[in] path The path to be followed by the ego.
+   * \param[in] option 0, 1, 2 for the path to the front, left front,
+   *                   and right front node respectively.
+   * \return The snapshot at the end of the simulation and the stage cost,
+   *         or \c boost::none if the simulation fails.
+   */
+  RolloutCache::Rollout simulateStationAlongPath(
+      const boost::shared_ptr<Station>& station,
+      const boost::shared_ptr<const WaypointNode>& target_node,
+      const ContinuousPath& path,
+      const size_t option) const;
+
+  /**
+   * \brief Merge the result of a simulation into the station graph.
+   *
+   * \param[in] station The station where the simulation starts.
+   * \param[in] rollout The result of the simulation.
+   * \param[in] option 0, 1, 2 for the simulation to the front, left front,
+   *                   and right front node respectively.
+   * \return The child station, which may be an existing station in the
+   *         table, or \c nullptr if the simulation failed.
+   */
+  boost::shared_ptr<Station> mergeStationRollout(
+      const boost::shared_ptr<Station>& station,
+      const StationRollout& rollout,
+      const size_t option);
+
   /// Compute the speed cost for a terminal station.
   const double terminalSpeedCost(const boost::shared_ptr<Station>& station) const;
 
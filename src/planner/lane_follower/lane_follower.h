@@ -14,7 +14,11 @@
 
 #pragma once
 
+#include <vector>
+#include <utility>
+#include <unordered_map>
 #include <boost/core/noncopyable.hpp>
+#include <boost/functional/hash.hpp>
 #include <planner/common/waypoint_lattice.h>
 #include <planner/common/vehicle_path.h>
 #include <planner/common/vehicle_path_planner.h>
@@ -59,7 +63,7 @@ public:
    * \param[in] router The router to be used in creating the waypoint lattice.
    */
   LaneFollower(const boost::shared_ptr<CarlaMap>& map,
-               const boost::shared_ptr<utils::FastWaypointMap>& fast_map,
+               const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
                const boost::shared_ptr<const CarlaWaypoint>& lattice_start,
                const double lattice_range,
                const boost::shared_ptr<router::Router>& router) :
@@ -81,7 +85,7 @@ public:
   virtual DiscretePath planPath(const size_t target, const Snapshot& snapshot) override {
 
     // Get the target vehicle and its waypoint.
-    const Vehicle target_vehicle = snapshot.vehicle(target);
+    const ConstVehicleView target_vehicle = snapshot.vehicle(target);
     const boost::shared_ptr<CarlaWaypoint> target_waypoint =
       fast_map_->waypoint(target_vehicle.transform().location);
 
@@ -94,66 +98,18 @@ public:
     // Find the waypoint 50m ahead of the current postion of the target vehicle.
     const boost::shared_ptr<const WaypointNode> front_node =
       waypoint_lattice_->front(target_waypoint, 50.0);
-    boost::shared_ptr<const CarlaWaypoint> front_waypoint = nullptr;
-
-    if (!front_node) {
-      if (target_vehicle.id() == snapshot.ego().id()) {
-        // If there is no front node 50m ahead of the ego,
-        // the waypoint lattice must be set incorrectly.
-        std::string error_msg("LaneFollower::plan(): there is no node 50m ahead of ego.\n");
-        std::string ego_msg = snapshot.ego().string();
-        throw std::runtime_error(error_msg + ego_msg);
-      } else if (front_waypoint = router_->frontWaypoint(target_waypoint, 50.0)) {
-      } else {
-        // If there is no front node for an agent vehicle. We may just find its next
-        // accessible waypoint with some distance.
-        std::vector<boost::shared_ptr<CarlaWaypoint>> front_waypoints =
-          target_waypoint->GetNext(10.0);
-
-        if (front_waypoints.size() <= 0) {
-          std::string error_msg("LaneFollower::plan(): cannot find next waypoints for an agent.\n");
-          std::string agent_msg = target_vehicle.string();
-          std::string waypoint_msg =
-            (boost::format("waypoint %1% x:%2% y:%3% z:%4% r:%5% p:%6% y:%7% road:%8% lane:%9%.\n")
-             % target_waypoint->GetId()
-             % target_waypoint->GetTransform().location.x
-             % target_waypoint->GetTransform().location.y
-             % target_waypoint->GetTransform().location.z
-             % target_waypoint->GetTransform().rotation.roll
-             % target_waypoint->GetTransform().rotation.pitch
-             % target_waypoint->GetTransform().rotation.yaw
-             % target_waypoint->GetRoadId()
-             % target_waypoint->GetLaneId()).str();
-          throw std::runtime_error(error_msg + agent_msg + waypoint_msg);
-        }
-
-        // Select the one with the least angle difference.
-        front_waypoint = front_waypoints[0];
-        for (size_t i = 1; i < front_waypoints.size(); ++i) {
-          const double diff1 = utils::shortestAngle(
-              target_waypoint->GetTransform().rotation.yaw,
-              front_waypoint->GetTransform().rotation.yaw);
-          const double diff2 = utils::shortestAngle(
-              target_waypoint->GetTransform().rotation.yaw,
-              front_waypoints[i]->GetTransform().rotation.yaw);
-
-          if (std::fabs(diff2) < std::fabs(diff1))
-            front_waypoint = front_waypoints[i];
-        }
-
-      }
-    } else {
-      front_waypoint = front_node->waypoint();
-    }
+    const boost::shared_ptr<const CarlaWaypoint> front_waypoint = front_node ?
+      front_node->waypoint() :
+      offLatticeFrontWaypoint(target_vehicle, target_waypoint, snapshot);
 
     // FIXME: Maybe I should use the transform and curvature from the target vehicle.
     //        However this can cause drifting of the vehile. Planning from the closest
     //        waypoint seems to be the easiest fix.
     const CarlaTransform current_transform = target_waypoint->GetTransform();
-    const double current_curvature = utils::curvatureAtWaypoint(target_waypoint, map_);
+    const double current_curvature = fast_map_->curvature(target_waypoint);
 
     const CarlaTransform reference_transform = front_waypoint->GetTransform();
-    const double reference_curvature = utils::curvatureAtWaypoint(front_waypoint, map_);
+    const double reference_curvature = fast_map_->curvature(front_waypoint);
 
     // Generate the path.
     return DiscretePath(
@@ -161,6 +117,153 @@ public:
         std::make_pair(reference_transform, reference_curvature),
         VehiclePath::LaneChangeType::KeepLane);
   }
+
+  /**
+   * \brief Plan the paths of a batch of vehicles.
+   *
+   * The paths are the same as the ones from \c planPath(), except that they
+   * are optimized through the path cache. The work shared by the targets is
+   * only done once:
+   * - The front node on the waypoint lattice only depends on the lattice node
+   *   closest to a target, so the search is done once per lattice node.
+   * - The curvatures are computed once per waypoint.
+   * - Targets starting from the same waypoint towards the same reference
+   *   waypoint share the same path object.
+   *
+   * The function does not modify the object, and can be called from
+   * different threads at the same time.
+   *
+   * \param[in] targets The IDs of the vehicles to plan paths for.
+   * \param[in] snapshot The traffic snapshot.
+   * \return The paths of the targets in the same order of \c targets.
+   *         \c nullptr is returned for a target whose path cannot be planned.
+   */
+  std::vector<boost::shared_ptr<const DiscretePath>> planPaths(
+      const std::vector<size_t>& targets, const Snapshot& snapshot) const {
+
+    if (!waypoint_lattice_) {
+      throw std::runtime_error(
+          "LaneFollower::planPaths(): the waypoint lattice is not set yet.\n");
+    }
+
+    const boost::shared_ptr<const WaypointLattice> lattice = waypointLattice();
+    std::vector<boost::shared_ptr<const DiscretePath>> paths(targets.size(), nullptr);
+
+    // Front nodes keyed by the index of the closest lattice node.
+    std::unordered_map<uint32_t, boost::shared_ptr<const WaypointNode>> front_nodes;
+    // Curvatures keyed by the waypoint ID.
+    std::unordered_map<size_t, double> curvatures;
+    // Paths keyed by the IDs of the start and reference waypoints.
+    std::unordered_map<std::pair<size_t, size_t>,
+                       boost::shared_ptr<const DiscretePath>,
+                       boost::hash<std::pair<size_t, size_t>>> planned_paths;
+
+    auto curvature = [this, &curvatures](
+        const boost::shared_ptr<const CarlaWaypoint>& waypoint)->double {
+      auto iter = curvatures.find(waypoint->GetId());
+      if (iter != curvatures.end()) return iter->second;
+      const double kappa = fast_map_->curvature(waypoint);
+      curvatures[waypoint->GetId()] = kappa;
+      return kappa;
+    };
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+      try {
+        const ConstVehicleView target_vehicle = snapshot.vehicle(targets[i]);
+        const boost::shared_ptr<CarlaWaypoint> target_waypoint =
+          fast_map_->waypoint(target_vehicle.transform().location);
+
+        // Find the waypoint 50m ahead of the target vehicle.
+        boost::shared_ptr<const WaypointNode> front_node = nullptr;
+        const boost::shared_ptr<const WaypointNode> closest_node =
+          lattice->closestNode(target_waypoint, lattice->longitudinalResolution());
+        if (closest_node) {
+          auto iter = front_nodes.find(closest_node->index());
+          if (iter == front_nodes.end()) {
+            iter = front_nodes.emplace(closest_node->index(),
+                lattice->front(target_waypoint, 50.0)).first;
+          }
+          front_node = iter->second;
+        }
+
+        const boost::shared_ptr<const CarlaWaypoint> front_waypoint = front_node ?
+          front_node->waypoint() :
+          offLatticeFrontWaypoint(target_vehicle, target_waypoint, snapshot);
+
+        const std::pair<size_t, size_t> key(
+            target_waypoint->GetId(), front_waypoint->GetId());
+        auto iter = planned_paths.find(key);
+        if (iter != planned_paths.end()) {
+          paths[i] = iter->second;
+          continue;
+        }
+
+        // A failed optimization is recorded as well, so that it is not retried.
+        planned_paths[key] = nullptr;
+        const boost::shared_ptr<ContinuousPath> continuous_path = path_cache_->path(
+            std::make_pair(target_waypoint->GetTransform(), curvature(target_waypoint)),
+            std::make_pair(front_waypoint->GetTransform(), curvature(front_waypoint)),
+            VehiclePath::LaneChangeType::KeepLane);
+        paths[i] = boost::make_shared<const DiscretePath>(*continuous_path);
+        planned_paths[key] = paths[i];
+
+      } catch (...) {
+        paths[i] = nullptr;
+      }
+    }
+
+    return paths;
+  }
+
+protected:
+
+  /**
+   * \brief Find the front waypoint of a vehicle which has no front node
+   *        50m ahead on the waypoint lattice.
+   *
+   * \throw std::runtime_error If the vehicle is the ego, or there is no
+   *        accessible waypoint in front of the vehicle.
+   */
+  boost::shared_ptr<const CarlaWaypoint> offLatticeFrontWaypoint(
+      const ConstVehicleView& target_vehicle,
+      const boost::shared_ptr<CarlaWaypoint>& target_waypoint,
+      const Snapshot& snapshot) const {
+
+    if (target_vehicle.id() == snapshot.ego().id()) {
+      // If there is no front node 50m ahead of the ego,
+      // the waypoint lattice must be set incorrectly.
+      std::string error_msg("LaneFollower::plan(): there is no node 50m ahead of ego.\n");
+      std::string ego_msg = snapshot.ego().string();
+      throw std::runtime_error(error_msg + ego_msg);
+    }
+
+    boost::shared_ptr<const CarlaWaypoint> front_waypoint =
+      router_->tryFrontWaypoint(target_waypoint, 50.0);
+    if (front_waypoint) return front_waypoint;
+
+    // If there is no front node for an agent vehicle. We may just find its next
+    // accessible waypoint with some distance.
+    front_waypoint = router_->nextWaypoint(target_waypoint, 10.0);
+
+    if (!front_waypoint) {
+      std::string error_msg("LaneFollower::plan(): cannot find next waypoints for an agent.\n");
+      std::string agent_msg = target_vehicle.string();
+      std::string waypoint_msg =
+        (boost::format("waypoint %1% x:%2% y:%3% z:%4% r:%5% p:%6% y:%7% road:%8% lane:%9%.\n")
+         % target_waypoint->GetId()
+         % target_waypoint->GetTransform().location.x
+         % target_waypoint->GetTransform().location.y
+         % target_waypoint->GetTransform().location.z
+         % target_waypoint->GetTransform().rotation.roll
+         % target_waypoint->GetTransform().rotation.pitch
+         % target_waypoint->GetTransform().rotation.yaw
+         % target_waypoint->GetRoadId()
+         % target_waypoint->GetLaneId()).str();
+      throw std::runtime_error(error_msg + agent_msg + waypoint_msg);
+    }
+
+    return front_waypoint;
+  }
 };
 
 } // End namespace lane_follower.
@@ -15,6 +15,7 @@
 #include <set>
 #include <list>
 #include <planner/common/utils.h>
+#include <planner/common/profiler.h>
 #include <planner/slc_lattice_planner/slc_lattice_planner.h>
 
 namespace planner {
@@ -59,18 +60,37 @@ const double SLCTrafficSimulator::agentAcceleration(const size_t agent) const {
   if (lead) {
     const double lead_speed = snapshot_.vehicle(lead->first).speed();
     const double following_distance = lead->second;
-    accel = idm_->idm(snapshot_.vehicle(agent).speed(),
-                      snapshot_.vehicle(agent).policySpeed(),
-                      lead_speed,
-                      following_distance);
+    accel = agentModel().idm(snapshot_.vehicle(agent).speed(),
+                             snapshot_.vehicle(agent).policySpeed(),
+                             lead_speed,
+                             following_distance);
   } else {
-    accel = idm_->idm(snapshot_.vehicle(agent).speed(),
-                      snapshot_.vehicle(agent).policySpeed());
+    accel = agentModel().idm(snapshot_.vehicle(agent).speed(),
+                             snapshot_.vehicle(agent).policySpeed());
   }
 
   return accel;
 }
 
+void SLCTrafficSimulator::agentAccelerations(std::vector<double>& accels) const {
+
+  // We assume all agent vehicles are lane followers for now.
+  std::vector<double> lead_speeds;
+  std::vector<double> distances;
+  agentLeads(lead_speeds, distances);
+
+  const VehicleTable& agents = snapshot_.agents();
+  accels.resize(agents.size());
+  agentModel().idm(agents.speeds().data(),
+                   agents.policySpeeds().data(),
+                   lead_speeds.data(),
+                   distances.data(),
+                   agents.size(),
+                   accels.data());
+
+  return;
+}
+
 void Vertex::updateParent(
     const Snapshot& snapshot,
     const double cost_to_come,
@@ -244,6 +264,7 @@ std::vector<ContinuousPath> SLCLatticePlanner::edges() const {
 
 DiscretePath SLCLatticePlanner::planPath(
     const size_t ego, const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("SLCLatticePlanner::planPath");
 
   if (ego != snapshot.ego().id()) {
     std::string error_msg(
@@ -256,6 +277,13 @@ DiscretePath SLCLatticePlanner::planPath(
     throw std::runtime_error(error_msg + id_msg);
   }
 
+  // Forget the simulations which are not reused in the last cycle.
+  nextRolloutCycle();
+
+  // The graph objects of this cycle are created in a new arena.
+  resetGraphArena();
+  edge_screening_.reset();
+
   // Update the waypoint lattice.
   updateWaypointLattice(snapshot);
 
@@ -320,18 +348,19 @@ bool SLCLatticePlanner::immediateNextVertexReached(
 }
 
 void SLCLatticePlanner::updateWaypointLattice(const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("SLCLatticePlanner::updateWaypointLattice");
 
   //std::printf("updateWaypointLattice(): \n");
 
   // If the waypoint lattice has not been initialized, a new one is created with
   // the start waypoint as where the ego currently is. Meanwhile, the range of
-  // the lattice is set to the spatial horizon. The resolution is hardcoded as 1.0m.
+  // the lattice is set to the spatial horizon. The resolution is \c lattice_resolution_.
   if (!waypoint_lattice_) {
     //std::printf("Create new waypoint lattice.\n");
     boost::shared_ptr<CarlaWaypoint> ego_waypoint =
       fast_map_->waypoint(snapshot.ego().transform().location);
     waypoint_lattice_ = boost::make_shared<WaypointLattice>(
-        ego_waypoint, spatial_horizon_+30.0, 1.0, router_);
+        ego_waypoint, spatial_horizon_+30.0, lattice_resolution_, router_);
     return;
   }
 
@@ -355,6 +384,7 @@ void SLCLatticePlanner::updateWaypointLattice(const Snapshot& snapshot) {
 
 std::deque<boost::shared_ptr<Vertex>>
   SLCLatticePlanner::pruneVertexGraph(const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("SLCLatticePlanner::pruneVertexGraph");
 
   //std::printf("pruneVertexGraph(): \n");
 
@@ -369,7 +399,7 @@ std::deque<boost::shared_ptr<Vertex>>
 
     // Initialize the new root vertex.
     boost::shared_ptr<Vertex> root =
-      boost::make_shared<Vertex>(snapshot, waypoint_lattice_, fast_map_);
+      makeGraphObject<Vertex>(snapshot, waypoint_lattice_, fast_map_);
     all_vertices_.push_back(root);
     root_ = root;
 
@@ -383,7 +413,7 @@ std::deque<boost::shared_ptr<Vertex>>
 
   // Create the new root vertex.
   boost::shared_ptr<Vertex> new_root =
-    boost::make_shared<Vertex>(snapshot, waypoint_lattice_, fast_map_);
+    makeGraphObject<Vertex>(snapshot, waypoint_lattice_, fast_map_);
 
   // Read the immedinate next waypoint node to be reached.
   boost::shared_ptr<const WaypointNode> next_node =
@@ -440,6 +470,7 @@ std::deque<boost::shared_ptr<Vertex>>
 
 void SLCLatticePlanner::constructVertexGraph(
     std::deque<boost::shared_ptr<Vertex>>& vertex_queue) {
+  CLP_PROFILE_SCOPE("SLCLatticePlanner::constructVertexGraph");
 
   //std::printf("constructVertexGraph(): \n");
 
@@ -453,38 +484,42 @@ void SLCLatticePlanner::constructVertexGraph(
       vertex_queue.push_back(vertex);
   };
 
-  while (!vertex_queue.empty()) {
-    boost::shared_ptr<Vertex> vertex = vertex_queue.front();
-    vertex_queue.pop_front();
-
-    // Try to connect to the front node.
-    boost::shared_ptr<const WaypointNode> front_node =
-      waypoint_lattice_->front(vertex->node().lock()->waypoint(), 50.0);
-    boost::shared_ptr<Vertex> front_vertex =
-      connectVertexToFrontNode(vertex, front_node);
-
-    addVertexToGraphAndQueue(front_vertex, front_node);
+  // Expand the vertices layer by layer. Each vertex is connected to its
+  // front (option 0), left front (option 1), and right front (option 2) nodes.
+  const boost::shared_ptr<const Vertex> root = root_.lock();
+  auto expand = [this, &root](const boost::shared_ptr<Vertex>& vertex,
+                              const size_t option)->VertexRollout{
+    const boost::shared_ptr<const CarlaWaypoint> waypoint =
+      vertex->node().lock()->waypoint();
+    if (option == 0) {
+      return simulateVertexToFrontNode(
+          vertex, waypoint_lattice_->front(waypoint, 50.0));
+    }
 
     // Check if the vertex is on the same lane with the root.
     // If not, no lane change options will be allowed further.
-    if (!(vertex->sameLaneWith(root_.lock()))) continue;
-
-    // Try to connect to the left front node.
-    boost::shared_ptr<const WaypointNode> left_front_node =
-      waypoint_lattice_->frontLeft(vertex->node().lock()->waypoint(), 50.0);
-    boost::shared_ptr<Vertex> left_front_vertex =
-      connectVertexToLeftFrontNode(vertex, left_front_node);
-
-    addVertexToGraphAndQueue(left_front_vertex, left_front_node);
+    if (!(vertex->sameLaneWith(root))) return VertexRollout();
+
+    if (option == 1) {
+      return simulateVertexToLeftFrontNode(
+          vertex, waypoint_lattice_->frontLeft(waypoint, 50.0));
+    } else {
+      return simulateVertexToRightFrontNode(
+          vertex, waypoint_lattice_->frontRight(waypoint, 50.0));
+    }
+  };
 
-    // Try to connect to the right front node.
-    boost::shared_ptr<const WaypointNode> right_front_node =
-      waypoint_lattice_->frontRight(vertex->node().lock()->waypoint(), 50.0);
-    boost::shared_ptr<Vertex> right_front_vertex =
-      connectVertexToRightFrontNode(vertex, right_front_node);
+  auto merge = [this, &addVertexToGraphAndQueue](
+      const boost::shared_ptr<Vertex>& vertex,
+      const size_t option,
+      const VertexRollout& rollout,
+      std::deque<boost::shared_ptr<Vertex>>&)->void{
+    addVertexToGraphAndQueue(
+        mergeVertexRollout(vertex, rollout, option), rollout.target_node);
+  };
 
-    addVertexToGraphAndQueue(right_front_vertex, right_front_node);
-  }
+  truncated_ = !expandWavefront(
+      vertex_queue, 3, thread_pool_, expand, merge, deadline_);
 
   return;
 }
@@ -492,81 +527,77 @@ void SLCLatticePlanner::constructVertexGraph(
 boost::shared_ptr<Vertex> SLCLatticePlanner::connectVertexToFrontNode(
     const boost::shared_ptr<Vertex>& vertex,
     const boost::shared_ptr<const WaypointNode>& target_node) {
+  return mergeVertexRollout(vertex, simulateVertexToFrontNode(vertex, target_node), 0);
+}
+
+SLCLatticePlanner::VertexRollout SLCLatticePlanner::simulateVertexToFrontNode(
+    const boost::shared_ptr<Vertex>& vertex,
+    const boost::shared_ptr<const WaypointNode>& target_node) const {
 
-  //std::printf("connectVertexToFrontNode(): \n");
+  //std::printf("simulateVertexToFrontNode(): \n");
 
   // Return directly if the target node does not exist.
-  if (!target_node) return nullptr;
+  if (!target_node) return VertexRollout();
 
   // Plan a path between the node at the current vertex to the target node.
   //std::printf("Compute Kelly-Nagy path.\n");
   boost::shared_ptr<ContinuousPath> path = nullptr;
   try {
-    path = boost::make_shared<ContinuousPath>(
+    path = path_cache_->path(
         std::make_pair(vertex->snapshot().ego().transform(),
                        vertex->snapshot().ego().curvature()),
         std::make_pair(target_node->waypoint()->GetTransform(),
-                       target_node->curvature(map_)),
+                       fast_map_->curvature(target_node->waypoint())),
         ContinuousPath::LaneChangeType::KeepLane);
   } catch (std::exception& e) {
     // If for whatever reason, the path cannot be created, the vertex
     // cannot be created either.
     std::printf("%s", e.what());
-    return nullptr;
+    return VertexRollout();
   }
 
-  // Now, simulate the traffic forward with ego following the created path.
-  //std::printf("Simulate the traffic.\n");
-  SLCTrafficSimulator simulator(vertex->snapshot(), map_, fast_map_);
-  double simulation_time = 0.0; double stage_cost = 0.0;
-  try {
-    const bool no_collision = simulator.simulate(
-        *path, sim_time_step_, 5.0, simulation_time, stage_cost);
-    // There a collision is detected in the simulation, this option is ignored.
-    if (!no_collision) return nullptr;
-  } catch(std::exception& e) {
-    std::printf("SLCLatticePlanner::connectVertexToFrontNode(): WARNING\n"
-                "%s", e.what());
-    return nullptr;
-  }
-
-  // A new vertex should be created.
-  //std::printf("Create child vertex.\n");
-  boost::shared_ptr<Vertex> next_vertex = boost::make_shared<Vertex>(
-      simulator.snapshot(), waypoint_lattice_, fast_map_);
-
-  // Set the child vertex of the parent vertex.
-  //std::printf("Update the child vertex of the input vertex.\n");
-  vertex->updateFrontChild(*path, stage_cost, next_vertex);
-
-  // Set the parent vertex of the child vertex.
-  //std::printf("Update the parent vertex of the new vertex.\n");
-  next_vertex->updateParent(
-      simulator.snapshot(), vertex->costToCome()+stage_cost, vertex);
-
-  return next_vertex;
+  // Now, simulate the traffic forward with the ego following the created path.
+  const RolloutCache::Rollout result =
+    simulateVertexAlongPath(vertex, target_node, *path, 0);
+  if (!result) return VertexRollout();
+
+  // Create the vertex at the end of the simulation.
+  VertexRollout rollout;
+  rollout.target_node = target_node;
+  rollout.path = path;
+  rollout.stage_cost = result->second;
+  rollout.vertex = makeGraphObject<Vertex>(
+      result->first, waypoint_lattice_, fast_map_);
+
+  return rollout;
 }
 
 boost::shared_ptr<Vertex> SLCLatticePlanner::connectVertexToLeftFrontNode(
     const boost::shared_ptr<Vertex>& vertex,
     const boost::shared_ptr<const WaypointNode>& target_node) {
+  return mergeVertexRollout(vertex, simulateVertexToLeftFrontNode(vertex, target_node), 1);
+}
 
-  //std::printf("connectVertexToLeftFrontNode(): \n");
+SLCLatticePlanner::VertexRollout SLCLatticePlanner::simulateVertexToLeftFrontNode(
+    const boost::shared_ptr<Vertex>& vertex,
+    const boost::shared_ptr<const WaypointNode>& target_node) const {
+
+  //std::printf("simulateVertexToLeftFrontNode(): \n");
 
   // Return directly if the target node does not exisit.
-  if (!target_node) return nullptr;
+  if (!target_node) return VertexRollout();
 
   // Return directly if the target node is already very close to the vertex.
   // It is not reasonable to change lane with this short distance.
   if (target_node->distance()-vertex->node().lock()->distance() < 20.0)
-    return nullptr;
+    return VertexRollout();
 
   // If the ego is on the right of the lane center, connecting to the
   // left lane is forbidden.
   if (utils::distanceToLaneCenter(
         vertex->snapshot().ego().transform().location,
         vertex->node().lock()->waypoint()) > 0.5)
-    return nullptr;
+    return VertexRollout();
 
   // Check the left front and left back vehicles.
   //
@@ -580,78 +611,73 @@ boost::shared_ptr<Vertex> SLCLatticePlanner::connectVertexToLeftFrontNode(
   boost::optional<std::pair<size_t, double>> left_back =
     vertex->snapshot().trafficLattice()->leftBack(vertex->snapshot().ego().id());
 
-  if (left_front && left_front->second <= 0.0) return nullptr;
-  if (left_back  && left_back->second  <= 0.0) return nullptr;
+  if (left_front && left_front->second <= 0.0) return VertexRollout();
+  if (left_back  && left_back->second  <= 0.0) return VertexRollout();
+
+  // The edge is rejected before the path is optimized if the ego does not
+  // fit into the gap on the left lane.
+  if (screenOutLaneChange(vertex->snapshot(), ContinuousPath::LaneChangeType::LeftLaneChange))
+    return VertexRollout();
 
   // Plan a path between the node at the current vertex to the target node.
   //std::printf("Compute Kelly-Nagy path.\n");
   boost::shared_ptr<ContinuousPath> path = nullptr;
   try {
-    path = boost::make_shared<ContinuousPath>(
+    path = path_cache_->path(
         std::make_pair(vertex->snapshot().ego().transform(),
                        vertex->snapshot().ego().curvature()),
         std::make_pair(target_node->waypoint()->GetTransform(),
-                       target_node->curvature(map_)),
+                       fast_map_->curvature(target_node->waypoint())),
         ContinuousPath::LaneChangeType::LeftLaneChange);
   } catch (const std::exception& e) {
     // If for whatever reason, the path cannot be created,
     // just ignore this option.
     std::printf("%s", e.what());
-    return nullptr;
+    return VertexRollout();
   }
 
-  // Now, simulate the traffic forward with ego following the created path.
-  //std::printf("Simulate the traffic.\n");
-  SLCTrafficSimulator simulator(vertex->snapshot(), map_, fast_map_);
-  double simulation_time = 0.0; double stage_cost = 0.0;
-  try {
-    const bool no_collision = simulator.simulate(
-        *path, sim_time_step_, 5.0, simulation_time, stage_cost);
-    // There a collision is detected in the simulation, this option is ignored.
-    if (!no_collision) return nullptr;
-  } catch (std::exception& e) {
-    std::printf("SLCLatticePlanner::connectVertexToLeftFrontNode(): WARNING\n"
-                "%s", e.what());
-    return nullptr;
-  }
-
-  // Create a new vertex.
-  //std::printf("Create child vertex.\n");
-  boost::shared_ptr<Vertex> next_vertex = boost::make_shared<Vertex>(
-      simulator.snapshot(), waypoint_lattice_, fast_map_);
-
-  // Set the child vertex of the parent vertex.
-  //std::printf("Update the child vertex of the input vertex.\n");
-  vertex->updateLeftChild(*path, stage_cost, next_vertex);
-
-  // Set the parent vertex of the child vertex.
-  //std::printf("Update the parent vertex of the new vertex.\n");
-  next_vertex->updateParent(
-      simulator.snapshot(), vertex->costToCome()+stage_cost, vertex);
-
-  return next_vertex;
+  // Now, simulate the traffic forward with the ego following the created path.
+  const RolloutCache::Rollout result =
+    simulateVertexAlongPath(vertex, target_node, *path, 1);
+  if (!result) return VertexRollout();
+
+  // Create the vertex at the end of the simulation.
+  VertexRollout rollout;
+  rollout.target_node = target_node;
+  rollout.path = path;
+  rollout.stage_cost = result->second;
+  rollout.vertex = makeGraphObject<Vertex>(
+      result->first, waypoint_lattice_, fast_map_);
+
+  return rollout;
 }
 
 boost::shared_ptr<Vertex> SLCLatticePlanner::connectVertexToRightFrontNode(
     const boost::shared_ptr<Vertex>& vertex,
     const boost::shared_ptr<const WaypointNode>& target_node) {
+  return mergeVertexRollout(vertex, simulateVertexToRightFrontNode(vertex, target_node), 2);
+}
+
+SLCLatticePlanner::VertexRollout SLCLatticePlanner::simulateVertexToRightFrontNode(
+    const boost::shared_ptr<Vertex>& vertex,
+    const boost::shared_ptr<const WaypointNode>& target_node) const {
 
-  //std::printf("connectVertexToRightFrontNode(): \n");
+  //std::printf("simulateVertexToRightFrontNode(): \n");
 
   // Return directly if the target node does not exisit.
-  if (!target_node) return nullptr;
+  if (!target_node) return VertexRollout();
 
   // Return directly if the target node is already very close to the vertex.
   // It is not reasonable to change lane with this short distance.
   if (target_node->distance()-vertex->node().lock()->distance() < 20.0)
-    return nullptr;
+    return VertexRollout();
 
   // If the ego is on the left of the lane center, connecting to the
   // right lane is forbidden.
   if (utils::distanceToLaneCenter(
         vertex->snapshot().ego().transform().location,
         vertex->node().lock()->waypoint()) < -0.5)
-    return nullptr;
+    return VertexRollout();
 
   // Check the right front and right back vehicles.
   //
@@ -665,54 +691,66 @@ boost::shared_ptr<Vertex> SLCLatticePlanner::connectVertexToRightFrontNode(
   boost::optional<std::pair<size_t, double>> right_back =
     vertex->snapshot().trafficLattice()->rightBack(vertex->snapshot().ego().id());
 
-  if (right_front && right_front->second <= 0.0) return nullptr;
-  if (right_back  && right_back->second  <= 0.0) return nullptr;
+  if (right_front && right_front->second <= 0.0) return VertexRollout();
+  if (right_back  && right_back->second  <= 0.0) return VertexRollout();
+
+  // The edge is rejected before the path is optimized if the ego does not
+  // fit into the gap on the right lane.
+  if (screenOutLaneChange(vertex->snapshot(), ContinuousPath::LaneChangeType::RightLaneChange))
+    return VertexRollout();
 
   // Plan a path between the node at the current vertex to the target node.
   //std::printf("Compute Kelly-Nagy path.\n");
   boost::shared_ptr<ContinuousPath> path = nullptr;
   try {
-    path = boost::make_shared<ContinuousPath>(
+    path = path_cache_->path(
         std::make_pair(vertex->snapshot().ego().transform(),
                        vertex->snapshot().ego().curvature()),
         std::make_pair(target_node->waypoint()->GetTransform(),
-                       target_node->curvature(map_)),
+                       fast_map_->curvature(target_node->waypoint())),
         ContinuousPath::LaneChangeType::RightLaneChange);
   } catch (std::exception& e) {
     // If for whatever reason, the path cannot be created,
     // just ignore this option.
     std::printf("%s", e.what());
-    return nullptr;
+    return VertexRollout();
   }
 
   // Now, simulate the traffic forward with the ego following the created path.
-  //std::printf("Simulate the traffic.\n");
-  SLCTrafficSimulator simulator(vertex->snapshot(), map_, fast_map_);
-  double simulation_time = 0.0; double stage_cost = 0.0;
-  try {
-    const bool no_collision = simulator.simulate(
-        *path, sim_time_step_, 5.0, simulation_time, stage_cost);
-    // There a collision is detected in the simulation, this option is ignored.
-    if (!no_collision) return nullptr;
-  } catch (std::exception& e) {
-    std::printf("SLCLatticePlanner::connectVertexToRightFrontNode(): WARNING\n"
-                "%s", e.what());
-    return nullptr;
-  }
+  const RolloutCache::Rollout result =
+    simulateVertexAlongPath(vertex, target_node, *path, 2);
+  if (!result) return VertexRollout();
+
+  // Create the vertex at the end of the simulation.
+  VertexRollout rollout;
+  rollout.target_node = target_node;
+  rollout.path = path;
+  rollout.stage_cost = result->second;
+  rollout.vertex = makeGraphObject<Vertex>(
+      result->first, waypoint_lattice_, fast_map_);
+
+  return rollout;
+}
 
-  // Create a new vertex.
-  //std::printf("Create child vertex.\n");
-  boost::shared_ptr<Vertex> next_vertex = boost::make_shared<Vertex>(
-      simulator.snapshot(), waypoint_lattice_, fast_map_);
+boost::shared_ptr<Vertex> SLCLatticePlanner::mergeVertexRollout(
+    const boost::shared_ptr<Vertex>& vertex,
+    const VertexRollout& rollout,
+    const size_t option) {
+
+  if (!rollout.vertex) return nullptr;
+  boost::shared_ptr<Vertex> next_vertex = rollout.vertex;
 
   // Set the child vertex of the parent vertex.
-  //std::printf("Update the child vertex of the input vertex.\n");
-  vertex->updateRightChild(*path, stage_cost, next_vertex);
+  if (option == 0)
+    vertex->updateFrontChild(*(rollout.path), rollout.stage_cost, next_vertex);
+  else if (option == 1)
+    vertex->updateLeftChild(*(rollout.path), rollout.stage_cost, next_vertex);
+  else
+    vertex->updateRightChild(*(rollout.path), rollout.stage_cost, next_vertex);
 
   // Set the parent vertex of the child vertex.
-  //std::printf("Update the parent vertex of the new vertex.\n");
   next_vertex->updateParent(
-      simulator.snapshot(), vertex->costToCome()+stage_cost, vertex);
+      next_vertex->snapshot(), vertex->costToCome()+rollout.stage_cost, vertex);
 
   return next_vertex;
 }
@@ -727,11 +765,6 @@ const double SLCLatticePlanner::terminalSpeedCost(
     throw std::runtime_error(error_msg + vertex->string());
   }
 
-  static std::unordered_map<int, double> cost_map {
-    {0, 4.0}, {1, 4.0}, {2, 4.0}, {3, 3.0}, {4, 3.0},
-    {5, 2.0}, {6, 2.0}, {7, 1.0}, {8, 1.0}, {9, 0.0},
-  };
-
   const double ego_speed = vertex->snapshot().ego().speed();
   const double ego_policy_speed = vertex->snapshot().ego().policySpeed();
   if (ego_speed < 0.0 || ego_policy_speed < 0.0) {
@@ -754,7 +787,7 @@ const double SLCLatticePlanner::terminalSpeedCost(
 
   // There is no cost if the speed of the ego matches or exceeds the policy speed.
   if (speed_ratio >= 1.0) return 0.0;
-  else return cost_map[static_cast<int>(speed_ratio*10.0)];
+  else return cost_model_->terminalSpeedCost(speed_ratio);
 }
 
 const double SLCLatticePlanner::terminalDistanceCost(
@@ -767,11 +800,6 @@ const double SLCLatticePlanner::terminalDistanceCost(
     throw std::runtime_error(error_msg + vertex->string());
   }
 
-  static std::unordered_map<int, double> cost_map {
-    {0, 20.0}, {1, 20.0}, {2, 20.0}, {3, 20.0}, {4, 20.0},
-    {5, 20.0}, {6, 20.0}, {7, 20.0}, {8, 10.0},  {9, 5.0},
-  };
-
   // Find the current spatial planning horizon.
   boost::shared_ptr<const Vertex> root_child;
   if (root_.lock()->hasFrontChild())
@@ -794,7 +822,7 @@ const double SLCLatticePlanner::terminalDistanceCost(
   //    distance, spatial_horizon, distance_ratio);
 
   if (distance_ratio >= 1.0) return 0.0;
-  else return cost_map[static_cast<int>(distance_ratio*10.0)];
+  else return cost_model_->terminalDistanceCost(distance_ratio);
 }
 
 const double SLCLatticePlanner::costFromRootToTerminal(
@@ -820,6 +848,7 @@ const double SLCLatticePlanner::costFromRootToTerminal(
 void SLCLatticePlanner::selectOptimalPath(
     std::list<ContinuousPath>& path_sequence,
     std::list<boost::weak_ptr<Vertex>>& vertex_sequence) const {
+  CLP_PROFILE_SCOPE("SLCLatticePlanner::selectOptimalPath");
 
   //std::printf("selectOptimalPath():\n");
 
@@ -918,6 +947,7 @@ void SLCLatticePlanner::selectOptimalPath(
 
 DiscretePath SLCLatticePlanner::mergePaths(
     const std::list<ContinuousPath>& paths) const {
+  CLP_PROFILE_SCOPE("SLCLatticePlanner::mergePaths");
 
   DiscretePath path(paths.front());
   for (std::list<ContinuousPath>::const_iterator iter = ++(paths.begin());
@@ -925,5 +955,34 @@ DiscretePath SLCLatticePlanner::mergePaths(
   return path;
 }
 
+RolloutCache::Rollout SLCLatticePlanner::simulateVertexAlongPath(
+    const boost::shared_ptr<Vertex>& vertex,
+    const boost::shared_ptr<const WaypointNode>& target_node,
+    const ContinuousPath& path,
+    const size_t option) const {
+
+  auto simulate = [this, &vertex, &path]()->RolloutCache::Rollout{
+    SLCTrafficSimulator simulator(rolloutSnapshot(vertex->snapshot()), map_, fast_map_);
+    simulator.costModel() = cost_model_;
+    double simulation_time = 0.0; double stage_cost = 0.0;
+    try {
+      const bool no_collision = simulator.simulate(
+          path, sim_time_step_, 5.0, simulation_time, stage_cost);
+      // There a collision is detected in the simulation, this option is ignored.
+      if (!no_collision) return boost::none;
+    } catch (std::exception& e) {
+      std::printf("SLCLatticePlanner::simulateVertexAlongPath(): WARNING\n"
+                  "%s", e.what());
+      return boost::none;
+    }
+    return std::make_pair(
+        rolloutResult(vertex->snapshot(), simulator.snapshot(), simulation_time), stage_cost);
+  };
+
+  return simulateRollout(
+      RolloutCache::Key{vertex->node().lock()->id(), target_node->id(), option},
+      vertex->snapshot(), simulate);
+}
+
 } // End namespace slc_lattice_planner.
 } // End namespace planner.
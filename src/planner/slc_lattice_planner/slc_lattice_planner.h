@@ -30,6 +30,8 @@
 #include <planner/common/vehicle_path_planner.h>
 #include <planner/common/traffic_simulator.h>
 #include <planner/common/intelligent_driver_model.h>
+#include <planner/common/thread_pool.h>
+#include <planner/common/wavefront_expansion.h>
 
 namespace planner {
 namespace slc_lattice_planner {
@@ -42,36 +44,57 @@ namespace slc_lattice_planner {
  * (including the ego) follows the intelligent driver model, which adjust
  * acceleration adaptively based on the current traffic scenario.
  */
-class SLCTrafficSimulator : public TrafficSimulator {
+class SLCTrafficSimulator final : public TrafficSimulatorCore<SLCTrafficSimulator> {
 
 private:
 
-  using Base = TrafficSimulator;
+  using Base = TrafficSimulatorCore<SLCTrafficSimulator>;
   using This = SLCTrafficSimulator;
 
+  friend class TrafficSimulatorCore<SLCTrafficSimulator>;
+
 protected:
 
   /// Intelligent driver model.
   boost::shared_ptr<IntelligentDriverModel> idm_ = nullptr;
 
+  /// Intelligent driver model of the agents if they are simulated with
+  /// a different hypothesis, otherwise \c nullptr and \c idm_ is used.
+  boost::shared_ptr<IntelligentDriverModel> agent_idm_ = nullptr;
+
 public:
 
   SLCTrafficSimulator(
       const Snapshot& snapshot,
       const boost::shared_ptr<CarlaMap>& map,
-      const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
     Base(snapshot, map, fast_map),
     idm_(boost::make_shared<IntelligentDriverModel>()) {}
 
   const boost::shared_ptr<const IntelligentDriverModel> idm() const { return idm_; }
   boost::shared_ptr<IntelligentDriverModel>& idm() { return idm_; }
 
+  /// The model of the agents, which follows \c idm() unless set separately.
+  const boost::shared_ptr<const IntelligentDriverModel> agentIdm() const {
+    if (agent_idm_) return agent_idm_;
+    else return idm_;
+  }
+  /// Set to \c nullptr to simulate the agents with \c idm() again.
+  boost::shared_ptr<IntelligentDriverModel>& agentIdm() { return agent_idm_; }
+
 protected:
 
+  const IntelligentDriverModel& agentModel() const {
+    return agent_idm_ ? *agent_idm_ : *idm_;
+  }
+
   virtual const double egoAcceleration() const override;
 
   virtual const double agentAcceleration(const size_t agent) const override;
 
+  /// All agents are evaluated with one batched call of the IDM.
+  virtual void agentAccelerations(std::vector<double>& accels) const override;
+
 }; // End class IDMTrafficSimulator.
 
 /**
@@ -143,7 +166,7 @@ public:
 
   Vertex(const Snapshot& snapshot,
          const boost::shared_ptr<const WaypointLattice>& waypoint_lattice,
-         const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+         const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
     snapshot_(snapshot) {
     boost::shared_ptr<const WaypointNode> node = waypoint_lattice->closestNode(
         fast_map->waypoint(snapshot.ego().transform().location),
@@ -237,6 +260,19 @@ protected:
   using CarlaTransform   = carla::geom::Transform;
   using CarlaBoundingBox = carla::geom::BoundingBox;
 
+  /**
+   * \brief The result of simulating the ego from a vertex to a target node,
+   *        before it is merged into the vertex graph.
+   *
+   * \c vertex is \c nullptr if the simulation fails for whatever reason.
+   */
+  struct VertexRollout {
+    boost::shared_ptr<const WaypointNode> target_node = nullptr;
+    boost::shared_ptr<ContinuousPath> path = nullptr;
+    double stage_cost = 0.0;
+    boost::shared_ptr<Vertex> vertex = nullptr;
+  };
+
 protected:
 
   /// Simulation time step.
@@ -272,6 +308,10 @@ protected:
    */
   boost::weak_ptr<Vertex> cached_next_vertex_;
 
+  /// The thread pool used to expand the vertices in parallel.
+  /// The vertices are expanded serially if this is \c nullptr.
+  boost::shared_ptr<utils::ThreadPool> thread_pool_ = nullptr;
+
 public:
 
   /// Constructor of the class.
@@ -280,11 +320,13 @@ public:
       const double spatial_horizon,
       const boost::shared_ptr<router::Router>& router,
       const boost::shared_ptr<CarlaMap>& map,
-      const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+      const boost::shared_ptr<utils::ThreadPool>& thread_pool = nullptr) :
     Base(map, fast_map),
     sim_time_step_(sim_time_step),
     spatial_horizon_(spatial_horizon),
-    router_(router) {}
+    router_(router),
+    thread_pool_(thread_pool) {}
 
   /// Destructor of the class.
   virtual ~SLCLatticePlanner() {}
@@ -300,12 +342,32 @@ public:
   /// Get the router used by the planner.
   boost::shared_ptr<const router::Router> router() const { return router_; }
 
+  /// Get the spatial planning horizon.
+  const double spatialHorizon() const { return spatial_horizon_; }
+
+  /**
+   * \brief Set the spatial planning horizon.
+   *
+   * The waypoint lattice and the vertex graph of the last planning cycle are
+   * dropped, so that the lattice is recreated with the new range in the
+   * next planning cycle.
+   */
+  void setSpatialHorizon(const double spatial_horizon) {
+    spatial_horizon_ = spatial_horizon;
+    waypoint_lattice_ = nullptr;
+    all_vertices_.clear();
+    root_.reset();
+    cached_next_vertex_.reset();
+  }
+
   /// Get the waypoint nodes used in the planner.
   std::vector<boost::shared_ptr<const WaypointNode>> nodes() const;
 
   /// Get all paths connecting the waypoint nodes in the planner.
   std::vector<ContinuousPath> edges() const;
 
+  using Base::planPath;
+
   virtual DiscretePath planPath(const size_t ego, const Snapshot& snapshot) override;
 
 protected:
@@ -319,9 +381,18 @@ protected:
   /// Prune/update the vertex graph of last step.
   std::deque<boost::shared_ptr<Vertex>> pruneVertexGraph(const Snapshot& snapshot);
 
-  /// Construct the vertex graph.
+  /**
+   * \brief Construct the vertex graph.
+   *
+   * The vertices are expanded layer by layer with \c expandWavefront(),
+   * so that the graph does not depend on the number of threads. The expansion
+   * stops if the next layer cannot be finished before \c deadline_, in which
+   * case the unexpanded vertices are left as terminals.
+   */
   void constructVertexGraph(std::deque<boost::shared_ptr<Vertex>>& vertex_queue);
 
+  /// Connect a vertex to a target node, i.e. simulate and merge.
+
   boost::shared_ptr<Vertex> connectVertexToFrontNode(
       const boost::shared_ptr<Vertex>& vertex,
       const boost::shared_ptr<const WaypointNode>& target_node);
@@ -332,6 +403,53 @@ protected:
       const boost::shared_ptr<Vertex>& vertex,
       const boost::shared_ptr<const WaypointNode>& target_node);
 
+  /// Simulate the traffic forward with the ego following the path from a
+  /// vertex to a target node. The vertex graph is not changed, so these
+  /// functions can be called concurrently.
+  VertexRollout simulateVertexToFrontNode(
+      const boost::shared_ptr<Vertex>& vertex,
+      const boost::shared_ptr<const WaypointNode>& target_node) const;
+  VertexRollout simulateVertexToLeftFrontNode(
+      const boost::shared_ptr<Vertex>& vertex,
+      const boost::shared_ptr<const WaypointNode>& target_node) const;
+  VertexRollout simulateVertexToRightFrontNode(
+      const boost::shared_ptr<Vertex>& vertex,
+      const boost::shared_ptr<const WaypointNode>& target_node) const;
+
+  /**
+   * \brief Simulate the traffic forward with the ego following the given path.
+   *
+   * The simulation is reused from the previous planning cycles through
+   * \c rolloutCache() if possible.
+   *
+   * \param[in] vertex The vertex where the simulation starts.
+   * \param[in] target_node The node where the path ends.
+   * \param[in] path The path to be followed by the ego.
+   * \param[in] option 0, 1, 2 for the path to the front, left front,
+   *                   and right front node respectively.
+   * \return The snapshot at the end of the simulation and the stage cost,
+   *         or \c boost::none if the simulation fails.
+   */
+  RolloutCache::Rollout simulateVertexAlongPath(
+      const boost::shared_ptr<Vertex>& vertex,
+      const boost::shared_ptr<const WaypointNode>& target_node,
+      const ContinuousPath& path,
+      const size_t option) const;
+
+  /**
+   * \brief Merge a simulated rollout into the vertex graph.
+   *
+   * \param[in] vertex The vertex where the rollout starts.
+   * \param[in] rollout The rollout returned by one of the \c simulateVertexTo*() functions.
+   * \param[in] option 0, 1, 2 for the path to the front, left front,
+   *                   and right front node respectively.
+   * \return The child vertex, or \c nullptr if the simulation failed.
+   */
+  boost::shared_ptr<Vertex> mergeVertexRollout(
+      const boost::shared_ptr<Vertex>& vertex,
+      const VertexRollout& rollout,
+      const size_t option);
+
   /// Compute the speed cost for a terminal vertex
   const double terminalSpeedCost(const boost::shared_ptr<Vertex>& vertex) const;
 
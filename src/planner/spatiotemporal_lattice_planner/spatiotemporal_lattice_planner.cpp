@@ -13,45 +13,200 @@
 */
 
 #include <set>
+#include <queue>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 #include <planner/common/utils.h>
+#include <planner/common/profiler.h>
 #include <planner/spatiotemporal_lattice_planner/spatiotemporal_lattice_planner.h>
 
 namespace planner {
 namespace spatiotemporal_lattice_planner {
 
-constexpr std::array<std::pair<double, double>, 3> Vertex::kSpeedIntervalsPerStation_;
 constexpr std::array<double, 6> SpatiotemporalLatticePlanner::kAccelerationOptions_;
+constexpr double SpatiotemporalLatticePlanner::kStationInterval_;
+constexpr double SpatiotemporalLatticePlanner::kMaxStageTime_;
+constexpr double ConstAccelTrafficSimulator::kMaxEventInterval_;
+constexpr double ConstAccelTrafficSimulator::kEventTimeMargin_;
+
+void ConstAccelTrafficSimulator::agentAccelerations(std::vector<double>& accels) const {
+  const VehicleTable& agents = snapshot_.agents();
+  accels = agents.accelerations();
+  for (size_t slot = 0; slot < agents.size(); ++slot) {
+    if (agents.speeds()[slot] <= 0.0 && accels[slot] < 0.0) accels[slot] = 0.0;
+  }
+  return;
+}
 
-const double ConstAccelTrafficSimulator::accelCost(
-    const double accel, const double speed, const double policy_speed) const {
-  // The cost map for brake.
-  // [0, 1) -> 0
-  // [1, 2) -> 1
-  // [2, 4) -> 2
-  // [4, 6) -> 4
-  // [6, 8) -> 8
-  // [8, +) -> 16
-  static std::unordered_map<int, double> cost_map {
-    {0, 0.0},
-    {1, 1.0},
-    {2, 2.0}, {3, 2.0},
-    {4, 4.0}, {5, 4.0},
-    {6, 8.0}, {7, 8.0},
+const double ConstAccelTrafficSimulator::nextEventTime(
+    const double ego_accel, const std::vector<double>& agent_accels) const {
+
+  // The first positive root of c0 + c1*t + c2*t^2 = 0, or infinity if there is none.
+  auto firstRoot = [](const double c0, const double c1, const double c2)->double{
+    const double inf = std::numeric_limits<double>::infinity();
+    if (std::fabs(c2) < 1.0e-10) {
+      if (c1 == 0.0) return inf;
+      const double t = -c0 / c1;
+      return t > 0.0 ? t : inf;
+    }
+    const double discriminant = c1*c1 - 4.0*c0*c2;
+    if (discriminant < 0.0) return inf;
+    const double sqrt_discriminant = std::sqrt(discriminant);
+    const double t0 = (-c1-sqrt_discriminant) / (2.0*c2);
+    const double t1 = (-c1+sqrt_discriminant) / (2.0*c2);
+    double t = inf;
+    if (t0 > 0.0) t = std::min(t, t0);
+    if (t1 > 0.0) t = std::min(t, t1);
+    return t;
+  };
+
+  const VehicleTable& agents = snapshot_.agents();
+  const Vehicle& ego = snapshot_.ego();
+  auto acceleration = [&ego, &agents, &agent_accels, ego_accel](const size_t id)->double{
+    return id == ego.id() ? ego_accel : agent_accels[agents.slot(id)];
   };
 
-  // Crusing.
-  if (accel == 0.0) return 0.0;
+  double event_time = std::numeric_limits<double>::infinity();
+  auto addEvent = [&event_time](const double t, const double margin)->void{
+    event_time = std::min(event_time, std::max(t-margin, 0.0));
+  };
+
+  // A vehicle stops, or crosses its policy speed which changes the accel cost.
+  auto addSpeedEvents = [&](const double speed, const double accel, const double policy_speed)->void{
+    if (accel == 0.0) return;
+    if (accel < 0.0 && speed > 0.0) addEvent(-speed/accel, 0.0);
+    addEvent(firstRoot(speed-policy_speed, accel, 0.0), kEventTimeMargin_);
+  };
+
+  // The gap between a follower and its leader closes.
+  auto addGapEvent = [&](const size_t follower, const size_t leader, const double gap)->void{
+    const ConstVehicleView follower_vehicle = snapshot_.vehicle(follower);
+    const ConstVehicleView leader_vehicle = snapshot_.vehicle(leader);
+    addEvent(firstRoot(gap,
+                       leader_vehicle.speed()-follower_vehicle.speed(),
+                       0.5*(acceleration(leader)-acceleration(follower))),
+             kEventTimeMargin_);
+  };
+
+  // Gaps between all agents and their leaders, the ego is checked below.
+  for (size_t slot = 0; slot < agents.size(); ++slot) {
+    const size_t id = agents.ids()[slot];
+    addSpeedEvents(agents.speeds()[slot], agent_accels[slot], agents.policySpeeds()[slot]);
+    const boost::optional<std::pair<size_t, double>> lead =
+      snapshot_.trafficLattice()->front(id);
+    if (lead && lead->first != ego.id()) addGapEvent(id, lead->first, lead->second);
+  }
+
+  // The ego vehicle crosses its policy speed. The stop of the ego vehicle
+  // is handled by \c remainingTime().
+  addEvent(firstRoot(ego.speed()-ego.policySpeed(), ego_accel, 0.0), kEventTimeMargin_);
+
+  // Gaps between the ego and the surrounding vehicles, which determine the
+  // followers considered in the accel cost, and may lead to collisions.
+  const boost::shared_ptr<const TrafficLattice> lattice = snapshot_.trafficLattice();
+  const boost::optional<std::pair<size_t, double>> front = lattice->front(ego.id());
+  const boost::optional<std::pair<size_t, double>> left_front = lattice->leftFront(ego.id());
+  const boost::optional<std::pair<size_t, double>> right_front = lattice->rightFront(ego.id());
+  const boost::optional<std::pair<size_t, double>> back = lattice->back(ego.id());
+  const boost::optional<std::pair<size_t, double>> left_back = lattice->leftBack(ego.id());
+  const boost::optional<std::pair<size_t, double>> right_back = lattice->rightBack(ego.id());
+
+  if (front)       addGapEvent(ego.id(), front->first, front->second);
+  if (left_front)  addGapEvent(ego.id(), left_front->first, left_front->second);
+  if (right_front) addGapEvent(ego.id(), right_front->first, right_front->second);
+  if (back)        addGapEvent(back->first, ego.id(), back->second);
+  if (left_back)   addGapEvent(left_back->first, ego.id(), left_back->second);
+  if (right_back)  addGapEvent(right_back->first, ego.id(), right_back->second);
+
+  for (const auto& follower : {back, left_back, right_back}) {
+    if (!follower) continue;
+    const ConstVehicleView vehicle = snapshot_.vehicle(follower->first);
+    addSpeedEvents(vehicle.speed(), acceleration(follower->first), vehicle.policySpeed());
+  }
+
+  // The ttc of the ego crosses the thresholds of the ttc cost,
+  // i.e. gap = k*ego_speed for k = 1, 2, 3.
+  if (front) {
+    const ConstVehicleView lead = snapshot_.vehicle(front->first);
+    for (const double k : {1.0, 2.0, 3.0}) {
+      addEvent(firstRoot(front->second - k*ego.speed(),
+                         lead.speed() - ego.speed() - k*ego_accel,
+                         0.5*(acceleration(front->first)-ego_accel)),
+               kEventTimeMargin_);
+    }
+  }
+
+  return event_time;
+}
+
+const bool ConstAccelTrafficSimulator::simulate(
+    const ContinuousPath& path, const double default_dt, const double max_time,
+    double& time, double& cost) {
+  CLP_PROFILE_SCOPE("ConstAccelTrafficSimulator::simulate");
+
+  if (!event_driven_) return Base::simulate(path, default_dt, max_time, time, cost);
+
+  // Reset the output to 0.
+  time = 0.0;
+  cost = 0.0;
+
+  // The distance that ego has travelled on the input path.
+  double ego_distance = 0.0;
+
+  // The costs integrated over time.
+  double ttc_cost = 0.0;
+  double brake_cost = 0.0;
+
+  // The accelerations of the agents, reused across iterations.
+  std::vector<double> agent_accels;
+
+  bool ego_done = false;
+  while (time < max_time && !ego_done) {
+
+    const double ego_accel = egoAcceleration();
+    agentAccelerations(agent_accels);
+
+    // Jump to the next event, but not less than the default time step.
+    double dt = nextEventTime(ego_accel, agent_accels);
+    dt = std::max(dt, default_dt);
+    dt = std::min(dt, kMaxEventInterval_);
+
+    // Stop if the ego stops or reaches the end of the path.
+    const double remaining_time = remainingTime(
+        snapshot_.ego().speed(), ego_accel, path.range()-ego_distance);
+    if (dt >= remaining_time) {
+      dt = remaining_time;
+      ego_done = true;
+    }
+    dt = std::min(dt, max_time-time);
+
+    if (!step(path, dt, ego_accel, agent_accels, ego_distance)) return false;
+
+    // The costs at the end of the interval apply to the whole interval.
+    ttc_cost += ttcCost() * dt;
+    brake_cost += accelCost() * dt;
+    time += dt;
+  }
 
-  // Accelerating.
-  if (accel > 0.0) {
-    if (speed < policy_speed) return -1.0;
-    else return 1.0;
+  if (time > 0.0) {
+    ttc_cost /= time;
+    brake_cost /= time;
+  } else {
+    ttc_cost = ttcCost();
+    brake_cost = accelCost();
   }
 
-  // Braking.
-  const int brake_key = static_cast<int>(-accel);
-  if (brake_key < 8) return cost_map[brake_key];
-  else return 16.0;
+  cost = ttc_cost + brake_cost;
+  if (path.laneChangeType() != VehiclePath::LaneChangeType::KeepLane)
+    cost += cost_model_->laneChangeCost();
+
+  return true;
+}
+
+const double ConstAccelTrafficSimulator::accelCost(
+    const double accel, const double speed, const double policy_speed) const {
+  return cost_model_->policyAccelCost(accel, speed, policy_speed);
 }
 
 const double ConstAccelTrafficSimulator::accelCost() const {
@@ -87,105 +242,178 @@ const double ConstAccelTrafficSimulator::accelCost() const {
         snapshot_.vehicle(right_back->first).speed(),
         snapshot_.vehicle(right_back->first).speed());
 
-  return ego_brake_cost + 0.5*agent_brake_cost;
+  return ego_brake_cost + cost_model_->followerAccelCostWeight()*agent_brake_cost;
 }
 
-void Vertex::updateOptimalParent() {
-  // Set the \c optimal_parent_ to an existing parent vertex.
-  // It does not matter which parent is used for now.
-  if (!optimal_parent_) {
-    for (const auto& parent : left_parents_) {
-      if (!parent) continue;
-      optimal_parent_ = parent;
-      break;
-    }
+StateDiscretization::StateDiscretization(
+    const double speed_resolution,
+    const double max_speed,
+    const double time_resolution,
+    const size_t time_buckets) :
+  speed_resolution_(speed_resolution),
+  max_speed_(max_speed),
+  time_resolution_(time_resolution),
+  time_buckets_(time_buckets) {
+
+  if (speed_resolution_ <= 0.0 || max_speed_ <= 0.0 ||
+      time_resolution_ <= 0.0 || time_buckets_ == 0) {
+    std::string error_msg = (boost::format(
+          "StateDiscretization::StateDiscretization(): "
+          "invalid discretization speed resolution:%1% max speed:%2% "
+          "time resolution:%3% time buckets:%4%.\n")
+        % speed_resolution_
+        % max_speed_
+        % time_resolution_
+        % time_buckets_).str();
+    throw std::runtime_error(error_msg);
   }
 
-  if (!optimal_parent_) {
-    for (const auto& parent : back_parents_) {
-      if (!parent) continue;
-      optimal_parent_ = parent;
-      break;
-    }
+  // Tolerate the rounding error if the maximum speed is a multiple of the resolution.
+  speed_buckets_ = static_cast<size_t>(std::ceil(max_speed_/speed_resolution_ - 1.0e-6));
+  return;
+}
+
+boost::optional<size_t> StateDiscretization::bucket(
+    const double speed, const double time) const {
+
+  // Return \c boost::none if the input speed is less than 0 or too large.
+  if (speed < 0.0 || speed >= max_speed_) return boost::none;
+
+  const size_t speed_idx = std::min(
+      static_cast<size_t>(speed/speed_resolution_), speed_buckets_-1);
+  const size_t time_idx = time <= 0.0 ? 0 : std::min(
+      static_cast<size_t>(time/time_resolution_), time_buckets_-1);
+
+  return speed_idx*time_buckets_ + time_idx;
+}
+
+const bool Vertex::dominates(const Parent& a, const Parent& b) {
+  // How much the ego speed falls short of the policy speed, which is
+  // not penalized once the ego drives at the policy speed.
+  auto speedMargin = [](const Parent& parent)->double{
+    const Vehicle& ego = std::get<0>(parent).ego();
+    return std::max(ego.policySpeed()-ego.speed(), 0.0);
+  };
+
+  return std::get<1>(a) <= std::get<1>(b) &&
+         speedMargin(a) <= speedMargin(b) &&
+         std::get<3>(a) <= std::get<3>(b);
+}
+
+const bool Vertex::updateParent(std::vector<Parent>& parents,
+                                Parent&& parent,
+                                std::vector<Snapshot>* released) {
+
+  const boost::shared_ptr<Vertex> parent_vertex = std::get<2>(parent).lock();
+  auto fromParentVertex = [&parent_vertex](const Parent& other)->bool{
+    return std::get<2>(other).lock() == parent_vertex;
+  };
+
+  // Only the cheapest edge from the same parent vertex is kept.
+  for (const auto& other : parents) {
+    if (fromParentVertex(other) && std::get<1>(other) <= std::get<1>(parent))
+      return false;
   }
 
-  if (!optimal_parent_) {
-    for (const auto& parent : right_parents_) {
-      if (!parent) continue;
-      optimal_parent_ = parent;
-      break;
-    }
+  // Discard the parent if any existing parent is at least as good.
+  for (const std::vector<Parent>* others : {&left_parents_, &back_parents_, &right_parents_}) {
+    for (const auto& other : *others)
+      if (dominates(other, parent)) return false;
   }
 
-  if (!optimal_parent_) {
-    throw std::runtime_error(
-        "Vertex::updateOptimalParent(): "
-        "cannot update optimal parent since there is no parent available.\n");
+  // Remove the existing parents which are dominated by the new one.
+  for (std::vector<Parent>* others : {&left_parents_, &back_parents_, &right_parents_}) {
+    removeParents(*others,
+        [&parent](const Parent& other){ return dominates(parent, other); }, released);
   }
+  removeParents(parents, fromParentVertex, released);
+
+  parents.push_back(std::move(parent));
+  updateOptimalParent();
+  return true;
+}
+
+void Vertex::updateOptimalParent() {
 
   // Set the \c optimal_parent_ to the existing parent with the minimum cost-to-come.
   // With the same cost-to-come, the back parent is preferred.
-  for (const auto& parent : left_parents_) {
-    if (!parent) continue;
-    if (std::get<1>(*parent) <= std::get<1>(*optimal_parent_))
-      optimal_parent_ = parent;
-  }
-
-  for (const auto& parent : right_parents_) {
-    if (!parent) continue;
-    if (std::get<1>(*parent) <= std::get<1>(*optimal_parent_))
-      optimal_parent_ = parent;
+  optimal_parent_ = boost::none;
+  for (const std::vector<Parent>* parents : {&left_parents_, &right_parents_, &back_parents_}) {
+    for (const auto& parent : *parents) {
+      if (!optimal_parent_ || std::get<1>(parent) <= std::get<1>(*optimal_parent_))
+        optimal_parent_ = parent;
+    }
   }
 
-  for (const auto& parent : back_parents_) {
-    if (!parent) continue;
-    if (std::get<1>(*parent) <= std::get<1>(*optimal_parent_))
-      optimal_parent_ = parent;
+  if (!optimal_parent_) {
+    throw std::runtime_error(
+        "Vertex::updateOptimalParent(): "
+        "cannot update optimal parent since there is no parent available.\n");
   }
 
-  // Update the snapshot at this vertex to the one reached
-  // from the optimal parent.
+  // Update the snapshot and time at this vertex to the ones
+  // reached from the optimal parent.
   snapshot_ = std::get<0>(*optimal_parent_);
+  time_ = std::get<3>(*optimal_parent_);
 
   return;
 }
 
-void Vertex::updateLeftParent(
+const bool Vertex::updateLeftParent(
     const Snapshot& snapshot,
     const double cost_to_come,
-    const boost::shared_ptr<Vertex>& parent_vertex) {
-  // Figure out which speed interval this vertex belongs to.
-  boost::optional<size_t> idx = speedIntervalIdx(parent_vertex->speed());
-  if (!idx) return;
-
-  left_parents_[*idx] = std::make_tuple(snapshot, cost_to_come, parent_vertex);
-  updateOptimalParent();
-  return;
+    const boost::shared_ptr<Vertex>& parent_vertex,
+    const double time,
+    std::vector<Snapshot>* released) {
+  return updateParent(left_parents_,
+      std::make_tuple(snapshot, cost_to_come, parent_vertex, time), released);
 }
 
-void Vertex::updateBackParent(
+const bool Vertex::updateBackParent(
     const Snapshot& snapshot,
     const double cost_to_come,
-    const boost::shared_ptr<Vertex>& parent_vertex) {
-  // Figure out which speed interval this vertex belongs to.
-  boost::optional<size_t> idx = speedIntervalIdx(parent_vertex->speed());
-  if (!idx) return;
-
-  back_parents_[*idx] = std::make_tuple(snapshot, cost_to_come, parent_vertex);
-  updateOptimalParent();
-  return;
+    const boost::shared_ptr<Vertex>& parent_vertex,
+    const double time,
+    std::vector<Snapshot>* released) {
+  return updateParent(back_parents_,
+      std::make_tuple(snapshot, cost_to_come, parent_vertex, time), released);
 }
 
-void Vertex::updateRightParent(
+const bool Vertex::updateRightParent(
     const Snapshot& snapshot,
     const double cost_to_come,
-    const boost::shared_ptr<Vertex>& parent_vertex) {
-  // Figure out which speed interval this vertex belongs to.
-  boost::optional<size_t> idx = speedIntervalIdx(parent_vertex->speed());
-  if (!idx) return;
+    const boost::shared_ptr<Vertex>& parent_vertex,
+    const double time,
+    std::vector<Snapshot>* released) {
+  return updateParent(right_parents_,
+      std::make_tuple(snapshot, cost_to_come, parent_vertex, time), released);
+}
 
-  right_parents_[*idx] = std::make_tuple(snapshot, cost_to_come, parent_vertex);
-  updateOptimalParent();
+const size_t Vertex::dropSuboptimalParents(std::vector<Snapshot>* released) {
+  if (!optimal_parent_) return 0;
+  const boost::shared_ptr<Vertex> optimal_vertex = std::get<2>(*optimal_parent_).lock();
+  if (!optimal_vertex) return 0;
+
+  // A parent vertex takes at most one entry of the parents.
+  auto suboptimal = [&optimal_vertex](const Parent& parent)->bool{
+    return std::get<2>(parent).lock() != optimal_vertex;
+  };
+
+  size_t dropped = 0;
+  dropped += removeParents(left_parents_, suboptimal, released);
+  dropped += removeParents(back_parents_, suboptimal, released);
+  dropped += removeParents(right_parents_, suboptimal, released);
+  return dropped;
+}
+
+void Vertex::updateChild(std::vector<Child>& children, Child&& child) {
+  const boost::shared_ptr<Vertex> child_vertex = std::get<3>(child).lock();
+  for (auto& other : children) {
+    if (std::get<3>(other).lock() != child_vertex) continue;
+    if (std::get<2>(other) > std::get<2>(child)) other = std::move(child);
+    return;
+  }
+  children.push_back(std::move(child));
   return;
 }
 
@@ -194,14 +422,8 @@ void Vertex::updateLeftChild(
     const double acceleration,
     const double stage_cost,
     const boost::shared_ptr<Vertex>& child_vertex) {
-  // Figure out which speed interval this vertex belongs to.
-  boost::optional<size_t> idx = speedIntervalIdx(child_vertex->speed());
-  if (!idx) return;
-
-  if (!(left_children_[*idx]) ||
-      std::get<2>(*(left_children_[*idx])) > stage_cost)
-    left_children_[*idx] = std::make_tuple(path, acceleration, stage_cost, child_vertex);
-
+  updateChild(left_children_,
+      std::make_tuple(path, acceleration, stage_cost, child_vertex));
   return;
 }
 
@@ -210,13 +432,8 @@ void Vertex::updateFrontChild(
     const double acceleration,
     const double stage_cost,
     const boost::shared_ptr<Vertex>& child_vertex) {
-  // Figure out which speed interval this vertex belongs to.
-  boost::optional<size_t> idx = speedIntervalIdx(child_vertex->speed());
-  if (!idx) return;
-
-  if (!(front_children_[*idx]) ||
-      std::get<2>(*(front_children_[*idx])) > stage_cost)
-    front_children_[*idx] = std::make_tuple(path, acceleration, stage_cost, child_vertex);
+  updateChild(front_children_,
+      std::make_tuple(path, acceleration, stage_cost, child_vertex));
   return;
 }
 
@@ -225,49 +442,45 @@ void Vertex::updateRightChild(
     const double acceleration,
     const double stage_cost,
     const boost::shared_ptr<Vertex>& child_vertex) {
-  // Figure out which speed interval this vertex belongs to.
-  boost::optional<size_t> idx = speedIntervalIdx(child_vertex->speed());
-  if (!idx) return;
-
-  if (!(right_children_[*idx]) ||
-      std::get<2>(*(right_children_[*idx])) > stage_cost)
-    right_children_[*idx] = std::make_tuple(path, acceleration, stage_cost, child_vertex);
+  updateChild(right_children_,
+      std::make_tuple(path, acceleration, stage_cost, child_vertex));
   return;
 }
 
 std::string Vertex::string(const std::string& prefix) const {
   std::string output = prefix;
   output += "node id: " + std::to_string(node_.lock()->id()) + "\n";
+  output += "time: " + std::to_string(time_) + "\n";
   output += "snapshot: \n" + snapshot_.string();
 
   // Output the parents.
-  boost::format parent_format("node id:%1% ego speed:%2% cost to come:%3%\n");
+  boost::format parent_format("node id:%1% ego speed:%2% cost to come:%3% time:%4%\n");
 
   //std::printf("Get left parents.\n");
   output += std::string("left parents #: ") + std::to_string(leftParentsSize()) + "\n";
   for (const auto& parent : left_parents_) {
-    if (!parent) continue;
-    output += (parent_format % std::get<2>(*parent).lock()->node().lock()->id()
-                             % std::get<2>(*parent).lock()->speed()
-                             % std::get<1>(*parent)).str();
+    output += (parent_format % std::get<2>(parent).lock()->node().lock()->id()
+                             % std::get<2>(parent).lock()->speed()
+                             % std::get<1>(parent)
+                             % std::get<3>(parent)).str();
   }
 
   //std::printf("Get back parents.\n");
   output += std::string("back parents #: ") + std::to_string(backParentsSize()) + "\n";
   for (const auto& parent : back_parents_) {
-    if (!parent) continue;
-    output += (parent_format % std::get<2>(*parent).lock()->node().lock()->id()
-                             % std::get<2>(*parent).lock()->speed()
-                             % std::get<1>(*parent)).str();
+    output += (parent_format % std::get<2>(parent).lock()->node().lock()->id()
+                             % std::get<2>(parent).lock()->speed()
+                             % std::get<1>(parent)
+                             % std::get<3>(parent)).str();
   }
 
   //std::printf("Get right parents.\n");
   output += std::string("right parents #: ") + std::to_string(rightParentsSize()) + "\n";
   for (const auto& parent : right_parents_) {
-    if (!parent) continue;
-    output += (parent_format % std::get<2>(*parent).lock()->node().lock()->id()
-                             % std::get<2>(*parent).lock()->speed()
-                             % std::get<1>(*parent)).str();
+    output += (parent_format % std::get<2>(parent).lock()->node().lock()->id()
+                             % std::get<2>(parent).lock()->speed()
+                             % std::get<1>(parent)
+                             % std::get<3>(parent)).str();
   }
 
   //std::printf("Get the optimal parent.\n");
@@ -275,7 +488,8 @@ std::string Vertex::string(const std::string& prefix) const {
   if (optimal_parent_)
     output += (parent_format % std::get<2>(*optimal_parent_).lock()->node().lock()->id()
                              % std::get<2>(*optimal_parent_).lock()->speed()
-                             % std::get<1>(*optimal_parent_)).str();
+                             % std::get<1>(*optimal_parent_)
+                             % std::get<3>(*optimal_parent_)).str();
   else output += "\n";
 
   // Output the children.
@@ -285,34 +499,31 @@ std::string Vertex::string(const std::string& prefix) const {
   //std::printf("Get left children.\n");
   output += std::string("left children #: ") + std::to_string(leftChildrenSize()) + "\n";
   for (const auto& child : left_children_) {
-    if (!child) continue;
-    output += (child_format % std::get<3>(*child).lock()->node().lock()->id()
-                           % std::get<3>(*child).lock()->speed()
-                           % std::get<1>(*child)
-                           % std::get<0>(*child).range()
-                           % std::get<2>(*child)).str();
+    output += (child_format % std::get<3>(child).lock()->node().lock()->id()
+                           % std::get<3>(child).lock()->speed()
+                           % std::get<1>(child)
+                           % std::get<0>(child).range()
+                           % std::get<2>(child)).str();
   }
 
   //std::printf("Get front children.\n");
   output += std::string("front children #: ") + std::to_string(frontChildrenSize()) + "\n";
   for (const auto& child : front_children_) {
-    if (!child) continue;
-    output += (child_format % std::get<3>(*child).lock()->node().lock()->id()
-                           % std::get<3>(*child).lock()->speed()
-                           % std::get<1>(*child)
-                           % std::get<0>(*child).range()
-                           % std::get<2>(*child)).str();
+    output += (child_format % std::get<3>(child).lock()->node().lock()->id()
+                           % std::get<3>(child).lock()->speed()
+                           % std::get<1>(child)
+                           % std::get<0>(child).range()
+                           % std::get<2>(child)).str();
   }
 
   //std::printf("Get right children.\n");
   output += std::string("right children #: ") + std::to_string(rightChildrenSize()) + "\n";
   for (const auto& child : right_children_) {
-    if (!child) continue;
-    output += (child_format % std::get<3>(*child).lock()->node().lock()->id()
-                           % std::get<3>(*child).lock()->speed()
-                           % std::get<1>(*child)
-                           % std::get<0>(*child).range()
-                           % std::get<2>(*child)).str();
+    output += (child_format % std::get<3>(child).lock()->node().lock()->id()
+                           % std::get<3>(child).lock()->speed()
+                           % std::get<1>(child)
+                           % std::get<0>(child).range()
+                           % std::get<2>(child)).str();
   }
 
   return output;
@@ -348,7 +559,7 @@ std::vector<ContinuousPath> SpatiotemporalLatticePlanner::edges() const {
       boost::shared_ptr<const WaypointNode> node = vertex->node().lock();
 
       // Paths to left children.
-      for (const auto& child : vertex->validLeftChildren()) {
+      for (const auto& child : vertex->leftChildren()) {
         boost::shared_ptr<const WaypointNode> child_node = std::get<3>(child).lock()->node().lock();
 
         size_t path_id = 0;
@@ -360,7 +571,7 @@ std::vector<ContinuousPath> SpatiotemporalLatticePlanner::edges() const {
       }
 
       // Paths to front children.
-      for (const auto& child : vertex->validFrontChildren()) {
+      for (const auto& child : vertex->frontChildren()) {
         boost::shared_ptr<const WaypointNode> child_node = std::get<3>(child).lock()->node().lock();
 
         size_t path_id = 0;
@@ -372,7 +583,7 @@ std::vector<ContinuousPath> SpatiotemporalLatticePlanner::edges() const {
       }
 
       // Paths to right children.
-      for (const auto& child : vertex->validRightChildren()) {
+      for (const auto& child : vertex->rightChildren()) {
         boost::shared_ptr<const WaypointNode> child_node = std::get<3>(child).lock()->node().lock();
 
         size_t path_id = 0;
@@ -412,18 +623,19 @@ bool SpatiotemporalLatticePlanner::immediateNextVertexReached(
 }
 
 void SpatiotemporalLatticePlanner::updateWaypointLattice(const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("SpatiotemporalLatticePlanner::updateWaypointLattice");
 
   //std::printf("SpatiotemporalLatticePlanner::updateWaypointLattice()\n");
 
   // If the waypoint lattice has not been initialized, a new one is created with
   // the start waypoint as where the ego currently is. Meanwhile, the range of
-  // the lattice is set to the spatial horizon. The resolution is hardcoded as 1.0m.
+  // the lattice is set to the spatial horizon. The resolution is \c lattice_resolution_.
   if (!waypoint_lattice_) {
     //std::printf("Create new waypoint lattice.\n");
     boost::shared_ptr<CarlaWaypoint> ego_waypoint =
       fast_map_->waypoint(snapshot.ego().transform().location);
     waypoint_lattice_ = boost::make_shared<WaypointLattice>(
-        ego_waypoint, spatial_horizon_+30.0, 1.0, router_);
+        ego_waypoint, spatial_horizon_+30.0, lattice_resolution_, router_);
     return;
   }
 
@@ -448,6 +660,7 @@ void SpatiotemporalLatticePlanner::updateWaypointLattice(const Snapshot& snapsho
 std::list<std::pair<ContinuousPath, double>>
   SpatiotemporalLatticePlanner::planTraj(
     const size_t ego, const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("SpatiotemporalLatticePlanner::planTraj");
 
   //std::printf("SpatiotemporalLatticePlanner::planTraj()\n");
 
@@ -462,6 +675,15 @@ std::list<std::pair<ContinuousPath, double>>
     throw std::runtime_error(error_msg + id_msg);
   }
 
+  // Forget the simulations which are not reused in the last cycle.
+  nextRolloutCycle();
+
+  // The graph objects of this cycle are created in a new arena.
+  resetGraphArena();
+  edge_screening_.reset();
+  graph_memory_.reset(graph_arena_);
+  memory_capped_ = false;
+
   // Update the waypoint lattice.
   updateWaypointLattice(snapshot);
 
@@ -480,7 +702,21 @@ std::list<std::pair<ContinuousPath, double>>
   }
 
   // Construct the vertex graph.
-  constructVertexGraph(vertex_queue);
+  expanded_vertices_ = 0;
+  pruned_vertices_ = 0;
+  truncated_ = false;
+  if (branch_and_bound_) branchAndBoundVertexGraph(vertex_queue);
+  else constructVertexGraph(vertex_queue);
+
+  // Report the memory of the graph together with the time breakdown.
+  CLP_PROFILE_COUNT("SpatiotemporalLatticePlanner::graphVertices",
+      static_cast<int64_t>(verticesSize()));
+  CLP_PROFILE_COUNT("SpatiotemporalLatticePlanner::graphSnapshots",
+      static_cast<int64_t>(graph_memory_.snapshots()));
+  CLP_PROFILE_COUNT("SpatiotemporalLatticePlanner::graphBytes",
+      static_cast<int64_t>(graph_memory_.bytes()));
+  CLP_PROFILE_COUNT("SpatiotemporalLatticePlanner::peakGraphBytes",
+      static_cast<int64_t>(graph_memory_.peakBytes()));
 
   // Select the optimal trajectory sequence from the graph.
   std::list<std::pair<ContinuousPath, double>> optimal_traj_seq;
@@ -496,6 +732,7 @@ std::list<std::pair<ContinuousPath, double>>
 
 DiscretePath SpatiotemporalLatticePlanner::planPath(
     const size_t ego, const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("SpatiotemporalLatticePlanner::planPath");
 
   //std::printf("SpatiotemporalLatticePlanner::planPath()\n");
 
@@ -517,6 +754,7 @@ DiscretePath SpatiotemporalLatticePlanner::planPath(
 std::deque<boost::shared_ptr<Vertex>>
   SpatiotemporalLatticePlanner::pruneVertexGraph(
     const Snapshot& snapshot) {
+  CLP_PROFILE_SCOPE("SpatiotemporalLatticePlanner::pruneVertexGraph");
 
   //std::printf("SpatiotemporalLatticePlanner::pruneVertexGraph()\n");
 
@@ -532,7 +770,7 @@ std::deque<boost::shared_ptr<Vertex>>
 
     // Initialize the new root station.
     boost::shared_ptr<Vertex> root =
-      boost::make_shared<Vertex>(snapshot, waypoint_lattice_, fast_map_);
+      makeGraphObject<Vertex>(snapshot, waypoint_lattice_, fast_map_);
     addVertexToTable(root);
     root_ = root;
 
@@ -546,7 +784,7 @@ std::deque<boost::shared_ptr<Vertex>>
 
   // Create the new root station.
   boost::shared_ptr<Vertex> new_root =
-    boost::make_shared<Vertex>(snapshot, waypoint_lattice_, fast_map_);
+    makeGraphObject<Vertex>(snapshot, waypoint_lattice_, fast_map_);
 
   // Find the immedidate waypoint nodes.
   boost::shared_ptr<const WaypointNode> next_node = cached_next_vertex_.lock()->node().lock();
@@ -599,18 +837,158 @@ std::deque<boost::shared_ptr<Vertex>>
   return vertex_queue;
 }
 
+const bool SpatiotemporalLatticePlanner::withinMemoryCap() {
+  if (!graph_memory_.exceeded()) return true;
+
+  // The suboptimal parents have been dropped since the cap was exceeded
+  // the first time, so there is nothing left to be released.
+  if (memory_capped_) return false;
+  memory_capped_ = true;
+
+  // Keep only the optimal parents, and release the snapshots of the others.
+  size_t dropped = 0;
+  std::vector<Snapshot> released;
+  for (const auto& item : node_to_vertices_table_) {
+    for (const auto& vertex : item.second) {
+      if (!vertex) continue;
+      dropped += vertex->dropSuboptimalParents(&released);
+    }
+  }
+  for (const Snapshot& snapshot : released) graph_memory_.removeSnapshot(snapshot);
+  CLP_PROFILE_COUNT("SpatiotemporalLatticePlanner::droppedParents", dropped);
+
+  return !graph_memory_.exceeded();
+}
+
+void SpatiotemporalLatticePlanner::countNewParent(
+    const boost::shared_ptr<Vertex>& vertex,
+    const Snapshot& snapshot,
+    std::vector<Snapshot>& released) {
+  // Once the memory is capped, only the optimal parents are kept.
+  graph_memory_.addSnapshot(snapshot);
+  if (memory_capped_) vertex->dropSuboptimalParents(&released);
+  for (const Snapshot& released_snapshot : released)
+    graph_memory_.removeSnapshot(released_snapshot);
+  return;
+}
+
 void SpatiotemporalLatticePlanner::constructVertexGraph(
     std::deque<boost::shared_ptr<Vertex>>& vertex_queue) {
+  CLP_PROFILE_SCOPE("SpatiotemporalLatticePlanner::constructVertexGraph");
 
   //std::printf("SpatiotemporalLatticePlanner::constructVertexGraph()\n");
 
-  auto addVerticesToTableAndQueue = [this, &vertex_queue](
+  std::vector<boost::shared_ptr<Vertex>> open_vertices;
+  std::vector<boost::shared_ptr<Vertex>> terminal_vertices;
+
+  while (!vertex_queue.empty()) {
+    if (!deadline_.allowsNextStep() || !withinMemoryCap()) {
+      truncated_ = true;
+      break;
+    }
+
+    // Get the next vertex to expand.
+    boost::shared_ptr<Vertex> vertex = vertex_queue.front();
+    vertex_queue.pop_front();
+
+    deadline_.startStep();
+    expandVertex(vertex, open_vertices, terminal_vertices);
+    for (const auto& open_vertex : open_vertices) vertex_queue.push_back(open_vertex);
+    deadline_.finishStep();
+  }
+
+  return;
+}
+
+void SpatiotemporalLatticePlanner::branchAndBoundVertexGraph(
+    std::deque<boost::shared_ptr<Vertex>>& vertex_queue) {
+  CLP_PROFILE_SCOPE("SpatiotemporalLatticePlanner::branchAndBoundVertexGraph");
+
+  // The vertices to be expanded, ordered by the lower bound of the terminal cost,
+  // and then by the order they are found in.
+  using Entry = std::tuple<double, size_t, boost::shared_ptr<Vertex>>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open_queue;
+  size_t sequence = 0;
+
+  for (const auto& vertex : vertex_queue)
+    open_queue.emplace(terminalCostLowerBound(vertex), sequence++, vertex);
+  vertex_queue.clear();
+
+  // The minimum terminal cost found so far.
+  double incumbent = std::numeric_limits<double>::infinity();
+  auto updateIncumbent = [this, &incumbent](const boost::shared_ptr<Vertex>& vertex)->void{
+    // The root vertex cannot be a valid terminal.
+    if (!vertex->hasParents() || vertex->hasChildren()) return;
+    incumbent = std::min(incumbent, costFromRootToTerminal(vertex));
+  };
+
+  std::vector<boost::shared_ptr<Vertex>> open_vertices;
+  std::vector<boost::shared_ptr<Vertex>> terminal_vertices;
+  bool refreshed = false;
+
+  while (!open_queue.empty()) {
+    if (!deadline_.allowsNextStep() || !withinMemoryCap()) {
+      truncated_ = true;
+      break;
+    }
+
+    boost::shared_ptr<Vertex> vertex = std::get<2>(open_queue.top());
+    const double lower_bound = terminalCostLowerBound(vertex);
+
+    if (lower_bound > incumbent) {
+      // The cost-to-come of a queued vertex may have decreased since it was
+      // queued, if a cheaper parent is found later. Refresh the bounds once
+      // before concluding that all the remaining vertices can be pruned.
+      if (refreshed) break;
+      std::vector<Entry> entries;
+      entries.reserve(open_queue.size());
+      while (!open_queue.empty()) {
+        const boost::shared_ptr<Vertex> queued_vertex = std::get<2>(open_queue.top());
+        entries.emplace_back(terminalCostLowerBound(queued_vertex),
+                             std::get<1>(open_queue.top()), queued_vertex);
+        open_queue.pop();
+      }
+      for (auto& entry : entries) open_queue.push(std::move(entry));
+      refreshed = true;
+      continue;
+    }
+
+    open_queue.pop();
+    refreshed = false;
+
+    deadline_.startStep();
+    expandVertex(vertex, open_vertices, terminal_vertices);
+    for (const auto& open_vertex : open_vertices)
+      open_queue.emplace(terminalCostLowerBound(open_vertex), sequence++, open_vertex);
+    for (const auto& terminal_vertex : terminal_vertices)
+      updateIncumbent(terminal_vertex);
+    updateIncumbent(vertex);
+    deadline_.finishStep();
+  }
+
+  // The remaining vertices stay in the graph as terminals. They are only
+  // counted as pruned if the search is not truncated by the deadline.
+  if (!truncated_) pruned_vertices_ = open_queue.size();
+  return;
+}
+
+void SpatiotemporalLatticePlanner::expandVertex(
+    const boost::shared_ptr<Vertex>& vertex,
+    std::vector<boost::shared_ptr<Vertex>>& open_vertices,
+    std::vector<boost::shared_ptr<Vertex>>& terminal_vertices) {
+  CLP_PROFILE_COUNT("SpatiotemporalLatticePlanner::expandVertex", 1);
+
+  open_vertices.clear();
+  terminal_vertices.clear();
+  ++expanded_vertices_;
+
+  auto addVerticesToTable = [this, &open_vertices, &terminal_vertices](
       const std::vector<boost::shared_ptr<Vertex>>& vertices,
       const boost::shared_ptr<const WaypointNode>& node)->void{
 
     if (vertices.size()==0 || (!node)) return;
 
-    // Try to add the new vertices to the table and queue.
+    // Try to add the new vertices to the table.
     for (const auto& vertex : vertices) {
       // The vertex already exists in the table.
       // Therefore, we don't have to add it to the table or the queue.
@@ -620,39 +998,35 @@ void SpatiotemporalLatticePlanner::constructVertexGraph(
       // add the vertex to the queue and table in order to expand later.
       addVertexToTable(vertex);
       if (vertex->node().lock()->id() == node->id())
-        vertex_queue.push_back(vertex);
+        open_vertices.push_back(vertex);
+      else
+        terminal_vertices.push_back(vertex);
     }
   };
 
-  while (!vertex_queue.empty()) {
-    // Get the next vertex to expand.
-    boost::shared_ptr<Vertex> vertex = vertex_queue.front();
-    vertex_queue.pop_front();
-
-    // Try to connect to the front node.
-    boost::shared_ptr<const WaypointNode> front_node =
-      waypoint_lattice_->front(vertex->node().lock()->waypoint(), 50.0);
-    std::vector<boost::shared_ptr<Vertex>> front_vertices =
-      connectVertexToFrontNode(vertex, front_node);
+  // Try to connect to the front node.
+  boost::shared_ptr<const WaypointNode> front_node =
+    waypoint_lattice_->front(vertex->node().lock()->waypoint(), kStationInterval_);
+  std::vector<boost::shared_ptr<Vertex>> front_vertices =
+    connectVertexToFrontNode(vertex, front_node);
 
-    addVerticesToTableAndQueue(front_vertices, front_node);
+  addVerticesToTable(front_vertices, front_node);
 
-    // Try to connect to the left front node.
-    boost::shared_ptr<const WaypointNode> left_front_node =
-      waypoint_lattice_->leftFront(vertex->node().lock()->waypoint(), 50.0);
-    std::vector<boost::shared_ptr<Vertex>> left_front_vertices =
-      connectVertexToLeftFrontNode(vertex, left_front_node);
+  // Try to connect to the left front node.
+  boost::shared_ptr<const WaypointNode> left_front_node =
+    waypoint_lattice_->leftFront(vertex->node().lock()->waypoint(), kStationInterval_);
+  std::vector<boost::shared_ptr<Vertex>> left_front_vertices =
+    connectVertexToLeftFrontNode(vertex, left_front_node);
 
-    addVerticesToTableAndQueue(left_front_vertices, left_front_node);
+  addVerticesToTable(left_front_vertices, left_front_node);
 
-    // Try to connect to the right front node.
-    boost::shared_ptr<const WaypointNode> right_front_node =
-      waypoint_lattice_->rightFront(vertex->node().lock()->waypoint(), 50.0);
-    std::vector<boost::shared_ptr<Vertex>> right_front_vertices =
-      connectVertexToRightFrontNode(vertex, right_front_node);
+  // Try to connect to the right front node.
+  boost::shared_ptr<const WaypointNode> right_front_node =
+    waypoint_lattice_->rightFront(vertex->node().lock()->waypoint(), kStationInterval_);
+  std::vector<boost::shared_ptr<Vertex>> right_front_vertices =
+    connectVertexToRightFrontNode(vertex, right_front_node);
 
-    addVerticesToTableAndQueue(right_front_vertices, right_front_node);
-  }
+  addVerticesToTable(right_front_vertices, right_front_node);
 
   return;
 }
@@ -664,21 +1038,23 @@ std::vector<boost::shared_ptr<Vertex>>
 
   //std::printf("SpatiotemporalLatticePlanner::connectVertexToFrontNode()\n");
 
-  // Stores the expanded front children of the input vertex.
-  std::array<boost::shared_ptr<Vertex>, Vertex::kSpeedIntervalsPerStation_.size()>
-    front_children;
-
   // Return directly if the target node does not exist.
   if (!target_node) return std::vector<boost::shared_ptr<Vertex>>();
 
+  // Reject the edge, or some of its acceleration options, by the cheap
+  // checks before the path is optimized and the traffic is simulated.
+  std::array<bool, kAccelerationOptions_.size()> options;
+  if (!screenEdge(vertex, target_node, ContinuousPath::LaneChangeType::KeepLane, options))
+    return std::vector<boost::shared_ptr<Vertex>>();
+
   // Plan a path between the node at the current vertex to the target node.
   boost::shared_ptr<ContinuousPath> path = nullptr;
   try {
-    path = boost::make_shared<ContinuousPath>(
+    path = path_cache_->path(
         std::make_pair(vertex->snapshot().ego().transform(),
                        vertex->snapshot().ego().curvature()),
         std::make_pair(target_node->waypoint()->GetTransform(),
-                       target_node->curvature(map_)),
+                       fast_map_->curvature(target_node->waypoint())),
         ContinuousPath::LaneChangeType::KeepLane);
   } catch (std::exception& e) {
     // If for whatever reason, the path cannot be created, the front vertices
@@ -689,31 +1065,22 @@ std::vector<boost::shared_ptr<Vertex>>
 
   // Simulate the traffic forward with the ego applying different constant
   // accelerations over the path created above.
-  for (const double accel : kAccelerationOptions_) {
-    // Prepare the start snapshot.
-    // The acceleration of the ego is set accordingly.
-    Snapshot snapshot = vertex->snapshot();
-    snapshot.ego().acceleration() = accel;
-
-    ConstAccelTrafficSimulator simulator(snapshot, map_, fast_map_);
-    double simulation_time = 0.0; double stage_cost = 0.0;
-
-    try {
-      const bool no_collision = simulator.simulate(
-          *path, sim_time_step_, 5.0, simulation_time, stage_cost);
-      // Continue if this acceleration option leads to collision.
-      if (!no_collision) continue;
-    } catch (std::exception& e) {
-      std::printf("SpatiotemporalLatticePlanner::connectVertexToFrontNode(): WARNING\n"
-                  "%s", e.what());
-      continue;
-    }
-
-    // Create a new vertex using the end snapshot of the simulation.
-    boost::shared_ptr<Vertex> next_vertex = boost::make_shared<Vertex>(
-        simulator.snapshot(), waypoint_lattice_, fast_map_);
-
-    // Check if a similar vertex (close in ego velocity) has already been created.
+  std::array<double, kAccelerationOptions_.size()> stage_costs;
+  const std::array<boost::shared_ptr<Vertex>, kAccelerationOptions_.size()>
+    rollout_vertices = simulateAccelerationOptions(
+        vertex, *path, target_node, 0, options, "connectVertexToFrontNode", stage_costs);
+
+  // Merge the simulation results into the graph in the order of the options.
+  for (size_t k = 0; k < kAccelerationOptions_.size(); ++k) {
+    // Continue if this acceleration option leads to collision.
+    if (!rollout_vertices[k]) continue;
+    const double accel = kAccelerationOptions_[k];
+    const double stage_cost = stage_costs[k];
+    const Snapshot end_snapshot = rollout_vertices[k]->snapshot();
+    const double end_time = rollout_vertices[k]->time();
+    boost::shared_ptr<Vertex> next_vertex = rollout_vertices[k];
+
+    // Check if a similar vertex (in the same state bucket) has already been created.
     // If so, the \c next_vertex is replaced with the existing one in the table.
     boost::shared_ptr<Vertex> similar_vertex = findVertexInTable(next_vertex);
     if (similar_vertex) next_vertex = similar_vertex;
@@ -726,30 +1093,20 @@ std::vector<boost::shared_ptr<Vertex>>
     // Update the child of the parent vertex.
     vertex->updateFrontChild(*path, accel, stage_cost, next_vertex);
 
-    // Update the parent vertex of the child.
-    if (vertex->hasParents()) {
-      next_vertex->updateBackParent(
-          simulator.snapshot(), vertex->costToCome()+stage_cost, vertex);
-    } else {
-      next_vertex->updateBackParent(
-          simulator.snapshot(), stage_cost, vertex);
-    }
-
-    // Set the front vertices that are connected with this vertex.
-    auto children = vertex->frontChildren();
-    for (size_t i = 0; i < Vertex::kSpeedIntervalsPerStation_.size(); ++i) {
-      if (!(children[i])) continue;
-      front_children[i] = std::get<3>(*(children[i])).lock();
-    }
+    // Update the parent vertex of the child. The end snapshot is only
+    // stored if the parent is not dominated by the existing ones.
+    const double cost_to_come = vertex->hasParents() ?
+      vertex->costToCome()+stage_cost : stage_cost;
+    std::vector<Snapshot> released;
+    if (next_vertex->updateBackParent(end_snapshot, cost_to_come, vertex, end_time, &released))
+      countNewParent(next_vertex, end_snapshot, released);
 
   } // End for loop for different acceleration options.
 
   // Collect all the front child vertices of the input vertex.
   std::vector<boost::shared_ptr<Vertex>> output_vertices;
-  for (const auto& child : front_children) {
-    if (!child) continue;
-    output_vertices.push_back(child);
-  }
+  for (const auto& child : vertex->frontChildren())
+    output_vertices.push_back(std::get<3>(child).lock());
 
   return output_vertices;
 }
@@ -761,10 +1118,6 @@ std::vector<boost::shared_ptr<Vertex>>
 
   //std::printf("SpatiotemporalLatticePlanner::connectVertexToLeftFrontNode()\n");
 
-  // Stores the expanded left front children of the input vertex.
-  std::array<boost::shared_ptr<Vertex>, Vertex::kSpeedIntervalsPerStation_.size()>
-    left_children;
-
   // Return directly if the target node does not exist.
   if (!target_node) return std::vector<boost::shared_ptr<Vertex>>();
 
@@ -797,14 +1150,20 @@ std::vector<boost::shared_ptr<Vertex>>
   if (left_back && left_back->second <= 0.0)
     return std::vector<boost::shared_ptr<Vertex>>();
 
+  // Reject the edge, or some of its acceleration options, by the cheap
+  // checks before the path is optimized and the traffic is simulated.
+  std::array<bool, kAccelerationOptions_.size()> options;
+  if (!screenEdge(vertex, target_node, ContinuousPath::LaneChangeType::LeftLaneChange, options))
+    return std::vector<boost::shared_ptr<Vertex>>();
+
   // Plan a path between the node at the current vertex to the target node.
   boost::shared_ptr<ContinuousPath> path = nullptr;
   try {
-    path = boost::make_shared<ContinuousPath>(
+    path = path_cache_->path(
         std::make_pair(vertex->snapshot().ego().transform(),
                        vertex->snapshot().ego().curvature()),
         std::make_pair(target_node->waypoint()->GetTransform(),
-                       target_node->curvature(map_)),
+                       fast_map_->curvature(target_node->waypoint())),
         ContinuousPath::LaneChangeType::LeftLaneChange);
   } catch (std::exception& e) {
     // If for whatever reason, the path cannot be created, the front vertices
@@ -815,31 +1174,22 @@ std::vector<boost::shared_ptr<Vertex>>
 
   // Simulate the traffic forward with the ego applying different constant
   // accelerations over the path created above.
-  for (const double accel : kAccelerationOptions_) {
-    // Prepare the start snapshot.
-    // The acceleration of the ego is set accordingly.
-    Snapshot snapshot = vertex->snapshot();
-    snapshot.ego().acceleration() = accel;
-
-    ConstAccelTrafficSimulator simulator(snapshot, map_, fast_map_);
-    double simulation_time = 0.0; double stage_cost = 0.0;
-
-    try {
-      const bool no_collision = simulator.simulate(
-          *path, sim_time_step_, 5.0, simulation_time, stage_cost);
-      // Continue if this acceleration option leads to collision.
-      if (!no_collision) continue;
-    } catch (std::exception& e) {
-      std::printf("SpatiotemporalLatticePlanner::connectVertexToLeftFrontNode(): WARNING\n"
-                  "%s", e.what());
-      continue;
-    }
-
-    // Create a new vertex using the end snapshot of the simulation.
-    boost::shared_ptr<Vertex> next_vertex = boost::make_shared<Vertex>(
-        simulator.snapshot(), waypoint_lattice_, fast_map_);
-
-    // Check if a similar vertex (close in ego velocity) has already been created.
+  std::array<double, kAccelerationOptions_.size()> stage_costs;
+  const std::array<boost::shared_ptr<Vertex>, kAccelerationOptions_.size()>
+    rollout_vertices = simulateAccelerationOptions(
+        vertex, *path, target_node, 1, options, "connectVertexToLeftFrontNode", stage_costs);
+
+  // Merge the simulation results into the graph in the order of the options.
+  for (size_t k = 0; k < kAccelerationOptions_.size(); ++k) {
+    // Continue if this acceleration option leads to collision.
+    if (!rollout_vertices[k]) continue;
+    const double accel = kAccelerationOptions_[k];
+    const double stage_cost = stage_costs[k];
+    const Snapshot end_snapshot = rollout_vertices[k]->snapshot();
+    const double end_time = rollout_vertices[k]->time();
+    boost::shared_ptr<Vertex> next_vertex = rollout_vertices[k];
+
+    // Check if a similar vertex (in the same state bucket) has already been created.
     // If so, the \c next_vertex is replaced with the existing one in the table.
     boost::shared_ptr<Vertex> similar_vertex = findVertexInTable(next_vertex);
     if (similar_vertex) next_vertex = similar_vertex;
@@ -852,29 +1202,19 @@ std::vector<boost::shared_ptr<Vertex>>
     // Update the child of the parent vertex.
     vertex->updateLeftChild(*path, accel, stage_cost, next_vertex);
 
-    // Update the parent vertex of the child.
-    if (vertex->hasParents()) {
-      next_vertex->updateRightParent(
-          simulator.snapshot(), vertex->costToCome()+stage_cost, vertex);
-    } else {
-      next_vertex->updateRightParent(
-          simulator.snapshot(), stage_cost, vertex);
-    }
-
-    // Set the left front vertices that are connected with this vertex.
-    auto children = vertex->leftChildren();
-    for (size_t i = 0; i < Vertex::kSpeedIntervalsPerStation_.size(); ++i) {
-      if (!(children[i])) continue;
-      left_children[i] = std::get<3>(*(children[i])).lock();
-    }
+    // Update the parent vertex of the child. The end snapshot is only
+    // stored if the parent is not dominated by the existing ones.
+    const double cost_to_come = vertex->hasParents() ?
+      vertex->costToCome()+stage_cost : stage_cost;
+    std::vector<Snapshot> released;
+    if (next_vertex->updateRightParent(end_snapshot, cost_to_come, vertex, end_time, &released))
+      countNewParent(next_vertex, end_snapshot, released);
   } // End for loop for different acceleration options.
 
   // Collect all the left child vertices of the input vertex.
   std::vector<boost::shared_ptr<Vertex>> output_vertices;
-  for (const auto& child : left_children) {
-    if (!child) continue;
-    output_vertices.push_back(child);
-  }
+  for (const auto& child : vertex->leftChildren())
+    output_vertices.push_back(std::get<3>(child).lock());
 
   return output_vertices;
 }
@@ -886,10 +1226,6 @@ std::vector<boost::shared_ptr<Vertex>>
 
   //std::printf("SpatiotemporalLatticePlanner::connectVertexToRightFrontNode()\n");
 
-  // Stores the expanded right front children of the input vertex.
-  std::array<boost::shared_ptr<Vertex>, Vertex::kSpeedIntervalsPerStation_.size()>
-    right_children;
-
   // Return directly if the target node does not exist.
   if (!target_node) return std::vector<boost::shared_ptr<Vertex>>();
 
@@ -922,14 +1258,20 @@ std::vector<boost::shared_ptr<Vertex>>
   if (right_back && right_back->second <= 0.0)
     return std::vector<boost::shared_ptr<Vertex>>();
 
+  // Reject the edge, or some of its acceleration options, by the cheap
+  // checks before the path is optimized and the traffic is simulated.
+  std::array<bool, kAccelerationOptions_.size()> options;
+  if (!screenEdge(vertex, target_node, ContinuousPath::LaneChangeType::RightLaneChange, options))
+    return std::vector<boost::shared_ptr<Vertex>>();
+
   // Plan a path between the node at the current vertex to the target node.
   boost::shared_ptr<ContinuousPath> path = nullptr;
   try {
-    path = boost::make_shared<ContinuousPath>(
+    path = path_cache_->path(
         std::make_pair(vertex->snapshot().ego().transform(),
                        vertex->snapshot().ego().curvature()),
         std::make_pair(target_node->waypoint()->GetTransform(),
-                       target_node->curvature(map_)),
+                       fast_map_->curvature(target_node->waypoint())),
         ContinuousPath::LaneChangeType::RightLaneChange);
   } catch (std::exception& e) {
     // If for whatever reason, the path cannot be created, the front vertices
@@ -940,31 +1282,22 @@ std::vector<boost::shared_ptr<Vertex>>
 
   // Simulate the traffic forward with the ego applying different constant
   // accelerations over the path created above.
-  for (const double accel : kAccelerationOptions_) {
-    // Prepare the start snapshot.
-    // The acceleration of the ego is set accordingly.
-    Snapshot snapshot = vertex->snapshot();
-    snapshot.ego().acceleration() = accel;
-
-    ConstAccelTrafficSimulator simulator(snapshot, map_, fast_map_);
-    double simulation_time = 0.0; double stage_cost = 0.0;
-
-    try {
-      const bool no_collision = simulator.simulate(
-          *path, sim_time_step_, 5.0, simulation_time, stage_cost);
-      // Continue if this acceleration option leads to collision.
-      if (!no_collision) continue;
-    } catch (std::exception& e) {
-      std::printf("SpatiotemporalLatticePlanner::connectVertexToRightFrontNode(): WARNING\n"
-                  "%s", e.what());
-      continue;
-    }
-
-    // Create a new vertex using the end snapshot of the simulation.
-    boost::shared_ptr<Vertex> next_vertex = boost::make_shared<Vertex>(
-        simulator.snapshot(), waypoint_lattice_, fast_map_);
-
-    // Check if a similar vertex (close in ego velocity) has already been created.
+  std::array<double, kAccelerationOptions_.size()> stage_costs;
+  const std::array<boost::shared_ptr<Vertex>, kAccelerationOptions_.size()>
+    rollout_vertices = simulateAccelerationOptions(
+        vertex, *path, target_node, 2, options, "connectVertexToRightFrontNode", stage_costs);
+
+  // Merge the simulation results into the graph in the order of the options.
+  for (size_t k = 0; k < kAccelerationOptions_.size(); ++k) {
+    // Continue if this acceleration option leads to collision.
+    if (!rollout_vertices[k]) continue;
+    const double accel = kAccelerationOptions_[k];
+    const double stage_cost = stage_costs[k];
+    const Snapshot end_snapshot = rollout_vertices[k]->snapshot();
+    const double end_time = rollout_vertices[k]->time();
+    boost::shared_ptr<Vertex> next_vertex = rollout_vertices[k];
+
+    // Check if a similar vertex (in the same state bucket) has already been created.
     // If so, the \c next_vertex is replaced with the existing one in the table.
     boost::shared_ptr<Vertex> similar_vertex = findVertexInTable(next_vertex);
     if (similar_vertex) next_vertex = similar_vertex;
@@ -977,39 +1310,145 @@ std::vector<boost::shared_ptr<Vertex>>
     // Update the child of the parent vertex.
     vertex->updateRightChild(*path, accel, stage_cost, next_vertex);
 
-    // Update the parent vertex of the child.
-    if (vertex->hasParents()) {
-      next_vertex->updateLeftParent(
-          simulator.snapshot(), vertex->costToCome()+stage_cost, vertex);
-    } else {
-      next_vertex->updateLeftParent(
-          simulator.snapshot(), stage_cost, vertex);
-    }
-
-    // Set the right front vertices that are connected with this vertex.
-    auto children = vertex->rightChildren();
-    for (size_t i = 0; i < Vertex::kSpeedIntervalsPerStation_.size(); ++i) {
-      if (!(children[i])) continue;
-      right_children[i] = std::get<3>(*(children[i])).lock();
-    }
+    // Update the parent vertex of the child. The end snapshot is only
+    // stored if the parent is not dominated by the existing ones.
+    const double cost_to_come = vertex->hasParents() ?
+      vertex->costToCome()+stage_cost : stage_cost;
+    std::vector<Snapshot> released;
+    if (next_vertex->updateLeftParent(end_snapshot, cost_to_come, vertex, end_time, &released))
+      countNewParent(next_vertex, end_snapshot, released);
   } // End for loop for different acceleration options.
 
   // Collect all the right child vertices of the input vertex.
   std::vector<boost::shared_ptr<Vertex>> output_vertices;
-  for (const auto& child : right_children) {
-    if (!child) continue;
-    output_vertices.push_back(child);
-  }
+  for (const auto& child : vertex->rightChildren())
+    output_vertices.push_back(std::get<3>(child).lock());
 
   return output_vertices;
 }
 
+const bool SpatiotemporalLatticePlanner::screenEdge(
+    const boost::shared_ptr<Vertex>& vertex,
+    const boost::shared_ptr<const WaypointNode>& target_node,
+    const ContinuousPath::LaneChangeType lane_change_type,
+    std::array<bool, kAccelerationOptions_.size()>& options) const {
+
+  options = active_acceleration_options_;
+  if (!edge_screening_.enabled()) return true;
+
+  const Snapshot& snapshot = vertex->snapshot();
+  if (screenOutLaneChange(snapshot, lane_change_type)) return false;
+
+  // The path is no shorter than the straight line between its ends.
+  const double distance = snapshot.ego().transform().location.Distance(
+      target_node->waypoint()->GetTransform().location);
+
+  // The agents which cannot interact with the ego within the relevance
+  // horizon are not in the simulation, so the gaps are only checked
+  // within the horizon.
+  const double max_time = relevance_horizon_ > 0.0 ?
+    std::min(kMaxStageTime_, relevance_horizon_) : kMaxStageTime_;
+
+  size_t active = 0;
+  size_t feasible = 0;
+  for (size_t k = 0; k < kAccelerationOptions_.size(); ++k) {
+    if (!options[k]) continue;
+    ++active;
+    if (edge_screening_.accelerationFeasible(
+          snapshot, lane_change_type, kAccelerationOptions_[k], distance,
+          max_time, state_discretization_.maxSpeed())) {
+      ++feasible;
+    } else {
+      options[k] = false;
+    }
+  }
+
+  // The options are only counted if some of them survive,
+  // otherwise the edge as a whole is counted.
+  if (active > 0 && feasible == 0) {
+    edge_screening_.addScreenedEdge();
+    return false;
+  }
+  edge_screening_.addScreenedOptions(active-feasible);
+
+  return true;
+}
+
+std::array<boost::shared_ptr<Vertex>,
+           SpatiotemporalLatticePlanner::kAccelerationOptions_.size()>
+  SpatiotemporalLatticePlanner::simulateAccelerationOptions(
+    const boost::shared_ptr<Vertex>& vertex,
+    const ContinuousPath& path,
+    const boost::shared_ptr<const WaypointNode>& target_node,
+    const size_t option,
+    const std::array<bool, kAccelerationOptions_.size()>& options,
+    const std::string& caller,
+    std::array<double, kAccelerationOptions_.size()>& stage_costs) const {
+
+  std::array<boost::shared_ptr<Vertex>, kAccelerationOptions_.size()> next_vertices;
+  stage_costs.fill(0.0);
+
+  // Each option works on its own copy of the snapshot, and only reads the
+  // shared waypoint lattice and maps.
+  auto simulateOption = [this, &vertex, &path, &target_node, option, &options,
+                         &caller, &next_vertices, &stage_costs](const size_t k) {
+    if (!options[k]) return;
+
+    // Prepare the start snapshot.
+    // The acceleration of the ego is set accordingly.
+    Snapshot snapshot = vertex->snapshot();
+    snapshot.ego().acceleration() = kAccelerationOptions_[k];
+
+    auto simulate = [this, &snapshot, &path, &caller]()->RolloutCache::Rollout{
+      ConstAccelTrafficSimulator simulator(
+          rolloutSnapshot(snapshot), map_, fast_map_, event_driven_simulation_);
+      simulator.costModel() = cost_model_;
+      double simulation_time = 0.0; double stage_cost = 0.0;
+
+      try {
+        const bool no_collision = simulator.simulate(
+            path, sim_time_step_, kMaxStageTime_, simulation_time, stage_cost);
+        // Return if this acceleration option leads to collision.
+        if (!no_collision) return boost::none;
+      } catch (std::exception& e) {
+        std::printf("SpatiotemporalLatticePlanner::%s(): WARNING\n"
+                    "%s", caller.c_str(), e.what());
+        return boost::none;
+      }
+      return std::make_pair(
+          rolloutResult(snapshot, simulator.snapshot(), simulation_time), stage_cost);
+    };
+
+    // The acceleration options of the same path are different edges.
+    const RolloutCache::Rollout result = simulateRollout(
+        RolloutCache::Key{vertex->node().lock()->id(), target_node->id(),
+                          option*kAccelerationOptions_.size()+k},
+        snapshot, simulate);
+    if (!result) return;
+
+    // Create a new vertex using the end snapshot of the simulation.
+    next_vertices[k] = makeGraphObject<Vertex>(
+        result->first, waypoint_lattice_, fast_map_);
+    next_vertices[k]->time() = vertex->time() + stageTime(vertex, next_vertices[k]);
+    stage_costs[k] = result->second;
+  };
+
+  if (thread_pool_) {
+    thread_pool_->parallelFor(kAccelerationOptions_.size(), simulateOption);
+  } else {
+    for (size_t k = 0; k < kAccelerationOptions_.size(); ++k) simulateOption(k);
+  }
+
+  return next_vertices;
+}
+
 boost::shared_ptr<Vertex> SpatiotemporalLatticePlanner::findVertexInTable(
     const boost::shared_ptr<Vertex>& vertex) {
 
   //std::printf("SpatiotemporalLatticePlanner::findVertexInTable()\n");
 
-  boost::optional<size_t> idx = Vertex::speedIntervalIdx(vertex->speed());
+  boost::optional<size_t> idx =
+    state_discretization_.bucket(vertex->speed(), vertex->time());
   if (!idx) {
     std::string error_msg(
         "SpatiotemporalLattice::findVertexInTable(): "
@@ -1023,6 +1462,16 @@ boost::shared_ptr<Vertex> SpatiotemporalLatticePlanner::findVertexInTable(
   return (iter->second)[*idx];
 }
 
+const double SpatiotemporalLatticePlanner::stageTime(
+    const boost::shared_ptr<const Vertex>& parent,
+    const boost::shared_ptr<const Vertex>& child) const {
+
+  const double distance = child->node()->distance() - parent->node()->distance();
+  const double speed_sum = parent->speed() + child->speed();
+  if (distance <= 0.0 || speed_sum <= 1.0e-3) return kMaxStageTime_;
+  return std::min(2.0*distance/speed_sum, kMaxStageTime_);
+}
+
 const double SpatiotemporalLatticePlanner::terminalSpeedCost(
     const boost::shared_ptr<Vertex>& vertex) const {
 
@@ -1033,13 +1482,12 @@ const double SpatiotemporalLatticePlanner::terminalSpeedCost(
     throw std::runtime_error(error_msg + vertex->string());
   }
 
-  static std::unordered_map<int, double> cost_map {
-    {0, 4.0}, {1, 4.0}, {2, 4.0}, {3, 3.0}, {4, 3.0},
-    {5, 2.0}, {6, 2.0}, {7, 1.0}, {8, 1.0}, {9, 0.0},
-  };
+  return terminalSpeedCost(vertex->speed(), vertex->snapshot().ego().policySpeed());
+}
+
+const double SpatiotemporalLatticePlanner::terminalSpeedCost(
+    const double ego_speed, const double ego_policy_speed) const {
 
-  const double ego_speed = vertex->speed();
-  const double ego_policy_speed = vertex->snapshot().ego().policySpeed();
   if (ego_speed < 0.0 || ego_policy_speed < 0.0) {
     std::string error_msg(
         "SpatiotemporalLatticePlanner::terminalSpeedCost(): "
@@ -1060,7 +1508,7 @@ const double SpatiotemporalLatticePlanner::terminalSpeedCost(
 
   // There is no cost if the speed of the ego matches or exceeds the policy speed.
   if (speed_ratio >= 1.0) return 0.0;
-  else return cost_map[static_cast<int>(speed_ratio*10.0)];
+  else return cost_model_->terminalSpeedCost(speed_ratio);
 }
 
 const double SpatiotemporalLatticePlanner::terminalDistanceCost(
@@ -1073,31 +1521,60 @@ const double SpatiotemporalLatticePlanner::terminalDistanceCost(
     throw std::runtime_error(error_msg + vertex->string());
   }
 
-  static std::unordered_map<int, double> cost_map {
-    {0, 20.0}, {1, 20.0}, {2, 20.0}, {3, 20.0}, {4, 20.0},
-    {5, 20.0}, {6, 20.0}, {7, 20.0}, {8, 10.0},  {9, 5.0},
-  };
-
   // Find the current spatial planning horizon.
   boost::shared_ptr<const Vertex> root_child;
   if (root_.lock()->hasFrontChildren())
-    root_child = std::get<3>(root_.lock()->validFrontChildren().front()).lock();
+    root_child = std::get<3>(root_.lock()->frontChildren().front()).lock();
   else if (root_.lock()->hasLeftChildren())
-    root_child = std::get<3>(root_.lock()->validLeftChildren().front()).lock();
+    root_child = std::get<3>(root_.lock()->leftChildren().front()).lock();
   else if (root_.lock()->hasRightChildren())
-    root_child = std::get<3>(root_.lock()->validRightChildren().front()).lock();
+    root_child = std::get<3>(root_.lock()->rightChildren().front()).lock();
 
   const double spatial_horizon =
-    spatial_horizon_ - 50.0 +
+    spatial_horizon_ - kStationInterval_ +
     root_child->node()->distance() -
     root_.lock()->node().lock()->distance();
 
   const double distance = vertex->node().lock()->distance() -
                           root_.lock()->node().lock()->distance();
+  return terminalDistanceCost(distance);
+}
+
+const double SpatiotemporalLatticePlanner::terminalDistanceCost(
+    const double distance) const {
+
   const double distance_ratio = distance / spatial_horizon_;
 
   if (distance_ratio >= 1.0) return 0.0;
-  else return cost_map[static_cast<int>(distance_ratio*10.0)];
+  else return cost_model_->terminalDistanceCost(distance_ratio);
+}
+
+const double SpatiotemporalLatticePlanner::terminalCostLowerBound(
+    const boost::shared_ptr<Vertex>& vertex) const {
+
+  const double cost_to_come = vertex->hasParents() ? vertex->costToCome() : 0.0;
+
+  // No terminal can be further away from the root than the end of the lattice.
+  const double max_distance = waypoint_lattice_->range();
+  const double distance = vertex->node().lock()->distance() -
+                          root_.lock()->node().lock()->distance();
+
+  // Each expanded station is (almost) a station interval ahead of its parent,
+  // which bounds the number of the stations left before the end of the lattice.
+  const double min_interval =
+    kStationInterval_ - waypoint_lattice_->longitudinalResolution();
+  const double stages = std::ceil(std::max(max_distance-distance, 0.0) / min_interval);
+
+  // The ego cannot gain more speed than accelerating at the maximum
+  // acceleration option through the whole simulation of each stage.
+  const double max_accel = *std::max_element(
+      kAccelerationOptions_.begin(), kAccelerationOptions_.end());
+  const double max_speed = vertex->speed() + max_accel*kMaxStageTime_*stages;
+
+  return cost_to_come +
+         std::min(cost_model_->minPolicyStageCost(), 0.0)*stages +
+         terminalSpeedCost(max_speed, vertex->snapshot().ego().policySpeed()) +
+         terminalDistanceCost(max_distance);
 }
 
 const double SpatiotemporalLatticePlanner::costFromRootToTerminal(
@@ -1121,6 +1598,7 @@ const double SpatiotemporalLatticePlanner::costFromRootToTerminal(
 void SpatiotemporalLatticePlanner::selectOptimalTraj(
     std::list<std::pair<ContinuousPath, double>>& traj_sequence,
     std::list<boost::weak_ptr<Vertex>>& vertex_sequence) const {
+  CLP_PROFILE_SCOPE("SpatiotemporalLatticePlanner::selectOptimalTraj");
 
   //std::printf("SpatiotemporalLatticePlanner::selectOptimalTraj()\n");
 
@@ -1207,6 +1685,8 @@ void SpatiotemporalLatticePlanner::selectOptimalTraj(
 
 DiscretePath SpatiotemporalLatticePlanner::mergePaths(
     const std::list<ContinuousPath>& paths) const {
+  CLP_PROFILE_SCOPE("SpatiotemporalLatticePlanner::mergePaths");
+
   //std::printf("SpatiotemporalLatticePlanner::mergePaths()\n");
   DiscretePath path(paths.front());
   for (std::list<ContinuousPath>::const_iterator iter = ++(paths.begin());
@@ -1221,76 +1701,13 @@ boost::optional<std::pair<ContinuousPath, double>>
 
   //std::printf("SpatiotemporalLatticePlanner::findTrajfromParentToChild()\n");
 
-  // FIXME: The three blocks of code are very similar.
-  //        Maybe consider merging them into one function call.
-
-  // Check if the input child is a left child.
-  const auto& left_children = parent->leftChildren();
-
-  for (const auto& candidate : left_children) {
-    if (!candidate) continue;
-    // Stop if the left children does not share the same node with the input child.
-    boost::shared_ptr<const Vertex> candidate_vertex = std::get<3>(*candidate).lock();
-    if (candidate_vertex->node()->id() != child->node().lock()->id()) continue;
-
-    // Figure out the which child the input child actually is.
-    boost::optional<size_t> idx = Vertex::speedIntervalIdx(child->speed());
-    if (!idx) {
-      std::string error_msg(
-          "SpatiotemporalLatticePlanner::findTrajFromParentToChild(): "
-          "The desired left child is missing.\n");
-      error_msg += parent->string("parent:\n") + child->string("child:\n");
-      throw std::runtime_error(error_msg);
+  // The input child may be a left, front, or right child.
+  for (const std::vector<Vertex::Child>* children :
+      {&parent->leftChildren(), &parent->frontChildren(), &parent->rightChildren()}) {
+    for (const auto& candidate : *children) {
+      if (std::get<3>(candidate).lock() != child) continue;
+      return std::make_pair(std::get<0>(candidate), std::get<1>(candidate));
     }
-
-    return std::make_pair(std::get<0>(*(left_children[*idx])),
-                          std::get<1>(*(left_children[*idx])));
-  }
-
-  // Check if the input child is a front child.
-  const auto& front_children = parent->frontChildren();
-
-  for (const auto& candidate : front_children) {
-    if (!candidate) continue;
-    // Stop if the left children does not share the same node with the input child.
-    boost::shared_ptr<const Vertex> candidate_vertex = std::get<3>(*candidate).lock();
-    if (candidate_vertex->node()->id() != child->node().lock()->id()) continue;
-
-    // Figure out the which child the input child actually is.
-    boost::optional<size_t> idx = Vertex::speedIntervalIdx(child->speed());
-    if (!idx) {
-      std::string error_msg(
-          "SpatiotemporalLatticePlanner::findTrajFromParentToChild(): "
-          "The desired front child is missing.\n");
-      error_msg += parent->string("parent:\n") + child->string("child:\n");
-      throw std::runtime_error(error_msg);
-    }
-
-    return std::make_pair(std::get<0>(*(front_children[*idx])),
-                          std::get<1>(*(front_children[*idx])));
-  }
-
-  // Check if the input child is a right child.
-  const auto& right_children = parent->rightChildren();
-
-  for (const auto& candidate : right_children) {
-    if (!candidate) continue;
-    // Stop if the left children does not share the same node with the input child.
-    boost::shared_ptr<const Vertex> candidate_vertex = std::get<3>(*candidate).lock();
-    if (candidate_vertex->node()->id() != child->node().lock()->id()) continue;
-
-    // Figure out the which child the input child actually is.
-    boost::optional<size_t> idx = Vertex::speedIntervalIdx(child->speed());
-    if (!idx) {
-      std::string error_msg(
-          "SpatiotemporalLatticePlanner::findTrajFromParentToChild(): "
-          "The desired right child is missing.\n");
-      error_msg += parent->string("parent:\n") + child->string("child:\n");
-      throw std::runtime_error(error_msg);
-    }
-
-    return std::make_pair(std::get<0>(*(right_children[*idx])),
-                          std::get<1>(*(right_children[*idx])));
   }
 
   // If the \c child vertex is not found, return \c boost::none.
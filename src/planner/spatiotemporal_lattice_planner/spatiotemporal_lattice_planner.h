@@ -18,7 +18,9 @@
 #include <deque>
 #include <list>
 #include <array>
+#include <vector>
 #include <string>
+#include <algorithm>
 #include <unordered_map>
 #include <boost/optional.hpp>
 #include <boost/core/noncopyable.hpp>
@@ -32,25 +34,80 @@
 #include <planner/common/vehicle_path_planner.h>
 #include <planner/common/traffic_simulator.h>
 #include <planner/common/intelligent_driver_model.h>
+#include <planner/common/thread_pool.h>
+#include <planner/common/graph_memory.h>
 
 namespace planner {
 namespace spatiotemporal_lattice_planner {
 
-
-class ConstAccelTrafficSimulator : public TrafficSimulator {
+/**
+ * \brief ConstAccelTrafficSimulator simulates the traffic forward assuming
+ *        all vehicles keep their current accelerations.
+ *
+ * By default, the simulator steps at the default time step like the other
+ * simulators. Optionally, since the motion of the vehicles is known in closed
+ * form, the simulation can be event driven instead. It then jumps to the next
+ * time at which something relevant may happen, i.e. a gap between two
+ * vehicles closes, the ttc of the ego crosses a cost threshold, a vehicle
+ * stops or crosses its policy speed, or the ego reaches the end of the path.
+ *
+ * The event driven mode is an approximation of the stepping mode, and its
+ * costs and plans differ from the stepping mode:
+ * - The traffic lattice, i.e. which vehicle follows which, and the collisions
+ *   are only checked at the events, or every \c kMaxEventInterval_ if there
+ *   is no event, instead of at every time step. Changes in between, e.g. a
+ *   vehicle leaving the lattice, are picked up late.
+ * - The costs are integrated with the rectangle rule, i.e. the cost at the
+ *   end of an interval is applied to the whole interval, which may be as
+ *   long as \c kMaxEventInterval_, while e.g. the accel cost changes with
+ *   the speeds within the interval.
+ */
+class ConstAccelTrafficSimulator final : public TrafficSimulatorCore<ConstAccelTrafficSimulator> {
 
 private:
 
-  using Base = TrafficSimulator;
+  using Base = TrafficSimulatorCore<ConstAccelTrafficSimulator>;
   using This = ConstAccelTrafficSimulator;
 
+  friend class TrafficSimulatorCore<ConstAccelTrafficSimulator>;
+
+protected:
+
+  /// The maximum interval (s) between two events, after which the lattice is
+  /// refreshed anyway, e.g. for the vehicles which are not tracked by the events.
+  static constexpr double kMaxEventInterval_ = 1.0;
+
+  /// Threshold crossings are scheduled this early (s), so that the cost evaluated
+  /// at the end of an interval is the one that applies within the interval.
+  static constexpr double kEventTimeMargin_ = 1.0e-3;
+
+  /// Whether the simulation is event driven, or steps at the default time step.
+  bool event_driven_ = false;
+
 public:
 
   ConstAccelTrafficSimulator(
       const Snapshot& snapshot,
       const boost::shared_ptr<CarlaMap>& map,
-      const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
-    Base(snapshot, map, fast_map) {}
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+      const bool event_driven = false) :
+    Base(snapshot, map, fast_map),
+    event_driven_(event_driven) {}
+
+  const bool eventDriven() const { return event_driven_; }
+  bool& eventDriven() { return event_driven_; }
+
+  /**
+   * \brief Simulate the traffic.
+   *
+   * See \c TrafficSimulator::simulate(). In the event driven mode, \c default_dt
+   * is the minimum interval between two events, and the costs are averaged over
+   * time instead of over the simulation steps, see the class description for
+   * how this differs from the stepping mode.
+   */
+  virtual const bool simulate(
+      const ContinuousPath& path, const double default_dt, const double max_time,
+      double& time, double& cost) override;
 
 protected:
 
@@ -62,6 +119,18 @@ protected:
     return snapshot_.agent(agent).acceleration();
   }
 
+  /// Stopped agents are held at rest instead of driving backwards.
+  virtual void agentAccelerations(std::vector<double>& accels) const override;
+
+  /**
+   * \brief Find the time until the next event, given the accelerations of the vehicles.
+   * \return The time (s) to the next event, which is infinity if there is no event.
+   */
+  const double nextEventTime(
+      const double ego_accel, const std::vector<double>& agent_accels) const;
+
+  using Base::accelCost;
+
   const double accelCost(
       const double accel, const double speed, const double policy_speed) const;
 
@@ -69,6 +138,70 @@ protected:
 
 }; // End ConstAccelTrafficSimulator.
 
+/**
+ * \brief StateDiscretization defines the buckets of the ego state at a station.
+ *
+ * At reaching a station, the ego state falls into a bucket determined by the
+ * speed and the time (since the start of the planning) of the ego. All the
+ * trajectories reaching the same station within the same bucket are merged
+ * into one vertex. If the ego speed is outside all the speed buckets, it will
+ * be considered as an invalid trajectory option. Times beyond the last time
+ * bucket fall into the last bucket.
+ *
+ * Each bucket is left-closed and right-open, i.e. [a, b).
+ *
+ * In the paper, M. McNaughton, et al, "Motion Planning for Autonomous Driving with
+ * a Conformal Spatiotemporal Lattice", there is also discretizetion of time at each
+ * station. The default discretization has three speed buckets of 13.4112m/s
+ * (30mph) and a single time bucket.
+ */
+class StateDiscretization {
+
+protected:
+
+  /// Width (m/s) of a speed bucket.
+  double speed_resolution_ = 13.4112;
+
+  /// The speeds (m/s) at or beyond this are invalid.
+  double max_speed_ = 40.2336;
+
+  /// Width (s) of a time bucket.
+  double time_resolution_ = 1.0;
+
+  /// Number of the speed buckets, derived from the speed resolution and maximum speed.
+  size_t speed_buckets_ = 3;
+
+  /// Number of the time buckets.
+  size_t time_buckets_ = 1;
+
+public:
+
+  StateDiscretization(const double speed_resolution = 13.4112,
+                      const double max_speed = 40.2336,
+                      const double time_resolution = 1.0,
+                      const size_t time_buckets = 1);
+
+  const double speedResolution() const { return speed_resolution_; }
+  const double maxSpeed() const { return max_speed_; }
+  const double timeResolution() const { return time_resolution_; }
+
+  const size_t speedBuckets() const { return speed_buckets_; }
+  const size_t timeBuckets() const { return time_buckets_; }
+
+  /// Number of the buckets at each station.
+  const size_t size() const { return speed_buckets_ * time_buckets_; }
+
+  /**
+   * \brief Find the bucket of the given ego state.
+   * \param[in] speed The ego speed (m/s).
+   * \param[in] time The time (s) since the start of the planning.
+   * \return The index of the bucket in [0, size()), or \c boost::none
+   *         if the speed is outside all speed buckets.
+   */
+  boost::optional<size_t> bucket(const double speed, const double time) const;
+
+}; // End class StateDiscretization.
+
 class Vertex {
 
 protected:
@@ -77,12 +210,15 @@ protected:
   using CarlaWaypoint  = carla::client::Waypoint;
   using CarlaTransform = carla::geom::Transform;
 
+public:
+
   /**
    * \brief Stores a parent vertex of this vertex.
    *
-   * The tuple stores the snapshot and the cost-to-come if come form this parent vertex.
+   * The tuple stores the snapshot, the cost-to-come if come form this parent vertex,
+   * the parent vertex, and the time (s) to reach this vertex through the parent.
    */
-  using Parent = std::tuple<Snapshot, double, boost::weak_ptr<Vertex>>;
+  using Parent = std::tuple<Snapshot, double, boost::weak_ptr<Vertex>, double>;
 
   /**
    * \brief Stores a child vertex of this vertex.
@@ -92,31 +228,6 @@ protected:
    */
   using Child = std::tuple<ContinuousPath, double, double, boost::weak_ptr<Vertex>>;
 
-public:
-
-  /**
-   * \brief The hard-coded interval of velocities at a station.
-   *
-   * At reaching the station, if the ego velocity is outside all the intervals,
-   * it will be considered as an invalid trajectory option.
-   *
-   * Each interval is left-closed and right-open, i.e. [a, b).
-   *
-   * In the paper, M. McNaughton, et al, "Motion Planning for Autonomous Driving with
-   * a Conformal Spatiotemporal Lattice", there is also discretizetion of time at each
-   * station. In this implementation, we assume there is just one interval for the time.
-   *
-   * This is subject to discussion. What should be recorded at each station/vertex
-   * reprents some sort of the "state" of the ego. Having time as a variable in the
-   * state might indicates a flawed design of an algorithm. Time is often not a part
-   * of the state vector.
-   */
-  static constexpr std::array<std::pair<double, double>, 3>
-    kSpeedIntervalsPerStation_ {{
-      { 0.0,    13.4112},
-      {13.4112, 26.8224},
-      {26.8224, 40.2336} }};
-
 protected:
 
   /// The node that the vertex is most close to on the waypoint lattice.
@@ -125,27 +236,26 @@ protected:
   /// The snapshot of the traffic when the ego vehicle reaches this vertex.
   Snapshot snapshot_;
 
+  /// The time (s) when the ego vehicle reaches this vertex.
+  double time_ = 0.0;
+
   /**
    * \name Parent vertices of this vertex.
    *
    * Each vertex may have more than one parents from the same lane, left lane,
-   * or the right lane. The maximum number of parents from each lane depends on
-   * the size of \c kSpeedIntervalsPerStation_.
+   * or the right lane. A parent is only kept if no other parent is at least as
+   * good in cost-to-come, speed margin, and time, see \c dominates(). A parent
+   * vertex reaching this vertex through several edges is kept once, with the
+   * cheapest edge.
    *
    * The \c optimal_parent is a copy of the parent which has the
    * minimum cost-to-come. This is mainly used to backtrace the optimal
    * path/trajectory.
    */
   /// @{
-  std::array<boost::optional<Parent>, kSpeedIntervalsPerStation_.size()>
-    left_parents_ {boost::none};
-
-  std::array<boost::optional<Parent>, kSpeedIntervalsPerStation_.size()>
-    back_parents_ {boost::none};
-
-  std::array<boost::optional<Parent>, kSpeedIntervalsPerStation_.size()>
-    right_parents_ {boost::none};
-
+  std::vector<Parent> left_parents_;
+  std::vector<Parent> back_parents_;
+  std::vector<Parent> right_parents_;
   boost::optional<Parent> optimal_parent_ = boost::none;
   /// @}
 
@@ -153,18 +263,13 @@ protected:
    * \name Child vertices if this vertex.
    *
    * Each vertex may have more than one child vertices from the same lane, left lane,
-   * or the right lane. The maximum number of children from each lane depends on the
-   * size of \c kSpeedIntervalsPerStation_.
+   * or the right lane. A child vertex reached through several edges is kept once,
+   * with the cheapest edge.
    */
   /// @{
-  std::array<boost::optional<Child>, kSpeedIntervalsPerStation_.size()>
-    left_children_ {boost::none};
-
-  std::array<boost::optional<Child>, kSpeedIntervalsPerStation_.size()>
-    front_children_ {boost::none};
-
-  std::array<boost::optional<Child>, kSpeedIntervalsPerStation_.size()>
-    right_children_ {boost::none};
+  std::vector<Child> left_children_;
+  std::vector<Child> front_children_;
+  std::vector<Child> right_children_;
   /// @}
 
 public:
@@ -180,7 +285,7 @@ public:
 
   Vertex(const Snapshot& snapshot,
          const boost::shared_ptr<const WaypointLattice>& waypoint_lattice,
-         const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+         const boost::shared_ptr<const utils::FastWaypointMap>& fast_map) :
     snapshot_(snapshot) {
     boost::shared_ptr<const WaypointNode> node = waypoint_lattice->closestNode(
         fast_map->waypoint(snapshot.ego().transform().location),
@@ -205,6 +310,11 @@ public:
 
   const double speed() const { return snapshot_.ego().speed(); }
 
+  /// Get or set the time (s) when the ego reaches the vertex, which
+  /// follows the optimal parent once there is one.
+  const double time() const { return time_; }
+  double& time() { return time_; }
+
   const Snapshot& snapshot() const { return snapshot_; }
 
   const double costToCome() const {
@@ -217,29 +327,18 @@ public:
   }
 
   /// Accessors for the parent vertices.
-  const std::array<boost::optional<Parent>, kSpeedIntervalsPerStation_.size()>&
-    leftParents() const { return left_parents_; }
-
-  const std::array<boost::optional<Parent>, kSpeedIntervalsPerStation_.size()>&
-    backParents() const { return back_parents_; }
-
-  const std::array<boost::optional<Parent>, kSpeedIntervalsPerStation_.size()>&
-    rightParents() const { return right_parents_; }
+  const std::vector<Parent>& leftParents() const { return left_parents_; }
+  const std::vector<Parent>& backParents() const { return back_parents_; }
+  const std::vector<Parent>& rightParents() const { return right_parents_; }
 
   const boost::optional<Parent>& optimalParent() const {
     return optimal_parent_;
   }
 
-  std::vector<Parent> validLeftParents() const { return validParents(left_parents_); }
-  std::vector<Parent> validBackParents() const { return validParents(back_parents_); }
-  std::vector<Parent> validRightParents() const { return validParents(right_parents_); };
-
   /// Check the number of parents.
-  /// FIXME: There is some unnecessary copying (not much) going on here.
-  ///        Should be easy to get rid of this by counting the valid parents directly.
-  const size_t leftParentsSize() const { return validLeftParents().size(); }
-  const size_t backParentsSize() const { return validBackParents().size(); }
-  const size_t rightParentsSize() const { return validRightParents().size(); }
+  const size_t leftParentsSize() const { return left_parents_.size(); }
+  const size_t backParentsSize() const { return back_parents_.size(); }
+  const size_t rightParentsSize() const { return right_parents_.size(); }
   const size_t parentsSize() const {
     return leftParentsSize() + backParentsSize() + rightParentsSize();
   }
@@ -251,25 +350,14 @@ public:
   const bool hasParents() const { return parentsSize() > 0; }
 
   /// Accessors for the child vertices.
-  const std::array<boost::optional<Child>, kSpeedIntervalsPerStation_.size()>&
-    leftChildren() const { return left_children_; }
-
-  const std::array<boost::optional<Child>, kSpeedIntervalsPerStation_.size()>&
-    frontChildren() const { return front_children_; }
-
-  const std::array<boost::optional<Child>, kSpeedIntervalsPerStation_.size()>&
-    rightChildren() const { return right_children_; }
-
-  std::vector<Child> validLeftChildren() const { return validChildren(left_children_); }
-  std::vector<Child> validFrontChildren() const { return validChildren(front_children_); }
-  std::vector<Child> validRightChildren() const { return validChildren(right_children_); }
+  const std::vector<Child>& leftChildren() const { return left_children_; }
+  const std::vector<Child>& frontChildren() const { return front_children_; }
+  const std::vector<Child>& rightChildren() const { return right_children_; }
 
   /// Check the number of children.
-  /// FIXME: There is some unnecessary copying (not much) going on here.
-  ///        Should be easy to get rid of this by counting the valid parents directly.
-  const size_t leftChildrenSize() const { return validLeftChildren().size(); }
-  const size_t frontChildrenSize() const { return validFrontChildren().size(); }
-  const size_t rightChildrenSize() const { return validRightChildren().size(); }
+  const size_t leftChildrenSize() const { return left_children_.size(); }
+  const size_t frontChildrenSize() const { return front_children_.size(); }
+  const size_t rightChildrenSize() const { return right_children_.size(); }
   const size_t childrenSize() const {
     return leftChildrenSize() + frontChildrenSize() + rightChildrenSize();
   }
@@ -280,18 +368,50 @@ public:
   const bool hasRightChildren() const { return rightChildrenSize() > 0; }
   const bool hasChildren() const { return childrenSize() > 0; }
 
-  /// Update parent vertices.
-  void updateLeftParent(const Snapshot& snapshot,
-                        const double cost_to_come,
-                        const boost::shared_ptr<Vertex>& parent_vertex);
-
-  void updateBackParent(const Snapshot& snapshot,
-                        const double cost_to_come,
-                        const boost::shared_ptr<Vertex>& parent_vertex);
+  /**
+   * \name Update parent vertices.
+   *
+   * \param[in] snapshot The snapshot reaching this vertex from the parent.
+   * \param[in] cost_to_come The cost-to-come through the parent.
+   * \param[in] parent_vertex The parent vertex.
+   * \param[in] time The time (s) reaching this vertex through the parent.
+   * \param[out] released If not \c nullptr, the snapshots of the existing
+   *              parents removed in favor of the new one are appended.
+   * \return False if the parent is discarded, since it is dominated by
+   *         an existing parent. The snapshot is not stored in this case.
+   */
+  /// @{
+  const bool updateLeftParent(const Snapshot& snapshot,
+                              const double cost_to_come,
+                              const boost::shared_ptr<Vertex>& parent_vertex,
+                              const double time,
+                              std::vector<Snapshot>* released = nullptr);
+
+  const bool updateBackParent(const Snapshot& snapshot,
+                              const double cost_to_come,
+                              const boost::shared_ptr<Vertex>& parent_vertex,
+                              const double time,
+                              std::vector<Snapshot>* released = nullptr);
+
+  const bool updateRightParent(const Snapshot& snapshot,
+                               const double cost_to_come,
+                               const boost::shared_ptr<Vertex>& parent_vertex,
+                               const double time,
+                               std::vector<Snapshot>* released = nullptr);
+  /// @}
 
-  void updateRightParent(const Snapshot& snapshot,
-                         const double cost_to_come,
-                         const boost::shared_ptr<Vertex>& parent_vertex);
+  /**
+   * \brief Remove all parents except the optimal one.
+   *
+   * The snapshots of the suboptimal parents are released, which saves memory
+   * at the risk of a worse cost-to-come, if the optimal parent is replaced
+   * by a more expensive one from the same parent vertex later.
+   *
+   * \param[out] released If not \c nullptr, the snapshots of the removed
+   *              parents are appended.
+   * \return The number of the removed parents.
+   */
+  const size_t dropSuboptimalParents(std::vector<Snapshot>* released = nullptr);
 
   /// Update child vertices.
   void updateLeftChild(const ContinuousPath& path,
@@ -311,46 +431,44 @@ public:
 
   std::string string(const std::string& prefix = "") const;
 
-  /// Figure out the speed interval index for the given speed.
-  static boost::optional<size_t> speedIntervalIdx(const double speed) {
-    // Return \c boost::none if the input speed is less than 0.
-    if (speed < 0.0) return boost::none;
+protected:
 
-    for (size_t i = 0; i < kSpeedIntervalsPerStation_.size(); ++i) {
-      if (speed < kSpeedIntervalsPerStation_[i].second) return i;
+  /**
+   * \brief Check whether parent \c a dominates parent \c b.
+   *
+   * \c a dominates \c b if it is no worse in all of the cost-to-come, the
+   * speed margin, i.e. how much the ego speed falls short of the policy speed,
+   * and the time reaching this vertex.
+   */
+  static const bool dominates(const Parent& a, const Parent& b);
+
+  /// Add a parent to the given parents if it is not dominated.
+  const bool updateParent(std::vector<Parent>& parents,
+                          Parent&& parent,
+                          std::vector<Snapshot>* released);
+
+  /// Remove the parents satisfying the predicate, and collect their snapshots.
+  template<typename Predicate>
+  static const size_t removeParents(std::vector<Parent>& parents,
+                                    Predicate&& predicate,
+                                    std::vector<Snapshot>* released) {
+    const auto end = std::stable_partition(parents.begin(), parents.end(),
+        [&predicate](const Parent& parent){ return !predicate(parent); });
+    const size_t removed = parents.end() - end;
+    if (released) {
+      for (auto iter = end; iter != parents.end(); ++iter)
+        released->push_back(std::move(std::get<0>(*iter)));
     }
-
-    // Return \c boost::none if the speed is too large.
-    return boost::none;
+    parents.erase(end, parents.end());
+    return removed;
   }
 
-protected:
+  /// Add a child to the given children, or replace the edge to the same vertex if cheaper.
+  static void updateChild(std::vector<Child>& children, Child&& child);
 
   /// Update the optimal parent vertex, which has the minimum cost-to-come.
   void updateOptimalParent();
 
-  std::vector<Parent> validParents(
-      const std::array<boost::optional<Parent>,
-                       kSpeedIntervalsPerStation_.size()>& parents) const {
-    std::vector<Parent> valid_parents;
-    for (const auto& parent : parents) {
-      if (!parent) continue;
-      valid_parents.push_back(*parent);
-    }
-    return valid_parents;
-  }
-
-  std::vector<Child> validChildren(
-      const std::array<boost::optional<Child>,
-                       kSpeedIntervalsPerStation_.size()>& children) const {
-    std::vector<Child> valid_children;
-    for (const auto& child : children) {
-      if (!child) continue;
-      valid_children.push_back(*child);
-    }
-    return valid_children;
-  }
-
 }; // End class Vertex.
 
 class SpatiotemporalLatticePlanner : public VehiclePathPlanner,
@@ -371,6 +489,12 @@ protected:
 
   static constexpr std::array<double, 6> kAccelerationOptions_ {-8.0, -4.0, -2.0, -1.0, 0.0, 1.0};
 
+  /// Distance between two consecutive stations along the waypoint lattice.
+  static constexpr double kStationInterval_ = 50.0;
+
+  /// Maximum simulation time (s) from one station to the next.
+  static constexpr double kMaxStageTime_ = 5.0;
+
   /// Simulation time step.
   double sim_time_step_;
 
@@ -385,12 +509,13 @@ protected:
   /// The waypoint lattice used to find nodes for stations.
   boost::shared_ptr<WaypointLattice> waypoint_lattice_ = nullptr;
 
+  /// The buckets of the ego state, within each of which the vertices are merged.
+  StateDiscretization state_discretization_;
+
   /// Stores all the constructed vertices.
-  /// The vetices are indexed by the node ID. Each node may link upto three vertices.
-  std::unordered_map<
-    size_t,
-    std::array<boost::shared_ptr<Vertex>, Vertex::kSpeedIntervalsPerStation_.size()>>
-      node_to_vertices_table_;
+  /// The vetices are indexed by the node ID. Each node may link upto one vertex
+  /// for each bucket of \c state_discretization_.
+  std::unordered_map<size_t, std::vector<boost::shared_ptr<Vertex>>> node_to_vertices_table_;
 
   /**
    * \brief The root vertex in the station graph.
@@ -404,6 +529,43 @@ protected:
   /// The next vertex to be reached.
   boost::weak_ptr<Vertex> cached_next_vertex_;
 
+  /// The thread pool used to simulate the acceleration options in parallel.
+  /// The options are simulated serially if this is \c nullptr.
+  boost::shared_ptr<utils::ThreadPool> thread_pool_ = nullptr;
+
+  /**
+   * \brief Whether to construct the vertex graph with branch-and-bound.
+   *
+   * If set, the vertices are expanded best-first ordered by a lower bound of
+   * the terminal cost, and any vertex whose lower bound exceeds the best
+   * terminal cost found so far is left unexpanded.
+   * See \c branchAndBoundVertexGraph().
+   */
+  bool branch_and_bound_ = false;
+
+  /// Number of vertices expanded in the last planning cycle.
+  size_t expanded_vertices_ = 0;
+
+  /// Number of vertices pruned by branch-and-bound in the last planning cycle.
+  size_t pruned_vertices_ = 0;
+
+  /// Memory used by the vertex graph in the current planning cycle,
+  /// together with the cap on the memory.
+  GraphMemory graph_memory_;
+
+  /// Whether the edges are simulated in the event driven mode of
+  /// \c ConstAccelTrafficSimulator, which is faster but approximate.
+  bool event_driven_simulation_ = false;
+
+  /// Whether the graph is degraded in the last planning cycle to stay within
+  /// the memory cap, by dropping the suboptimal parents or stopping the expansion.
+  bool memory_capped_ = false;
+
+  /// Whether each of the acceleration options is simulated when connecting
+  /// the vertices. Disabling options trades plan quality for planning time.
+  std::array<bool, kAccelerationOptions_.size()> active_acceleration_options_ {
+    true, true, true, true, true, true};
+
 public:
 
   /// Constructor of the class.
@@ -412,11 +574,15 @@ public:
       const double spatial_horizon,
       const boost::shared_ptr<router::Router>& router,
       const boost::shared_ptr<CarlaMap>& map,
-      const boost::shared_ptr<utils::FastWaypointMap>& fast_map) :
+      const boost::shared_ptr<const utils::FastWaypointMap>& fast_map,
+      const boost::shared_ptr<utils::ThreadPool>& thread_pool = nullptr,
+      const bool branch_and_bound = false) :
     Base(map, fast_map),
     sim_time_step_(sim_time_step),
     spatial_horizon_(spatial_horizon),
-    router_(router) {}
+    router_(router),
+    thread_pool_(thread_pool),
+    branch_and_bound_(branch_and_bound) {}
 
   /// Destructor of the class.
   virtual ~SpatiotemporalLatticePlanner() {}
@@ -432,6 +598,90 @@ public:
   /// Get the router used by the planner.
   boost::shared_ptr<const router::Router> router() const { return router_; }
 
+  /// Get the spatial planning horizon.
+  const double spatialHorizon() const { return spatial_horizon_; }
+
+  /**
+   * \brief Set the spatial planning horizon.
+   *
+   * The waypoint lattice and the vertex graph of the last planning cycle are
+   * dropped, so that the lattice is recreated with the new range in the
+   * next planning cycle.
+   */
+  void setSpatialHorizon(const double spatial_horizon) {
+    spatial_horizon_ = spatial_horizon;
+    waypoint_lattice_ = nullptr;
+    node_to_vertices_table_.clear();
+    root_.reset();
+    cached_next_vertex_.reset();
+  }
+
+  /// Get the buckets of the ego state.
+  const StateDiscretization& stateDiscretization() const { return state_discretization_; }
+
+  /**
+   * \brief Set the buckets of the ego state.
+   *
+   * Finer buckets give better plans at the cost of more vertices. The vertex
+   * graph of the last planning cycle is dropped, since it is built with the
+   * old buckets.
+   */
+  void setStateDiscretization(const StateDiscretization& state_discretization) {
+    state_discretization_ = state_discretization;
+    node_to_vertices_table_.clear();
+    root_.reset();
+    cached_next_vertex_.reset();
+  }
+
+  /// Enable or disable the branch-and-bound vertex graph construction.
+  const bool branchAndBound() const { return branch_and_bound_; }
+  bool& branchAndBound() { return branch_and_bound_; }
+
+  /// Enable or disable the event driven simulation of the edges.
+  /// This should not be changed while a rollout cache is shared with
+  /// the previous planning cycles, whose rollouts are simulated differently.
+  const bool eventDrivenSimulation() const { return event_driven_simulation_; }
+  bool& eventDrivenSimulation() { return event_driven_simulation_; }
+
+  /// The acceleration options available to the ego.
+  static const std::array<double, kAccelerationOptions_.size()>& accelerationOptions() {
+    return kAccelerationOptions_;
+  }
+
+  /// Get or set the acceleration options that are simulated, following the
+  /// order of \c accelerationOptions().
+  const std::array<bool, kAccelerationOptions_.size()>& activeAccelerationOptions() const {
+    return active_acceleration_options_;
+  }
+  std::array<bool, kAccelerationOptions_.size()>& activeAccelerationOptions() {
+    return active_acceleration_options_;
+  }
+
+  /// Number of vertices expanded in the last planning cycle.
+  const size_t expandedVertices() const { return expanded_vertices_; }
+
+  /// Number of vertices pruned by branch-and-bound in the last planning cycle.
+  const size_t prunedVertices() const { return pruned_vertices_; }
+
+  /// Number of vertices in the graph.
+  const size_t verticesSize() const {
+    size_t size = 0;
+    for (const auto& item : node_to_vertices_table_) {
+      for (const auto& vertex : item.second) if (vertex) ++size;
+    }
+    return size;
+  }
+
+  /// Memory used by the vertex graph in the last planning cycle.
+  const GraphMemory& graphMemory() const { return graph_memory_; }
+
+  /// Get or set the cap (bytes) on the memory used by the vertex graph.
+  const size_t memoryCap() const { return graph_memory_.cap(); }
+  size_t& memoryCap() { return graph_memory_.cap(); }
+
+  /// Whether the graph is degraded in the last planning cycle to stay within the memory cap.
+  const bool memoryCapped() const { return memory_capped_; }
+
   ///// Get all vertices in the graph.
   //std::vector<boost::shared_ptr<const Vertex>> vertices() const {
   //  std::vector<boost::shared_ptr<const Vertex>> valid_vertices;
@@ -451,11 +701,31 @@ public:
   /// Get the edges between nodes on the graph, corresponding to the paths.
   std::vector<ContinuousPath> edges() const;
 
+  using Base::planPath;
+
   // FIXME: How to get the acceleration out.
   virtual DiscretePath planPath(const size_t ego, const Snapshot& snapshot) override;
 
   std::list<std::pair<ContinuousPath, double>> planTraj(const size_t ego, const Snapshot& snapshot);
 
+  /**
+   * \brief Plan the trajectory with a time budget.
+   *
+   * The vertex graph construction stops expanding when the budget is nearly
+   * spent, and the best trajectory among the terminals found so far is returned.
+   *
+   * \param[in] ego The ID of the ego vehicle.
+   * \param[in] snapshot Snapshot of the current traffic scenario.
+   * \param[in] time_budget The planning time budget (s), or infinity if not limited.
+   * \param[out] truncated Whether the search is truncated by the deadline.
+   */
+  std::list<std::pair<ContinuousPath, double>> planTraj(
+      const size_t ego, const Snapshot& snapshot,
+      const double time_budget, bool& truncated) {
+    return planWithDeadline(time_budget, truncated,
+        [this, ego, &snapshot]() { return planTraj(ego, snapshot); });
+  }
+
 protected:
 
   /// Check if the any of the child vertices has been reached.
@@ -467,9 +737,64 @@ protected:
   /// Prune/update the vertex graph of last step.
   std::deque<boost::shared_ptr<Vertex>> pruneVertexGraph(const Snapshot& snapshot);
 
-  /// Construct the vertex graph.
+  /**
+   * \brief Check whether the graph is still within the memory cap.
+   *
+   * The first time the cap is exceeded in a cycle, the suboptimal parents
+   * of all vertices are dropped, and only the optimal parents are kept for
+   * the rest of the cycle, see \c countNewParent(). The graph construction
+   * should stop if the cap is exceeded afterwards, since there is nothing
+   * left to be released.
+   */
+  const bool withinMemoryCap();
+
+  /**
+   * \brief Count the memory after a new parent is added to a vertex.
+   *
+   * \param[in] vertex The vertex the parent is added to.
+   * \param[in] snapshot The snapshot of the new parent.
+   * \param[in] released The snapshots of the parents removed by the new one.
+   */
+  void countNewParent(const boost::shared_ptr<Vertex>& vertex,
+                      const Snapshot& snapshot,
+                      std::vector<Snapshot>& released);
+
+  /**
+   * \brief Construct the vertex graph.
+   *
+   * The expansion stops if the next vertex cannot be expanded before
+   * \c deadline_, or the graph exceeds the memory cap, see \c withinMemoryCap().
+   * In either case, the unexpanded vertices are left as terminals.
+   */
   void constructVertexGraph(std::deque<boost::shared_ptr<Vertex>>& vertex_queue);
 
+  /**
+   * \brief Construct the vertex graph with best-first branch-and-bound.
+   *
+   * The vertices are expanded in the order of \c terminalCostLowerBound().
+   * Every terminal vertex met on the way updates the incumbent, i.e. the
+   * minimum terminal cost found so far. The search stops once the lower
+   * bounds of all the remaining vertices exceed the incumbent. The remaining
+   * vertices are left as terminals in the graph, whose terminal costs are
+   * no less than their lower bounds. Therefore, they are never selected by
+   * \c selectOptimalTraj(). The search also stops at \c deadline_ and the
+   * memory cap as in \c constructVertexGraph().
+   *
+   * \param[in] vertex_queue The vertices to start the expansion from.
+   */
+  void branchAndBoundVertexGraph(std::deque<boost::shared_ptr<Vertex>>& vertex_queue);
+
+  /**
+   * \brief Connect a vertex to the front, left front, and right front nodes.
+   *
+   * The newly created vertices are added to the table. Those reaching the
+   * target node are returned in \c open_vertices to be expanded later, while
+   * the rest stay as terminals and are returned in \c terminal_vertices.
+   */
+  void expandVertex(const boost::shared_ptr<Vertex>& vertex,
+                    std::vector<boost::shared_ptr<Vertex>>& open_vertices,
+                    std::vector<boost::shared_ptr<Vertex>>& terminal_vertices);
+
   std::vector<boost::shared_ptr<Vertex>> connectVertexToFrontNode(
         const boost::shared_ptr<Vertex>& vertex,
         const boost::shared_ptr<const WaypointNode>& target_node);
@@ -482,12 +807,80 @@ protected:
       const boost::shared_ptr<Vertex>& vertex,
       const boost::shared_ptr<const WaypointNode>& target_node);
 
+  /**
+   * \brief Screen an edge before its path is optimized, see \c EdgeScreening.
+   *
+   * \param[in] vertex The vertex the edge starts from.
+   * \param[in] target_node The node where the edge ends.
+   * \param[in] lane_change_type The lane change of the edge.
+   * \param[out] options Whether each of the acceleration options should be
+   *             simulated, i.e. active and not rejected.
+   * \return False if the whole edge is rejected.
+   */
+  const bool screenEdge(
+      const boost::shared_ptr<Vertex>& vertex,
+      const boost::shared_ptr<const WaypointNode>& target_node,
+      const ContinuousPath::LaneChangeType lane_change_type,
+      std::array<bool, kAccelerationOptions_.size()>& options) const;
+
+  /**
+   * \brief Simulate the traffic forward with the ego applying each of the
+   *        acceleration options over the given path.
+   *
+   * The simulations are independent of each other, and are run in parallel
+   * if \c thread_pool_ is available. The function does not touch the vertex
+   * graph, so that the results can be merged into the graph in the order
+   * of the acceleration options afterwards, regardless of the threads.
+   *
+   * \param[in] vertex The vertex to start the simulation from.
+   * \param[in] path The path to be followed by the ego.
+   * \param[in] target_node The node where the path ends.
+   * \param[in] option 0, 1, 2 for the path to the front, left front,
+   *                   and right front node respectively. Together with the
+   *                   nodes, it identifies the simulations in \c rolloutCache().
+   * \param[in] options Whether each of the acceleration options is simulated,
+   *                    see \c screenEdge().
+   * \param[in] caller Name of the calling function, used in the warnings.
+   * \param[out] stage_costs The stage cost of each acceleration option.
+   * \return The new vertex at the end of the simulation for each acceleration
+   *         option, or \c nullptr if the option leads to collision, fails,
+   *         or is not simulated.
+   */
+  std::array<boost::shared_ptr<Vertex>, kAccelerationOptions_.size()>
+    simulateAccelerationOptions(
+        const boost::shared_ptr<Vertex>& vertex,
+        const ContinuousPath& path,
+        const boost::shared_ptr<const WaypointNode>& target_node,
+        const size_t option,
+        const std::array<bool, kAccelerationOptions_.size()>& options,
+        const std::string& caller,
+        std::array<double, kAccelerationOptions_.size()>& stage_costs) const;
+
   /// Compute the speed cost for a terminal vertex.
   const double terminalSpeedCost(const boost::shared_ptr<Vertex>& vertex) const;
 
+  /// Compute the speed cost given the ego speed and policy speed at a terminal.
+  const double terminalSpeedCost(const double speed, const double policy_speed) const;
+
   /// Compute the distance cost for a terminal vertex.
   const double terminalDistanceCost(const boost::shared_ptr<Vertex>& vertex) const;
 
+  /// Compute the distance cost given the distance from the root to a terminal.
+  const double terminalDistanceCost(const double distance) const;
+
+  /**
+   * \brief Compute a lower bound of the cost of any terminal reachable
+   *        from the given vertex, including the vertex itself.
+   *
+   * The bound adds up the cost-to-come of the vertex, the lower bound of the
+   * stage cost, i.e. \c CostModel::minPolicyStageCost(), for
+   * each station left on the waypoint lattice, the speed cost at the highest
+   * speed reachable at the end of the lattice, and the distance cost at the
+   * end of the lattice. The bound is admissible as long as the terminal cost
+   * tables of the cost model are non-increasing, as the default ones are.
+   */
+  const double terminalCostLowerBound(const boost::shared_ptr<Vertex>& vertex) const;
+
   /// Compute the cost from root to this terminal, including the terminal costs.
   const double costFromRootToTerminal(const boost::shared_ptr<Vertex>& terminal) const;
 
@@ -499,13 +892,22 @@ protected:
   /// Merge the path segements from \c selectOptimalTraj() into a single discrete path.
   DiscretePath mergePaths(const std::list<ContinuousPath>& paths) const;
 
+  /**
+   * \brief Estimate the time (s) the ego takes to move from a parent to a child vertex.
+   *
+   * The ego keeps a constant acceleration through a stage, with which the time
+   * is recovered from the distance and the speeds at both ends. The estimate is
+   * bounded by \c kMaxStageTime_, e.g. for the ego stopping within the stage.
+   */
+  const double stageTime(const boost::shared_ptr<const Vertex>& parent,
+                         const boost::shared_ptr<const Vertex>& child) const;
+
   /**
    * \brief Try to find a vertex in the table that shared the same station and
-   *        the same speed interval with the given vertex.
+   *        the same bucket of \c state_discretization_ with the given vertex.
    *
    * The function throws runtime error if the ego speed within the input vertex
-   * is not within the valid range. The valid range is defined by
-   * \c Vertex::kSpeedIntervalsPerStation_.
+   * is not within the valid range of \c state_discretization_.
    *
    * \param[in] vertex The query vertex.
    * \return \c nullptr if no vertex satisfying the requirement is found. Otherwise,
@@ -524,16 +926,22 @@ protected:
    * \param[in] vertex The vertex to be added to the table.
    */
   void addVertexToTable(const boost::shared_ptr<Vertex>& vertex) {
-    boost::optional<size_t> idx = Vertex::speedIntervalIdx(vertex->speed());
+    boost::optional<size_t> idx =
+      state_discretization_.bucket(vertex->speed(), vertex->time());
     if (!idx) {
       std::string error_msg(
-          "SpatiotemporalLatticePlanner::addVertexToTable(): ",
+          "SpatiotemporalLatticePlanner::addVertexToTable(): "
           "The speed of the input vertex is invalid.\n");
       error_msg += vertex->string();
       throw std::runtime_error(error_msg);
     }
 
-    node_to_vertices_table_[vertex->node().lock()->id()][*idx] = vertex;
+    std::vector<boost::shared_ptr<Vertex>>& vertices =
+      node_to_vertices_table_[vertex->node().lock()->id()];
+    if (vertices.empty()) vertices.resize(state_discretization_.size());
+    vertices[*idx] = vertex;
+    // The snapshots of the vertices with parents are counted with the parents.
+    if (!vertex->hasParents()) graph_memory_.addSnapshot(vertex->snapshot());
     return;
   }
 
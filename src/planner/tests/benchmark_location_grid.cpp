@@ -0,0 +1,132 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/**
+ * Benchmark of the closest location queries with \c utils::LocationGrid,
+ * which backs \c utils::FastWaypointMap, against \c pcl::KdTreeFLANN.
+ *
+ * The locations are sampled on a number of synthetic lanes with the same
+ * resolution as the waypoints in \c utils::FastWaypointMap. The queries are
+ * randomly perturbed locations around the lanes, similar to the locations
+ * of the vehicles.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <boost/timer/timer.hpp>
+
+#include <pcl/point_cloud.h>
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include <carla/geom/Location.h>
+#include <planner/common/location_grid.h>
+
+using CarlaLocation = carla::geom::Location;
+
+int main(int argc, char** argv) {
+
+  const double resolution = 0.05;
+  const size_t num_roads = 20;
+  const size_t num_lanes = 4;
+  const double road_length = 500.0;
+  const double lane_width = 3.5;
+  const size_t num_queries = 100000;
+
+  // Generate the locations on the lanes. Each road is a circular arc
+  // with a random center and radius.
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<double> center_dist(-500.0, 500.0);
+  std::uniform_real_distribution<double> radius_dist(100.0, 1000.0);
+
+  std::vector<CarlaLocation> locations;
+  for (size_t road = 0; road < num_roads; ++road) {
+    const double cx = center_dist(generator);
+    const double cy = center_dist(generator);
+    const double radius = radius_dist(generator);
+
+    for (size_t lane = 0; lane < num_lanes; ++lane) {
+      const double r = radius + lane*lane_width;
+      for (double s = 0.0; s < road_length; s += resolution) {
+        locations.emplace_back(
+            cx + r*std::cos(s/radius), cy + r*std::sin(s/radius), 0.0);
+      }
+    }
+  }
+
+  // Generate the queries around the locations.
+  std::uniform_int_distribution<size_t> index_dist(0, locations.size()-1);
+  std::normal_distribution<double> noise_dist(0.0, 1.0);
+  std::vector<CarlaLocation> queries;
+  queries.reserve(num_queries);
+  for (size_t i = 0; i < num_queries; ++i) {
+    const CarlaLocation& location = locations[index_dist(generator)];
+    queries.emplace_back(location.x + noise_dist(generator),
+                         location.y + noise_dist(generator),
+                         location.z + 0.1*noise_dist(generator));
+  }
+
+  std::printf("locations: %lu queries: %lu\n", locations.size(), queries.size());
+
+  // Build the KD tree.
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud =
+    boost::make_shared<pcl::PointCloud<pcl::PointXYZ>>();
+  pcl::KdTreeFLANN<pcl::PointXYZ> kdtree;
+  {
+    boost::timer::auto_cpu_timer timer("kdtree construction: %ws\n");
+    for (const auto& location : locations)
+      cloud->push_back(pcl::PointXYZ(location.x, location.y, location.z));
+    kdtree.setEpsilon(resolution);
+    kdtree.setInputCloud(cloud);
+  }
+
+  // Build the grid.
+  boost::timer::cpu_timer grid_timer;
+  utils::LocationGrid grid(locations, std::max(1.0, 10.0*resolution));
+  std::printf("grid construction: %fs\n", grid_timer.elapsed().wall*1.0e-9);
+
+  // Query with the KD tree.
+  std::vector<int> kdtree_results(queries.size());
+  {
+    boost::timer::auto_cpu_timer timer("kdtree queries: %ws\n");
+    for (size_t i = 0; i < queries.size(); ++i) {
+      std::vector<int> indices(1);
+      std::vector<float> sqr_distances(1);
+      const pcl::PointXYZ point(queries[i].x, queries[i].y, queries[i].z);
+      kdtree.nearestKSearch(point, 1, indices, sqr_distances);
+      kdtree_results[i] = indices[0];
+    }
+  }
+
+  // Query with the grid.
+  std::vector<utils::LocationGrid::Index> grid_results(queries.size());
+  {
+    boost::timer::auto_cpu_timer timer("grid queries: %ws\n");
+    grid.closest(queries.data(), queries.size(), grid_results.data());
+  }
+
+  // Compare the results. The KD tree search is approximate given the
+  // epsilon, so only count the queries where the grid is worse.
+  size_t worse = 0;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    const double kdtree_distance = (locations[kdtree_results[i]]-queries[i]).Length();
+    const double grid_distance = (locations[grid_results[i]]-queries[i]).Length();
+    if (grid_distance > kdtree_distance+1.0e-4) ++worse;
+  }
+  std::printf("queries where the grid is worse than the kdtree: %lu\n", worse);
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include <carla/client/Map.h>
+#include <carla/client/Waypoint.h>
+
+#include <router/loop_router/loop_router.h>
+#include <planner/common/vehicle.h>
+#include <planner/common/fast_waypoint_map.h>
+#include <planner/common/waypoint_graph.h>
+#include <node/common/load_map.h>
+
+#ifndef CLP_BENCHMARK_MAP
+#define CLP_BENCHMARK_MAP "data/benchmark_loop.xodr"
+#endif
+
+namespace planner {
+
+/**
+ * \brief BenchmarkLoopTest runs the tests on the loop in
+ *        \c data/benchmark_loop.xodr, loaded without a carla server.
+ *
+ * The map is the same as the one of \c core_benchmarks. It is loaded once
+ * and shared by all tests of the executable, which should not modify it.
+ * The loop consists of roads 1 to 4, each with three driving lanes 3.5m
+ * wide on the right of the reference line. The first road is a straight
+ * along +x starting from the origin.
+ */
+class BenchmarkLoopTest : public ::testing::Test {
+
+protected:
+
+  using CarlaMap         = carla::client::Map;
+  using CarlaWaypoint    = carla::client::Waypoint;
+  using CarlaLocation    = carla::geom::Location;
+  using CarlaVector3D    = carla::geom::Vector3D;
+  using CarlaTransform   = carla::geom::Transform;
+  using CarlaBoundingBox = carla::geom::BoundingBox;
+
+  struct Environment {
+    boost::shared_ptr<CarlaMap> map = nullptr;
+    boost::shared_ptr<utils::FastWaypointMap> fast_map = nullptr;
+    boost::shared_ptr<const utils::WaypointGraph> graph = nullptr;
+    boost::shared_ptr<router::LoopRouter> router = nullptr;
+
+    /// Waypoints sampled every 2m on all the lanes of the map.
+    std::vector<boost::shared_ptr<CarlaWaypoint>> waypoints;
+  };
+
+  static const Environment& environment() {
+    static const Environment env = createEnvironment();
+    return env;
+  }
+
+  static const boost::shared_ptr<CarlaMap>& map() { return environment().map; }
+  static const boost::shared_ptr<utils::FastWaypointMap>& fastMap() { return environment().fast_map; }
+  static const boost::shared_ptr<const utils::WaypointGraph>& graph() { return environment().graph; }
+  static const boost::shared_ptr<router::LoopRouter>& router() { return environment().router; }
+
+  /// Every \c stride-th of the waypoints of the environment on the loop.
+  static std::vector<boost::shared_ptr<CarlaWaypoint>> routeWaypoints(const size_t stride = 1) {
+    std::vector<boost::shared_ptr<CarlaWaypoint>> waypoints;
+    const std::vector<boost::shared_ptr<CarlaWaypoint>>& all = environment().waypoints;
+    for (size_t i = 0; i < all.size(); i += stride) {
+      if (router()->hasRoad(all[i]->GetRoadId())) waypoints.push_back(all[i]);
+    }
+    return waypoints;
+  }
+
+  /// The y coordinate of the center of a lane on the first straight, 1 to 3 from left to right.
+  static float laneY(const int lane) { return -(lane-0.5f)*3.5f; }
+
+  /// Create a vehicle of the usual size on the waypoint closest to the location.
+  static Vehicle createVehicle(const size_t id,
+                               const CarlaLocation& location,
+                               const double speed) {
+    const boost::shared_ptr<CarlaWaypoint> waypoint = fastMap()->waypoint(location);
+    if (!waypoint) {
+      throw std::runtime_error((boost::format(
+            "BenchmarkLoopTest::createVehicle(): no waypoint at x:%1% y:%2%.\n")
+            % location.x % location.y).str());
+    }
+    const CarlaVector3D extent(2.4f, 0.95f, 0.75f);
+    return Vehicle(
+        id, CarlaBoundingBox(CarlaLocation(0.0f, 0.0f, extent.z), extent),
+        waypoint->GetTransform(), speed, 29.0, 0.0, fastMap()->curvature(waypoint));
+  }
+
+  /// Whether two waypoints are the same, where either may be \c nullptr.
+  static bool sameWaypoint(const boost::shared_ptr<const CarlaWaypoint>& w1,
+                           const boost::shared_ptr<const CarlaWaypoint>& w2) {
+    if (!w1 || !w2) return !w1 && !w2;
+    return w1->GetId() == w2->GetId();
+  }
+
+  /// Whether two waypoints are on the same lane and within the tolerance (m).
+  static bool closeWaypoint(const boost::shared_ptr<const CarlaWaypoint>& w1,
+                            const boost::shared_ptr<const CarlaWaypoint>& w2,
+                            const double tolerance) {
+    if (!w1 || !w2) return !w1 && !w2;
+    return w1->GetRoadId() == w2->GetRoadId() &&
+           w1->GetLaneId() == w2->GetLaneId() &&
+           w1->GetTransform().location.Distance(w2->GetTransform().location) <= tolerance;
+  }
+
+  /// Whether any of the first waypoints is close to any of the second ones, see \c closeWaypoint().
+  static bool anyCloseWaypoint(const std::vector<boost::shared_ptr<CarlaWaypoint>>& w1,
+                               const std::vector<boost::shared_ptr<CarlaWaypoint>>& w2,
+                               const double tolerance) {
+    for (const auto& a : w1) {
+      for (const auto& b : w2)
+        if (closeWaypoint(a, b, tolerance)) return true;
+    }
+    return false;
+  }
+
+private:
+
+  static Environment createEnvironment() {
+    Environment env;
+    env.map = node::loadMap(CLP_BENCHMARK_MAP);
+    env.fast_map = boost::make_shared<utils::FastWaypointMap>(env.map, 0.05);
+    env.graph = boost::make_shared<const utils::WaypointGraph>(env.fast_map);
+    env.router = boost::make_shared<router::LoopRouter>(std::vector<size_t>{1, 2, 3, 4});
+    env.router->setWaypointGraph(env.graph);
+    env.router->buildRouteIndex(env.map);
+    env.waypoints = env.map->GenerateWaypoints(2.0);
+    return env;
+  }
+
+}; // End class BenchmarkLoopTest.
+
+} // End namespace planner.
@@ -0,0 +1,410 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/**
+ * Micro-benchmarks of the core primitives of the planners.
+ *
+ * Different from \c planner_benchmarks, which measures whole planning cycles
+ * on recorded traffic, every primitive is measured in isolation here, so that
+ * an optimization of one primitive can be evaluated on its own. The map is
+ * the small loop in \c data/benchmark_loop.xodr by default, loaded without a
+ * carla server, and the traffic is placed on it deterministically.
+ *
+ * Every primitive is run in batches until the minimum time has elapsed. The
+ * mean, p50, and p99 time per call over the batches are reported on stdout,
+ * and written as JSON to the result file if it is given, for trend tracking.
+ *
+ * Usage:
+ *   core_benchmarks [results.json] [min_time] [map.xodr]
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/timer/timer.hpp>
+
+#include <carla/client/Map.h>
+#include <carla/client/Waypoint.h>
+
+#include <router/loop_router/loop_router.h>
+#include <planner/common/utils.h>
+#include <planner/common/kn_path_gen.h>
+#include <planner/common/vehicle_path.h>
+#include <planner/common/snapshot.h>
+#include <planner/common/traffic_lattice.h>
+#include <planner/common/fast_waypoint_map.h>
+#include <planner/common/intelligent_driver_model.h>
+#include <planner/idm_lattice_planner/idm_lattice_planner.h>
+#include <planner/slc_lattice_planner/slc_lattice_planner.h>
+#include <planner/spatiotemporal_lattice_planner/spatiotemporal_lattice_planner.h>
+#include <node/common/load_map.h>
+
+#ifndef CLP_BENCHMARK_MAP
+#define CLP_BENCHMARK_MAP "data/benchmark_loop.xodr"
+#endif
+
+using CarlaMap         = carla::client::Map;
+using CarlaWaypoint    = carla::client::Waypoint;
+using CarlaLocation    = carla::geom::Location;
+using CarlaVector3D    = carla::geom::Vector3D;
+using CarlaTransform   = carla::geom::Transform;
+using CarlaBoundingBox = carla::geom::BoundingBox;
+
+namespace {
+
+/// Timing of one primitive.
+struct BenchmarkResult {
+  std::string name;
+  /// Total number of calls timed.
+  size_t iterations = 0;
+  /// Time (ns) per call, averaged within each batch.
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p99 = 0.0;
+};
+
+/// Keep the compiler from optimizing away the value of a call.
+template<typename T>
+inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+double percentile(std::vector<double> values, const double p) {
+  if (values.empty()) return std::numeric_limits<double>::quiet_NaN();
+  std::sort(values.begin(), values.end());
+  const size_t rank = static_cast<size_t>(std::ceil(p*values.size()));
+  return values[std::max<size_t>(rank, 1) - 1];
+}
+
+/**
+ * \brief Time a primitive.
+ *
+ * \param[in] name The name of the primitive in the results.
+ * \param[in] batch The number of calls timed together, which should be
+ *                  large enough for the timer resolution.
+ * \param[in] min_time The minimum time (s) spent on the primitive.
+ * \param[in] call Calls the primitive once with the index of the call,
+ *                 so that the inputs can be varied across the calls.
+ */
+template<typename Call>
+BenchmarkResult benchmark(const std::string& name,
+                          const size_t batch,
+                          const double min_time,
+                          Call&& call) {
+  // Warm up the caches, including the ones of the primitives.
+  for (size_t i = 0; i < batch; ++i) call(i);
+
+  std::vector<double> batch_times;
+  size_t iterations = 0;
+  double total_time = 0.0;
+
+  while (total_time < min_time || batch_times.size() < 10) {
+    boost::timer::cpu_timer timer;
+    for (size_t i = 0; i < batch; ++i) call(iterations+i);
+    const double time = timer.elapsed().wall*1.0e-9;
+
+    batch_times.push_back(time/batch*1.0e9);
+    total_time += time;
+    iterations += batch;
+  }
+
+  BenchmarkResult result;
+  result.name = name;
+  result.iterations = iterations;
+  result.mean = total_time/iterations*1.0e9;
+  result.p50 = percentile(batch_times, 0.5);
+  result.p99 = percentile(batch_times, 0.99);
+
+  std::printf("%-36s %12lu %12.1f %12.1f %12.1f\n",
+      result.name.c_str(), result.iterations, result.mean, result.p50, result.p99);
+  std::fflush(stdout);
+  return result;
+}
+
+void writeResults(const std::string& filename,
+                  const std::string& map_filename,
+                  const std::vector<BenchmarkResult>& results) {
+  FILE* file = filename == "-" ? stdout : std::fopen(filename.c_str(), "w");
+  if (!file) {
+    throw std::runtime_error((boost::format(
+          "writeResults(): cannot open the result file %1%.\n") % filename).str());
+  }
+
+  std::fprintf(file, "{\n  \"context\": {\"map\": \"%s\", \"time_unit\": \"ns\"},\n",
+      map_filename.c_str());
+  std::fprintf(file, "  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    std::fprintf(file,
+        "    {\"name\": \"%s\", \"iterations\": %lu, "
+        "\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f}%s\n",
+        results[i].name.c_str(), results[i].iterations,
+        results[i].mean, results[i].p50, results[i].p99,
+        i+1 < results.size() ? "," : "");
+  }
+  std::fprintf(file, "  ]\n}\n");
+
+  if (file != stdout) std::fclose(file);
+  return;
+}
+
+/// The map, the router, and the traffic shared by the benchmarks.
+struct Environment {
+  boost::shared_ptr<router::LoopRouter> router = nullptr;
+  boost::shared_ptr<CarlaMap> map = nullptr;
+  boost::shared_ptr<utils::FastWaypointMap> fast_map = nullptr;
+
+  /// Waypoints sampled on all the lanes of the map.
+  std::vector<boost::shared_ptr<CarlaWaypoint>> waypoints;
+
+  /// The ego and the agents on the first straight of the loop.
+  planner::Vehicle ego;
+  std::unordered_map<size_t, planner::Vehicle> agents;
+};
+
+planner::Vehicle createVehicle(
+    const Environment& env, const size_t id,
+    const CarlaLocation& location, const double speed) {
+  const boost::shared_ptr<CarlaWaypoint> waypoint = env.fast_map->waypoint(location);
+  if (!waypoint) {
+    throw std::runtime_error((boost::format(
+          "createVehicle(): no waypoint at x:%1% y:%2%.\n") % location.x % location.y).str());
+  }
+  const CarlaVector3D extent(2.4f, 0.95f, 0.75f);
+  return planner::Vehicle(
+      id, CarlaBoundingBox(CarlaLocation(0.0f, 0.0f, extent.z), extent),
+      waypoint->GetTransform(), speed, 29.0, 0.0, env.fast_map->curvature(waypoint));
+}
+
+/**
+ * The ego is at the middle lane 100m after the start of the first straight,
+ * with the agents spread on all three lanes within 100m around the ego.
+ * The lanes are 3.5m wide on the right of the reference line along +x.
+ */
+void createTraffic(Environment& env) {
+  const auto laneY = [](const int lane)->float{ return -(lane-0.5f)*3.5f; };
+
+  env.ego = createVehicle(env, 0, CarlaLocation(100.0f, laneY(2), 0.0f), 25.0);
+
+  size_t id = 1;
+  for (int lane = 1; lane <= 3; ++lane) {
+    for (float x = 55.0f; x <= 155.0f; x += 25.0f) {
+      // Leave room for the ego.
+      if (lane == 2 && std::fabs(x-100.0f) < 10.0f) continue;
+      const float offset = 5.0f*(lane-2);
+      env.agents[id] = createVehicle(
+          env, id, CarlaLocation(x+offset, laneY(lane), 0.0f), 20.0+2.0*lane);
+      ++id;
+    }
+  }
+  return;
+}
+
+std::vector<planner::TrafficLattice::VehicleTuple> vehicleTuples(const Environment& env) {
+  std::vector<planner::TrafficLattice::VehicleTuple> vehicles;
+  vehicles.push_back(planner::TrafficLattice::VehicleTuple(
+        env.ego.id(), env.ego.transform(), env.ego.boundingBox()));
+  for (const auto& item : env.agents) {
+    vehicles.push_back(planner::TrafficLattice::VehicleTuple(
+          item.second.id(), item.second.transform(), item.second.boundingBox()));
+  }
+  return vehicles;
+}
+
+/// The path of the ego keeping the lane for 50m.
+boost::shared_ptr<planner::ContinuousPath> egoPath(const Environment& env) {
+  const boost::shared_ptr<CarlaWaypoint> start =
+    env.fast_map->waypoint(env.ego.transform().location);
+  const boost::shared_ptr<CarlaWaypoint> end = env.router->frontWaypoint(start, 50.0);
+  if (!end) {
+    throw std::runtime_error("egoPath(): cannot find the end of the ego path.\n");
+  }
+  return boost::make_shared<planner::ContinuousPath>(
+      std::make_pair(env.ego.transform(), env.ego.curvature()),
+      std::make_pair(end->GetTransform(), env.fast_map->curvature(end)),
+      planner::ContinuousPath::LaneChangeType::KeepLane);
+}
+
+template<typename Simulator>
+BenchmarkResult benchmarkSimulator(
+    const std::string& name,
+    const Environment& env,
+    const planner::Snapshot& snapshot,
+    const planner::ContinuousPath& path,
+    const double min_time) {
+  return benchmark(name, 4, min_time, [&env, &snapshot, &path](const size_t) {
+    Simulator simulator(snapshot, env.map, env.fast_map);
+    double time = 0.0; double cost = 0.0;
+    const bool no_collision = simulator.simulate(path, 0.1, 5.0, time, cost);
+    doNotOptimize(no_collision);
+    doNotOptimize(cost);
+  });
+}
+
+} // End anonymous namespace.
+
+int main(int argc, char** argv) {
+
+  const std::string result_filename = argc > 1 ? argv[1] : "";
+  const double min_time = argc > 2 ? std::max(std::atof(argv[2]), 0.01) : 0.5;
+  const std::string map_filename = argc > 3 ? argv[3] : CLP_BENCHMARK_MAP;
+
+  Environment env;
+  {
+    boost::timer::cpu_timer timer;
+    env.map = node::loadMap(map_filename);
+    // The waypoints are not cached on the disk, so that the map
+    // preparation does not depend on the previous runs.
+    env.fast_map = boost::make_shared<utils::FastWaypointMap>(env.map, 0.05);
+    env.router = boost::make_shared<router::LoopRouter>(std::vector<size_t>{1, 2, 3, 4});
+    env.router->setWaypointGraph(
+        boost::make_shared<const utils::WaypointGraph>(env.fast_map));
+    env.router->buildRouteIndex(env.map);
+    env.waypoints = env.map->GenerateWaypoints(2.0);
+    createTraffic(env);
+    std::printf("map preparation: %fs waypoints: %lu vehicles: %lu\n",
+        timer.elapsed().wall*1.0e-9, env.waypoints.size(), env.agents.size()+1);
+  }
+
+  const std::vector<planner::TrafficLattice::VehicleTuple> vehicles = vehicleTuples(env);
+  const planner::TrafficLattice traffic_lattice(vehicles, env.map, env.fast_map, env.router);
+  const planner::Snapshot snapshot(env.ego, env.agents, env.router, env.map, env.fast_map);
+  const boost::shared_ptr<planner::ContinuousPath> ego_path = egoPath(env);
+
+  // Queries around the lane centers, similar to the locations of the vehicles.
+  std::mt19937 generator(0);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  std::vector<CarlaLocation> locations;
+  for (size_t i = 0; i < 1024; ++i) {
+    const CarlaLocation location =
+      env.waypoints[i*7919 % env.waypoints.size()]->GetTransform().location;
+    locations.emplace_back(location.x+noise(generator), location.y+noise(generator), location.z);
+  }
+
+  // Boundary states of the paths, for keeping the lane and changing lanes on both sides.
+  const std::vector<std::pair<planner::NonHolonomicPath::State,
+                              planner::NonHolonomicPath::State>> boundaries{
+    {{0.0, 0.0, 0.0, 0.0},   {50.0, 0.0, 0.0, 0.0}},
+    {{0.0, 0.0, 0.0, 0.0},   {50.0, 3.5, 0.0, 0.0}},
+    {{0.0, 0.0, 0.0, 0.0},   {50.0, -3.5, 0.0, 0.0}},
+    {{0.0, 0.0, 0.0, 0.01},  {45.0, 12.0, 0.5, 0.01}},
+  };
+
+  std::vector<size_t> vehicle_ids{env.ego.id()};
+  for (const auto& item : env.agents) vehicle_ids.push_back(item.first);
+
+  // Inputs of the IDM, covering the free road and the car following cases.
+  std::vector<double> idm_speeds(256), idm_gaps(256);
+  std::uniform_real_distribution<double> speed_dist(0.0, 35.0);
+  std::uniform_real_distribution<double> gap_dist(2.0, 120.0);
+  for (size_t i = 0; i < idm_speeds.size(); ++i) {
+    idm_speeds[i] = speed_dist(generator);
+    idm_gaps[i] = i%4 == 0 ? std::numeric_limits<double>::infinity() : gap_dist(generator);
+  }
+  const planner::BasicIntelligentDriverModel basic_idm;
+
+  std::printf("%-36s %12s %12s %12s %12s\n", "benchmark", "iterations", "mean(ns)", "p50(ns)", "p99(ns)");
+  std::vector<BenchmarkResult> results;
+
+  results.push_back(benchmark("FastWaypointMap::waypoint", 1024, min_time,
+        [&env, &locations](const size_t i) {
+          doNotOptimize(env.fast_map->waypoint(locations[i%locations.size()]));
+        }));
+
+  results.push_back(benchmark("utils::curvatureAtWaypoint", 64, min_time,
+        [&env](const size_t i) {
+          doNotOptimize(utils::curvatureAtWaypoint(
+                env.waypoints[i%env.waypoints.size()], env.map));
+        }));
+
+  results.push_back(benchmark("NonHolonomicPath::optimizePath", 16, min_time,
+        [&boundaries](const size_t i) {
+          planner::NonHolonomicPath path;
+          const auto& boundary = boundaries[i%boundaries.size()];
+          doNotOptimize(path.optimizePath(boundary.first, boundary.second));
+        }));
+
+  results.push_back(benchmark("ContinuousPath::transformAt", 1024, min_time,
+        [&ego_path](const size_t i) {
+          doNotOptimize(ego_path->transformAt(
+                static_cast<double>(i%100)/100.0*ego_path->range()));
+        }));
+
+  results.push_back(benchmark("TrafficLattice::TrafficLattice", 4, min_time,
+        [&env, &vehicles](const size_t) {
+          planner::TrafficLattice lattice(vehicles, env.map, env.fast_map, env.router);
+          doNotOptimize(lattice);
+        }));
+
+  results.push_back(benchmark("TrafficLattice copy", 64, min_time,
+        [&traffic_lattice](const size_t) {
+          planner::TrafficLattice lattice(traffic_lattice);
+          doNotOptimize(lattice);
+        }));
+
+  results.push_back(benchmark("TrafficLattice::front", 1024, min_time,
+        [&traffic_lattice, &vehicle_ids](const size_t i) {
+          doNotOptimize(traffic_lattice.front(vehicle_ids[i%vehicle_ids.size()]));
+        }));
+
+  results.push_back(benchmark("Snapshot copy", 64, min_time,
+        [&snapshot](const size_t) {
+          planner::Snapshot copy(snapshot);
+          doNotOptimize(copy);
+        }));
+
+  results.push_back(benchmarkSimulator<planner::idm_lattice_planner::IDMTrafficSimulator>(
+        "IDMTrafficSimulator::simulate", env, snapshot, *ego_path, min_time));
+  results.push_back(benchmarkSimulator<planner::slc_lattice_planner::SLCTrafficSimulator>(
+        "SLCTrafficSimulator::simulate", env, snapshot, *ego_path, min_time));
+  results.push_back(benchmarkSimulator<planner::spatiotemporal_lattice_planner::ConstAccelTrafficSimulator>(
+        "ConstAccelTrafficSimulator::simulate", env, snapshot, *ego_path, min_time));
+
+  results.push_back(benchmark("BasicIntelligentDriverModel::idm", 1024, min_time,
+        [&basic_idm, &idm_speeds, &idm_gaps](const size_t i) {
+          const size_t k = i % idm_speeds.size();
+          const size_t l = (i+1) % idm_speeds.size();
+          if (std::isinf(idm_gaps[k])) {
+            doNotOptimize(basic_idm.idm(idm_speeds[k], 29.0));
+          } else {
+            doNotOptimize(basic_idm.idm(idm_speeds[k], 29.0, idm_speeds[l], idm_gaps[k]));
+          }
+        }));
+
+  std::vector<double> idm_accels(idm_speeds.size());
+  const std::vector<double> idm_policy_speeds(idm_speeds.size(), 29.0);
+  std::vector<double> idm_lead_speeds(idm_speeds.size());
+  std::rotate_copy(idm_speeds.begin(), idm_speeds.begin()+1, idm_speeds.end(), idm_lead_speeds.begin());
+  results.push_back(benchmark("BasicIntelligentDriverModel::idm batched", 16, min_time,
+        [&basic_idm, &idm_speeds, &idm_policy_speeds, &idm_lead_speeds, &idm_gaps, &idm_accels](const size_t) {
+          basic_idm.idm(idm_speeds.data(), idm_policy_speeds.data(), idm_lead_speeds.data(),
+                        idm_gaps.data(), idm_speeds.size(), idm_accels.data());
+          doNotOptimize(idm_accels.front());
+        }));
+
+  if (!result_filename.empty()) writeResults(result_filename, map_filename, results);
+
+  return 0;
+}
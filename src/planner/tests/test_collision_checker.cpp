@@ -0,0 +1,132 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include <planner/common/collision_checker.h>
+
+using namespace planner;
+
+namespace {
+
+/// Footprint of a vehicle of the usual size at (x, y) with the given yaw (rad).
+CollisionChecker::Footprint footprint(const double x, const double y, const double yaw) {
+  CollisionChecker::Footprint footprint;
+  footprint.x = x;
+  footprint.y = y;
+  footprint.yaw = yaw;
+  footprint.half_length = 2.4;
+  footprint.half_width = 0.95;
+  return footprint;
+}
+
+/// Footprint of a vehicle driving counter-clockwise on a circle
+/// centered at the origin, at the angle phi (rad).
+CollisionChecker::Footprint circleFootprint(const double radius, const double phi) {
+  return footprint(radius*std::cos(phi), radius*std::sin(phi), phi+M_PI/2.0);
+}
+
+} // End anonymous namespace.
+
+TEST(CollisionChecker, footprint) {
+  const carla::geom::Transform transform(
+      carla::geom::Location(10.0f, 5.0f, 0.0f),
+      carla::geom::Rotation(0.0f, 90.0f, 0.0f));
+  const carla::geom::BoundingBox bounding_box(
+      carla::geom::Location(1.0f, 0.0f, 0.75f),
+      carla::geom::Vector3D(2.4f, 0.95f, 0.75f));
+
+  // The offset of the bounding box rotates with the vehicle.
+  const CollisionChecker::Footprint footprint(transform, bounding_box);
+  EXPECT_NEAR(footprint.x, 10.0, 1e-5);
+  EXPECT_NEAR(footprint.y, 6.0, 1e-5);
+  EXPECT_NEAR(footprint.yaw, M_PI/2.0, 1e-5);
+  EXPECT_NEAR(footprint.half_length, 2.4, 1e-5);
+  EXPECT_NEAR(footprint.half_width, 0.95, 1e-5);
+}
+
+TEST(CollisionChecker, straightSameLane) {
+  // The follower closes the gap from 25.2m to 20.2m within the step.
+  EXPECT_FALSE(CollisionChecker::sweptOverlap(
+        footprint(0.0, 0.0, 0.0), footprint(20.0, 0.0, 0.0),
+        footprint(30.0, 0.0, 0.0), footprint(45.0, 0.0, 0.0)));
+
+  // The follower runs into the leader within the step.
+  EXPECT_TRUE(CollisionChecker::sweptOverlap(
+        footprint(0.0, 0.0, 0.0), footprint(20.0, 0.0, 0.0),
+        footprint(10.0, 0.0, 0.0), footprint(12.0, 0.0, 0.0)));
+
+  // The follower passes through the leader within the step,
+  // without overlapping at either end of the step.
+  EXPECT_TRUE(CollisionChecker::sweptOverlap(
+        footprint(0.0, 0.0, 0.0), footprint(40.0, 0.0, 0.0),
+        footprint(10.0, 0.0, 0.0), footprint(15.0, 0.0, 0.0)));
+}
+
+TEST(CollisionChecker, adjacentLanesOnCurve) {
+  // Two vehicles side by side on the adjacent lanes, 3.5m apart, turning
+  // by 0.4rad within a long step. The corners of the vehicles are displaced
+  // by more than the 1.6m lateral clearance due to the rotation.
+  const double inner = 50.0;
+  const double outer = 53.5;
+
+  EXPECT_FALSE(CollisionChecker::sweptOverlap(
+        circleFootprint(inner, 0.0), circleFootprint(inner, 0.4),
+        circleFootprint(outer, 0.0), circleFootprint(outer, 0.4)));
+
+  // The same with the outer vehicle slightly ahead.
+  EXPECT_FALSE(CollisionChecker::sweptOverlap(
+        circleFootprint(inner, 0.0), circleFootprint(inner, 0.4),
+        circleFootprint(outer, 0.05), circleFootprint(outer, 0.45)));
+
+  // The checker finds no collision among the vehicles either.
+  CollisionChecker checker;
+  const std::vector<CollisionChecker::Footprint> starts{
+    circleFootprint(inner, 0.0), circleFootprint(outer, 0.0), circleFootprint(inner, 0.2)};
+  const std::vector<CollisionChecker::Footprint> ends{
+    circleFootprint(inner, 0.4), circleFootprint(outer, 0.4), circleFootprint(inner, 0.6)};
+  EXPECT_FALSE(checker.sweptCollision(starts, ends));
+
+  // A vehicle running into its leader on the same lane of the curve.
+  const std::vector<CollisionChecker::Footprint> crash_ends{
+    circleFootprint(inner, 0.4), circleFootprint(outer, 0.4), circleFootprint(inner, 0.25)};
+  const auto collision = checker.sweptCollision(starts, crash_ends);
+  ASSERT_TRUE(collision);
+  EXPECT_EQ(collision->first, 0u);
+  EXPECT_EQ(collision->second, 2u);
+}
+
+TEST(CollisionChecker, crossing) {
+  // Two vehicles crossing at the origin at the middle of the step,
+  // without overlapping at either end of the step.
+  EXPECT_TRUE(CollisionChecker::sweptOverlap(
+        footprint(-20.0, 0.0, 0.0), footprint(20.0, 0.0, 0.0),
+        footprint(0.0, -20.0, M_PI/2.0), footprint(0.0, 20.0, M_PI/2.0)));
+
+  // The second vehicle arrives at the crossing after the first one has left.
+  EXPECT_FALSE(CollisionChecker::sweptOverlap(
+        footprint(-20.0, 0.0, 0.0), footprint(20.0, 0.0, 0.0),
+        footprint(0.0, -40.0, M_PI/2.0), footprint(0.0, -5.0, M_PI/2.0)));
+
+  // A vehicle turning across the lane of another one.
+  EXPECT_TRUE(CollisionChecker::sweptOverlap(
+        footprint(-10.0, -3.5, 0.0), footprint(0.0, 5.0, M_PI/2.0),
+        footprint(-20.0, 0.0, 0.0), footprint(10.0, 0.0, 0.0)));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -12,6 +12,9 @@
  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cmath>
+#include <limits>
+#include <vector>
 #include <gtest/gtest.h>
 #include <planner/common/intelligent_driver_model.h>
 
@@ -172,6 +175,48 @@ TEST(AdaptiveCruiseControl, idm) {
   }
 }
 
+namespace {
+
+/**
+ * \brief Check the batched \c idm() against the scalar one.
+ *
+ * Every other vehicle has a lead. The number of vehicles is not a multiple
+ * of the block size, so that the padding of the last block is covered.
+ */
+void expectBatchedIdmEqualsScalar(const BasicIntelligentDriverModel& idm) {
+  const size_t num = 21;
+  std::vector<double> ego_v(num), ego_v0(num), lead_v(num), s(num), accel(num);
+
+  for (size_t i = 0; i < num; ++i) {
+    ego_v[i]  = std::fmod(1.7*i, 35.0);
+    ego_v0[i] = i%3 == 0 ? 20.0 : 29.0;
+    lead_v[i] = std::fmod(2.3*i, 30.0);
+    s[i] = i%2 == 0 ? std::numeric_limits<double>::infinity() : 3.0 + 4.1*i;
+  }
+
+  idm.idm(ego_v.data(), ego_v0.data(), lead_v.data(), s.data(), num, accel.data());
+
+  for (size_t i = 0; i < num; ++i) {
+    const double expected = i%2 == 0 ?
+      idm.idm(ego_v[i], ego_v0[i]) :
+      idm.idm(ego_v[i], ego_v0[i], lead_v[i], s[i]);
+    EXPECT_NEAR(accel[i], expected, 1e-6) << "vehicle " << i;
+  }
+}
+
+} // End anonymous namespace.
+
+TEST(BasicIntelligentDriverModel, batchedIdm) {
+  expectBatchedIdmEqualsScalar(BasicIntelligentDriverModel());
+}
+
+TEST(ImprovedIntelligentDriverModel, batchedIdm) {
+  expectBatchedIdmEqualsScalar(ImprovedIntelligentDriverModel());
+}
+
+TEST(AdaptiveCruiseControl, batchedIdm) {
+  expectBatchedIdmEqualsScalar(AdaptiveCruiseControl());
+}
 
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
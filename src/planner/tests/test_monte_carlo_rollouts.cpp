@@ -0,0 +1,148 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <random>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/smart_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include <planner/common/snapshot.h>
+#include <planner/common/vehicle_path.h>
+#include <planner/common/thread_pool.h>
+#include <planner/common/intelligent_driver_model.h>
+#include <planner/common/monte_carlo_rollouts.h>
+#include <planner/idm_lattice_planner/idm_lattice_planner.h>
+#include <planner/slc_lattice_planner/slc_lattice_planner.h>
+#include "benchmark_loop_fixture.h"
+
+using namespace planner;
+
+class MonteCarloRolloutsTest : public BenchmarkLoopTest {
+
+protected:
+
+  /// The ego on the middle lane of the first straight, with agents on all three lanes.
+  static Snapshot createSnapshot() {
+    const Vehicle ego = createVehicle(0, CarlaLocation(100.0f, laneY(2), 0.0f), 20.0);
+    std::unordered_map<size_t, Vehicle> agents;
+    agents.emplace(1, createVehicle(1, CarlaLocation(140.0f, laneY(2), 0.0f), 15.0));
+    agents.emplace(2, createVehicle(2, CarlaLocation( 90.0f, laneY(1), 0.0f), 22.0));
+    agents.emplace(3, createVehicle(3, CarlaLocation(130.0f, laneY(1), 0.0f), 18.0));
+    agents.emplace(4, createVehicle(4, CarlaLocation(110.0f, laneY(3), 0.0f), 12.0));
+    agents.emplace(5, createVehicle(5, CarlaLocation(150.0f, laneY(3), 0.0f), 10.0));
+    return Snapshot(ego, agents, router(), map(), fastMap());
+  }
+
+  /// The path of the ego keeping its lane for 50m.
+  static ContinuousPath egoPath(const Snapshot& snapshot) {
+    const boost::shared_ptr<CarlaWaypoint> start =
+      fastMap()->waypoint(snapshot.ego().transform().location);
+    const boost::shared_ptr<CarlaWaypoint> end = router()->frontWaypoint(start, 50.0);
+    if (!end) {
+      throw std::runtime_error(
+          "MonteCarloRolloutsTest::egoPath(): cannot find the end of the ego path.\n");
+    }
+    return ContinuousPath(
+        std::make_pair(snapshot.ego().transform(), snapshot.ego().curvature()),
+        std::make_pair(end->GetTransform(), fastMap()->curvature(end)),
+        ContinuousPath::LaneChangeType::KeepLane);
+  }
+
+  /// Hypotheses where every sample is the nominal behaviour of the agents.
+  static AgentHypotheses zeroNoiseHypotheses(const Snapshot& snapshot, const size_t samples) {
+    std::mt19937 rand_gen(0);
+    AgentHypotheses hypotheses(snapshot, samples, rand_gen);
+
+    const IntelligentDriverModel default_idm;
+    const std::vector<double>& policy_speeds = snapshot.agents().policySpeeds();
+    for (size_t k = 0; k < hypotheses.size(); ++k) {
+      std::copy(policy_speeds.begin(), policy_speeds.end(), hypotheses.policySpeeds(k));
+      hypotheses.timeGap(k) = default_idm.timeGap();
+      hypotheses.distanceGap(k) = default_idm.distanceGap();
+    }
+    return hypotheses;
+  }
+
+  /// Expect the zero-noise samples to reproduce the nominal rollout.
+  template<typename Simulator>
+  static void expectNominalRollout(const boost::shared_ptr<utils::ThreadPool>& thread_pool) {
+    const Snapshot snapshot = createSnapshot();
+    const ContinuousPath path = egoPath(snapshot);
+
+    Simulator simulator(snapshot, map(), fastMap());
+    double time = 0.0; double cost = 0.0;
+    ASSERT_TRUE(simulator.simulate(path, 0.1, 5.0, time, cost));
+
+    const MonteCarloRollouts<Simulator> rollouts(map(), fastMap(), thread_pool);
+    const typename MonteCarloRollouts<Simulator>::Result result =
+      rollouts.simulate(snapshot, zeroNoiseHypotheses(snapshot, 8), path, 0.1, 5.0);
+
+    EXPECT_EQ(result.samples, 8u);
+    EXPECT_EQ(result.collisions, 0u);
+    EXPECT_EQ(result.worst_cost, cost);
+    EXPECT_DOUBLE_EQ(result.expected_cost, cost);
+    EXPECT_DOUBLE_EQ(result.expected_time, time);
+  }
+
+}; // End class MonteCarloRolloutsTest.
+
+TEST_F(MonteCarloRolloutsTest, zeroNoise) {
+  const boost::shared_ptr<utils::ThreadPool> thread_pool =
+    boost::make_shared<utils::ThreadPool>(4);
+
+  expectNominalRollout<idm_lattice_planner::IDMTrafficSimulator>(nullptr);
+  expectNominalRollout<idm_lattice_planner::IDMTrafficSimulator>(thread_pool);
+  expectNominalRollout<slc_lattice_planner::SLCTrafficSimulator>(nullptr);
+  expectNominalRollout<slc_lattice_planner::SLCTrafficSimulator>(thread_pool);
+}
+
+TEST_F(MonteCarloRolloutsTest, agentIdmFollowsIdm) {
+  const Snapshot snapshot = createSnapshot();
+  const ContinuousPath path = egoPath(snapshot);
+
+  // The agents follow the model replaced after the construction.
+  const boost::shared_ptr<IntelligentDriverModel> cautious =
+    boost::make_shared<IntelligentDriverModel>(2.5, 8.0);
+  idm_lattice_planner::IDMTrafficSimulator simulator(snapshot, map(), fastMap());
+  simulator.idm() = cautious;
+  const idm_lattice_planner::IDMTrafficSimulator& const_simulator = simulator;
+  EXPECT_EQ(const_simulator.agentIdm(), cautious);
+
+  double time = 0.0; double cost = 0.0;
+  ASSERT_TRUE(simulator.simulate(path, 0.1, 5.0, time, cost));
+
+  idm_lattice_planner::IDMTrafficSimulator expected_simulator(snapshot, map(), fastMap());
+  expected_simulator.idm() = cautious;
+  expected_simulator.agentIdm() = cautious;
+  double expected_time = 0.0; double expected_cost = 0.0;
+  ASSERT_TRUE(expected_simulator.simulate(path, 0.1, 5.0, expected_time, expected_cost));
+
+  EXPECT_EQ(time, expected_time);
+  EXPECT_EQ(cost, expected_cost);
+
+  // A separate model of the agents is dropped by resetting it.
+  simulator.agentIdm() = boost::make_shared<IntelligentDriverModel>();
+  EXPECT_NE(const_simulator.agentIdm(), cautious);
+  simulator.agentIdm() = nullptr;
+  EXPECT_EQ(const_simulator.agentIdm(), cautious);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
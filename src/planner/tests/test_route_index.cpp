@@ -0,0 +1,101 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <vector>
+#include <boost/smart_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include <router/common/route_index.h>
+#include "benchmark_loop_fixture.h"
+
+using namespace planner;
+
+namespace {
+
+/// Tolerance (m) between the answers of the index and the map.
+const double kTolerance = 0.2;
+
+} // End anonymous namespace.
+
+class RouteIndexTest : public BenchmarkLoopTest {
+
+protected:
+
+  /// The waypoints the distance after the given one on the map,
+  /// or the waypoint itself if the distance is (almost) zero.
+  static std::vector<boost::shared_ptr<CarlaWaypoint>> nextWaypoints(
+      const boost::shared_ptr<CarlaWaypoint>& waypoint, const double distance) {
+    if (distance < 1.0e-3) return {waypoint};
+    return waypoint->GetNext(distance);
+  }
+
+}; // End class RouteIndexTest.
+
+TEST_F(RouteIndexTest, frontWaypoint) {
+  const boost::shared_ptr<const router::RouteIndex> index = router()->routeIndex();
+  ASSERT_TRUE(index);
+  ASSERT_GT(index->size(), 0u);
+
+  const std::vector<boost::shared_ptr<CarlaWaypoint>> waypoints = routeWaypoints(5);
+  ASSERT_FALSE(waypoints.empty());
+
+  // The longer distances run across the road boundaries of the loop.
+  for (const boost::shared_ptr<CarlaWaypoint>& waypoint : waypoints) {
+    for (const double distance : {0.5, 3.7, 25.0, 120.0}) {
+      const auto front = index->frontWaypoint(waypoint, distance);
+      ASSERT_TRUE(front)
+        << "road " << waypoint->GetRoadId() << " lane " << waypoint->GetLaneId()
+        << " s " << waypoint->GetDistance() << " distance " << distance;
+      EXPECT_LT(front->second, index->resolution());
+
+      EXPECT_TRUE(anyCloseWaypoint(nextWaypoints(front->first, front->second),
+                                   waypoint->GetNext(distance), kTolerance))
+        << "road " << waypoint->GetRoadId() << " lane " << waypoint->GetLaneId()
+        << " s " << waypoint->GetDistance() << " distance " << distance;
+    }
+  }
+}
+
+TEST_F(RouteIndexTest, neighborWaypoints) {
+  const boost::shared_ptr<const router::RouteIndex> index = router()->routeIndex();
+  ASSERT_TRUE(index);
+
+  for (const boost::shared_ptr<CarlaWaypoint>& waypoint : routeWaypoints(5)) {
+    const auto sampled = index->sampledWaypoint(waypoint);
+    ASSERT_TRUE(sampled)
+      << "road " << waypoint->GetRoadId() << " lane " << waypoint->GetLaneId()
+      << " s " << waypoint->GetDistance();
+    EXPECT_LT(sampled->second, index->resolution());
+
+    // The lanes of the loop start abreast, so the neighbors are always sampled.
+    const boost::shared_ptr<CarlaWaypoint> left = sampled->first->GetLeft();
+    const auto index_left = index->leftWaypoint(sampled->first);
+    ASSERT_TRUE(index_left);
+    EXPECT_TRUE(closeWaypoint(*index_left, left, kTolerance))
+      << "road " << waypoint->GetRoadId() << " lane " << waypoint->GetLaneId()
+      << " s " << waypoint->GetDistance();
+
+    const boost::shared_ptr<CarlaWaypoint> right = sampled->first->GetRight();
+    const auto index_right = index->rightWaypoint(sampled->first);
+    ASSERT_TRUE(index_right);
+    EXPECT_TRUE(closeWaypoint(*index_right, right, kTolerance))
+      << "road " << waypoint->GetRoadId() << " lane " << waypoint->GetLaneId()
+      << " s " << waypoint->GetDistance();
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include <planner/common/thread_pool.h>
+#include <planner/common/traffic_lattice.h>
+#include "benchmark_loop_fixture.h"
+
+using namespace planner;
+
+namespace {
+
+using CarlaLocation    = carla::geom::Location;
+using CarlaTransform   = carla::geom::Transform;
+using CarlaBoundingBox = carla::geom::BoundingBox;
+
+/// The rear (-1), center (0), or head (1) location of a vehicle.
+CarlaLocation vehicleLocation(const CarlaTransform& transform,
+                              const CarlaBoundingBox& bounding_box,
+                              const int side) {
+  const double sin = std::sin(transform.rotation.yaw/180.0*M_PI);
+  const double cos = std::cos(transform.rotation.yaw/180.0*M_PI);
+  CarlaLocation location = transform.location;
+  location.x += side * cos*bounding_box.extent.x;
+  location.y += side * sin*bounding_box.extent.x;
+  return location;
+}
+
+/// Move a vehicle forward along the route by the distance (m).
+TrafficLattice::VehicleTuple moveForward(const TrafficLattice::VehicleTuple& vehicle,
+                                         const boost::shared_ptr<router::Router>& router,
+                                         const boost::shared_ptr<utils::FastWaypointMap>& fast_map,
+                                         const double distance) {
+  size_t id; CarlaTransform transform; CarlaBoundingBox bounding_box;
+  std::tie(id, transform, bounding_box) = vehicle;
+  const boost::shared_ptr<carla::client::Waypoint> waypoint =
+    router->frontWaypoint(fast_map->waypoint(transform.location), distance);
+  if (!waypoint) throw std::runtime_error("moveForward(): no front waypoint.\n");
+  return std::make_tuple(id, waypoint->GetTransform(), bounding_box);
+}
+
+/// Move a vehicle to the right lane.
+TrafficLattice::VehicleTuple moveRight(const TrafficLattice::VehicleTuple& vehicle,
+                                       const boost::shared_ptr<utils::FastWaypointMap>& fast_map) {
+  size_t id; CarlaTransform transform; CarlaBoundingBox bounding_box;
+  std::tie(id, transform, bounding_box) = vehicle;
+  const boost::shared_ptr<carla::client::Waypoint> waypoint =
+    fast_map->waypoint(transform.location)->GetRight();
+  if (!waypoint) throw std::runtime_error("moveRight(): no right waypoint.\n");
+  return std::make_tuple(id, waypoint->GetTransform(), bounding_box);
+}
+
+/// Expect the same vehicle (if any) is found, with the gaps within the tolerance (m).
+void expectSameNeighbor(const boost::optional<std::pair<size_t, double>>& shifted,
+                        const boost::optional<std::pair<size_t, double>>& rebuilt,
+                        const double tolerance,
+                        const std::string& msg) {
+  ASSERT_EQ(static_cast<bool>(shifted), static_cast<bool>(rebuilt)) << msg;
+  if (!shifted) return;
+  EXPECT_EQ(shifted->first, rebuilt->first) << msg;
+  EXPECT_NEAR(shifted->second, rebuilt->second, tolerance) << msg;
+}
+
+} // End anonymous namespace.
+
+TEST_F(BenchmarkLoopTest, resolveVehicleWaypoints) {
+
+  // Vehicles on all lanes of the map, many more than a chunk, and
+  // not a multiple of the chunk size.
+  std::vector<TrafficLattice::VehicleTuple> vehicles;
+  const std::vector<boost::shared_ptr<CarlaWaypoint>>& waypoints = environment().waypoints;
+  for (size_t i = 0; i < waypoints.size() && vehicles.size() < 203; i += 3) {
+    const Vehicle vehicle = createVehicle(
+        vehicles.size(), waypoints[i]->GetTransform().location, 20.0);
+    vehicles.emplace_back(vehicle.id(), vehicle.transform(), vehicle.boundingBox());
+  }
+  ASSERT_EQ(vehicles.size(), 203u);
+
+  // The waypoints queried one location at a time.
+  std::unordered_map<size_t, TrafficLattice::VehicleWaypoints> expected_waypoints;
+  for (const auto& vehicle : vehicles) {
+    size_t id; CarlaTransform transform; CarlaBoundingBox bounding_box;
+    std::tie(id, transform, bounding_box) = vehicle;
+    for (int side = -1; side <= 1; ++side) {
+      expected_waypoints[id][side+1] = fastMap()->waypoint(
+          vehicleLocation(transform, bounding_box, side));
+    }
+  }
+
+  const boost::shared_ptr<utils::ThreadPool> thread_pool =
+    boost::make_shared<utils::ThreadPool>(4);
+  const std::unordered_map<size_t, TrafficLattice::VehicleWaypoints> serial_waypoints =
+    TrafficLattice::resolveVehicleWaypoints(vehicles, fastMap());
+  const std::unordered_map<size_t, TrafficLattice::VehicleWaypoints> parallel_waypoints =
+    TrafficLattice::resolveVehicleWaypoints(vehicles, fastMap(), thread_pool);
+
+  ASSERT_EQ(serial_waypoints.size(), vehicles.size());
+  ASSERT_EQ(parallel_waypoints.size(), vehicles.size());
+
+  for (const auto& item : expected_waypoints) {
+    ASSERT_EQ(serial_waypoints.count(item.first), 1u);
+    ASSERT_EQ(parallel_waypoints.count(item.first), 1u);
+    for (size_t j = 0; j < 3; ++j) {
+      EXPECT_TRUE(sameWaypoint(serial_waypoints.at(item.first)[j], item.second[j]))
+        << "vehicle " << item.first << " waypoint " << j;
+      EXPECT_TRUE(sameWaypoint(parallel_waypoints.at(item.first)[j], item.second[j]))
+        << "vehicle " << item.first << " waypoint " << j;
+    }
+  }
+}
+
+TEST_F(BenchmarkLoopTest, moveTrafficForward) {
+
+  // Two vehicles on each lane towards the end of the first straight, where
+  // the vehicles on the same lane drive at the same speed. The faster lanes
+  // overtake the slower ones, so the neighbors of the vehicles change.
+  const std::vector<std::pair<CarlaLocation, double>> starts{
+    {CarlaLocation(420.0f, laneY(1), 0.0f), 1.5},
+    {CarlaLocation(440.0f, laneY(1), 0.0f), 1.5},
+    {CarlaLocation(425.0f, laneY(2), 0.0f), 2.2},
+    {CarlaLocation(455.0f, laneY(2), 0.0f), 2.2},
+    {CarlaLocation(430.0f, laneY(3), 0.0f), 0.8},
+    {CarlaLocation(450.0f, laneY(3), 0.0f), 0.8},
+  };
+
+  std::vector<TrafficLattice::VehicleTuple> vehicles;
+  std::vector<double> steps;
+  for (const auto& start : starts) {
+    const Vehicle vehicle = createVehicle(vehicles.size(), start.first, 20.0);
+    vehicles.emplace_back(vehicle.id(), vehicle.transform(), vehicle.boundingBox());
+    steps.push_back(start.second);
+  }
+
+  const boost::shared_ptr<router::Router> route = router();
+  TrafficLattice shifted(vehicles, map(), fastMap(), route);
+
+  // The nodes of a lattice moved forward and a new lattice are not aligned,
+  // so the gaps may differ by a node on either end.
+  const double tolerance = 2.0 + 1.0e-3;
+
+  // The vehicles move into the curve of the second road. One of them
+  // changes to the right lane on the way.
+  for (size_t step = 0; step < 40; ++step) {
+    for (size_t i = 0; i < vehicles.size(); ++i)
+      vehicles[i] = moveForward(vehicles[i], route, fastMap(), steps[i]);
+    if (step == 20) vehicles[3] = moveRight(vehicles[3], fastMap());
+
+    std::unordered_set<size_t> shifted_disappeared;
+    ASSERT_TRUE(shifted.moveTrafficForward(vehicles, shifted_disappeared)) << "step " << step;
+
+    std::unordered_set<size_t> rebuilt_disappeared;
+    const TrafficLattice rebuilt(vehicles, map(), fastMap(), route, rebuilt_disappeared);
+
+    ASSERT_EQ(shifted_disappeared, rebuilt_disappeared) << "step " << step;
+    ASSERT_EQ(shifted.vehicles(), rebuilt.vehicles()) << "step " << step;
+
+    for (const size_t id : rebuilt.vehicles()) {
+      const std::string msg = (boost::format("step %1% vehicle %2%") % step % id).str();
+      EXPECT_EQ(shifted.isChangingLane(id), rebuilt.isChangingLane(id)) << msg;
+
+      const boost::optional<std::pair<double, double>> shifted_span = shifted.vehicleSpan(id);
+      const boost::optional<std::pair<double, double>> rebuilt_span = rebuilt.vehicleSpan(id);
+      ASSERT_TRUE(shifted_span && rebuilt_span) << msg;
+      EXPECT_NEAR(shifted_span->second-shifted_span->first,
+                  rebuilt_span->second-rebuilt_span->first, tolerance) << msg;
+
+      expectSameNeighbor(shifted.front(id), rebuilt.front(id), tolerance, msg + " front");
+      expectSameNeighbor(shifted.back(id), rebuilt.back(id), tolerance, msg + " back");
+      expectSameNeighbor(shifted.leftFront(id), rebuilt.leftFront(id), tolerance, msg + " left front");
+      expectSameNeighbor(shifted.leftBack(id), rebuilt.leftBack(id), tolerance, msg + " left back");
+      expectSameNeighbor(shifted.rightFront(id), rebuilt.rightFront(id), tolerance, msg + " right front");
+      expectSameNeighbor(shifted.rightBack(id), rebuilt.rightBack(id), tolerance, msg + " right back");
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <gtest/gtest.h>
+#include <controller/vehicle_controller.h>
+
+using namespace controller;
+
+namespace {
+
+using CarlaLocation  = carla::geom::Location;
+using CarlaRotation  = carla::geom::Rotation;
+using CarlaTransform = carla::geom::Transform;
+
+const std::vector<double> kLongitudinalGains{0.5, 0.05, 0.02};
+const std::vector<double> kLateralGains{0.8, 0.05, 0.01};
+
+const double kDt = 0.05;
+const double kTolerance = 1.0e-4;
+
+/**
+ * \brief Fleet stores the per vehicle controllers and the inputs of the
+ *        vehicles for one tick.
+ *
+ * The vehicles move along their headings and turn slowly from tick to
+ * tick. The reference locations are kept away from the heading of the
+ * vehicles, where the angle of \c PIDLateralController loses the precision.
+ */
+struct Fleet {
+  std::vector<std::unique_ptr<VehiclePIDController>> controllers;
+
+  std::vector<double> current_speeds;
+  std::vector<double> reference_speeds;
+  std::vector<CarlaTransform> current_transforms;
+  std::vector<CarlaTransform> reference_transforms;
+
+  void resize(const size_t size) {
+    while (controllers.size() < size) {
+      controllers.emplace_back(new VehiclePIDController(kLongitudinalGains, kLateralGains));
+    }
+    controllers.resize(size);
+    current_speeds.resize(size);
+    reference_speeds.resize(size);
+    current_transforms.resize(size);
+    reference_transforms.resize(size);
+  }
+
+  void update(const size_t tick) {
+    for (size_t i = 0; i < controllers.size(); ++i) {
+      current_speeds[i] = 5.0 + i + std::sin(0.3*tick + i);
+      reference_speeds[i] = 8.0 + 0.5*i;
+
+      const double yaw = -120.0 + 40.0*i + 2.0*tick;
+      const double heading = yaw / 180.0 * M_PI;
+      const double travel = 1.0 * tick;
+      current_transforms[i] = CarlaTransform(
+          CarlaLocation(10.0*i + travel*std::cos(heading),
+                        3.0*i + travel*std::sin(heading), 0.0f),
+          CarlaRotation(0.0f, yaw, 0.0f));
+
+      const double offset = (i%2 ? 1.0 : -1.0) * (0.08 + 0.04*i + 0.02*tick);
+      const CarlaLocation& location = current_transforms[i].location;
+      reference_transforms[i] = CarlaTransform(
+          CarlaLocation(location.x + 10.0*std::cos(heading+offset),
+                        location.y + 10.0*std::sin(heading+offset), 0.0f),
+          CarlaRotation(0.0f, yaw, 0.0f));
+    }
+  }
+};
+
+/// Run one tick through both controllers and compare the controls per vehicle.
+void expectSameControl(Fleet& fleet, FleetPIDController& fleet_controller, const size_t tick) {
+  std::vector<double> throttles, brakes, steerings;
+  fleet_controller.control(fleet.current_speeds, fleet.reference_speeds,
+                           fleet.current_transforms, fleet.reference_transforms,
+                           kDt, throttles, brakes, steerings);
+
+  ASSERT_EQ(throttles.size(), fleet.controllers.size());
+  ASSERT_EQ(brakes.size(), fleet.controllers.size());
+  ASSERT_EQ(steerings.size(), fleet.controllers.size());
+
+  for (size_t i = 0; i < fleet.controllers.size(); ++i) {
+    VehiclePIDController& controller = *(fleet.controllers[i]);
+    // The longitudinal control is split into the throttle and brake.
+    const double accel = controller.throttle(
+        fleet.current_speeds[i], fleet.reference_speeds[i], kDt);
+    const double steering = controller.steering(
+        fleet.current_transforms[i], fleet.reference_transforms[i], kDt, 1.0, -1.0);
+
+    EXPECT_NEAR(throttles[i], std::min(std::max(accel, 0.0), 1.0), kTolerance)
+      << "tick " << tick << " vehicle " << i;
+    EXPECT_NEAR(brakes[i], std::min(std::max(-accel, 0.0), 1.0), kTolerance)
+      << "tick " << tick << " vehicle " << i;
+    EXPECT_NEAR(steerings[i], steering, kTolerance)
+      << "tick " << tick << " vehicle " << i;
+  }
+}
+
+} // End anonymous namespace.
+
+TEST(FleetPIDController, sameAsVehiclePIDController) {
+  Fleet fleet;
+  fleet.resize(7);
+  FleetPIDController fleet_controller(kLongitudinalGains, kLateralGains, 7);
+  ASSERT_EQ(fleet_controller.size(), 7u);
+
+  for (size_t tick = 0; tick < 20; ++tick) {
+    fleet.update(tick);
+    expectSameControl(fleet, fleet_controller, tick);
+  }
+}
+
+TEST(FleetPIDController, resetAndResize) {
+  Fleet fleet;
+  fleet.resize(7);
+  FleetPIDController fleet_controller(kLongitudinalGains, kLateralGains, 7);
+
+  size_t tick = 0;
+  for (; tick < 10; ++tick) {
+    fleet.update(tick);
+    expectSameControl(fleet, fleet_controller, tick);
+  }
+
+  // The slot is taken by a new vehicle, whose history is empty,
+  // while the other vehicles keep their history.
+  fleet_controller.reset(2);
+  fleet.controllers[2].reset(new VehiclePIDController(kLongitudinalGains, kLateralGains));
+  for (; tick < 15; ++tick) {
+    fleet.update(tick);
+    expectSameControl(fleet, fleet_controller, tick);
+  }
+
+  // The new vehicles start with an empty history.
+  fleet_controller.resize(9);
+  fleet.resize(9);
+  ASSERT_EQ(fleet_controller.size(), 9u);
+  for (; tick < 20; ++tick) {
+    fleet.update(tick);
+    expectSameControl(fleet, fleet_controller, tick);
+  }
+}
+
+TEST(FleetPIDController, mismatchedInputs) {
+  Fleet fleet;
+  fleet.resize(7);
+  fleet.update(0);
+  FleetPIDController fleet_controller(kLongitudinalGains, kLateralGains, 7);
+  std::vector<double> throttles, brakes, steerings;
+
+  std::vector<double> speeds = fleet.current_speeds;
+  speeds.pop_back();
+  EXPECT_THROW(fleet_controller.control(
+        speeds, fleet.reference_speeds,
+        fleet.current_transforms, fleet.reference_transforms,
+        kDt, throttles, brakes, steerings), std::runtime_error);
+
+  std::vector<CarlaTransform> transforms = fleet.reference_transforms;
+  transforms.push_back(transforms.back());
+  EXPECT_THROW(fleet_controller.control(
+        fleet.current_speeds, fleet.reference_speeds,
+        fleet.current_transforms, transforms,
+        kDt, throttles, brakes, steerings), std::runtime_error);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string>
+#include <vector>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include <planner/common/waypoint_graph.h>
+#include "benchmark_loop_fixture.h"
+
+using namespace planner;
+
+class WaypointGraphTest : public BenchmarkLoopTest {
+
+protected:
+
+  using WaypointHandle = utils::WaypointGraph::WaypointHandle;
+
+  /// Tolerance (m) between the answers of the graph and the map. The graph
+  /// snaps to the waypoints of the fast map, which are a resolution apart,
+  /// and each lane may end up to a resolution short of its actual length.
+  static double tolerance() { return 3.0 * fastMap()->resolution(); }
+
+  static std::string describe(const boost::shared_ptr<CarlaWaypoint>& waypoint) {
+    return (boost::format("road %1% section %2% lane %3% s %4%")
+        % waypoint->GetRoadId() % waypoint->GetSectionId()
+        % waypoint->GetLaneId() % waypoint->GetDistance()).str();
+  }
+
+  /// Expect the neighbor on the graph to be the driving lane neighbor on the map.
+  static void expectSameNeighbor(const WaypointHandle graph_neighbor,
+                                 const boost::shared_ptr<CarlaWaypoint>& map_neighbor,
+                                 const std::string& msg) {
+    if (!map_neighbor || map_neighbor->GetType() != carla::road::Lane::LaneType::Driving) {
+      EXPECT_EQ(graph_neighbor, utils::WaypointGraph::kNullHandle) << msg;
+      return;
+    }
+    ASSERT_NE(graph_neighbor, utils::WaypointGraph::kNullHandle) << msg;
+    EXPECT_TRUE(closeWaypoint(graph()->waypoint(graph_neighbor), map_neighbor, tolerance())) << msg;
+  }
+
+}; // End class WaypointGraphTest.
+
+TEST_F(WaypointGraphTest, handle) {
+  for (const boost::shared_ptr<CarlaWaypoint>& waypoint : routeWaypoints(5)) {
+    const WaypointHandle handle = graph()->handle(*waypoint);
+    ASSERT_NE(handle, utils::WaypointGraph::kNullHandle) << describe(waypoint);
+    EXPECT_TRUE(closeWaypoint(graph()->waypoint(handle), waypoint, tolerance()))
+      << describe(waypoint);
+  }
+}
+
+TEST_F(WaypointGraphTest, frontWaypoint) {
+  // The longer distances run across the boundaries of the roads, each of which
+  // is a single section on this map, i.e. onto the successor lanes of the graph.
+  for (const boost::shared_ptr<CarlaWaypoint>& waypoint : routeWaypoints(5)) {
+    const WaypointHandle handle = graph()->handle(*waypoint);
+    ASSERT_NE(handle, utils::WaypointGraph::kNullHandle) << describe(waypoint);
+
+    for (const double distance : {0.5, 3.7, 25.0, 120.0, 400.0}) {
+      const std::string msg = describe(waypoint) +
+        (boost::format(" distance %1%") % distance).str();
+      const std::vector<boost::shared_ptr<CarlaWaypoint>> expected = waypoint->GetNext(distance);
+
+      const WaypointHandle front = graph()->front(handle, distance);
+      ASSERT_NE(front, utils::WaypointGraph::kNullHandle) << msg;
+      EXPECT_TRUE(anyCloseWaypoint({graph()->waypoint(front)}, expected, tolerance())) << msg;
+
+      const boost::shared_ptr<CarlaWaypoint> next = router()->nextWaypoint(waypoint, distance);
+      ASSERT_TRUE(next) << msg;
+      EXPECT_TRUE(anyCloseWaypoint({next}, expected, tolerance())) << msg;
+    }
+  }
+}
+
+TEST_F(WaypointGraphTest, neighborWaypoints) {
+  for (const boost::shared_ptr<CarlaWaypoint>& waypoint : routeWaypoints(5)) {
+    const WaypointHandle handle = graph()->handle(*waypoint);
+    ASSERT_NE(handle, utils::WaypointGraph::kNullHandle) << describe(waypoint);
+
+    // Compare the neighbors of the waypoint on the graph, since the
+    // neighbors are at the same distance of the road.
+    const boost::shared_ptr<CarlaWaypoint> graph_waypoint = graph()->waypoint(handle);
+    expectSameNeighbor(graph()->left(handle), graph_waypoint->GetLeft(),
+        describe(waypoint) + " left");
+    expectSameNeighbor(graph()->right(handle), graph_waypoint->GetRight(),
+        describe(waypoint) + " right");
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include <boost/smart_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include <planner/common/waypoint_lattice.h>
+#include "benchmark_loop_fixture.h"
+
+using namespace planner;
+
+namespace {
+
+/**
+ * \brief Check the links and the spacing of all nodes on the lattice.
+ *
+ * The front and back links of the nodes should be symmetric, the distances
+ * should increase along the links, and the spacing of the nodes should be
+ * no coarser than the resolution at their distances.
+ */
+void expectConsistentLattice(const WaypointLattice& lattice, const std::string& msg) {
+  const LatticeResolution& resolution = lattice.resolution();
+  const double tolerance = 0.5 * resolution.finest();
+
+  const std::unordered_map<size_t, boost::shared_ptr<const WaypointNode>> nodes = lattice.nodes();
+  ASSERT_FALSE(nodes.empty()) << msg;
+
+  for (const auto& item : nodes) {
+    const boost::shared_ptr<const WaypointNode>& node = item.second;
+    const std::string node_msg = msg + (boost::format(" node %1% distance %2%")
+        % node->id() % node->distance()).str();
+
+    EXPECT_GE(node->distance(), -1.0e-6) << node_msg;
+    EXPECT_LE(node->distance(), lattice.range() + 1.0e-6) << node_msg;
+
+    const boost::shared_ptr<const WaypointNode> front = node->front();
+    if (front) {
+      ASSERT_TRUE(front->back()) << node_msg;
+      EXPECT_EQ(front->back()->id(), node->id()) << node_msg;
+
+      const double spacing = front->distance() - node->distance();
+      EXPECT_GT(spacing, 0.0) << node_msg;
+      EXPECT_LT(spacing, resolution.at(node->distance()) + tolerance) << node_msg;
+    }
+
+    const boost::shared_ptr<const WaypointNode> back = node->back();
+    if (back) {
+      ASSERT_TRUE(back->front()) << node_msg;
+      EXPECT_EQ(back->front()->id(), node->id()) << node_msg;
+      EXPECT_LT(back->distance(), node->distance()) << node_msg;
+    }
+  }
+}
+
+} // End anonymous namespace.
+
+TEST_F(BenchmarkLoopTest, refineLattice) {
+
+  // Finer nodes close to the start of the lattice.
+  const LatticeResolution resolution(std::vector<std::pair<double, double>>{
+      {0.0, 1.0}, {30.0, 2.0}, {80.0, 4.0}});
+
+  const boost::shared_ptr<const CarlaWaypoint> start =
+    fastMap()->waypoint(CarlaLocation(10.0f, laneY(2), 0.0f));
+  ASSERT_TRUE(start);
+
+  WaypointLattice lattice(start, 150.0, resolution, router());
+  expectConsistentLattice(lattice, "constructed");
+
+  // Shortening moves the nodes of the coarse levels into the finer ones,
+  // which are refined. Shift all the way into the curve of the second road.
+  for (size_t i = 0; i < 30; ++i) {
+    const double range = lattice.range();
+    lattice.extend(range + 17.0);
+    lattice.shorten(range);
+    EXPECT_NEAR(lattice.range(), range, resolution.coarsest());
+    expectConsistentLattice(lattice, (boost::format("shift %1%") % i).str());
+  }
+
+  // Shorten the lattice into the finest level only.
+  lattice.shorten(25.0);
+  expectConsistentLattice(lattice, "shortened");
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <router/common/route_index.h>
+
+namespace router {
+
+RouteIndex::RouteIndex(
+    const std::vector<boost::shared_ptr<CarlaWaypoint>>& seeds,
+    const Router& router,
+    const double resolution,
+    const double max_length) :
+  resolution_(resolution) {
+
+  if (resolution_ <= 0.0) {
+    throw std::runtime_error((boost::format(
+            "RouteIndex::RouteIndex(): "
+            "invalid resolution %1%.\n") % resolution_).str());
+  }
+
+  for (const auto& seed : seeds) {
+    if (!seed) continue;
+    addChain(seed, router, max_length);
+  }
+
+  addNeighbors();
+  return;
+}
+
+const size_t RouteIndex::size() const {
+  size_t size = 0;
+  for (const auto& chain : chains_) size += chain.waypoints.size();
+  return size;
+}
+
+boost::optional<std::pair<boost::shared_ptr<RouteIndex::CarlaWaypoint>, double>>
+  RouteIndex::frontWaypoint(
+    const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+    const double distance) const {
+
+  if (distance < 0.0) return boost::none;
+
+  boost::optional<Position> position = locate(waypoint);
+  if (!position) return boost::none;
+
+  // Arc length of the front waypoint on the chain.
+  size_t chain = position->chain;
+  double s = position->index*resolution_ + position->offset + distance;
+
+  // Follow the chains if the front waypoint is beyond the current one.
+  for (size_t jumps = 0; ; ++jumps) {
+    const Chain& current = chains_[chain];
+    const double end = current.waypoints.size() * resolution_;
+    if (s < end) break;
+    if (!current.next || jumps > chains_.size()) return boost::none;
+    s += current.next->index*resolution_ + current.next->offset - end;
+    chain = current.next->chain;
+  }
+
+  if (s < 0.0) return boost::none;
+
+  const std::vector<boost::shared_ptr<CarlaWaypoint>>& waypoints = chains_[chain].waypoints;
+  const size_t index = std::min(
+      static_cast<size_t>(std::floor(s/resolution_ + 1.0e-9)), waypoints.size()-1);
+  const double residual = std::max(s - index*resolution_, 0.0);
+
+  return std::make_pair(waypoints[index], residual);
+}
+
+boost::optional<std::pair<boost::shared_ptr<RouteIndex::CarlaWaypoint>, double>>
+  RouteIndex::sampledWaypoint(
+    const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
+
+  boost::optional<Position> position = locate(waypoint);
+  if (!position) return boost::none;
+
+  // The query is before the first sampled waypoint of its lane, or
+  // beyond the resolution after the last one.
+  if (position->offset < 0.0 || position->offset >= resolution_) return boost::none;
+  return std::make_pair(chains_[position->chain].waypoints[position->index], position->offset);
+}
+
+boost::optional<RouteIndex::Position> RouteIndex::locate(
+    const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
+
+  std::unordered_map<LaneKey, Segment, LaneKeyHash>::const_iterator segment_iter =
+    segments_.find(laneKey(waypoint));
+  if (segment_iter == segments_.end()) return boost::none;
+
+  const Segment& segment = segment_iter->second;
+  const std::vector<boost::shared_ptr<CarlaWaypoint>>& waypoints =
+    chains_[segment.chain].waypoints;
+  const double s = waypoint->GetDistance();
+
+  // Find the first waypoint of the segment after the query waypoint.
+  std::vector<boost::shared_ptr<CarlaWaypoint>>::const_iterator first =
+    waypoints.begin() + segment.begin;
+  std::vector<boost::shared_ptr<CarlaWaypoint>>::const_iterator last =
+    waypoints.begin() + segment.end;
+  std::vector<boost::shared_ptr<CarlaWaypoint>>::const_iterator after;
+
+  if (segment.increasing) {
+    after = std::upper_bound(first, last, s,
+        [](const double s, const boost::shared_ptr<CarlaWaypoint>& w) {
+          return s < w->GetDistance(); });
+  } else {
+    after = std::upper_bound(first, last, s,
+        [](const double s, const boost::shared_ptr<CarlaWaypoint>& w) {
+          return s > w->GetDistance(); });
+  }
+
+  // The query waypoint is located relative to the waypoint right before it.
+  // If it is before the whole segment, the offset is negative.
+  const size_t index = after == first ?
+    segment.begin : static_cast<size_t>(after-waypoints.begin()) - 1;
+  const double offset = segment.increasing ?
+    s - waypoints[index]->GetDistance() :
+    waypoints[index]->GetDistance() - s;
+
+  return Position{segment.chain, index, offset};
+}
+
+void RouteIndex::addChain(
+    const boost::shared_ptr<CarlaWaypoint>& seed,
+    const Router& router,
+    const double max_length) {
+
+  // The lane may have been sampled from another seed already.
+  if (segments_.count(laneKey(seed)) > 0) return;
+
+  const size_t chain = chains_.size();
+  chains_.emplace_back();
+  std::vector<boost::shared_ptr<CarlaWaypoint>>& waypoints = chains_[chain].waypoints;
+  const size_t max_size = static_cast<size_t>(max_length/resolution_) + 1;
+
+  boost::shared_ptr<CarlaWaypoint> waypoint = seed;
+  while (waypoint && waypoints.size() < max_size) {
+    const LaneKey key = laneKey(waypoint);
+    std::unordered_map<LaneKey, Segment, LaneKeyHash>::iterator segment_iter =
+      segments_.find(key);
+
+    if (segment_iter == segments_.end()) {
+      // Start a new segment for the lane.
+      segment_iter = segments_.emplace(
+          key, Segment{chain, waypoints.size(), waypoints.size(), true}).first;
+    } else if (segment_iter->second.chain != chain ||
+               segment_iter->second.end != waypoints.size()) {
+      // The lane has been sampled, by another chain or earlier in this
+      // chain, e.g. the route is a loop. Continue into the sampled lane.
+      chains_[chain].next = locate(waypoint);
+      break;
+    }
+
+    Segment& segment = segment_iter->second;
+    waypoints.push_back(waypoint);
+    ++segment.end;
+    if (segment.end-segment.begin == 2) {
+      segment.increasing = waypoints[segment.begin+1]->GetDistance() >=
+                           waypoints[segment.begin]->GetDistance();
+    }
+
+    waypoint = router.tryFrontWaypoint(waypoint, resolution_);
+  }
+
+  return;
+}
+
+boost::optional<boost::shared_ptr<RouteIndex::CarlaWaypoint>>
+  RouteIndex::matchNeighbor(
+    const boost::shared_ptr<const CarlaWaypoint>& neighbor) const {
+
+  if (!neighbor) return boost::shared_ptr<CarlaWaypoint>(nullptr);
+
+  boost::optional<Position> position = locate(neighbor);
+  if (!position) return boost::none;
+
+  // The sampled waypoints of neighboring lanes are aligned as long as the
+  // lanes start at the same place. Only accept a sampled waypoint which is
+  // close enough, so that the nodes on a lattice stay abreast.
+  const double kTolerance = 0.2;
+  const std::vector<boost::shared_ptr<CarlaWaypoint>>& waypoints =
+    chains_[position->chain].waypoints;
+
+  if (std::fabs(position->offset) <= kTolerance)
+    return waypoints[position->index];
+  if (resolution_-position->offset <= kTolerance &&
+      position->index+1 < waypoints.size() &&
+      laneKey(waypoints[position->index+1]) == laneKey(neighbor))
+    return waypoints[position->index+1];
+
+  return boost::none;
+}
+
+void RouteIndex::addNeighbors() {
+  for (const Chain& chain : chains_) {
+    for (const boost::shared_ptr<CarlaWaypoint>& waypoint : chain.waypoints) {
+      neighbors_[waypoint->GetId()] = std::make_pair(
+          matchNeighbor(waypoint->GetLeft()), matchNeighbor(waypoint->GetRight()));
+    }
+  }
+  return;
+}
+
+} // End namespace router.
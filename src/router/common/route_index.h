@@ -0,0 +1,232 @@
+/*
+ * Copyright 2020 Ke Sun
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <boost/smart_ptr.hpp>
+#include <boost/optional.hpp>
+#include <boost/functional/hash.hpp>
+#include <carla/client/Waypoint.h>
+
+#include <router/common/router.h>
+
+namespace router {
+
+/**
+ * \brief RouteIndex samples the lanes along a route once, so that the front
+ *        waypoint at some distance can be found without walking the map.
+ *
+ * Starting from each seed waypoint, which is usually the start of a lane,
+ * the lane is followed along the route with \c Router::tryFrontWaypoint(),
+ * and a waypoint is recorded every \c resolution meters. The recorded
+ * waypoints of a lane form a chain, where the i-th waypoint is at the
+ * arc length \c i*resolution. A chain stops when it runs into a lane that
+ * is already recorded, e.g. a loop closes or two lanes merge, in which case
+ * it continues into the chain of that lane.
+ *
+ * The recorded waypoints are grouped by (road, section, lane), and sorted by
+ * the distance along the road within each group. A query waypoint is then
+ * located on its chain with a binary search, and the front waypoint is just
+ * an offset along the chain.
+ *
+ * Once all lanes are sampled, the left and right neighbors of every sampled
+ * waypoint are looked up on the index as well. Together with the chains,
+ * this makes the index a lattice of the whole route, with the topology
+ * computed once. Lattices whose nodes are on the sampled waypoints, at a
+ * multiple of the resolution apart, can then be paved without querying the
+ * map, and all of them share the same waypoint objects.
+ *
+ * The index is immutable once built, so it can be shared by threads.
+ */
+class RouteIndex {
+
+protected:
+
+  using CarlaWaypoint = carla::client::Waypoint;
+
+  /// A position on the index, i.e. \c offset meters after the
+  /// \c index-th waypoint of the \c chain-th chain.
+  struct Position {
+    size_t chain;
+    size_t index;
+    double offset;
+  };
+
+  /// Waypoints sampled along a lane of the route.
+  struct Chain {
+    /// The i-th waypoint is \c i*resolution_ meters from the start of the chain.
+    std::vector<boost::shared_ptr<CarlaWaypoint>> waypoints;
+    /// Where the chain continues, i.e. the position one \c resolution_
+    /// after the last waypoint, if the lane continues on the route.
+    boost::optional<Position> next;
+  };
+
+  /// Identifies a lane within a road section.
+  struct LaneKey {
+    size_t road;
+    size_t section;
+    int lane;
+
+    bool operator==(const LaneKey& other) const {
+      return road == other.road && section == other.section && lane == other.lane;
+    }
+  };
+
+  struct LaneKeyHash {
+    size_t operator()(const LaneKey& key) const {
+      size_t seed = 0;
+      boost::hash_combine(seed, key.road);
+      boost::hash_combine(seed, key.section);
+      boost::hash_combine(seed, key.lane);
+      return seed;
+    }
+  };
+
+  /// The waypoints of a lane as a range of a chain.
+  struct Segment {
+    size_t chain;
+    size_t begin;
+    size_t end;
+    /// Whether the distance along the road increases along the chain.
+    bool increasing;
+  };
+
+protected:
+
+  /// Distance between the sampled waypoints.
+  double resolution_;
+
+  /// Lanes sampled along the route.
+  std::vector<Chain> chains_;
+
+  /// Find the sampled waypoints of a lane.
+  std::unordered_map<LaneKey, Segment, LaneKeyHash> segments_;
+
+  /**
+   * The left and right neighbors of the sampled waypoints, keyed by the
+   * waypoint IDs. A neighbor is \c nullptr if there is no lane on that side,
+   * and \c boost::none if the neighbor is not one of the sampled waypoints.
+   */
+  std::unordered_map<size_t, std::pair<
+    boost::optional<boost::shared_ptr<CarlaWaypoint>>,
+    boost::optional<boost::shared_ptr<CarlaWaypoint>>>> neighbors_;
+
+public:
+
+  /**
+   * \brief Class constructor.
+   *
+   * \param[in] seeds Waypoints where the lanes on the route start.
+   * \param[in] router The router defining the route. Its \c tryFrontWaypoint()
+   *                   is used to follow the lanes, and it should not be
+   *                   using this index yet.
+   * \param[in] resolution Distance between the sampled waypoints.
+   * \param[in] max_length Maximum length of a chain, which guards against
+   *                       routes that never close.
+   */
+  RouteIndex(const std::vector<boost::shared_ptr<CarlaWaypoint>>& seeds,
+             const Router& router,
+             const double resolution = 1.0,
+             const double max_length = 1.0e5);
+
+  /// Distance between the sampled waypoints.
+  const double resolution() const { return resolution_; }
+
+  /// Number of waypoints in the index.
+  const size_t size() const;
+
+  /**
+   * \brief Find the front waypoint of the query one with a certain distance.
+   *
+   * \param[in] waypoint The query waypoint.
+   * \param[in] distance The distance to look for the front waypoint.
+   * \return The sampled waypoint at or right before the front waypoint,
+   *         together with the remaining distance to the front waypoint,
+   *         which is less than \c resolution(). \c boost::none is
+   *         returned if the query waypoint is not in the index, or the
+   *         lane ends on the route before the given distance.
+   */
+  boost::optional<std::pair<boost::shared_ptr<CarlaWaypoint>, double>>
+    frontWaypoint(const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+                  const double distance) const;
+
+  /**
+   * \brief Find the sampled waypoint at or right before the query waypoint.
+   *
+   * \param[in] waypoint The query waypoint.
+   * \return The sampled waypoint, together with its distance to the query
+   *         waypoint, which is less than \c resolution(). \c boost::none
+   *         is returned if the query waypoint is not in the index.
+   */
+  boost::optional<std::pair<boost::shared_ptr<CarlaWaypoint>, double>>
+    sampledWaypoint(const boost::shared_ptr<const CarlaWaypoint>& waypoint) const;
+
+  /**
+   * \brief Get the left neighbor of a sampled waypoint.
+   *
+   * \param[in] waypoint The query waypoint.
+   * \return The sampled waypoint on the left lane, or \c nullptr if there
+   *         is no left lane. \c boost::none is returned if the query is
+   *         not a sampled waypoint, or its left neighbor is not sampled.
+   */
+  boost::optional<boost::shared_ptr<CarlaWaypoint>> leftWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
+    auto iter = neighbors_.find(waypoint->GetId());
+    if (iter == neighbors_.end()) return boost::none;
+    return iter->second.first;
+  }
+
+  /// Same as \c leftWaypoint(), but for the right neighbor.
+  boost::optional<boost::shared_ptr<CarlaWaypoint>> rightWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
+    auto iter = neighbors_.find(waypoint->GetId());
+    if (iter == neighbors_.end()) return boost::none;
+    return iter->second.second;
+  }
+
+protected:
+
+  static LaneKey laneKey(const boost::shared_ptr<const CarlaWaypoint>& waypoint) {
+    return LaneKey{waypoint->GetRoadId(), waypoint->GetSectionId(), waypoint->GetLaneId()};
+  }
+
+  /// Locate a waypoint on the index.
+  boost::optional<Position> locate(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint) const;
+
+  /// Sample the lane starting from the seed into a new chain.
+  void addChain(const boost::shared_ptr<CarlaWaypoint>& seed,
+                const Router& router,
+                const double max_length);
+
+  /**
+   * \brief Match a neighbor found on the map to a sampled waypoint.
+   *
+   * \param[in] neighbor The neighbor waypoint from the map.
+   * \return \c nullptr if \c neighbor is \c nullptr, the sampled
+   *         waypoint within a small tolerance of \c neighbor, or
+   *         \c boost::none if there is no such sampled waypoint.
+   */
+  boost::optional<boost::shared_ptr<CarlaWaypoint>> matchNeighbor(
+      const boost::shared_ptr<const CarlaWaypoint>& neighbor) const;
+
+  /// Find the left and right neighbors of all sampled waypoints.
+  void addNeighbors();
+
+}; // End class RouteIndex.
+
+} // End namespace router.
@@ -14,10 +14,14 @@
 
 #pragma once
 
+#include <vector>
+#include <utility>
 #include <boost/smart_ptr.hpp>
 #include <boost/optional.hpp>
 #include <carla/client/Waypoint.h>
 
+#include <planner/common/waypoint_graph.h>
+
 namespace router {
 
 /**
@@ -32,10 +36,29 @@ protected:
 
   using CarlaWaypoint = carla::client::Waypoint;
 
+  /// Waypoint graph of the whole map, optional.
+  boost::shared_ptr<const utils::WaypointGraph> waypoint_graph_ = nullptr;
+
 public:
 
   virtual ~Router() {}
 
+  /**
+   * \brief Set the waypoint graph of the map.
+   *
+   * With the graph, the waypoints ahead and on the adjacent lanes are
+   * looked up on the graph instead of querying the carla map. The graph
+   * should be set before the router is used by any thread.
+   */
+  void setWaypointGraph(const boost::shared_ptr<const utils::WaypointGraph>& graph) {
+    waypoint_graph_ = graph;
+  }
+
+  /// Get the waypoint graph of the map, \c nullptr if it is not set.
+  const boost::shared_ptr<const utils::WaypointGraph>& waypointGraph() const {
+    return waypoint_graph_;
+  }
+
   /**
    * \brief Tells whether the query road is in the road sequence.
    * \param[in] road The ID of the query road.
@@ -117,6 +140,123 @@ public:
   virtual boost::shared_ptr<CarlaWaypoint> frontWaypoint(
       const boost::shared_ptr<const CarlaWaypoint>& waypoint, const double distance) const = 0;
 
+  /**
+   * \brief Get the front waypoint of the query one with a certain distance,
+   *        without throwing.
+   *
+   * This is the same as \c frontWaypoint(), except that \c nullptr is
+   * returned whenever \c frontWaypoint() would throw, e.g. the query waypoint
+   * is not on the route or the distance is not positive. It is meant for the
+   * hot paths, where not finding the front waypoint is the normal case,
+   * e.g. agents leaving the route.
+   *
+   * The default implementation wraps \c frontWaypoint(). Derived classes
+   * should override this with one that does not rely on exceptions.
+   *
+   * \param[in] waypoint The query waypoint.
+   * \param[in] distance The distance to look for the front waypoint.
+   * \return If there is no such front waypoint, \c nullptr is returned.
+   */
+  virtual boost::shared_ptr<CarlaWaypoint> tryFrontWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint, const double distance) const {
+    try {
+      return frontWaypoint(waypoint, distance);
+    } catch (...) {
+      return nullptr;
+    }
+  }
+
+  /**
+   * \brief Find the waypoint at or right before the query one, on which a
+   *        lattice with the given resolution can be started so that its
+   *        nodes are shared with other lattices.
+   *
+   * The default implementation returns \c boost::none, i.e. the lattices
+   * are started at wherever they are requested.
+   *
+   * \param[in] waypoint The query waypoint.
+   * \param[in] resolution The longitudinal resolution of the lattice.
+   * \return The waypoint, together with its distance to the query waypoint.
+   */
+  virtual boost::optional<std::pair<boost::shared_ptr<CarlaWaypoint>, double>>
+    latticeStartWaypoint(const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+                         const double resolution) const {
+    return boost::none;
+  }
+
+  /**
+   * \brief Get the front waypoint of the query one with a certain distance,
+   *        following the lanes whether they are on the route or not.
+   *
+   * This is meant for the vehicles leaving the route. Where a lane splits,
+   * the lane on the route is preferred, and then the one with the least
+   * change of the heading.
+   *
+   * The default implementation looks up the waypoint graph if it is set,
+   * and queries the carla map otherwise.
+   *
+   * \param[in] waypoint The query waypoint.
+   * \param[in] distance The distance to look for the front waypoint.
+   * \return If there is no such front waypoint, \c nullptr is returned.
+   */
+  virtual boost::shared_ptr<CarlaWaypoint> nextWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint, const double distance) const {
+
+    if (waypoint_graph_) {
+      const utils::WaypointGraph::WaypointHandle handle = waypoint_graph_->handle(*waypoint);
+      if (handle != utils::WaypointGraph::kNullHandle) {
+        return waypoint_graph_->waypoint(waypoint_graph_->front(
+              handle, distance, [this](const size_t road) { return hasRoad(road); }));
+      }
+    }
+
+    boost::shared_ptr<CarlaWaypoint> next_waypoint = nullptr;
+    bool next_on_route = false;
+    double next_angle = 0.0;
+    for (const auto& candidate : waypoint->GetNext(distance)) {
+      const bool on_route = hasRoad(candidate->GetRoadId());
+      const double angle = utils::WaypointGraph::yawDifference(
+            waypoint->GetTransform().rotation.yaw,
+            candidate->GetTransform().rotation.yaw);
+      if (!next_waypoint || (on_route && !next_on_route) ||
+          (on_route == next_on_route && angle < next_angle)) {
+        next_waypoint = candidate;
+        next_on_route = on_route;
+        next_angle = angle;
+      }
+    }
+
+    return next_waypoint;
+  }
+
+  /**
+   * \brief Get the left waypoint of the query one.
+   *
+   * The default implementation looks up the waypoint graph if it is set,
+   * and queries the carla map otherwise. Derived classes may look up the
+   * neighbors of the waypoints they have sampled in advance.
+   */
+  virtual boost::shared_ptr<CarlaWaypoint> leftWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
+    if (waypoint_graph_) {
+      const utils::WaypointGraph::WaypointHandle handle = waypoint_graph_->handle(*waypoint);
+      if (handle != utils::WaypointGraph::kNullHandle)
+        return waypoint_graph_->waypoint(waypoint_graph_->left(handle));
+    }
+    return waypoint->GetLeft();
+  }
+
+  /// Same as \c leftWaypoint(), but for the right waypoint.
+  virtual boost::shared_ptr<CarlaWaypoint> rightWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
+    if (waypoint_graph_) {
+      const utils::WaypointGraph::WaypointHandle handle = waypoint_graph_->handle(*waypoint);
+      if (handle != utils::WaypointGraph::kNullHandle)
+        return waypoint_graph_->waypoint(waypoint_graph_->right(handle));
+    }
+    return waypoint->GetRight();
+  }
+
   /**
    * \brief Get the road sequence in the router
    */
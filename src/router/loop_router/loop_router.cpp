@@ -13,6 +13,7 @@
 */
 
 #include <string>
+#include <cmath>
 #include <boost/format.hpp>
 #include <algorithm>
 #include <stdexcept>
@@ -27,6 +28,31 @@ LoopRouter::LoopRouter() :
                   540, 37, 1021, 38, 678, 39, 728, 40, 841, 41, 6, 45, 103,
                   46, 659}){ return; }
 
+LoopRouter::LoopRouter(const std::vector<size_t>& road_sequence) :
+  road_sequence_(road_sequence) {
+  if (road_sequence_.empty()) {
+    throw std::runtime_error(
+        "LoopRouter::LoopRouter(): "
+        "the road sequence should not be empty.\n");
+  }
+  return;
+}
+
+void LoopRouter::buildRouteIndex(
+    const boost::shared_ptr<const CarlaMap>& map, const double resolution) {
+
+  // Sample the lanes from where they start on the route.
+  std::vector<boost::shared_ptr<CarlaWaypoint>> seeds;
+  for (const auto& segment : map->GetTopology()) {
+    if (hasRoad(segment.first->GetRoadId())) seeds.push_back(segment.first);
+  }
+
+  // The index is built with the front waypoints searched on the map.
+  route_index_ = nullptr;
+  route_index_ = boost::make_shared<const RouteIndex>(seeds, *this, resolution);
+  return;
+}
+
 boost::shared_ptr<LoopRouter::CarlaWaypoint> LoopRouter::waypointOnRoute(
     const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
 
@@ -96,11 +122,100 @@ boost::shared_ptr<LoopRouter::CarlaWaypoint> LoopRouter::frontWaypoint(
     throw std::runtime_error(error_msg + waypoint_msg + distance_msg);
   }
 
-  std::vector<boost::shared_ptr<CarlaWaypoint>> candidates = waypoint->GetNext(distance);
+  // Throws if the road of the waypoint is not on the route.
+  nextRoad(waypoint->GetRoadId());
+
+  return tryFrontWaypoint(waypoint, distance);
+}
+
+boost::shared_ptr<LoopRouter::CarlaWaypoint> LoopRouter::tryFrontWaypoint(
+    const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+    const double distance) const {
+
+  if (distance <= 0.0) return nullptr;
+
+  // Find the sampled waypoint right before the front waypoint, and
+  // only search the remaining distance on the map.
+  if (route_index_) {
+    boost::optional<std::pair<boost::shared_ptr<CarlaWaypoint>, double>>
+      front = route_index_->frontWaypoint(waypoint, distance);
+    if (front) {
+      if (front->second < 1.0e-3) return front->first;
+      boost::shared_ptr<CarlaWaypoint> front_waypoint =
+        searchFrontWaypoint(front->first, front->second);
+      if (front_waypoint) return front_waypoint;
+    }
+  }
+
+  return searchFrontWaypoint(waypoint, distance);
+}
+
+boost::optional<std::pair<boost::shared_ptr<LoopRouter::CarlaWaypoint>, double>>
+  LoopRouter::latticeStartWaypoint(
+    const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+    const double resolution) const {
+
+  if (!route_index_) return boost::none;
+
+  // The nodes of the lattice are only on the sampled waypoints if
+  // the resolution of the lattice is a multiple of the index.
+  const double ratio = resolution / route_index_->resolution();
+  if (ratio < 1.0-1.0e-6 || std::fabs(ratio-std::round(ratio)) > 1.0e-6)
+    return boost::none;
+
+  return route_index_->sampledWaypoint(waypoint);
+}
+
+boost::shared_ptr<LoopRouter::CarlaWaypoint> LoopRouter::leftWaypoint(
+    const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
+  if (route_index_) {
+    boost::optional<boost::shared_ptr<CarlaWaypoint>> left =
+      route_index_->leftWaypoint(waypoint);
+    if (left) return *left;
+  }
+  return Router::leftWaypoint(waypoint);
+}
+
+boost::shared_ptr<LoopRouter::CarlaWaypoint> LoopRouter::rightWaypoint(
+    const boost::shared_ptr<const CarlaWaypoint>& waypoint) const {
+  if (route_index_) {
+    boost::optional<boost::shared_ptr<CarlaWaypoint>> right =
+      route_index_->rightWaypoint(waypoint);
+    if (right) return *right;
+  }
+  return Router::rightWaypoint(waypoint);
+}
+
+boost::shared_ptr<LoopRouter::CarlaWaypoint> LoopRouter::searchFrontWaypoint(
+    const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+    const double distance) const {
+
+  if (distance <= 0.0) return nullptr;
+
   const size_t this_road = waypoint->GetRoadId();
+  std::vector<size_t>::const_iterator iter = std::find(
+      road_sequence_.begin(), road_sequence_.end(), this_road);
+  if (iter == road_sequence_.end()) return nullptr;
+
+  const size_t next_road =
+    iter != road_sequence_.end()-1 ? *(iter+1) : road_sequence_.front();
+
+  if (waypoint_graph_) {
+    const utils::WaypointGraph::WaypointHandle handle = waypoint_graph_->handle(*waypoint);
+    if (handle != utils::WaypointGraph::kNullHandle) {
+      // The graph prefers to stay on the same road, then the next road on the route.
+      const utils::WaypointGraph::WaypointHandle front = waypoint_graph_->front(
+          handle, distance, [next_road](const size_t road) { return road == next_road; });
+      if (front == utils::WaypointGraph::kNullHandle) return nullptr;
+
+      boost::shared_ptr<CarlaWaypoint> front_waypoint = waypoint_graph_->waypoint(front);
+      if (front_waypoint->GetRoadId() == this_road ||
+          front_waypoint->GetRoadId() == next_road) return front_waypoint;
+      return nullptr;
+    }
+  }
 
-  boost::optional<size_t> is_next_road = nextRoad(this_road);
-  const size_t next_road = is_next_road ? *is_next_road : -1;
+  std::vector<boost::shared_ptr<CarlaWaypoint>> candidates = waypoint->GetNext(distance);
 
   boost::shared_ptr<CarlaWaypoint> next_waypoint = nullptr;
   for (const auto& candidate : candidates) {
@@ -15,21 +15,29 @@
 #pragma once
 
 #include <vector>
+#include <carla/client/Map.h>
 #include <router/common/router.h>
+#include <router/common/route_index.h>
 
 namespace router {
 
 /**
  * \brief LoopRouter implements a predefined loop router which never ends.
  *
- * For now, the predefined route is the highway loop in the carla map Town04.
+ * By default, the predefined route is the highway loop in the carla map Town04.
  */
 class LoopRouter : public Router {
 
 protected:
 
+  using CarlaMap = carla::client::Map;
+
   std::vector<size_t> road_sequence_;
 
+  /// Lanes sampled along the route, used to find the front waypoints.
+  /// The map is searched directly if this is \c nullptr.
+  boost::shared_ptr<const RouteIndex> route_index_ = nullptr;
+
 public:
 
   /**
@@ -40,9 +48,30 @@ public:
    */
   LoopRouter();
 
+  /**
+   * \brief Constructor with a custom road sequence, e.g. the loop of a
+   *        map other than Town04. The last road is followed by the first.
+   */
+  LoopRouter(const std::vector<size_t>& road_sequence);
+
   /// Destructor of the class.
   ~LoopRouter() { return; }
 
+  /**
+   * \brief Sample the lanes on the route of the given map, so that the front
+   *        waypoints are found on the samples instead of searching the map.
+   *
+   * This should be called before the router is shared with other threads.
+   *
+   * \param[in] map The carla map the route is on.
+   * \param[in] resolution Distance between the sampled waypoints.
+   */
+  void buildRouteIndex(const boost::shared_ptr<const CarlaMap>& map,
+                       const double resolution = 1.0);
+
+  /// Get the route index, which is \c nullptr if it is not built.
+  const boost::shared_ptr<const RouteIndex> routeIndex() const { return route_index_; }
+
   bool hasRoad(const size_t road) const override {
     std::vector<size_t>::const_iterator iter = std::find(
         road_sequence_.begin(), road_sequence_.end(), road);
@@ -66,6 +95,27 @@ public:
       const boost::shared_ptr<const CarlaWaypoint>& waypoint,
       const double distance) const override;
 
+  boost::shared_ptr<CarlaWaypoint> tryFrontWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+      const double distance) const override;
+
+  /**
+   * \brief Find the sampled waypoint of the route index at or right before
+   *        the query waypoint.
+   *
+   * \c boost::none is returned if the route index is not built, or the given
+   * resolution is not a multiple of the resolution of the route index.
+   */
+  boost::optional<std::pair<boost::shared_ptr<CarlaWaypoint>, double>>
+    latticeStartWaypoint(const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+                         const double resolution) const override;
+
+  boost::shared_ptr<CarlaWaypoint> leftWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint) const override;
+
+  boost::shared_ptr<CarlaWaypoint> rightWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint) const override;
+
   /**
    * \brief Get the road sequence in the LoopRouter.
    *
@@ -76,6 +126,13 @@ public:
     return road_sequence_;
   }
 
+protected:
+
+  /// Search the front waypoint on the map, without using the route index.
+  boost::shared_ptr<CarlaWaypoint> searchFrontWaypoint(
+      const boost::shared_ptr<const CarlaWaypoint>& waypoint,
+      const double distance) const;
+
 }; // End class LoopRouter.
 
 } // End namespace router.